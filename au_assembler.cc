@@ -0,0 +1,372 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "au_assembler.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "buffer.h"
+
+namespace easymedia {
+
+static const uint8_t kStartCode[4] = {0, 0, 0, 1};
+// enough for any sane slice header, the slice data is of no interest
+static const size_t kMaxSliceHeaderSize = 4096;
+
+AccessUnitAssembler::AccessUnitAssembler(NalCodec nal_codec)
+    : codec(nal_codec), fps_num(0), fps_den(0), stream_timing(false) {
+  parser = NalParser::Create(codec);
+  Reset();
+}
+
+void AccessUnitAssembler::SetFrameRate(uint32_t num, uint32_t den) {
+  if (num == 0 || den == 0)
+    num = den = 0;
+  fps_num = num;
+  fps_den = den;
+}
+
+void AccessUnitAssembler::Reset() {
+  nal.clear();
+  nal_started = false;
+  nal_checked = false;
+  nal_sc_size = 0;
+  nal_timestamp = 0;
+  tail_len = 0;
+  ResetAccessUnit();
+  au_count = 0;
+  base_valid = false;
+  base_timestamp = 0;
+  timed_count = 0;
+  if (parser)
+    parser->Reset();
+}
+
+void AccessUnitAssembler::ResetAccessUnit() {
+  au.clear();
+  au_timestamp = 0;
+  au_has_vcl = false;
+  au_param_set = false;
+  au_keyframe = false;
+  au_recovery_point = false;
+  au_predicted = false;
+  au_bipredictive = false;
+}
+
+void AccessUnitAssembler::Append(std::vector<Piece> &pieces,
+                                 const std::shared_ptr<MediaBuffer> &holder,
+                                 const uint8_t *ptr, size_t size) {
+  if (size == 0)
+    return;
+  if (!pieces.empty()) {
+    Piece &last = pieces.back();
+    if (last.holder == holder && last.ptr + last.size == ptr) {
+      last.size += size;
+      return;
+    }
+  }
+  pieces.push_back({holder, ptr, size});
+}
+
+void AccessUnitAssembler::StartNal(const std::shared_ptr<MediaBuffer> &holder,
+                                   const uint8_t *sc, size_t sc_size,
+                                   int64_t timestamp) {
+  assert(nal.empty());
+  Append(nal, holder, sc, sc_size);
+  nal_started = true;
+  nal_checked = false;
+  nal_sc_size = sc_size;
+  nal_timestamp = timestamp;
+}
+
+void AccessUnitAssembler::TrimNal(size_t size) {
+  while (size > 0 && !nal.empty()) {
+    Piece &last = nal.back();
+    if (last.size > size) {
+      last.size -= size;
+      return;
+    }
+    size -= last.size;
+    nal.pop_back();
+  }
+}
+
+void AccessUnitAssembler::Push(const std::shared_ptr<MediaBuffer> &chunk,
+                               std::list<std::shared_ptr<MediaBuffer>> &out) {
+  const uint8_t *data = chunk ? (const uint8_t *)chunk->GetPtr() : nullptr;
+  size_t size = chunk ? chunk->GetValidSize() : 0;
+  if (data && size > 0) {
+    int64_t ts = chunk->GetTimeStamp();
+    size_t cur = 0;
+    // a start code whose 01 is in this chunk but begins in the former data
+    if (tail_len > 0) {
+      uint8_t t[6];
+      size_t n = std::min<size_t>(size, 3);
+      memcpy(t, tail, tail_len);
+      memcpy(t + tail_len, data, n);
+      positions.clear();
+      FindAllStartCodes(t, tail_len + n, positions);
+      for (auto &p : positions) {
+        if (p.offset >= tail_len || p.offset + p.size <= tail_len)
+          continue;
+        if (nal_started)
+          TrimNal(tail_len - p.offset);
+        FinishNal(out);
+        StartNal(nullptr, kStartCode + 4 - p.size, p.size, ts);
+        cur = p.offset + p.size - tail_len;
+        break;
+      }
+    }
+    size_t base = cur;
+    positions.clear();
+    FindAllStartCodes(data + base, size - base, positions);
+    for (auto &p : positions) {
+      size_t offset = base + p.offset;
+      if (nal_started)
+        Append(nal, chunk, data + cur, offset - cur);
+      FinishNal(out);
+      StartNal(chunk, data + offset, p.size, ts);
+      cur = offset + p.size;
+    }
+    if (nal_started) {
+      Append(nal, chunk, data + cur, size - cur);
+      if (!nal_checked)
+        CheckBoundary(out, false);
+    }
+    // keep the last 3 bytes
+    if (size >= 3) {
+      memcpy(tail, data + size - 3, 3);
+      tail_len = 3;
+    } else {
+      size_t keep = std::min<size_t>(tail_len, 3 - size);
+      memmove(tail, tail + tail_len - keep, keep);
+      memcpy(tail + keep, data, size);
+      tail_len = keep + size;
+    }
+  }
+  if (chunk && chunk->IsEOF())
+    Flush(out);
+}
+
+void AccessUnitAssembler::Flush(std::list<std::shared_ptr<MediaBuffer>> &out) {
+  FinishNal(out);
+  EmitAccessUnit(out);
+  tail_len = 0;
+}
+
+static inline bool h264_begin_access_unit(int type) {
+  // aud, sps, pps, sei, 14..18
+  return (type >= 6 && type <= 9) || (type >= 14 && type <= 18);
+}
+
+static inline bool h265_begin_access_unit(int type) {
+  // vps, sps, pps, aud, prefix sei, 41..44, 48..55
+  return (type >= 32 && type <= 35) || type == 39 ||
+         (type >= 41 && type <= 44) || (type >= 48 && type <= 55);
+}
+
+size_t AccessUnitAssembler::CopyPayload(uint8_t *dst, size_t max) const {
+  size_t skip = nal_sc_size, copied = 0;
+  for (auto &p : nal) {
+    if (skip >= p.size) {
+      skip -= p.size;
+      continue;
+    }
+    size_t s = std::min(p.size - skip, max - copied);
+    memcpy(dst + copied, p.ptr + skip, s);
+    copied += s;
+    skip = 0;
+    if (copied == max)
+      break;
+  }
+  return copied;
+}
+
+// The boundary only needs the first 3 bytes of a nal unit, so the former
+// access unit goes out as soon as the next one shows up, without waiting
+// for the end of its first nal unit.
+void AccessUnitAssembler::CheckBoundary(
+    std::list<std::shared_ptr<MediaBuffer>> &out, bool nal_end) {
+  uint8_t head[3];
+  size_t len = CopyPayload(head, sizeof(head));
+  if (len < sizeof(head) && !nal_end)
+    return;
+  nal_checked = true;
+  bool begin = false;
+  if (len == 0) {
+    return;
+  } else if (codec == NalCodec::H264) {
+    int type = head[0] & 0x1F;
+    if (type == 1 || type == 2 || type == 5)
+      // first_mb_in_slice ue(v) is 0 iff its first bit is 1
+      begin = (len > 1 && (head[1] & 0x80));
+    else
+      begin = h264_begin_access_unit(type);
+  } else if (len >= 2 && !(head[0] & 1) && !(head[1] & 0xF8)) {
+    // only the nal units of nuh_layer_id 0 decide
+    int type = (head[0] >> 1) & 0x3F;
+    if (type < 32)
+      // first_slice_segment_in_pic_flag
+      begin = (len > 2 && (head[2] & 0x80));
+    else
+      begin = h265_begin_access_unit(type);
+  }
+  if (begin && au_has_vcl)
+    EmitAccessUnit(out);
+}
+
+void AccessUnitAssembler::FinishNal(
+    std::list<std::shared_ptr<MediaBuffer>> &out) {
+  if (!nal_started)
+    return;
+  size_t total = 0;
+  for (auto &p : nal)
+    total += p.size;
+  // drop the empty one, such as 00 00 01 00 00 01
+  if (total <= nal_sc_size) {
+    nal.clear();
+    nal_started = false;
+    return;
+  }
+  if (!nal_checked)
+    CheckBoundary(out, true);
+  const uint8_t *payload;
+  size_t len = total - nal_sc_size;
+  if (nal.size() == 1) {
+    payload = nal[0].ptr + nal_sc_size;
+  } else {
+    // crossing chunks, gather the bytes to parse
+    uint8_t first;
+    CopyPayload(&first, 1);
+    bool slice = (codec == NalCodec::H264) ? ((first & 0x1F) <= 5)
+                                           : (((first >> 1) & 0x3F) < 32);
+    if (slice)
+      len = std::min(len, kMaxSliceHeaderSize);
+    scratch.resize(len);
+    CopyPayload(scratch.data(), len);
+    payload = scratch.data();
+  }
+  NalUnitInfo info;
+  parser->Parse(payload, len, info);
+
+  if (au.empty())
+    au_timestamp = nal_timestamp;
+  for (auto &p : nal)
+    Append(au, p.holder, p.ptr, p.size);
+  nal.clear();
+  nal_started = false;
+
+  if (info.vcl && info.layer_id == 0) {
+    au_has_vcl = true;
+    if (info.keyframe)
+      au_keyframe = true;
+    else if (info.slice_type == SliceType::B)
+      au_bipredictive = true;
+    else if (info.slice_type == SliceType::P ||
+             info.slice_type == SliceType::SP)
+      au_predicted = true;
+  } else {
+    if (GetNalUnitFlag(info) & MediaBuffer::kExtraIntra)
+      au_param_set = true;
+    if (info.recovery_point)
+      au_recovery_point = true;
+  }
+}
+
+bool AccessUnitAssembler::GetFrameRate(uint32_t &num, uint32_t &den) const {
+  if (fps_num > 0) {
+    num = fps_num;
+    den = fps_den;
+    return true;
+  }
+  StreamInfo si;
+  if (stream_timing && parser->GetStreamInfo(si) && si.fps_num > 0 &&
+      si.fps_den > 0) {
+    num = si.fps_num;
+    den = si.fps_den;
+    return true;
+  }
+  return false;
+}
+
+void AccessUnitAssembler::EmitAccessUnit(
+    std::list<std::shared_ptr<MediaBuffer>> &out) {
+  if (au.empty())
+    return;
+  size_t total = 0;
+  for (auto &p : au)
+    total += p.size;
+  std::shared_ptr<MediaBuffer> buffer;
+  if (au.size() == 1 && au[0].holder) {
+    // a view of the chunk, keeping it alive
+    buffer = std::make_shared<MediaBuffer>((void *)au[0].ptr, total);
+    if (buffer)
+      buffer->SetUserData(au[0].holder);
+  } else {
+    buffer = MediaBuffer::Alloc(total, MediaBuffer::MemType::MEM_COMMON,
+                                "au_assembler");
+    if (buffer) {
+      uint8_t *dst = (uint8_t *)buffer->GetPtr();
+      for (auto &p : au) {
+        memcpy(dst, p.ptr, p.size);
+        dst += p.size;
+      }
+    }
+  }
+  if (!buffer) {
+    LOG_NO_MEMORY();
+    ResetAccessUnit();
+    return;
+  }
+  buffer->SetValidSize(total);
+  buffer->SetType(Type::Video);
+  uint32_t flag = 0;
+  if (au_keyframe ||
+      (au_recovery_point && au_has_vcl && !au_predicted && !au_bipredictive))
+    flag = MediaBuffer::kIntra;
+  else if (au_bipredictive)
+    flag = MediaBuffer::kBiPredictive;
+  else if (au_predicted)
+    flag = MediaBuffer::kPredicted;
+  if (au_param_set)
+    flag |= MediaBuffer::kExtraIntra;
+  buffer->SetUserFlag(flag);
+  int64_t ts = au_timestamp;
+  uint32_t num, den;
+  if (GetFrameRate(num, den)) {
+    if (!base_valid) {
+      base_valid = true;
+      base_timestamp = au_timestamp;
+      timed_count = 0;
+    }
+    ts = base_timestamp + timed_count * 1000 * den / num;
+    timed_count++;
+  }
+  buffer->SetTimeStamp(ts);
+  au_count++;
+  out.push_back(buffer);
+  ResetAccessUnit();
+}
+
+} // namespace easymedia
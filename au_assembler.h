@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_AU_ASSEMBLER_H_
+#define EASYMEDIA_AU_ASSEMBLER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "h26x_parser.h"
+#include "startcode.h"
+#include "utils.h"
+
+namespace easymedia {
+
+class MediaBuffer;
+
+// Cut an Annex-B elementary stream, pushed as chunks of any size, into
+// access units. The boundaries come from the access unit delimiters,
+// parameter sets and sei, and from first_mb_in_slice of h264 or
+// first_slice_segment_in_pic_flag of h265 (7.4.1.2.3 of h264,
+// 7.4.2.4.4 of h265).
+// An access unit which lies in one chunk is output as a view of that chunk,
+// which holds the chunk; only the ones crossing chunks are copied.
+// The user flag of an output is kIntra for the idr/irap pictures and the
+// intra pictures with a recovery point sei, else kBiPredictive or
+// kPredicted by the slice types; kExtraIntra is or-ed in if it carries
+// parameter sets.
+class _API AccessUnitAssembler {
+public:
+  AccessUnitAssembler(NalCodec nal_codec);
+  ~AccessUnitAssembler() = default;
+
+  // Timestamps of the outputs, in milliseconds:
+  //  1. if the frame rate is set, counted from the first access unit;
+  //  2. else if stream timing is enabled and the sps has the timing info,
+  //     counted the same way by the signalled frame rate;
+  //  3. else the timestamp of the chunk where the access unit begins.
+  // Counted timestamps are in decoding order.
+  void SetFrameRate(uint32_t num, uint32_t den);
+  void UseStreamTiming(bool enable) { stream_timing = enable; }
+
+  // Feed a chunk, the valid data of which is the stream. The completed
+  // access units are appended to out. An eof chunk flushes the pending one.
+  void Push(const std::shared_ptr<MediaBuffer> &chunk,
+            std::list<std::shared_ptr<MediaBuffer>> &out);
+  // Output the pending access unit at the end of the stream. The next push
+  // starts a new stream, but keeps the parameter sets.
+  void Flush(std::list<std::shared_ptr<MediaBuffer>> &out);
+  // Drop all pending data and states.
+  void Reset();
+
+  NalCodec GetCodec() const { return codec; }
+  const NalParser *GetParser() const { return parser.get(); }
+  int64_t GetOutputCount() const { return au_count; }
+
+private:
+  // a piece of stream bytes, the holder is null for static memory
+  struct Piece {
+    std::shared_ptr<MediaBuffer> holder;
+    const uint8_t *ptr;
+    size_t size;
+  };
+  static void Append(std::vector<Piece> &pieces,
+                     const std::shared_ptr<MediaBuffer> &holder,
+                     const uint8_t *ptr, size_t size);
+  void StartNal(const std::shared_ptr<MediaBuffer> &holder, const uint8_t *sc,
+                size_t sc_size, int64_t timestamp);
+  void TrimNal(size_t size);
+  size_t CopyPayload(uint8_t *dst, size_t max) const;
+  void CheckBoundary(std::list<std::shared_ptr<MediaBuffer>> &out,
+                     bool nal_end);
+  void FinishNal(std::list<std::shared_ptr<MediaBuffer>> &out);
+  void EmitAccessUnit(std::list<std::shared_ptr<MediaBuffer>> &out);
+  void ResetAccessUnit();
+  bool GetFrameRate(uint32_t &num, uint32_t &den) const;
+
+  NalCodec codec;
+  std::shared_ptr<NalParser> parser;
+  uint32_t fps_num;
+  uint32_t fps_den;
+  bool stream_timing;
+
+  // the nal unit being received, with its start code
+  std::vector<Piece> nal;
+  bool nal_started;
+  bool nal_checked; // whether it has been checked to begin an access unit
+  size_t nal_sc_size;
+  int64_t nal_timestamp;
+  // the last bytes of the stream, for the start codes crossing chunks
+  uint8_t tail[3];
+  size_t tail_len;
+  std::vector<StartCodePos> positions;
+  std::vector<uint8_t> scratch;
+
+  // the access unit being assembled, of complete nal units
+  std::vector<Piece> au;
+  int64_t au_timestamp;
+  bool au_has_vcl;
+  bool au_param_set;
+  bool au_keyframe;
+  bool au_recovery_point;
+  bool au_predicted;
+  bool au_bipredictive;
+
+  int64_t au_count;
+  // for the counted timestamps
+  bool base_valid;
+  int64_t base_timestamp;
+  int64_t timed_count;
+};
+
+} // namespace easymedia
+
+#endif // EASYMEDIA_AU_ASSEMBLER_H_
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_BIT_READER_H_
+#define EASYMEDIA_BIT_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace easymedia {
+
+// Read the rbsp of a h264/h265 nal unit bit by bit. The emulation prevention
+// bytes (00 00 03) are dropped on the fly, so no unescaped copy is needed.
+// Reading over the end gives zero bits and sets the error flag, callers
+// check Error() once after a whole syntax structure.
+class BitReader {
+public:
+  BitReader(const uint8_t *data, size_t size, bool has_escape = true)
+      : p(data), end(data + size), cache(0), cache_bits(0), zeros(0),
+        pos(0), escaped(has_escape), error(false), stop_bits(0) {
+    // the rbsp stop bit is the lowest set bit of the last non zero byte
+    while (end > p && !end[-1])
+      end--;
+    if (end > p)
+      stop_bits = __builtin_ctz(end[-1]) + 1;
+  }
+
+  uint32_t ReadBits(int n) {
+    if (n <= 0)
+      return 0;
+    if (cache_bits < n)
+      Refill();
+    if (cache_bits < n) {
+      error = true;
+      uint32_t v = cache_bits ? (uint32_t)(cache >> (64 - n)) : 0;
+      pos += cache_bits;
+      cache = 0;
+      cache_bits = 0;
+      return v;
+    }
+    uint32_t v = (uint32_t)(cache >> (64 - n));
+    cache <<= n;
+    cache_bits -= n;
+    pos += n;
+    return v;
+  }
+  uint32_t ReadBit() { return ReadBits(1); }
+  bool ReadFlag() { return ReadBits(1) != 0; }
+  void SkipBits(size_t n) {
+    for (; n > 32; n -= 32)
+      ReadBits(32);
+    ReadBits((int)n);
+  }
+  void SkipBytes(size_t n) { SkipBits(n * 8); }
+
+  // ue(v), up to 32 bits value
+  uint32_t ReadUE() {
+    if (cache_bits < 32)
+      Refill();
+    int lz = cache ? __builtin_clzll(cache) : 64;
+    if (lz < 32 && 2 * lz + 1 <= cache_bits) {
+      // fast path, the whole code is in the cache
+      uint32_t v = (uint32_t)(cache >> (64 - (2 * lz + 1))) - 1;
+      cache <<= 2 * lz + 1;
+      cache_bits -= 2 * lz + 1;
+      pos += 2 * lz + 1;
+      return v;
+    }
+    lz = 0;
+    while (!ReadBit()) {
+      if (error || ++lz > 31) {
+        error = true;
+        return 0;
+      }
+    }
+    return (uint32_t)(((uint64_t)1 << lz) - 1 + ReadBits(lz));
+  }
+  // se(v)
+  int32_t ReadSE() {
+    uint32_t v = ReadUE();
+    return (v & 1) ? (int32_t)((v >> 1) + 1) : -(int32_t)(v >> 1);
+  }
+
+  bool Error() const { return error; }
+  // the number of rbsp bits read
+  size_t BitPosition() const { return pos; }
+  bool ByteAligned() const { return !(pos & 7); }
+  void ByteAlign() { ReadBits((8 - (pos & 7)) & 7); }
+  // more_rbsp_data() of the spec
+  bool MoreRbspData() const {
+    // escaped bytes never appear just before the stop bit
+    return (size_t)cache_bits + (size_t)(end - p) * 8 > stop_bits;
+  }
+
+private:
+  void Refill() {
+    while (cache_bits <= 56 && p < end) {
+      uint8_t b = *p++;
+      if (escaped && zeros >= 2 && b == 3) {
+        zeros = 0;
+        continue;
+      }
+      zeros = b ? 0 : zeros + 1;
+      cache |= (uint64_t)b << (56 - cache_bits);
+      cache_bits += 8;
+    }
+  }
+
+  const uint8_t *p;
+  const uint8_t *end;
+  uint64_t cache; // msb first
+  int cache_bits;
+  int zeros;
+  size_t pos;
+  bool escaped;
+  bool error;
+  size_t stop_bits;
+};
+
+} // namespace easymedia
+
+#endif // EASYMEDIA_BIT_READER_H_
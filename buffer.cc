@@ -22,11 +22,19 @@
 #include "buffer.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <linux/dma-buf.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <mutex>
+
+#include "buffer_census.h"
+#include "buffer_copy.h"
 #include "key_string.h"
 #include "utils.h"
 
@@ -63,13 +71,14 @@ static MediaBuffer alloc_common_memory(size_t size) {
 
 #ifdef LIBION
 #include <ion/ion.h>
-class IonBuffer {
+class IonBuffer : public BufferMapper {
 public:
   IonBuffer(int param_client, ion_user_handle_t param_handle, int param_fd,
-            void *param_map_ptr, size_t param_len)
+            size_t param_len)
       : client(param_client), handle(param_handle), fd(param_fd),
-        map_ptr(param_map_ptr), len(param_len) {}
-  ~IonBuffer();
+        map_ptr(nullptr), len(param_len) {}
+  virtual ~IonBuffer();
+  virtual void *Map() override;
 
 private:
   int client;
@@ -77,6 +86,7 @@ private:
   int fd;
   void *map_ptr;
   size_t len;
+  std::mutex mtx;
 };
 
 IonBuffer::~IonBuffer() {
@@ -94,6 +104,20 @@ IonBuffer::~IonBuffer() {
   ion_close(client);
 }
 
+void *IonBuffer::Map() {
+  std::lock_guard<std::mutex> _lg(mtx);
+  if (map_ptr)
+    return map_ptr;
+  void *ptr =
+      mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd, 0);
+  if (ptr == MAP_FAILED) {
+    LOG("ion mmap() failed: %m\n");
+    return nullptr;
+  }
+  map_ptr = ptr;
+  return map_ptr;
+}
+
 static int free_ion_memory(void *buffer) {
   assert(buffer);
   IonBuffer *ion_buffer = static_cast<IonBuffer *>(buffer);
@@ -105,7 +129,6 @@ static MediaBuffer alloc_ion_memory(size_t size) {
   ion_user_handle_t handle;
   int ret;
   int fd;
-  void *ptr;
   IonBuffer *buffer;
   int client = ion_open();
   if (client < 0) {
@@ -125,25 +148,19 @@ static MediaBuffer alloc_ion_memory(size_t size) {
     ion_close(client);
     goto err;
   }
-  ptr =
-      mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd, 0);
-  if (!ptr) {
-    LOG("ion mmap() failed: %m\n");
-    ion_free(client, handle);
-    ion_close(client);
-    close(fd);
-    goto err;
-  }
-  buffer = new IonBuffer(client, handle, fd, ptr, size);
+  // mapped to cpu on demand
+  buffer = new IonBuffer(client, handle, fd, size);
   if (!buffer) {
     ion_free(client, handle);
     ion_close(client);
     close(fd);
-    munmap(ptr, size);
     goto err;
   }
-
-  return MediaBuffer(ptr, size, fd, buffer, free_ion_memory);
+  {
+    MediaBuffer mb(nullptr, size, fd, buffer, free_ion_memory);
+    mb.SetMapper(std::shared_ptr<BufferMapper>(mb.GetUserData(), buffer));
+    return mb;
+  }
 err:
   return MediaBuffer();
 }
@@ -251,7 +268,7 @@ public:
   int fd;
 };
 
-class DrmBuffer {
+class DrmBuffer : public BufferMapper {
 public:
   DrmBuffer(std::shared_ptr<DrmDevice> dev, size_t s, __u32 flags = 0)
       : device(dev), handle(0), len(UPALIGNTO(s, PAGE_SIZE)), fd(-1),
@@ -279,7 +296,7 @@ public:
     }
     assert(fd >= 0);
   }
-  ~DrmBuffer() {
+  virtual ~DrmBuffer() {
     if (map_ptr)
       drm_munmap(map_ptr, len);
     int ret;
@@ -318,12 +335,19 @@ public:
     return true;
   }
   bool Valid() { return fd >= 0; }
+  virtual void *Map() override {
+    std::lock_guard<std::mutex> _lg(mtx);
+    if (!map_ptr && !MapToVirtual())
+      return nullptr;
+    return map_ptr;
+  }
 
   std::shared_ptr<DrmDevice> device;
   __u32 handle;
   size_t len;
   int fd;
   void *map_ptr;
+  std::mutex mtx;
 };
 
 static int free_drm_memory(void *buffer) {
@@ -332,7 +356,8 @@ static int free_drm_memory(void *buffer) {
   return 0;
 }
 
-static MediaBuffer alloc_drm_memory(size_t size, bool map = true) {
+// Not mapped by default, most hardware buffers are never touched by cpu.
+static MediaBuffer alloc_drm_memory(size_t size, bool map = false) {
   static auto drm_dev = std::make_shared<DrmDevice>();
   DrmBuffer *db = nullptr;
   do {
@@ -341,9 +366,11 @@ static MediaBuffer alloc_drm_memory(size_t size, bool map = true) {
     db = new DrmBuffer(drm_dev, size);
     if (!db || !db->Valid())
       break;
-    if (map && !db->MapToVirtual())
+    if (map && !db->Map())
       break;
-    return MediaBuffer(db->map_ptr, db->len, db->fd, db, free_drm_memory);
+    MediaBuffer mb(db->map_ptr, db->len, db->fd, db, free_drm_memory);
+    mb.SetMapper(std::shared_ptr<BufferMapper>(mb.GetUserData(), db));
+    return mb;
   } while (false);
   if (db)
     delete db;
@@ -351,49 +378,223 @@ static MediaBuffer alloc_drm_memory(size_t size, bool map = true) {
 }
 #endif
 
-std::shared_ptr<MediaBuffer> MediaBuffer::Alloc(size_t size, MemType type) {
-  MediaBuffer &&mb = Alloc2(size, type);
+std::shared_ptr<MediaBuffer> MediaBuffer::Alloc(size_t size, MemType type,
+                                                const char *tag) {
+  MediaBuffer &&mb = Alloc2(size, type, tag);
   if (mb.GetSize() == 0)
     return nullptr;
   return std::make_shared<MediaBuffer>(mb);
 }
 
-MediaBuffer MediaBuffer::Alloc2(size_t size, MemType type) {
+MediaBuffer MediaBuffer::Alloc2(size_t size, MemType type, const char *tag) {
+  MediaBuffer mb;
   switch (type) {
   case MemType::MEM_COMMON:
-    return alloc_common_memory(size);
+    mb = alloc_common_memory(size);
+    break;
 #ifdef LIBION
   case MemType::MEM_ION:
-    return alloc_ion_memory(size);
+    mb = alloc_ion_memory(size);
+    break;
 #endif
 #ifdef LIBDRM
   case MemType::MEM_DRM:
-    return alloc_drm_memory(size);
+    mb = alloc_drm_memory(size);
+    break;
 #endif
   default:
     LOG("unknown memtype\n");
     return MediaBuffer();
   }
+  if (mb.GetSize() > 0)
+    CensusTrack(mb, tag, type);
+  return mb;
 }
 
 std::shared_ptr<MediaBuffer> MediaBuffer::Clone(MediaBuffer &src,
-                                                MemType dst_type) {
+                                                MemType dst_type,
+                                                const char *tag) {
   size_t size = src.GetValidSize();
   if (!size)
     return nullptr;
-  auto new_buffer = Alloc(size, dst_type);
+  auto new_buffer = Alloc(size, dst_type, tag ? tag : "clone");
   if (!new_buffer) {
     LOG_NO_MEMORY();
     return nullptr;
   }
-  if (src.IsHwBuffer() && new_buffer->IsHwBuffer())
-    LOG_TODO(); // TODO: fd -> fd by RGA
-  memcpy(new_buffer->GetPtr(), src.GetPtr(), size);
+  // fd -> fd by the registered backend, or cpu copy picked by size/memtype
+  if (CopyMediaBuffer(*new_buffer, src, size)) {
+    LOG("fail to copy buffer of size %d\n", (int)size);
+    return nullptr;
+  }
   new_buffer->SetValidSize(size);
   new_buffer->CopyAttribute(src);
   return new_buffer;
 }
 
+void *MediaBuffer::MapPtr() const {
+  if (!mapper)
+    return nullptr;
+  ptr = mapper->Map();
+  return ptr;
+}
+
+static int dma_buf_sync(int fd, uint64_t flags) {
+  if (fd < 0)
+    return 0;
+  struct dma_buf_sync sync;
+  sync.flags = flags;
+  int ret;
+  do {
+    ret = ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+  } while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+  if (ret < 0) {
+    // not a dma buffer, nothing to sync
+    if (errno == ENOTTY || errno == EINVAL)
+      return 0;
+    LOG("DMA_BUF_IOCTL_SYNC failed on fd %d: %m\n", fd);
+    return -errno;
+  }
+  return 0;
+}
+
+static uint64_t dma_buf_sync_flags(bool read, bool write) {
+  uint64_t flags = 0;
+  if (read)
+    flags |= DMA_BUF_SYNC_READ;
+  if (write)
+    flags |= DMA_BUF_SYNC_WRITE;
+  return flags;
+}
+
+int MediaBuffer::BeginCPUAccess(bool read, bool write) {
+  return dma_buf_sync(fd, DMA_BUF_SYNC_START | dma_buf_sync_flags(read, write));
+}
+
+int MediaBuffer::EndCPUAccess(bool read, bool write) {
+  return dma_buf_sync(fd, DMA_BUF_SYNC_END | dma_buf_sync_flags(read, write));
+}
+
+void ImageBuffer::SetPlanes(const ImagePlane *planes, int num) {
+  assert(num >= 0 && num <= IMAGE_MAX_PLANES);
+  ClearPlanes();
+  plane_num = num;
+  if (num <= 0)
+    return;
+  memcpy(image_planes, planes, num * sizeof(*planes));
+  int s = CalPixFmtSize(image_info, planes, num);
+  if (s > 0)
+    SetValidSize(s);
+}
+
+int ImageBuffer::GetPlanes(ImagePlane planes[IMAGE_MAX_PLANES]) const {
+  if (plane_num > 0) {
+    memcpy(planes, image_planes, plane_num * sizeof(*planes));
+    return plane_num;
+  }
+  return GetImagePlanes(image_info, planes);
+}
+
+int ImageBuffer::GetPlanePtrs(uint8_t *data[IMAGE_MAX_PLANES]) {
+  ImagePlane planes[IMAGE_MAX_PLANES];
+  int num = GetPlanes(planes);
+  for (int i = 0; i < num; i++) {
+    const ImagePlane &p = planes[i];
+    if (p.fd < 0) {
+      if (!GetPtr())
+        return 0;
+      data[i] = (uint8_t *)GetPtr() + p.offset;
+      continue;
+    }
+    if (!plane_maps[i]) {
+      size_t len = (size_t)p.offset + (size_t)p.stride * p.rows;
+      void *addr =
+          mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, p.fd, 0);
+      if (addr == MAP_FAILED) {
+        LOG("mmap plane %d of fd %d failed: %m\n", i, p.fd);
+        return 0;
+      }
+      plane_maps[i].reset(addr, [len](void *a) { munmap(a, len); });
+    }
+    data[i] = (uint8_t *)plane_maps[i].get() + p.offset;
+  }
+  return num;
+}
+
+bool ImageBuffer::CopyPlanesFrom(ImageBuffer &src) {
+  ImagePlane dp[IMAGE_MAX_PLANES], sp[IMAGE_MAX_PLANES];
+  uint8_t *dd[IMAGE_MAX_PLANES], *sd[IMAGE_MAX_PLANES];
+  int num = GetPlanes(dp);
+  if (src.GetPixelFormat() != GetPixelFormat() ||
+      src.GetWidth() != GetWidth() || src.GetHeight() != GetHeight() ||
+      num <= 0 || src.GetPlanes(sp) != num || GetPlanePtrs(dd) != num ||
+      src.GetPlanePtrs(sd) != num)
+    return false;
+  src.BeginCPUAccess(true, false);
+  BeginCPUAccess(false, true);
+  for (int i = 0; i < num; i++) {
+    int rows = std::min(dp[i].rows, sp[i].rows);
+    int bytes = std::min(dp[i].row_bytes, sp[i].row_bytes);
+    for (int r = 0; r < rows; r++)
+      memcpy(dd[i] + (size_t)r * dp[i].stride,
+             sd[i] + (size_t)r * sp[i].stride, bytes);
+  }
+  EndCPUAccess(false, true);
+  src.EndCPUAccess(true, false);
+  return true;
+}
+
+std::shared_ptr<ImageBuffer> ImageBuffer::PackedCopy(MemType mem_type) {
+  ImageInfo info = image_info;
+  info.vir_width = UPALIGNTO16(info.width);
+  info.vir_height = UPALIGNTO16(info.height);
+  int packed_size = CalPixFmtSize(info);
+  if (packed_size <= 0)
+    return nullptr;
+  auto mb = MediaBuffer::Alloc(packed_size, mem_type, "packed_image");
+  if (!mb)
+    return nullptr;
+  auto ib = std::make_shared<ImageBuffer>(*mb, info);
+  if (!ib || !ib->CopyPlanesFrom(*this))
+    return nullptr;
+  ib->SetTimeStamp(GetTimeStamp());
+  return ib;
+}
+
+std::shared_ptr<ImageBuffer>
+ImageBuffer::CropView(const std::shared_ptr<ImageBuffer> &src,
+                      const ImageRect &rect) {
+  if (!src || !src->IsValid())
+    return nullptr;
+  ImagePlane planes[IMAGE_MAX_PLANES], crop[IMAGE_MAX_PLANES];
+  int num = src->GetPlanes(planes);
+  if (num <= 0 ||
+      GetCropPlanes(src->image_info, planes, num, rect, crop) <= 0) {
+    LOG("invalid crop (%d,%d,%d,%d) of %dx%d %s\n", rect.x, rect.y, rect.w,
+        rect.h, src->GetWidth(), src->GetHeight(),
+        PixFmtToString(src->GetPixelFormat()));
+    return nullptr;
+  }
+  auto view = std::make_shared<ImageBuffer>(*src);
+  if (!view)
+    return nullptr;
+  view->image_info.width = rect.w;
+  view->image_info.height = rect.h;
+  view->SetPlanes(crop, num);
+  // the last row of the crop ends before the stride does, which may be
+  // beyond the buffer for a crop at the right bottom
+  size_t end = 0;
+  for (int i = 0; i < num; i++) {
+    if (crop[i].fd < 0)
+      end = std::max(end, (size_t)crop[i].offset +
+                              (size_t)crop[i].stride * (crop[i].rows - 1) +
+                              crop[i].row_bytes);
+  }
+  view->SetValidSize(end);
+  view->SetRelatedSPtr(src);
+  return view;
+}
+
 void MediaBuffer::CopyAttribute(MediaBuffer &src_attr) {
   type = src_attr.GetType();
   user_flag = src_attr.GetUserFlag();
@@ -36,6 +36,15 @@ typedef int (*DeleteFun)(void *arg);
 
 namespace easymedia {
 
+// Map the memory to cpu on demand, such as the hardware buffers which are
+// seldom touched by cpu. The mapping is cached till the memory is freed.
+class _API BufferMapper {
+public:
+  virtual ~BufferMapper() = default;
+  // return nullptr if fail
+  virtual void *Map() = 0;
+};
+
 // wrapping existing buffer
 class _API MediaBuffer {
 public:
@@ -61,7 +70,8 @@ public:
   virtual SampleFormat GetSampleFormat() const { return SAMPLE_FMT_NONE; }
   int GetFD() const { return fd; }
   void SetFD(int new_fd) { fd = new_fd; }
-  void *GetPtr() const { return ptr; }
+  // For the lazily mapped buffer, the first call maps it.
+  void *GetPtr() const { return ptr ? ptr : MapPtr(); }
   void SetPtr(void *addr) { ptr = addr; }
   size_t GetSize() const { return size; }
   void SetSize(size_t s) { size = s; }
@@ -83,7 +93,9 @@ public:
   bool IsEOF() const { return eof; }
   void SetEOF(bool val) { eof = val; }
 
+  // The new user data means new memory, drop the mapper of the old one.
   void SetUserData(void *user_data, DeleteFun df) {
+    mapper.reset();
     if (user_data) {
       if (df)
         userdata.reset(user_data, df);
@@ -93,7 +105,18 @@ public:
       userdata.reset();
     }
   }
-  void SetUserData(std::shared_ptr<void> user_data) { userdata = user_data; }
+  void SetUserData(std::shared_ptr<void> user_data) {
+    mapper.reset();
+    userdata = user_data;
+  }
+  void SetMapper(std::shared_ptr<BufferMapper> m) { mapper = m; }
+  // Whether the cpu address is available without mapping.
+  bool IsMapped() const { return ptr != nullptr; }
+
+  // Bracket the cpu access of a dma buffer, which drives the cache
+  // maintenance by DMA_BUF_IOCTL_SYNC. Do nothing for the common memory.
+  int BeginCPUAccess(bool read = true, bool write = true);
+  int EndCPUAccess(bool read = true, bool write = true);
   std::shared_ptr<void> GetUserData() { return userdata; }
 
   void SetRelatedSPtr(const std::shared_ptr<void> &rdata, int index = -1) {
@@ -109,6 +132,12 @@ public:
     return related_sptrs;
   }
 
+  // see buffer_census.h
+  void SetCensusEntry(const std::shared_ptr<void> &entry) {
+    census_entry = entry;
+  }
+  const std::shared_ptr<void> &GetCensusEntry() const { return census_entry; }
+
   bool IsValid() { return valid_size > 0; }
   bool IsHwBuffer() { return fd >= 0; }
 
@@ -123,17 +152,22 @@ public:
     MEM_HARD_WARE = MEM_DRM,
 #endif
   };
+  // tag: the allocation site shown by buffer census, must be a static string
   static std::shared_ptr<MediaBuffer> Alloc(size_t size,
-                                            MemType type = MemType::MEM_COMMON);
-  static MediaBuffer Alloc2(size_t size, MemType type = MemType::MEM_COMMON);
+                                            MemType type = MemType::MEM_COMMON,
+                                            const char *tag = nullptr);
+  static MediaBuffer Alloc2(size_t size, MemType type = MemType::MEM_COMMON,
+                            const char *tag = nullptr);
   static std::shared_ptr<MediaBuffer>
-  Clone(MediaBuffer &src, MemType dst_type = MemType::MEM_COMMON);
+  Clone(MediaBuffer &src, MemType dst_type = MemType::MEM_COMMON,
+        const char *tag = nullptr);
 
 private:
   // copy attributs except buffer
   void CopyAttribute(MediaBuffer &src_attr);
+  void *MapPtr() const;
 
-  void *ptr; // buffer virtual address
+  mutable void *ptr; // buffer virtual address, may be mapped lazily
   size_t size;
   int fd;            // buffer fd
   size_t valid_size; // valid data size, less than above size
@@ -144,9 +178,11 @@ private:
 
   std::shared_ptr<void> userdata;
   std::vector<std::shared_ptr<void>> related_sptrs;
+  std::shared_ptr<void> census_entry;
+  std::shared_ptr<BufferMapper> mapper;
 };
 
-MediaBuffer::MemType StringToMemType(const char *s);
+_API MediaBuffer::MemType StringToMemType(const char *s);
 
 // Audio sample buffer
 class _API SampleBuffer : public MediaBuffer {
@@ -180,7 +216,7 @@ public:
     ResetValues();
   }
   ImageBuffer(const MediaBuffer &buffer, const ImageInfo &info)
-      : MediaBuffer(buffer), image_info(info) {
+      : MediaBuffer(buffer), image_info(info), plane_num(0) {
     SetType(Type::Image);
     // if set a valid info, set valid size
     size_t s = CalPixFmtSize(info);
@@ -197,13 +233,49 @@ public:
   int GetVirHeight() const { return image_info.vir_height; }
   ImageInfo &GetImageInfo() { return image_info; }
 
+  // Explicit layout of the planes, for the ones not tightly packed by
+  // vir_width/vir_height, such as multi-planar v4l2, aligned chroma of
+  // decoder or cropped views. Also updates the valid size.
+  void SetPlanes(const ImagePlane *planes, int num);
+  void ClearPlanes() {
+    plane_num = 0;
+    for (auto &m : plane_maps)
+      m.reset();
+  }
+  bool HasExplicitPlanes() const { return plane_num > 0; }
+  // Return the explicit planes, or the default ones of the image info.
+  int GetPlanes(ImagePlane planes[IMAGE_MAX_PLANES]) const;
+  // The cpu address of each plane. The planes of their own fd are mapped
+  // once and stay mapped as long as this buffer. Return the number of
+  // planes, 0 if failed.
+  int GetPlanePtrs(uint8_t *data[IMAGE_MAX_PLANES]);
+  // Copy the valid rows of src, which is of the same format and size, into
+  // the planes of this. Return false if failed.
+  bool CopyPlanesFrom(ImageBuffer &src);
+  // A copy in a new buffer of mem_type, packed by the 16 aligned size, for
+  // the hardware which only takes one buffer of such layout. nullptr if
+  // failed.
+  std::shared_ptr<ImageBuffer> PackedCopy(MemType mem_type);
+
+  // A view of the rect of src, which shares its memory and fd: the planes
+  // point into the rect, nothing is copied. The consumers which honour the
+  // explicit planes take it as any image, such as rga, drm planes and the
+  // cpu filters. The view holds src, so a pooled src is not recycled before
+  // it. The rect of yuv must be even. Return nullptr if invalid.
+  static std::shared_ptr<ImageBuffer>
+  CropView(const std::shared_ptr<ImageBuffer> &src, const ImageRect &rect);
+
 private:
   void ResetValues() {
     SetType(Type::Image);
     memset(&image_info, 0, sizeof(image_info));
     image_info.pix_fmt = PIX_FMT_NONE;
+    ClearPlanes();
   }
   ImageInfo image_info;
+  int plane_num;
+  ImagePlane image_planes[IMAGE_MAX_PLANES];
+  std::shared_ptr<void> plane_maps[IMAGE_MAX_PLANES]; // of the plane fds
 };
 
 } // namespace easymedia
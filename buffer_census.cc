@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "buffer_census.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+
+#include "utils.h"
+
+namespace easymedia {
+
+static const int kMemTypeNum = 3;
+
+static const char *mem_type_name(MediaBuffer::MemType type) {
+  switch (type) {
+  case MediaBuffer::MemType::MEM_COMMON:
+    return "common";
+#ifdef LIBION
+  case MediaBuffer::MemType::MEM_ION:
+    return "ion";
+#endif
+#ifdef LIBDRM
+  case MediaBuffer::MemType::MEM_DRM:
+    return "drm";
+#endif
+  default:
+    return "unknown";
+  }
+}
+
+class CensusEntry;
+
+class Census {
+public:
+  Census() : next_id(1), max_age(0), last_check(0), alert_func(nullptr) {
+    const char *env = getenv("EASYMEDIA_BUFFER_CENSUS");
+    enabled = (env && atoi(env) > 0);
+    memset(bytes, 0, sizeof(bytes));
+    memset(max_bytes, 0, sizeof(max_bytes));
+  }
+
+  std::atomic<bool> enabled;
+  std::mutex mtx;
+  uint64_t next_id;
+  std::map<uint64_t, CensusEntry *> entries;
+  size_t bytes[kMemTypeNum];
+  size_t max_bytes[kMemTypeNum];
+  int64_t max_age;
+  int64_t last_check;
+  CensusAlertFunc alert_func;
+};
+
+// never destructed, the buffers in static objects may die after it
+static Census &census() {
+  static Census *c = new Census();
+  return *c;
+}
+
+class CensusEntry {
+public:
+  CensusEntry(const char *t, MediaBuffer::MemType mt, size_t s, bool sh)
+      : tag(t), mem_type(mt), size(s), shared(sh), born(gettimeofday()),
+        held_since(0) {
+    Census &c = census();
+    std::lock_guard<std::mutex> _lg(c.mtx);
+    id = c.next_id++;
+    c.entries[id] = this;
+    if (!shared)
+      c.bytes[(int)mem_type] += size;
+  }
+  ~CensusEntry() {
+    Census &c = census();
+    std::lock_guard<std::mutex> _lg(c.mtx);
+    c.entries.erase(id);
+    if (!shared)
+      c.bytes[(int)mem_type] -= size;
+  }
+
+  uint64_t id;
+  const char *tag;
+  MediaBuffer::MemType mem_type;
+  size_t size;
+  bool shared;
+  int64_t born;
+  // guarded by census mutex
+  std::string holder;
+  int64_t held_since;
+};
+
+void EnableBufferCensus(bool enable) { census().enabled = enable; }
+
+bool IsBufferCensusEnabled() { return census().enabled; }
+
+static void census_track(MediaBuffer &mb, const char *tag,
+                         MediaBuffer::MemType type, bool shared) {
+  Census &c = census();
+  if (!c.enabled || mb.GetCensusEntry())
+    return;
+  auto entry = std::make_shared<CensusEntry>(tag ? tag : "unknown", type,
+                                             mb.GetSize(), shared);
+  if (!entry)
+    return;
+  mb.SetCensusEntry(entry);
+  bool need_check = false;
+  int64_t now = entry->born;
+  {
+    std::lock_guard<std::mutex> _lg(c.mtx);
+    if (now - c.last_check >= 1000) {
+      c.last_check = now;
+      need_check = true;
+    }
+  }
+  if (need_check)
+    CheckBufferCensus();
+}
+
+void CensusTrack(MediaBuffer &mb, const char *tag, MediaBuffer::MemType type) {
+  census_track(mb, tag, type, false);
+}
+
+void CensusTrackShared(MediaBuffer &mb, const char *tag,
+                       MediaBuffer::MemType type) {
+  census_track(mb, tag, type, true);
+}
+
+void CensusTrackCopy(MediaBuffer &copy) {
+  auto &sp = copy.GetCensusEntry();
+  if (!sp)
+    return;
+  CensusEntry *origin = static_cast<CensusEntry *>(sp.get());
+  const char *tag = origin->tag;
+  MediaBuffer::MemType type = origin->mem_type;
+  copy.SetCensusEntry(nullptr);
+  census_track(copy, tag, type, true);
+}
+
+void CensusSetHolder(MediaBuffer &mb, const std::string &holder) {
+  auto &sp = mb.GetCensusEntry();
+  if (!sp)
+    return;
+  CensusEntry *entry = static_cast<CensusEntry *>(sp.get());
+  Census &c = census();
+  std::lock_guard<std::mutex> _lg(c.mtx);
+  if (entry->holder == holder)
+    return;
+  entry->holder = holder;
+  entry->held_since = gettimeofday();
+}
+
+std::vector<BufferCensusRecord> GetBufferCensus() {
+  std::vector<BufferCensusRecord> records;
+  Census &c = census();
+  int64_t now = gettimeofday();
+  std::lock_guard<std::mutex> _lg(c.mtx);
+  records.reserve(c.entries.size());
+  for (auto &p : c.entries) {
+    CensusEntry *e = p.second;
+    records.push_back({e->id, e->tag, e->mem_type, e->size, now - e->born,
+                       e->holder, e->holder.empty() ? 0 : now - e->held_since,
+                       e->shared});
+  }
+  return records;
+}
+
+size_t GetCensusBytes(MediaBuffer::MemType type) {
+  Census &c = census();
+  std::lock_guard<std::mutex> _lg(c.mtx);
+  return c.bytes[(int)type];
+}
+
+void DumpBufferCensus(FILE *fp) {
+  auto records = GetBufferCensus();
+  std::sort(records.begin(), records.end(),
+            [](const BufferCensusRecord &a, const BufferCensusRecord &b) {
+              return a.age > b.age;
+            });
+  // tag/holder -> (count, bytes, oldest)
+  std::map<std::string, std::pair<int, size_t>> groups;
+  size_t total = 0;
+  fprintf(fp, "buffer census: %d live buffers\n", (int)records.size());
+  for (auto &r : records) {
+    fprintf(fp, "  #%llu %-16s %-7s %9zu bytes, age %6lld ms, holder %s",
+            (unsigned long long)r.id, r.tag, mem_type_name(r.mem_type), r.size,
+            (long long)r.age, r.holder.empty() ? "-" : r.holder.c_str());
+    if (!r.holder.empty())
+      fprintf(fp, " for %lld ms", (long long)r.held_time);
+    fprintf(fp, "%s\n", r.shared ? ", shared" : "");
+    auto &g = groups[std::string(r.tag) + " @ " +
+                     (r.holder.empty() ? "-" : r.holder)];
+    g.first++;
+    if (r.shared)
+      continue;
+    g.second += r.size;
+    total += r.size;
+  }
+  fprintf(fp, "by tag @ holder:\n");
+  for (auto &g : groups)
+    fprintf(fp, "  %-40s %4d buffers, %zu bytes\n", g.first.c_str(),
+            g.second.first, g.second.second);
+  fprintf(fp, "total %zu bytes\n", total);
+}
+
+void SetCensusBytesThreshold(MediaBuffer::MemType type, size_t max_bytes) {
+  Census &c = census();
+  std::lock_guard<std::mutex> _lg(c.mtx);
+  c.max_bytes[(int)type] = max_bytes;
+}
+
+void SetCensusAgeThreshold(int64_t max_age) {
+  Census &c = census();
+  std::lock_guard<std::mutex> _lg(c.mtx);
+  c.max_age = max_age;
+}
+
+void SetCensusAlertFunc(CensusAlertFunc func) {
+  Census &c = census();
+  std::lock_guard<std::mutex> _lg(c.mtx);
+  c.alert_func = func;
+}
+
+int CheckBufferCensus() {
+  Census &c = census();
+  std::vector<std::string> alerts;
+  CensusAlertFunc func;
+  {
+    char msg[256];
+    int64_t now = gettimeofday();
+    std::lock_guard<std::mutex> _lg(c.mtx);
+    func = c.alert_func;
+    for (int i = 0; i < kMemTypeNum; i++) {
+      if (c.max_bytes[i] > 0 && c.bytes[i] > c.max_bytes[i]) {
+        snprintf(msg, sizeof(msg),
+                 "buffer census: %s memory %zu bytes exceeds %zu\n",
+                 mem_type_name((MediaBuffer::MemType)i), c.bytes[i],
+                 c.max_bytes[i]);
+        alerts.push_back(msg);
+      }
+    }
+    if (c.max_age > 0) {
+      for (auto &p : c.entries) {
+        CensusEntry *e = p.second;
+        if (e->holder.empty() || now - e->held_since <= c.max_age)
+          continue;
+        snprintf(msg, sizeof(msg),
+                 "buffer census: #%llu %s (%zu bytes) held %lld ms by %s\n",
+                 (unsigned long long)e->id, e->tag, e->size,
+                 (long long)(now - e->held_since), e->holder.c_str());
+        alerts.push_back(msg);
+      }
+    }
+  }
+  // call out of lock, the alert function may dump the census
+  for (auto &a : alerts) {
+    if (func)
+      func(a.c_str());
+    else
+      LOG("%s", a.c_str());
+  }
+  return alerts.size();
+}
+
+} // namespace easymedia
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_BUFFER_CENSUS_H_
+#define EASYMEDIA_BUFFER_CENSUS_H_
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+
+// Census of the live buffers, for finding who holds buffers too long.
+// It is off by default, enable by EnableBufferCensus(true) or the environment
+// EASYMEDIA_BUFFER_CENSUS=1. A tracked buffer leaves the census when the last
+// copy of its MediaBuffer destructs.
+
+namespace easymedia {
+
+typedef struct {
+  uint64_t id;
+  const char *tag; // allocation site
+  MediaBuffer::MemType mem_type;
+  size_t size;
+  int64_t age;         // ms since tracked
+  std::string holder;  // the flow which holds it now, empty if none
+  int64_t held_time;   // ms since held by the holder
+  bool shared;         // its bytes are counted by another record
+} BufferCensusRecord;
+
+_API void EnableBufferCensus(bool enable);
+_API bool IsBufferCensusEnabled();
+
+// Add the buffer to census, tag must be a static string.
+// Does nothing if census is disabled or the buffer is tracked already.
+_API void CensusTrack(MediaBuffer &mb, const char *tag,
+                      MediaBuffer::MemType type);
+// The same, for a buffer on the memory of another tracked one, such as a
+// dequeued slot of a capture ring: it has its own age and holder, but its
+// bytes are not counted again.
+_API void CensusTrackShared(MediaBuffer &mb, const char *tag,
+                            MediaBuffer::MemType type);
+// A copy handed out of the memory of a tracked buffer, such as a buffer of a
+// pool: it leaves the entry of the memory owner for its own shared one of
+// the same tag, with no holder.
+_API void CensusTrackCopy(MediaBuffer &copy);
+_API void CensusSetHolder(MediaBuffer &mb, const std::string &holder);
+
+_API std::vector<BufferCensusRecord> GetBufferCensus();
+// the live bytes of the memtype, each memory once
+_API size_t GetCensusBytes(MediaBuffer::MemType type);
+// print the live buffers, grouped by tag and holder, the oldest first
+_API void DumpBufferCensus(FILE *fp = stderr);
+
+// Alert when the live bytes of the memtype exceed max_bytes, 0 means no limit.
+_API void SetCensusBytesThreshold(MediaBuffer::MemType type, size_t max_bytes);
+// Alert when a buffer is held by a flow longer than max_age ms, 0 means no
+// limit. The memory owners, such as the slots of a pool or a capture ring,
+// are never held themselves.
+_API void SetCensusAgeThreshold(int64_t max_age);
+// Default alert is LOG.
+typedef void (*CensusAlertFunc)(const char *msg);
+_API void SetCensusAlertFunc(CensusAlertFunc func);
+// Check the thresholds, return the number of alerts. It is also checked
+// at most once a second when tracking new buffers.
+_API int CheckBufferCensus();
+
+} // namespace easymedia
+
+#endif // EASYMEDIA_BUFFER_CENSUS_H_
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "buffer_chain.h"
+
+#include <errno.h>
+
+#include <algorithm>
+
+#include "utils.h"
+
+namespace easymedia {
+
+const size_t BufferChain::kStorageBlockSize;
+
+void BufferChain::Append(const void *ptr, size_t size) {
+  if (!ptr || size == 0)
+    return;
+  segments.push_back({ptr, size, nullptr});
+  total_size += size;
+}
+
+bool BufferChain::Append(std::shared_ptr<MediaBuffer> buf, size_t offset,
+                         size_t size) {
+  if (!buf || !buf->GetPtr() || offset > buf->GetValidSize()) {
+    errno = EINVAL;
+    return false;
+  }
+  if (size == 0)
+    size = buf->GetValidSize() - offset;
+  if (offset + size > buf->GetValidSize()) {
+    errno = EINVAL;
+    return false;
+  }
+  if (size == 0)
+    return true;
+  segments.push_back({(uint8_t *)buf->GetPtr() + offset, size, buf});
+  total_size += size;
+  return true;
+}
+
+bool BufferChain::AppendCopy(const void *ptr, size_t size) {
+  if (!ptr || size == 0)
+    return true;
+  size_t used = storage ? storage->GetValidSize() : 0;
+  if (!storage || storage->GetSize() - used < size) {
+    storage = MediaBuffer::Alloc(std::max(size, kStorageBlockSize),
+                                 MediaBuffer::MemType::MEM_COMMON,
+                                 "buffer_chain");
+    if (!storage) {
+      LOG_NO_MEMORY();
+      errno = ENOMEM;
+      return false;
+    }
+    used = 0;
+  }
+  uint8_t *dst = (uint8_t *)storage->GetPtr() + used;
+  memcpy(dst, ptr, size);
+  storage->SetValidSize(used + size);
+  copied_size += size;
+  total_size += size;
+  if (!segments.empty()) {
+    Segment &last = segments.back();
+    if (last.ref == storage && (uint8_t *)last.ptr + last.size == dst) {
+      last.size += size;
+      return true;
+    }
+  }
+  segments.push_back({dst, size, storage});
+  return true;
+}
+
+void BufferChain::Clear() {
+  segments.clear();
+  storage.reset();
+  total_size = 0;
+  copied_size = 0;
+}
+
+void BufferChain::ToIovec(std::vector<struct iovec> &iov) const {
+  iov.reserve(iov.size() + segments.size());
+  for (auto &s : segments)
+    iov.push_back({const_cast<void *>(s.ptr), s.size});
+}
+
+std::shared_ptr<MediaBuffer> BufferChain::Gather() {
+  if (total_size == 0)
+    return nullptr;
+  if (segments.size() == 1) {
+    Segment &s = segments.front();
+    if (s.ref && s.ptr == s.ref->GetPtr() &&
+        (s.ref == storage || s.size == s.ref->GetValidSize())) {
+      auto ret = s.ref;
+      // the storage is given out, never append into it again
+      if (ret == storage) {
+        storage.reset();
+        ret->SetValidSize(s.size);
+      }
+      return ret;
+    }
+  }
+  auto ret = MediaBuffer::Alloc(total_size, MediaBuffer::MemType::MEM_COMMON,
+                                "buffer_chain");
+  if (!ret) {
+    LOG_NO_MEMORY();
+    errno = ENOMEM;
+    return nullptr;
+  }
+  uint8_t *dst = (uint8_t *)ret->GetPtr();
+  for (auto &s : segments) {
+    memcpy(dst, s.ptr, s.size);
+    dst += s.size;
+  }
+  ret->SetValidSize(total_size);
+  return ret;
+}
+
+} // namespace easymedia
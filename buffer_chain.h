@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_BUFFER_CHAIN_H_
+#define EASYMEDIA_BUFFER_CHAIN_H_
+
+#include <sys/uio.h>
+
+#include <memory>
+#include <vector>
+
+#include "buffer.h"
+
+namespace easymedia {
+
+// Scatter-gather buffer, an ordered list of segments. Each segment is either a
+// plain memory range or a view of another MediaBuffer, so that headers and
+// payloads can be written out by one writev without concatenating them first.
+class _API BufferChain {
+public:
+  struct Segment {
+    const void *ptr;
+    size_t size;
+    std::shared_ptr<MediaBuffer> ref; // keep the viewed buffer alive
+  };
+
+  BufferChain() : total_size(0), copied_size(0) {}
+  ~BufferChain() = default;
+
+  // The memory must keep valid until the chain is consumed.
+  void Append(const void *ptr, size_t size);
+  // View of [offset, offset + size) of buf, size 0 means till the valid end.
+  bool Append(std::shared_ptr<MediaBuffer> buf, size_t offset = 0,
+              size_t size = 0);
+  // Copy into chain owned storage, for memory which will not outlive the
+  // caller, such as the pages of libogg. Adjacent copies are coalesced.
+  bool AppendCopy(const void *ptr, size_t size);
+  void Clear();
+
+  bool Empty() const { return segments.empty(); }
+  size_t GetSize() const { return total_size; }
+  // bytes copied by AppendCopy since the last Clear
+  size_t GetCopiedSize() const { return copied_size; }
+  const std::vector<Segment> &GetSegments() const { return segments; }
+  void ToIovec(std::vector<struct iovec> &iov) const;
+
+  // Return a contiguous buffer of the whole chain. If the chain is only one
+  // segment which starts at the head of a MediaBuffer, no copy happens.
+  std::shared_ptr<MediaBuffer> Gather();
+
+private:
+  static const size_t kStorageBlockSize = 64 * 1024;
+
+  std::vector<Segment> segments;
+  std::shared_ptr<MediaBuffer> storage; // tail block of AppendCopy
+  size_t total_size;
+  size_t copied_size;
+};
+
+} // namespace easymedia
+
+#endif // EASYMEDIA_BUFFER_CHAIN_H_
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "buffer_copy.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "buffer.h"
+#include "utils.h"
+
+namespace easymedia {
+
+static std::atomic<FdCopyFunc> fd_copy_backend(nullptr);
+static std::atomic<size_t> non_temporal_threshold(256 * 1024);
+static std::atomic<size_t> multi_thread_threshold(4 * 1024 * 1024);
+static std::atomic<int> copy_threads(0);
+
+static const int kMaxCopyThreads = 4;
+
+void RegisterFdCopyBackend(FdCopyFunc func) { fd_copy_backend = func; }
+
+void SetCopyThreshold(size_t non_temporal, size_t multi_thread) {
+  non_temporal_threshold = non_temporal;
+  multi_thread_threshold = multi_thread;
+}
+
+void SetCopyThreads(int num) { copy_threads = num; }
+
+static int get_copy_threads() {
+  int num = copy_threads;
+  if (num > 0)
+    return num;
+  num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (num < 1)
+    num = 1;
+  return std::min(num, kMaxCopyThreads);
+}
+
+// Streaming stores write around the cache, which avoids the read-for-ownership
+// of the dst lines and does not evict the working set by a frame sized copy.
+static void non_temporal_copy(void *dst, const void *src, size_t size) {
+#if defined(__SSE2__)
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t *s = (const uint8_t *)src;
+  size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+  if (head > size)
+    head = size;
+  memcpy(d, s, head);
+  d += head;
+  s += head;
+  size -= head;
+  for (; size >= 64; size -= 64, d += 64, s += 64) {
+    __m128i x0 = _mm_loadu_si128((const __m128i *)s);
+    __m128i x1 = _mm_loadu_si128((const __m128i *)(s + 16));
+    __m128i x2 = _mm_loadu_si128((const __m128i *)(s + 32));
+    __m128i x3 = _mm_loadu_si128((const __m128i *)(s + 48));
+    _mm_stream_si128((__m128i *)d, x0);
+    _mm_stream_si128((__m128i *)(d + 16), x1);
+    _mm_stream_si128((__m128i *)(d + 32), x2);
+    _mm_stream_si128((__m128i *)(d + 48), x3);
+  }
+  _mm_sfence();
+  memcpy(d, s, size);
+#elif defined(__aarch64__)
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t *s = (const uint8_t *)src;
+  for (; size >= 64; size -= 64, d += 64, s += 64) {
+    __asm__ volatile("ldp q0, q1, [%1]\n"
+                     "ldp q2, q3, [%1, #32]\n"
+                     "stnp q0, q1, [%0]\n"
+                     "stnp q2, q3, [%0, #32]\n"
+                     :
+                     : "r"(d), "r"(s)
+                     : "v0", "v1", "v2", "v3", "memory");
+  }
+  memcpy(d, s, size);
+#else
+  // no streaming store, the libc memcpy is the best we have
+  memcpy(dst, src, size);
+#endif
+}
+
+static void single_copy(void *dst, const void *src, size_t size,
+                        bool non_temporal) {
+  if (non_temporal)
+    non_temporal_copy(dst, src, size);
+  else
+    memcpy(dst, src, size);
+}
+
+static void multi_thread_copy(void *dst, const void *src, size_t size,
+                              bool non_temporal) {
+  int num = get_copy_threads();
+  // chunks are cache line aligned, so that no line is shared by two threads
+  size_t chunk = UPALIGNTO(size / num, (size_t)64);
+  if (num <= 1 || chunk == 0) {
+    single_copy(dst, src, size, non_temporal);
+    return;
+  }
+  std::vector<std::thread> threads;
+  size_t offset = 0;
+  for (int i = 0; i < num - 1 && offset + chunk < size; i++) {
+    threads.emplace_back(single_copy, (uint8_t *)dst + offset,
+                         (const uint8_t *)src + offset, chunk, non_temporal);
+    offset += chunk;
+  }
+  single_copy((uint8_t *)dst + offset, (const uint8_t *)src + offset,
+              size - offset, non_temporal);
+  for (auto &t : threads)
+    t.join();
+}
+
+static CopyStrategy pick_strategy(size_t size, bool dst_uncached) {
+  size_t mt = multi_thread_threshold;
+  size_t nt = non_temporal_threshold;
+  if (mt > 0 && size >= mt)
+    return CopyStrategy::MULTI_THREAD;
+  if (dst_uncached && nt > 0 && size >= nt)
+    return CopyStrategy::NON_TEMPORAL;
+  return CopyStrategy::CPU;
+}
+
+void CopyMemory(void *dst, const void *src, size_t size,
+                CopyStrategy strategy, bool dst_uncached) {
+  if (size == 0 || dst == src)
+    return;
+  if (strategy == CopyStrategy::AUTO)
+    strategy = pick_strategy(size, dst_uncached);
+  switch (strategy) {
+  case CopyStrategy::NON_TEMPORAL:
+    non_temporal_copy(dst, src, size);
+    break;
+  case CopyStrategy::MULTI_THREAD: {
+    size_t nt = non_temporal_threshold;
+    multi_thread_copy(dst, src, size, dst_uncached && nt > 0);
+  } break;
+  default:
+    memcpy(dst, src, size);
+  }
+}
+
+int CopyMediaBuffer(MediaBuffer &dst, MediaBuffer &src, size_t size,
+                    CopyStrategy strategy) {
+  if (size > dst.GetSize() || size > src.GetSize())
+    return -EINVAL;
+  FdCopyFunc func = fd_copy_backend;
+  if (func && src.IsHwBuffer() && dst.IsHwBuffer() &&
+      strategy == CopyStrategy::AUTO) {
+    if (!func(dst.GetFD(), src.GetFD(), size))
+      return 0;
+    LOGD("fd copy backend failed, fallback to cpu\n");
+  }
+  if (!dst.GetPtr() || !src.GetPtr())
+    return -EINVAL;
+  src.BeginCPUAccess(true, false);
+  dst.BeginCPUAccess(false, true);
+  // the hardware buffers are mapped uncached or write-combined
+  CopyMemory(dst.GetPtr(), src.GetPtr(), size, strategy, dst.IsHwBuffer());
+  dst.EndCPUAccess(false, true);
+  src.EndCPUAccess(true, false);
+  return 0;
+}
+
+struct RowCopy {
+  uint8_t *dst;
+  const uint8_t *src;
+  int dst_stride;
+  int src_stride;
+  int row_bytes;
+  int rows;
+};
+
+static void copy_rows(const RowCopy &rc, bool non_temporal) {
+  // small padding, copy through the padding in one go is cheaper
+  if (rc.dst_stride == rc.src_stride &&
+      (rc.dst_stride - rc.row_bytes) * 8 <= rc.dst_stride) {
+    size_t size = (size_t)rc.dst_stride * (rc.rows - 1) + rc.row_bytes;
+    single_copy(rc.dst, rc.src, size, non_temporal);
+    return;
+  }
+  for (int i = 0; i < rc.rows; i++)
+    single_copy(rc.dst + (size_t)i * rc.dst_stride,
+                rc.src + (size_t)i * rc.src_stride, rc.row_bytes,
+                non_temporal);
+}
+
+bool CopyImage(void *dst, const ImageInfo &dst_info, const void *src,
+               const ImageInfo &src_info, CopyStrategy strategy,
+               bool dst_uncached) {
+  if (dst_info.pix_fmt != src_info.pix_fmt ||
+      dst_info.width != src_info.width || dst_info.height != src_info.height) {
+    LOG("CopyImage: mismatch of format or size\n");
+    return false;
+  }
+  ImagePlane dplanes[IMAGE_MAX_PLANES], splanes[IMAGE_MAX_PLANES];
+  int num = GetImagePlanes(dst_info, dplanes);
+  if (num <= 0 || GetImagePlanes(src_info, splanes) != num) {
+    LOG("CopyImage: unsupport fmt %d\n", dst_info.pix_fmt);
+    return false;
+  }
+  std::vector<RowCopy> jobs;
+  size_t total = 0;
+  for (int i = 0; i < num; i++) {
+    if (dplanes[i].rows <= 0 || dplanes[i].row_bytes <= 0)
+      continue;
+    jobs.push_back({(uint8_t *)dst + dplanes[i].offset,
+                    (const uint8_t *)src + splanes[i].offset, dplanes[i].stride,
+                    splanes[i].stride, dplanes[i].row_bytes, dplanes[i].rows});
+    total += (size_t)dplanes[i].row_bytes * dplanes[i].rows;
+  }
+  if (strategy == CopyStrategy::AUTO)
+    strategy = pick_strategy(total, dst_uncached);
+  bool non_temporal = (strategy == CopyStrategy::NON_TEMPORAL) ||
+                      (strategy == CopyStrategy::MULTI_THREAD && dst_uncached);
+  int threads = get_copy_threads();
+  if (strategy != CopyStrategy::MULTI_THREAD || threads <= 1) {
+    for (auto &rc : jobs)
+      copy_rows(rc, non_temporal);
+    return true;
+  }
+  // split every plane into row bands, one band of each plane per thread
+  std::vector<std::vector<RowCopy>> bands(threads);
+  for (auto &rc : jobs) {
+    int step = (rc.rows + threads - 1) / threads;
+    for (int t = 0, row = 0; t < threads && row < rc.rows; t++, row += step) {
+      RowCopy band = rc;
+      band.dst += (size_t)row * rc.dst_stride;
+      band.src += (size_t)row * rc.src_stride;
+      band.rows = std::min(step, rc.rows - row);
+      bands[t].push_back(band);
+    }
+  }
+  auto run_bands = [non_temporal](const std::vector<RowCopy> *b) {
+    for (auto &rc : *b)
+      copy_rows(rc, non_temporal);
+  };
+  std::vector<std::thread> workers;
+  for (int t = 1; t < threads; t++)
+    workers.emplace_back(run_bands, &bands[t]);
+  run_bands(&bands[0]);
+  for (auto &w : workers)
+    w.join();
+  return true;
+}
+
+} // namespace easymedia
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_BUFFER_COPY_H_
+#define EASYMEDIA_BUFFER_COPY_H_
+
+#include <stddef.h>
+
+#include "image.h"
+
+namespace easymedia {
+
+class MediaBuffer;
+
+enum class CopyStrategy {
+  AUTO,         // pick by size and memory type
+  CPU,          // plain memcpy, the reference
+  NON_TEMPORAL, // streaming stores, bypass cache, for uncached/wc dst
+  MULTI_THREAD, // split into chunks, copied by several threads
+};
+
+// Backend which copies between two dma buffers without cpu, such as rga.
+// Return 0 if success, otherwise the engine falls back to cpu copy.
+typedef int (*FdCopyFunc)(int dst_fd, int src_fd, size_t size);
+_API void RegisterFdCopyBackend(FdCopyFunc func);
+
+// Sizes in bytes where AUTO switches strategy, 0 means never.
+// Default non-temporal from 256KB, multi-thread from 4MB.
+_API void SetCopyThreshold(size_t non_temporal, size_t multi_thread);
+// 0 means the number of online cpus, up to 4.
+_API void SetCopyThreads(int num);
+
+// dst_uncached: the dst memory is uncached or write-combined.
+_API void CopyMemory(void *dst, const void *src, size_t size,
+                     CopyStrategy strategy = CopyStrategy::AUTO,
+                     bool dst_uncached = false);
+
+// Copy size bytes of src into dst. Both sides with fd try the fd backend
+// first. Return 0 if success.
+_API int CopyMediaBuffer(MediaBuffer &dst, MediaBuffer &src, size_t size,
+                         CopyStrategy strategy = CopyStrategy::AUTO);
+
+// Copy the valid rows of every plane, the stride padding is skipped.
+// The two infos must be the same format and size, strides may differ.
+_API bool CopyImage(void *dst, const ImageInfo &dst_info, const void *src,
+                    const ImageInfo &src_info,
+                    CopyStrategy strategy = CopyStrategy::AUTO,
+                    bool dst_uncached = false);
+
+} // namespace easymedia
+
+#endif // EASYMEDIA_BUFFER_COPY_H_
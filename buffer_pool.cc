@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "buffer_pool.h"
+
+#include "buffer_census.h"
+#include "utils.h"
+
+namespace easymedia {
+
+BufferPool::BufferPool(int buffer_num, size_t size, MediaBuffer::MemType type,
+                       const char *tag)
+    : state(std::make_shared<State>()), num(0), buffer_size(size),
+      mem_type(type) {
+  for (int i = 0; i < buffer_num; i++) {
+    MediaBuffer &&mb = MediaBuffer::Alloc2(size, type, tag);
+    if (mb.GetSize() == 0) {
+      LOG("buffer pool: only %d of %d buffers of size %zu\n", num, buffer_num,
+          size);
+      break;
+    }
+    state->free_buffers.push_back(mb);
+    num++;
+  }
+}
+
+BufferPool::BufferPool(const std::vector<MediaBuffer> &buffers,
+                       MediaBuffer::MemType type)
+    : state(std::make_shared<State>()), num(buffers.size()),
+      buffer_size(buffers.empty() ? 0 : buffers[0].GetSize()),
+      mem_type(type) {
+  state->free_buffers = buffers;
+}
+
+std::shared_ptr<MediaBuffer> BufferPool::Get() {
+  std::unique_lock<std::mutex> lock(state->mtx);
+  if (state->free_buffers.empty())
+    return nullptr;
+  MediaBuffer origin = state->free_buffers.back();
+  state->free_buffers.pop_back();
+  lock.unlock();
+  // return the untouched origin, whatever the user does on the copy
+  std::shared_ptr<State> s = state;
+  auto recycle = [s, origin](MediaBuffer *mb) {
+    delete mb;
+    std::lock_guard<std::mutex> lg(s->mtx);
+    s->free_buffers.push_back(origin);
+  };
+  MediaBuffer *mb = new MediaBuffer(origin);
+  if (!mb) {
+    LOG_NO_MEMORY();
+    lock.lock();
+    state->free_buffers.push_back(origin);
+    return nullptr;
+  }
+  // held and aged on its own, the slot stays untouched in the pool
+  CensusTrackCopy(*mb);
+  return std::shared_ptr<MediaBuffer>(mb, recycle);
+}
+
+int BufferPool::GetFreeNum() {
+  std::lock_guard<std::mutex> _lg(state->mtx);
+  return state->free_buffers.size();
+}
+
+} // namespace easymedia
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_BUFFER_POOL_H_
+#define EASYMEDIA_BUFFER_POOL_H_
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "buffer.h"
+
+namespace easymedia {
+
+// A fixed set of buffers allocated once, such as the output buffers of an
+// encoder sized to the worst-case frame. Get hands out a buffer which goes
+// back to the pool when its last reference is released, so the pool may be
+// destroyed before the buffers in use. The attributes set on a handed out
+// buffer are not kept, neither is the user data replaced on it.
+class _API BufferPool {
+public:
+  // tag: the allocation site shown by buffer census, a static string
+  BufferPool(int num, size_t size,
+             MediaBuffer::MemType type = MediaBuffer::MemType::MEM_COMMON,
+             const char *tag = "buffer_pool");
+  // take over the given buffers, which are of the same size and type
+  BufferPool(const std::vector<MediaBuffer> &buffers,
+             MediaBuffer::MemType type = MediaBuffer::MemType::MEM_COMMON);
+  ~BufferPool() = default;
+
+  // Return nullptr if all buffers are in use, never blocks.
+  std::shared_ptr<MediaBuffer> Get();
+  // the number of the allocated buffers, less than required if out of memory
+  int GetNum() const { return num; }
+  int GetFreeNum();
+  size_t GetBufferSize() const { return buffer_size; }
+  MediaBuffer::MemType GetMemType() const { return mem_type; }
+
+private:
+  struct State {
+    std::mutex mtx;
+    std::vector<MediaBuffer> free_buffers;
+  };
+  std::shared_ptr<State> state;
+  int num;
+  size_t buffer_size;
+  MediaBuffer::MemType mem_type;
+};
+
+} // namespace easymedia
+
+#endif // EASYMEDIA_BUFFER_POOL_H_
@@ -24,6 +24,7 @@
 #include <sys/prctl.h>
 
 #include "buffer.h"
+#include "startcode.h"
 #include "utils.h"
 
 namespace easymedia {
@@ -65,46 +66,8 @@ bool Codec::SetExtraData(void *data, size_t size, bool realloc) {
 
 bool Codec::Init() { return false; }
 
-// Copy from ffmpeg.
-static const uint8_t *find_startcode_internal(const uint8_t *p,
-                                              const uint8_t *end) {
-  const uint8_t *a = p + 4 - ((intptr_t)p & 3);
-
-  for (end -= 3; p < a && p < end; p++) {
-    if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-      return p;
-  }
-
-  for (end -= 3; p < end; p += 4) {
-    uint32_t x = *(const uint32_t *)p;
-    //      if ((x - 0x01000100) & (~x) & 0x80008000) // little endian
-    //      if ((x - 0x00010001) & (~x) & 0x00800080) // big endian
-    if ((x - 0x01010101) & (~x) & 0x80808080) { // generic
-      if (p[1] == 0) {
-        if (p[0] == 0 && p[2] == 1)
-          return p;
-        if (p[2] == 0 && p[3] == 1)
-          return p + 1;
-      }
-      if (p[3] == 0) {
-        if (p[2] == 0 && p[4] == 1)
-          return p + 2;
-        if (p[4] == 0 && p[5] == 1)
-          return p + 3;
-      }
-    }
-  }
-
-  for (end += 3; p < end; p++) {
-    if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-      return p;
-  }
-
-  return end + 3;
-}
-
 const uint8_t *find_h264_startcode(const uint8_t *p, const uint8_t *end) {
-  const uint8_t *out = find_startcode_internal(p, end);
+  const uint8_t *out = FindStartCode(p, end);
   if (p < out && out < end && !out[-1])
     out--;
   return out;
@@ -113,18 +76,14 @@ const uint8_t *find_h264_startcode(const uint8_t *p, const uint8_t *end) {
 std::list<std::shared_ptr<MediaBuffer>>
 split_h264_separate(const uint8_t *buffer, size_t length, int64_t timestamp) {
   std::list<std::shared_ptr<MediaBuffer>> l;
-  const uint8_t *p = buffer;
-  const uint8_t *end = p + length;
-  const uint8_t *nal_start = nullptr, *nal_end = nullptr;
-  nal_start = find_h264_startcode(p, end);
-  // 00 00 01 or 00 00 00 01
-  size_t start_len = (nal_start[2] == 1 ? 3 : 4);
-  for (;;) {
-    if (nal_start == end)
+  std::vector<StartCodePos> pos;
+  FindAllStartCodes(buffer, length, pos);
+  for (size_t i = 0; i < pos.size(); i++) {
+    const uint8_t *nal_start = buffer + pos[i].offset + pos[i].size;
+    size_t size = (i + 1 < pos.size() ? pos[i + 1].offset : length) -
+                  pos[i].offset;
+    if (nal_start >= buffer + length)
       break;
-    nal_start += start_len;
-    nal_end = find_h264_startcode(nal_start, end);
-    size_t size = nal_end - nal_start + start_len;
     uint8_t nal_type = (*nal_start) & 0x1F;
     uint32_t flag;
     switch (nal_type) {
@@ -137,6 +96,7 @@ split_h264_separate(const uint8_t *buffer, size_t length, int64_t timestamp) {
       break;
     case 1:
       flag = MediaBuffer::kPredicted;
+      break;
     default:
       flag = 0;
     }
@@ -146,13 +106,11 @@ split_h264_separate(const uint8_t *buffer, size_t length, int64_t timestamp) {
       l.clear();
       return l;
     }
-    memcpy(sub_buffer->GetPtr(), nal_start - start_len, size);
+    memcpy(sub_buffer->GetPtr(), buffer + pos[i].offset, size);
     sub_buffer->SetValidSize(size);
     sub_buffer->SetUserFlag(flag);
     sub_buffer->SetTimeStamp(timestamp);
     l.push_back(sub_buffer);
-
-    nal_start = nal_end;
   }
   return std::move(l);
 }
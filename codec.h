@@ -22,6 +22,7 @@
 #ifndef EASYMEDIA_CODEC_H_
 #define EASYMEDIA_CODEC_H_
 
+#include <functional>
 #include <list>
 #include <memory>
 
@@ -54,6 +55,16 @@ public:
   virtual int SendInput(std::shared_ptr<MediaBuffer> input) = 0;
   virtual std::shared_ptr<MediaBuffer> FetchOutput() = 0;
 
+  // Readiness notification of the async call, instead of polling SendInput
+  // and FetchOutput. The callback runs in a thread of the codec, with
+  // kEventInput if SendInput may take more input now, and kEventOutput if
+  // FetchOutput has outputs. A null callback stops it; once that returns, no
+  // callback is running. Return false if the codec does not support it.
+  static const uint32_t kEventInput = 1 << 0;
+  static const uint32_t kEventOutput = 1 << 1;
+  typedef std::function<void(uint32_t events)> EventCallback;
+  virtual bool SetEventCallback(EventCallback) { return false; }
+
 private:
   MediaConfig config;
   void *extra_data;
@@ -24,6 +24,8 @@
 
 #include <stdint.h>
 
+#include "image.h"
+
 namespace easymedia {
 
 typedef struct {
@@ -31,11 +33,31 @@ typedef struct {
   uint64_t value;
 } DRMPropertyArg;
 
+typedef struct {
+  uint32_t num; // frames per second = num / den
+  uint32_t den;
+} FrameRateArg;
+
 typedef struct {
   unsigned long int sub_request;
   void *arg;
 } SubRequest;
 
+// The crop window eases to the target in frames, 0 jumps.
+typedef struct {
+  ImageRect rect; // the target window, if zoom is 0
+  // else the window of the zoom (>= 1), centred at rect.x, rect.y, or at the
+  // image centre if they are negative
+  float zoom;
+  int frames;
+} PanZoomArg;
+
+typedef struct {
+  int tile; // -1 for all
+  int width;
+  uint32_t color; // 0xRRGGBB
+} MosaicBorderArg;
+
 enum {
   S_FIRST_CONTROL = 10000,
   S_SUB_REQUEST, // many devices have their kernel controls
@@ -52,6 +74,22 @@ enum {
   S_CONNECTOR_PROPERTY,
   // any type
   S_STREAM_OFF,
+  // ImageInfo, of the self-described stream
+  G_STREAM_IMAGE_INFO,
+  // FrameRateArg
+  G_STREAM_FRAME_RATE,
+  // PanZoomArg, of the filters which output crop views
+  S_PAN_ZOOM,
+  // ImageRect, the crop window of the last frame
+  G_CROP_WINDOW,
+  // OverlayRegionArg of image_overlay.h, add or replace the region of id
+  S_OVERLAY_REGION,
+  // OverlayRegionArg, move the region of id to rect.x, rect.y
+  S_OVERLAY_MOVE,
+  // int, the id of the region to remove, -1 for all
+  S_OVERLAY_REMOVE,
+  // MosaicBorderArg, the frame of the tiles of a mosaic
+  S_MOSAIC_BORDER,
 };
 
 } // namespace easymedia
@@ -57,9 +57,18 @@ public:
 #define DEFINE_VIDEO_DECODER_FACTORY(REAL_PRODUCT)                             \
   DEFINE_DECODER_FACTORY(REAL_PRODUCT, VideoDecoder)
 
+class BufferPool;
 class _API VideoDecoder : public Decoder {
 public:
   virtual ~VideoDecoder() = default;
+  // Decode to the buffers of pool, if the decoder supports it, which are then
+  // all the frames it has; call it before decoding. A new resolution beyond
+  // the buffer size replaces the pool with one of the same number and memory
+  // type, while the frames of the old one drain.
+  void SetOutputPool(std::shared_ptr<BufferPool> pool) { output_pool = pool; }
+
+protected:
+  std::shared_ptr<BufferPool> output_pool;
 
   DECLARE_PART_FINAL_EXPOSE_PRODUCT(Decoder)
 };
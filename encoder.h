@@ -31,6 +31,8 @@
 
 namespace easymedia {
 
+class BufferPool;
+
 DECLARE_FACTORY(Encoder)
 
 // usage: REFLECTOR(Encoder)::Create<T>(codecname, param)
@@ -89,11 +91,17 @@ public:
   virtual ~VideoEncoder() = default;
   void RequestChange(uint32_t change, std::shared_ptr<ParameterBuffer> value);
   virtual bool InitConfig(const MediaConfig &cfg) override;
+  // The async FetchOutput returns the buffers of pool written by the encoder
+  // directly, if the encoder supports it and a buffer is free. The sync
+  // Process takes the output buffer from the caller instead.
+  void SetOutputPool(std::shared_ptr<BufferPool> pool) { output_pool = pool; }
 
 protected:
   bool HasChangeReq() { return !change_list.empty(); }
   std::pair<uint32_t, std::shared_ptr<ParameterBuffer>> PeekChange();
 
+  std::shared_ptr<BufferPool> output_pool;
+
 private:
   std::mutex change_mtx;
   std::list<std::pair<uint32_t, std::shared_ptr<ParameterBuffer>>> change_list;
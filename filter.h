@@ -55,6 +55,9 @@ public:
   // sync or async safe call, depends on specific filter.
   virtual int SendInput(std::shared_ptr<MediaBuffer> input);
   virtual std::shared_ptr<MediaBuffer> FetchOutput();
+  // runtime controls, such as the requests of control.h; may be called in
+  // any thread, the filter takes care of its own locking
+  virtual int IoCtrl(unsigned long int request _UNUSED, ...) { return -1; }
 
   DEFINE_ERR_GETSET()
   DECLARE_PART_FINAL_EXPOSE_PRODUCT(Filter)
@@ -26,6 +26,7 @@
 #include <algorithm>
 
 #include "buffer.h"
+#include "buffer_census.h"
 #include "key_string.h"
 #include "utils.h"
 
@@ -441,6 +442,8 @@ bool Flow::InstallSlotMap(SlotMap &map, const std::string &mark,
   }
   c->Bind(in_slots, out_slots);
   coroutines.push_back(c);
+  if (flow_name.empty())
+    flow_name = mark;
   if (!in_slots.empty()) {
     int max_idx = in_slots[in_slots.size() - 1];
     if ((int)v_input.size() <= max_idx)
@@ -545,6 +548,8 @@ void Flow::SendInput(std::shared_ptr<MediaBuffer> &input, int in_slot_index) {
   }
 #endif
   if (enable) {
+    if (input && input->GetCensusEntry())
+      CensusSetHolder(*input, flow_name);
     auto &in = v_input[in_slot_index];
     CALL_MEMBER_FN(in, in.send_input_behavior)(input);
   }
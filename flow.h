@@ -198,6 +198,7 @@ protected:
 private:
   volatile bool enable;
   volatile bool quit;
+  std::string flow_name; // the holder name in buffer census
 
   friend class FlowCoroutine;
 
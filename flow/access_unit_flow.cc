@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include <math.h>
+
+#include "au_assembler.h"
+#include "buffer.h"
+#include "flow.h"
+#include "key_string.h"
+#include "media_reflector.h"
+#include "media_type.h"
+
+namespace easymedia {
+
+static bool do_assemble(Flow *f, MediaBufferVector &input_vector);
+
+// Cut the Annex-B byte stream of any framing into access units, see
+// au_assembler.h. Mostly after file_read_flow or a pipe, so that decoders,
+// muxers and servers get whole frames with the right flags.
+class AccessUnitFlow : public Flow {
+public:
+  AccessUnitFlow(const char *param);
+  virtual ~AccessUnitFlow() { StopAllThread(); }
+  static const char *GetFlowName() { return "access_unit"; }
+
+private:
+  std::shared_ptr<AccessUnitAssembler> assembler;
+
+  friend bool do_assemble(Flow *f, MediaBufferVector &input_vector);
+};
+
+AccessUnitFlow::AccessUnitFlow(const char *param) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  const std::string &type = params[KEY_INPUTDATATYPE];
+  NalCodec codec;
+  if (type.empty() || type == VIDEO_H264) {
+    codec = NalCodec::H264;
+  } else if (type == VIDEO_H265) {
+    codec = NalCodec::H265;
+  } else {
+    LOG("access unit flow does not support %s\n", type.c_str());
+    SetError(-EINVAL);
+    return;
+  }
+  assembler = std::make_shared<AccessUnitAssembler>(codec);
+  if (!assembler) {
+    LOG_NO_MEMORY();
+    SetError(-ENOMEM);
+    return;
+  }
+  const std::string &fps = params[KEY_FPS];
+  if (!fps.empty()) {
+    // 30, 29.97 or 30000/1001
+    uint32_t num = 0, den = 1;
+    size_t slash = fps.find('/');
+    if (slash != std::string::npos) {
+      num = std::stoul(fps.substr(0, slash));
+      den = std::stoul(fps.substr(slash + 1));
+    } else {
+      float f = std::stof(fps);
+      num = (uint32_t)lroundf(f * 1000);
+      den = 1000;
+    }
+    assembler->SetFrameRate(num, den);
+  }
+  const std::string &timing = params[KEY_STREAM_TIMING];
+  if (!timing.empty())
+    assembler->UseStreamTiming(!!std::stoi(timing));
+  SlotMap sm;
+  int input_maxcachenum = 2;
+  ParseParamToSlotMap(params, sm, input_maxcachenum);
+  // cheap enough to run in the thread of the upstream
+  if (sm.thread_model == Model::NONE)
+    sm.thread_model = Model::SYNC;
+  // a dropped chunk breaks the access units around it
+  if (sm.mode_when_full == InputMode::NONE)
+    sm.mode_when_full = InputMode::BLOCKING;
+  sm.input_slots.push_back(0);
+  sm.input_maxcachenum.push_back(input_maxcachenum);
+  sm.output_slots.push_back(0);
+  sm.process = do_assemble;
+  if (!InstallSlotMap(sm, GetFlowName(), -1)) {
+    LOG("Fail to InstallSlotMap, %s\n", GetFlowName());
+    SetError(-EINVAL);
+    return;
+  }
+}
+
+bool do_assemble(Flow *f, MediaBufferVector &input_vector) {
+  AccessUnitFlow *flow = static_cast<AccessUnitFlow *>(f);
+  auto &in = input_vector[0];
+  if (!in)
+    return false;
+  std::list<std::shared_ptr<MediaBuffer>> aus;
+  flow->assembler->Push(in, aus);
+  if (aus.empty())
+    return false;
+  if (in->IsEOF())
+    aus.back()->SetEOF(true);
+  bool ret = false;
+  for (auto &au : aus) {
+    if (flow->SetOutput(au, 0))
+      ret = true;
+  }
+  return ret;
+}
+
+DEFINE_FLOW_FACTORY(AccessUnitFlow, Flow)
+const char *FACTORY(AccessUnitFlow)::ExpectedInputDataType() {
+  return TYPENEAR(VIDEO_H264) TYPENEAR(VIDEO_H265);
+}
+const char *FACTORY(AccessUnitFlow)::OutPutDataType() {
+  return TYPENEAR(VIDEO_H264) TYPENEAR(VIDEO_H265);
+}
+
+} // namespace easymedia
@@ -21,6 +21,10 @@
 
 #include <assert.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
 #include "buffer.h"
 #include "decoder.h"
 #include "flow.h"
@@ -33,12 +37,23 @@ static bool do_decode(Flow *f, MediaBufferVector &input_vector);
 class VideoDecoderFlow : public Flow {
 public:
   VideoDecoderFlow(const char *param);
-  virtual ~VideoDecoderFlow() { StopAllThread(); }
+  virtual ~VideoDecoderFlow();
   static const char *GetFlowName() { return "video_dec"; }
 
 private:
+  // With the events of the decoder, the frames are sent down from its thread
+  // through this internal input slot.
+  static const int kDecodedSlot = 1;
+  static const int kInputWaitMs = 100;
+  void OnDecoderEvent(uint32_t events);
+
   std::shared_ptr<Decoder> decoder;
   bool support_async;
+  bool event_driven;
+  std::mutex event_mtx;
+  std::condition_variable event_cond;
+  bool input_ready;
+  bool event_quit;
   Model thread_model;
   std::vector<std::shared_ptr<MediaBuffer>> out_buffers;
   size_t out_index;
@@ -47,7 +62,8 @@ private:
 };
 
 VideoDecoderFlow::VideoDecoderFlow(const char *param)
-    : support_async(true), thread_model(Model::NONE), out_index(0) {
+    : support_async(true), event_driven(false), input_ready(false),
+      event_quit(false), thread_model(Model::NONE), out_index(0) {
   std::list<std::string> separate_list;
   std::map<std::string, std::string> params;
   if (!ParseWrapFlowParams(param, params, separate_list)) {
@@ -64,6 +80,24 @@ VideoDecoderFlow::VideoDecoderFlow(const char *param)
     SetError(-EINVAL);
     return;
   }
+  if (decoder->SendInput(nullptr) < 0 && errno == ENOSYS)
+    support_async = false;
+  if (support_async)
+    event_driven = decoder->SetEventCallback(
+        [this](uint32_t events) { OnDecoderEvent(events); });
+  if (event_driven) {
+    // the inputs can not move once inited, so the higher slot goes first
+    SlotMap decoded_sm;
+    decoded_sm.input_slots.push_back(kDecodedSlot);
+    decoded_sm.output_slots.push_back(0);
+    decoded_sm.process = void_transaction00;
+    decoded_sm.thread_model = Model::SYNC;
+    if (!InstallSlotMap(decoded_sm, name, -1)) {
+      LOG("Fail to InstallSlotMap, %s decoded\n", decoder_name);
+      SetError(-EINVAL);
+      return;
+    }
+  }
   SlotMap sm;
   int input_maxcachenum = 2;
   ParseParamToSlotMap(params, sm, input_maxcachenum);
@@ -74,15 +108,42 @@ VideoDecoderFlow::VideoDecoderFlow(const char *param)
     sm.mode_when_full = InputMode::BLOCKING;
   sm.input_slots.push_back(0);
   sm.input_maxcachenum.push_back(input_maxcachenum);
-  sm.output_slots.push_back(0);
+  if (!event_driven)
+    sm.output_slots.push_back(0);
   sm.process = do_decode;
   if (!InstallSlotMap(sm, name, -1)) {
     LOG("Fail to InstallSlotMap, %s\n", decoder_name);
     SetError(-EINVAL);
     return;
   }
-  if (decoder->SendInput(nullptr) < 0 && errno == ENOSYS)
-    support_async = false;
+}
+
+const int VideoDecoderFlow::kDecodedSlot;
+const int VideoDecoderFlow::kInputWaitMs;
+
+VideoDecoderFlow::~VideoDecoderFlow() {
+  if (event_driven) {
+    {
+      std::lock_guard<std::mutex> _lg(event_mtx);
+      event_quit = true;
+      event_cond.notify_all();
+    }
+    decoder->SetEventCallback(nullptr);
+  }
+  StopAllThread();
+}
+
+void VideoDecoderFlow::OnDecoderEvent(uint32_t events) {
+  if (events & Codec::kEventInput) {
+    std::lock_guard<std::mutex> _lg(event_mtx);
+    input_ready = true;
+    event_cond.notify_all();
+  }
+  if (events & Codec::kEventOutput) {
+    std::shared_ptr<MediaBuffer> output;
+    while ((output = decoder->FetchOutput()))
+      SendInput(output, kDecodedSlot);
+  }
 }
 
 bool do_decode(Flow *f, MediaBufferVector &input_vector) {
@@ -93,7 +154,23 @@ bool do_decode(Flow *f, MediaBufferVector &input_vector) {
     return false;
   bool ret = false;
   std::shared_ptr<MediaBuffer> output;
-  if (flow->support_async) {
+  if (flow->event_driven) {
+    // wait for the decoder to take it, the frames go down by the events
+    int send_ret = 0;
+    std::unique_lock<std::mutex> lock(flow->event_mtx);
+    while (!flow->event_quit) {
+      flow->input_ready = false;
+      lock.unlock();
+      send_ret = decoder->SendInput(in);
+      lock.lock();
+      if (send_ret != -EAGAIN)
+        break;
+      flow->event_cond.wait_for(
+          lock, std::chrono::milliseconds(VideoDecoderFlow::kInputWaitMs),
+          [flow] { return flow->input_ready || flow->event_quit; });
+    }
+    return send_ret == 0;
+  } else if (flow->support_async) {
     int send_ret = 0;
     do {
       send_ret = decoder->SendInput(in);
@@ -136,7 +136,7 @@ void FileReadFlow::ReadThreadRun() {
       else
         break;
     }
-    auto buffer = MediaBuffer::Alloc(alloc_size, mtype);
+    auto buffer = MediaBuffer::Alloc(alloc_size, mtype, "file_read_flow");
     if (!buffer) {
       LOG_NO_MEMORY();
       continue;
@@ -36,6 +36,19 @@ public:
   FilterFlow(const char *param);
   virtual ~FilterFlow() { StopAllThread(); }
   static const char *GetFlowName() { return "filter"; }
+  // forwarded to all the filters, done if any of them takes it
+  virtual int Control(unsigned long int request, ...) final {
+    va_list vl;
+    va_start(vl, request);
+    void *arg = va_arg(vl, void *);
+    va_end(vl);
+    int ret = -1;
+    for (auto &filter : filters) {
+      if (filter->IoCtrl(request, arg) >= 0)
+        ret = 0;
+    }
+    return ret;
+  }
 
 private:
   std::vector<std::shared_ptr<Filter>> filters;
@@ -112,8 +125,9 @@ FilterFlow::FilterFlow(const char *param)
         return;
       }
     }
-  } else {
-    LOG_TODO();
+  } else if (filters.size() > 1) {
+    // the outputs of an async filter come later than its input
+    LOG("async filter %s takes one input\n", filter_name);
     SetError(-EINVAL);
     return;
   }
@@ -142,8 +156,8 @@ bool do_filters(Flow *f, MediaBufferVector &input_vector) {
     } else {
       if (info.vir_width > 0 && info.vir_height > 0) {
         size_t size = CalPixFmtSize(info);
-        auto &&mb =
-            MediaBuffer::Alloc2(size, MediaBuffer::MemType::MEM_HARD_WARE);
+        auto &&mb = MediaBuffer::Alloc2(
+            size, MediaBuffer::MemType::MEM_HARD_WARE, "filter_flow");
         out_buffer = std::make_shared<ImageBuffer>(mb, info);
       } else {
         auto ib = std::make_shared<ImageBuffer>();
@@ -198,8 +212,7 @@ bool do_filters(Flow *f, MediaBufferVector &input_vector) {
       auto out = last_filter->FetchOutput();
       if (!out)
         break;
-      if (flow->hold_input)
-        FlowOutputHoldInput(out, input_vector);
+      // not of this input, the async filters hold their own inputs
       if (flow->SetOutput(out, 0))
         ret = true;
     } while (true);
@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <deque>
+
+#include "buffer.h"
+#include "buffer_pool.h"
+#include "flow.h"
+#include "image_mosaic.h"
+#include "key_string.h"
+#include "media_reflector.h"
+
+namespace easymedia {
+
+static bool compose(Flow *f, MediaBufferVector &input_vector);
+
+// N image inputs into the tiles of one output, KEY_FPS a second. The output
+// is of the time of the latest frame of the slowest input, each tile shows
+// the frame of its input nearest to it, of the last ones seen at the ticks.
+// The inputs are scaled by the cpu, so a nvr preview or a multi view encode
+// of many channels takes no rga pass per tile; only the tiles of new frames
+// are drawn. Params:
+//   KEY_OUTPUTDATATYPE, KEY_BUFFER_WIDTH, KEY_BUFFER_HEIGHT: the output
+//   KEY_MOSAIC_LAYOUT: the tiles, one input slot per tile in their order
+//   KEY_MOSAIC_BORDER, KEY_MOSAIC_BORDER_COLOR: the frame of each tile
+//   KEY_MOSAIC_PLACEHOLDER_COLOR: of the tiles without input, dark grey
+//   KEY_MOSAIC_TIMEOUT: ms, an input silent for longer shows the placeholder
+//   and its frames are released
+//   KEY_POOL_BUFFER_NUM, KEY_MEM_TYPE: the output buffers
+//   KEY_SCALE_MODE, KEY_THREAD_NUM: as swblit
+// Control:
+//   S_MOSAIC_BORDER: MosaicBorderArg
+class MosaicFlow : public Flow {
+public:
+  MosaicFlow(const char *param);
+  virtual ~MosaicFlow() { StopAllThread(); }
+  static const char *GetFlowName() { return "mosaic"; }
+  virtual int Control(unsigned long int request, ...) final;
+
+private:
+#if defined(LIBION) || defined(LIBDRM)
+  static const MediaBuffer::MemType kDefaultMemType =
+      MediaBuffer::MemType::MEM_HARD_WARE;
+#else
+  static const MediaBuffer::MemType kDefaultMemType =
+      MediaBuffer::MemType::MEM_COMMON;
+#endif
+  // one being composed, one downstream, one kept as the last output
+  static const int kDefaultPoolBufferNum = 3;
+  static const int kDefaultTimeout = 1000;
+
+  ImageInfo out_info;
+  std::unique_ptr<ImageMosaic> mosaic;
+  std::shared_ptr<BufferPool> pool;
+  int timeout;
+  // the frames kept of an input for the alignment, the upstream pools are
+  // not starved
+  static const size_t kMaxFrames = 3;
+
+  struct Frame {
+    std::shared_ptr<MediaBuffer> buffer;
+    uint64_t seq;
+  };
+  // drop the frame of the atomic input slot, unless a newer one came
+  void ReleaseInput(int index, const std::shared_ptr<MediaBuffer> &stale);
+
+  // the recent frames of each tile, the oldest first, and when the last came
+  std::vector<std::deque<Frame>> frames;
+  std::vector<uint64_t> seqs;
+  std::vector<int64_t> arrivals;
+
+  friend bool compose(Flow *f, MediaBufferVector &input_vector);
+};
+
+static uint32_t get_color(const std::string &value, uint32_t def) {
+  return value.empty() ? def : (uint32_t)std::stoul(value, nullptr, 0);
+}
+
+MosaicFlow::MosaicFlow(const char *param) : timeout(kDefaultTimeout) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  if (params[KEY_BUFFER_VIR_WIDTH].empty())
+    params[KEY_BUFFER_VIR_WIDTH] = params[KEY_BUFFER_WIDTH];
+  if (params[KEY_BUFFER_VIR_HEIGHT].empty())
+    params[KEY_BUFFER_VIR_HEIGHT] = params[KEY_BUFFER_HEIGHT];
+  if (!ParseImageInfoFromMap(params, out_info, false)) {
+    SetError(-EINVAL);
+    return;
+  }
+  auto &&tiles = ImageMosaic::ParseLayout(params[KEY_MOSAIC_LAYOUT],
+                                          out_info.width, out_info.height);
+  if (tiles.empty()) {
+    LOG("missing %s\n", KEY_MOSAIC_LAYOUT);
+    SetError(-EINVAL);
+    return;
+  }
+  int num = tiles.size();
+  mosaic.reset(new ImageMosaic(tiles));
+  const std::string &border = params[KEY_MOSAIC_BORDER];
+  if (!border.empty())
+    mosaic->SetBorder(-1, std::stoi(border),
+                      get_color(params[KEY_MOSAIC_BORDER_COLOR], 0xFFFFFF));
+  const std::string &placeholder = params[KEY_MOSAIC_PLACEHOLDER_COLOR];
+  if (!placeholder.empty())
+    mosaic->SetPlaceholder(get_color(placeholder, 0));
+  mosaic->SetScaleMode(GetScaleModeByString(params[KEY_SCALE_MODE].c_str()));
+  const std::string &threads = params[KEY_THREAD_NUM];
+  if (!threads.empty())
+    mosaic->SetThreads(std::stoi(threads));
+  const std::string &stimeout = params[KEY_MOSAIC_TIMEOUT];
+  if (!stimeout.empty())
+    timeout = std::stoi(stimeout);
+
+  const std::string &snum = params[KEY_POOL_BUFFER_NUM];
+  int pool_num = snum.empty() ? kDefaultPoolBufferNum : std::stoi(snum);
+  const std::string &mem_type = params[KEY_MEM_TYPE];
+  MediaBuffer::MemType type =
+      mem_type.empty() ? kDefaultMemType : StringToMemType(mem_type.c_str());
+  pool = std::make_shared<BufferPool>(pool_num, CalPixFmtSize(out_info), type,
+                                      "mosaic");
+  if (!pool || pool->GetNum() == 0) {
+    LOG("Fail to allocate the mosaic buffers\n");
+    SetError(-ENOMEM);
+    return;
+  }
+  frames.resize(num);
+  seqs.assign(num, 0);
+  arrivals.assign(num, 0);
+
+  SlotMap sm;
+  int input_maxcachenum = 1;
+  ParseParamToSlotMap(params, sm, input_maxcachenum);
+  if (params[KEY_FPS].empty())
+    sm.interval = 40;
+  // the latest frame of every input at each tick
+  sm.thread_model = Model::ASYNCATOMIC;
+  sm.mode_when_full = InputMode::DROPFRONT;
+  for (int i = 0; i < num; i++) {
+    sm.input_slots.push_back(i);
+    sm.input_maxcachenum.push_back(input_maxcachenum);
+  }
+  sm.output_slots.push_back(0);
+  sm.process = compose;
+  if (!InstallSlotMap(sm, GetFlowName(), -1)) {
+    LOG("Fail to InstallSlotMap, mosaic\n");
+    SetError(-EINVAL);
+    return;
+  }
+}
+
+int MosaicFlow::Control(unsigned long int request, ...) {
+  va_list vl;
+  va_start(vl, request);
+  void *arg = va_arg(vl, void *);
+  va_end(vl);
+  if (!arg)
+    return -EINVAL;
+  switch (request) {
+  case S_MOSAIC_BORDER: {
+    auto ba = static_cast<MosaicBorderArg *>(arg);
+    mosaic->SetBorder(ba->tile, ba->width, ba->color);
+    return 0;
+  }
+  default:
+    return -1;
+  }
+}
+
+void MosaicFlow::ReleaseInput(int index,
+                              const std::shared_ptr<MediaBuffer> &stale) {
+  auto &input = v_input[index];
+  AutoLockMutex _alm(input.spin_mtx);
+  if (input.cached_buffer == stale)
+    input.cached_buffer.reset();
+}
+
+static bool get_cpu_image(ImageBuffer *ib, CpuImage &img) {
+  ImagePlane planes[IMAGE_MAX_PLANES];
+  uint8_t *data[IMAGE_MAX_PLANES];
+  int num = ib->GetPlanes(planes);
+  return ib->GetPlanePtrs(data) == num &&
+         GetCpuImage(img, data, ib->GetImageInfo(), planes, num);
+}
+
+bool compose(Flow *f, MediaBufferVector &input_vector) {
+  MosaicFlow *mf = static_cast<MosaicFlow *>(f);
+  size_t num = mf->frames.size();
+  int64_t now = gettimeofday();
+  std::vector<CpuImage> imgs(num);
+  std::vector<ImageMosaic::Input> inputs(num, {nullptr, 0});
+  std::vector<std::shared_ptr<ImageBuffer>> used;
+  int64_t timestamp = INT64_MAX;
+  for (size_t i = 0; i < num; i++) {
+    auto &in = input_vector[i];
+    auto &list = mf->frames[i];
+    // the atomic input gives the same frame until a new one comes
+    if (in && in->GetType() == Type::Image &&
+        (list.empty() || in != list.back().buffer)) {
+      list.push_back({in, ++mf->seqs[i]});
+      if (list.size() > MosaicFlow::kMaxFrames)
+        list.pop_front();
+      mf->arrivals[i] = now;
+    }
+    if (!list.empty() && mf->timeout > 0 &&
+        now - mf->arrivals[i] > mf->timeout) {
+      // silent, back to the placeholder, the frames go back to their pools
+      mf->ReleaseInput(i, in);
+      in.reset();
+      list.clear();
+    }
+    if (!list.empty())
+      timestamp = std::min(timestamp, list.back().buffer->GetTimeStamp());
+  }
+  for (size_t i = 0; i < num; i++) {
+    auto &list = mf->frames[i];
+    if (list.empty())
+      continue;
+    // the newer one of the nearest, the older ones are never taken again
+    auto nearest = list.begin();
+    for (auto it = list.begin(); it != list.end(); it++) {
+      if (std::abs(it->buffer->GetTimeStamp() - timestamp) <=
+          std::abs(nearest->buffer->GetTimeStamp() - timestamp))
+        nearest = it;
+    }
+    list.erase(list.begin(), nearest);
+    auto ib = std::static_pointer_cast<ImageBuffer>(list.front().buffer);
+    if (!get_cpu_image(ib.get(), imgs[i]))
+      continue;
+    inputs[i] = {&imgs[i], list.front().seq};
+    used.push_back(ib);
+  }
+  auto mb = mf->pool->Get();
+  if (!mb)
+    return false; // all downstream, skip the tick
+  auto out = std::make_shared<ImageBuffer>(*mb, mf->out_info);
+  if (!out) {
+    LOG_NO_MEMORY();
+    return false;
+  }
+  out->SetRelatedSPtr(mb);
+  CpuImage dst;
+  if (!GetCpuImage(dst, out->GetPtr(), mf->out_info))
+    return false;
+  for (auto &ib : used)
+    ib->BeginCPUAccess(true, false);
+  out->BeginCPUAccess(false, true);
+  int ret = mf->mosaic->Compose(dst, (uintptr_t)out->GetPtr(), inputs);
+  out->EndCPUAccess(false, true);
+  for (auto &ib : used)
+    ib->EndCPUAccess(true, false);
+  if (ret)
+    return false;
+  out->SetTimeStamp(used.empty() ? now : timestamp);
+  return mf->SetOutput(out, 0);
+}
+
+DEFINE_FLOW_FACTORY(MosaicFlow, Flow)
+const char *FACTORY(MosaicFlow)::ExpectedInputDataType() { return ""; }
+const char *FACTORY(MosaicFlow)::OutPutDataType() { return ""; }
+
+} // namespace easymedia
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "buffer.h"
+#include "buffer_pool.h"
+#include "flow.h"
+#include "key_string.h"
+#include "media_reflector.h"
+#include "nn_cascade.h"
+
+namespace easymedia {
+
+static bool do_cascade(Flow *f, MediaBufferVector &input_vector);
+
+// Runs a second model on the crops of the detections of a first one, by
+// batches, see NNCascade. The input is a Type::Detection buffer, such as the
+// output of nnpostprocess, see nn_detection.h. The output is a Type::NNResult
+// as the rknn filter's, of the timestamp of the frame; each tensor has the
+// results of the crops one after another, of NNCascade::GetCropOutputSize
+// bytes each, its attr of the dims [crops, ...], and GetRelatedSPtrs()[0] is
+// a buffer of these crops of the frame. Params:
+//   KEY_NN_BACKEND: as the rknn filter, which takes the param too
+//   KEY_NN_CASCADE_MAX_CROPS: of a frame, 16 if not set
+//   KEY_TENSOR_CHANNEL_ORDER, KEY_TENSOR_MEAN, ..., KEY_LETTERBOX_COLOR: the
+//   crops as nnpreprocess, their size, type and format are the model's
+//   KEY_COLOR_MATRIX, KEY_COLOR_RANGE, KEY_THREAD_NUM: as nnpreprocess
+//   KEY_OUTPUT_WANT_FLOAT: as the rknn filter
+//   KEY_POOL_BUFFER_NUM: the output buffers of each tensor, 2 if not set
+class NNCascadeFlow : public Flow {
+public:
+  NNCascadeFlow(const char *param);
+  virtual ~NNCascadeFlow() { StopAllThread(); }
+  static const char *GetFlowName() { return "nncascade"; }
+
+private:
+  static const int kDefaultMaxCrops = 16;
+  static const int kDefaultPoolBufferNum = 2;
+
+  std::unique_ptr<NNCascade> cascade;
+  std::vector<std::shared_ptr<BufferPool>> pools;
+
+  friend bool do_cascade(Flow *f, MediaBufferVector &input_vector);
+};
+
+NNCascadeFlow::NNCascadeFlow(const char *param) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  std::string backend_name = params[KEY_NN_BACKEND];
+  if (backend_name.empty())
+    backend_name = "rknn";
+  auto backend =
+      REFLECTOR(NNBackend)::Create<NNBackend>(backend_name.c_str(), param);
+  if (!backend) {
+    LOG("Fail to create nn backend %s\n", backend_name.c_str());
+    SetError(-EINVAL);
+    return;
+  }
+  TensorSpec spec;
+  if (!ParseTensorSpecFromMap(params, spec)) {
+    SetError(-EINVAL);
+    return;
+  }
+  int max_crops = kDefaultMaxCrops;
+  const std::string &mc = params[KEY_NN_CASCADE_MAX_CROPS];
+  if (!mc.empty())
+    max_crops = std::stoi(mc);
+  std::vector<bool> want_float;
+  const std::string &wf = params[KEY_OUTPUT_WANT_FLOAT];
+  if (!wf.empty()) {
+    std::list<std::string> value_list;
+    if (!parse_media_param_list(wf.c_str(), value_list, ',')) {
+      SetError(-EINVAL);
+      return;
+    }
+    for (auto &s : value_list)
+      want_float.push_back(!!std::stoi(s));
+  }
+  cascade.reset(new NNCascade(backend, spec, max_crops, want_float));
+  if (!cascade->Init()) {
+    SetError(-EINVAL);
+    return;
+  }
+  cascade->SetColorMatrix(GetYuvMatrixByString(
+      params[KEY_COLOR_MATRIX].c_str(), params[KEY_COLOR_RANGE].c_str()));
+  const std::string &threads = params[KEY_THREAD_NUM];
+  if (!threads.empty())
+    cascade->SetThreads(std::stoi(threads));
+  int num = kDefaultPoolBufferNum;
+  const std::string &pn = params[KEY_POOL_BUFFER_NUM];
+  if (!pn.empty())
+    num = std::stoi(pn);
+  for (size_t i = 0; i < cascade->GetOutputAttrs().size(); i++)
+    pools.push_back(num > 0 ? std::make_shared<BufferPool>(
+                                  num, cascade->GetOutputSize(i),
+                                  MediaBuffer::MemType::MEM_COMMON,
+                                  "nncascade")
+                            : nullptr);
+
+  SlotMap sm;
+  int input_maxcachenum = 2;
+  ParseParamToSlotMap(params, sm, input_maxcachenum);
+  if (sm.thread_model == Model::NONE)
+    sm.thread_model = Model::ASYNCCOMMON;
+  if (sm.mode_when_full == InputMode::NONE)
+    sm.mode_when_full = InputMode::DROPFRONT;
+  sm.input_slots.push_back(0);
+  sm.input_maxcachenum.push_back(input_maxcachenum);
+  sm.output_slots.push_back(0);
+  sm.process = do_cascade;
+  if (!InstallSlotMap(sm, GetFlowName(), -1)) {
+    LOG("Fail to InstallSlotMap, nncascade\n");
+    SetError(-EINVAL);
+    return;
+  }
+}
+
+static bool get_cpu_image(ImageBuffer *ib, CpuImage &img) {
+  ImagePlane planes[IMAGE_MAX_PLANES];
+  uint8_t *data[IMAGE_MAX_PLANES];
+  int num = ib->GetPlanes(planes);
+  return ib->GetPlanePtrs(data) == num &&
+         GetCpuImage(img, data, ib->GetImageInfo(), planes, num);
+}
+
+bool do_cascade(Flow *f, MediaBufferVector &input_vector) {
+  NNCascadeFlow *flow = static_cast<NNCascadeFlow *>(f);
+  auto &in = input_vector[0];
+  if (!in || in->GetRelatedSPtrs().empty())
+    return false;
+  auto frame = std::static_pointer_cast<MediaBuffer>(in->GetRelatedSPtrs()[0]);
+  if (!frame || frame->GetType() != Type::Image)
+    return false;
+  auto ib = std::static_pointer_cast<ImageBuffer>(frame);
+  CpuImage img;
+  if (!get_cpu_image(ib.get(), img))
+    return false;
+  int num = 0;
+  const NNDetection *dets = GetDetections(*in, num);
+  if (num < 0) {
+    LOG("nncascade takes the Type::Detection buffers\n");
+    return false;
+  }
+  std::vector<NNDetection> detections(dets, dets + num);
+
+  auto outs = std::make_shared<NNResultMeta>();
+  NNCascade *cascade = flow->cascade.get();
+  for (size_t i = 0; i < flow->pools.size(); i++) {
+    size_t size = cascade->GetOutputSize(i);
+    std::shared_ptr<MediaBuffer> mb =
+        flow->pools[i] ? flow->pools[i]->Get() : nullptr;
+    if (!mb)
+      mb = MediaBuffer::Alloc(size, MediaBuffer::MemType::MEM_COMMON,
+                              "nncascade");
+    if (!mb || !mb->GetPtr()) {
+      LOG_NO_MEMORY();
+      return false;
+    }
+    NNOutput o;
+    memset(&o, 0, sizeof(o));
+    o.buf = mb->GetPtr();
+    o.size = size;
+    outs->outputs.push_back(o);
+    outs->memory.push_back(mb);
+  }
+  auto crops = std::make_shared<std::vector<NNDetection>>();
+  ib->BeginCPUAccess(true, false);
+  int runs = cascade->Run(img, detections, *crops, outs->outputs);
+  ib->EndCPUAccess(true, false);
+  if (runs < 0)
+    return false;
+  for (size_t i = 0; i < outs->outputs.size(); i++) {
+    NNTensorAttr attr = GetNNOutputAttr(cascade->GetOutputAttrs()[i],
+                                        outs->outputs[i].want_float);
+    uint32_t n = crops->size();
+    attr.n_elems = attr.n_elems / cascade->GetBatch() * n;
+    attr.size = outs->outputs[i].size;
+    if (!attr.dims.empty())
+      attr.dims[0] = n;
+    outs->attrs.push_back(attr);
+  }
+
+  auto crop_buffer = std::make_shared<MediaBuffer>(
+      crops->data(), crops->size() * sizeof(NNDetection));
+  crop_buffer->SetUserData(crops);
+  crop_buffer->SetValidSize(crops->size());
+  crop_buffer->SetTimeStamp(frame->GetTimeStamp());
+  crop_buffer->SetRelatedSPtr(frame, 0);
+  auto out = std::make_shared<MediaBuffer>(
+      outs->outputs.data(), outs->outputs.size() * sizeof(NNOutput));
+  out->SetUserData(outs);
+  out->SetType(Type::NNResult);
+  out->SetValidSize(outs->outputs.size());
+  out->SetTimeStamp(frame->GetTimeStamp());
+  out->SetRelatedSPtr(crop_buffer, 0);
+  return flow->SetOutput(out, 0);
+}
+
+DEFINE_FLOW_FACTORY(NNCascadeFlow, Flow)
+const char *FACTORY(NNCascadeFlow)::ExpectedInputDataType() { return ""; }
+const char *FACTORY(NNCascadeFlow)::OutPutDataType() { return ""; }
+
+} // namespace easymedia
@@ -25,6 +25,7 @@
 #include "flow.h"
 
 #include "buffer.h"
+#include "buffer_pool.h"
 #include "media_type.h"
 
 namespace easymedia {
@@ -41,19 +42,63 @@ public:
   static const char *GetFlowName() { return "video_enc"; }
 
 private:
+#if defined(LIBION) || defined(LIBDRM)
+  static const int kDefaultPoolBufferNum = 4;
+#else
+  static const int kDefaultPoolBufferNum = 0; // no memory for the encoder
+#endif
+
+  bool OutputEncoded();
+  bool InitOutputPool(std::map<std::string, std::string> &params,
+                      const MediaConfig &mc);
+
   std::shared_ptr<VideoEncoder> enc;
   bool extra_output;
+  // frame N+1 goes into the encoder while frame N is still encoding
+  bool async;
+  // the encoder writes into them directly, downstream takes them as they are
+  std::shared_ptr<BufferPool> output_pool;
   std::list<std::shared_ptr<MediaBuffer>> extra_buffer_list;
 
   friend bool encode(Flow *f, MediaBufferVector &input_vector);
 };
 
+bool VideoEncoderFlow::OutputEncoded() {
+  bool ret = true;
+  std::shared_ptr<MediaBuffer> dst;
+  while ((dst = enc->FetchOutput()))
+    ret &= SetOutput(dst, 0);
+  if (errno) {
+    LOG("encoder failed to fetch output, %m\n");
+    return false;
+  }
+  return ret;
+}
+
 bool encode(Flow *f, MediaBufferVector &input_vector) {
   VideoEncoderFlow *vf = (VideoEncoderFlow *)f;
   std::shared_ptr<VideoEncoder> enc = vf->enc;
   std::shared_ptr<MediaBuffer> &src = input_vector[0];
   std::shared_ptr<MediaBuffer> dst, extra_dst;
-  dst = std::make_shared<MediaBuffer>(); // TODO: buffer pool
+  if (vf->async) {
+    int ret;
+    while ((ret = enc->SendInput(src)) == -EAGAIN) {
+      // the pipeline is full, the oldest frame comes out first
+      if (!vf->OutputEncoded())
+        return false;
+    }
+    if (ret) {
+      LOG("encoder failed\n");
+      return false;
+    }
+    return vf->OutputEncoded();
+  }
+  if (vf->output_pool)
+    dst = vf->output_pool->Get();
+  if (dst)
+    dst->SetValidSize(dst->GetSize()); // written by the encoder
+  else
+    dst = std::make_shared<MediaBuffer>();
   if (!dst) {
     LOG_NO_MEMORY();
     return false;
@@ -76,7 +121,44 @@ bool encode(Flow *f, MediaBufferVector &input_vector) {
   return ret;
 }
 
-VideoEncoderFlow::VideoEncoderFlow(const char *param) : extra_output(false) {
+bool VideoEncoderFlow::InitOutputPool(
+    std::map<std::string, std::string> &params, const MediaConfig &mc) {
+  const std::string &snum = params[KEY_POOL_BUFFER_NUM];
+  int num = snum.empty() ? kDefaultPoolBufferNum : std::stoi(snum);
+  if (num <= 0)
+    return true;
+  const std::string &mem_type = params[KEY_MEM_TYPE];
+  MediaBuffer::MemType type =
+      StringToMemType(mem_type.empty() ? KEY_MEM_HARDWARE : mem_type.c_str());
+  if (type == MediaBuffer::MemType::MEM_COMMON) {
+    LOG("the encoder copies to the common memory, no output pool\n");
+    return true;
+  }
+  long size = 0;
+  const std::string &ssize = params[KEY_POOL_BUFFER_SIZE];
+  if (!ssize.empty()) {
+    size = std::stol(ssize);
+  } else {
+    // the raw frame, an encoded one is hardly bigger
+    const ImageInfo &info = (params[KEY_OUTPUTDATATYPE] == IMAGE_JPEG)
+                                ? mc.img_cfg.image_info
+                                : mc.vid_cfg.image_cfg.image_info;
+    size = CalPixFmtSize(info);
+  }
+  if (size <= 0)
+    return false;
+  output_pool = std::make_shared<BufferPool>(num, size, type, "video_enc");
+  if (!output_pool || output_pool->GetNum() == 0) {
+    LOG("Fail to allocate the output pool, %d x %ld\n", num, size);
+    output_pool.reset();
+    return true; // mpp allocates
+  }
+  enc->SetOutputPool(output_pool);
+  return true;
+}
+
+VideoEncoderFlow::VideoEncoderFlow(const char *param)
+    : extra_output(false), async(false) {
   // TODO: ParseWrapFlowParams
   std::map<std::string, std::string> params;
   if (!parse_media_param_map(param, params)) {
@@ -146,6 +228,15 @@ VideoEncoderFlow::VideoEncoderFlow(const char *param) : extra_output(false) {
     extra_output = true;
     sm.output_slots.push_back(1);
   }
+  // the async path has no extra output, the encoder takes it only if
+  // KEY_MPP_ASYNC_DEPTH of its codec param is set
+  if (!extra_output && enc->SendInput(nullptr) == 0)
+    async = true;
+  if (!InitOutputPool(params, mc)) {
+    LOG("Invalid output pool of %s\n", ccodec_name);
+    SetError(-EINVAL);
+    return;
+  }
   sm.process = encode;
   sm.thread_model = Model::ASYNCCOMMON;
   sm.mode_when_full = InputMode::DROPFRONT;
@@ -0,0 +1,1222 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "h26x_parser.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "bit_reader.h"
+#include "buffer.h"
+
+namespace easymedia {
+
+static const int sar_table[][2] = {
+    {0, 0},   {1, 1},   {12, 11}, {10, 11}, {16, 11},  {40, 33},
+    {24, 11}, {20, 11}, {32, 11}, {80, 33}, {18, 11},  {15, 11},
+    {64, 33}, {160, 99}, {4, 3},  {3, 2},   {2, 1}};
+
+static void reset_vui(VideoUsability &vui) {
+  memset(&vui, 0, sizeof(vui));
+  vui.colour_primaries = 2;
+  vui.transfer_characteristics = 2;
+  vui.matrix_coefficients = 2;
+  vui.max_num_reorder_frames = -1;
+}
+
+// The head of vui_parameters() which is the same in h264 and h265.
+static void parse_vui_common(BitReader &br, VideoUsability &vui) {
+  if (br.ReadFlag()) { // aspect_ratio_info_present_flag
+    uint32_t idc = br.ReadBits(8);
+    if (idc == 255) {
+      vui.sar_width = br.ReadBits(16);
+      vui.sar_height = br.ReadBits(16);
+    } else if (idc < ARRAY_ELEMS(sar_table)) {
+      vui.sar_width = sar_table[idc][0];
+      vui.sar_height = sar_table[idc][1];
+    }
+  }
+  if (br.ReadFlag()) // overscan_info_present_flag
+    br.ReadBit();
+  if (br.ReadFlag()) { // video_signal_type_present_flag
+    br.ReadBits(3);
+    vui.full_range = br.ReadFlag();
+    if (br.ReadFlag()) { // colour_description_present_flag
+      vui.colour_primaries = br.ReadBits(8);
+      vui.transfer_characteristics = br.ReadBits(8);
+      vui.matrix_coefficients = br.ReadBits(8);
+    }
+  }
+  if (br.ReadFlag()) { // chroma_loc_info_present_flag
+    br.ReadUE();
+    br.ReadUE();
+  }
+}
+
+// sei_rbsp(), only the recovery point is kept
+static int parse_sei(BitReader &br, NalCodec codec, NalUnitInfo &info) {
+  do {
+    size_t type = 0, size = 0;
+    uint32_t b;
+    do {
+      b = br.ReadBits(8);
+      type += b;
+    } while (b == 0xFF && !br.Error());
+    do {
+      b = br.ReadBits(8);
+      size += b;
+    } while (b == 0xFF && !br.Error());
+    if (br.Error())
+      return -EINVAL;
+    size_t start = br.BitPosition();
+    if (type == 6) {
+      info.recovery_point = true;
+      if (codec == NalCodec::H264)
+        info.recovery_frame_cnt = br.ReadUE();
+      else
+        info.recovery_frame_cnt = br.ReadSE();
+      info.exact_match = br.ReadFlag();
+      info.broken_link = br.ReadFlag();
+    }
+    size_t used = br.BitPosition() - start;
+    if (used > size * 8)
+      return -EINVAL;
+    br.SkipBits(size * 8 - used);
+    if (br.Error())
+      return -EINVAL;
+  } while (br.MoreRbspData());
+  return 0;
+}
+
+static inline bool is_h264_high_profile(int profile_idc) {
+  switch (profile_idc) {
+  case 100:
+  case 110:
+  case 122:
+  case 244:
+  case 44:
+  case 83:
+  case 86:
+  case 118:
+  case 128:
+  case 138:
+  case 139:
+  case 134:
+  case 135:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static void skip_h264_scaling_list(BitReader &br, int size) {
+  int last = 8, next = 8;
+  for (int j = 0; j < size && !br.Error(); j++) {
+    if (next)
+      next = (last + br.ReadSE() + 256) % 256;
+    last = next ? next : last;
+  }
+}
+
+static bool skip_h264_hrd(BitReader &br) {
+  uint32_t cpb_cnt = br.ReadUE() + 1;
+  if (cpb_cnt > 32)
+    return false;
+  br.ReadBits(8); // bit_rate_scale, cpb_size_scale
+  for (uint32_t i = 0; i < cpb_cnt; i++) {
+    br.ReadUE();
+    br.ReadUE();
+    br.ReadBit();
+  }
+  br.ReadBits(20); // the four delay lengths
+  return true;
+}
+
+static bool parse_h264_vui(BitReader &br, VideoUsability &vui) {
+  parse_vui_common(br, vui);
+  vui.timing_info_present = br.ReadFlag();
+  if (vui.timing_info_present) {
+    vui.num_units_in_tick = br.ReadBits(32);
+    vui.time_scale = br.ReadBits(32);
+    vui.fixed_frame_rate = br.ReadFlag();
+  }
+  bool nal_hrd = br.ReadFlag();
+  if (nal_hrd && !skip_h264_hrd(br))
+    return false;
+  bool vcl_hrd = br.ReadFlag();
+  if (vcl_hrd && !skip_h264_hrd(br))
+    return false;
+  if (nal_hrd || vcl_hrd)
+    br.ReadBit(); // low_delay_hrd_flag
+  br.ReadBit();   // pic_struct_present_flag
+  if (br.ReadFlag()) { // bitstream_restriction_flag
+    br.ReadBit();
+    for (int i = 0; i < 4; i++)
+      br.ReadUE();
+    vui.max_num_reorder_frames = br.ReadUE();
+    br.ReadUE(); // max_dec_frame_buffering
+  }
+  return !br.Error();
+}
+
+static int parse_h264_sps(BitReader &br, H264SPS &s) {
+  memset(&s, 0, sizeof(s));
+  reset_vui(s.vui);
+  s.profile_idc = br.ReadBits(8);
+  s.constraint_flags = br.ReadBits(8);
+  s.level_idc = br.ReadBits(8);
+  uint32_t id = br.ReadUE();
+  if (id >= (uint32_t)H264Parser::kMaxSPS)
+    return -EINVAL;
+  s.sps_id = id;
+  s.chroma_format_idc = 1;
+  s.bit_depth_luma = s.bit_depth_chroma = 8;
+  if (is_h264_high_profile(s.profile_idc)) {
+    uint32_t chroma = br.ReadUE();
+    if (chroma > 3)
+      return -EINVAL;
+    s.chroma_format_idc = chroma;
+    if (chroma == 3)
+      s.separate_colour_plane = br.ReadFlag();
+    uint32_t luma_depth = br.ReadUE() + 8, chroma_depth = br.ReadUE() + 8;
+    if (luma_depth > 14 || chroma_depth > 14)
+      return -EINVAL;
+    s.bit_depth_luma = luma_depth;
+    s.bit_depth_chroma = chroma_depth;
+    br.ReadBit(); // qpprime_y_zero_transform_bypass_flag
+    if (br.ReadFlag()) { // seq_scaling_matrix_present_flag
+      for (int i = 0; i < (chroma != 3 ? 8 : 12); i++) {
+        if (br.ReadFlag())
+          skip_h264_scaling_list(br, i < 6 ? 16 : 64);
+      }
+    }
+  }
+  uint32_t v = br.ReadUE() + 4;
+  if (v > 16)
+    return -EINVAL;
+  s.log2_max_frame_num = v;
+  v = br.ReadUE();
+  if (v > 2)
+    return -EINVAL;
+  s.pic_order_cnt_type = v;
+  if (s.pic_order_cnt_type == 0) {
+    v = br.ReadUE() + 4;
+    if (v > 16)
+      return -EINVAL;
+    s.log2_max_poc_lsb = v;
+  } else if (s.pic_order_cnt_type == 1) {
+    s.delta_pic_order_always_zero = br.ReadFlag();
+    s.offset_for_non_ref_pic = br.ReadSE();
+    s.offset_for_top_to_bottom_field = br.ReadSE();
+    v = br.ReadUE();
+    if (v > 255)
+      return -EINVAL;
+    s.num_ref_frames_in_poc_cycle = v;
+    for (int i = 0; i < s.num_ref_frames_in_poc_cycle; i++)
+      s.offset_for_ref_frame[i] = br.ReadSE();
+  }
+  s.max_num_ref_frames = br.ReadUE();
+  br.ReadBit(); // gaps_in_frame_num_value_allowed_flag
+  uint32_t mb_width = br.ReadUE() + 1, map_units = br.ReadUE() + 1;
+  s.frame_mbs_only = br.ReadFlag();
+  if (!s.frame_mbs_only)
+    s.mb_adaptive_frame_field = br.ReadFlag();
+  s.mb_width = mb_width;
+  s.mb_height = map_units * (2 - s.frame_mbs_only);
+  // level 6.2 allows 139264 mbs, no side over 16384 pixels
+  if (mb_width > 1024 || map_units > 1024 || s.mb_height > 1024)
+    return -EINVAL;
+  br.ReadBit(); // direct_8x8_inference_flag
+  uint32_t crop[4] = {0, 0, 0, 0};
+  if (br.ReadFlag()) { // frame_cropping_flag
+    for (int i = 0; i < 4; i++)
+      crop[i] = br.ReadUE();
+  }
+  int chroma_array_type = s.separate_colour_plane ? 0 : s.chroma_format_idc;
+  int crop_x = 1, crop_y = 2 - s.frame_mbs_only;
+  if (chroma_array_type) {
+    crop_x = chroma_array_type == 3 ? 1 : 2;
+    crop_y *= chroma_array_type == 1 ? 2 : 1;
+  }
+  int coded_width = s.mb_width * 16, coded_height = s.mb_height * 16;
+  uint64_t crop_w = (uint64_t)crop_x * (crop[0] + (uint64_t)crop[1]);
+  uint64_t crop_h = (uint64_t)crop_y * (crop[2] + (uint64_t)crop[3]);
+  if (crop_w >= (uint64_t)coded_width || crop_h >= (uint64_t)coded_height)
+    return -EINVAL;
+  s.crop_left = crop_x * crop[0];
+  s.crop_right = crop_x * crop[1];
+  s.crop_top = crop_y * crop[2];
+  s.crop_bottom = crop_y * crop[3];
+  s.width = coded_width - s.crop_left - s.crop_right;
+  s.height = coded_height - s.crop_top - s.crop_bottom;
+  if (br.Error())
+    return -EINVAL;
+  s.vui_present = br.ReadFlag();
+  if (s.vui_present && !parse_h264_vui(br, s.vui)) {
+    // some encoders write a truncated vui, keep the sps without it
+    s.vui_present = false;
+    reset_vui(s.vui);
+  }
+  s.valid = true;
+  return 0;
+}
+
+static int parse_h264_pps(BitReader &br, H264PPS &p) {
+  memset(&p, 0, sizeof(p));
+  uint32_t pps_id = br.ReadUE(), sps_id = br.ReadUE();
+  if (pps_id >= (uint32_t)H264Parser::kMaxPPS ||
+      sps_id >= (uint32_t)H264Parser::kMaxSPS)
+    return -EINVAL;
+  p.pps_id = pps_id;
+  p.sps_id = sps_id;
+  p.entropy_coding_mode = br.ReadFlag();
+  p.bottom_field_pic_order_in_frame_present = br.ReadFlag();
+  uint32_t groups = br.ReadUE() + 1;
+  if (groups > 8)
+    return -EINVAL;
+  p.num_slice_groups = groups;
+  if (groups > 1) {
+    uint32_t map_type = br.ReadUE();
+    if (map_type == 0) {
+      for (uint32_t i = 0; i < groups; i++)
+        br.ReadUE(); // run_length_minus1
+    } else if (map_type == 2) {
+      for (uint32_t i = 0; i < groups - 1; i++) {
+        br.ReadUE(); // top_left
+        br.ReadUE(); // bottom_right
+      }
+    } else if (map_type >= 3 && map_type <= 5) {
+      br.ReadBit();
+      br.ReadUE();
+    } else if (map_type == 6) {
+      uint32_t map_units = br.ReadUE() + 1;
+      if (map_units > 139264)
+        return -EINVAL;
+      int bits = 0;
+      while ((1u << bits) < groups)
+        bits++;
+      br.SkipBits((size_t)map_units * bits);
+    } else if (map_type > 6) {
+      return -EINVAL;
+    }
+  }
+  uint32_t l0 = br.ReadUE() + 1, l1 = br.ReadUE() + 1;
+  if (l0 > 32 || l1 > 32)
+    return -EINVAL;
+  p.num_ref_idx_l0_default_active = l0;
+  p.num_ref_idx_l1_default_active = l1;
+  p.weighted_pred = br.ReadFlag();
+  p.weighted_bipred_idc = br.ReadBits(2);
+  p.pic_init_qp = 26 + br.ReadSE();
+  br.ReadSE(); // pic_init_qs_minus26
+  br.ReadSE(); // chroma_qp_index_offset
+  p.deblocking_filter_control_present = br.ReadFlag();
+  p.constrained_intra_pred = br.ReadFlag();
+  p.redundant_pic_cnt_present = br.ReadFlag();
+  if (br.Error())
+    return -EINVAL;
+  if (br.MoreRbspData())
+    p.transform_8x8_mode = br.ReadFlag();
+  p.valid = true;
+  return 0;
+}
+
+static bool skip_h264_ref_pic_list_modification(BitReader &br) {
+  if (!br.ReadFlag())
+    return true;
+  for (int n = 0; n <= 32 && !br.Error(); n++) {
+    uint32_t idc = br.ReadUE();
+    if (idc == 3)
+      return true;
+    if (idc > 5)
+      return false;
+    br.ReadUE(); // abs_diff_pic_num_minus1, long_term_pic_num, ...
+  }
+  return false;
+}
+
+static void skip_h264_pred_weight_table(BitReader &br, int chroma_array_type,
+                                        int num_l0, int num_l1) {
+  br.ReadUE(); // luma_log2_weight_denom
+  if (chroma_array_type)
+    br.ReadUE();
+  for (int num : {num_l0, num_l1}) {
+    for (int i = 0; i < num; i++) {
+      if (br.ReadFlag()) { // luma_weight_flag
+        br.ReadSE();
+        br.ReadSE();
+      }
+      if (chroma_array_type && br.ReadFlag()) {
+        for (int j = 0; j < 4; j++)
+          br.ReadSE();
+      }
+    }
+  }
+}
+
+H264Parser::H264Parser()
+    : NalParser(NalCodec::H264), sps(new H264SPS[kMaxSPS]),
+      pps(new H264PPS[kMaxPPS]) {
+  Reset();
+}
+
+void H264Parser::Reset() {
+  for (int i = 0; i < kMaxSPS; i++)
+    sps[i].valid = false;
+  for (int i = 0; i < kMaxPPS; i++)
+    pps[i].valid = false;
+  active_sps = last_sps = -1;
+  memset(&cur, 0, sizeof(cur));
+  pic_started = false;
+  prev_poc_msb = prev_poc_lsb = 0;
+  prev_frame_num_offset = prev_frame_num = 0;
+  prev_mmco5 = false;
+  last_poc = 0;
+}
+
+const H264SPS *H264Parser::GetSPS(int id) const {
+  if (id < 0 || id >= kMaxSPS || !sps[id].valid)
+    return nullptr;
+  return &sps[id];
+}
+
+const H264PPS *H264Parser::GetPPS(int id) const {
+  if (id < 0 || id >= kMaxPPS || !pps[id].valid)
+    return nullptr;
+  return &pps[id];
+}
+
+int H264Parser::Parse(const uint8_t *nal, size_t size, NalUnitInfo &info) {
+  memset(&info, 0, sizeof(info));
+  info.codec = NalCodec::H264;
+  info.param_id = -1;
+  info.slice_type = SliceType::NONE;
+  if (size < 1 || (nal[0] & 0x80))
+    return -EINVAL;
+  info.type = nal[0] & 0x1F;
+  info.ref_idc = (nal[0] >> 5) & 0x3;
+  BitReader br(nal + 1, size - 1);
+  int ret = 0;
+  switch (info.type) {
+  case 1: // non-idr slice
+  case 2: // slice data partition a, which has the slice header
+  case 5: // idr slice
+    info.vcl = true;
+    info.keyframe = (info.type == 5);
+    return ParseSlice(br, info);
+  case 3:
+  case 4:
+    info.vcl = true;
+    break;
+  case 6:
+    ret = parse_sei(br, NalCodec::H264, info);
+    break;
+  case 7: {
+    H264SPS s;
+    ret = parse_h264_sps(br, s);
+    if (!ret) {
+      info.param_id = s.sps_id;
+      sps[s.sps_id] = s;
+      last_sps = s.sps_id;
+    }
+    break;
+  }
+  case 8: {
+    H264PPS p;
+    ret = parse_h264_pps(br, p);
+    if (!ret) {
+      info.param_id = p.pps_id;
+      pps[p.pps_id] = p;
+    }
+    break;
+  }
+  default:
+    break;
+  }
+  return ret;
+}
+
+int H264Parser::ParseSlice(BitReader &br, NalUnitInfo &info) {
+  static const SliceType slice_types[5] = {SliceType::P, SliceType::B,
+                                           SliceType::I, SliceType::SP,
+                                           SliceType::SI};
+  uint32_t first_mb = br.ReadUE();
+  uint32_t slice_type = br.ReadUE();
+  uint32_t pps_id = br.ReadUE();
+  if (br.Error() || slice_type > 9 || pps_id >= (uint32_t)kMaxPPS)
+    return -EINVAL;
+  SliceType t = slice_types[slice_type % 5];
+  info.slice_type = t;
+  info.first_slice = (first_mb == 0);
+  info.param_id = pps_id;
+  const H264PPS &p = pps[pps_id];
+  if (!p.valid || !sps[p.sps_id].valid)
+    return -ENOENT;
+  const H264SPS &s = sps[p.sps_id];
+  bool idr = (info.type == 5);
+  SliceState st;
+  memset(&st, 0, sizeof(st));
+  if (s.separate_colour_plane)
+    br.ReadBits(2); // colour_plane_id
+  st.frame_num = br.ReadBits(s.log2_max_frame_num);
+  if (!s.frame_mbs_only) {
+    st.field_pic = br.ReadFlag();
+    if (st.field_pic)
+      st.bottom_field = br.ReadFlag();
+  }
+  if (idr)
+    br.ReadUE(); // idr_pic_id
+  bool bottom_present =
+      p.bottom_field_pic_order_in_frame_present && !st.field_pic;
+  if (s.pic_order_cnt_type == 0) {
+    st.poc_lsb = br.ReadBits(s.log2_max_poc_lsb);
+    if (bottom_present)
+      st.delta_poc_bottom = br.ReadSE();
+  }
+  if (s.pic_order_cnt_type == 1 && !s.delta_pic_order_always_zero) {
+    st.delta_poc[0] = br.ReadSE();
+    if (bottom_present)
+      st.delta_poc[1] = br.ReadSE();
+  }
+  if (p.redundant_pic_cnt_present)
+    br.ReadUE();
+  // go on to dec_ref_pic_marking(), a mmco 5 resets the poc
+  if (t == SliceType::B)
+    br.ReadBit(); // direct_spatial_mv_pred_flag
+  int num_l0 = p.num_ref_idx_l0_default_active;
+  int num_l1 = p.num_ref_idx_l1_default_active;
+  if (t == SliceType::P || t == SliceType::SP || t == SliceType::B) {
+    if (br.ReadFlag()) { // num_ref_idx_active_override_flag
+      num_l0 = br.ReadUE() + 1;
+      if (t == SliceType::B)
+        num_l1 = br.ReadUE() + 1;
+    }
+    if (num_l0 > 32 || num_l1 > 32 || num_l0 < 1 || num_l1 < 1)
+      return -EINVAL;
+  }
+  if (t != SliceType::I && t != SliceType::SI) {
+    if (!skip_h264_ref_pic_list_modification(br))
+      return -EINVAL;
+    if (t == SliceType::B && !skip_h264_ref_pic_list_modification(br))
+      return -EINVAL;
+  }
+  if ((p.weighted_pred && (t == SliceType::P || t == SliceType::SP)) ||
+      (p.weighted_bipred_idc == 1 && t == SliceType::B))
+    skip_h264_pred_weight_table(br,
+                                s.separate_colour_plane ? 0
+                                                        : s.chroma_format_idc,
+                                num_l0, t == SliceType::B ? num_l1 : 0);
+  if (info.ref_idc) {
+    if (idr) {
+      br.ReadBit(); // no_output_of_prior_pics_flag
+      br.ReadBit(); // long_term_reference_flag
+    } else if (br.ReadFlag()) { // adaptive_ref_pic_marking_mode_flag
+      uint32_t op;
+      int n = 0;
+      do {
+        op = br.ReadUE();
+        if (op == 1 || op == 2 || op == 3 || op == 4 || op == 6)
+          br.ReadUE();
+        if (op == 3)
+          br.ReadUE();
+        if (op == 5)
+          st.mmco5 = true;
+        if (op > 6)
+          return -EINVAL;
+      } while (op && !br.Error() && ++n < 66);
+    }
+  }
+  if (br.Error())
+    return -EINVAL;
+  info.frame_num = st.frame_num;
+  active_sps = p.sps_id;
+  cur = st;
+  UpdatePOC(s, info);
+  return 0;
+}
+
+// 8.2.1, the poc of the picture which the slice belongs to
+void H264Parser::UpdatePOC(const H264SPS &s, NalUnitInfo &info) {
+  if (!info.first_slice && pic_started) {
+    info.pic_order_cnt = last_poc;
+    return;
+  }
+  pic_started = true;
+  bool idr = info.keyframe;
+  // 64 bits, so that broken streams can not overflow
+  int64_t top = 0, bottom = 0;
+  if (s.pic_order_cnt_type == 0) {
+    int max_lsb = 1 << s.log2_max_poc_lsb;
+    if (idr)
+      prev_poc_msb = prev_poc_lsb = 0;
+    int lsb = cur.poc_lsb, msb = prev_poc_msb;
+    if (lsb < prev_poc_lsb && prev_poc_lsb - lsb >= max_lsb / 2)
+      msb = prev_poc_msb + max_lsb;
+    else if (lsb > prev_poc_lsb && lsb - prev_poc_lsb > max_lsb / 2)
+      msb = prev_poc_msb - max_lsb;
+    top = bottom = msb + lsb;
+    if (!cur.field_pic)
+      bottom = top + cur.delta_poc_bottom;
+    if (info.ref_idc) {
+      prev_poc_msb = msb;
+      prev_poc_lsb = lsb;
+    }
+  } else {
+    int max_frame_num = 1 << s.log2_max_frame_num;
+    int frame_num_offset = 0;
+    if (!idr) {
+      frame_num_offset = prev_mmco5 ? 0 : prev_frame_num_offset;
+      if (prev_frame_num > cur.frame_num)
+        frame_num_offset += max_frame_num;
+    }
+    if (s.pic_order_cnt_type == 1) {
+      int abs_frame_num = 0;
+      int64_t expected = 0;
+      int n = s.num_ref_frames_in_poc_cycle;
+      if (n)
+        abs_frame_num = frame_num_offset + cur.frame_num;
+      if (!info.ref_idc && abs_frame_num > 0)
+        abs_frame_num--;
+      if (abs_frame_num > 0) {
+        int64_t delta_per_cycle = 0;
+        for (int i = 0; i < n; i++)
+          delta_per_cycle += s.offset_for_ref_frame[i];
+        int cycle_cnt = (abs_frame_num - 1) / n;
+        int in_cycle = (abs_frame_num - 1) % n;
+        expected = cycle_cnt * delta_per_cycle;
+        for (int i = 0; i <= in_cycle; i++)
+          expected += s.offset_for_ref_frame[i];
+      }
+      if (!info.ref_idc)
+        expected += s.offset_for_non_ref_pic;
+      if (!cur.field_pic) {
+        top = expected + cur.delta_poc[0];
+        bottom = top + s.offset_for_top_to_bottom_field + cur.delta_poc[1];
+      } else if (!cur.bottom_field) {
+        top = bottom = expected + cur.delta_poc[0];
+      } else {
+        top = bottom =
+            expected + s.offset_for_top_to_bottom_field + cur.delta_poc[0];
+      }
+    } else {
+      top = bottom = idr ? 0
+                         : 2 * ((int64_t)frame_num_offset + cur.frame_num) -
+                               (info.ref_idc ? 0 : 1);
+    }
+    prev_frame_num_offset = frame_num_offset;
+    prev_frame_num = cur.frame_num;
+  }
+  int poc = (int)std::min(top, bottom);
+  if (cur.field_pic)
+    poc = (int)(cur.bottom_field ? bottom : top);
+  if (cur.mmco5) {
+    // the picture turns into poc 0 and frame_num 0 for the following ones
+    prev_poc_msb = 0;
+    prev_poc_lsb = cur.bottom_field ? 0 : (int)(top - poc);
+    prev_frame_num = 0;
+    poc = 0;
+  }
+  prev_mmco5 = cur.mmco5;
+  last_poc = poc;
+  info.pic_order_cnt = poc;
+}
+
+bool H264Parser::GetStreamInfo(StreamInfo &info) const {
+  const H264SPS *s = GetSPS(active_sps >= 0 ? active_sps : last_sps);
+  if (!s)
+    return false;
+  memset(&info, 0, sizeof(info));
+  info.codec = NalCodec::H264;
+  info.profile = s->profile_idc;
+  info.level = s->level_idc;
+  info.width = s->width;
+  info.height = s->height;
+  info.coded_width = s->mb_width * 16;
+  info.coded_height = s->mb_height * 16;
+  info.chroma_format_idc = s->chroma_format_idc;
+  info.bit_depth = s->bit_depth_luma;
+  info.sar_width = s->vui.sar_width;
+  info.sar_height = s->vui.sar_height;
+  info.full_range = s->vui.full_range;
+  if (s->vui.timing_info_present && s->vui.num_units_in_tick &&
+      s->vui.time_scale) {
+    // a tick is a field
+    info.fps_num = s->vui.time_scale;
+    info.fps_den = s->vui.num_units_in_tick * 2;
+  }
+  return true;
+}
+
+// ----------------------------------- h265 -----------------------------------
+
+// profile_tier_level(1, max_sub_layers_minus1)
+static void parse_h265_ptl(BitReader &br, int max_sub_layers_minus1,
+                           H265SPS *s) {
+  int profile_space = br.ReadBits(2);
+  bool tier = br.ReadFlag();
+  int profile_idc = br.ReadBits(5);
+  br.SkipBits(32); // general_profile_compatibility_flag
+  br.SkipBits(48); // progressive_source_flag .. general_inbld_flag
+  int level_idc = br.ReadBits(8);
+  if (s) {
+    s->profile_space = profile_space;
+    s->tier = tier;
+    s->profile_idc = profile_idc;
+    s->level_idc = level_idc;
+  }
+  bool profile_present[8], level_present[8];
+  for (int i = 0; i < max_sub_layers_minus1; i++) {
+    profile_present[i] = br.ReadFlag();
+    level_present[i] = br.ReadFlag();
+  }
+  if (max_sub_layers_minus1 > 0) {
+    for (int i = max_sub_layers_minus1; i < 8; i++)
+      br.ReadBits(2); // reserved_zero_2bits
+  }
+  for (int i = 0; i < max_sub_layers_minus1; i++) {
+    if (profile_present[i])
+      br.SkipBits(88);
+    if (level_present[i])
+      br.SkipBits(8);
+  }
+}
+
+static int parse_h265_vps(BitReader &br, H265VPS &v) {
+  memset(&v, 0, sizeof(v));
+  v.vps_id = br.ReadBits(4);
+  br.ReadBits(2); // vps_base_layer_internal_flag, vps_base_layer_available
+  br.ReadBits(6); // vps_max_layers_minus1
+  v.max_sub_layers = br.ReadBits(3) + 1;
+  if (v.max_sub_layers > 7)
+    return -EINVAL;
+  br.ReadBit();    // vps_temporal_id_nesting_flag
+  br.ReadBits(16); // vps_reserved_0xffff_16bits
+  parse_h265_ptl(br, v.max_sub_layers - 1, nullptr);
+  bool ordering_info = br.ReadFlag();
+  for (int i = ordering_info ? 0 : v.max_sub_layers - 1; i < v.max_sub_layers;
+       i++) {
+    br.ReadUE();
+    br.ReadUE();
+    br.ReadUE();
+  }
+  int max_layer_id = br.ReadBits(6);
+  uint32_t layer_sets = br.ReadUE() + 1;
+  if (layer_sets > 1024)
+    return -EINVAL;
+  br.SkipBits((size_t)(layer_sets - 1) * (max_layer_id + 1));
+  v.timing_info_present = br.ReadFlag();
+  if (v.timing_info_present) {
+    v.num_units_in_tick = br.ReadBits(32);
+    v.time_scale = br.ReadBits(32);
+  }
+  if (br.Error())
+    return -EINVAL;
+  v.valid = true;
+  return 0;
+}
+
+static void skip_h265_scaling_list_data(BitReader &br) {
+  for (int size_id = 0; size_id < 4; size_id++) {
+    for (int matrix_id = 0; matrix_id < 6;
+         matrix_id += (size_id == 3) ? 3 : 1) {
+      if (!br.ReadFlag()) { // scaling_list_pred_mode_flag
+        br.ReadUE();        // scaling_list_pred_matrix_id_delta
+        continue;
+      }
+      int coef_num = std::min(64, 1 << (4 + (size_id << 1)));
+      if (size_id > 1)
+        br.ReadSE(); // scaling_list_dc_coef_minus8
+      for (int i = 0; i < coef_num; i++)
+        br.ReadSE();
+    }
+  }
+}
+
+struct H265ShortTermRPS {
+  int num_negative;
+  int num_positive;
+  int delta_poc_s0[16];
+  int delta_poc_s1[16];
+};
+
+// st_ref_pic_set(idx) of a sps, the delta pocs are needed by the inter
+// prediction of the following sets.
+static bool parse_h265_st_rps(BitReader &br, int idx, H265ShortTermRPS *sets) {
+  H265ShortTermRPS &rps = sets[idx];
+  memset(&rps, 0, sizeof(rps));
+  if (idx && br.ReadFlag()) { // inter_ref_pic_set_prediction_flag
+    const H265ShortTermRPS &ref = sets[idx - 1];
+    int sign = br.ReadBit();
+    uint32_t abs_delta = br.ReadUE() + 1;
+    if (abs_delta > 32768)
+      return false;
+    int delta_rps = sign ? -(int)abs_delta : (int)abs_delta;
+    int num_ref = ref.num_negative + ref.num_positive;
+    bool use_delta[33];
+    for (int j = 0; j <= num_ref; j++) {
+      bool used = br.ReadFlag(); // used_by_curr_pic_flag
+      use_delta[j] = used ? true : br.ReadFlag();
+    }
+    // (7-61) and (7-62)
+    int i = 0;
+    for (int j = ref.num_positive - 1; j >= 0; j--) {
+      int d = ref.delta_poc_s1[j] + delta_rps;
+      if (d < 0 && use_delta[ref.num_negative + j] && i < 16)
+        rps.delta_poc_s0[i++] = d;
+    }
+    if (delta_rps < 0 && use_delta[num_ref] && i < 16)
+      rps.delta_poc_s0[i++] = delta_rps;
+    for (int j = 0; j < ref.num_negative; j++) {
+      int d = ref.delta_poc_s0[j] + delta_rps;
+      if (d < 0 && use_delta[j] && i < 16)
+        rps.delta_poc_s0[i++] = d;
+    }
+    rps.num_negative = i;
+    i = 0;
+    for (int j = ref.num_negative - 1; j >= 0; j--) {
+      int d = ref.delta_poc_s0[j] + delta_rps;
+      if (d > 0 && use_delta[j] && i < 16)
+        rps.delta_poc_s1[i++] = d;
+    }
+    if (delta_rps > 0 && use_delta[num_ref] && i < 16)
+      rps.delta_poc_s1[i++] = delta_rps;
+    for (int j = 0; j < ref.num_positive; j++) {
+      int d = ref.delta_poc_s1[j] + delta_rps;
+      if (d > 0 && use_delta[ref.num_negative + j] && i < 16)
+        rps.delta_poc_s1[i++] = d;
+    }
+    rps.num_positive = i;
+  } else {
+    uint32_t neg = br.ReadUE(), pos = br.ReadUE();
+    if (neg > 16 || pos > 16)
+      return false;
+    rps.num_negative = neg;
+    rps.num_positive = pos;
+    int poc = 0;
+    for (uint32_t i = 0; i < neg; i++) {
+      poc -= (int)std::min(br.ReadUE(), 32767u) + 1;
+      br.ReadBit(); // used_by_curr_pic_s0_flag
+      rps.delta_poc_s0[i] = poc;
+    }
+    poc = 0;
+    for (uint32_t i = 0; i < pos; i++) {
+      poc += (int)std::min(br.ReadUE(), 32767u) + 1;
+      br.ReadBit(); // used_by_curr_pic_s1_flag
+      rps.delta_poc_s1[i] = poc;
+    }
+  }
+  return !br.Error();
+}
+
+static bool parse_h265_vui(BitReader &br, VideoUsability &vui) {
+  parse_vui_common(br, vui);
+  br.ReadBit(); // neutral_chroma_indication_flag
+  br.ReadBit(); // field_seq_flag
+  br.ReadBit(); // frame_field_info_present_flag
+  if (br.ReadFlag()) { // default_display_window_flag
+    for (int i = 0; i < 4; i++)
+      br.ReadUE();
+  }
+  vui.timing_info_present = br.ReadFlag();
+  if (vui.timing_info_present) {
+    vui.num_units_in_tick = br.ReadBits(32);
+    vui.time_scale = br.ReadBits(32);
+    if (br.ReadFlag()) // vui_poc_proportional_to_timing_flag
+      br.ReadUE();
+  }
+  // hrd and bitstream restriction are of no interest
+  return !br.Error();
+}
+
+static int parse_h265_sps(BitReader &br, H265SPS &s) {
+  memset(&s, 0, sizeof(s));
+  reset_vui(s.vui);
+  s.vps_id = br.ReadBits(4);
+  s.max_sub_layers = br.ReadBits(3) + 1;
+  if (s.max_sub_layers > 7)
+    return -EINVAL;
+  br.ReadBit(); // sps_temporal_id_nesting_flag
+  parse_h265_ptl(br, s.max_sub_layers - 1, &s);
+  uint32_t id = br.ReadUE();
+  if (id >= (uint32_t)H265Parser::kMaxSPS)
+    return -EINVAL;
+  s.sps_id = id;
+  uint32_t chroma = br.ReadUE();
+  if (chroma > 3)
+    return -EINVAL;
+  s.chroma_format_idc = chroma;
+  if (chroma == 3)
+    s.separate_colour_plane = br.ReadFlag();
+  uint32_t w = br.ReadUE(), h = br.ReadUE();
+  if (!w || !h || w > 16888 || h > 16888)
+    return -EINVAL;
+  s.pic_width = w;
+  s.pic_height = h;
+  uint32_t win[4] = {0, 0, 0, 0};
+  if (br.ReadFlag()) { // conformance_window_flag
+    for (int i = 0; i < 4; i++)
+      win[i] = br.ReadUE();
+  }
+  bool sub_chroma = !s.separate_colour_plane;
+  int sub_width = (sub_chroma && (chroma == 1 || chroma == 2)) ? 2 : 1;
+  int sub_height = (sub_chroma && chroma == 1) ? 2 : 1;
+  if ((uint64_t)sub_width * (win[0] + (uint64_t)win[1]) >= w ||
+      (uint64_t)sub_height * (win[2] + (uint64_t)win[3]) >= h)
+    return -EINVAL;
+  s.conf_win_left = sub_width * win[0];
+  s.conf_win_right = sub_width * win[1];
+  s.conf_win_top = sub_height * win[2];
+  s.conf_win_bottom = sub_height * win[3];
+  s.width = s.pic_width - s.conf_win_left - s.conf_win_right;
+  s.height = s.pic_height - s.conf_win_top - s.conf_win_bottom;
+  uint32_t luma_depth = br.ReadUE() + 8, chroma_depth = br.ReadUE() + 8;
+  if (luma_depth > 16 || chroma_depth > 16)
+    return -EINVAL;
+  s.bit_depth_luma = luma_depth;
+  s.bit_depth_chroma = chroma_depth;
+  uint32_t v = br.ReadUE() + 4;
+  if (v > 16)
+    return -EINVAL;
+  s.log2_max_poc_lsb = v;
+  bool ordering_info = br.ReadFlag();
+  for (int i = ordering_info ? 0 : s.max_sub_layers - 1; i < s.max_sub_layers;
+       i++) {
+    br.ReadUE(); // sps_max_dec_pic_buffering_minus1
+    s.max_num_reorder_pics = std::min(br.ReadUE(), 16u);
+    br.ReadUE(); // sps_max_latency_increase_plus1
+  }
+  uint32_t min_cb = br.ReadUE() + 3;
+  uint32_t ctb = min_cb + br.ReadUE();
+  if (min_cb > 6 || ctb < 4 || ctb > 6)
+    return -EINVAL;
+  s.log2_ctb_size = ctb;
+  s.pic_width_in_ctbs = (s.pic_width + (1 << ctb) - 1) >> ctb;
+  s.pic_height_in_ctbs = (s.pic_height + (1 << ctb) - 1) >> ctb;
+  for (int i = 0; i < 4; i++)
+    br.ReadUE(); // transform block sizes and hierarchy depths
+  if (br.ReadFlag() && br.ReadFlag()) // scaling_list_enabled_flag
+    skip_h265_scaling_list_data(br);
+  br.ReadBit();        // amp_enabled_flag
+  br.ReadBit();        // sample_adaptive_offset_enabled_flag
+  if (br.ReadFlag()) { // pcm_enabled_flag
+    br.ReadBits(8);
+    br.ReadUE();
+    br.ReadUE();
+    br.ReadBit();
+  }
+  v = br.ReadUE();
+  if (v > 64)
+    return -EINVAL;
+  s.num_short_term_ref_pic_sets = v;
+  if (v) {
+    std::unique_ptr<H265ShortTermRPS[]> sets(new H265ShortTermRPS[v]);
+    for (uint32_t i = 0; i < v; i++) {
+      if (!parse_h265_st_rps(br, i, sets.get()))
+        return -EINVAL;
+    }
+  }
+  s.long_term_ref_pics_present = br.ReadFlag();
+  if (s.long_term_ref_pics_present) {
+    v = br.ReadUE();
+    if (v > 32)
+      return -EINVAL;
+    br.SkipBits((size_t)v * (s.log2_max_poc_lsb + 1));
+  }
+  s.temporal_mvp_enabled = br.ReadFlag();
+  br.ReadBit(); // strong_intra_smoothing_enabled_flag
+  if (br.Error())
+    return -EINVAL;
+  s.vui_present = br.ReadFlag();
+  if (s.vui_present && !parse_h265_vui(br, s.vui)) {
+    s.vui_present = false;
+    reset_vui(s.vui);
+  }
+  s.valid = true;
+  return 0;
+}
+
+static int parse_h265_pps(BitReader &br, H265PPS &p) {
+  memset(&p, 0, sizeof(p));
+  uint32_t pps_id = br.ReadUE(), sps_id = br.ReadUE();
+  if (pps_id >= (uint32_t)H265Parser::kMaxPPS ||
+      sps_id >= (uint32_t)H265Parser::kMaxSPS)
+    return -EINVAL;
+  p.pps_id = pps_id;
+  p.sps_id = sps_id;
+  p.dependent_slice_segments_enabled = br.ReadFlag();
+  p.output_flag_present = br.ReadFlag();
+  p.num_extra_slice_header_bits = br.ReadBits(3);
+  p.sign_data_hiding = br.ReadFlag();
+  p.cabac_init_present = br.ReadFlag();
+  uint32_t l0 = br.ReadUE() + 1, l1 = br.ReadUE() + 1;
+  if (l0 > 15 || l1 > 15)
+    return -EINVAL;
+  p.num_ref_idx_l0_default_active = l0;
+  p.num_ref_idx_l1_default_active = l1;
+  p.init_qp = 26 + br.ReadSE();
+  // the rest is for the slice data
+  if (br.Error())
+    return -EINVAL;
+  p.valid = true;
+  return 0;
+}
+
+H265Parser::H265Parser()
+    : NalParser(NalCodec::H265), vps(new H265VPS[kMaxVPS]),
+      sps(new H265SPS[kMaxSPS]), pps(new H265PPS[kMaxPPS]) {
+  Reset();
+}
+
+void H265Parser::Reset() {
+  for (int i = 0; i < kMaxVPS; i++)
+    vps[i].valid = false;
+  for (int i = 0; i < kMaxSPS; i++)
+    sps[i].valid = false;
+  for (int i = 0; i < kMaxPPS; i++)
+    pps[i].valid = false;
+  active_sps = last_sps = -1;
+  first_picture = true;
+  prev_tid0_poc = 0;
+  last_poc = 0;
+  last_slice_type = SliceType::NONE;
+}
+
+const H265VPS *H265Parser::GetVPS(int id) const {
+  if (id < 0 || id >= kMaxVPS || !vps[id].valid)
+    return nullptr;
+  return &vps[id];
+}
+
+const H265SPS *H265Parser::GetSPS(int id) const {
+  if (id < 0 || id >= kMaxSPS || !sps[id].valid)
+    return nullptr;
+  return &sps[id];
+}
+
+const H265PPS *H265Parser::GetPPS(int id) const {
+  if (id < 0 || id >= kMaxPPS || !pps[id].valid)
+    return nullptr;
+  return &pps[id];
+}
+
+int H265Parser::Parse(const uint8_t *nal, size_t size, NalUnitInfo &info) {
+  memset(&info, 0, sizeof(info));
+  info.codec = NalCodec::H265;
+  info.param_id = -1;
+  info.slice_type = SliceType::NONE;
+  if (size < 2 || (nal[0] & 0x80))
+    return -EINVAL;
+  info.type = (nal[0] >> 1) & 0x3F;
+  info.layer_id = ((nal[0] & 1) << 5) | (nal[1] >> 3);
+  info.temporal_id = (nal[1] & 0x7) - 1;
+  if (info.temporal_id < 0)
+    return -EINVAL;
+  // sub-layer non-reference pictures: TRAIL_N, TSA_N, ..., RSV_VCL_N14
+  info.ref_idc = (info.type <= 14 && !(info.type & 1)) ? 0 : 1;
+  info.vcl = (info.type < 32);
+  info.keyframe = (info.type >= 16 && info.type <= 23);
+  // only the base layer is of interest
+  if (info.layer_id > 0)
+    return 0;
+  BitReader br(nal + 2, size - 2);
+  int ret = 0;
+  switch (info.type) {
+  case 0 ... 9:
+  case 16 ... 21:
+    return ParseSlice(br, info);
+  case 32: {
+    H265VPS v;
+    ret = parse_h265_vps(br, v);
+    if (!ret) {
+      info.param_id = v.vps_id;
+      vps[v.vps_id] = v;
+    }
+    break;
+  }
+  case 33: {
+    H265SPS s;
+    ret = parse_h265_sps(br, s);
+    if (!ret) {
+      info.param_id = s.sps_id;
+      sps[s.sps_id] = s;
+      last_sps = s.sps_id;
+    }
+    break;
+  }
+  case 34: {
+    H265PPS p;
+    ret = parse_h265_pps(br, p);
+    if (!ret) {
+      info.param_id = p.pps_id;
+      pps[p.pps_id] = p;
+    }
+    break;
+  }
+  case 36: // end of sequence
+  case 37: // end of bitstream
+    first_picture = true;
+    break;
+  case 39: // prefix sei
+    ret = parse_sei(br, NalCodec::H265, info);
+    break;
+  default:
+    break;
+  }
+  return ret;
+}
+
+int H265Parser::ParseSlice(BitReader &br, NalUnitInfo &info) {
+  info.first_slice = br.ReadFlag(); // first_slice_segment_in_pic_flag
+  if (info.keyframe)
+    br.ReadBit(); // no_output_of_prior_pics_flag
+  uint32_t pps_id = br.ReadUE();
+  if (br.Error() || pps_id >= (uint32_t)kMaxPPS)
+    return -EINVAL;
+  info.param_id = pps_id;
+  const H265PPS &p = pps[pps_id];
+  if (!p.valid || !sps[p.sps_id].valid)
+    return -ENOENT;
+  const H265SPS &s = sps[p.sps_id];
+  if (!info.first_slice) {
+    if (p.dependent_slice_segments_enabled)
+      info.dependent_slice = br.ReadFlag();
+    int ctbs = s.pic_width_in_ctbs * s.pic_height_in_ctbs;
+    int bits = 0;
+    while ((1 << bits) < ctbs)
+      bits++;
+    br.ReadBits(bits); // slice_segment_address
+  }
+  if (info.dependent_slice) {
+    // the header is of the previous independent slice segment
+    info.slice_type = last_slice_type;
+    info.pic_order_cnt = last_poc;
+    return br.Error() ? -EINVAL : 0;
+  }
+  br.SkipBits(p.num_extra_slice_header_bits);
+  uint32_t slice_type = br.ReadUE();
+  if (slice_type > 2)
+    return -EINVAL;
+  static const SliceType slice_types[3] = {SliceType::B, SliceType::P,
+                                           SliceType::I};
+  info.slice_type = slice_types[slice_type];
+  if (p.output_flag_present)
+    br.ReadBit(); // pic_output_flag
+  if (s.separate_colour_plane)
+    br.ReadBits(2); // colour_plane_id
+  int lsb = 0;
+  bool idr = (info.type == 19 || info.type == 20);
+  if (!idr)
+    lsb = br.ReadBits(s.log2_max_poc_lsb);
+  if (br.Error())
+    return -EINVAL;
+  active_sps = p.sps_id;
+  last_slice_type = info.slice_type;
+  if (!info.first_slice) {
+    info.pic_order_cnt = last_poc;
+    return 0;
+  }
+  // 8.3.1
+  int poc_msb = 0;
+  bool no_rasl_output = info.keyframe && (info.type <= 20 || first_picture);
+  if (!no_rasl_output) {
+    int max_lsb = 1 << s.log2_max_poc_lsb;
+    int prev_lsb = prev_tid0_poc & (max_lsb - 1);
+    int prev_msb = prev_tid0_poc - prev_lsb;
+    poc_msb = prev_msb;
+    if (lsb < prev_lsb && prev_lsb - lsb >= max_lsb / 2)
+      poc_msb = prev_msb + max_lsb;
+    else if (lsb > prev_lsb && lsb - prev_lsb > max_lsb / 2)
+      poc_msb = prev_msb - max_lsb;
+  }
+  int poc = poc_msb + lsb;
+  // RADL 6/7, RASL 8/9 and sub-layer non-reference pictures never serve as
+  // the prevTid0Pic
+  if (info.temporal_id == 0 && !(info.type >= 6 && info.type <= 9) &&
+      info.ref_idc)
+    prev_tid0_poc = poc;
+  first_picture = false;
+  last_poc = poc;
+  info.pic_order_cnt = poc;
+  return 0;
+}
+
+bool H265Parser::GetStreamInfo(StreamInfo &info) const {
+  const H265SPS *s = GetSPS(active_sps >= 0 ? active_sps : last_sps);
+  if (!s)
+    return false;
+  memset(&info, 0, sizeof(info));
+  info.codec = NalCodec::H265;
+  info.profile = s->profile_idc;
+  info.level = s->level_idc;
+  info.width = s->width;
+  info.height = s->height;
+  info.coded_width = s->pic_width;
+  info.coded_height = s->pic_height;
+  info.chroma_format_idc = s->chroma_format_idc;
+  info.bit_depth = s->bit_depth_luma;
+  info.sar_width = s->vui.sar_width;
+  info.sar_height = s->vui.sar_height;
+  info.full_range = s->vui.full_range;
+  uint32_t num_units = 0, time_scale = 0;
+  if (s->vui.timing_info_present) {
+    num_units = s->vui.num_units_in_tick;
+    time_scale = s->vui.time_scale;
+  } else if (vps[s->vps_id].valid && vps[s->vps_id].timing_info_present) {
+    num_units = vps[s->vps_id].num_units_in_tick;
+    time_scale = vps[s->vps_id].time_scale;
+  }
+  if (num_units && time_scale) {
+    info.fps_num = time_scale;
+    info.fps_den = num_units;
+  }
+  return true;
+}
+
+std::shared_ptr<NalParser> NalParser::Create(NalCodec codec) {
+  if (codec == NalCodec::H264)
+    return std::make_shared<H264Parser>();
+  return std::make_shared<H265Parser>();
+}
+
+uint32_t GetNalUnitFlag(const NalUnitInfo &info) {
+  if (!info.vcl) {
+    bool param_set = (info.codec == NalCodec::H264)
+                         ? (info.type == 7 || info.type == 8)
+                         : (info.type >= 32 && info.type <= 34);
+    return param_set ? MediaBuffer::kExtraIntra : 0;
+  }
+  if (info.keyframe)
+    return MediaBuffer::kIntra;
+  switch (info.slice_type) {
+  case SliceType::P:
+  case SliceType::SP:
+    return MediaBuffer::kPredicted;
+  case SliceType::B:
+    return MediaBuffer::kBiPredictive;
+  default:
+    // an intra slice which is not a random access point
+    return 0;
+  }
+}
+
+} // namespace easymedia
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_H26X_PARSER_H_
+#define EASYMEDIA_H26X_PARSER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+
+#include "utils.h"
+
+namespace easymedia {
+
+class BitReader;
+
+// Parse the nal units of h264/h265 elementary streams: parameter sets,
+// slice headers and the sei messages which matter to stream handling, so
+// that muxers, servers and recorders can classify frames and build headers
+// without a decoder.
+
+enum class NalCodec { H264, H265 };
+
+enum class SliceType { NONE = -1, P, B, I, SP, SI };
+
+// The video usability fields which matter outside a decoder.
+struct VideoUsability {
+  int sar_width; // 0 if unknown
+  int sar_height;
+  bool full_range;
+  int colour_primaries; // 2 if unspecified
+  int transfer_characteristics;
+  int matrix_coefficients;
+  bool timing_info_present;
+  uint32_t num_units_in_tick;
+  uint32_t time_scale;
+  bool fixed_frame_rate; // h264 only
+  int max_num_reorder_frames; // -1 if unknown
+};
+
+// The stream level information of the active sequence parameter set.
+struct StreamInfo {
+  NalCodec codec;
+  int profile;
+  int level;
+  int width; // cropped, the displayed size
+  int height;
+  int coded_width;
+  int coded_height;
+  int chroma_format_idc;
+  int bit_depth;
+  int sar_width;
+  int sar_height;
+  bool full_range;
+  // frame rate = fps_num / fps_den, both 0 if not signalled
+  uint32_t fps_num;
+  uint32_t fps_den;
+};
+
+struct NalUnitInfo {
+  NalCodec codec;
+  int type;        // nal_unit_type
+  int ref_idc;     // h264 nal_ref_idc, h265 always 1 except sub-layer non-ref
+  int temporal_id; // h265
+  int layer_id;    // h265
+  int param_id;    // the id of a parameter set, or the pps id of a slice
+  bool vcl;
+  // idr of h264; irap of h265, which also covers cra/bla
+  bool keyframe;
+  // valid if vcl
+  bool first_slice;     // the first slice (segment) of a picture
+  bool dependent_slice; // h265 dependent slice segment, no own header
+  SliceType slice_type;
+  int frame_num; // h264
+  int pic_order_cnt;
+  // recovery point sei
+  bool recovery_point;
+  int recovery_frame_cnt; // h264 frames, h265 poc count
+  bool exact_match;
+  bool broken_link;
+};
+
+struct H264SPS {
+  bool valid;
+  int profile_idc;
+  int constraint_flags;
+  int level_idc;
+  int sps_id;
+  int chroma_format_idc;
+  bool separate_colour_plane;
+  int bit_depth_luma;
+  int bit_depth_chroma;
+  int log2_max_frame_num;
+  int pic_order_cnt_type;
+  int log2_max_poc_lsb;
+  bool delta_pic_order_always_zero;
+  int offset_for_non_ref_pic;
+  int offset_for_top_to_bottom_field;
+  int num_ref_frames_in_poc_cycle;
+  int offset_for_ref_frame[256];
+  int max_num_ref_frames;
+  bool frame_mbs_only;
+  bool mb_adaptive_frame_field;
+  int mb_width;
+  int mb_height; // of a frame
+  int crop_left; // in pixels
+  int crop_right;
+  int crop_top;
+  int crop_bottom;
+  int width;
+  int height;
+  bool vui_present;
+  VideoUsability vui;
+};
+
+struct H264PPS {
+  bool valid;
+  int pps_id;
+  int sps_id;
+  bool entropy_coding_mode;
+  bool bottom_field_pic_order_in_frame_present;
+  int num_slice_groups;
+  int num_ref_idx_l0_default_active;
+  int num_ref_idx_l1_default_active;
+  bool weighted_pred;
+  int weighted_bipred_idc;
+  int pic_init_qp;
+  bool deblocking_filter_control_present;
+  bool constrained_intra_pred;
+  bool redundant_pic_cnt_present;
+  bool transform_8x8_mode;
+};
+
+struct H265VPS {
+  bool valid;
+  int vps_id;
+  int max_sub_layers;
+  bool timing_info_present;
+  uint32_t num_units_in_tick;
+  uint32_t time_scale;
+};
+
+struct H265SPS {
+  bool valid;
+  int sps_id;
+  int vps_id;
+  int max_sub_layers;
+  int profile_space;
+  bool tier;
+  int profile_idc;
+  int level_idc;
+  int chroma_format_idc;
+  bool separate_colour_plane;
+  int pic_width; // coded, in luma samples
+  int pic_height;
+  int conf_win_left; // in luma samples
+  int conf_win_right;
+  int conf_win_top;
+  int conf_win_bottom;
+  int width; // cropped by the conformance window
+  int height;
+  int bit_depth_luma;
+  int bit_depth_chroma;
+  int log2_max_poc_lsb;
+  int max_num_reorder_pics;
+  int log2_ctb_size;
+  int pic_width_in_ctbs;
+  int pic_height_in_ctbs;
+  int num_short_term_ref_pic_sets;
+  bool long_term_ref_pics_present;
+  bool temporal_mvp_enabled;
+  bool vui_present;
+  VideoUsability vui;
+};
+
+struct H265PPS {
+  bool valid;
+  int pps_id;
+  int sps_id;
+  bool dependent_slice_segments_enabled;
+  bool output_flag_present;
+  int num_extra_slice_header_bits;
+  bool sign_data_hiding;
+  bool cabac_init_present;
+  int num_ref_idx_l0_default_active;
+  int num_ref_idx_l1_default_active;
+  int init_qp;
+};
+
+class _API NalParser {
+public:
+  static std::shared_ptr<NalParser> Create(NalCodec codec);
+  virtual ~NalParser() = default;
+
+  NalCodec GetCodec() const { return codec; }
+  // Parse one nal unit without start code.
+  // Return 0 if success. -EINVAL if the nal unit is malformed, -ENOENT if a
+  // slice refers to a parameter set not seen yet. The nal header fields of
+  // info are valid in any case.
+  virtual int Parse(const uint8_t *nal, size_t size, NalUnitInfo &info) = 0;
+  // The stream info of the sps which the last slice used, or the last sps
+  // if no slice yet. Return false if none.
+  virtual bool GetStreamInfo(StreamInfo &info) const = 0;
+  // forget the parameter sets and the poc state
+  virtual void Reset() = 0;
+
+protected:
+  NalParser(NalCodec c) : codec(c) {}
+
+private:
+  NalCodec codec;
+};
+
+class _API H264Parser : public NalParser {
+public:
+  H264Parser();
+  virtual int Parse(const uint8_t *nal, size_t size,
+                    NalUnitInfo &info) override;
+  virtual bool GetStreamInfo(StreamInfo &info) const override;
+  virtual void Reset() override;
+
+  const H264SPS *GetSPS(int id) const;
+  const H264PPS *GetPPS(int id) const;
+
+  static const int kMaxSPS = 32;
+  static const int kMaxPPS = 256;
+
+private:
+  int ParseSlice(BitReader &br, NalUnitInfo &info);
+  void UpdatePOC(const H264SPS &sps, NalUnitInfo &info);
+
+  std::unique_ptr<H264SPS[]> sps;
+  std::unique_ptr<H264PPS[]> pps;
+  int active_sps;
+  int last_sps;
+  // the slice header fields which poc decoding needs
+  struct SliceState {
+    int frame_num;
+    bool field_pic;
+    bool bottom_field;
+    int poc_lsb;
+    int delta_poc_bottom;
+    int delta_poc[2];
+    bool mmco5;
+  } cur;
+  // poc decoding state, 8.2.1
+  bool pic_started;
+  int prev_poc_msb;
+  int prev_poc_lsb;
+  int prev_frame_num_offset;
+  int prev_frame_num;
+  bool prev_mmco5;
+  int last_poc;
+};
+
+class _API H265Parser : public NalParser {
+public:
+  H265Parser();
+  virtual int Parse(const uint8_t *nal, size_t size,
+                    NalUnitInfo &info) override;
+  virtual bool GetStreamInfo(StreamInfo &info) const override;
+  virtual void Reset() override;
+
+  const H265VPS *GetVPS(int id) const;
+  const H265SPS *GetSPS(int id) const;
+  const H265PPS *GetPPS(int id) const;
+
+  static const int kMaxVPS = 16;
+  static const int kMaxSPS = 16;
+  static const int kMaxPPS = 64;
+
+private:
+  int ParseSlice(BitReader &br, NalUnitInfo &info);
+
+  std::unique_ptr<H265VPS[]> vps;
+  std::unique_ptr<H265SPS[]> sps;
+  std::unique_ptr<H265PPS[]> pps;
+  int active_sps;
+  int last_sps;
+  // poc decoding state, 8.3.1
+  bool first_picture; // the next irap has NoRaslOutputFlag
+  int prev_tid0_poc;
+  int last_poc;
+  SliceType last_slice_type;
+};
+
+// MediaBuffer user flag for a nal unit: parameter sets are kExtraIntra,
+// keyframes kIntra, P slices kPredicted, B slices kBiPredictive.
+_API uint32_t GetNalUnitFlag(const NalUnitInfo &info);
+
+} // namespace easymedia
+
+#endif // EASYMEDIA_H26X_PARSER_H_
@@ -24,6 +24,8 @@
 #include <assert.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include "key_string.h"
 #include "media_type.h"
 #include "utils.h"
@@ -70,6 +72,171 @@ int CalPixFmtSize(const PixelFormat &fmt, const int width, const int height) {
   return width * height * num / den;
 }
 
+int GetImagePlanes(const ImageInfo &ii, ImagePlane planes[IMAGE_MAX_PLANES]) {
+  int w = ii.width, h = ii.height;
+  int vw = ii.vir_width, vh = ii.vir_height;
+  int y_size = vw * vh;
+  int bpp = 0;
+  switch (ii.pix_fmt) {
+  case PIX_FMT_YUV420P:
+    planes[0] = {0, vw, w, h, -1};
+    planes[1] = {y_size, vw / 2, w / 2, h / 2, -1};
+    planes[2] = {y_size + y_size / 4, vw / 2, w / 2, h / 2, -1};
+    return 3;
+  case PIX_FMT_NV12:
+  case PIX_FMT_NV21:
+    planes[0] = {0, vw, w, h, -1};
+    planes[1] = {y_size, vw, w, h / 2, -1};
+    return 2;
+  case PIX_FMT_YUV422P:
+    planes[0] = {0, vw, w, h, -1};
+    planes[1] = {y_size, vw / 2, w / 2, h, -1};
+    planes[2] = {y_size + y_size / 2, vw / 2, w / 2, h, -1};
+    return 3;
+  case PIX_FMT_NV16:
+  case PIX_FMT_NV61:
+    planes[0] = {0, vw, w, h, -1};
+    planes[1] = {y_size, vw, w, h, -1};
+    return 2;
+  case PIX_FMT_RGB332:
+    bpp = 1;
+    break;
+  case PIX_FMT_YUYV422:
+  case PIX_FMT_UYVY422:
+  case PIX_FMT_RGB565:
+  case PIX_FMT_BGR565:
+    bpp = 2;
+    break;
+  case PIX_FMT_RGB888:
+  case PIX_FMT_BGR888:
+    bpp = 3;
+    break;
+  case PIX_FMT_ARGB8888:
+  case PIX_FMT_ABGR8888:
+    bpp = 4;
+    break;
+  default:
+    return 0;
+  }
+  planes[0] = {0, vw * bpp, w * bpp, h, -1};
+  return 1;
+}
+
+int CalPixFmtSize(const ImageInfo &ii, const ImagePlane *planes, int num) {
+  if (!planes || num <= 0)
+    return CalPixFmtSize(ii);
+  int size = 0;
+  for (int i = 0; i < num; i++) {
+    if (planes[i].fd >= 0)
+      continue;
+    size = std::max(size, planes[i].offset + planes[i].stride * planes[i].rows);
+  }
+  return size;
+}
+
+// the chroma of yuv is shared by pixel pairs, the crops are even
+static bool is_yuv(PixelFormat fmt) {
+  return fmt >= PIX_FMT_YUV420P && fmt <= PIX_FMT_UYVY422;
+}
+
+// Move the planes of the image of ii by x, y pixels, which may be negative.
+static bool move_planes(const ImageInfo &ii, ImagePlane *planes, int num,
+                        int x, int y) {
+  ImagePlane def[IMAGE_MAX_PLANES];
+  ImageInfo vi = ii;
+  vi.vir_width = vi.width;
+  vi.vir_height = vi.height;
+  if (ii.width <= 0 || ii.height <= 0 || GetImagePlanes(vi, def) != num)
+    return false;
+  for (int i = 0; i < num; i++)
+    planes[i].offset += y * def[i].rows / ii.height * planes[i].stride +
+                        x * def[i].row_bytes / ii.width;
+  return true;
+}
+
+int GetCropPlanes(const ImageInfo &ii, const ImagePlane *planes, int num,
+                  const ImageRect &rect, ImagePlane crop[IMAGE_MAX_PLANES]) {
+  if (rect.x < 0 || rect.y < 0 || rect.w <= 0 || rect.h <= 0 ||
+      rect.x + rect.w > ii.width || rect.y + rect.h > ii.height)
+    return 0;
+  if (is_yuv(ii.pix_fmt) && ((rect.x | rect.y | rect.w | rect.h) & 1))
+    return 0;
+  ImagePlane def[IMAGE_MAX_PLANES];
+  ImageInfo ci = {ii.pix_fmt, rect.w, rect.h, rect.w, rect.h};
+  if (num <= 0 || GetImagePlanes(ci, def) != num)
+    return 0;
+  for (int i = 0; i < num; i++) {
+    crop[i] = planes[i];
+    crop[i].row_bytes = def[i].row_bytes;
+    crop[i].rows = def[i].rows;
+  }
+  if (!move_planes(ii, crop, num, rect.x, rect.y))
+    return 0;
+  return num;
+}
+
+bool GetVirRectOfPlanes(const ImageInfo &ii, const ImagePlane *planes,
+                        int num, int &vir_width, int &vir_height,
+                        ImageRect &rect) {
+  ImagePlane def[IMAGE_MAX_PLANES];
+  ImageInfo vi = ii;
+  vi.vir_width = vi.width;
+  vi.vir_height = vi.height;
+  int def_num = GetImagePlanes(vi, def);
+  if (def_num <= 0 || def_num != num || planes[0].stride <= 0)
+    return false;
+  for (int i = 1; i < num; i++) {
+    if (planes[i].fd != planes[0].fd)
+      return false;
+  }
+  // bytes per pixel of the first plane
+  int bpp = def[0].row_bytes / ii.width;
+  if (bpp <= 0 || planes[0].stride % bpp)
+    return false;
+  // a crop starts inside the first row of its parent
+  int x = planes[0].offset % planes[0].stride;
+  int y = planes[0].offset / planes[0].stride;
+  if (x % bpp)
+    return false;
+  x /= bpp;
+  if (is_yuv(ii.pix_fmt) && ((x | y) & 1))
+    return false;
+  ImagePlane origin[IMAGE_MAX_PLANES];
+  memcpy(origin, planes, num * sizeof(*planes));
+  if (!move_planes(ii, origin, num, -x, -y) || origin[0].offset != 0)
+    return false;
+  vi.vir_width = planes[0].stride / bpp;
+  if (num > 1) {
+    if (origin[1].offset % planes[0].stride)
+      return false;
+    vi.vir_height = origin[1].offset / planes[0].stride;
+  } else {
+    vi.vir_height = std::max(ii.vir_height, y + ii.height);
+  }
+  if (vi.vir_width < x + ii.width || vi.vir_height < y + ii.height)
+    return false;
+  GetImagePlanes(vi, def);
+  for (int i = 0; i < num; i++) {
+    if (def[i].offset != origin[i].offset || def[i].stride != origin[i].stride)
+      return false;
+  }
+  vir_width = vi.vir_width;
+  vir_height = vi.vir_height;
+  rect = {x, y, ii.width, ii.height};
+  return true;
+}
+
+bool GetVirSizeOfPlanes(const ImageInfo &ii, const ImagePlane *planes,
+                        int num, int &vir_width, int &vir_height) {
+  ImageRect rect;
+  int w, h;
+  if (!GetVirRectOfPlanes(ii, planes, num, w, h, rect) || rect.x || rect.y)
+    return false;
+  vir_width = w;
+  vir_height = h;
+  return true;
+}
+
 static const struct PixFmtStringEntry {
   PixelFormat fmt;
   const char *type_str;
@@ -87,7 +254,7 @@ static const struct PixFmtStringEntry {
 PixelFormat GetPixFmtByString(const char *type) {
   if (!type)
     return PIX_FMT_NONE;
-  for (size_t i = 0; i < ARRAY_ELEMS(pix_fmt_string_map) - 1; i++) {
+  for (size_t i = 0; i < ARRAY_ELEMS(pix_fmt_string_map); i++) {
     if (!strcmp(type, pix_fmt_string_map[i].type_str))
       return pix_fmt_string_map[i].fmt;
   }
@@ -95,7 +262,7 @@ PixelFormat GetPixFmtByString(const char *type) {
 }
 
 const char *PixFmtToString(PixelFormat fmt) {
-  for (size_t i = 0; i < ARRAY_ELEMS(pix_fmt_string_map) - 1; i++) {
+  for (size_t i = 0; i < ARRAY_ELEMS(pix_fmt_string_map); i++) {
     if (fmt == pix_fmt_string_map[i].fmt)
       return pix_fmt_string_map[i].type_str;
   }
@@ -61,6 +61,17 @@ typedef struct {
   int w, h; // width, height
 } ImageRect;
 
+#define IMAGE_MAX_PLANES 4
+
+// one plane of an image, in bytes
+typedef struct {
+  int offset;    // from the head of the buffer
+  int stride;    // bytes per row, including the padding
+  int row_bytes; // valid bytes per row
+  int rows;      // valid rows
+  int fd;        // the dma buffer of this plane, -1 means the image buffer
+} ImagePlane;
+
 #ifdef __cplusplus
 }
 #endif
@@ -73,6 +84,29 @@ _API int CalPixFmtSize(const PixelFormat &fmt, const int width,
 _API inline int CalPixFmtSize(const ImageInfo &ii) {
   return CalPixFmtSize(ii.pix_fmt, ii.vir_width, ii.vir_height);
 }
+// The bytes spanned by the planes which are in the image buffer.
+_API int CalPixFmtSize(const ImageInfo &ii, const ImagePlane *planes,
+                       int num);
+// Fill the plane layout of the image which is stored by vir_width/vir_height,
+// return the number of planes, 0 if unsupported.
+_API int GetImagePlanes(const ImageInfo &ii,
+                        ImagePlane planes[IMAGE_MAX_PLANES]);
+// Most hardware only takes planes packed by a virtual size in one buffer.
+// Find such vir_width/vir_height which gives the same layout as the planes,
+// return false if there is none.
+_API bool GetVirSizeOfPlanes(const ImageInfo &ii, const ImagePlane *planes,
+                             int num, int &vir_width, int &vir_height);
+// The planes of the rect of the image, which point into the same memory, so
+// that the rect is taken with no copy. The rect of yuv must be even.
+// Return the number of planes, 0 if the rect is invalid.
+_API int GetCropPlanes(const ImageInfo &ii, const ImagePlane *planes, int num,
+                       const ImageRect &rect,
+                       ImagePlane crop[IMAGE_MAX_PLANES]);
+// The same to GetVirSizeOfPlanes, also for the planes of a crop, rect is
+// then where the crop is in the image of vir_width/vir_height.
+_API bool GetVirRectOfPlanes(const ImageInfo &ii, const ImagePlane *planes,
+                             int num, int &vir_width, int &vir_height,
+                             ImageRect &rect);
 _API PixelFormat GetPixFmtByString(const char *type);
 _API const char *PixFmtToString(PixelFormat fmt);
 
@@ -0,0 +1,607 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "image_blit.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__)
+#define BLIT_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define BLIT_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "key_string.h"
+#include "utils.h"
+
+namespace easymedia {
+
+ScaleMode GetScaleModeByString(const char *mode) {
+  if (mode && !strcmp(mode, KEY_SCALE_BILINEAR))
+    return ScaleMode::BILINEAR;
+  if (mode && !strcmp(mode, KEY_SCALE_AREA))
+    return ScaleMode::AREA;
+  return ScaleMode::AUTO;
+}
+
+int GetImageTransform(int rotate) {
+  switch (rotate) {
+  case 90:
+    return IMAGE_ROT_90;
+  case 180:
+    return IMAGE_ROT_180;
+  case 270:
+    return IMAGE_ROT_270;
+  default:
+    return (rotate >= 0 && rotate <= 7) ? rotate : -1;
+  }
+}
+
+struct PlaneView {
+  uint8_t *data;
+  int stride;
+  int w, h; // in pixels
+  int bpp;
+};
+
+static inline uint8_t *row_of(const PlaneView &p, int y) {
+  return p.data + (size_t)y * p.stride;
+}
+
+void BlendRows(uint8_t *dst, const uint8_t *r0, const uint8_t *r1, int n,
+               int f) {
+  int x = 0;
+#if defined(BLIT_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i f0 = _mm_set1_epi16(256 - f), f1 = _mm_set1_epi16(f);
+  const __m128i half = _mm_set1_epi16(128);
+  for (; x + 16 <= n; x += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(r0 + x));
+    __m128i b = _mm_loadu_si128((const __m128i *)(r1 + x));
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), f0),
+                               _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), f1));
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), f0),
+                               _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), f1));
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, half), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, half), 8);
+    _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(lo, hi));
+  }
+#elif defined(BLIT_NEON)
+  const uint8x8_t f0 = vdup_n_u8((uint8_t)(256 - f));
+  const uint8x8_t f1 = vdup_n_u8((uint8_t)f);
+  for (; x + 16 <= n; x += 16) {
+    uint8x16_t a = vld1q_u8(r0 + x), b = vld1q_u8(r1 + x);
+    uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(a), f0), vget_low_u8(b), f1);
+    uint16x8_t hi =
+        vmlal_u8(vmull_u8(vget_high_u8(a), f0), vget_high_u8(b), f1);
+    vst1q_u8(dst + x, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+  }
+#endif
+  for (; x < n; x++)
+    dst[x] = (uint8_t)((r0[x] * (256 - f) + r1[x] * f + 128) >> 8);
+}
+
+// the two nearest pixels of the center of d, and the weight of the second
+static void get_tap(int d, int dn, int sn, int &i0, int &i1, int &f) {
+  int64_t s = (((int64_t)(2 * d + 1) * sn) << 16) / (2 * dn) - 32768;
+  if (s < 0)
+    s = 0;
+  i0 = (int)(s >> 16);
+  f = (int)(s >> 8) & 255;
+  if (i0 >= sn - 1) {
+    i0 = sn - 1;
+    f = 0;
+  }
+  i1 = f ? i0 + 1 : i0;
+}
+
+struct XTap {
+  int x0, x1; // byte offsets of the two pixels
+  int f;
+};
+
+template <int BPP>
+static void hscale_row(uint8_t *dst, const uint8_t *src, const XTap *taps,
+                       int w) {
+  for (int x = 0; x < w; x++, dst += BPP) {
+    const uint8_t *a = src + taps[x].x0, *b = src + taps[x].x1;
+    int f = taps[x].f;
+    for (int c = 0; c < BPP; c++)
+      dst[c] = (uint8_t)((a[c] * (256 - f) + b[c] * f + 128) >> 8);
+  }
+}
+
+typedef void (*HScaleFunc)(uint8_t *, const uint8_t *, const XTap *, int);
+static const HScaleFunc hscale_funcs[] = {nullptr, hscale_row<1>,
+                                          hscale_row<2>, hscale_row<3>,
+                                          hscale_row<4>};
+
+// The rows are blended first, which the vectors do well, then the columns.
+static void bilinear_plane(const PlaneView &dp, const PlaneView &sp,
+                           int threads) {
+  std::vector<XTap> taps(dp.w);
+  for (int x = 0; x < dp.w; x++) {
+    int i0, i1, f;
+    get_tap(x, dp.w, sp.w, i0, i1, f);
+    taps[x] = {i0 * sp.bpp, i1 * sp.bpp, f};
+  }
+  bool hcopy = (dp.w == sp.w);
+  int n = sp.w * sp.bpp;
+  HScaleFunc hscale = hscale_funcs[sp.bpp];
+  ForEachRowBand(dp.h, 1, threads, [&](int y0, int y1) {
+    std::vector<uint8_t> row(n);
+    for (int y = y0; y < y1; y++) {
+      int i0, i1, f;
+      get_tap(y, dp.h, sp.h, i0, i1, f);
+      const uint8_t *p = row_of(sp, i0);
+      uint8_t *out = row_of(dp, y);
+      uint8_t *mid = hcopy ? out : row.data();
+      if (f)
+        BlendRows(mid, p, row_of(sp, i1), n, f);
+      else if (hcopy)
+        memcpy(out, p, n);
+      if (hcopy)
+        continue;
+      hscale(out, f ? mid : p, taps.data(), dp.w);
+    }
+  });
+}
+
+static void accumulate_row(uint32_t *acc, const uint8_t *row, int n) {
+  int x = 0;
+#if defined(BLIT_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  for (; x + 16 <= n; x += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(row + x));
+    __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+    __m128i *a = (__m128i *)(acc + x);
+    _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a),
+                                      _mm_unpacklo_epi16(lo, zero)));
+    _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1),
+                                          _mm_unpackhi_epi16(lo, zero)));
+    _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2),
+                                          _mm_unpacklo_epi16(hi, zero)));
+    _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3),
+                                          _mm_unpackhi_epi16(hi, zero)));
+  }
+#elif defined(BLIT_NEON)
+  for (; x + 16 <= n; x += 16) {
+    uint8x16_t v = vld1q_u8(row + x);
+    uint16x8_t lo = vmovl_u8(vget_low_u8(v)), hi = vmovl_u8(vget_high_u8(v));
+    uint32_t *a = acc + x;
+    vst1q_u32(a, vaddw_u16(vld1q_u32(a), vget_low_u16(lo)));
+    vst1q_u32(a + 4, vaddw_u16(vld1q_u32(a + 4), vget_high_u16(lo)));
+    vst1q_u32(a + 8, vaddw_u16(vld1q_u32(a + 8), vget_low_u16(hi)));
+    vst1q_u32(a + 12, vaddw_u16(vld1q_u32(a + 12), vget_high_u16(hi)));
+  }
+#endif
+  for (; x < n; x++)
+    acc[x] += row[x];
+}
+
+// (a + b + c + d + 2) >> 2 of every 2x2 block, w is of dst
+static void halve_row(uint8_t *dst, const uint8_t *r0, const uint8_t *r1,
+                      int w) {
+  int x = 0;
+#if defined(BLIT_SSE2)
+  const __m128i mask = _mm_set1_epi16(0xff), two = _mm_set1_epi16(2);
+  for (; x + 16 <= w; x += 16) {
+    __m128i s[2];
+    for (int i = 0; i < 2; i++) {
+      __m128i a = _mm_loadu_si128((const __m128i *)(r0 + 2 * x + 16 * i));
+      __m128i b = _mm_loadu_si128((const __m128i *)(r1 + 2 * x + 16 * i));
+      __m128i t = _mm_add_epi16(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8));
+      t = _mm_add_epi16(t, _mm_and_si128(b, mask));
+      t = _mm_add_epi16(t, _mm_srli_epi16(b, 8));
+      s[i] = _mm_srli_epi16(_mm_add_epi16(t, two), 2);
+    }
+    _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(s[0], s[1]));
+  }
+#elif defined(BLIT_NEON)
+  for (; x + 8 <= w; x += 8) {
+    uint16x8_t s = vpaddlq_u8(vld1q_u8(r0 + 2 * x));
+    s = vpadalq_u8(s, vld1q_u8(r1 + 2 * x));
+    vst1_u8(dst + x, vrshrn_n_u16(s, 2));
+  }
+#endif
+  for (; x < w; x++)
+    dst[x] = (uint8_t)((r0[2 * x] + r0[2 * x + 1] + r1[2 * x] +
+                        r1[2 * x + 1] + 2) >> 2);
+}
+
+static void area_plane(const PlaneView &dp, const PlaneView &sp,
+                       int threads) {
+  if (sp.bpp == 1 && sp.w == dp.w * 2 && sp.h == dp.h * 2) {
+    ForEachRowBand(dp.h, 1, threads, [&](int y0, int y1) {
+      for (int y = y0; y < y1; y++)
+        halve_row(row_of(dp, y), row_of(sp, 2 * y), row_of(sp, 2 * y + 1),
+                  dp.w);
+    });
+    return;
+  }
+  // the box of dst x is [bx[x], bx[x + 1]) in src
+  std::vector<int> bx(dp.w + 1);
+  for (int x = 0; x <= dp.w; x++)
+    bx[x] = (int)((int64_t)x * sp.w / dp.w);
+  int bpp = sp.bpp, n = sp.w * bpp;
+  ForEachRowBand(dp.h, 1, threads, [&](int y0, int y1) {
+    std::vector<uint32_t> acc(n);
+    for (int y = y0; y < y1; y++) {
+      int by0 = (int)((int64_t)y * sp.h / dp.h);
+      int by1 = std::max((int)((int64_t)(y + 1) * sp.h / dp.h), by0 + 1);
+      std::fill(acc.begin(), acc.end(), 0);
+      for (int r = by0; r < by1; r++)
+        accumulate_row(acc.data(), row_of(sp, r), n);
+      uint8_t *out = row_of(dp, y);
+      for (int x = 0; x < dp.w; x++) {
+        int bx0 = bx[x], bx1 = std::max(bx[x + 1], bx0 + 1);
+        uint32_t area = (uint32_t)(bx1 - bx0) * (by1 - by0);
+        for (int c = 0; c < bpp; c++) {
+          uint32_t sum = 0;
+          for (int i = bx0; i < bx1; i++)
+            sum += acc[i * bpp + c];
+          *out++ = (uint8_t)((sum + area / 2) / area);
+        }
+      }
+    }
+  });
+}
+
+static void scale_plane(const PlaneView &dp, const PlaneView &sp,
+                        ScaleMode mode, int threads) {
+  if (dp.w == sp.w && dp.h == sp.h) {
+    for (int y = 0; y < dp.h; y++)
+      memcpy(row_of(dp, y), row_of(sp, y), dp.w * dp.bpp);
+    return;
+  }
+  bool area;
+  if (mode == ScaleMode::AREA)
+    area = (dp.w <= sp.w && dp.h <= sp.h);
+  else
+    area = (mode == ScaleMode::AUTO && sp.w >= 2 * dp.w && sp.h >= 2 * dp.h);
+  if (area)
+    area_plane(dp, sp, threads);
+  else
+    bilinear_plane(dp, sp, threads);
+}
+
+template <int BPP>
+static void gather_row(uint8_t *dst, const uint8_t *src, ptrdiff_t step,
+                       int n) {
+  for (int x = 0; x < n; x++, dst += BPP, src += step)
+    memcpy(dst, src, BPP);
+}
+
+typedef void (*GatherFunc)(uint8_t *, const uint8_t *, ptrdiff_t, int);
+static const GatherFunc gather_funcs[] = {nullptr, gather_row<1>,
+                                          gather_row<2>, gather_row<3>,
+                                          gather_row<4>};
+
+#if defined(BLIT_SSE2) || defined(BLIT_NEON)
+// The 8x8 block of dst at dst. The lanes of the src vector i, which starts at
+// src + i * step, are of the dst column i; lane j is of the dst row j, or 7 - j
+// if rev.
+static void transpose8x8_u8(uint8_t *dst, ptrdiff_t dst_stride,
+                            const uint8_t *src, ptrdiff_t step, bool rev) {
+  uint8_t *out[8];
+  for (int j = 0; j < 8; j++)
+    out[j] = dst + (rev ? 7 - j : j) * dst_stride;
+#if defined(BLIT_SSE2)
+  __m128i r[8];
+  for (int i = 0; i < 8; i++)
+    r[i] = _mm_loadl_epi64((const __m128i *)(src + i * step));
+  __m128i a0 = _mm_unpacklo_epi8(r[0], r[1]);
+  __m128i a1 = _mm_unpacklo_epi8(r[2], r[3]);
+  __m128i a2 = _mm_unpacklo_epi8(r[4], r[5]);
+  __m128i a3 = _mm_unpacklo_epi8(r[6], r[7]);
+  __m128i b0 = _mm_unpacklo_epi16(a0, a1), b1 = _mm_unpackhi_epi16(a0, a1);
+  __m128i b2 = _mm_unpacklo_epi16(a2, a3), b3 = _mm_unpackhi_epi16(a2, a3);
+  __m128i c[4] = {_mm_unpacklo_epi32(b0, b2), _mm_unpackhi_epi32(b0, b2),
+                  _mm_unpacklo_epi32(b1, b3), _mm_unpackhi_epi32(b1, b3)};
+  for (int k = 0; k < 4; k++) {
+    _mm_storel_epi64((__m128i *)out[2 * k], c[k]);
+    _mm_storel_epi64((__m128i *)out[2 * k + 1], _mm_srli_si128(c[k], 8));
+  }
+#else
+  uint8x8_t r[8];
+  for (int i = 0; i < 8; i++)
+    r[i] = vld1_u8(src + i * step);
+  uint8x8x2_t b0 = vtrn_u8(r[0], r[1]), b1 = vtrn_u8(r[2], r[3]);
+  uint8x8x2_t b2 = vtrn_u8(r[4], r[5]), b3 = vtrn_u8(r[6], r[7]);
+  uint16x4x2_t c0 = vtrn_u16(vreinterpret_u16_u8(b0.val[0]),
+                             vreinterpret_u16_u8(b1.val[0]));
+  uint16x4x2_t c1 = vtrn_u16(vreinterpret_u16_u8(b0.val[1]),
+                             vreinterpret_u16_u8(b1.val[1]));
+  uint16x4x2_t c2 = vtrn_u16(vreinterpret_u16_u8(b2.val[0]),
+                             vreinterpret_u16_u8(b3.val[0]));
+  uint16x4x2_t c3 = vtrn_u16(vreinterpret_u16_u8(b2.val[1]),
+                             vreinterpret_u16_u8(b3.val[1]));
+  uint32x2x2_t d0 = vtrn_u32(vreinterpret_u32_u16(c0.val[0]),
+                             vreinterpret_u32_u16(c2.val[0]));
+  uint32x2x2_t d1 = vtrn_u32(vreinterpret_u32_u16(c1.val[0]),
+                             vreinterpret_u32_u16(c3.val[0]));
+  uint32x2x2_t d2 = vtrn_u32(vreinterpret_u32_u16(c0.val[1]),
+                             vreinterpret_u32_u16(c2.val[1]));
+  uint32x2x2_t d3 = vtrn_u32(vreinterpret_u32_u16(c1.val[1]),
+                             vreinterpret_u32_u16(c3.val[1]));
+  uint32x2_t rows[8] = {d0.val[0], d1.val[0], d2.val[0], d3.val[0],
+                        d0.val[1], d1.val[1], d2.val[1], d3.val[1]};
+  for (int j = 0; j < 8; j++)
+    vst1_u8(out[j], vreinterpret_u8_u32(rows[j]));
+#endif
+}
+
+// the same of 16 bits pixels, such as the interleaved chroma
+static void transpose8x8_u16(uint8_t *dst, ptrdiff_t dst_stride,
+                             const uint8_t *src, ptrdiff_t step, bool rev) {
+  uint8_t *out[8];
+  for (int j = 0; j < 8; j++)
+    out[j] = dst + (rev ? 7 - j : j) * dst_stride;
+#if defined(BLIT_SSE2)
+  __m128i r[8];
+  for (int i = 0; i < 8; i++)
+    r[i] = _mm_loadu_si128((const __m128i *)(src + i * step));
+  __m128i a[8], b[8];
+  for (int i = 0; i < 4; i++) {
+    a[2 * i] = _mm_unpacklo_epi16(r[2 * i], r[2 * i + 1]);
+    a[2 * i + 1] = _mm_unpackhi_epi16(r[2 * i], r[2 * i + 1]);
+  }
+  for (int i = 0; i < 2; i++) {
+    // pixels 0-1, 2-3, 4-5, 6-7 of the rows 4i..4i+3
+    b[4 * i] = _mm_unpacklo_epi32(a[4 * i], a[4 * i + 2]);
+    b[4 * i + 1] = _mm_unpackhi_epi32(a[4 * i], a[4 * i + 2]);
+    b[4 * i + 2] = _mm_unpacklo_epi32(a[4 * i + 1], a[4 * i + 3]);
+    b[4 * i + 3] = _mm_unpackhi_epi32(a[4 * i + 1], a[4 * i + 3]);
+  }
+  for (int k = 0; k < 4; k++) {
+    _mm_storeu_si128((__m128i *)out[2 * k], _mm_unpacklo_epi64(b[k], b[k + 4]));
+    _mm_storeu_si128((__m128i *)out[2 * k + 1],
+                     _mm_unpackhi_epi64(b[k], b[k + 4]));
+  }
+#else
+  uint16x8_t r[8];
+  for (int i = 0; i < 8; i++)
+    r[i] = vld1q_u16((const uint16_t *)(src + i * step));
+  uint16x8x2_t b0 = vtrnq_u16(r[0], r[1]), b1 = vtrnq_u16(r[2], r[3]);
+  uint16x8x2_t b2 = vtrnq_u16(r[4], r[5]), b3 = vtrnq_u16(r[6], r[7]);
+  uint32x4x2_t c0 = vtrnq_u32(vreinterpretq_u32_u16(b0.val[0]),
+                              vreinterpretq_u32_u16(b1.val[0]));
+  uint32x4x2_t c1 = vtrnq_u32(vreinterpretq_u32_u16(b0.val[1]),
+                              vreinterpretq_u32_u16(b1.val[1]));
+  uint32x4x2_t c2 = vtrnq_u32(vreinterpretq_u32_u16(b2.val[0]),
+                              vreinterpretq_u32_u16(b3.val[0]));
+  uint32x4x2_t c3 = vtrnq_u32(vreinterpretq_u32_u16(b2.val[1]),
+                              vreinterpretq_u32_u16(b3.val[1]));
+  // the low halves are of the rows 0-3, the high ones of the rows 4-7
+  uint32x4_t lo[4] = {c0.val[0], c1.val[0], c0.val[1], c1.val[1]};
+  uint32x4_t hi[4] = {c2.val[0], c3.val[0], c2.val[1], c3.val[1]};
+  for (int k = 0; k < 4; k++) {
+    vst1q_u32((uint32_t *)out[k],
+              vcombine_u32(vget_low_u32(lo[k]), vget_low_u32(hi[k])));
+    vst1q_u32((uint32_t *)out[k + 4],
+              vcombine_u32(vget_high_u32(lo[k]), vget_high_u32(hi[k])));
+  }
+#endif
+}
+#endif // BLIT_SSE2 || BLIT_NEON
+
+// dst(x, y) is at src + x * a + y * b, a steps over the src rows
+static void transpose_rows(const PlaneView &dp, const uint8_t *src,
+                           ptrdiff_t a, ptrdiff_t b, int y0, int y1) {
+  const int kTile = 16;
+  GatherFunc gather = gather_funcs[dp.bpp];
+  int y = y0;
+  for (; y + 8 <= y1; y += 8) {
+    int x = 0;
+#if defined(BLIT_SSE2) || defined(BLIT_NEON)
+    if (dp.bpp == 1 || dp.bpp == 2) {
+      auto kernel = (dp.bpp == 1) ? transpose8x8_u8 : transpose8x8_u16;
+      const uint8_t *base = src + y * b + (b < 0 ? 7 * b : 0);
+      for (; x + 8 <= dp.w; x += 8)
+        kernel(row_of(dp, y) + x * dp.bpp, dp.stride, base + x * a, a, b < 0);
+    }
+#endif
+    // the tiles keep the lines of the src columns in cache
+    for (; x < dp.w; x += kTile) {
+      int n = std::min(kTile, dp.w - x);
+      for (int j = 0; j < 8; j++)
+        gather(row_of(dp, y + j) + x * dp.bpp, src + x * a + (y + j) * b, a,
+               n);
+    }
+  }
+  for (; y < y1; y++)
+    gather(row_of(dp, y), src + y * b, a, dp.w);
+}
+
+// dst(x, y) is at src + x * a + y * b, a is one pixel left or right
+static void flip_rows(const PlaneView &dp, const uint8_t *src, ptrdiff_t a,
+                      ptrdiff_t b, int y0, int y1) {
+  GatherFunc gather = gather_funcs[dp.bpp];
+  for (int y = y0; y < y1; y++) {
+    if (a > 0)
+      memcpy(row_of(dp, y), src + y * b, dp.w * dp.bpp);
+    else
+      gather(row_of(dp, y), src + y * b, a, dp.w);
+  }
+}
+
+// sp is of the size before the rotation
+static void transform_plane(const PlaneView &dp, const PlaneView &sp,
+                            int transform, int threads) {
+  bool rot = transform & IMAGE_ROT_90;
+  bool fh = transform & IMAGE_FLIP_H, fv = transform & IMAGE_FLIP_V;
+  ptrdiff_t bpp = sp.bpp, stride = sp.stride;
+  const uint8_t *p0;
+  ptrdiff_t a, b;
+  if (rot) {
+    // dst(x, y) = src(fh ? w - 1 - y : y, fv ? x : h - 1 - x)
+    p0 = sp.data + (fv ? 0 : (sp.h - 1) * stride) + (fh ? (sp.w - 1) * bpp : 0);
+    a = fv ? stride : -stride;
+    b = fh ? -bpp : bpp;
+  } else {
+    p0 = sp.data + (fv ? (sp.h - 1) * stride : 0) + (fh ? (sp.w - 1) * bpp : 0);
+    a = fh ? -bpp : bpp;
+    b = fv ? -stride : stride;
+  }
+  ForEachRowBand(dp.h, 8, threads, [&](int y0, int y1) {
+    if (rot)
+      transpose_rows(dp, p0, a, b, y0, y1);
+    else
+      flip_rows(dp, p0, a, b, y0, y1);
+  });
+}
+
+// The two formats have the planes one to one, each plane is scaled to the
+// one of dst before the rotation, then rotated.
+static void scale_rotate(const CpuImage &dst, const CpuImage &src,
+                         int transform, ScaleMode mode, int threads) {
+  PlaneLayout dl[IMAGE_MAX_PLANES], sl[IMAGE_MAX_PLANES];
+  int num = GetPlaneLayout(dst.fmt, dl);
+  GetPlaneLayout(src.fmt, sl);
+  std::vector<uint8_t> tmp;
+  for (int i = 0; i < num; i++) {
+    PlaneView sp = {src.data[i], src.stride[i], src.width / sl[i].xdiv,
+                    src.height / sl[i].ydiv, sl[i].bpp};
+    PlaneView dp = {dst.data[i], dst.stride[i], dst.width / dl[i].xdiv,
+                    dst.height / dl[i].ydiv, dl[i].bpp};
+    if (!transform) {
+      scale_plane(dp, sp, mode, threads);
+      continue;
+    }
+    PlaneView tp = dp;
+    if (transform & IMAGE_ROT_90)
+      std::swap(tp.w, tp.h);
+    if (tp.w != sp.w || tp.h != sp.h) {
+      tmp.resize((size_t)tp.w * tp.h * tp.bpp);
+      tp.data = tmp.data();
+      tp.stride = tp.w * tp.bpp;
+      scale_plane(tp, sp, mode, threads);
+      sp = tp;
+    }
+    transform_plane(dp, sp, transform, threads);
+  }
+}
+
+static bool get_rect(const CpuImage &img, const ImageRect *rect, bool even,
+                     ImageRect &r) {
+  r = rect ? *rect : ImageRect{0, 0, img.width, img.height};
+  if (even) {
+    r.x &= ~1;
+    r.y &= ~1;
+    r.w &= ~1;
+    r.h &= ~1;
+  }
+  return r.x >= 0 && r.y >= 0 && r.w > 0 && r.h > 0 &&
+         r.x + r.w <= img.width && r.y + r.h <= img.height;
+}
+
+static CpuImage crop_image(const CpuImage &img, const ImageRect &r) {
+  PlaneLayout layout[IMAGE_MAX_PLANES];
+  GetPlaneLayout(img.fmt, layout);
+  CpuImage c = img;
+  c.width = r.w;
+  c.height = r.h;
+  for (int i = 0; i < img.num; i++)
+    c.data[i] += (size_t)(r.y / layout[i].ydiv) * img.stride[i] +
+                 r.x / layout[i].xdiv * layout[i].bpp;
+  return c;
+}
+
+static bool alloc_image(std::vector<uint8_t> &mem, CpuImage &img,
+                        PixelFormat fmt, int w, int h) {
+  ImageInfo info = {fmt, w, h, w, h};
+  int size = CalPixFmtSize(info);
+  if (size <= 0)
+    return false;
+  mem.resize(size);
+  return GetCpuImage(img, mem.data(), info);
+}
+
+int BlitImage(const CpuImage &dst, const ImageRect *dst_rect,
+              const CpuImage &src, const ImageRect *src_rect, int rotate,
+              ScaleMode mode, int threads) {
+  int transform = GetImageTransform(rotate);
+  if (transform < 0) {
+    LOG("BlitImage: invalid rotate %d\n", rotate);
+    return -EINVAL;
+  }
+  PlaneLayout layout[IMAGE_MAX_PLANES];
+  int dn = GetPlaneLayout(dst.fmt, layout);
+  int sn = GetPlaneLayout(src.fmt, layout);
+  if (!dn || !sn || dn != dst.num || sn != src.num) {
+    LOG("BlitImage: unsupport fmt %d -> %d\n", src.fmt, dst.fmt);
+    return -EINVAL;
+  }
+  // yuv of any layout takes the chroma of pixel pairs
+  PixelFormat ss = GetScalableFormat(src.fmt), ds = GetScalableFormat(dst.fmt);
+  int ssn = GetPlaneLayout(ss, layout), dsn = GetPlaneLayout(ds, layout);
+  bool even = (ssn > 1 || dsn > 1);
+  ImageRect dr, sr;
+  if (!get_rect(dst, dst_rect, even, dr) ||
+      !get_rect(src, src_rect, even, sr)) {
+    LOG("BlitImage: invalid rect\n");
+    return -EINVAL;
+  }
+  CpuImage d = crop_image(dst, dr), s = crop_image(src, sr);
+  bool rot = transform & IMAGE_ROT_90;
+  int pw = rot ? d.height : d.width, ph = rot ? d.width : d.height;
+  size_t src_pixels = (size_t)s.width * s.height;
+  threads = GetWorkThreads(
+      threads, std::max(src_pixels, (size_t)d.width * d.height));
+  bool same_size = (pw == s.width && ph == s.height);
+  // a yuyv pixel is half of a pair, it is only moved as it is
+  bool whole = (ssn == sn || !transform);
+  if (IsPlaneCompatible(s.fmt, d.fmt) &&
+      (ss == s.fmt || (same_size && whole))) {
+    scale_rotate(d, s, transform, mode, threads);
+    return 0;
+  }
+  std::vector<uint8_t> mem0, mem1;
+  CpuImage t0, t1;
+  if (ss == s.fmt && (size_t)pw * ph < src_pixels) {
+    // shrink in the src format first, less pixels to convert
+    if (!alloc_image(mem0, t0, s.fmt, d.width, d.height))
+      return -ENOMEM;
+    scale_rotate(t0, s, transform, mode, threads);
+    return ConvertImage(d, t0, YuvMatrix::BT601_LIMITED, threads);
+  }
+  if (!alloc_image(mem0, t0, ds, s.width, s.height))
+    return -ENOMEM;
+  int ret = ConvertImage(t0, s, YuvMatrix::BT601_LIMITED, threads);
+  if (ret || ds == d.fmt) {
+    if (!ret)
+      scale_rotate(d, t0, transform, mode, threads);
+    return ret;
+  }
+  // such as rgb565 and yuyv, which are interpolated in rgb888 and nv16
+  if (!alloc_image(mem1, t1, ds, d.width, d.height))
+    return -ENOMEM;
+  scale_rotate(t1, t0, transform, mode, threads);
+  return ConvertImage(d, t1, YuvMatrix::BT601_LIMITED, threads);
+}
+
+} // namespace easymedia
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_IMAGE_BLIT_H_
+#define EASYMEDIA_IMAGE_BLIT_H_
+
+#include "image_convert.h"
+
+namespace easymedia {
+
+// The values of KEY_BUFFER_ROTATE, the same transforms as rga takes, the
+// flips are done before the rotation. The degrees 90, 180 and 270 are taken
+// too, clockwise.
+enum {
+  IMAGE_FLIP_H = 0x01,
+  IMAGE_FLIP_V = 0x02,
+  IMAGE_ROT_90 = 0x04,
+  IMAGE_ROT_180 = 0x03,
+  IMAGE_ROT_270 = 0x07,
+};
+
+enum class ScaleMode {
+  AUTO,     // area if shrinking by 2 or more in both directions, or bilinear
+  BILINEAR, // of the pixel centers
+  AREA,     // average of the covered box, bilinear if enlarging
+};
+
+_API ScaleMode GetScaleModeByString(const char *mode);
+
+// Return the transform bits of the rotate value, -1 if invalid.
+_API int GetImageTransform(int rotate);
+
+// The cpu counterpart of rga blit: crop src_rect of src, scale it to dst_rect
+// of dst with the rotation, and convert the format if the two differ.
+// Null rects are the whole images, dst_rect is the one after the rotation.
+// The rects are aligned to even if either format is subsampled yuv.
+// The rows are banded to threads, 0 picks by the image size.
+// Return 0 if success.
+_API int BlitImage(const CpuImage &dst, const ImageRect *dst_rect,
+                   const CpuImage &src, const ImageRect *src_rect,
+                   int rotate = 0, ScaleMode mode = ScaleMode::AUTO,
+                   int threads = 0);
+
+// dst = (r0 * (256 - f) + r1 * f + 128) >> 8 of n bytes, 0 < f < 256, the
+// vertical pass of the bilinear scaling.
+void BlendRows(uint8_t *dst, const uint8_t *r0, const uint8_t *r1, int n,
+               int f);
+
+} // namespace easymedia
+
+#endif // EASYMEDIA_IMAGE_BLIT_H_
@@ -0,0 +1,1176 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "image_convert.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#define CONVERT_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "key_string.h"
+#include "utils.h"
+
+namespace easymedia {
+
+static const int kMaxWorkThreads = 4;
+// smaller works are not worth the thread creation
+static const size_t kThreadMinPixels = 640 * 360;
+
+int GetWorkThreads(int threads, size_t pixels) {
+  if (threads > 0)
+    return threads;
+  if (pixels < kThreadMinPixels)
+    return 1;
+  int num = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (num < 1)
+    num = 1;
+  return std::min(num, kMaxWorkThreads);
+}
+
+void ForEachRowBand(int rows, int align, int threads,
+                    const std::function<void(int, int)> &fn) {
+  if (rows <= 0)
+    return;
+  int step = UPALIGNTO((rows + threads - 1) / std::max(threads, 1), align);
+  if (threads <= 1 || step >= rows) {
+    fn(0, rows);
+    return;
+  }
+  std::vector<std::thread> workers;
+  int row = 0;
+  for (; row + step < rows; row += step)
+    workers.emplace_back(fn, row, row + step);
+  fn(row, rows);
+  for (auto &w : workers)
+    w.join();
+}
+
+struct FmtDesc {
+  PixelFormat fmt;
+  bool yuv;
+  int ydiv;    // vertical chroma subsampling, the horizontal one is 2
+  bool semi;   // interleaved chroma
+  bool vu;     // v first of the interleaved chroma
+  bool packed; // y and chroma interleaved in one plane, yuyv or uyvy
+  int bpp;     // bytes per pixel of the packed formats
+  int r, g, b; // byte index of the channels, -1 for the bit fields
+  int a;       // -1 if no alpha
+};
+
+static const FmtDesc fmt_descs[] = {
+    {PIX_FMT_YUV420P, true, 2, false, false, false, 1, -1, -1, -1, -1},
+    {PIX_FMT_NV12, true, 2, true, false, false, 1, -1, -1, -1, -1},
+    {PIX_FMT_NV21, true, 2, true, true, false, 1, -1, -1, -1, -1},
+    {PIX_FMT_YUV422P, true, 1, false, false, false, 1, -1, -1, -1, -1},
+    {PIX_FMT_NV16, true, 1, true, false, false, 1, -1, -1, -1, -1},
+    {PIX_FMT_NV61, true, 1, true, true, false, 1, -1, -1, -1, -1},
+    {PIX_FMT_YUYV422, true, 1, false, false, true, 2, -1, -1, -1, -1},
+    {PIX_FMT_UYVY422, true, 1, false, false, true, 2, -1, -1, -1, -1},
+    {PIX_FMT_RGB332, false, 1, false, false, false, 1, -1, -1, -1, -1},
+    {PIX_FMT_RGB565, false, 1, false, false, false, 2, -1, -1, -1, -1},
+    {PIX_FMT_BGR565, false, 1, false, false, false, 2, -1, -1, -1, -1},
+    {PIX_FMT_RGB888, false, 1, false, false, false, 3, 0, 1, 2, -1},
+    {PIX_FMT_BGR888, false, 1, false, false, false, 3, 2, 1, 0, -1},
+    {PIX_FMT_ARGB8888, false, 1, false, false, false, 4, 0, 1, 2, 3},
+    {PIX_FMT_ABGR8888, false, 1, false, false, false, 4, 2, 1, 0, 3},
+};
+
+static const FmtDesc *get_fmt_desc(PixelFormat fmt) {
+  for (size_t i = 0; i < ARRAY_ELEMS(fmt_descs); i++) {
+    if (fmt_descs[i].fmt == fmt)
+      return &fmt_descs[i];
+  }
+  return nullptr;
+}
+
+int GetPlaneLayout(PixelFormat fmt, PlaneLayout layout[IMAGE_MAX_PLANES]) {
+  const FmtDesc *d = get_fmt_desc(fmt);
+  if (!d)
+    return 0;
+  if (!d->yuv || d->packed) {
+    layout[0] = {d->bpp, 1, 1};
+    return 1;
+  }
+  layout[0] = {1, 1, 1};
+  if (d->semi) {
+    layout[1] = {2, 2, d->ydiv};
+    return 2;
+  }
+  layout[1] = {1, 2, d->ydiv};
+  layout[2] = {1, 2, d->ydiv};
+  return 3;
+}
+
+bool IsPlaneCompatible(PixelFormat a, PixelFormat b) {
+  const FmtDesc *da = get_fmt_desc(a), *db = get_fmt_desc(b);
+  if (!da || !db)
+    return false;
+  if (!da->yuv || !db->yuv || da->packed || db->packed)
+    return a == b;
+  return da->semi == db->semi && da->vu == db->vu;
+}
+
+PixelFormat GetScalableFormat(PixelFormat fmt) {
+  switch (fmt) {
+  case PIX_FMT_YUYV422:
+  case PIX_FMT_UYVY422:
+    return PIX_FMT_NV16;
+  case PIX_FMT_RGB332:
+  case PIX_FMT_RGB565:
+    return PIX_FMT_RGB888;
+  case PIX_FMT_BGR565:
+    return PIX_FMT_BGR888;
+  default:
+    return get_fmt_desc(fmt) ? fmt : PIX_FMT_NONE;
+  }
+}
+
+bool GetCpuImage(CpuImage &img, void *ptr, const ImageInfo &info,
+                 const ImagePlane *planes, int num) {
+  ImagePlane def[IMAGE_MAX_PLANES];
+  if (!planes || num <= 0) {
+    num = GetImagePlanes(info, def);
+    planes = def;
+  }
+  if (!ptr || num <= 0 || num > IMAGE_MAX_PLANES)
+    return false;
+  uint8_t *data[IMAGE_MAX_PLANES];
+  for (int i = 0; i < num; i++) {
+    if (planes[i].fd >= 0) {
+      LOG("cpu image: plane %d is of separate fd %d, not in ptr\n", i,
+          planes[i].fd);
+      return false;
+    }
+    data[i] = (uint8_t *)ptr + planes[i].offset;
+  }
+  return GetCpuImage(img, data, info, planes, num);
+}
+
+bool GetCpuImage(CpuImage &img, uint8_t *const data[], const ImageInfo &info,
+                 const ImagePlane *planes, int num) {
+  PlaneLayout layout[IMAGE_MAX_PLANES];
+  if (!data || !planes || num <= 0 ||
+      GetPlaneLayout(info.pix_fmt, layout) != num)
+    return false;
+  img.fmt = info.pix_fmt;
+  img.width = info.width;
+  img.height = info.height;
+  img.num = num;
+  for (int i = 0; i < num; i++) {
+    if (!data[i])
+      return false;
+    img.data[i] = data[i];
+    img.stride[i] = planes[i].stride;
+  }
+  return true;
+}
+
+// Fixed point colour matrix. yuv to rgb is Q6 of 16 bits, so that the vector
+// kernels can take the same numbers; rgb to yuv is Q8.
+struct YuvCoeffs {
+  int y_off;
+  int y_mul;
+  int v_r, u_g, v_g, u_b;
+  int r_y, g_y, b_y;
+  int r_u, g_u, b_u;
+  int r_v, g_v, b_v;
+};
+
+// in the order of YuvMatrix
+static const YuvCoeffs yuv_coeffs[] = {
+    // BT.601 limited range
+    {16, 75, 102, 25, 52, 129, 66, 129, 25, -38, -74, 112, 112, -94, -18},
+    // BT.601 full range
+    {0, 64, 90, 22, 46, 113, 77, 150, 29, -43, -85, 128, 128, -107, -21},
+    // BT.709 limited range
+    {16, 75, 115, 14, 34, 135, 47, 157, 16, -26, -87, 112, 112, -102, -10},
+    // BT.709 full range
+    {0, 64, 101, 12, 30, 119, 54, 183, 19, -29, -99, 128, 128, -116, -12},
+};
+
+YuvMatrix GetYuvMatrixByString(const char *matrix, const char *range) {
+  bool bt709 = matrix && !strcmp(matrix, KEY_BT709);
+  bool full = range && !strcmp(range, KEY_RANGE_FULL);
+  if (bt709)
+    return full ? YuvMatrix::BT709_FULL : YuvMatrix::BT709_LIMITED;
+  return full ? YuvMatrix::BT601_FULL : YuvMatrix::BT601_LIMITED;
+}
+
+static inline uint8_t clamp_u8(int v) {
+  return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+void RgbToYuv(YuvMatrix matrix, uint8_t r, uint8_t g, uint8_t b, uint8_t &y,
+              uint8_t &u, uint8_t &v) {
+  const YuvCoeffs &k = yuv_coeffs[static_cast<int>(matrix)];
+  y = clamp_u8(((k.r_y * r + k.g_y * g + k.b_y * b + 128) >> 8) + k.y_off);
+  u = clamp_u8(((k.r_u * r + k.g_u * g + k.b_u * b + 128) >> 8) + 128);
+  v = clamp_u8(((k.r_v * r + k.g_v * g + k.b_v * b + 128) >> 8) + 128);
+}
+
+static inline uint8_t *row_of(const CpuImage &img, int plane, int y) {
+  return img.data[plane] + (size_t)y * img.stride[plane];
+}
+
+// The row kernels. The scalar ones are the reference, the vector ones
+// process the bulk and leave the tail to them, so both are bit exact.
+// rgba rows have 4 bytes per pixel, r,g,b,a in memory.
+
+static void yuv_to_rgba_c(const YuvCoeffs &k, const uint8_t *y,
+                          const uint8_t *u, const uint8_t *v, uint8_t *rgba,
+                          int w, bool bgr) {
+  int ri = bgr ? 2 : 0, bi = 2 - ri;
+  for (int x = 0; x < w; x++, rgba += 4) {
+    int yy = (y[x] - k.y_off) * k.y_mul + 32;
+    int uu = u[x >> 1] - 128, vv = v[x >> 1] - 128;
+    rgba[ri] = clamp_u8((yy + k.v_r * vv) >> 6);
+    rgba[1] = clamp_u8((yy - k.u_g * uu - k.v_g * vv) >> 6);
+    rgba[bi] = clamp_u8((yy + k.u_b * uu) >> 6);
+    rgba[3] = 255;
+  }
+}
+
+static void rgba_to_y_c(const YuvCoeffs &k, const uint8_t *rgba, uint8_t *y,
+                        int w) {
+  for (int x = 0; x < w; x++, rgba += 4)
+    y[x] = clamp_u8(
+        ((k.r_y * rgba[0] + k.g_y * rgba[1] + k.b_y * rgba[2] + 128) >> 8) +
+        k.y_off);
+}
+
+// chroma of the 2x2 pixels of the two rows, or 2x1 if r1 is r0
+static void rgba_to_uv_c(const YuvCoeffs &k, const uint8_t *r0,
+                         const uint8_t *r1, uint8_t *u, uint8_t *v, int cw) {
+  for (int c = 0; c < cw; c++, r0 += 8, r1 += 8) {
+    int r = (r0[0] + r0[4] + r1[0] + r1[4] + 2) >> 2;
+    int g = (r0[1] + r0[5] + r1[1] + r1[5] + 2) >> 2;
+    int b = (r0[2] + r0[6] + r1[2] + r1[6] + 2) >> 2;
+    u[c] = clamp_u8(((k.r_u * r + k.g_u * g + k.b_u * b + 128) >> 8) + 128);
+    v[c] = clamp_u8(((k.r_v * r + k.g_v * g + k.b_v * b + 128) >> 8) + 128);
+  }
+}
+
+static void split_uv_c(const uint8_t *src, uint8_t *a, uint8_t *b, int cw) {
+  for (int c = 0; c < cw; c++) {
+    a[c] = src[2 * c];
+    b[c] = src[2 * c + 1];
+  }
+}
+
+static void merge_uv_c(const uint8_t *a, const uint8_t *b, uint8_t *dst,
+                       int cw) {
+  for (int c = 0; c < cw; c++) {
+    dst[2 * c] = a[c];
+    dst[2 * c + 1] = b[c];
+  }
+}
+
+// yuyv is y0,u,y1,v and uyvy is u,y0,v,y1 in memory
+static void split_yuyv_c(const uint8_t *src, uint8_t *y, uint8_t *u,
+                         uint8_t *v, int w, bool uyvy) {
+  int yi = uyvy ? 1 : 0, ci = 1 - yi;
+  for (int c = 0; c < w / 2; c++, src += 4) {
+    y[2 * c] = src[yi];
+    y[2 * c + 1] = src[yi + 2];
+    u[c] = src[ci];
+    v[c] = src[ci + 2];
+  }
+}
+
+static void merge_yuyv_c(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                         uint8_t *dst, int w, bool uyvy) {
+  int yi = uyvy ? 1 : 0, ci = 1 - yi;
+  for (int c = 0; c < w / 2; c++, dst += 4) {
+    dst[yi] = y[2 * c];
+    dst[yi + 2] = y[2 * c + 1];
+    dst[ci] = u[c];
+    dst[ci + 2] = v[c];
+  }
+}
+
+// the rounded average of two chroma rows
+static void avg_row_c(const uint8_t *a, const uint8_t *b, uint8_t *dst,
+                      int n) {
+  for (int i = 0; i < n; i++)
+    dst[i] = (uint8_t)((a[i] + b[i] + 1) >> 1);
+}
+
+// between argb8888 and abgr8888, which are rgba and bgra in memory
+static void swap_rb_c(const uint8_t *src, uint8_t *dst, int w) {
+  for (int x = 0; x < w; x++, src += 4, dst += 4) {
+    uint8_t r = src[0], b = src[2];
+    dst[0] = b;
+    dst[1] = src[1];
+    dst[2] = r;
+    dst[3] = src[3];
+  }
+}
+
+// between rgb888 or bgr888 and rgba
+static void rgb24_to_rgba_c(const uint8_t *src, uint8_t *rgba, int w,
+                            bool bgr) {
+  int ri = bgr ? 2 : 0, bi = 2 - ri;
+  for (int x = 0; x < w; x++, src += 3, rgba += 4) {
+    rgba[0] = src[ri];
+    rgba[1] = src[1];
+    rgba[2] = src[bi];
+    rgba[3] = 255;
+  }
+}
+
+static void rgba_to_rgb24_c(const uint8_t *rgba, uint8_t *dst, int w,
+                            bool bgr) {
+  int ri = bgr ? 2 : 0, bi = 2 - ri;
+  for (int x = 0; x < w; x++, dst += 3, rgba += 4) {
+    dst[ri] = rgba[0];
+    dst[1] = rgba[1];
+    dst[bi] = rgba[2];
+  }
+}
+
+#ifdef CONVERT_SSE2
+static void yuv_to_rgba_sse2(const YuvCoeffs &k, const uint8_t *y,
+                             const uint8_t *u, const uint8_t *v,
+                             uint8_t *rgba, int w, bool bgr) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i c128 = _mm_set1_epi16(128), round = _mm_set1_epi16(32);
+  const __m128i yoff = _mm_set1_epi16(k.y_off), ymul = _mm_set1_epi16(k.y_mul);
+  const __m128i vr = _mm_set1_epi16(k.v_r), ug = _mm_set1_epi16(k.u_g);
+  const __m128i vg = _mm_set1_epi16(k.v_g), ub = _mm_set1_epi16(k.u_b);
+  const __m128i alpha = _mm_set1_epi8((char)0xff);
+  int x = 0;
+  for (; x + 16 <= w; x += 16) {
+    __m128i yv = _mm_loadu_si128((const __m128i *)(y + x));
+    __m128i uu = _mm_loadl_epi64((const __m128i *)(u + x / 2));
+    __m128i vv = _mm_loadl_epi64((const __m128i *)(v + x / 2));
+    uu = _mm_sub_epi16(_mm_unpacklo_epi8(uu, zero), c128);
+    vv = _mm_sub_epi16(_mm_unpacklo_epi8(vv, zero), c128);
+    // the chroma terms of 8 pixel pairs, within 16 bits
+    __m128i cr = _mm_mullo_epi16(vv, vr);
+    __m128i cg =
+        _mm_add_epi16(_mm_mullo_epi16(uu, ug), _mm_mullo_epi16(vv, vg));
+    __m128i cb = _mm_mullo_epi16(uu, ub);
+    __m128i r[2], g[2], b[2];
+    for (int h = 0; h < 2; h++) {
+      __m128i yy =
+          h ? _mm_unpackhi_epi8(yv, zero) : _mm_unpacklo_epi8(yv, zero);
+      yy = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(yy, yoff), ymul), round);
+      __m128i tr = h ? _mm_unpackhi_epi16(cr, cr) : _mm_unpacklo_epi16(cr, cr);
+      __m128i tg = h ? _mm_unpackhi_epi16(cg, cg) : _mm_unpacklo_epi16(cg, cg);
+      __m128i tb = h ? _mm_unpackhi_epi16(cb, cb) : _mm_unpacklo_epi16(cb, cb);
+      // saturation only hits the sums which clamp to 255 anyway
+      r[h] = _mm_srai_epi16(_mm_adds_epi16(yy, tr), 6);
+      g[h] = _mm_srai_epi16(_mm_subs_epi16(yy, tg), 6);
+      b[h] = _mm_srai_epi16(_mm_adds_epi16(yy, tb), 6);
+    }
+    __m128i r8 = _mm_packus_epi16(r[0], r[1]);
+    __m128i g8 = _mm_packus_epi16(g[0], g[1]);
+    __m128i b8 = _mm_packus_epi16(b[0], b[1]);
+    if (bgr)
+      std::swap(r8, b8);
+    __m128i rg0 = _mm_unpacklo_epi8(r8, g8), rg1 = _mm_unpackhi_epi8(r8, g8);
+    __m128i ba0 = _mm_unpacklo_epi8(b8, alpha);
+    __m128i ba1 = _mm_unpackhi_epi8(b8, alpha);
+    __m128i *out = (__m128i *)(rgba + x * 4);
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(rg0, ba0));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg0, ba0));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rg1, ba1));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rg1, ba1));
+  }
+  yuv_to_rgba_c(k, y + x, u + x / 2, v + x / 2, rgba + x * 4, w - x, bgr);
+}
+
+// 8 samples of one channel of 8 rgba pixels, as 16 bits
+static inline __m128i channel_epi16(__m128i p0, __m128i p1, int shift) {
+  const __m128i mask = _mm_set1_epi32(0xff);
+  p0 = _mm_and_si128(_mm_srl_epi32(p0, _mm_cvtsi32_si128(shift)), mask);
+  p1 = _mm_and_si128(_mm_srl_epi32(p1, _mm_cvtsi32_si128(shift)), mask);
+  return _mm_packs_epi32(p0, p1);
+}
+
+static void rgba_to_y_sse2(const YuvCoeffs &k, const uint8_t *rgba,
+                           uint8_t *y, int w) {
+  const __m128i ry = _mm_set1_epi16(k.r_y), gy = _mm_set1_epi16(k.g_y);
+  const __m128i by = _mm_set1_epi16(k.b_y), round = _mm_set1_epi16(128);
+  const __m128i yoff = _mm_set1_epi16(k.y_off);
+  int x = 0;
+  for (; x + 8 <= w; x += 8) {
+    __m128i p0 = _mm_loadu_si128((const __m128i *)(rgba + x * 4));
+    __m128i p1 = _mm_loadu_si128((const __m128i *)(rgba + x * 4 + 16));
+    // the weights sum to 256 at most, unsigned 16 bits holds the sum
+    __m128i s = _mm_add_epi16(_mm_mullo_epi16(channel_epi16(p0, p1, 0), ry),
+                              _mm_mullo_epi16(channel_epi16(p0, p1, 8), gy));
+    s = _mm_add_epi16(s, _mm_mullo_epi16(channel_epi16(p0, p1, 16), by));
+    s = _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(s, round), 8), yoff);
+    _mm_storel_epi64((__m128i *)(y + x), _mm_packus_epi16(s, s));
+  }
+  rgba_to_y_c(k, rgba + x * 4, y + x, w - x);
+}
+
+// (t + 128) >> 8 of the 16 bits chroma sums, which may be 32640
+static inline __m128i round_shift8(__m128i t) {
+  return _mm_srai_epi16(_mm_add_epi16(_mm_srai_epi16(t, 7), _mm_set1_epi16(1)),
+                        1);
+}
+
+static void rgba_to_uv_sse2(const YuvCoeffs &k, const uint8_t *r0,
+                            const uint8_t *r1, uint8_t *u, uint8_t *v,
+                            int cw) {
+  const __m128i one = _mm_set1_epi16(1), two = _mm_set1_epi32(2);
+  const __m128i c128 = _mm_set1_epi16(128);
+  const __m128i ru = _mm_set1_epi16(k.r_u), gu = _mm_set1_epi16(k.g_u);
+  const __m128i bu = _mm_set1_epi16(k.b_u), rv = _mm_set1_epi16(k.r_v);
+  const __m128i gv = _mm_set1_epi16(k.g_v), bv = _mm_set1_epi16(k.b_v);
+  int c = 0;
+  for (; c + 8 <= cw; c += 8) {
+    __m128i avg[3];
+    for (int ch = 0; ch < 3; ch++) {
+      __m128i half[2];
+      for (int h = 0; h < 2; h++) {
+        const __m128i *p0 = (const __m128i *)(r0 + c * 8 + h * 32);
+        const __m128i *p1 = (const __m128i *)(r1 + c * 8 + h * 32);
+        __m128i s = _mm_add_epi16(
+            channel_epi16(_mm_loadu_si128(p0), _mm_loadu_si128(p0 + 1),
+                          ch * 8),
+            channel_epi16(_mm_loadu_si128(p1), _mm_loadu_si128(p1 + 1),
+                          ch * 8));
+        // sums of the pixel pairs
+        s = _mm_madd_epi16(s, one);
+        half[h] = _mm_srai_epi32(_mm_add_epi32(s, two), 2);
+      }
+      avg[ch] = _mm_packs_epi32(half[0], half[1]);
+    }
+    __m128i tu = _mm_add_epi16(_mm_mullo_epi16(avg[0], ru),
+                               _mm_mullo_epi16(avg[1], gu));
+    tu = _mm_add_epi16(tu, _mm_mullo_epi16(avg[2], bu));
+    __m128i tv = _mm_add_epi16(_mm_mullo_epi16(avg[0], rv),
+                               _mm_mullo_epi16(avg[1], gv));
+    tv = _mm_add_epi16(tv, _mm_mullo_epi16(avg[2], bv));
+    tu = _mm_add_epi16(round_shift8(tu), c128);
+    tv = _mm_add_epi16(round_shift8(tv), c128);
+    _mm_storel_epi64((__m128i *)(u + c), _mm_packus_epi16(tu, tu));
+    _mm_storel_epi64((__m128i *)(v + c), _mm_packus_epi16(tv, tv));
+  }
+  rgba_to_uv_c(k, r0 + c * 8, r1 + c * 8, u + c, v + c, cw - c);
+}
+
+static void split_uv_sse2(const uint8_t *src, uint8_t *a, uint8_t *b,
+                          int cw) {
+  const __m128i mask = _mm_set1_epi16(0xff);
+  int c = 0;
+  for (; c + 16 <= cw; c += 16) {
+    __m128i p0 = _mm_loadu_si128((const __m128i *)(src + c * 2));
+    __m128i p1 = _mm_loadu_si128((const __m128i *)(src + c * 2 + 16));
+    _mm_storeu_si128((__m128i *)(a + c),
+                     _mm_packus_epi16(_mm_and_si128(p0, mask),
+                                      _mm_and_si128(p1, mask)));
+    _mm_storeu_si128((__m128i *)(b + c),
+                     _mm_packus_epi16(_mm_srli_epi16(p0, 8),
+                                      _mm_srli_epi16(p1, 8)));
+  }
+  split_uv_c(src + c * 2, a + c, b + c, cw - c);
+}
+
+static void merge_uv_sse2(const uint8_t *a, const uint8_t *b, uint8_t *dst,
+                          int cw) {
+  int c = 0;
+  for (; c + 16 <= cw; c += 16) {
+    __m128i va = _mm_loadu_si128((const __m128i *)(a + c));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b + c));
+    _mm_storeu_si128((__m128i *)(dst + c * 2), _mm_unpacklo_epi8(va, vb));
+    _mm_storeu_si128((__m128i *)(dst + c * 2 + 16),
+                     _mm_unpackhi_epi8(va, vb));
+  }
+  merge_uv_c(a + c, b + c, dst + c * 2, cw - c);
+}
+
+static void split_yuyv_sse2(const uint8_t *src, uint8_t *y, uint8_t *u,
+                            uint8_t *v, int w, bool uyvy) {
+  const __m128i mask = _mm_set1_epi16(0xff);
+  const __m128i zero = _mm_setzero_si128();
+  int x = 0;
+  for (; x + 16 <= w; x += 16) {
+    __m128i p0 = _mm_loadu_si128((const __m128i *)(src + x * 2));
+    __m128i p1 = _mm_loadu_si128((const __m128i *)(src + x * 2 + 16));
+    __m128i even = _mm_packus_epi16(_mm_and_si128(p0, mask),
+                                    _mm_and_si128(p1, mask));
+    __m128i odd =
+        _mm_packus_epi16(_mm_srli_epi16(p0, 8), _mm_srli_epi16(p1, 8));
+    __m128i yv = uyvy ? odd : even, cv = uyvy ? even : odd;
+    _mm_storeu_si128((__m128i *)(y + x), yv);
+    _mm_storel_epi64((__m128i *)(u + x / 2),
+                     _mm_packus_epi16(_mm_and_si128(cv, mask), zero));
+    _mm_storel_epi64((__m128i *)(v + x / 2),
+                     _mm_packus_epi16(_mm_srli_epi16(cv, 8), zero));
+  }
+  split_yuyv_c(src + x * 2, y + x, u + x / 2, v + x / 2, w - x, uyvy);
+}
+
+static void merge_yuyv_sse2(const uint8_t *y, const uint8_t *u,
+                            const uint8_t *v, uint8_t *dst, int w, bool uyvy) {
+  int x = 0;
+  for (; x + 16 <= w; x += 16) {
+    __m128i yv = _mm_loadu_si128((const __m128i *)(y + x));
+    __m128i cv =
+        _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + x / 2)),
+                          _mm_loadl_epi64((const __m128i *)(v + x / 2)));
+    __m128i *out = (__m128i *)(dst + x * 2);
+    if (uyvy) {
+      _mm_storeu_si128(out, _mm_unpacklo_epi8(cv, yv));
+      _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(cv, yv));
+    } else {
+      _mm_storeu_si128(out, _mm_unpacklo_epi8(yv, cv));
+      _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(yv, cv));
+    }
+  }
+  merge_yuyv_c(y + x, u + x / 2, v + x / 2, dst + x * 2, w - x, uyvy);
+}
+
+static void avg_row_sse2(const uint8_t *a, const uint8_t *b, uint8_t *dst,
+                         int n) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                  _mm_loadu_si128((const __m128i *)(b + i))));
+  avg_row_c(a + i, b + i, dst + i, n - i);
+}
+
+static void swap_rb_sse2(const uint8_t *src, uint8_t *dst, int w) {
+  const __m128i ga = _mm_set1_epi32((int)0xff00ff00);
+  int x = 0;
+  for (; x + 4 <= w; x += 4) {
+    __m128i p = _mm_loadu_si128((const __m128i *)(src + x * 4));
+    // swap the 16 bits halves of r and b in each pixel
+    __m128i rb = _mm_andnot_si128(ga, p);
+    rb = _mm_shufflehi_epi16(_mm_shufflelo_epi16(rb, 0xb1), 0xb1);
+    _mm_storeu_si128((__m128i *)(dst + x * 4),
+                     _mm_or_si128(_mm_and_si128(p, ga), rb));
+  }
+  swap_rb_c(src + x * 4, dst + x * 4, w - x);
+}
+#endif // CONVERT_SSE2
+
+#ifdef CONVERT_NEON
+static void yuv_to_rgba_neon(const YuvCoeffs &k, const uint8_t *y,
+                             const uint8_t *u, const uint8_t *v,
+                             uint8_t *rgba, int w, bool bgr) {
+  const uint8x8_t c128 = vdup_n_u8(128);
+  const int16x8_t yoff = vdupq_n_s16(k.y_off), round = vdupq_n_s16(32);
+  int x = 0;
+  for (; x + 16 <= w; x += 16) {
+    uint8x16_t yv = vld1q_u8(y + x);
+    int16x8_t uu = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(u + x / 2), c128));
+    int16x8_t vv = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(v + x / 2), c128));
+    int16x8_t cr = vmulq_n_s16(vv, (int16_t)k.v_r);
+    int16x8_t cg = vmlaq_n_s16(vmulq_n_s16(uu, (int16_t)k.u_g), vv,
+                               (int16_t)k.v_g);
+    int16x8_t cb = vmulq_n_s16(uu, (int16_t)k.u_b);
+    int16x8x2_t tr = vzipq_s16(cr, cr), tg = vzipq_s16(cg, cg);
+    int16x8x2_t tb = vzipq_s16(cb, cb);
+    uint8x8_t r[2], g[2], b[2];
+    for (int h = 0; h < 2; h++) {
+      int16x8_t yy = vreinterpretq_s16_u16(
+          vmovl_u8(h ? vget_high_u8(yv) : vget_low_u8(yv)));
+      yy = vaddq_s16(vmulq_n_s16(vsubq_s16(yy, yoff), (int16_t)k.y_mul),
+                     round);
+      r[h] = vqshrun_n_s16(vqaddq_s16(yy, tr.val[h]), 6);
+      g[h] = vqshrun_n_s16(vqsubq_s16(yy, tg.val[h]), 6);
+      b[h] = vqshrun_n_s16(vqaddq_s16(yy, tb.val[h]), 6);
+    }
+    uint8x16x4_t px;
+    px.val[bgr ? 2 : 0] = vcombine_u8(r[0], r[1]);
+    px.val[1] = vcombine_u8(g[0], g[1]);
+    px.val[bgr ? 0 : 2] = vcombine_u8(b[0], b[1]);
+    px.val[3] = vdupq_n_u8(255);
+    vst4q_u8(rgba + x * 4, px);
+  }
+  yuv_to_rgba_c(k, y + x, u + x / 2, v + x / 2, rgba + x * 4, w - x, bgr);
+}
+
+static void rgba_to_y_neon(const YuvCoeffs &k, const uint8_t *rgba,
+                           uint8_t *y, int w) {
+  const uint8x8_t ry = vdup_n_u8(k.r_y), gy = vdup_n_u8(k.g_y);
+  const uint8x8_t by = vdup_n_u8(k.b_y), yoff = vdup_n_u8(k.y_off);
+  int x = 0;
+  for (; x + 8 <= w; x += 8) {
+    uint8x8x4_t p = vld4_u8(rgba + x * 4);
+    uint16x8_t s = vmull_u8(p.val[0], ry);
+    s = vmlal_u8(s, p.val[1], gy);
+    s = vmlal_u8(s, p.val[2], by);
+    vst1_u8(y + x, vadd_u8(vrshrn_n_u16(s, 8), yoff));
+  }
+  rgba_to_y_c(k, rgba + x * 4, y + x, w - x);
+}
+
+static void rgba_to_uv_neon(const YuvCoeffs &k, const uint8_t *r0,
+                            const uint8_t *r1, uint8_t *u, uint8_t *v,
+                            int cw) {
+  const int16x8_t c128 = vdupq_n_s16(128);
+  int c = 0;
+  for (; c + 8 <= cw; c += 8) {
+    uint8x16x4_t p0 = vld4q_u8(r0 + c * 8);
+    uint8x16x4_t p1 = vld4q_u8(r1 + c * 8);
+    int16x8_t avg[3];
+    for (int ch = 0; ch < 3; ch++) {
+      uint16x8_t s = vpadalq_u8(vpaddlq_u8(p0.val[ch]), p1.val[ch]);
+      avg[ch] = vreinterpretq_s16_u16(vrshrq_n_u16(s, 2));
+    }
+    int16x8_t tu = vmulq_n_s16(avg[0], (int16_t)k.r_u);
+    tu = vmlaq_n_s16(tu, avg[1], (int16_t)k.g_u);
+    tu = vmlaq_n_s16(tu, avg[2], (int16_t)k.b_u);
+    int16x8_t tv = vmulq_n_s16(avg[0], (int16_t)k.r_v);
+    tv = vmlaq_n_s16(tv, avg[1], (int16_t)k.g_v);
+    tv = vmlaq_n_s16(tv, avg[2], (int16_t)k.b_v);
+    vst1_u8(u + c, vqmovun_s16(vaddq_s16(vrshrq_n_s16(tu, 8), c128)));
+    vst1_u8(v + c, vqmovun_s16(vaddq_s16(vrshrq_n_s16(tv, 8), c128)));
+  }
+  rgba_to_uv_c(k, r0 + c * 8, r1 + c * 8, u + c, v + c, cw - c);
+}
+
+static void split_uv_neon(const uint8_t *src, uint8_t *a, uint8_t *b,
+                          int cw) {
+  int c = 0;
+  for (; c + 16 <= cw; c += 16) {
+    uint8x16x2_t p = vld2q_u8(src + c * 2);
+    vst1q_u8(a + c, p.val[0]);
+    vst1q_u8(b + c, p.val[1]);
+  }
+  split_uv_c(src + c * 2, a + c, b + c, cw - c);
+}
+
+static void merge_uv_neon(const uint8_t *a, const uint8_t *b, uint8_t *dst,
+                          int cw) {
+  int c = 0;
+  for (; c + 16 <= cw; c += 16) {
+    uint8x16x2_t p;
+    p.val[0] = vld1q_u8(a + c);
+    p.val[1] = vld1q_u8(b + c);
+    vst2q_u8(dst + c * 2, p);
+  }
+  merge_uv_c(a + c, b + c, dst + c * 2, cw - c);
+}
+
+static void split_yuyv_neon(const uint8_t *src, uint8_t *y, uint8_t *u,
+                            uint8_t *v, int w, bool uyvy) {
+  int yi = uyvy ? 1 : 0, ci = 1 - yi;
+  int x = 0;
+  for (; x + 16 <= w; x += 16) {
+    uint8x8x4_t p = vld4_u8(src + x * 2);
+    uint8x8x2_t yy;
+    yy.val[0] = p.val[yi];
+    yy.val[1] = p.val[yi + 2];
+    vst2_u8(y + x, yy);
+    vst1_u8(u + x / 2, p.val[ci]);
+    vst1_u8(v + x / 2, p.val[ci + 2]);
+  }
+  split_yuyv_c(src + x * 2, y + x, u + x / 2, v + x / 2, w - x, uyvy);
+}
+
+static void merge_yuyv_neon(const uint8_t *y, const uint8_t *u,
+                            const uint8_t *v, uint8_t *dst, int w, bool uyvy) {
+  int yi = uyvy ? 1 : 0, ci = 1 - yi;
+  int x = 0;
+  for (; x + 16 <= w; x += 16) {
+    uint8x8x2_t yy = vld2_u8(y + x);
+    uint8x8x4_t p;
+    p.val[yi] = yy.val[0];
+    p.val[yi + 2] = yy.val[1];
+    p.val[ci] = vld1_u8(u + x / 2);
+    p.val[ci + 2] = vld1_u8(v + x / 2);
+    vst4_u8(dst + x * 2, p);
+  }
+  merge_yuyv_c(y + x, u + x / 2, v + x / 2, dst + x * 2, w - x, uyvy);
+}
+
+static void avg_row_neon(const uint8_t *a, const uint8_t *b, uint8_t *dst,
+                         int n) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+    vst1q_u8(dst + i, vrhaddq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+  avg_row_c(a + i, b + i, dst + i, n - i);
+}
+
+static void swap_rb_neon(const uint8_t *src, uint8_t *dst, int w) {
+  int x = 0;
+  for (; x + 16 <= w; x += 16) {
+    uint8x16x4_t p = vld4q_u8(src + x * 4);
+    uint8x16_t r = p.val[0];
+    p.val[0] = p.val[2];
+    p.val[2] = r;
+    vst4q_u8(dst + x * 4, p);
+  }
+  swap_rb_c(src + x * 4, dst + x * 4, w - x);
+}
+
+static void rgb24_to_rgba_neon(const uint8_t *src, uint8_t *rgba, int w,
+                               bool bgr) {
+  int ri = bgr ? 2 : 0, bi = 2 - ri;
+  int x = 0;
+  for (; x + 16 <= w; x += 16) {
+    uint8x16x3_t p = vld3q_u8(src + x * 3);
+    uint8x16x4_t q;
+    q.val[0] = p.val[ri];
+    q.val[1] = p.val[1];
+    q.val[2] = p.val[bi];
+    q.val[3] = vdupq_n_u8(255);
+    vst4q_u8(rgba + x * 4, q);
+  }
+  rgb24_to_rgba_c(src + x * 3, rgba + x * 4, w - x, bgr);
+}
+
+static void rgba_to_rgb24_neon(const uint8_t *rgba, uint8_t *dst, int w,
+                               bool bgr) {
+  int ri = bgr ? 2 : 0, bi = 2 - ri;
+  int x = 0;
+  for (; x + 16 <= w; x += 16) {
+    uint8x16x4_t p = vld4q_u8(rgba + x * 4);
+    uint8x16x3_t q;
+    q.val[ri] = p.val[0];
+    q.val[1] = p.val[1];
+    q.val[bi] = p.val[2];
+    vst3q_u8(dst + x * 3, q);
+  }
+  rgba_to_rgb24_c(rgba + x * 4, dst + x * 3, w - x, bgr);
+}
+#endif // CONVERT_NEON
+
+struct ConvertKernels {
+  void (*yuv_to_rgba)(const YuvCoeffs &k, const uint8_t *y, const uint8_t *u,
+                      const uint8_t *v, uint8_t *rgba, int w, bool bgr);
+  void (*rgba_to_y)(const YuvCoeffs &k, const uint8_t *rgba, uint8_t *y,
+                    int w);
+  void (*rgba_to_uv)(const YuvCoeffs &k, const uint8_t *r0, const uint8_t *r1,
+                     uint8_t *u, uint8_t *v, int cw);
+  void (*split_uv)(const uint8_t *src, uint8_t *a, uint8_t *b, int cw);
+  void (*merge_uv)(const uint8_t *a, const uint8_t *b, uint8_t *dst, int cw);
+  void (*split_yuyv)(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v,
+                     int w, bool uyvy);
+  void (*merge_yuyv)(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                     uint8_t *dst, int w, bool uyvy);
+  void (*avg_row)(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n);
+  void (*swap_rb)(const uint8_t *src, uint8_t *dst, int w);
+  void (*rgb24_to_rgba)(const uint8_t *src, uint8_t *rgba, int w, bool bgr);
+  void (*rgba_to_rgb24)(const uint8_t *rgba, uint8_t *dst, int w, bool bgr);
+};
+
+static const ConvertKernels scalar_kernels = {
+    yuv_to_rgba_c,   rgba_to_y_c,    rgba_to_uv_c, split_uv_c,
+    merge_uv_c,      split_yuyv_c,   merge_yuyv_c, avg_row_c,
+    swap_rb_c,       rgb24_to_rgba_c, rgba_to_rgb24_c};
+
+#ifdef CONVERT_SSE2
+// the 3 bytes pixels need pshufb, sse2 leaves them to the scalar ones
+static const ConvertKernels sse2_kernels = {
+    yuv_to_rgba_sse2, rgba_to_y_sse2,  rgba_to_uv_sse2, split_uv_sse2,
+    merge_uv_sse2,    split_yuyv_sse2, merge_yuyv_sse2, avg_row_sse2,
+    swap_rb_sse2,     rgb24_to_rgba_c, rgba_to_rgb24_c};
+#endif
+
+#ifdef CONVERT_NEON
+static const ConvertKernels neon_kernels = {
+    yuv_to_rgba_neon, rgba_to_y_neon,  rgba_to_uv_neon, split_uv_neon,
+    merge_uv_neon,    split_yuyv_neon,    merge_yuyv_neon, avg_row_neon,
+    swap_rb_neon,     rgb24_to_rgba_neon, rgba_to_rgb24_neon};
+#endif
+
+static const ConvertKernels *get_kernels(ConvertImpl impl) {
+  switch (impl) {
+  case ConvertImpl::AUTO:
+    for (ConvertImpl i : {ConvertImpl::SSE2, ConvertImpl::NEON}) {
+      const ConvertKernels *kn = get_kernels(i);
+      if (kn)
+        return kn;
+    }
+    return &scalar_kernels;
+  case ConvertImpl::SCALAR:
+    return &scalar_kernels;
+#ifdef CONVERT_SSE2
+  case ConvertImpl::SSE2:
+    return &sse2_kernels;
+#endif
+#ifdef CONVERT_NEON
+  case ConvertImpl::NEON:
+    return &neon_kernels;
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+static std::atomic<const ConvertKernels *> convert_kernels(nullptr);
+static std::atomic<ConvertImpl> convert_impl(ConvertImpl::AUTO);
+
+static inline const ConvertKernels *current_kernels() {
+  const ConvertKernels *kn = convert_kernels.load(std::memory_order_relaxed);
+  if (!kn) {
+    kn = get_kernels(ConvertImpl::AUTO);
+    convert_kernels.store(kn, std::memory_order_relaxed);
+  }
+  return kn;
+}
+
+bool SetConvertImpl(ConvertImpl impl) {
+  const ConvertKernels *kn = get_kernels(impl);
+  if (!kn)
+    return false;
+  convert_impl = impl;
+  convert_kernels = kn;
+  return true;
+}
+
+ConvertImpl GetConvertImpl() { return convert_impl; }
+
+bool IsConvertImplSupported(ConvertImpl impl) {
+  return get_kernels(impl) != nullptr;
+}
+
+const char *ConvertImplToString(ConvertImpl impl) {
+  switch (impl) {
+  case ConvertImpl::AUTO:
+    return "auto";
+  case ConvertImpl::SCALAR:
+    return "scalar";
+  case ConvertImpl::SSE2:
+    return "sse2";
+  case ConvertImpl::NEON:
+    return "neon";
+  }
+  return "unknown";
+}
+
+void YuvToRgbaRow(YuvMatrix matrix, const uint8_t *y, const uint8_t *u,
+                  const uint8_t *v, uint8_t *rgba, int w, bool bgr) {
+  current_kernels()->yuv_to_rgba(yuv_coeffs[static_cast<int>(matrix)], y, u,
+                                 v, rgba, w, bgr);
+}
+
+struct ConvertJob {
+  const CpuImage *dst, *src;
+  const FmtDesc *dd, *sd;
+  const YuvCoeffs *k;
+  const ConvertKernels *kn;
+};
+
+// Row buffers of one band.
+struct RowScratch {
+  explicit RowScratch(int w) : mem(w * 13) {
+    int cw = w / 2;
+    uint8_t *p = mem.data();
+    rgba[0] = p;
+    rgba[1] = p + w * 4;
+    y = p + w * 8;
+    for (int i = 0; i < 2; i++) {
+      u[i] = y + w + cw * i;
+      v[i] = y + w + cw * (2 + i);
+    }
+    mu = y + w + cw * 4;
+    mv = mu + cw;
+  }
+  std::vector<uint8_t> mem;
+  uint8_t *rgba[2];
+  uint8_t *y;
+  uint8_t *u[2], *v[2];
+  uint8_t *mu, *mv;
+};
+
+// The u and v of chroma row cy, the interleaved ones are split into the
+// buffers, ybuf takes the luma of a packed row.
+static void get_uv(const ConvertJob &job, const CpuImage &img,
+                   const FmtDesc &d, int cy, const uint8_t *&u,
+                   const uint8_t *&v, uint8_t *ubuf, uint8_t *vbuf,
+                   uint8_t *ybuf) {
+  int cw = img.width / 2;
+  if (d.packed) {
+    job.kn->split_yuyv(row_of(img, 0, cy), ybuf, ubuf, vbuf, img.width,
+                       d.fmt == PIX_FMT_UYVY422);
+  } else if (d.semi) {
+    job.kn->split_uv(row_of(img, 1, cy), d.vu ? vbuf : ubuf,
+                     d.vu ? ubuf : vbuf, cw);
+  } else {
+    u = row_of(img, 1, cy);
+    v = row_of(img, 2, cy);
+    return;
+  }
+  u = ubuf;
+  v = vbuf;
+}
+
+static void put_uv(const ConvertJob &job, const CpuImage &img,
+                   const FmtDesc &d, int cy, const uint8_t *u,
+                   const uint8_t *v) {
+  int cw = img.width / 2;
+  if (!d.semi) {
+    memcpy(row_of(img, 1, cy), u, cw);
+    memcpy(row_of(img, 2, cy), v, cw);
+    return;
+  }
+  job.kn->merge_uv(d.vu ? v : u, d.vu ? u : v, row_of(img, 1, cy), cw);
+}
+
+// The rgba of a row, which is the row itself for argb8888.
+static const uint8_t *get_rgba(const ConvertJob &job, const FmtDesc &d,
+                               const uint8_t *src, uint8_t *rgba, int w) {
+  switch (d.fmt) {
+  case PIX_FMT_ARGB8888:
+    return src;
+  case PIX_FMT_ABGR8888:
+    job.kn->swap_rb(src, rgba, w);
+    return rgba;
+  case PIX_FMT_RGB888:
+  case PIX_FMT_BGR888:
+    job.kn->rgb24_to_rgba(src, rgba, w, d.fmt == PIX_FMT_BGR888);
+    return rgba;
+  case PIX_FMT_RGB332:
+    for (int x = 0; x < w; x++) {
+      int v = src[x], r = v >> 5, g = (v >> 2) & 7;
+      rgba[x * 4] = (uint8_t)((r << 5) | (r << 2) | (r >> 1));
+      rgba[x * 4 + 1] = (uint8_t)((g << 5) | (g << 2) | (g >> 1));
+      rgba[x * 4 + 2] = (uint8_t)((v & 3) * 85);
+      rgba[x * 4 + 3] = 255;
+    }
+    return rgba;
+  default:
+    break;
+  }
+  bool bgr = (d.fmt == PIX_FMT_BGR565);
+  uint8_t *p = rgba;
+  for (int x = 0; x < w; x++, src += 2, p += 4) {
+    int v = src[0] | (src[1] << 8);
+    int hi = v >> 11, g = (v >> 5) & 63, lo = v & 31;
+    hi = (hi << 3) | (hi >> 2);
+    lo = (lo << 3) | (lo >> 2);
+    p[0] = (uint8_t)(bgr ? lo : hi);
+    p[1] = (uint8_t)((g << 2) | (g >> 4));
+    p[2] = (uint8_t)(bgr ? hi : lo);
+    p[3] = 255;
+  }
+  return rgba;
+}
+
+static void put_rgba(const ConvertJob &job, const FmtDesc &d,
+                     const uint8_t *rgba, uint8_t *dst, int w) {
+  switch (d.fmt) {
+  case PIX_FMT_ARGB8888:
+    memcpy(dst, rgba, w * 4);
+    return;
+  case PIX_FMT_ABGR8888:
+    job.kn->swap_rb(rgba, dst, w);
+    return;
+  case PIX_FMT_RGB888:
+  case PIX_FMT_BGR888:
+    job.kn->rgba_to_rgb24(rgba, dst, w, d.fmt == PIX_FMT_BGR888);
+    return;
+  case PIX_FMT_RGB332:
+    for (int x = 0; x < w; x++, rgba += 4)
+      dst[x] = (uint8_t)((rgba[0] & 0xe0) | ((rgba[1] >> 3) & 0x1c) |
+                         (rgba[2] >> 6));
+    return;
+  default:
+    break;
+  }
+  bool bgr = (d.fmt == PIX_FMT_BGR565);
+  for (int x = 0; x < w; x++, dst += 2, rgba += 4) {
+    int hi = (bgr ? rgba[2] : rgba[0]) >> 3;
+    int lo = (bgr ? rgba[0] : rgba[2]) >> 3;
+    int v = (hi << 11) | ((rgba[1] >> 2) << 5) | lo;
+    dst[0] = (uint8_t)v;
+    dst[1] = (uint8_t)(v >> 8);
+  }
+}
+
+static void copy_rows(const ConvertJob &job, int y0, int y1) {
+  const CpuImage &dst = *job.dst, &src = *job.src;
+  PlaneLayout layout[IMAGE_MAX_PLANES];
+  int num = GetPlaneLayout(dst.fmt, layout);
+  for (int i = 0; i < num; i++) {
+    const PlaneLayout &l = layout[i];
+    int bytes = dst.width / l.xdiv * l.bpp;
+    for (int y = y0 / l.ydiv; y < y1 / l.ydiv; y++)
+      memcpy(row_of(dst, i, y), row_of(src, i, y), bytes);
+  }
+}
+
+static void yuv_to_yuv_rows(const ConvertJob &job, int y0, int y1) {
+  const CpuImage &dst = *job.dst, &src = *job.src;
+  const FmtDesc &dd = *job.dd, &sd = *job.sd;
+  int w = dst.width, cw = w / 2, src_ch = src.height / sd.ydiv;
+  RowScratch s(w);
+  for (int y = y0; y < y1; y++) {
+    const uint8_t *yy = row_of(src, 0, y), *u = nullptr, *v = nullptr;
+    if (sd.packed) {
+      get_uv(job, src, sd, y, u, v, s.u[1], s.v[1], s.y);
+      yy = s.y;
+    }
+    if (!dd.packed) {
+      memcpy(row_of(dst, 0, y), yy, w);
+      continue;
+    }
+    // the packed rows take the chroma of their own
+    if (!sd.packed)
+      get_uv(job, src, sd, y / sd.ydiv, u, v, s.u[1], s.v[1], nullptr);
+    job.kn->merge_yuyv(yy, u, v, row_of(dst, 0, y), w,
+                       dd.fmt == PIX_FMT_UYVY422);
+  }
+  if (dd.packed)
+    return;
+  for (int cy = y0 / dd.ydiv; cy < y1 / dd.ydiv; cy++) {
+    const uint8_t *u, *v;
+    if (dd.ydiv == sd.ydiv) {
+      get_uv(job, src, sd, cy, u, v, s.u[0], s.v[0], s.y);
+    } else if (dd.ydiv > sd.ydiv) {
+      // 422 to 420, the two chroma rows are averaged
+      const uint8_t *u1, *v1;
+      get_uv(job, src, sd, cy * 2, u, v, s.u[0], s.v[0], s.y);
+      get_uv(job, src, sd, std::min(cy * 2 + 1, src_ch - 1), u1, v1, s.u[1],
+             s.v[1], s.y);
+      job.kn->avg_row(u, u1, s.mu, cw);
+      job.kn->avg_row(v, v1, s.mv, cw);
+      u = s.mu;
+      v = s.mv;
+    } else {
+      get_uv(job, src, sd, cy / 2, u, v, s.u[0], s.v[0], s.y);
+    }
+    put_uv(job, dst, dd, cy, u, v);
+  }
+}
+
+static void yuv_to_rgb_rows(const ConvertJob &job, int y0, int y1) {
+  const CpuImage &dst = *job.dst, &src = *job.src;
+  const FmtDesc &dd = *job.dd, &sd = *job.sd;
+  int w = dst.width;
+  RowScratch s(w);
+  // the 4 bytes formats are written directly
+  bool direct = (dd.bpp == 4);
+  for (int y = y0; y < y1; y++) {
+    const uint8_t *yy = row_of(src, 0, y), *u, *v;
+    get_uv(job, src, sd, y / sd.ydiv, u, v, s.u[0], s.v[0], s.y);
+    if (sd.packed)
+      yy = s.y;
+    uint8_t *out = direct ? row_of(dst, 0, y) : s.rgba[0];
+    job.kn->yuv_to_rgba(*job.k, yy, u, v, out, w,
+                        dd.fmt == PIX_FMT_ABGR8888);
+    if (!direct)
+      put_rgba(job, dd, out, row_of(dst, 0, y), w);
+  }
+}
+
+static void rgb_to_yuv_rows(const ConvertJob &job, int y0, int y1) {
+  const CpuImage &dst = *job.dst, &src = *job.src;
+  const FmtDesc &dd = *job.dd, &sd = *job.sd;
+  int w = dst.width;
+  RowScratch s(w);
+  YuvCoeffs k = *job.k;
+  const FmtDesc *rd = &sd;
+  if (sd.fmt == PIX_FMT_ABGR8888) {
+    // bgra rows are read directly by the swapped weights
+    std::swap(k.r_y, k.b_y);
+    std::swap(k.r_u, k.b_u);
+    std::swap(k.r_v, k.b_v);
+    rd = get_fmt_desc(PIX_FMT_ARGB8888);
+  }
+  bool uyvy = (dd.fmt == PIX_FMT_UYVY422);
+  for (int y = y0; y < y1; y += dd.ydiv) {
+    int rows = std::min(dd.ydiv, y1 - y);
+    const uint8_t *rgba[2];
+    for (int i = 0; i < rows; i++) {
+      rgba[i] = get_rgba(job, *rd, row_of(src, 0, y + i), s.rgba[i], w);
+      job.kn->rgba_to_y(k, rgba[i], dd.packed ? s.y : row_of(dst, 0, y + i),
+                        w);
+    }
+    job.kn->rgba_to_uv(k, rgba[0], rgba[rows - 1], s.u[0], s.v[0], w / 2);
+    if (dd.packed)
+      job.kn->merge_yuyv(s.y, s.u[0], s.v[0], row_of(dst, 0, y), w, uyvy);
+    else
+      put_uv(job, dst, dd, y / dd.ydiv, s.u[0], s.v[0]);
+  }
+}
+
+static void rgb_to_rgb_rows(const ConvertJob &job, int y0, int y1) {
+  const CpuImage &dst = *job.dst, &src = *job.src;
+  const FmtDesc &dd = *job.dd, &sd = *job.sd;
+  int w = dst.width;
+  RowScratch s(w);
+  for (int y = y0; y < y1; y++) {
+    if (dd.bpp == 4 && sd.bpp == 4) {
+      job.kn->swap_rb(row_of(src, 0, y), row_of(dst, 0, y), w);
+      continue;
+    }
+    const uint8_t *rgba = get_rgba(job, sd, row_of(src, 0, y), s.rgba[0], w);
+    put_rgba(job, dd, rgba, row_of(dst, 0, y), w);
+  }
+}
+
+int ConvertImage(const CpuImage &dst, const CpuImage &src, YuvMatrix matrix,
+                 int threads) {
+  const FmtDesc *dd = get_fmt_desc(dst.fmt);
+  const FmtDesc *sd = get_fmt_desc(src.fmt);
+  if (!dd || !sd) {
+    LOG("ConvertImage: unsupport fmt %d -> %d\n", src.fmt, dst.fmt);
+    return -EINVAL;
+  }
+  if (dst.width != src.width || dst.height != src.height ||
+      dst.width <= 0 || dst.height <= 0) {
+    LOG("ConvertImage: mismatch of size\n");
+    return -EINVAL;
+  }
+  if ((dd->yuv || sd->yuv) && ((dst.width & 1) || (dst.height & 1))) {
+    LOG("ConvertImage: odd size %dx%d of yuv\n", dst.width, dst.height);
+    return -EINVAL;
+  }
+  int m = static_cast<int>(matrix);
+  if (m < 0 || m >= (int)ARRAY_ELEMS(yuv_coeffs)) {
+    LOG("ConvertImage: unknown colour matrix %d\n", m);
+    return -EINVAL;
+  }
+  ConvertJob job = {&dst, &src, dd, sd, &yuv_coeffs[m], current_kernels()};
+  void (*rows)(const ConvertJob &, int, int);
+  if (dd == sd)
+    rows = copy_rows;
+  else if (dd->yuv && sd->yuv)
+    rows = yuv_to_yuv_rows;
+  else if (sd->yuv)
+    rows = yuv_to_rgb_rows;
+  else if (dd->yuv)
+    rows = rgb_to_yuv_rows;
+  else
+    rows = rgb_to_rgb_rows;
+  int align = (dd->yuv || sd->yuv) ? 2 : 1;
+  threads = GetWorkThreads(threads, (size_t)dst.width * dst.height);
+  ForEachRowBand(dst.height, align, threads,
+                 [&job, rows](int y0, int y1) { rows(job, y0, y1); });
+  return 0;
+}
+
+} // namespace easymedia
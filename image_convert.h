@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_IMAGE_CONVERT_H_
+#define EASYMEDIA_IMAGE_CONVERT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+
+#include "image.h"
+
+namespace easymedia {
+
+// An image in cpu memory, every plane is addressed directly.
+// The byte orders of the packed rgb formats are the ones rga takes:
+// rgb888 is r,g,b, argb8888 is r,g,b,a and abgr8888 is b,g,r,a in memory,
+// rgb565 is a little endian word with red in the high bits, rgb332 is a
+// byte of r3,g3,b2 from the high bits; yuyv is y0,u,y1,v and uyvy is
+// u,y0,v,y1.
+struct CpuImage {
+  PixelFormat fmt;
+  int width;
+  int height;
+  int num; // of planes
+  uint8_t *data[IMAGE_MAX_PLANES];
+  int stride[IMAGE_MAX_PLANES];
+};
+
+// Fill img by the buffer ptr and the planes, the default planes of info are
+// taken if planes is null. The planes of a separate fd are not in ptr, they
+// fail here. Return false if unsupported.
+_API bool GetCpuImage(CpuImage &img, void *ptr, const ImageInfo &info,
+                      const ImagePlane *planes = nullptr, int num = 0);
+// The same by the address of every plane, such as ImageBuffer::GetPlanePtrs
+// gives, which also takes the planes of a separate fd.
+_API bool GetCpuImage(CpuImage &img, uint8_t *const data[],
+                      const ImageInfo &info, const ImagePlane *planes,
+                      int num);
+
+// Samples of one plane, per pixel of the plane.
+struct PlaneLayout {
+  int bpp;  // bytes per pixel of the plane
+  int xdiv; // subsampling of the plane against the image
+  int ydiv;
+};
+// Return the number of planes of fmt, 0 if the cpu path does not support it.
+_API int GetPlaneLayout(PixelFormat fmt, PlaneLayout layout[IMAGE_MAX_PLANES]);
+
+// The formats which differ only by the sizes of the planes, such as nv12
+// and nv16, so that their planes map one to one.
+bool IsPlaneCompatible(PixelFormat a, PixelFormat b);
+// The format of 8 bits samples which fmt is interpolated in, such as rgb888
+// for rgb565 and nv16 for yuyv.
+PixelFormat GetScalableFormat(PixelFormat fmt);
+
+// The colour matrices of the conversions between yuv and rgb.
+enum class YuvMatrix {
+  BT601_LIMITED, // the one rga takes
+  BT601_FULL,
+  BT709_LIMITED,
+  BT709_FULL,
+};
+// By the values of KEY_COLOR_MATRIX and KEY_COLOR_RANGE, null or unknown
+// ones are bt601 and limited.
+_API YuvMatrix GetYuvMatrixByString(const char *matrix, const char *range);
+
+// The row kernels of the conversion. The vector ones are bit exact to the
+// scalar ones, which are the reference.
+enum class ConvertImpl {
+  AUTO, // the best one the build supports
+  SCALAR,
+  SSE2,
+  NEON,
+};
+
+// Return false if the build does not support impl.
+_API bool SetConvertImpl(ConvertImpl impl);
+_API ConvertImpl GetConvertImpl();
+_API bool IsConvertImplSupported(ConvertImpl impl);
+_API const char *ConvertImplToString(ConvertImpl impl);
+
+// Convert src to dst of the same size, any pair of the supported formats,
+// the strides of the planes may be larger than the rows.
+// threads: 0 picks by the image size. Return 0 if success.
+_API int ConvertImage(const CpuImage &dst, const CpuImage &src,
+                      YuvMatrix matrix = YuvMatrix::BT601_LIMITED,
+                      int threads = 0);
+
+// One pixel of rgb to yuv, by the same numbers as ConvertImage.
+_API void RgbToYuv(YuvMatrix matrix, uint8_t r, uint8_t g, uint8_t b,
+                   uint8_t &y, uint8_t &u, uint8_t &v);
+
+// One row of yuv to r,g,b,a, or b,g,r,a if bgr, by the kernels of
+// ConvertImage; u and v are of the pixel pairs.
+void YuvToRgbaRow(YuvMatrix matrix, const uint8_t *y, const uint8_t *u,
+                  const uint8_t *v, uint8_t *rgba, int w, bool bgr);
+
+// 0 threads picks by the pixels of the work, up to the online cpus.
+int GetWorkThreads(int threads, size_t pixels);
+// Run fn(begin, end) on the row bands of [0, rows) in threads, the band
+// sizes are multiples of align. The last band runs in the caller.
+void ForEachRowBand(int rows, int align, int threads,
+                    const std::function<void(int, int)> &fn);
+
+} // namespace easymedia
+
+#endif // EASYMEDIA_IMAGE_CONVERT_H_
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "image_mosaic.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "utils.h"
+
+namespace easymedia {
+
+// the seq of a tile showing the placeholder, and of a tile never drawn; the
+// seqs of the inputs count from 1
+static const uint64_t kPlaceholderSeq = ~0ull;
+static const uint64_t kNeverDrawn = ~0ull - 1;
+// the output buffers remembered, the ones over it are drawn whole, such as
+// the ones never reused
+static const size_t kMaxRememberedBuffers = 16;
+// the colour of the area out of the tiles
+static const uint32_t kBackground = 0x000000;
+
+static ImageRect align_rect(const ImageRect &r) {
+  int x0 = (r.x + 1) & ~1, y0 = (r.y + 1) & ~1;
+  int x1 = (r.x + r.w) & ~1, y1 = (r.y + r.h) & ~1;
+  return {x0, y0, x1 - x0, y1 - y0};
+}
+
+// the tiles are drawn in parallel and skipped alone, so none may cover
+// another; return the first one overlapping an earlier one, -1 if none
+static int find_overlap(const std::vector<ImageRect> &rects) {
+  for (size_t i = 1; i < rects.size(); i++) {
+    const ImageRect &a = rects[i];
+    for (size_t j = 0; j < i; j++) {
+      const ImageRect &b = rects[j];
+      if (a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h &&
+          b.y < a.y + a.h)
+        return i;
+    }
+  }
+  return -1;
+}
+
+// fill the even rect of img with rgb, any format of ConvertImage
+static int fill_rect(const CpuImage &img, const ImageRect &r, uint32_t rgb,
+                     YuvMatrix matrix) {
+  if (r.w <= 0 || r.h <= 0)
+    return 0;
+  // a 2x2 block of the colour in the format of img, the pattern of the rows
+  uint8_t src_px[2 * 2 * 3];
+  for (int i = 0; i < 4; i++) {
+    src_px[i * 3] = rgb >> 16;
+    src_px[i * 3 + 1] = rgb >> 8;
+    src_px[i * 3 + 2] = rgb;
+  }
+  uint8_t block_px[2 * 2 * 4];
+  CpuImage src, block;
+  if (!GetCpuImage(src, src_px, {PIX_FMT_RGB888, 2, 2, 2, 2}) ||
+      !GetCpuImage(block, block_px, {img.fmt, 2, 2, 2, 2}))
+    return -EINVAL;
+  int ret = ConvertImage(block, src, matrix, 1);
+  if (ret)
+    return ret;
+  PlaneLayout layout[IMAGE_MAX_PLANES];
+  int num = GetPlaneLayout(img.fmt, layout);
+  for (int p = 0; p < num; p++) {
+    const PlaneLayout &l = layout[p];
+    int unit = 2 / l.xdiv * l.bpp; // the bytes of 2 pixels
+    int bytes = r.w / 2 * unit;
+    int y0 = r.y / l.ydiv, y1 = (r.y + r.h) / l.ydiv;
+    uint8_t *first =
+        img.data[p] + (size_t)y0 * img.stride[p] + r.x / l.xdiv * l.bpp;
+    memcpy(first, block.data[p], unit);
+    for (int n = unit; n < bytes; n *= 2)
+      memcpy(first + n, first, std::min(n, bytes - n));
+    for (int y = y0 + 1; y < y1; y++)
+      memcpy(first + (size_t)(y - y0) * img.stride[p], first, bytes);
+  }
+  return 0;
+}
+
+ImageMosaic::ImageMosaic(const std::vector<ImageRect> &t, YuvMatrix m)
+    : matrix(m), placeholder(0x101010), mode(ScaleMode::AUTO), threads(0),
+      last_fmt(PIX_FMT_NONE), last_width(0), last_height(0), last_drawn(0) {
+  for (const ImageRect &r : t)
+    tiles.push_back(align_rect(r));
+  styles.assign(tiles.size(), {0, 0});
+}
+
+std::vector<ImageRect> ImageMosaic::GridLayout(int cols, int rows, int width,
+                                               int height) {
+  std::vector<ImageRect> grid;
+  if (cols <= 0 || rows <= 0)
+    return grid;
+  for (int r = 0; r < rows; r++) {
+    int y0 = (r * height / rows) & ~1, y1 = ((r + 1) * height / rows) & ~1;
+    for (int c = 0; c < cols; c++) {
+      int x0 = (c * width / cols) & ~1, x1 = ((c + 1) * width / cols) & ~1;
+      grid.push_back({x0, y0, x1 - x0, y1 - y0});
+    }
+  }
+  return grid;
+}
+
+std::vector<ImageRect> ImageMosaic::ParseLayout(const std::string &layout,
+                                                int width, int height) {
+  std::vector<ImageRect> rects, aligned;
+  int cols = 0, rows = 0, n = 0;
+  if (sscanf(layout.c_str(), "%dx%d%n", &cols, &rows, &n) == 2 &&
+      n == (int)layout.size())
+    return GridLayout(cols, rows, width, height);
+  const char *p = layout.c_str();
+  while (*p) {
+    ImageRect r;
+    n = 0;
+    if (sscanf(p, " (%d,%d,%d,%d)%n", &r.x, &r.y, &r.w, &r.h, &n) != 4 ||
+        !n) {
+      LOG("invalid mosaic layout: %s\n", layout.c_str());
+      return std::vector<ImageRect>();
+    }
+    rects.push_back(r);
+    aligned.push_back(align_rect(r));
+    p += n;
+    while (*p == ' ')
+      p++;
+  }
+  int i = find_overlap(aligned);
+  if (i >= 0) {
+    LOG("mosaic layout: rect %d overlaps another, %s\n", i, layout.c_str());
+    return std::vector<ImageRect>();
+  }
+  return rects;
+}
+
+void ImageMosaic::SetBorder(int tile, int width, uint32_t color) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  TileStyle style = {(std::max(width, 0) + 1) & ~1, color};
+  if (tile < 0)
+    styles.assign(tiles.size(), style);
+  else if (tile < (int)tiles.size())
+    styles[tile] = style;
+  Invalidate();
+}
+
+void ImageMosaic::SetPlaceholder(uint32_t color) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  placeholder = color;
+  for (auto &it : drawn) {
+    for (auto &seq : it.second) {
+      if (seq == kPlaceholderSeq)
+        seq = kNeverDrawn;
+    }
+  }
+}
+
+void ImageMosaic::SetScaleMode(ScaleMode m) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  mode = m;
+  Invalidate();
+}
+
+void ImageMosaic::SetThreads(int t) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  threads = t;
+}
+
+int ImageMosaic::DrawTile(const CpuImage &dst, int i, const Input &in) {
+  const ImageRect &t = tiles[i];
+  int b = styles[i].border;
+  if (2 * b >= t.w || 2 * b >= t.h)
+    b = 0;
+  ImageRect inner = {t.x + b, t.y + b, t.w - 2 * b, t.h - 2 * b};
+  if (b) {
+    uint32_t c = styles[i].border_color;
+    const ImageRect frame[4] = {{t.x, t.y, t.w, b},
+                                {t.x, t.y + t.h - b, t.w, b},
+                                {t.x, inner.y, b, inner.h},
+                                {t.x + t.w - b, inner.y, b, inner.h}};
+    for (const ImageRect &r : frame) {
+      int ret = fill_rect(dst, r, c, matrix);
+      if (ret)
+        return ret;
+    }
+  }
+  if (!in.img)
+    return fill_rect(dst, inner, placeholder, matrix);
+  return BlitImage(dst, &inner, *in.img, nullptr, 0, mode, 1);
+}
+
+int ImageMosaic::Compose(const CpuImage &dst, uintptr_t dst_id,
+                         const std::vector<Input> &inputs) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  if (inputs.size() != tiles.size()) {
+    LOG("mosaic: %d inputs of %d tiles\n", (int)inputs.size(),
+        (int)tiles.size());
+    return -EINVAL;
+  }
+  for (const ImageRect &t : tiles) {
+    if (t.x < 0 || t.y < 0 || t.w <= 0 || t.h <= 0 ||
+        t.x + t.w > dst.width || t.y + t.h > dst.height) {
+      LOG("mosaic: tile (%d,%d,%d,%d) out of %dx%d\n", t.x, t.y, t.w, t.h,
+          dst.width, dst.height);
+      return -EINVAL;
+    }
+  }
+  int overlap = find_overlap(tiles);
+  if (overlap >= 0) {
+    LOG("mosaic: tile %d overlaps another\n", overlap);
+    return -EINVAL;
+  }
+  if (dst.fmt != last_fmt || dst.width != last_width ||
+      dst.height != last_height) {
+    Invalidate();
+    last_fmt = dst.fmt;
+    last_width = dst.width;
+    last_height = dst.height;
+  }
+  std::vector<uint64_t> *shown = nullptr;
+  bool whole = true;
+  if (dst_id) {
+    if (!drawn.count(dst_id) && drawn.size() >= kMaxRememberedBuffers)
+      Invalidate();
+    shown = &drawn[dst_id];
+    whole = shown->size() != tiles.size();
+    if (whole)
+      shown->assign(tiles.size(), kNeverDrawn);
+  }
+  // the area out of the tiles is cleared once a buffer
+  size_t covered = 0;
+  for (const ImageRect &t : tiles)
+    covered += (size_t)t.w * t.h;
+  if (whole && covered < (size_t)dst.width * dst.height) {
+    int ret = fill_rect(dst, {0, 0, dst.width & ~1, dst.height & ~1},
+                        kBackground, matrix);
+    if (ret) {
+      if (shown)
+        drawn.erase(dst_id);
+      return ret;
+    }
+  }
+  std::vector<int> dirty;
+  std::vector<uint64_t> seqs;
+  size_t pixels = 0;
+  for (size_t i = 0; i < tiles.size(); i++) {
+    uint64_t seq = inputs[i].img ? inputs[i].seq : kPlaceholderSeq;
+    if (shown && (*shown)[i] == seq)
+      continue;
+    dirty.push_back(i);
+    seqs.push_back(seq);
+    pixels += (size_t)tiles[i].w * tiles[i].h;
+  }
+  int n = dirty.size();
+  std::vector<int> results(n, 0);
+  int t = std::min(GetWorkThreads(threads, pixels), std::max(n, 1));
+  ForEachRowBand(n, 1, t, [&](int begin, int end) {
+    for (int k = begin; k < end; k++)
+      results[k] = DrawTile(dst, dirty[k], inputs[dirty[k]]);
+  });
+  int ret = 0;
+  for (int k = 0; k < n; k++) {
+    if (results[k])
+      ret = results[k];
+    if (shown)
+      (*shown)[dirty[k]] = results[k] ? kNeverDrawn : seqs[k];
+  }
+  last_drawn = n;
+  return ret;
+}
+
+} // namespace easymedia
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_IMAGE_MOSAIC_H_
+#define EASYMEDIA_IMAGE_MOSAIC_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "image_blit.h"
+
+namespace easymedia {
+
+// Composes many images into the tiles of one, such as the preview of the
+// cameras of a nvr, scaled by the cpu. It remembers which frame each tile of
+// each output buffer shows, so the buffers of a pool are only redrawn where
+// their tiles changed; the tiles run in parallel.
+class _API ImageMosaic {
+public:
+  struct Input {
+    const CpuImage *img; // null if the tile has no input
+    uint64_t seq;        // differs for each new frame of the tile
+  };
+
+  // tiles: where the inputs go in the output, aligned to even, none
+  // overlapping another
+  explicit ImageMosaic(const std::vector<ImageRect> &tiles,
+                       YuvMatrix matrix = YuvMatrix::BT601_LIMITED);
+
+  // cols x rows tiles of the same size, filling width x height
+  static std::vector<ImageRect> GridLayout(int cols, int rows, int width,
+                                           int height);
+  // The value of KEY_MOSAIC_LAYOUT: "CxR" of a grid of width x height, or the
+  // rects "(x,y,w,h)(x,y,w,h)..."; empty if invalid or overlapping.
+  static std::vector<ImageRect> ParseLayout(const std::string &layout,
+                                            int width, int height);
+
+  int GetTileNum() const { return tiles.size(); }
+  const std::vector<ImageRect> &GetTiles() const { return tiles; }
+  // A frame of width pixels and color (0xRRGGBB) inside the tile, such as
+  // the highlight of the selected one; -1 for all tiles.
+  void SetBorder(int tile, int width, uint32_t color);
+  // the colour of the tiles which have no input, 0xRRGGBB
+  void SetPlaceholder(uint32_t color);
+  void SetScaleMode(ScaleMode m);
+  // the threads the changed tiles split to, 0 picks by their size
+  void SetThreads(int t);
+
+  // Draw the inputs of the tiles into dst, one per tile, any format
+  // BlitImage takes. dst_id tells the output buffers apart, such as the
+  // address of their memory: the tiles which show the same seq since dst_id
+  // was last composed are skipped; 0 draws all. The area out of the tiles is
+  // black, drawn when the whole buffer is. Return 0 if success.
+  int Compose(const CpuImage &dst, uintptr_t dst_id,
+              const std::vector<Input> &inputs);
+  // the tiles drawn by the last Compose
+  int GetLastDrawnNum() const { return last_drawn; }
+
+private:
+  struct TileStyle {
+    int border;
+    uint32_t border_color;
+  };
+  int DrawTile(const CpuImage &dst, int i, const Input &in);
+  void Invalidate() { drawn.clear(); }
+
+  std::mutex mtx;
+  std::vector<ImageRect> tiles;
+  std::vector<TileStyle> styles;
+  YuvMatrix matrix;
+  uint32_t placeholder;
+  ScaleMode mode;
+  int threads;
+  // the seqs each output buffer shows
+  std::map<uintptr_t, std::vector<uint64_t>> drawn;
+  PixelFormat last_fmt;
+  int last_width, last_height;
+  int last_drawn;
+};
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_IMAGE_MOSAIC_H_
@@ -0,0 +1,437 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "image_overlay.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__)
+#define OVERLAY_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define OVERLAY_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "utils.h"
+
+namespace easymedia {
+
+// the transparent gaps shorter than it are blended through rather than
+// splitting the span
+static const int kMinSkipBytes = 16;
+
+// dst = (src * a + dst * (255 - a)) / 255, rounded. The vector kernels take
+// the same sums in 16 bits lanes, so all are bit exact; a of 0 and 255 give
+// dst and src exactly, so the skipped and the copied spans are too.
+static void blend_row_c(uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+                        int n) {
+  for (int i = 0; i < n; i++) {
+    unsigned t = src[i] * alpha[i] + dst[i] * (255 - alpha[i]) + 128;
+    dst[i] = (uint8_t)((t + (t >> 8)) >> 8);
+  }
+}
+
+#ifdef OVERLAY_SSE2
+// the products are unsigned, the wrapped low 16 bits are right
+static inline __m128i blend_epi16(__m128i s, __m128i d, __m128i a) {
+  const __m128i k255 = _mm_set1_epi16(255);
+  __m128i t = _mm_add_epi16(_mm_mullo_epi16(s, a),
+                            _mm_mullo_epi16(d, _mm_sub_epi16(k255, a)));
+  t = _mm_add_epi16(t, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+static void blend_row_sse2(uint8_t *dst, const uint8_t *src,
+                           const uint8_t *alpha, int n) {
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+    __m128i a = _mm_loadu_si128((const __m128i *)(alpha + i));
+    __m128i lo =
+        blend_epi16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero),
+                    _mm_unpacklo_epi8(a, zero));
+    __m128i hi =
+        blend_epi16(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero),
+                    _mm_unpackhi_epi8(a, zero));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+  }
+  blend_row_c(dst + i, src + i, alpha + i, n - i);
+}
+#endif // OVERLAY_SSE2
+
+#ifdef OVERLAY_NEON
+static void blend_row_neon(uint8_t *dst, const uint8_t *src,
+                           const uint8_t *alpha, int n) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t s = vld1q_u8(src + i);
+    uint8x16_t d = vld1q_u8(dst + i);
+    uint8x16_t a = vld1q_u8(alpha + i);
+    uint8x16_t na = vmvnq_u8(a);
+    uint16x8_t lo = vmull_u8(vget_low_u8(s), vget_low_u8(a));
+    lo = vmlal_u8(lo, vget_low_u8(d), vget_low_u8(na));
+    uint16x8_t hi = vmull_u8(vget_high_u8(s), vget_high_u8(a));
+    hi = vmlal_u8(hi, vget_high_u8(d), vget_high_u8(na));
+    // (t + ((t + 128) >> 8) + 128) >> 8
+    uint8x8_t rl = vraddhn_u16(lo, vrshrq_n_u16(lo, 8));
+    uint8x8_t rh = vraddhn_u16(hi, vrshrq_n_u16(hi, 8));
+    vst1q_u8(dst + i, vcombine_u8(rl, rh));
+  }
+  blend_row_c(dst + i, src + i, alpha + i, n - i);
+}
+#endif // OVERLAY_NEON
+
+typedef void (*BlendRow)(uint8_t *dst, const uint8_t *src,
+                         const uint8_t *alpha, int n);
+
+static BlendRow get_blend_row() {
+  if (GetConvertImpl() == ConvertImpl::SCALAR)
+    return blend_row_c;
+#if defined(OVERLAY_SSE2)
+  return blend_row_sse2;
+#elif defined(OVERLAY_NEON)
+  return blend_row_neon;
+#else
+  return blend_row_c;
+#endif
+}
+
+static bool get_overlay_layout(PixelFormat fmt,
+                               PlaneLayout layout[IMAGE_MAX_PLANES], int &num,
+                               bool &vu) {
+  switch (fmt) {
+  case PIX_FMT_YUV420P:
+  case PIX_FMT_NV12:
+  case PIX_FMT_YUV422P:
+  case PIX_FMT_NV16:
+    vu = false;
+    break;
+  case PIX_FMT_NV21:
+  case PIX_FMT_NV61:
+    vu = true;
+    break;
+  default:
+    return false;
+  }
+  num = GetPlaneLayout(fmt, layout);
+  return num > 0;
+}
+
+// A run of the bytes of a plane row which is not transparent.
+struct OverlaySpan {
+  int x, n;
+  bool opaque;
+};
+
+static void find_spans(const uint8_t *alpha, int n,
+                       std::vector<OverlaySpan> &spans) {
+  spans.clear();
+  int x = 0;
+  while (x < n) {
+    while (x < n && !alpha[x])
+      x++;
+    if (x >= n)
+      break;
+    int start = x, end = x;
+    while (x < n) {
+      if (alpha[x]) {
+        end = ++x;
+        continue;
+      }
+      int gap = x;
+      while (x < n && !alpha[x])
+        x++;
+      if (x - gap >= kMinSkipBytes)
+        break;
+    }
+    bool opaque = true;
+    for (int i = start; i < end && opaque; i++)
+      opaque = (alpha[i] == 255);
+    spans.push_back({start, end - start, opaque});
+  }
+}
+
+// The region in the samples of one plane of a frame format.
+struct OverlayPlane {
+  int bpp, xdiv, ydiv;
+  int w, h;
+  // rows of w * bpp bytes, only one of a mask
+  std::vector<uint8_t> src, alpha;
+  std::vector<std::vector<OverlaySpan>> spans;
+};
+
+struct ImageOverlay::Region {
+  OverlayType type;
+  int x, y, w, h;
+  // of the pixels, or one of the colour of a mask
+  std::vector<uint8_t> py, pu, pv, pa;
+  PixelFormat fmt; // of the planes
+  int num;
+  OverlayPlane planes[IMAGE_MAX_PLANES];
+
+  void SetPixel(size_t i, YuvMatrix m, uint8_t r, uint8_t g, uint8_t b,
+                uint8_t a) {
+    RgbToYuv(m, r, g, b, py[i], pu[i], pv[i]);
+    pa[i] = a;
+  }
+  // chroma of the samples under (cx, cy) of a plane, weighted by alpha
+  void GetChroma(int cx, int cy, int xdiv, int ydiv, uint8_t &u, uint8_t &v,
+                 uint8_t &a) const;
+  void Build(PixelFormat f, const PlaneLayout *layout, int n, bool vu);
+  void Draw(const CpuImage &img, BlendRow blend) const;
+};
+
+void ImageOverlay::Region::GetChroma(int cx, int cy, int xdiv, int ydiv,
+                                     uint8_t &u, uint8_t &v,
+                                     uint8_t &a) const {
+  if (type == OverlayType::MASK) {
+    u = pu[0];
+    v = pv[0];
+    a = pa[0];
+    return;
+  }
+  int sa = 0, su = 0, sv = 0;
+  for (int dy = 0; dy < ydiv; dy++) {
+    int yy = cy * ydiv + dy;
+    for (int dx = 0; dx < xdiv; dx++) {
+      int xx = cx * xdiv + dx;
+      if (xx >= w || yy >= h)
+        continue;
+      size_t i = (size_t)yy * w + xx;
+      sa += pa[i];
+      su += pa[i] * pu[i];
+      sv += pa[i] * pv[i];
+    }
+  }
+  int n = xdiv * ydiv;
+  a = (uint8_t)((sa + n / 2) / n);
+  u = (uint8_t)(sa ? (su + sa / 2) / sa : 128);
+  v = (uint8_t)(sa ? (sv + sa / 2) / sa : 128);
+}
+
+void ImageOverlay::Region::Build(PixelFormat f, const PlaneLayout *layout,
+                                 int n, bool vu) {
+  bool mask = (type == OverlayType::MASK);
+  for (int p = 0; p < n; p++) {
+    OverlayPlane &pl = planes[p];
+    pl.bpp = layout[p].bpp;
+    pl.xdiv = layout[p].xdiv;
+    pl.ydiv = layout[p].ydiv;
+    pl.w = (w + pl.xdiv - 1) / pl.xdiv;
+    pl.h = (h + pl.ydiv - 1) / pl.ydiv;
+    int rows = mask ? 1 : pl.h;
+    int bytes = pl.w * pl.bpp;
+    pl.src.resize((size_t)bytes * rows);
+    pl.alpha.resize((size_t)bytes * rows);
+    pl.spans.resize(rows);
+    for (int j = 0; j < rows; j++) {
+      uint8_t *s = &pl.src[(size_t)j * bytes];
+      uint8_t *al = &pl.alpha[(size_t)j * bytes];
+      for (int i = 0; i < pl.w; i++) {
+        if (p == 0) {
+          size_t k = mask ? 0 : (size_t)j * w + i;
+          s[i] = py[k];
+          al[i] = pa[k];
+          continue;
+        }
+        uint8_t u, v, a;
+        GetChroma(i, j, pl.xdiv, pl.ydiv, u, v, a);
+        if (pl.bpp == 2) {
+          s[2 * i] = vu ? v : u;
+          s[2 * i + 1] = vu ? u : v;
+          al[2 * i] = al[2 * i + 1] = a;
+        } else {
+          s[i] = (p == 1) ? u : v;
+          al[i] = a;
+        }
+      }
+      find_spans(al, bytes, pl.spans[j]);
+    }
+  }
+  num = n;
+  fmt = f;
+}
+
+void ImageOverlay::Region::Draw(const CpuImage &img, BlendRow blend) const {
+  bool mask = (type == OverlayType::MASK);
+  for (int p = 0; p < num; p++) {
+    const OverlayPlane &pl = planes[p];
+    // x and y are even, so are exact in the chroma
+    int ox = x / pl.xdiv, oy = y / pl.ydiv;
+    int fw = (img.width + pl.xdiv - 1) / pl.xdiv;
+    int fh = (img.height + pl.ydiv - 1) / pl.ydiv;
+    int r0 = std::max(0, -oy), r1 = std::min(pl.h, fh - oy);
+    int b0 = std::max(0, -ox) * pl.bpp;
+    int b1 = std::min(pl.w, fw - ox) * pl.bpp;
+    if (r0 >= r1 || b0 >= b1)
+      continue;
+    int bytes = pl.w * pl.bpp;
+    for (int r = r0; r < r1; r++) {
+      size_t j = mask ? 0 : r;
+      const uint8_t *s = &pl.src[j * bytes];
+      const uint8_t *al = &pl.alpha[j * bytes];
+      uint8_t *d = img.data[p] + (ptrdiff_t)(oy + r) * img.stride[p] +
+                   (ptrdiff_t)ox * pl.bpp;
+      for (const OverlaySpan &sp : pl.spans[j]) {
+        int s0 = std::max(sp.x, b0), s1 = std::min(sp.x + sp.n, b1);
+        if (s0 >= s1)
+          continue;
+        if (sp.opaque)
+          memcpy(d + s0, s + s0, s1 - s0);
+        else
+          blend(d + s0, s + s0, al + s0, s1 - s0);
+      }
+    }
+  }
+}
+
+ImageOverlay::ImageOverlay(YuvMatrix m) : matrix(m) {}
+
+ImageOverlay::~ImageOverlay() {}
+
+int ImageOverlay::SetRegion(int id, const OverlayRegion &region) {
+  const ImageRect &rc = region.rect;
+  if (rc.w <= 0 || rc.h <= 0) {
+    LOG("overlay: invalid region size %dx%d\n", rc.w, rc.h);
+    return -EINVAL;
+  }
+  std::unique_ptr<Region> r(new Region());
+  r->type = region.type;
+  r->x = rc.x & ~1;
+  r->y = rc.y & ~1;
+  r->w = rc.w;
+  r->h = rc.h;
+  r->fmt = PIX_FMT_NONE;
+  r->num = 0;
+  size_t size = (size_t)rc.w * rc.h;
+  switch (region.type) {
+  case OverlayType::MASK: {
+    uint32_t c = region.color;
+    size = 1;
+    r->py.resize(size);
+    r->pu.resize(size);
+    r->pv.resize(size);
+    r->pa.resize(size);
+    r->SetPixel(0, matrix, c >> 16, c >> 8, c, c >> 24);
+    break;
+  }
+  case OverlayType::BITMAP: {
+    if (!region.pixels)
+      return -EINVAL;
+    int stride = region.stride > 0 ? region.stride : rc.w * 4;
+    r->py.resize(size);
+    r->pu.resize(size);
+    r->pv.resize(size);
+    r->pa.resize(size);
+    for (int j = 0; j < rc.h; j++) {
+      const uint8_t *row = region.pixels + (size_t)j * stride;
+      for (int i = 0; i < rc.w; i++, row += 4)
+        r->SetPixel((size_t)j * rc.w + i, matrix, row[0], row[1], row[2],
+                    row[3]);
+    }
+    break;
+  }
+  case OverlayType::PALETTE: {
+    if (!region.pixels || !region.palette)
+      return -EINVAL;
+    int stride = region.stride > 0 ? region.stride : rc.w;
+    uint8_t table[256][4];
+    for (int c = 0; c < 256; c++) {
+      uint32_t argb = region.palette[c];
+      RgbToYuv(matrix, argb >> 16, argb >> 8, argb, table[c][0], table[c][1],
+               table[c][2]);
+      table[c][3] = argb >> 24;
+    }
+    r->py.resize(size);
+    r->pu.resize(size);
+    r->pv.resize(size);
+    r->pa.resize(size);
+    for (int j = 0; j < rc.h; j++) {
+      const uint8_t *row = region.pixels + (size_t)j * stride;
+      for (int i = 0; i < rc.w; i++) {
+        const uint8_t *t = table[row[i]];
+        size_t k = (size_t)j * rc.w + i;
+        r->py[k] = t[0];
+        r->pu[k] = t[1];
+        r->pv[k] = t[2];
+        r->pa[k] = t[3];
+      }
+    }
+    break;
+  }
+  default:
+    return -EINVAL;
+  }
+  std::lock_guard<std::mutex> _lg(mtx);
+  regions[id] = std::move(r);
+  return 0;
+}
+
+int ImageOverlay::MoveRegion(int id, int x, int y) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  auto it = regions.find(id);
+  if (it == regions.end())
+    return -EINVAL;
+  it->second->x = x & ~1;
+  it->second->y = y & ~1;
+  return 0;
+}
+
+void ImageOverlay::RemoveRegion(int id) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  if (id < 0)
+    regions.clear();
+  else
+    regions.erase(id);
+}
+
+bool ImageOverlay::Empty() {
+  std::lock_guard<std::mutex> _lg(mtx);
+  return regions.empty();
+}
+
+int ImageOverlay::Apply(const CpuImage &img) {
+  PlaneLayout layout[IMAGE_MAX_PLANES];
+  int num = 0;
+  bool vu = false;
+  if (!get_overlay_layout(img.fmt, layout, num, vu) || img.num != num) {
+    LOG("overlay: unsupport fmt %d\n", img.fmt);
+    return -EINVAL;
+  }
+  BlendRow blend = get_blend_row();
+  std::lock_guard<std::mutex> _lg(mtx);
+  for (auto &it : regions) {
+    Region &r = *it.second;
+    if (r.fmt != img.fmt)
+      r.Build(img.fmt, layout, num, vu);
+    r.Draw(img, blend);
+  }
+  return 0;
+}
+
+} // namespace easymedia
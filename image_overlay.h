@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_IMAGE_OVERLAY_H_
+#define EASYMEDIA_IMAGE_OVERLAY_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "image_convert.h"
+
+namespace easymedia {
+
+enum class OverlayType {
+  BITMAP,  // rgba pixels, argb8888 of CpuImage in memory
+  PALETTE, // 8 bits indices of a palette
+  MASK,    // a rect of one colour, such as a privacy mask
+};
+
+// A region of the on screen display, such as a time stamp or a logo. The
+// pixels are converted when the region is set, the caller keeps none of them.
+struct OverlayRegion {
+  OverlayType type;
+  ImageRect rect;          // in the frame, w and h are the ones of the pixels
+  const uint8_t *pixels;   // BITMAP and PALETTE
+  int stride;              // bytes of a row of the pixels, 0 if packed
+  const uint32_t *palette; // PALETTE: 256 colours of 0xAARRGGBB
+  uint32_t color;          // MASK: 0xAARRGGBB
+};
+
+// the arg of S_OVERLAY_REGION
+typedef struct {
+  int id;
+  OverlayRegion region;
+} OverlayRegionArg;
+
+// Blends the regions onto yuv frames in place, the encoder independent
+// counterpart of the osd of the vpu. A region is converted to yuv and alpha
+// once, and to the planes of a frame format at its first frame; the frames
+// then only blend the rows and the spans it covers, the transparent spans
+// are skipped and the opaque ones copied. The kernels follow SetConvertImpl.
+class _API ImageOverlay {
+public:
+  explicit ImageOverlay(YuvMatrix matrix = YuvMatrix::BT601_LIMITED);
+  ~ImageOverlay();
+
+  // Add or replace the region of id, the regions are drawn in the order of
+  // the ids. x and y are aligned down to even for the subsampled chroma.
+  // Return 0 if success.
+  int SetRegion(int id, const OverlayRegion &region);
+  // Move the region of id without converting it again.
+  int MoveRegion(int id, int x, int y);
+  // -1 removes all
+  void RemoveRegion(int id);
+  bool Empty();
+
+  // Draw the regions onto img of nv12, nv21, nv16, nv61, yuv420p or yuv422p,
+  // the parts out of the frame are clipped. Return 0 if success.
+  int Apply(const CpuImage &img);
+
+private:
+  struct Region;
+  std::mutex mtx;
+  YuvMatrix matrix;
+  std::map<int, std::unique_ptr<Region>> regions;
+};
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_IMAGE_OVERLAY_H_
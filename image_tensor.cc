@@ -0,0 +1,489 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "image_tensor.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <list>
+#include <vector>
+
+#include "buffer.h"
+#include "image_blit.h"
+#include "key_string.h"
+#include "utils.h"
+
+namespace easymedia {
+
+bool GetTensorTypeByString(const char *type, TensorType &t) {
+  if (!type)
+    return false;
+  if (!strcmp(type, NN_UINT8))
+    t = TensorType::UINT8;
+  else if (!strcmp(type, NN_INT8))
+    t = TensorType::INT8;
+  else if (!strcmp(type, NN_FLOAT32))
+    t = TensorType::FLOAT32;
+  else if (!strcmp(type, NN_FLOAT16))
+    t = TensorType::FLOAT16;
+  else if (!strcmp(type, NN_INT16))
+    t = TensorType::INT16;
+  else
+    return false;
+  return true;
+}
+
+bool GetTensorLayoutByString(const char *fmt, TensorLayout &l) {
+  if (!fmt)
+    return false;
+  if (!strcmp(fmt, KEY_NCHW))
+    l = TensorLayout::NCHW;
+  else if (!strcmp(fmt, KEY_NHWC))
+    l = TensorLayout::NHWC;
+  else
+    return false;
+  return true;
+}
+
+TensorSpec::TensorSpec()
+    : width(0), height(0), type(TensorType::UINT8),
+      layout(TensorLayout::NHWC), bgr(false), letterbox(true),
+      pad_color(0x727272), qnt_scale(1.0f), qnt_zp(0) {
+  for (int c = 0; c < 3; c++) {
+    mean[c] = 0.0f;
+    scale[c] = 1.0f;
+  }
+}
+
+int GetTensorTypeSize(TensorType t) {
+  switch (t) {
+  case TensorType::FLOAT32:
+    return 4;
+  case TensorType::FLOAT16:
+  case TensorType::INT16:
+    return 2;
+  default:
+    return 1;
+  }
+}
+
+size_t GetTensorSize(const TensorSpec &spec) {
+  if (spec.width <= 0 || spec.height <= 0)
+    return 0;
+  return (size_t)spec.width * spec.height * 3 * GetTensorTypeSize(spec.type);
+}
+
+// one value for all channels or one for each
+static bool parse_channels(const std::string &value, float out[3]) {
+  if (value.empty())
+    return true;
+  std::list<std::string> values;
+  if (!parse_media_param_list(value.c_str(), values, ','))
+    return false;
+  if (values.size() != 1 && values.size() != 3)
+    return false;
+  int c = 0;
+  for (auto &s : values)
+    out[c++] = std::stof(s);
+  for (; c < 3; c++)
+    out[c] = out[0];
+  return true;
+}
+
+bool ParseTensorSpecFromMap(std::map<std::string, std::string> &params,
+                            TensorSpec &spec) {
+  const std::string &type = params[KEY_TENSOR_TYPE];
+  const std::string &fmt = params[KEY_TENSOR_FMT];
+  if ((!type.empty() && !GetTensorTypeByString(type.c_str(), spec.type)) ||
+      (!fmt.empty() && !GetTensorLayoutByString(fmt.c_str(), spec.layout))) {
+    LOG("unsupported tensor %s, %s\n", type.c_str(), fmt.c_str());
+    return false;
+  }
+  const std::string &order = params[KEY_TENSOR_CHANNEL_ORDER];
+  if (!order.empty())
+    spec.bgr = (order == KEY_BGR);
+  if (!parse_channels(params[KEY_TENSOR_MEAN], spec.mean) ||
+      !parse_channels(params[KEY_TENSOR_SCALE], spec.scale)) {
+    LOG("invalid tensor mean or scale\n");
+    return false;
+  }
+  const std::string &qs = params[KEY_TENSOR_QNT_SCALE];
+  if (!qs.empty())
+    spec.qnt_scale = std::stof(qs);
+  const std::string &zp = params[KEY_TENSOR_QNT_ZP];
+  if (!zp.empty())
+    spec.qnt_zp = std::stoi(zp);
+  if (spec.qnt_scale == 0.0f) {
+    LOG("zero tensor quantisation scale\n");
+    return false;
+  }
+  const std::string &lb = params[KEY_LETTERBOX];
+  if (!lb.empty())
+    spec.letterbox = !!std::stoi(lb);
+  const std::string &color = params[KEY_LETTERBOX_COLOR];
+  if (!color.empty())
+    spec.pad_color = (uint32_t)std::stoul(color, nullptr, 0);
+  return true;
+}
+
+TensorMeta *GetTensorMeta(MediaBuffer &mb) {
+  if (mb.GetType() != Type::Tensor)
+    return nullptr;
+  return static_cast<TensorMeta *>(mb.GetUserData().get());
+}
+
+// The formats the rows are scaled from.
+struct SrcDesc {
+  PixelFormat fmt;
+  bool yuv;
+  int ydiv;    // vertical chroma subsampling, the horizontal one is 2
+  bool semi;   // interleaved chroma
+  bool vu;     // v first of the interleaved chroma
+  int bpp;     // of the rgb pixels
+  int r, g, b; // byte index of the rgb channels
+};
+
+static const SrcDesc src_descs[] = {
+    {PIX_FMT_YUV420P, true, 2, false, false, 1, 0, 0, 0},
+    {PIX_FMT_NV12, true, 2, true, false, 1, 0, 0, 0},
+    {PIX_FMT_NV21, true, 2, true, true, 1, 0, 0, 0},
+    {PIX_FMT_YUV422P, true, 1, false, false, 1, 0, 0, 0},
+    {PIX_FMT_NV16, true, 1, true, false, 1, 0, 0, 0},
+    {PIX_FMT_NV61, true, 1, true, true, 1, 0, 0, 0},
+    {PIX_FMT_RGB888, false, 1, false, false, 3, 0, 1, 2},
+    {PIX_FMT_BGR888, false, 1, false, false, 3, 2, 1, 0},
+    {PIX_FMT_ARGB8888, false, 1, false, false, 4, 0, 1, 2},
+    {PIX_FMT_ABGR8888, false, 1, false, false, 4, 2, 1, 0},
+};
+
+static const SrcDesc *get_src_desc(PixelFormat fmt) {
+  for (size_t i = 0; i < ARRAY_ELEMS(src_descs); i++) {
+    if (src_descs[i].fmt == fmt)
+      return &src_descs[i];
+  }
+  return nullptr;
+}
+
+// The two nearest samples of the position num / den - 0.5 among n samples,
+// and the weight of the second, as get_tap of the blitter.
+struct Tap {
+  int i0, i1;
+  int f;
+};
+
+static Tap get_tap(int64_t num, int64_t den, int n) {
+  int64_t s = (num << 16) / den - 32768;
+  if (s < 0)
+    s = 0;
+  Tap t;
+  t.i0 = (int)(s >> 16);
+  t.f = (int)(s >> 8) & 255;
+  if (t.i0 >= n - 1) {
+    t.i0 = n - 1;
+    t.f = 0;
+  }
+  t.i1 = t.f ? t.i0 + 1 : t.i0;
+  return t;
+}
+
+static inline uint8_t lerp(const uint8_t *row, const Tap &t) {
+  return (uint8_t)((row[t.i0] * (256 - t.f) + row[t.i1] * t.f + 128) >> 8);
+}
+
+struct TensorJob {
+  const SrcDesc *sd;
+  CpuImage src;  // cropped to the rect taken
+  ImageRect dst; // of the tensor
+  int width, height;
+  TensorLayout layout;
+  YuvMatrix matrix;
+  // the byte offsets of the columns of dst, of the luma or the rgb pixels;
+  // and of the chroma of the pixel pairs
+  std::vector<Tap> xtaps;
+  std::vector<Tap> ctaps;
+  int ch[3]; // the rgba byte of each channel of the tensor
+};
+
+// The rows of one band: the source rows are blended vertically, then the
+// columns of dst are picked out, converted to r,g,b,a and packed.
+class TensorRows {
+public:
+  explicit TensorRows(const TensorJob &j)
+      : job(j), n(j.src.width * j.sd->bpp), mid0(n), mid1(n),
+        y(j.dst.w), u((j.dst.w + 1) / 2), v((j.dst.w + 1) / 2),
+        rgba(j.dst.w * 4) {}
+
+  // r,g,b,a of the row ry of dst
+  const uint8_t *Scale(int ry);
+
+private:
+  const uint8_t *blend(std::vector<uint8_t> &mid, int plane, const Tap &t,
+                       int bytes);
+
+  const TensorJob &job;
+  int n;
+  std::vector<uint8_t> mid0, mid1;
+  std::vector<uint8_t> y, u, v;
+  std::vector<uint8_t> rgba;
+};
+
+const uint8_t *TensorRows::blend(std::vector<uint8_t> &mid, int plane,
+                                 const Tap &t, int bytes) {
+  const CpuImage &s = job.src;
+  const uint8_t *r0 = s.data[plane] + (size_t)t.i0 * s.stride[plane];
+  if (!t.f)
+    return r0;
+  const uint8_t *r1 = s.data[plane] + (size_t)t.i1 * s.stride[plane];
+  BlendRows(mid.data(), r0, r1, bytes, t.f);
+  return mid.data();
+}
+
+const uint8_t *TensorRows::Scale(int ry) {
+  const SrcDesc &sd = *job.sd;
+  int sh = job.src.height, dh = job.dst.h, w = job.dst.w;
+  Tap ty = get_tap((int64_t)(2 * ry + 1) * sh, 2 * dh, sh);
+  const uint8_t *row = blend(mid0, 0, ty, n);
+  if (!sd.yuv) {
+    uint8_t *p = rgba.data();
+    for (int x = 0; x < w; x++, p += 4) {
+      const Tap &t = job.xtaps[x];
+      p[0] = lerp(row + sd.r, t);
+      p[1] = lerp(row + sd.g, t);
+      p[2] = lerp(row + sd.b, t);
+      p[3] = 255;
+    }
+    return rgba.data();
+  }
+  for (int x = 0; x < w; x++)
+    y[x] = lerp(row, job.xtaps[x]);
+  int cw = (w + 1) / 2, ch = sh / sd.ydiv;
+  Tap tc = get_tap((int64_t)(2 * ry + 1) * sh, 2 * dh * sd.ydiv, ch);
+  if (sd.semi) {
+    const uint8_t *c = blend(mid1, 1, tc, job.src.width);
+    const uint8_t *cu = c + (sd.vu ? 1 : 0), *cv = c + (sd.vu ? 0 : 1);
+    for (int x = 0; x < cw; x++) {
+      u[x] = lerp(cu, job.ctaps[x]);
+      v[x] = lerp(cv, job.ctaps[x]);
+    }
+  } else {
+    int cn = job.src.width / 2;
+    const uint8_t *cu = blend(mid1, 1, tc, cn);
+    for (int x = 0; x < cw; x++)
+      u[x] = lerp(cu, job.ctaps[x]);
+    // the v row reuses mid0, the luma row is done with
+    const uint8_t *cv = blend(mid0, 2, tc, cn);
+    for (int x = 0; x < cw; x++)
+      v[x] = lerp(cv, job.ctaps[x]);
+  }
+  YuvToRgbaRow(job.matrix, y.data(), u.data(), v.data(), rgba.data(), w,
+               false);
+  return rgba.data();
+}
+
+// The values of the channels of the tensor by the 8 bits samples, so the
+// normalisation and the quantisation are one lookup.
+template <typename T> struct TensorLut {
+  T lut[3][256];
+  T pad[3];
+};
+
+static void make_lut(const TensorSpec &spec, const int ch[3],
+                     TensorLut<float> &t) {
+  for (int c = 0; c < 3; c++) {
+    int k = ch[c];
+    for (int i = 0; i < 256; i++)
+      t.lut[c][i] = (i - spec.mean[k]) * spec.scale[k];
+    t.pad[c] = t.lut[c][(spec.pad_color >> (16 - 8 * k)) & 0xFF];
+  }
+}
+
+static void make_lut(const TensorSpec &spec, const int ch[3],
+                     TensorLut<uint8_t> &t) {
+  int lo = 0, hi = 255;
+  if (spec.type == TensorType::INT8) {
+    lo = -128;
+    hi = 127;
+  }
+  for (int c = 0; c < 3; c++) {
+    int k = ch[c];
+    for (int i = 0; i < 256; i++) {
+      float value = (i - spec.mean[k]) * spec.scale[k];
+      int q = (int)lrintf(value / spec.qnt_scale) + spec.qnt_zp;
+      t.lut[c][i] = (uint8_t)std::min(std::max(q, lo), hi);
+    }
+    t.pad[c] = t.lut[c][(spec.pad_color >> (16 - 8 * k)) & 0xFF];
+  }
+}
+
+template <typename T>
+static void pad_row(const TensorJob &job, const TensorLut<T> &t, T *tensor,
+                    int ty, int x0, int x1) {
+  size_t w = job.width;
+  if (job.layout == TensorLayout::NHWC) {
+    T *p = tensor + (ty * w + x0) * 3;
+    for (int x = x0; x < x1; x++, p += 3) {
+      p[0] = t.pad[0];
+      p[1] = t.pad[1];
+      p[2] = t.pad[2];
+    }
+    return;
+  }
+  for (int c = 0; c < 3; c++) {
+    T *p = tensor + (c * job.height + ty) * w;
+    std::fill(p + x0, p + x1, t.pad[c]);
+  }
+}
+
+template <typename T>
+static void pack_row(const TensorJob &job, const TensorLut<T> &t, T *tensor,
+                     int ty, const uint8_t *rgba) {
+  size_t w = job.width;
+  int dw = job.dst.w;
+  const int *ch = job.ch;
+  if (job.layout == TensorLayout::NHWC) {
+    T *p = tensor + (ty * w + job.dst.x) * 3;
+    for (int x = 0; x < dw; x++, p += 3, rgba += 4) {
+      p[0] = t.lut[0][rgba[ch[0]]];
+      p[1] = t.lut[1][rgba[ch[1]]];
+      p[2] = t.lut[2][rgba[ch[2]]];
+    }
+    return;
+  }
+  for (int c = 0; c < 3; c++) {
+    T *p = tensor + (c * job.height + ty) * w + job.dst.x;
+    const uint8_t *s = rgba + ch[c];
+    const T *lut = t.lut[c];
+    for (int x = 0; x < dw; x++)
+      p[x] = lut[s[x * 4]];
+  }
+}
+
+template <typename T>
+static void fill_tensor(const TensorJob &job, const TensorSpec &spec,
+                        void *tensor, int threads) {
+  TensorLut<T> t;
+  make_lut(spec, job.ch, t);
+  T *out = static_cast<T *>(tensor);
+  const ImageRect &d = job.dst;
+  ForEachRowBand(job.height, 1, threads, [&](int y0, int y1) {
+    TensorRows rows(job);
+    for (int ty = y0; ty < y1; ty++) {
+      if (ty < d.y || ty >= d.y + d.h) {
+        pad_row(job, t, out, ty, 0, job.width);
+        continue;
+      }
+      pad_row(job, t, out, ty, 0, d.x);
+      pack_row(job, t, out, ty, rows.Scale(ty - d.y));
+      pad_row(job, t, out, ty, d.x + d.w, job.width);
+    }
+  });
+}
+
+// the largest rect of the aspect ratio of r centered in the tensor
+static ImageRect get_letterbox(const TensorSpec &spec, const ImageRect &r) {
+  int w = spec.width, h = spec.height;
+  if (!spec.letterbox)
+    return ImageRect{0, 0, w, h};
+  if ((int64_t)r.w * h <= (int64_t)r.h * w)
+    w = std::max(1, (int)(((int64_t)r.w * h + r.h / 2) / r.h));
+  else
+    h = std::max(1, (int)(((int64_t)r.h * w + r.w / 2) / r.w));
+  return ImageRect{(spec.width - w) / 2, (spec.height - h) / 2, w, h};
+}
+
+int ImageToTensor(void *tensor, const TensorSpec &spec, const CpuImage &src,
+                  const ImageRect *src_rect, LetterboxTransform *transform,
+                  YuvMatrix matrix, int threads) {
+  const SrcDesc *sd = get_src_desc(src.fmt);
+  bool packable = spec.type == TensorType::UINT8 ||
+                  spec.type == TensorType::INT8 ||
+                  spec.type == TensorType::FLOAT32;
+  if (!tensor || !sd || !packable || GetTensorSize(spec) == 0) {
+    LOG("ImageToTensor: unsupported %s to %dx%d\n", PixFmtToString(src.fmt),
+        spec.width, spec.height);
+    return -EINVAL;
+  }
+  if (spec.type != TensorType::FLOAT32 && spec.qnt_scale == 0.0f)
+    return -EINVAL;
+  ImageRect r = src_rect ? *src_rect : ImageRect{0, 0, src.width, src.height};
+  if (sd->yuv) {
+    r.x &= ~1;
+    r.y &= ~1;
+    r.w &= ~1;
+    r.h &= ~1;
+  }
+  if (r.x < 0 || r.y < 0 || r.w <= 0 || r.h <= 0 ||
+      r.x + r.w > src.width || r.y + r.h > src.height) {
+    LOG("ImageToTensor: invalid rect (%d,%d,%d,%d) of %dx%d\n", r.x, r.y,
+        r.w, r.h, src.width, src.height);
+    return -EINVAL;
+  }
+  TensorJob job;
+  job.sd = sd;
+  job.src = src;
+  job.src.width = r.w;
+  job.src.height = r.h;
+  job.src.data[0] += (size_t)r.y * src.stride[0] + r.x * sd->bpp;
+  if (sd->yuv) {
+    int cx = sd->semi ? r.x : r.x / 2;
+    for (int i = 1; i < src.num; i++)
+      job.src.data[i] += (size_t)(r.y / sd->ydiv) * src.stride[i] + cx;
+  }
+  job.dst = get_letterbox(spec, r);
+  job.width = spec.width;
+  job.height = spec.height;
+  job.layout = spec.layout;
+  job.matrix = matrix;
+  for (int c = 0; c < 3; c++)
+    job.ch[c] = spec.bgr ? 2 - c : c;
+  int bpp = sd->bpp, dw = job.dst.w;
+  job.xtaps.resize(dw);
+  for (int x = 0; x < dw; x++) {
+    Tap t = get_tap((int64_t)(2 * x + 1) * r.w, 2 * dw, r.w);
+    job.xtaps[x] = {t.i0 * bpp, t.i1 * bpp, t.f};
+  }
+  if (sd->yuv) {
+    // the centers of the pairs, among the chroma samples
+    int cstep = sd->semi ? 2 : 1;
+    job.ctaps.resize((dw + 1) / 2);
+    for (int x = 0; x < (dw + 1) / 2; x++) {
+      Tap t = get_tap((int64_t)(2 * x + 1) * r.w, 2 * dw, r.w / 2);
+      job.ctaps[x] = {t.i0 * cstep, t.i1 * cstep, t.f};
+    }
+  }
+  if (transform) {
+    transform->src = r;
+    transform->dst = job.dst;
+    transform->scale_x = (float)job.dst.w / r.w;
+    transform->scale_y = (float)job.dst.h / r.h;
+  }
+  threads = GetWorkThreads(threads, (size_t)spec.width * spec.height);
+  if (spec.type == TensorType::FLOAT32)
+    fill_tensor<float>(job, spec, tensor, threads);
+  else
+    fill_tensor<uint8_t>(job, spec, tensor, threads);
+  return 0;
+}
+
+} // namespace easymedia
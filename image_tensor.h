@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_IMAGE_TENSOR_H_
+#define EASYMEDIA_IMAGE_TENSOR_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "image_convert.h"
+
+namespace easymedia {
+
+class MediaBuffer;
+
+enum class TensorType {
+  UINT8,
+  INT8,
+  FLOAT32,
+  FLOAT16, // of the models only, not made by ImageToTensor
+  INT16,
+};
+
+enum class TensorLayout {
+  NCHW,
+  NHWC,
+};
+
+// By the values of KEY_TENSOR_TYPE (NN_UINT8, NN_INT8, NN_FLOAT32, ...) and
+// KEY_TENSOR_FMT. Return false if unknown.
+_API bool GetTensorTypeByString(const char *type, TensorType &t);
+_API bool GetTensorLayoutByString(const char *fmt, TensorLayout &l);
+// bytes of one element
+_API int GetTensorTypeSize(TensorType t);
+
+// The input tensor a model takes, 3 channels.
+struct _API TensorSpec {
+  TensorSpec();
+
+  int width, height;
+  TensorType type;
+  TensorLayout layout;
+  bool bgr;           // the order of the channels, rgb if false
+  bool letterbox;     // keep the aspect ratio and pad, or stretch
+  uint32_t pad_color; // 0xRRGGBB of the letterbox bars
+  // value = (pixel - mean) * scale, of the r, g, b channels
+  float mean[3];
+  float scale[3];
+  // the affine quantisation of the integer types, q = value / qnt_scale + zp
+  float qnt_scale;
+  int qnt_zp;
+};
+
+_API size_t GetTensorSize(const TensorSpec &spec);
+
+// Set spec by KEY_TENSOR_TYPE, KEY_TENSOR_FMT, KEY_TENSOR_CHANNEL_ORDER,
+// KEY_TENSOR_MEAN, KEY_TENSOR_SCALE, KEY_TENSOR_QNT_SCALE, KEY_TENSOR_QNT_ZP,
+// KEY_LETTERBOX and KEY_LETTERBOX_COLOR of params, the absent ones are kept.
+// Return false if any is invalid.
+_API bool ParseTensorSpecFromMap(std::map<std::string, std::string> &params,
+                                 TensorSpec &spec);
+
+// Where the image lands in the tensor, to map the detections back.
+struct _API LetterboxTransform {
+  ImageRect src; // the rect of the image taken
+  ImageRect dst; // where it is scaled to in the tensor, the rest is padded
+  float scale_x, scale_y;
+
+  void ToImage(float &x, float &y) const {
+    x = (x - dst.x) / scale_x + src.x;
+    y = (y - dst.y) / scale_y + src.y;
+  }
+  void ToTensor(float &x, float &y) const {
+    x = (x - src.x) * scale_x + dst.x;
+    y = (y - src.y) * scale_y + dst.y;
+  }
+};
+
+// Fill the tensor from src_rect of src in one sweep: each row of the tensor
+// is scaled bilinearly from the rows of src, converted to rgb, normalised,
+// quantised and stored by the layout, so no whole rgb frame is made.
+// Null src_rect is the whole image, aligned to even if src is subsampled yuv.
+// src is any of the yuv 420/422 formats, rgb888, bgr888, argb8888 or
+// abgr8888. The rows are banded to threads, 0 picks by the tensor size.
+// The type is UINT8, INT8 or FLOAT32. Return 0 if success.
+_API int ImageToTensor(void *tensor, const TensorSpec &spec,
+                       const CpuImage &src, const ImageRect *src_rect = nullptr,
+                       LetterboxTransform *transform = nullptr,
+                       YuvMatrix matrix = YuvMatrix::BT601_LIMITED,
+                       int threads = 0);
+
+// The user data of a buffer of Type::Tensor, such as the output of the
+// nnpreprocess filter.
+struct TensorMeta {
+  TensorSpec spec;
+  LetterboxTransform transform;
+  std::shared_ptr<MediaBuffer> memory; // where the tensor is
+  // the tensors of the next inputs of a model of more inputs, in their order
+  std::vector<std::shared_ptr<MediaBuffer>> next_inputs;
+};
+
+// Return nullptr if mb is not a tensor.
+_API TensorMeta *GetTensorMeta(MediaBuffer &mb);
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_IMAGE_TENSOR_H_
@@ -48,6 +48,19 @@
 #define KEY_RIGHT_DIRECTION "->"
 #define KEY_BUFFER_RECT "rect"
 #define KEY_BUFFER_ROTATE "rotate"
+// the interpolation of the cpu scaling, auto by default
+#define KEY_SCALE_MODE "scale_mode"
+#define KEY_SCALE_BILINEAR "bilinear"
+#define KEY_SCALE_AREA "area"
+// the threads which the cpu image processing splits the rows to
+#define KEY_THREAD_NUM "thread_num"
+// the colour matrix between yuv and rgb, bt601 limited range by default
+#define KEY_COLOR_MATRIX "color_matrix"
+#define KEY_BT601 "bt601"
+#define KEY_BT709 "bt709"
+#define KEY_COLOR_RANGE "color_range"
+#define KEY_RANGE_LIMITED "limited"
+#define KEY_RANGE_FULL "full"
 
 // video info
 #define KEY_COMPRESS_QP_INIT "qp_init"
@@ -66,6 +79,7 @@
 #define KEY_MPP_GROUP_MAX_FRAMES "fg_max_frames" // framegroup max frame num
 #define KEY_MPP_SPLIT_MODE "split_mode"
 #define KEY_OUTPUT_TIMEOUT "output_timeout"
+#define KEY_MPP_ASYNC_DEPTH "async_depth" // frames in flight, 0 is sync
 
 // audio info
 #define KEY_SAMPLE_FMT "sample_format"
@@ -97,7 +111,14 @@
 
 #define KEY_MEM_SIZE_PERTIME "size_pertime"
 
+// output buffers pooled by a flow or a decoder, the default size is the
+// worst case
+#define KEY_POOL_BUFFER_NUM "pool_buffer_num"
+#define KEY_POOL_BUFFER_SIZE "pool_buffer_size"
+
 #define KEY_LOOP_TIME "loop_time"
+// read the file source without pacing by the frame rate
+#define KEY_AS_FAST_AS_POSSIBLE "as_fast_as_possible"
 
 // flow
 #define KEK_THREAD_SYNC_MODEL "thread_model"
@@ -115,6 +136,17 @@
 
 #define KEY_OUTPUT_HOLD_INPUT "output_hold_input"
 
+// mosaic, "CxR" of a grid or the rects "(x,y,w,h)(x,y,w,h)..." of the tiles
+#define KEY_MOSAIC_LAYOUT "mosaic_layout"
+#define KEY_MOSAIC_BORDER "mosaic_border" // pixels of the frames of the tiles
+#define KEY_MOSAIC_BORDER_COLOR "mosaic_border_color" // 0xRRGGBB
+#define KEY_MOSAIC_PLACEHOLDER_COLOR "mosaic_placeholder_color"
+// ms without a new frame before a tile shows the placeholder, 0 never
+#define KEY_MOSAIC_TIMEOUT "mosaic_timeout"
+
+// access unit
+#define KEY_STREAM_TIMING "stream_timing"
+
 // drm
 #define KEY_CONNECTOR_ID "connector_id"
 #define KEY_CRTC_ID "crtc_id"
@@ -140,9 +172,43 @@
 
 // rknn
 #define KEY_OUTPUT_WANT_FLOAT "rknn_output_want_float"
+// the NNBackend which runs the model, "rknn" if not set
+#define KEY_NN_BACKEND "nn_backend"
+// the inferences of the rknn filter in flight, pipelined if more than 1
+#define KEY_NN_INFLIGHT "nn_inflight"
+// the stand-in npus, the dims of the tensors "1x640x640x3,1x25200x85"
+#define KEY_NN_SIM_INPUTS "nn_sim_inputs"
+#define KEY_NN_SIM_OUTPUTS "nn_sim_outputs"
+#define KEY_NN_SIM_LATENCY "nn_sim_latency" // us of one run
+// the cpu stand-in, the multiply-accumulates of one run in millions
+#define KEY_NN_CPU_MACS "nn_cpu_macs"
+// the crops of a frame the nncascade flow runs, of the highest scores
+#define KEY_NN_CASCADE_MAX_CROPS "nn_cascade_max_crops"
+// the detector head nnpostprocess decodes, and its anchors "w,h,w,h,..."
+#define KEY_NN_HEAD "nn_head"
+#define KEY_YOLOV5 "yolov5"
+#define KEY_YOLOV8 "yolov8"
+#define KEY_NN_ANCHORS "nn_anchors"
+#define KEY_NN_LOGITS "nn_logits" // 1 if the model leaves out the sigmoid
+#define KEY_NN_SCORE_THRESHOLD "nn_score_threshold"
+#define KEY_NN_NMS_THRESHOLD "nn_nms_threshold" // iou
+#define KEY_NN_MAX_DETECTIONS "nn_max_detections"
 #define KEY_TENSOR_TYPE "tensor_type"
 #define KEY_TENSOR_FMT "tensor_fmt"
 #define KEY_NCHW "NCHW"
 #define KEY_NHWC "NHWC"
+// the input tensor made by nnpreprocess, of KEY_BUFFER_WIDTH x
+// KEY_BUFFER_HEIGHT and KEY_TENSOR_TYPE, KEY_TENSOR_FMT
+#define KEY_TENSOR_CHANNEL_ORDER "tensor_channel_order"
+#define KEY_RGB "rgb"
+#define KEY_BGR "bgr"
+// "r,g,b" or one for all, value = (pixel - mean) * scale
+#define KEY_TENSOR_MEAN "tensor_mean"
+#define KEY_TENSOR_SCALE "tensor_scale"
+// of the integer tensors, q = value / qnt_scale + qnt_zp
+#define KEY_TENSOR_QNT_SCALE "tensor_qnt_scale"
+#define KEY_TENSOR_QNT_ZP "tensor_qnt_zp"
+#define KEY_LETTERBOX "letterbox" // 1 keeps the aspect ratio, 0 stretches
+#define KEY_LETTERBOX_COLOR "letterbox_color" // 0xRRGGBB
 
 #endif // #ifndef EASYMEDIA_MEDIA_KEY_STRING_H_
@@ -67,7 +67,8 @@ bool SendVideoToServer(Flow *f, MediaBufferVector &input_vector) {
   auto &buffer = input_vector[0];
   if (buffer && buffer->IsHwBuffer()) {
     // hardware buffer is limited, copy it
-    auto new_buffer = MediaBuffer::Clone(*buffer.get());
+    auto new_buffer = MediaBuffer::Clone(
+        *buffer.get(), MediaBuffer::MemType::MEM_COMMON, "rtsp_server");
     buffer = new_buffer;
   }
   rtsp_flow->server_input->PushNewVideo(buffer);
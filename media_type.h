@@ -22,7 +22,16 @@
 #ifndef EASYMEDIA_MEDIA_TYPE_H_
 #define EASYMEDIA_MEDIA_TYPE_H_
 
-enum class Type { None = -1, Audio = 0, Image, Video, Text };
+enum class Type {
+  None = -1,
+  Audio = 0,
+  Image,
+  Video,
+  Text,
+  Tensor,
+  NNResult,  // the outputs of a model, see NNResultMeta
+  Detection, // the objects found in a frame, see GetDetections
+};
 
 // My fixed convention:
 //  definition = "=", value separator = ",", definition separator = "\n"
@@ -57,6 +66,7 @@ enum class Type { None = -1, Audio = 0, Image, Video, Text };
 
 #define VIDEO_PREFIX "video:"
 #define VIDEO_H264 "video:h264"
+#define VIDEO_H265 "video:h265"
 
 #define AUDIO_PREFIX "audio:"
 #define AUDIO_VORBIS "audio:vorbis"
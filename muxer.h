@@ -57,7 +57,8 @@ public:
   virtual bool NewMuxerStream(std::shared_ptr<Encoder> enc, int &stream_no) = 0;
   // Some muxer has close integrated io operation, such as ffmpeg.
   // Need set into a corresponding Stream.
-  // If set io stream, the following function 'Write' may always return nullptr.
+  // If set io stream, the following function 'Write' may always return nullptr
+  // or a buffer of zero valid size which only carries the attributes.
   virtual bool SetIoStream(std::shared_ptr<Stream> output) {
     io_output = output;
     return true;
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "nn_backend.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <mutex>
+
+#include "buffer.h"
+
+namespace easymedia {
+
+static std::mutex model_mtx;
+// by the real path
+static std::map<std::string, std::weak_ptr<NNModel>> models;
+
+// the file over anonymous pages, so the padding reads zeros even if the file
+// ends at a page boundary
+static void *map_model(int fd, size_t size, size_t map_size) {
+  void *addr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED)
+    return nullptr;
+  void *data = mmap(addr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                    fd, 0);
+  if (data == MAP_FAILED) {
+    munmap(addr, map_size);
+    return nullptr;
+  }
+  return data;
+}
+
+std::shared_ptr<NNModel> NNModel::Open(const std::string &path) {
+  char real[PATH_MAX];
+  if (!realpath(path.c_str(), real)) {
+    LOG("Fail to find model %s, %m\n", path.c_str());
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> _lg(model_mtx);
+  auto it = models.find(real);
+  if (it != models.end()) {
+    auto model = it->second.lock();
+    if (model)
+      return model;
+    models.erase(it);
+  }
+  int fd = open(real, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    LOG("Fail to open model %s, %m\n", real);
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size <= 0) {
+    LOG("Fail to stat model %s\n", real);
+    close(fd);
+    return nullptr;
+  }
+  size_t size = st.st_size;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t map_size = (size + kPadding + page - 1) / page * page;
+  void *data = map_model(fd, size, map_size);
+  close(fd);
+  if (!data) {
+    LOG("Fail to mmap model %s, %m\n", real);
+    return nullptr;
+  }
+  std::shared_ptr<NNModel> model(new NNModel(real, data, size, map_size));
+  models[real] = model;
+  return model;
+}
+
+NNModel::~NNModel() { munmap(data, map_size); }
+
+NNResultMeta *GetNNResultMeta(MediaBuffer &mb) {
+  if (mb.GetType() != Type::NNResult)
+    return nullptr;
+  return static_cast<NNResultMeta *>(mb.GetUserData().get());
+}
+
+NNTensorAttr GetNNOutputAttr(const NNTensorAttr &attr, bool want_float) {
+  NNTensorAttr a = attr;
+  if (want_float) {
+    a.type = TensorType::FLOAT32;
+    a.size = a.n_elems * sizeof(float);
+    a.scale = 1.0f;
+    a.zp = 0;
+  }
+  return a;
+}
+
+DEFINE_REFLECTOR(NNBackend)
+
+// request should equal backend_name
+DEFINE_FACTORY_COMMON_PARSE(NNBackend)
+
+DEFINE_PART_FINAL_EXPOSE_PRODUCT(NNBackend, NNBackend)
+
+} // namespace easymedia
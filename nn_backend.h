@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_NN_BACKEND_H_
+#define EASYMEDIA_NN_BACKEND_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "image_tensor.h"
+#include "media_reflector.h"
+#include "media_type.h"
+
+namespace easymedia {
+
+DECLARE_FACTORY(NNBackend)
+
+// usage: REFLECTOR(NNBackend)::Create<NNBackend>(backendname, param)
+DECLARE_REFLECTOR(NNBackend)
+
+#define DEFINE_NN_BACKEND_FACTORY(REAL_PRODUCT)                                \
+  DEFINE_MEDIA_CHILD_FACTORY(REAL_PRODUCT, REAL_PRODUCT::GetBackendName(),     \
+                             NNBackend, NNBackend)                             \
+  DEFINE_MEDIA_CHILD_FACTORY_EXTRA(REAL_PRODUCT)                               \
+  DEFINE_MEDIA_NEW_PRODUCT_BY(REAL_PRODUCT, NNBackend, GetError() < 0)         \
+  const char *FACTORY(REAL_PRODUCT)::ExpectedInputDataType() {                 \
+    return TYPE_ANYTHING;                                                      \
+  }                                                                            \
+  const char *FACTORY(REAL_PRODUCT)::OutPutDataType() { return TYPE_ANYTHING; }
+
+struct NNTensorAttr {
+  uint32_t index;
+  std::string name;
+  std::vector<uint32_t> dims; // the outermost first
+  uint32_t n_elems;
+  uint32_t size; // bytes of the elements of type
+  TensorType type;
+  TensorLayout layout;
+  // the affine quantisation, value = (q - zp) * scale
+  float scale;
+  int32_t zp;
+};
+
+struct NNInput {
+  void *buf;
+  uint32_t size;
+  TensorType type;
+  TensorLayout layout;
+};
+
+// One output tensor, of the same layout as rknn_output (checked by the rknn
+// backend) so the consumers of the rknn filter take either.
+struct NNOutput {
+  uint8_t want_float; // converted to float32 from the quantised type
+  uint8_t is_prealloc;
+  uint32_t index;
+  void *buf;
+  uint32_t size;
+};
+
+// The user data of a buffer of Type::NNResult, the output of the rknn filter
+// and of the nncascade flow. The buffer is the array of the outputs, of valid
+// size their number; attrs tell each as it is in its buffer, float32 if it
+// is want_float.
+struct NNResultMeta {
+  std::vector<NNOutput> outputs;
+  std::vector<NNTensorAttr> attrs;
+  std::vector<std::shared_ptr<MediaBuffer>> memory;
+};
+
+// Return nullptr if mb is not a result.
+_API NNResultMeta *GetNNResultMeta(MediaBuffer &mb);
+// The attr of an output as it is got, float32 if want_float.
+_API NNTensorAttr GetNNOutputAttr(const NNTensorAttr &attr, bool want_float);
+
+// A model file, mapped once for all the backends which run it while any of
+// them holds it, so more detectors of one model share its memory. The
+// mapping is private and writable, as the runtimes take a non-const buffer,
+// and ends with kPadding zero bytes, as librknn_runtime reads over the end.
+class _API NNModel {
+public:
+  static const size_t kPadding = 1024;
+
+  // nullptr if the file fails to map
+  static std::shared_ptr<NNModel> Open(const std::string &path);
+  ~NNModel();
+  void *GetData() const { return data; }
+  size_t GetSize() const { return size; }
+  const std::string &GetPath() const { return path; }
+
+private:
+  NNModel(const std::string &file, void *mem, size_t len, size_t mapped)
+      : path(file), data(mem), size(len), map_size(mapped) {}
+
+  std::string path;
+  void *data;
+  size_t size;
+  size_t map_size;
+};
+
+// A runtime which runs one instance of a model, such as the npu of rknn.
+// The param is the one of the filter which creates it. The calls of one
+// backend are serial; more instances run at the same time.
+class _API NNBackend {
+public:
+  virtual ~NNBackend() = default;
+  static const char *GetBackendName() { return nullptr; }
+
+  const std::vector<NNTensorAttr> &GetInputAttrs() const {
+    return input_attrs;
+  }
+  const std::vector<NNTensorAttr> &GetOutputAttrs() const {
+    return output_attrs;
+  }
+
+  // One inference, each step blocks till done: copy the inputs, one for each
+  // input tensor, into the model; run it; write the outputs into the buffers
+  // of outputs, one for each output tensor, of the sizes of their attrs or
+  // n_elems floats if want_float. Return 0 if success.
+  virtual int SetInputs(const std::vector<NNInput> &inputs) = 0;
+  virtual int Run() = 0;
+  virtual int GetOutputs(std::vector<NNOutput> &outputs) = 0;
+
+protected:
+  std::vector<NNTensorAttr> input_attrs;
+  std::vector<NNTensorAttr> output_attrs;
+
+  DEFINE_ERR_GETSET()
+  DECLARE_PART_FINAL_EXPOSE_PRODUCT(NNBackend)
+};
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_NN_BACKEND_H_
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "nn_cascade.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "utils.h"
+
+namespace easymedia {
+
+NNCascade::NNCascade(std::shared_ptr<NNBackend> nn,
+                     const TensorSpec &crop_spec, int crops,
+                     const std::vector<bool> &floats)
+    : backend(nn), spec(crop_spec), max_crops(crops), want_float(floats),
+      matrix(YuvMatrix::BT601_LIMITED), threads(0), batch(1), crop_size(0) {}
+
+bool NNCascade::Init() {
+  if (!backend || max_crops < 1)
+    return false;
+  const auto &ins = backend->GetInputAttrs();
+  if (ins.size() != 1) {
+    LOG("cascade: the model has %d inputs, expect 1\n", (int)ins.size());
+    return false;
+  }
+  const NNTensorAttr &attr = ins[0];
+  std::vector<uint32_t> dims = attr.dims;
+  if (dims.size() == 3)
+    dims.insert(dims.begin(), 1);
+  bool nhwc = (attr.layout == TensorLayout::NHWC);
+  if (dims.size() != 4 || (nhwc ? dims[3] : dims[1]) != 3 ||
+      (attr.type != TensorType::UINT8 && attr.type != TensorType::INT8 &&
+       attr.type != TensorType::FLOAT32)) {
+    LOG("cascade: unsupported input %s of the model\n", attr.name.c_str());
+    return false;
+  }
+  batch = dims[0];
+  spec.height = nhwc ? dims[1] : dims[2];
+  spec.width = nhwc ? dims[2] : dims[3];
+  spec.type = attr.type;
+  spec.layout = attr.layout;
+  crop_size = GetTensorSize(spec);
+  if (batch < 1 || crop_size * batch != attr.size) {
+    LOG("cascade: %d crops of %dx%d mismatch the input of %u bytes\n", batch,
+        spec.width, spec.height, attr.size);
+    return false;
+  }
+  const auto &outs = backend->GetOutputAttrs();
+  want_float.resize(outs.size(), false);
+  run_sizes.clear();
+  for (size_t i = 0; i < outs.size(); i++) {
+    size_t size = outs[i].size;
+    if (want_float[i])
+      size = outs[i].n_elems * sizeof(float);
+    if (size % batch) {
+      LOG("cascade: output %s is not of the batch\n", outs[i].name.c_str());
+      return false;
+    }
+    run_sizes.push_back(size);
+  }
+  input.resize(crop_size * batch);
+  return true;
+}
+
+size_t NNCascade::GetOutputSize(int i) const {
+  return run_sizes[i] * ((max_crops + batch - 1) / batch);
+}
+
+int NNCascade::Run(const CpuImage &frame,
+                   const std::vector<NNDetection> &detections,
+                   std::vector<NNDetection> &crops,
+                   std::vector<NNOutput> &outputs) {
+  if (outputs.size() != run_sizes.size())
+    return -EINVAL;
+  for (size_t i = 0; i < outputs.size(); i++) {
+    if (!outputs[i].buf || outputs[i].size < GetOutputSize(i))
+      return -EINVAL;
+  }
+  std::vector<NNDetection> sorted(detections);
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const NNDetection &a, const NNDetection &b) {
+                     return a.score > b.score;
+                   });
+  crops.clear();
+  for (auto &d : sorted) {
+    if ((int)crops.size() >= max_crops)
+      break;
+    int x0 = std::max(d.box.x, 0), y0 = std::max(d.box.y, 0);
+    int x1 = std::min(d.box.x + d.box.w, frame.width);
+    int y1 = std::min(d.box.y + d.box.h, frame.height);
+    if (x1 - x0 < 2 || y1 - y0 < 2)
+      continue;
+    crops.push_back(d);
+    crops.back().box = {x0, y0, x1 - x0, y1 - y0};
+  }
+  int runs = 0;
+  std::vector<NNOutput> run_outputs(outputs.size());
+  for (size_t first = 0; first < crops.size(); first += batch, runs++) {
+    size_t n = std::min((size_t)batch, crops.size() - first);
+    for (size_t k = 0; k < n; k++) {
+      int ret = ImageToTensor(input.data() + k * crop_size, spec, frame,
+                              &crops[first + k].box, nullptr, matrix, threads);
+      if (ret)
+        return ret;
+    }
+    if (n < (size_t)batch)
+      memset(input.data() + n * crop_size, 0, (batch - n) * crop_size);
+    NNInput in = {input.data(), (uint32_t)input.size(), spec.type,
+                  spec.layout};
+    int ret = backend->SetInputs(std::vector<NNInput>(1, in));
+    if (!ret)
+      ret = backend->Run();
+    for (size_t i = 0; !ret && i < outputs.size(); i++) {
+      NNOutput &o = run_outputs[i];
+      o.want_float = want_float[i] ? 1 : 0;
+      o.is_prealloc = 1;
+      o.index = i;
+      o.buf = static_cast<uint8_t *>(outputs[i].buf) + runs * run_sizes[i];
+      o.size = run_sizes[i];
+    }
+    if (!ret)
+      ret = backend->GetOutputs(run_outputs);
+    if (ret) {
+      LOG("cascade: fail to run the batch of %d, ret=%d\n", (int)first, ret);
+      return ret < 0 ? ret : -1;
+    }
+  }
+  for (size_t i = 0; i < outputs.size(); i++) {
+    outputs[i].want_float = want_float[i] ? 1 : 0;
+    outputs[i].index = i;
+    outputs[i].size = crops.size() * GetCropOutputSize(i);
+  }
+  return runs;
+}
+
+} // namespace easymedia
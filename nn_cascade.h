@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_NN_CASCADE_H_
+#define EASYMEDIA_NN_CASCADE_H_
+
+#include <memory>
+#include <vector>
+
+#include "image_tensor.h"
+#include "nn_backend.h"
+#include "nn_detection.h"
+
+namespace easymedia {
+
+// Runs a second model, such as a classifier, on the crops of the detections
+// of a first one. The crops fill the batch of the input of the model, so n
+// crops take n / batch runs rounded up rather than n. The model has one
+// input, of the dims [batch, h, w, 3] or [batch, 3, h, w] by its layout.
+class _API NNCascade {
+public:
+  // spec: the normalisation of the crops, the size, type and layout are the
+  // ones of the model; max_crops: of one frame; want_float: of each output
+  NNCascade(std::shared_ptr<NNBackend> backend, const TensorSpec &spec,
+            int max_crops, const std::vector<bool> &want_float);
+  // false if the model does not fit
+  bool Init();
+  void SetColorMatrix(YuvMatrix m) { matrix = m; }
+  void SetThreads(int num) { threads = num; }
+
+  int GetBatch() const { return batch; }
+  int GetMaxCrops() const { return max_crops; }
+  const TensorSpec &GetSpec() const { return spec; }
+  const std::vector<NNTensorAttr> &GetOutputAttrs() const {
+    return backend->GetOutputAttrs();
+  }
+  // bytes of output tensor i of one crop, of a run and of max_crops
+  size_t GetCropOutputSize(int i) const { return run_sizes[i] / batch; }
+  size_t GetOutputSize(int i) const;
+
+  // Crop the detections out of frame, at most max_crops of the highest
+  // scores, and run them by batches. crops: the ones run, in the order of the
+  // outputs. outputs: one for each output tensor, of GetOutputSize bytes, set
+  // to the bytes of the crops run. Return the runs, < 0 if fails.
+  int Run(const CpuImage &frame, const std::vector<NNDetection> &detections,
+          std::vector<NNDetection> &crops, std::vector<NNOutput> &outputs);
+
+private:
+  std::shared_ptr<NNBackend> backend;
+  TensorSpec spec;
+  int max_crops;
+  std::vector<bool> want_float;
+  YuvMatrix matrix;
+  int threads;
+  int batch;
+  size_t crop_size;
+  std::vector<size_t> run_sizes; // of each output tensor
+  std::vector<uint8_t> input;    // the tensor of a batch
+};
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_NN_CASCADE_H_
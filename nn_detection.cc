@@ -0,0 +1,563 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "nn_detection.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#define DETECTION_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DETECTION_NEON 1
+#include <arm_neon.h>
+#endif
+
+#include "buffer.h"
+#include "image_convert.h"
+#include "utils.h"
+
+namespace easymedia {
+
+const NNDetection *GetDetections(MediaBuffer &mb, int &num) {
+  if (mb.GetType() != Type::Detection) {
+    num = -1;
+    return nullptr;
+  }
+  num = (int)mb.GetValidSize();
+  return static_cast<const NNDetection *>(mb.GetPtr());
+}
+
+// The scans write the indexes of the elements >= t in [i, n) to hits and
+// return their number. The bytes are taken xor bias, so the int8 ones
+// compare as uint8 by the bias 0x80. The vector kernels skip the blocks of
+// no hit and give the same hits as the scalar ones.
+static int scan_ge_u8_c(const uint8_t *p, int i, int n, uint8_t bias,
+                        uint8_t t, uint32_t *hits) {
+  int num = 0;
+  for (; i < n; i++)
+    if ((uint8_t)(p[i] ^ bias) >= t)
+      hits[num++] = i;
+  return num;
+}
+
+static int scan_ge_f32_c(const float *p, int i, int n, float t,
+                         uint32_t *hits) {
+  int num = 0;
+  for (; i < n; i++)
+    if (p[i] >= t)
+      hits[num++] = i;
+  return num;
+}
+
+// out[j] = the max of the column j of the rows, of the bytes xor bias.
+static void max_rows_u8_c(const uint8_t *p, int rows, int n, uint8_t bias,
+                          uint8_t *out) {
+  for (int j = 0; j < n; j++)
+    out[j] = p[j] ^ bias;
+  for (int r = 1; r < rows; r++) {
+    const uint8_t *row = p + (size_t)r * n;
+    for (int j = 0; j < n; j++) {
+      uint8_t v = row[j] ^ bias;
+      out[j] = v > out[j] ? v : out[j];
+    }
+  }
+}
+
+static void max_rows_f32_c(const float *p, int rows, int n, float *out) {
+  std::copy(p, p + n, out);
+  for (int r = 1; r < rows; r++) {
+    const float *row = p + (size_t)r * n;
+    for (int j = 0; j < n; j++)
+      out[j] = row[j] > out[j] ? row[j] : out[j];
+  }
+}
+
+// The kept boxes of nms by their fields, padded to 4 by the boxes of no
+// class.
+struct KeptBoxes {
+  explicit KeptBoxes(size_t capacity)
+      : x0(capacity), y0(capacity), x1(capacity), y1(capacity),
+        area(capacity), cls(capacity, INT_MIN) {}
+  std::vector<float> x0, y0, x1, y1, area;
+  std::vector<int32_t> cls;
+};
+
+static inline float box_area(const DetectionBox &b) {
+  return (b.x1 - b.x0) * (b.y1 - b.y0);
+}
+
+// If b overlaps any of the first n kept boxes of its class, by iou > t as
+// inter > t * union, free of the division. The vector kernels take the same
+// float operations.
+static bool overlaps_c(const KeptBoxes &k, int n, const DetectionBox &b,
+                       float area, float t) {
+  for (int i = 0; i < n; i++) {
+    if (k.cls[i] != b.cls)
+      continue;
+    float w = std::min(k.x1[i], b.x1) - std::max(k.x0[i], b.x0);
+    float h = std::min(k.y1[i], b.y1) - std::max(k.y0[i], b.y0);
+    float inter = std::max(w, 0.0f) * std::max(h, 0.0f);
+    if (inter > t * ((k.area[i] + area) - inter))
+      return true;
+  }
+  return false;
+}
+
+#ifdef DETECTION_SSE2
+static inline int take_hits(int mask, int i, uint32_t *hits) {
+  int num = 0;
+  while (mask) {
+    hits[num++] = i + __builtin_ctz(mask);
+    mask &= mask - 1;
+  }
+  return num;
+}
+
+static int scan_ge_u8_sse2(const uint8_t *p, int i, int n, uint8_t bias,
+                           uint8_t t, uint32_t *hits) {
+  const __m128i b = _mm_set1_epi8((char)bias);
+  const __m128i tv = _mm_set1_epi8((char)t);
+  int num = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + i)), b);
+    // v >= t as max(v, t) == v
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, tv), v));
+    num += take_hits(mask, i, hits + num);
+  }
+  return num + scan_ge_u8_c(p, i, n, bias, t, hits + num);
+}
+
+static int scan_ge_f32_sse2(const float *p, int i, int n, float t,
+                            uint32_t *hits) {
+  const __m128 tv = _mm_set1_ps(t);
+  int num = 0;
+  for (; i + 16 <= n; i += 16) {
+    int mask = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(p + i), tv)) |
+               _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(p + i + 4), tv))
+                   << 4 |
+               _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(p + i + 8), tv))
+                   << 8 |
+               _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(p + i + 12), tv))
+                   << 12;
+    num += take_hits(mask, i, hits + num);
+  }
+  return num + scan_ge_f32_c(p, i, n, t, hits + num);
+}
+
+static void max_rows_u8_sse2(const uint8_t *p, int rows, int n, uint8_t bias,
+                             uint8_t *out) {
+  const __m128i b = _mm_set1_epi8((char)bias);
+  int j = 0;
+  for (; j + 16 <= n; j += 16) {
+    __m128i m = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + j)), b);
+    for (int r = 1; r < rows; r++) {
+      const uint8_t *row = p + (size_t)r * n + j;
+      m = _mm_max_epu8(m, _mm_xor_si128(
+                              _mm_loadu_si128((const __m128i *)row), b));
+    }
+    _mm_storeu_si128((__m128i *)(out + j), m);
+  }
+  for (; j < n; j++) {
+    uint8_t m = p[j] ^ bias;
+    for (int r = 1; r < rows; r++) {
+      uint8_t v = p[(size_t)r * n + j] ^ bias;
+      m = v > m ? v : m;
+    }
+    out[j] = m;
+  }
+}
+
+static void max_rows_f32_sse2(const float *p, int rows, int n, float *out) {
+  int j = 0;
+  for (; j + 4 <= n; j += 4) {
+    __m128 m = _mm_loadu_ps(p + j);
+    for (int r = 1; r < rows; r++)
+      m = _mm_max_ps(_mm_loadu_ps(p + (size_t)r * n + j), m);
+    _mm_storeu_ps(out + j, m);
+  }
+  for (; j < n; j++) {
+    float m = p[j];
+    for (int r = 1; r < rows; r++) {
+      float v = p[(size_t)r * n + j];
+      m = v > m ? v : m;
+    }
+    out[j] = m;
+  }
+}
+
+static bool overlaps_sse2(const KeptBoxes &k, int n, const DetectionBox &b,
+                          float area, float t) {
+  const __m128 bx0 = _mm_set1_ps(b.x0), by0 = _mm_set1_ps(b.y0);
+  const __m128 bx1 = _mm_set1_ps(b.x1), by1 = _mm_set1_ps(b.y1);
+  const __m128 ba = _mm_set1_ps(area), tv = _mm_set1_ps(t);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128i bc = _mm_set1_epi32(b.cls);
+  for (int i = 0; i < n; i += 4) {
+    __m128 w = _mm_sub_ps(_mm_min_ps(_mm_loadu_ps(&k.x1[i]), bx1),
+                          _mm_max_ps(_mm_loadu_ps(&k.x0[i]), bx0));
+    __m128 h = _mm_sub_ps(_mm_min_ps(_mm_loadu_ps(&k.y1[i]), by1),
+                          _mm_max_ps(_mm_loadu_ps(&k.y0[i]), by0));
+    __m128 inter = _mm_mul_ps(_mm_max_ps(w, zero), _mm_max_ps(h, zero));
+    __m128 uni = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(&k.area[i]), ba), inter);
+    __m128i same =
+        _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)&k.cls[i]), bc);
+    __m128 hit = _mm_and_ps(_mm_cmpgt_ps(inter, _mm_mul_ps(tv, uni)),
+                            _mm_castsi128_ps(same));
+    if (_mm_movemask_ps(hit))
+      return true;
+  }
+  return false;
+}
+#endif // DETECTION_SSE2
+
+#ifdef DETECTION_NEON
+static inline bool any_lane(uint32x4_t m) {
+  uint64x2_t v = vreinterpretq_u64_u32(m);
+  return (vgetq_lane_u64(v, 0) | vgetq_lane_u64(v, 1)) != 0;
+}
+
+static int scan_ge_u8_neon(const uint8_t *p, int i, int n, uint8_t bias,
+                           uint8_t t, uint32_t *hits) {
+  const uint8x16_t b = vdupq_n_u8(bias);
+  const uint8x16_t tv = vdupq_n_u8(t);
+  int num = 0;
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t m = vcgeq_u8(veorq_u8(vld1q_u8(p + i), b), tv);
+    if (any_lane(vreinterpretq_u32_u8(m)))
+      num += scan_ge_u8_c(p, i, i + 16, bias, t, hits + num);
+  }
+  return num + scan_ge_u8_c(p, i, n, bias, t, hits + num);
+}
+
+static int scan_ge_f32_neon(const float *p, int i, int n, float t,
+                            uint32_t *hits) {
+  const float32x4_t tv = vdupq_n_f32(t);
+  int num = 0;
+  for (; i + 16 <= n; i += 16) {
+    uint32x4_t m = vorrq_u32(vcgeq_f32(vld1q_f32(p + i), tv),
+                             vcgeq_f32(vld1q_f32(p + i + 4), tv));
+    m = vorrq_u32(m, vcgeq_f32(vld1q_f32(p + i + 8), tv));
+    m = vorrq_u32(m, vcgeq_f32(vld1q_f32(p + i + 12), tv));
+    if (any_lane(m))
+      num += scan_ge_f32_c(p, i, i + 16, t, hits + num);
+  }
+  return num + scan_ge_f32_c(p, i, n, t, hits + num);
+}
+
+static void max_rows_u8_neon(const uint8_t *p, int rows, int n, uint8_t bias,
+                             uint8_t *out) {
+  const uint8x16_t b = vdupq_n_u8(bias);
+  int j = 0;
+  for (; j + 16 <= n; j += 16) {
+    uint8x16_t m = veorq_u8(vld1q_u8(p + j), b);
+    for (int r = 1; r < rows; r++)
+      m = vmaxq_u8(m, veorq_u8(vld1q_u8(p + (size_t)r * n + j), b));
+    vst1q_u8(out + j, m);
+  }
+  for (; j < n; j++) {
+    uint8_t m = p[j] ^ bias;
+    for (int r = 1; r < rows; r++) {
+      uint8_t v = p[(size_t)r * n + j] ^ bias;
+      m = v > m ? v : m;
+    }
+    out[j] = m;
+  }
+}
+
+static void max_rows_f32_neon(const float *p, int rows, int n, float *out) {
+  int j = 0;
+  for (; j + 4 <= n; j += 4) {
+    float32x4_t m = vld1q_f32(p + j);
+    for (int r = 1; r < rows; r++)
+      m = vmaxq_f32(m, vld1q_f32(p + (size_t)r * n + j));
+    vst1q_f32(out + j, m);
+  }
+  for (; j < n; j++) {
+    float m = p[j];
+    for (int r = 1; r < rows; r++) {
+      float v = p[(size_t)r * n + j];
+      m = v > m ? v : m;
+    }
+    out[j] = m;
+  }
+}
+
+static bool overlaps_neon(const KeptBoxes &k, int n, const DetectionBox &b,
+                          float area, float t) {
+  const float32x4_t bx0 = vdupq_n_f32(b.x0), by0 = vdupq_n_f32(b.y0);
+  const float32x4_t bx1 = vdupq_n_f32(b.x1), by1 = vdupq_n_f32(b.y1);
+  const float32x4_t ba = vdupq_n_f32(area), tv = vdupq_n_f32(t);
+  const float32x4_t zero = vdupq_n_f32(0.0f);
+  const int32x4_t bc = vdupq_n_s32(b.cls);
+  for (int i = 0; i < n; i += 4) {
+    float32x4_t w = vsubq_f32(vminq_f32(vld1q_f32(&k.x1[i]), bx1),
+                              vmaxq_f32(vld1q_f32(&k.x0[i]), bx0));
+    float32x4_t h = vsubq_f32(vminq_f32(vld1q_f32(&k.y1[i]), by1),
+                              vmaxq_f32(vld1q_f32(&k.y0[i]), by0));
+    float32x4_t inter = vmulq_f32(vmaxq_f32(w, zero), vmaxq_f32(h, zero));
+    float32x4_t uni = vsubq_f32(vaddq_f32(vld1q_f32(&k.area[i]), ba), inter);
+    uint32x4_t hit = vandq_u32(vcgtq_f32(inter, vmulq_f32(tv, uni)),
+                               vceqq_s32(vld1q_s32(&k.cls[i]), bc));
+    if (any_lane(hit))
+      return true;
+  }
+  return false;
+}
+#endif // DETECTION_NEON
+
+typedef int (*ScanU8)(const uint8_t *p, int i, int n, uint8_t bias,
+                      uint8_t t, uint32_t *hits);
+typedef int (*ScanF32)(const float *p, int i, int n, float t,
+                       uint32_t *hits);
+typedef void (*MaxRowsU8)(const uint8_t *p, int rows, int n, uint8_t bias,
+                          uint8_t *out);
+typedef void (*MaxRowsF32)(const float *p, int rows, int n, float *out);
+typedef bool (*Overlaps)(const KeptBoxes &k, int n, const DetectionBox &b,
+                         float area, float t);
+
+#if defined(DETECTION_SSE2)
+#define DETECTION_KERNEL(name) (name##_sse2)
+#elif defined(DETECTION_NEON)
+#define DETECTION_KERNEL(name) (name##_neon)
+#else
+#define DETECTION_KERNEL(name) (name##_c)
+#endif
+#define GET_DETECTION_KERNEL(name)                                             \
+  (GetConvertImpl() == ConvertImpl::SCALAR ? name##_c : DETECTION_KERNEL(name))
+
+// The least q of the quantised type whose value may reach v, one step lower
+// for the rounding of the float, the max + 1 of the type if none.
+static int quant_threshold(float v, const NNTensorAttr &attr) {
+  int lo = attr.type == TensorType::UINT8 ? 0 : -128;
+  float q = floorf(v / attr.scale + attr.zp) - 1;
+  if (!(q > lo))
+    return lo;
+  if (q > lo + 255)
+    return lo + 256;
+  return (int)q;
+}
+
+// The indexes of the n elements from offset whose values may reach v.
+static int scan_values(const void *data, const NNTensorAttr &attr,
+                       size_t offset, int n, float v, uint32_t *hits) {
+  if (attr.type == TensorType::FLOAT32) {
+    ScanF32 scan = GET_DETECTION_KERNEL(scan_ge_f32);
+    return scan(static_cast<const float *>(data) + offset, 0, n, v, hits);
+  }
+  int q = quant_threshold(v, attr);
+  int lo = attr.type == TensorType::UINT8 ? 0 : -128;
+  if (q > lo + 255)
+    return 0;
+  ScanU8 scan = GET_DETECTION_KERNEL(scan_ge_u8);
+  return scan(static_cast<const uint8_t *>(data) + offset, 0, n,
+              attr.type == TensorType::INT8 ? 0x80 : 0, (uint8_t)(q - lo),
+              hits);
+}
+
+static inline float get_value(const void *data, const NNTensorAttr &attr,
+                              size_t i) {
+  switch (attr.type) {
+  case TensorType::UINT8:
+    return ((int)static_cast<const uint8_t *>(data)[i] - attr.zp) *
+           attr.scale;
+  case TensorType::INT8:
+    return ((int)static_cast<const int8_t *>(data)[i] - attr.zp) * attr.scale;
+  default:
+    return static_cast<const float *>(data)[i];
+  }
+}
+
+static inline float sigmoid(float x) { return 1.0f / (1.0f + expf(-x)); }
+
+static bool check_head_tensor(const void *data, const NNTensorAttr &attr,
+                              const char *head) {
+  uint32_t n = 1;
+  for (uint32_t d : attr.dims)
+    n *= d;
+  bool quant =
+      attr.type == TensorType::UINT8 || attr.type == TensorType::INT8;
+  if (data && n == attr.n_elems && (quant ? attr.scale > 0
+                                          : attr.type == TensorType::FLOAT32))
+    return true;
+  LOG("%s: unsupported output tensor %d\n", head, (int)attr.index);
+  return false;
+}
+
+int DecodeYoloV5(const void *data, const NNTensorAttr &attr, int stride,
+                 const float anchors[6], float threshold, bool logits,
+                 std::vector<DetectionBox> &boxes) {
+  const auto &d = attr.dims;
+  if (d.size() != 4 || d[0] != 1 || d[1] % 3 || d[1] / 3 < 6 ||
+      stride <= 0) {
+    LOG("yolov5: the dims of tensor %d are not [1, 3 * (5 + classes), h, "
+        "w]\n",
+        (int)attr.index);
+    return -EINVAL;
+  }
+  if (!check_head_tensor(data, attr, "yolov5"))
+    return -EINVAL;
+  int channels = d[1] / 3, w = d[3];
+  int plane = d[2] * d[3];
+  // the objectness bounds the score, the survivors are the only ones decoded
+  float v = threshold;
+  if (logits) {
+    if (threshold <= 0)
+      v = -INFINITY;
+    else if (threshold >= 1)
+      v = INFINITY;
+    else
+      v = logf(threshold / (1 - threshold));
+  }
+  if (attr.type == TensorType::FLOAT32 && isfinite(v))
+    v -= 1e-3f * (1 + fabsf(v)); // as above, for the rounding of expf
+  auto act = [logits](float x) { return logits ? sigmoid(x) : x; };
+  std::vector<uint32_t> hits(plane);
+  size_t num = boxes.size();
+  for (int a = 0; a < 3; a++) {
+    size_t base = (size_t)a * channels * plane;
+    int n = scan_values(data, attr, base + 4 * (size_t)plane, plane, v,
+                        hits.data());
+    for (int k = 0; k < n; k++) {
+      size_t idx = base + hits[k];
+      auto value = [&](int c) {
+        return get_value(data, attr, idx + (size_t)c * plane);
+      };
+      // the affine dequantisation and the sigmoid keep the order
+      int cls = 0;
+      float best = value(5);
+      for (int c = 1; c < channels - 5; c++) {
+        float s = value(5 + c);
+        if (s > best) {
+          best = s;
+          cls = c;
+        }
+      }
+      float score = act(value(4)) * act(best);
+      if (score < threshold)
+        continue;
+      int gx = hits[k] % w, gy = hits[k] / w;
+      float cx = (act(value(0)) * 2 - 0.5f + gx) * stride;
+      float cy = (act(value(1)) * 2 - 0.5f + gy) * stride;
+      float bw = act(value(2)) * 2, bh = act(value(3)) * 2;
+      bw = bw * bw * anchors[a * 2];
+      bh = bh * bh * anchors[a * 2 + 1];
+      DetectionBox b = {cx - bw / 2, cy - bh / 2, cx + bw / 2, cy + bh / 2,
+                        score, cls};
+      boxes.push_back(b);
+    }
+  }
+  return (int)(boxes.size() - num);
+}
+
+int DecodeYoloV8(const void *data, const NNTensorAttr &attr, float threshold,
+                 std::vector<DetectionBox> &boxes) {
+  const auto &d = attr.dims;
+  if (d.size() != 3 || d[0] != 1 || d[1] < 5) {
+    LOG("yolov8: the dims of tensor %d are not [1, 4 + classes, n]\n",
+        (int)attr.index);
+    return -EINVAL;
+  }
+  if (!check_head_tensor(data, attr, "yolov8"))
+    return -EINVAL;
+  int classes = d[1] - 4, n = d[2];
+  std::vector<uint32_t> hits(n);
+  int hit_num;
+  // the max of the class rows of each candidate, then one scan of them
+  if (attr.type == TensorType::FLOAT32) {
+    std::vector<float> maxs(n);
+    MaxRowsF32 max_rows = GET_DETECTION_KERNEL(max_rows_f32);
+    max_rows(static_cast<const float *>(data) + 4 * (size_t)n, classes, n,
+             maxs.data());
+    ScanF32 scan = GET_DETECTION_KERNEL(scan_ge_f32);
+    hit_num = scan(maxs.data(), 0, n, threshold, hits.data());
+  } else {
+    int lo = attr.type == TensorType::UINT8 ? 0 : -128;
+    int q = quant_threshold(threshold, attr);
+    if (q > lo + 255)
+      return 0;
+    uint8_t bias = attr.type == TensorType::INT8 ? 0x80 : 0;
+    std::vector<uint8_t> maxs(n);
+    MaxRowsU8 max_rows = GET_DETECTION_KERNEL(max_rows_u8);
+    max_rows(static_cast<const uint8_t *>(data) + 4 * (size_t)n, classes, n,
+             bias, maxs.data());
+    // the maxs are biased already
+    ScanU8 scan = GET_DETECTION_KERNEL(scan_ge_u8);
+    hit_num = scan(maxs.data(), 0, n, 0, (uint8_t)(q - lo), hits.data());
+  }
+  size_t num = boxes.size();
+  for (int k = 0; k < hit_num; k++) {
+    size_t j = hits[k];
+    int cls = 0;
+    float score = get_value(data, attr, 4 * (size_t)n + j);
+    for (int c = 1; c < classes; c++) {
+      float s = get_value(data, attr, (4 + c) * (size_t)n + j);
+      if (s > score) {
+        score = s;
+        cls = c;
+      }
+    }
+    if (score < threshold)
+      continue;
+    float cx = get_value(data, attr, j);
+    float cy = get_value(data, attr, n + j);
+    float bw = get_value(data, attr, 2 * (size_t)n + j);
+    float bh = get_value(data, attr, 3 * (size_t)n + j);
+    DetectionBox b = {cx - bw / 2, cy - bh / 2, cx + bw / 2, cy + bh / 2,
+                      score, cls};
+    boxes.push_back(b);
+  }
+  return (int)(boxes.size() - num);
+}
+
+void NMSBoxes(std::vector<DetectionBox> &boxes, float iou_threshold,
+              int max_num) {
+  std::stable_sort(boxes.begin(), boxes.end(),
+                   [](const DetectionBox &a, const DetectionBox &b) {
+                     return a.score > b.score;
+                   });
+  size_t capacity = boxes.size();
+  if (max_num > 0 && (size_t)max_num < capacity)
+    capacity = max_num;
+  KeptBoxes k((capacity + 3) & ~(size_t)3);
+  Overlaps overlaps = GET_DETECTION_KERNEL(overlaps);
+  size_t kept = 0;
+  for (size_t i = 0; i < boxes.size() && kept < capacity; i++) {
+    const DetectionBox b = boxes[i];
+    float area = box_area(b);
+    if (overlaps(k, (int)kept, b, area, iou_threshold))
+      continue;
+    k.x0[kept] = b.x0;
+    k.y0[kept] = b.y0;
+    k.x1[kept] = b.x1;
+    k.y1[kept] = b.y1;
+    k.area[kept] = area;
+    k.cls[kept] = b.cls;
+    boxes[kept++] = b;
+  }
+  boxes.resize(kept);
+}
+
+} // namespace easymedia
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_NN_DETECTION_H_
+#define EASYMEDIA_NN_DETECTION_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "image.h"
+#include "nn_backend.h"
+
+namespace easymedia {
+
+class MediaBuffer;
+
+// One object found in a frame, in the pixels of the frame. The detections of
+// a frame travel as a buffer of Type::Detection, such as the output of the
+// nnpostprocess filter, of an array of them, of valid size their number,
+// whose GetRelatedSPtrs()[0] is the frame.
+struct NNDetection {
+  ImageRect box;
+  int32_t cls;
+  float score;
+};
+
+// Return the detections of a Type::Detection buffer and their number, else
+// nullptr and -1.
+_API const NNDetection *GetDetections(MediaBuffer &mb, int &num);
+
+// A candidate box of a detector head, in the pixels of the model input.
+struct DetectionBox {
+  float x0, y0, x1, y1;
+  float score;
+  int32_t cls;
+};
+
+// Append the candidates of score >= threshold of an output of a head to
+// boxes. The tensor is UINT8, INT8, by its scale and zp, or FLOAT32. Only the
+// elements over the threshold are decoded, found by the vector kernels of
+// SetConvertImpl. Return the candidates appended, < 0 if the attr does not
+// fit the head.
+// yolov5: one scale of the head, of the dims [1, 3 * (5 + classes), h, w];
+// anchors: the (w, h) of its 3 anchors; logits: the model leaves the sigmoid
+// to the decoding, the models of the rknn model zoo do not.
+_API int DecodeYoloV5(const void *data, const NNTensorAttr &attr, int stride,
+                      const float anchors[6], float threshold, bool logits,
+                      std::vector<DetectionBox> &boxes);
+// yolov8: the dims [1, 4 + classes, n], cx, cy, w, h then the class scores.
+_API int DecodeYoloV8(const void *data, const NNTensorAttr &attr,
+                      float threshold, std::vector<DetectionBox> &boxes);
+
+// Greedy nms: keep the boxes by the scores from high to low unless the iou
+// with a kept one of the same class is over iou_threshold, at most max_num,
+// no limit if 0. boxes is sorted and cut to the kept ones. A candidate is
+// only checked against the kept boxes, 4 at a time by the vector kernels.
+_API void NMSBoxes(std::vector<DetectionBox> &boxes, float iou_threshold,
+                   int max_num);
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_NN_DETECTION_H_
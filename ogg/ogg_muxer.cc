@@ -25,6 +25,7 @@
 
 #include "assert.h"
 #include "buffer.h"
+#include "buffer_chain.h"
 #include "encoder.h"
 #include "media_type.h"
 #include "ogg_utils.h"
@@ -45,6 +46,8 @@ public:
   Write(std::shared_ptr<MediaBuffer> orig_data, int stream_no) override;
 
 private:
+  std::shared_ptr<MediaBuffer> GatherData(BufferChain &chain);
+
   std::map<int, ogg_stream_state> streams;
   int stream_number;
 };
@@ -91,49 +94,31 @@ bool OggMuxer::NewMuxerStream(std::shared_ptr<Encoder> enc, int &stream_no) {
   return true;
 }
 
-// return the data length
-static size_t _write_ogg_page(const ogg_page &og,
-                              std::list<std::pair<void *, size_t>> &pages,
-                              std::shared_ptr<Stream> &out) {
+// The page memory belongs to libogg and is only valid till the next page out.
+// With io stream, header and body go out by one writev straight from it;
+// otherwise the page is copied once into the chain for the caller.
+static bool _write_ogg_page(const ogg_page &og, BufferChain &chain,
+                            std::shared_ptr<Stream> &out) {
   if (out) {
-    int wlen = out->Write(og.header, 1, og.header_len);
-    if (wlen != og.header_len)
-      LOG("write_ogg_page failed, %m\n");
-    wlen = out->Write(og.body, 1, og.body_len);
-    if (wlen != og.body_len)
+    struct iovec iov[2] = {{og.header, (size_t)og.header_len},
+                           {og.body, (size_t)og.body_len}};
+    size_t len = og.header_len + og.body_len;
+    if (out->Writev(iov, 2) != len) {
       LOG("write_ogg_page failed, %m\n");
+      return false;
+    }
+    return true;
   }
-  size_t len = (og.header_len + og.body_len);
-  void *buffer = malloc(len);
-  if (!buffer) {
-    errno = ENOMEM;
-    return 0;
-  }
-  memcpy(buffer, og.header, og.header_len);
-  memcpy(((unsigned char *)buffer) + og.header_len, og.body, og.body_len);
-  pages.push_back(std::pair<void *, size_t>(buffer, len));
-  return len;
+  return chain.AppendCopy(og.header, og.header_len) &&
+         chain.AppendCopy(og.body, og.body_len);
 }
 
-std::shared_ptr<MediaBuffer>
-_gather_data(const std::list<std::pair<void *, size_t>> &pages,
-             size_t total_len) {
-  if (total_len == 0)
-    return nullptr;
-  unsigned char *total_buffer;
-  auto ret = MediaBuffer::Alloc(total_len);
-  if (ret) {
-    ret->SetValidSize(total_len);
-  } else {
-    errno = ENOMEM;
-    return nullptr;
-  }
-  total_buffer = (unsigned char *)ret->GetPtr();
-  for (auto &p : pages) {
-    memcpy(total_buffer, p.first, p.second);
-    total_buffer += p.second;
-  }
-  return ret;
+// With io stream, the data has been written, return a buffer of zero valid
+// size only for carrying the attributes.
+std::shared_ptr<MediaBuffer> OggMuxer::GatherData(BufferChain &chain) {
+  if (io_output)
+    return std::make_shared<MediaBuffer>();
+  return chain.Gather();
 }
 
 std::shared_ptr<MediaBuffer> OggMuxer::WriteHeader(int stream_no) {
@@ -143,26 +128,17 @@ std::shared_ptr<MediaBuffer> OggMuxer::WriteHeader(int stream_no) {
     return nullptr;
   }
 
-  std::shared_ptr<MediaBuffer> ret;
-  size_t total_len = 0;
   ogg_stream_state &os = s->second;
-  std::list<std::pair<void *, size_t>> pages;
+  BufferChain chain;
   while (true) {
     ogg_page og;
     int result = ogg_stream_flush(&os, &og);
     if (result == 0)
       break;
-    size_t len = _write_ogg_page(og, pages, io_output);
-    if (len == 0)
-      goto out;
-    total_len += len;
+    if (!_write_ogg_page(og, chain, io_output))
+      return nullptr;
   }
-  ret = _gather_data(pages, total_len);
-
-out:
-  for (auto &p : pages)
-    free(p.first);
-  return ret;
+  return GatherData(chain);
 }
 
 std::shared_ptr<MediaBuffer>
@@ -191,31 +167,24 @@ OggMuxer::Write(std::shared_ptr<MediaBuffer> orig_data, int stream_no) {
   }
 
   bool eos = false;
-  std::shared_ptr<MediaBuffer> ret;
-  size_t total_len = 0;
-  std::list<std::pair<void *, size_t>> pages;
+  BufferChain chain;
   while (!eos) {
     ogg_page og;
     result = ogg_stream_pageout(&os, &og);
     if (result == 0)
       break;
-    size_t len = _write_ogg_page(og, pages, io_output);
-    if (len == 0)
-      goto out;
-    total_len += len;
+    if (!_write_ogg_page(og, chain, io_output))
+      return nullptr;
     if (ogg_page_eos(&og))
       eos = true;
   }
-  ret = _gather_data(pages, total_len);
+  auto ret = GatherData(chain);
   if (eos) {
-    ret->SetEOF(true);
+    if (ret)
+      ret->SetEOF(true);
     ogg_stream_clear(&os);
     streams.erase(stream_no);
   }
-
-out:
-  for (auto &p : pages)
-    free(p.first);
   return ret;
 }
 
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <list>
+#include <string>
+
+#include "buffer.h"
+#include "encoder.h"
+#include "muxer.h"
+
+// Counts the bytes which reach the io stream, no copy at all.
+class CountStream : public easymedia::Stream {
+public:
+  CountStream() : bytes(0), calls(0) { SetWriteable(true); }
+  virtual size_t Read(void *, size_t, size_t) override { return -1; }
+  virtual size_t Write(const void *, size_t size, size_t nmemb) override {
+    calls++;
+    bytes += size * nmemb;
+    return size * nmemb;
+  }
+  virtual size_t Writev(const struct iovec *iov, int iovcnt) override {
+    size_t total = 0;
+    calls++;
+    for (int i = 0; i < iovcnt; i++)
+      total += iov[i].iov_len;
+    bytes += total;
+    return total;
+  }
+  virtual int Seek(int64_t, int) override { return -1; }
+  virtual long Tell() override { return bytes; }
+  size_t bytes;
+  size_t calls;
+
+protected:
+  virtual int Open() override { return 0; }
+  virtual int Close() override { return 0; }
+};
+
+static int free_memory(void *buffer) {
+  free(buffer);
+  return 0;
+}
+
+static double now_ms() {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// encode seconds of sine once, the benchmark only times the muxer
+static std::shared_ptr<easymedia::Encoder>
+encode_packets(MediaConfig &cfg, int seconds,
+               std::list<std::shared_ptr<easymedia::MediaBuffer>> &packets) {
+  auto enc = easymedia::REFLECTOR(Encoder)::Create<easymedia::AudioEncoder>(
+      "libvorbisenc");
+  assert(enc);
+  if (!enc->InitConfig(cfg))
+    return nullptr;
+  SampleInfo &si = cfg.aud_cfg.sample_info;
+  const int frames = 1024;
+  si.frames = frames;
+  size_t size = GetFrameSize(si) * frames;
+  void *ptr = malloc(size);
+  assert(ptr);
+  auto sample_buffer = std::make_shared<easymedia::SampleBuffer>(
+      easymedia::MediaBuffer(ptr, size, -1, ptr, free_memory), si);
+  int total = si.sample_rate * seconds;
+  int16_t *pcm = (int16_t *)ptr;
+  for (int pos = 0; pos <= total; pos += frames) {
+    bool last = (pos + frames > total);
+    for (int i = 0; i < frames; i++)
+      for (int c = 0; c < si.channels; c++)
+        pcm[i * si.channels + c] =
+            (int16_t)(8000 * sin(2 * M_PI * 440 * (pos + i) / si.sample_rate));
+    sample_buffer->SetFrames(last ? 0 : frames);
+    if (enc->SendInput(sample_buffer))
+      return nullptr;
+    while (auto out = enc->FetchOutput()) {
+      if (out->GetValidSize() > 0)
+        packets.push_back(out);
+    }
+  }
+  return enc;
+}
+
+static void run(bool with_io, MediaConfig &cfg, int seconds) {
+  std::list<std::shared_ptr<easymedia::MediaBuffer>> packets;
+  auto enc = encode_packets(cfg, seconds, packets);
+  assert(enc && !packets.empty());
+  auto mux =
+      easymedia::REFLECTOR(Muxer)::Create<easymedia::Muxer>("liboggmuxer");
+  assert(mux);
+  int stream_no = -1;
+  assert(mux->NewMuxerStream(enc, stream_no));
+  auto count = std::make_shared<CountStream>();
+  if (with_io)
+    mux->SetIoStream(count);
+
+  size_t returned = 0;
+  double start = now_ms();
+  auto header = mux->WriteHeader(stream_no);
+  if (header)
+    returned += header->GetValidSize();
+  for (auto &p : packets) {
+    auto out = mux->Write(p, stream_no);
+    if (out)
+      returned += out->GetValidSize();
+  }
+  double cost = now_ms() - start;
+
+  size_t muxed = with_io ? count->bytes : returned;
+  // io stream: pages are written from libogg memory by writev, no copy;
+  // otherwise each page is copied once into the returned buffer.
+  size_t copied = with_io ? 0 : returned;
+  printf("%-10s: %d packets, %zu bytes muxed in %.3f ms (%.1f MB/s), "
+         "copied %.1f bytes per second of audio, %zu io calls\n",
+         with_io ? "io stream" : "returned", (int)packets.size(), muxed, cost,
+         muxed / 1024.0 / 1024.0 / (cost / 1000.0),
+         (double)copied / seconds, count->calls);
+}
+
+int main(int argc, char **argv) {
+  int seconds = 60;
+  int c;
+  while ((c = getopt(argc, argv, "?t:")) != -1) {
+    switch (c) {
+    case 't':
+      seconds = atoi(optarg);
+      break;
+    case '?':
+    default:
+      printf("usage: ogg_mux_bench [-t seconds of audio, default 60]\n");
+      exit(0);
+    }
+  }
+  if (seconds <= 0)
+    exit(EXIT_FAILURE);
+
+  MediaConfig cfg;
+  AudioConfig &aud_cfg = cfg.aud_cfg;
+  aud_cfg.sample_info.fmt = SAMPLE_FMT_S16;
+  aud_cfg.sample_info.channels = 2;
+  aud_cfg.sample_info.sample_rate = 48000;
+  aud_cfg.sample_info.frames = 0;
+  aud_cfg.quality = 1.0;
+
+  run(false, cfg, seconds);
+  run(true, cfg, seconds);
+  return 0;
+}
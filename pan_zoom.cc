@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "pan_zoom.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace easymedia {
+
+PanZoom::PanZoom(const ImageRect &win, int a)
+    : align(std::max(a, 1)), width(0), height(0), first(win),
+      pending(false), pending_zoom(false), pending_rect({0, 0, 0, 0}),
+      zoom(1), zoom_cx(-1), zoom_cy(-1), pending_frames(0), step(0),
+      steps(0), window({0, 0, 0, 0}) {
+  from = to = cur = {0, 0, 0, 0};
+}
+
+void PanZoom::SetTarget(const ImageRect &rect, int frames) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  pending = true;
+  pending_zoom = false;
+  pending_rect = rect;
+  pending_frames = frames;
+}
+
+void PanZoom::SetZoom(float z, int cx, int cy, int frames) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  pending = true;
+  pending_zoom = true;
+  zoom = std::max(z, 1.0f);
+  zoom_cx = cx;
+  zoom_cy = cy;
+  pending_frames = frames;
+}
+
+PanZoom::Window PanZoom::ToWindow(const ImageRect &rect) const {
+  float w = std::min(std::max(rect.w, align), width);
+  float h = std::min(std::max(rect.h, align), height);
+  float x = std::min(std::max(rect.x, 0), width - (int)w);
+  float y = std::min(std::max(rect.y, 0), height - (int)h);
+  return {x + w / 2, y + h / 2, w, h};
+}
+
+ImageRect PanZoom::ToRect(const Window &win) const {
+  int max_w = width / align * align, max_h = height / align * align;
+  int w = (int)(win.w / align + 0.5f) * align;
+  int h = (int)(win.h / align + 0.5f) * align;
+  w = std::min(std::max(w, align), max_w);
+  h = std::min(std::max(h, align), max_h);
+  int x = (int)((win.cx - w / 2.0f) / align + 0.5f) * align;
+  int y = (int)((win.cy - h / 2.0f) / align + 0.5f) * align;
+  x = std::min(std::max(x, 0), (width - w) / align * align);
+  y = std::min(std::max(y, 0), (height - h) / align * align);
+  return {x, y, w, h};
+}
+
+void PanZoom::StartMove() {
+  Window target;
+  if (pending_zoom) {
+    float w = width / zoom, h = height / zoom;
+    float cx = zoom_cx < 0 ? width / 2.0f : zoom_cx;
+    float cy = zoom_cy < 0 ? height / 2.0f : zoom_cy;
+    // keep the window inside the image
+    cx = std::min(std::max(cx, w / 2), width - w / 2);
+    cy = std::min(std::max(cy, h / 2), height - h / 2);
+    target = {cx, cy, w, h};
+  } else {
+    target = ToWindow(pending_rect);
+  }
+  pending = false;
+  from = cur;
+  to = target;
+  step = 0;
+  steps = std::max(pending_frames, 0);
+  if (!steps)
+    cur = to;
+}
+
+ImageRect PanZoom::Next(int w, int h) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  if (w <= 0 || h <= 0)
+    return {0, 0, 0, 0};
+  if (w != width || h != height) {
+    width = w;
+    height = h;
+    bool whole = (first.w <= 0 || first.h <= 0);
+    cur = to = ToWindow(whole ? ImageRect{0, 0, w, h} : first);
+    // the first window only for the first size
+    first = {0, 0, 0, 0};
+    steps = 0;
+  }
+  if (pending)
+    StartMove();
+  if (step < steps) {
+    step++;
+    float t = (float)step / steps;
+    // smoothstep, the window starts and stops gently
+    float s = t * t * (3 - 2 * t);
+    cur.cx = from.cx + (to.cx - from.cx) * s;
+    cur.cy = from.cy + (to.cy - from.cy) * s;
+    cur.w = from.w * powf(to.w / from.w, s);
+    cur.h = from.h * powf(to.h / from.h, s);
+  }
+  window = ToRect(cur);
+  return window;
+}
+
+ImageRect PanZoom::GetWindow() {
+  std::lock_guard<std::mutex> _lg(mtx);
+  return window;
+}
+
+bool PanZoom::IsMoving() {
+  std::lock_guard<std::mutex> _lg(mtx);
+  return pending || step < steps;
+}
+
+} // namespace easymedia
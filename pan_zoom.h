@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_PAN_ZOOM_H_
+#define EASYMEDIA_PAN_ZOOM_H_
+
+#include <mutex>
+
+#include "image.h"
+
+namespace easymedia {
+
+// A crop window which eases to its target a step per frame, for the digital
+// pan and zoom of a camera by crop views. The centre moves along a smooth
+// curve and the size changes by the same ratio each step, so that the zoom
+// looks even. The targets are set by any thread, the frames take the window.
+class _API PanZoom {
+public:
+  // window: the window of the first frame, the whole image if w or h is 0.
+  // align: of the windows, 2 for yuv.
+  explicit PanZoom(const ImageRect &window = {0, 0, 0, 0}, int align = 2);
+
+  // Ease to rect in frames, 0 jumps at once. rect is clamped into the image.
+  void SetTarget(const ImageRect &rect, int frames);
+  // Ease to the window of zoom (>= 1) centred at cx, cy, in the aspect of the
+  // image; the image centre if cx or cy is negative.
+  void SetZoom(float zoom, int cx, int cy, int frames);
+
+  // Advance a frame of the image size, return its window. A new image size
+  // restarts from the whole image.
+  ImageRect Next(int width, int height);
+  // the window of the last frame
+  ImageRect GetWindow();
+  bool IsMoving();
+
+private:
+  struct Window {
+    float cx, cy, w, h;
+  };
+  Window ToWindow(const ImageRect &rect) const;
+  ImageRect ToRect(const Window &win) const;
+  void StartMove();
+
+  std::mutex mtx;
+  int align;
+  int width, height;
+  ImageRect first;
+  // the target which is not taken yet
+  bool pending, pending_zoom;
+  ImageRect pending_rect;
+  float zoom;
+  int zoom_cx, zoom_cy;
+  int pending_frames;
+  // the move of the window
+  Window from, to, cur;
+  int step, steps;
+  ImageRect window;
+};
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_PAN_ZOOM_H_
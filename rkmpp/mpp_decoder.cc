@@ -25,6 +25,7 @@
 #include <unistd.h>
 
 #include "buffer.h"
+#include "buffer_pool.h"
 
 namespace easymedia {
 
@@ -32,7 +33,9 @@ MPPDecoder::MPPDecoder(const char *param)
     : output_format(PIX_FMT_NONE), fg_limit_num(kFRAMEGROUP_MAX_FRAMES),
       need_split(1), timeout(MPP_POLL_NON_BLOCK),
       coding_type(MPP_VIDEO_CodingUnused), support_sync(true),
-      support_async(true) {
+      support_async(true), pool_num(0),
+      pool_mem_type(MediaBuffer::MemType::MEM_COMMON), pool_group(NULL),
+      pool_stalled(false), event_thread(nullptr), event_quit(false) {
   MediaConfig &cfg = GetConfig();
   ImageInfo &img_info = cfg.img_cfg.image_info;
   img_info.pix_fmt = PIX_FMT_NONE;
@@ -42,6 +45,8 @@ MPPDecoder::MPPDecoder(const char *param)
   std::string limit_max_frame_num;
   std::string split_mode;
   std::string stimeout;
+  std::string spool_num;
+  std::string mem_type;
   req_list.push_back(std::pair<const std::string, std::string &>(
       KEY_INPUTDATATYPE, input_data_type));
   req_list.push_back(std::pair<const std::string, std::string &>(
@@ -52,6 +57,10 @@ MPPDecoder::MPPDecoder(const char *param)
       KEY_MPP_SPLIT_MODE, split_mode));
   req_list.push_back(std::pair<const std::string, std::string &>(
       KEY_OUTPUT_TIMEOUT, stimeout));
+  req_list.push_back(std::pair<const std::string, std::string &>(
+      KEY_POOL_BUFFER_NUM, spool_num));
+  req_list.push_back(std::pair<const std::string, std::string &>(
+      KEY_MEM_TYPE, mem_type));
 
   int ret = parse_media_param_match(param, params, req_list);
   if (ret == 0 || input_data_type.empty()) {
@@ -79,8 +88,17 @@ MPPDecoder::MPPDecoder(const char *param)
     if (timeout == 0)
       timeout = MPP_POLL_NON_BLOCK;
   }
+  if (!spool_num.empty()) {
+    pool_num = std::stoi(spool_num);
+    pool_mem_type = StringToMemType(mem_type.empty() ? KEY_MEM_HARDWARE
+                                                     : mem_type.c_str());
+  }
 }
 
+const RK_U32 MPPDecoder::kEventTimeout;
+
+MPPDecoder::~MPPDecoder() { StopEvents(); }
+
 static MppCodingType get_codingtype(const std::string &data_type) {
   if (data_type == VIDEO_H264)
     return MPP_VIDEO_CodingAVC;
@@ -181,6 +199,8 @@ public:
     if (frame)
       mpp_frame_deinit(&frame);
   }
+  // the memory of an output pool, freed after mpp drops it
+  std::shared_ptr<MediaBuffer> pool_buffer;
 
 private:
   std::shared_ptr<MPPContext> mctx;
@@ -194,9 +214,10 @@ static int __free_mppframecontext(void *p) {
 }
 
 // frame may be deinit here or depends on ImageBuffer
-static int SetImageBufferWithMppFrame(std::shared_ptr<ImageBuffer> ib,
-                                      std::shared_ptr<MPPContext> mctx,
-                                      MppFrame &frame) {
+static int
+SetImageBufferWithMppFrame(std::shared_ptr<ImageBuffer> ib,
+                           std::shared_ptr<MPPContext> mctx, MppFrame &frame,
+                           std::shared_ptr<MediaBuffer> pool_buffer = nullptr) {
   const MppBuffer buffer = mpp_frame_get_buffer(frame);
   if (!buffer) {
     LOG("Failed to retrieve the frame buffer\n");
@@ -217,6 +238,7 @@ static int SetImageBufferWithMppFrame(std::shared_ptr<ImageBuffer> ib,
       LOG_NO_MEMORY();
       return -ENOMEM;
     }
+    ctx->pool_buffer = pool_buffer;
     ib->SetFD(mpp_buffer_get_fd(buffer));
     ib->SetPtr(mpp_buffer_get_ptr(buffer));
     assert(size <= mpp_buffer_get_size(buffer));
@@ -445,6 +467,22 @@ int MPPDecoder::SendInput(std::shared_ptr<MediaBuffer> input) {
   }
   if (!input)
     return 0;
+  {
+    // no frame for mpp to decode to, as the user holds them all
+    std::lock_guard<std::mutex> _lg(pool_mtx);
+    size_t held = 0;
+    for (auto &mb : pool_buffers)
+      if (mb.use_count() > 1)
+        held++;
+    if (held > 0 && held == pool_buffers.size()) {
+      if (!pool_stalled)
+        LOG("mpp decoder stalls, all %d frames of pool are held\n",
+            (int)held);
+      pool_stalled = true;
+      return -EAGAIN;
+    }
+    pool_stalled = false;
+  }
   int fret = 0;
   MPP_RET ret;
   MppPacket packet = NULL;
@@ -477,14 +515,32 @@ int MPPDecoder::SendInput(std::shared_ptr<MediaBuffer> input) {
 }
 
 std::shared_ptr<MediaBuffer> MPPDecoder::FetchOutput() {
+  {
+    std::lock_guard<std::mutex> _lg(event_mtx);
+    if (!ready_frames.empty()) {
+      auto mb = ready_frames.front();
+      ready_frames.pop_front();
+      return mb;
+    }
+    if (event_thread) {
+      errno = 0;
+      return nullptr;
+    }
+  }
+  return GetMppFrame();
+}
+
+std::shared_ptr<MediaBuffer> MPPDecoder::GetMppFrame() {
   MppFrame mppframe = NULL;
   MppCtx ctx = mpp_ctx->ctx;
   MppApi *mpi = mpp_ctx->mpi;
   MPP_RET ret = mpi->decode_get_frame(ctx, &mppframe);
   errno = 0;
   if (ret != MPP_OK) {
-    if (ret != MPP_ERR_TIMEOUT)
+    if (ret != MPP_ERR_TIMEOUT) {
       LOG("Failed to get a frame from MPP (ret = %d)\n", ret);
+      errno = EIO;
+    }
     return nullptr;
   }
   if (!mppframe) {
@@ -499,6 +555,10 @@ std::shared_ptr<MediaBuffer> MPPDecoder::FetchOutput() {
     img_info.height = mpp_frame_get_height(mppframe);
     img_info.vir_width = mpp_frame_get_hor_stride(mppframe);
     img_info.vir_height = mpp_frame_get_ver_stride(mppframe);
+    if ((output_pool || pool_num > 0) &&
+        !CommitOutputPool(CalPixFmtSize(img_info.pix_fmt, img_info.vir_width,
+                                        img_info.vir_height)))
+      errno = ENOMEM;
     ret = mpi->control(ctx, MPP_DEC_SET_INFO_CHANGE_READY, NULL);
     if (ret != MPP_OK)
       LOG("info change ready failed ret = %d\n", ret);
@@ -528,7 +588,14 @@ std::shared_ptr<MediaBuffer> MPPDecoder::FetchOutput() {
       errno = ENOMEM;
       goto out;
     }
-    if (SetImageBufferWithMppFrame(mb, mpp_ctx, mppframe))
+    std::shared_ptr<MediaBuffer> pool_buffer;
+    if (pool_group) {
+      int index = mpp_buffer_get_index(mpp_frame_get_buffer(mppframe));
+      std::lock_guard<std::mutex> _lg(pool_mtx);
+      if (index >= 0 && index < (int)pool_buffers.size())
+        pool_buffer = pool_buffers[index];
+    }
+    if (SetImageBufferWithMppFrame(mb, mpp_ctx, mppframe, pool_buffer))
       goto out;
 
     return mb;
@@ -539,6 +606,131 @@ out:
   return nullptr;
 }
 
+// Commit the buffers of the output pool to an external group of mpp. A pool
+// too small for the new frames is replaced; the frames of the old geometry
+// keep their buffers, which go back to the old pool as they are released.
+bool MPPDecoder::CommitOutputPool(size_t frame_size) {
+  std::lock_guard<std::mutex> _lg(pool_mtx);
+  if (pool_group && output_pool->GetBufferSize() >= frame_size)
+    return true; // mpp keeps the committed ones
+  MPP_RET ret;
+  if (!output_pool || output_pool->GetBufferSize() < frame_size) {
+    int num = output_pool ? output_pool->GetNum() : pool_num;
+    auto type = output_pool ? output_pool->GetMemType() : pool_mem_type;
+    if (output_pool)
+      LOG("mpp decoder reallocates the output pool, %d x %zu\n", num,
+          frame_size);
+    output_pool =
+        std::make_shared<BufferPool>(num, frame_size, type, "mpp_dec");
+    if (!output_pool || output_pool->GetNum() < num) {
+      LOG("Fail to allocate the output pool, %d x %zu\n", num, frame_size);
+      return false;
+    }
+  }
+  if (!pool_group) {
+    ret = mpp_buffer_group_get_external(&pool_group, MPP_BUFFER_TYPE_ION);
+    if (ret != MPP_OK) {
+      LOG("Failed to get external buffer group (ret = %d)\n", ret);
+      return false;
+    }
+    ret = mpp_ctx->mpi->control(mpp_ctx->ctx, MPP_DEC_SET_EXT_BUF_GROUP,
+                                pool_group);
+    if (ret != MPP_OK) {
+      LOG("Failed to assign buffer group (ret = %d)\n", ret);
+      mpp_buffer_group_put(pool_group);
+      pool_group = NULL;
+      return false;
+    }
+    // instead of the internal one, put after mpp
+    if (mpp_ctx->frame_group)
+      mpp_buffer_group_put(mpp_ctx->frame_group);
+    mpp_ctx->frame_group = pool_group;
+  } else {
+    mpp_buffer_group_clear(pool_group);
+  }
+  pool_buffers.clear();
+  std::shared_ptr<MediaBuffer> mb;
+  while ((mb = output_pool->Get())) {
+    MppBufferInfo info;
+    memset(&info, 0, sizeof(info));
+    info.type = MPP_BUFFER_TYPE_ION;
+    info.size = mb->GetSize();
+    info.fd = mb->GetFD();
+    info.ptr = mb->GetPtr();
+    info.index = pool_buffers.size();
+    ret = mpp_buffer_commit(pool_group, &info);
+    if (ret != MPP_OK) {
+      LOG("Failed to commit buffer %d (ret = %d)\n", info.index, ret);
+      return false;
+    }
+    pool_buffers.push_back(mb);
+  }
+  LOG("mpp decoder commits %d frames of %zu\n", (int)pool_buffers.size(),
+      output_pool->GetBufferSize());
+  return true;
+}
+
+bool MPPDecoder::SetEventCallback(EventCallback cb) {
+  StopEvents();
+  if (!cb)
+    return true;
+  if (!support_async || !mpp_ctx)
+    return false;
+  RK_U32 wait = kEventTimeout;
+  MPP_RET ret =
+      mpp_ctx->mpi->control(mpp_ctx->ctx, MPP_SET_OUTPUT_TIMEOUT, &wait);
+  if (ret != MPP_OK) {
+    LOG("mpi set output timeout = %d, ret = %d\n", wait, ret);
+    return false;
+  }
+  event_cb = cb;
+  event_quit = false;
+  event_thread = new std::thread(&MPPDecoder::EventLoop, this);
+  if (!event_thread) {
+    LOG_NO_MEMORY();
+    return false;
+  }
+  return true;
+}
+
+void MPPDecoder::StopEvents() {
+  if (!event_thread)
+    return;
+  {
+    std::lock_guard<std::mutex> _lg(event_mtx);
+    event_quit = true;
+    event_cond.notify_all();
+  }
+  event_thread->join();
+  delete event_thread;
+  event_thread = nullptr;
+  event_cb = nullptr;
+  // back to the polling FetchOutput
+  mpp_ctx->mpi->control(mpp_ctx->ctx, MPP_SET_OUTPUT_TIMEOUT, &timeout);
+}
+
+void MPPDecoder::EventLoop() {
+  std::unique_lock<std::mutex> lock(event_mtx);
+  while (!event_quit) {
+    lock.unlock();
+    auto mb = GetMppFrame();
+    int err = errno;
+    lock.lock();
+    uint32_t events = kEventInput;
+    if (mb) {
+      ready_frames.push_back(mb);
+      events |= kEventOutput;
+    } else if (err) {
+      // not to spin on a failing mpp
+      event_cond.wait_for(lock, std::chrono::milliseconds(kEventTimeout));
+      continue;
+    }
+    lock.unlock();
+    event_cb(events);
+    lock.lock();
+  }
+}
+
 DEFINE_VIDEO_DECODER_FACTORY(MPPDecoder)
 const char *FACTORY(MPPDecoder)::ExpectedInputDataType() {
   return TYPENEAR(IMAGE_JPEG) TYPENEAR(VIDEO_H264);
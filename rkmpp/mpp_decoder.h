@@ -22,6 +22,12 @@
 #ifndef EASYMEDIA_MPP_DECODER_H
 #define EASYMEDIA_MPP_DECODER_H
 
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "decoder.h"
 #include "mpp_inc.h"
 
@@ -31,17 +37,29 @@ namespace easymedia {
 class MPPDecoder : public VideoDecoder {
 public:
   MPPDecoder(const char *param);
-  virtual ~MPPDecoder() = default;
+  virtual ~MPPDecoder();
   static const char *GetCodecName() { return "rkmpp"; }
 
   virtual bool Init() override;
   virtual int Process(std::shared_ptr<MediaBuffer> input,
                       std::shared_ptr<MediaBuffer> output,
                       std::shared_ptr<MediaBuffer> extra_output) override;
+  // -EAGAIN while the frames of the output pool are all held downstream,
+  // which stalls the decoding.
   virtual int SendInput(std::shared_ptr<MediaBuffer> input) override;
   virtual std::shared_ptr<MediaBuffer> FetchOutput() override;
 
+  // A thread waits on mpp for the frames, then FetchOutput takes them without
+  // blocking. Mpp tells nothing about its free input space, which is assumed
+  // to change as a frame comes out, or each kEventTimeout of waiting.
+  virtual bool SetEventCallback(EventCallback cb) override;
+
 private:
+  std::shared_ptr<MediaBuffer> GetMppFrame();
+  bool CommitOutputPool(size_t frame_size);
+  void StopEvents();
+  void EventLoop();
+
   std::string input_data_type;
   PixelFormat output_format;
   RK_S32 fg_limit_num;
@@ -52,6 +70,23 @@ private:
   bool support_sync;
   bool support_async;
   static const RK_S32 kFRAMEGROUP_MAX_FRAMES = 16;
+
+  // KEY_POOL_BUFFER_NUM frames allocated on the first info change, if no
+  // output pool is set
+  int pool_num;
+  MediaBuffer::MemType pool_mem_type;
+  std::mutex pool_mtx;
+  MppBufferGroup pool_group; // the external frame group of mpp_ctx
+  std::vector<std::shared_ptr<MediaBuffer>> pool_buffers; // index in mpp
+  bool pool_stalled;
+
+  static const RK_U32 kEventTimeout = 20; // ms
+  std::mutex event_mtx;
+  std::condition_variable event_cond;
+  std::thread *event_thread;
+  bool event_quit;
+  EventCallback event_cb;
+  std::list<std::shared_ptr<MediaBuffer>> ready_frames;
 };
 
 } // namespace easymedia
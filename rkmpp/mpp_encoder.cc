@@ -25,10 +25,43 @@
 #include <unistd.h>
 
 #include "buffer.h"
+#include "buffer_pool.h"
+#include "utils.h"
 
 namespace easymedia {
 
-MPPEncoder::MPPEncoder() : coding_type(MPP_VIDEO_CodingAutoDetect) {}
+MPPEncoder::MPPEncoder(const char *param)
+    : coding_type(MPP_VIDEO_CodingAutoDetect),
+      async_depth(kDefaultAsyncDepth), eof_in_flight(0), input_starved(false),
+      wait_idr(false) {
+  std::map<std::string, std::string> params;
+  if (!param || !parse_media_param_map(param, params))
+    return;
+  const std::string &depth = params[KEY_MPP_ASYNC_DEPTH];
+  if (!depth.empty()) {
+    async_depth = std::stoi(depth);
+    if (async_depth < 0) {
+      LOG("invalid %s %d, disable the async encoding\n", KEY_MPP_ASYNC_DEPTH,
+          async_depth);
+      async_depth = 0;
+    }
+  }
+}
+
+MPPEncoder::~MPPEncoder() {
+  // the vpu may still read the frames in flight
+  while (!in_flight.empty()) {
+    InFlightFrame &f = in_flight.front();
+    if (f.frame) {
+      MppPacket packet = nullptr;
+      if (FetchPacket(true, packet))
+        break;
+      mpp_packet_deinit(&packet);
+      mpp_frame_deinit(&f.frame);
+    }
+    in_flight.pop_front();
+  }
+}
 
 bool MPPEncoder::Init() {
   mpp_ctx = std::make_shared<MPPContext>();
@@ -51,6 +84,13 @@ bool MPPEncoder::Init() {
     mpi = NULL;
     return false;
   }
+  // the pool of the copied input frames, mpp recycles the returned buffers
+  ret = mpp_buffer_group_get_internal(&mpp_ctx->frame_group,
+                                      MPP_BUFFER_TYPE_ION);
+  if (ret != MPP_OK) {
+    LOG("Failed to get buffer group for input frames, ret = %d\n", ret);
+    mpp_ctx->frame_group = NULL;
+  }
   return true;
 }
 
@@ -71,6 +111,29 @@ int MPPEncoder::PrepareMppFrame(std::shared_ptr<MediaBuffer> input,
     return -EINVAL;
   }
   ImageBuffer *hw_buffer = static_cast<ImageBuffer *>(input.get());
+  int vir_width = hw_buffer->GetVirWidth();
+  int vir_height = hw_buffer->GetVirHeight();
+  if (hw_buffer->HasExplicitPlanes()) {
+    // mpp only takes one buffer described by the strides, the other plane
+    // layouts are encoded from a packed copy
+    ImagePlane planes[IMAGE_MAX_PLANES];
+    int num = hw_buffer->GetPlanes(planes);
+    if (!GetVirSizeOfPlanes(hw_buffer->GetImageInfo(), planes, num, vir_width,
+                            vir_height)) {
+      // !!time-consuming operation
+      auto packed = hw_buffer->PackedCopy(MediaBuffer::MemType::MEM_COMMON);
+      if (!packed) {
+        LOG("mpp encoder fail to pack the planes of %s\n",
+            PixFmtToString(fmt));
+        return -EINVAL;
+      }
+      packed->SetEOF(input->IsEOF());
+      input = packed;
+      hw_buffer = packed.get();
+      vir_width = hw_buffer->GetVirWidth();
+      vir_height = hw_buffer->GetVirHeight();
+    }
+  }
 
   assert(input->GetValidSize() > 0);
   mpp_frame_set_pts(frame, hw_buffer->GetTimeStamp());
@@ -80,12 +143,13 @@ int MPPEncoder::PrepareMppFrame(std::shared_ptr<MediaBuffer> input,
   mpp_frame_set_fmt(frame, ConvertToMppPixFmt(fmt));
 
   if (fmt == PIX_FMT_YUYV422 || fmt == PIX_FMT_UYVY422)
-    mpp_frame_set_hor_stride(frame, hw_buffer->GetVirWidth() * 2);
+    mpp_frame_set_hor_stride(frame, vir_width * 2);
   else
-    mpp_frame_set_hor_stride(frame, hw_buffer->GetVirWidth());
-  mpp_frame_set_ver_stride(frame, hw_buffer->GetVirHeight());
+    mpp_frame_set_hor_stride(frame, vir_width);
+  mpp_frame_set_ver_stride(frame, vir_height);
 
-  MPP_RET ret = init_mpp_buffer_with_content(pic_buf, input);
+  MPP_RET ret = init_mpp_buffer_with_content(pic_buf, input, &import_cache,
+                                             mpp_ctx->frame_group);
   if (ret) {
     LOG("prepare picture buffer failed\n");
     return ret;
@@ -107,7 +171,8 @@ int MPPEncoder::PrepareMppPacket(std::shared_ptr<MediaBuffer> output,
   if (!output->IsHwBuffer())
     return 0;
 
-  MPP_RET ret = init_mpp_buffer(mpp_buf, output, 0);
+  // the pooled outputs are imported once
+  MPP_RET ret = import_cache.Import(mpp_buf, output);
   if (ret) {
     LOG("import output stream buffer failed\n");
     return ret;
@@ -211,6 +276,20 @@ int MPPEncoder::Process(std::shared_ptr<MediaBuffer> input,
   if (ret)
     goto ENCODE_OUT;
 
+  if (import_packet && mpp_packet_get_length(packet) == 0) {
+    // mpp drops the frame which overflows the buffer, but its reconstruction
+    // is the reference of the next frame already, encode it again as an idr
+    // to a buffer of mpp
+    LOG("encoded frame overflows the output buffer of %zu\n",
+        output->GetSize());
+    mpp_packet_deinit(&packet);
+    import_packet = nullptr;
+    EncodeControl(MPP_ENC_SET_IDR_FRAME, nullptr);
+    ret = Process(frame, packet, mv_buf);
+    if (ret)
+      goto ENCODE_OUT;
+  }
+
   packet_len = mpp_packet_get_length(packet);
   packet_flag = (mpp_packet_get_flag(packet) & MPP_PACKET_FLAG_INTRA)
                     ? MediaBuffer::kIntra
@@ -219,7 +298,7 @@ int MPPEncoder::Process(std::shared_ptr<MediaBuffer> input,
   pts = mpp_packet_get_pts(packet);
   if (pts <= 0)
     pts = mpp_packet_get_dts(packet);
-  if (output->IsValid()) {
+  if (output->IsValid() && (import_packet || packet_len <= output->GetSize())) {
     if (!import_packet) {
       // !!time-consuming operation
       void *ptr = output->GetPtr();
@@ -333,13 +412,238 @@ int MPPEncoder::Process(MppFrame frame, MppPacket &packet, MppBuffer &mv_buf) {
   return 0;
 }
 
-int MPPEncoder::SendInput(std::shared_ptr<MediaBuffer> input _UNUSED) {
-  errno = ENOSYS;
-  return -1;
+int MPPEncoder::SendInput(std::shared_ptr<MediaBuffer> input) {
+  if (async_depth <= 0) {
+    errno = ENOSYS;
+    return -ENOSYS;
+  }
+  if (!input)
+    return 0;
+  {
+    std::lock_guard<std::mutex> _lg(async_mtx);
+    if ((int)in_flight.size() >= async_depth || input_starved)
+      return -EAGAIN;
+  }
+  if (!input->IsValid()) {
+    if (!input->IsEOF())
+      return 0;
+    // nothing to encode, FetchOutput gives the eof in order
+    std::lock_guard<std::mutex> _lg(async_mtx);
+    in_flight.push_back({input, nullptr, nullptr});
+    eof_in_flight++;
+    return 0;
+  }
+
+  // all changes must set before encode and among the same thread
+  if (HasChangeReq()) {
+    auto &&change = PeekChange();
+    if (change.first && !CheckConfigChange(change))
+      return -1;
+  }
+
+  MppFrame frame = nullptr;
+  MppPacket packet = nullptr;
+  std::shared_ptr<MediaBuffer> output;
+  MppTask task = NULL;
+  MppCtx ctx = mpp_ctx->ctx;
+  MppApi *mpi = mpp_ctx->mpi;
+  int ret = mpp_frame_init(&frame);
+  if (MPP_OK != ret) {
+    LOG("mpp_frame_init failed\n");
+    return ret;
+  }
+  ret = PrepareMppFrame(input, frame);
+  if (ret) {
+    LOG("PrepareMppFrame failed\n");
+    goto SEND_OUT;
+  }
+  // no overflow fallback here, the later frames are already in flight
+  if (output_pool && output_pool->GetBufferSize() >= input->GetValidSize())
+    output = output_pool->Get();
+  if (output) {
+    output->SetValidSize(output->GetSize());
+    if (PrepareMppPacket(output, packet) || !packet)
+      output.reset(); // mpp allocates
+  }
+  // never block here, the tasks only come back by FetchOutput
+  ret = mpi->poll(ctx, MPP_PORT_INPUT, MPP_POLL_NON_BLOCK);
+  if (ret) {
+    std::lock_guard<std::mutex> _lg(async_mtx);
+    if (in_flight.empty()) {
+      LOG("input poll ret %d\n", ret);
+      goto SEND_OUT;
+    }
+    input_starved = true;
+    ret = -EAGAIN;
+    goto SEND_OUT;
+  }
+  ret = mpi->dequeue(ctx, MPP_PORT_INPUT, &task);
+  if (ret || NULL == task) {
+    LOG("mpp task input dequeue failed\n");
+    ret = ret ? ret : -1;
+    goto SEND_OUT;
+  }
+  mpp_task_meta_set_frame(task, KEY_INPUT_FRAME, frame);
+  if (packet)
+    mpp_task_meta_set_packet(task, KEY_OUTPUT_PACKET, packet);
+  ret = mpi->enqueue(ctx, MPP_PORT_INPUT, task);
+  if (ret) {
+    LOG("mpp task input enqueue failed\n");
+    goto SEND_OUT;
+  }
+  {
+    std::lock_guard<std::mutex> _lg(async_mtx);
+    in_flight.push_back({input, frame, output});
+    if (input->IsEOF())
+      eof_in_flight++;
+  }
+  return 0;
+
+SEND_OUT:
+  if (frame)
+    mpp_frame_deinit(&frame);
+  if (packet)
+    mpp_packet_deinit(&packet);
+  return ret;
+}
+
+int MPPEncoder::FetchPacket(bool wait, MppPacket &packet) {
+  MppTask task = NULL;
+  MppCtx ctx = mpp_ctx->ctx;
+  MppApi *mpi = mpp_ctx->mpi;
+  MppPollType timeout = wait ? MPP_POLL_BLOCK : MPP_POLL_NON_BLOCK;
+  int ret = mpi->poll(ctx, MPP_PORT_OUTPUT, timeout);
+  if (ret) {
+    if (!wait)
+      return -EAGAIN;
+    LOG("output poll ret %d\n", ret);
+    return ret;
+  }
+  ret = mpi->dequeue(ctx, MPP_PORT_OUTPUT, &task);
+  if (ret || !task) {
+    LOG("mpp task output dequeue failed, ret %d \n", ret);
+    return ret ? ret : -1;
+  }
+  packet = nullptr;
+  mpp_task_meta_get_packet(task, KEY_OUTPUT_PACKET, &packet);
+  ret = mpi->enqueue(ctx, MPP_PORT_OUTPUT, task);
+  if (ret != MPP_OK) {
+    LOG("enqueue task output failed, ret = %d\n", ret);
+    if (packet)
+      mpp_packet_deinit(&packet);
+    return ret;
+  }
+  return packet ? 0 : -1;
+}
+
+std::shared_ptr<MediaBuffer> MPPEncoder::PacketToBuffer(MppPacket &packet) {
+  auto output = std::make_shared<MediaBuffer>();
+  MPPPacketContext *ctx = new MPPPacketContext(mpp_ctx, packet);
+  if (!output || !ctx) {
+    LOG_NO_MEMORY();
+    return nullptr;
+  }
+  output->SetFD(mpp_buffer_get_fd(mpp_packet_get_buffer(packet)));
+  output->SetPtr(mpp_packet_get_data(packet));
+  output->SetSize(mpp_packet_get_size(packet));
+  output->SetUserData(ctx, __free_mpppacketcontext);
+  output->SetValidSize(mpp_packet_get_length(packet));
+  output->SetUserFlag((mpp_packet_get_flag(packet) & MPP_PACKET_FLAG_INTRA)
+                          ? MediaBuffer::kIntra
+                          : MediaBuffer::kPredicted);
+  output->SetType(Type::Video);
+  packet = nullptr;
+  return output;
 }
+
 std::shared_ptr<MediaBuffer> MPPEncoder::FetchOutput() {
-  errno = ENOSYS;
-  return nullptr;
+  InFlightFrame f;
+  bool wait;
+  errno = 0;
+  if (async_depth <= 0) {
+    errno = ENOSYS;
+    return nullptr;
+  }
+  {
+    std::lock_guard<std::mutex> _lg(async_mtx);
+    if (in_flight.empty())
+      return nullptr;
+    f = in_flight.front();
+    wait = (int)in_flight.size() >= async_depth || input_starved ||
+           eof_in_flight > 0;
+  }
+  std::shared_ptr<MediaBuffer> output;
+  if (f.frame) {
+    MppPacket packet = nullptr;
+    int ret = FetchPacket(wait, packet);
+    if (ret == -EAGAIN)
+      return nullptr;
+    if (ret) {
+      errno = EIO;
+      return nullptr;
+    }
+    bool intra =
+        packet && (mpp_packet_get_flag(packet) & MPP_PACKET_FLAG_INTRA);
+    size_t len = packet ? mpp_packet_get_length(packet) : 0;
+    if (f.output && !len) {
+      // mpp drops the frame which overflows the pool buffer, the frames in
+      // flight after it refer to it, so drop them too until the idr
+      LOG("encoded frame overflows the pool buffer, request an idr\n");
+      EncodeControl(MPP_ENC_SET_IDR_FRAME, nullptr);
+      wait_idr = true;
+    } else if (intra) {
+      wait_idr = false;
+    }
+    if (wait_idr && !f.input->IsEOF()) {
+      if (packet)
+        mpp_packet_deinit(&packet);
+      PopInFlight();
+      return FetchOutput();
+    }
+    if (f.output) {
+      output = f.output;
+      output->SetValidSize(len);
+      output->SetUserFlag((mpp_packet_get_flag(packet) & MPP_PACKET_FLAG_INTRA)
+                              ? MediaBuffer::kIntra
+                              : MediaBuffer::kPredicted);
+      output->SetType(Type::Video);
+    } else {
+      output = PacketToBuffer(packet);
+    }
+    if (packet)
+      mpp_packet_deinit(&packet);
+    if (!output) {
+      errno = ENOMEM;
+      return nullptr;
+    }
+    if (wait_idr)
+      output->SetValidSize(0); // only the eof
+  } else {
+    output = std::make_shared<MediaBuffer>();
+    if (!output) {
+      errno = ENOMEM;
+      return nullptr;
+    }
+    output->SetType(Type::Video);
+  }
+  // mpp gives the packets in the input order
+  output->SetTimeStamp(f.input->GetTimeStamp());
+  output->SetEOF(f.input->IsEOF());
+  for (auto &sptr : f.input->GetRelatedSPtrs())
+    output->SetRelatedSPtr(sptr);
+  PopInFlight();
+  return output;
+}
+
+void MPPEncoder::PopInFlight() {
+  std::lock_guard<std::mutex> _lg(async_mtx);
+  InFlightFrame &front = in_flight.front();
+  if (front.frame)
+    mpp_frame_deinit(&front.frame);
+  if (front.input->IsEOF())
+    eof_in_flight--;
+  in_flight.pop_front();
+  input_starved = false;
 }
 
 int MPPEncoder::EncodeControl(int cmd, void *param) {
@@ -22,6 +22,9 @@
 #ifndef EASYMEDIA_MPP_ENCODER_H
 #define EASYMEDIA_MPP_ENCODER_H
 
+#include <list>
+#include <mutex>
+
 #include "encoder.h"
 #include "mpp_inc.h"
 
@@ -31,17 +34,35 @@ namespace easymedia {
 // Mpp is always video process module.
 class MPPEncoder : public VideoEncoder {
 public:
-  MPPEncoder();
-  virtual ~MPPEncoder() = default;
+  static const int kDefaultAsyncDepth = 0;
+
+  MPPEncoder(const char *param);
+  virtual ~MPPEncoder();
 
   virtual bool Init() override;
   virtual bool InitConfig(const MediaConfig &cfg) override;
 
-  // sync encode the raw input buffer to output buffer
+  // Sync encode the raw input buffer to output buffer. A valid output buffer
+  // is written directly if it is a hardware one. If the frame overflows it,
+  // the frame is encoded again as an idr to a buffer of mpp which replaces
+  // the memory of output.
   virtual int Process(std::shared_ptr<MediaBuffer> input,
                       std::shared_ptr<MediaBuffer> output,
                       std::shared_ptr<MediaBuffer> extra_output) override;
 
+  // The async path keeps up to KEY_MPP_ASYNC_DEPTH frames in the vpu, so the
+  // next frame is submitted while the last one encodes. SendInput returns
+  // -EAGAIN if the pipeline is full; FetchOutput then waits for the oldest
+  // frame, as it does while an eof frame is in the pipeline, else it returns
+  // nullptr at once if nothing is done. The outputs are in the input order,
+  // with the timestamps and the related sptrs of their inputs. They are the
+  // buffers of the output pool if it has a free hardware buffer not less than
+  // the raw frame, so they hardly overflow. If one does, it is dropped with
+  // the frames after it until the idr which is requested then.
+  // It is opt-in: a caller which fetches only after sending gets frame N
+  // when frame N+1 comes, one more frame interval of latency, and never the
+  // last one of a one-shot encode such as a jpeg snapshot. Depth 0, the
+  // default, disables it, SendInput fails with ENOSYS.
   virtual int SendInput(std::shared_ptr<MediaBuffer> input) override;
   virtual std::shared_ptr<MediaBuffer> FetchOutput() override;
 
@@ -64,8 +85,26 @@ protected:
   int Process(MppFrame frame, MppPacket &packet, MppBuffer &mv_buf);
 
 private:
+  struct InFlightFrame {
+    std::shared_ptr<MediaBuffer> input;  // kept until the vpu finishes it
+    MppFrame frame;                      // null for an eof without data
+    std::shared_ptr<MediaBuffer> output; // from the output pool, or null
+  };
+  int FetchPacket(bool wait, MppPacket &packet);
+  std::shared_ptr<MediaBuffer> PacketToBuffer(MppPacket &packet);
+  void PopInFlight();
+
   MppCodingType coding_type;
   std::shared_ptr<MPPContext> mpp_ctx;
+  // the fd-backed inputs, such as the capture rings, are imported once
+  MPPImportCache import_cache;
+
+  int async_depth;
+  std::mutex async_mtx;
+  std::list<InFlightFrame> in_flight;
+  int eof_in_flight;
+  bool input_starved; // mpp had no free task for the last input
+  bool wait_idr;      // an output overflowed, drop the frames until the idr
 };
 
 } // namespace easymedia
@@ -33,7 +33,7 @@ public:
   static const int kMPPH264MinBps = 2 * 1000;
   static const int kMPPH264MaxBps = 98 * 1000 * 1000;
 
-  MPPH264Encoder(const char *param _UNUSED) {
+  MPPH264Encoder(const char *param) : MPPEncoder(param) {
     SetMppCodeingType(MPP_VIDEO_CodingAVC);
   }
   virtual ~MPPH264Encoder() = default;
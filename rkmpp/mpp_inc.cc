@@ -22,6 +22,7 @@
 #include "mpp_inc.h"
 
 #include <assert.h>
+#include <sys/stat.h>
 
 #include "media_type.h"
 #include "utils.h"
@@ -127,11 +128,71 @@ MPPContext::~MPPContext() {
   }
 }
 
+MPPImportCache::MPPImportCache(size_t max_entries)
+    : capacity(max_entries), hits(0), misses(0) {}
+
+MPP_RET MPPImportCache::Import(MppBuffer &buffer,
+                               std::shared_ptr<MediaBuffer> &mb) {
+  struct stat st;
+  int fd = mb->GetFD();
+  std::shared_ptr<void> owner = mb->GetUserData();
+  if (fd < 0 || !owner || fstat(fd, &st))
+    return init_mpp_buffer(buffer, mb, 0);
+
+  std::lock_guard<std::mutex> _lg(mtx);
+  for (auto it = entries.begin(); it != entries.end();) {
+    if (it->owner.expired()) {
+      // the memory is gone, so may be the inode
+      mpp_buffer_put(it->buffer);
+      it = entries.erase(it);
+      continue;
+    }
+    if (it->dev == st.st_dev && it->ino == st.st_ino &&
+        it->owner.lock() == owner &&
+        mpp_buffer_get_size(it->buffer) >= mb->GetValidSize()) {
+      entries.splice(entries.begin(), entries, it);
+      buffer = it->buffer;
+      mpp_buffer_inc_ref(buffer);
+      hits++;
+      return MPP_OK;
+    }
+    ++it;
+  }
+  misses++;
+
+  // import the whole memory, the frames on it may have different sizes
+  MppBufferInfo info;
+  memset(&info, 0, sizeof(info));
+  info.type = MPP_BUFFER_TYPE_ION;
+  info.size = mb->GetSize() > 0 ? mb->GetSize() : mb->GetValidSize();
+  info.fd = fd;
+  info.ptr = mb->IsMapped() ? mb->GetPtr() : nullptr;
+  MPP_RET ret = mpp_buffer_import(&buffer, &info);
+  if (ret) {
+    LOG("import input picture buffer failed\n");
+    buffer = nullptr;
+    return ret;
+  }
+  if (entries.size() >= capacity) {
+    mpp_buffer_put(entries.back().buffer);
+    entries.pop_back();
+  }
+  entries.push_front(Entry{st.st_dev, st.st_ino, owner, buffer});
+  mpp_buffer_inc_ref(buffer);
+  return MPP_OK;
+}
+
+void MPPImportCache::Clear() {
+  std::lock_guard<std::mutex> _lg(mtx);
+  for (auto &entry : entries)
+    mpp_buffer_put(entry.buffer);
+  entries.clear();
+}
+
 MPP_RET init_mpp_buffer(MppBuffer &buffer, std::shared_ptr<MediaBuffer> &mb,
-                        size_t frame_size) {
+                        size_t frame_size, MppBufferGroup group) {
   MPP_RET ret;
   int fd = mb->GetFD();
-  void *ptr = mb->GetPtr();
   size_t size = mb->GetValidSize();
 
   if (fd >= 0) {
@@ -141,7 +202,8 @@ MPP_RET init_mpp_buffer(MppBuffer &buffer, std::shared_ptr<MediaBuffer> &mb,
     info.type = MPP_BUFFER_TYPE_ION;
     info.size = size;
     info.fd = fd;
-    info.ptr = ptr;
+    // import by fd, never map a hardware only buffer for mpp
+    info.ptr = mb->IsMapped() ? mb->GetPtr() : nullptr;
 
     ret = mpp_buffer_import(&buffer, &info);
     if (ret) {
@@ -155,7 +217,7 @@ MPP_RET init_mpp_buffer(MppBuffer &buffer, std::shared_ptr<MediaBuffer> &mb,
       size = frame_size;
       assert(frame_size > 0);
     }
-    ret = mpp_buffer_get(NULL, &buffer, size);
+    ret = mpp_buffer_get(group, &buffer, size);
     if (ret) {
       LOG("allocate output stream buffer failed\n");
       goto fail;
@@ -173,13 +235,17 @@ fail:
 }
 
 MPP_RET init_mpp_buffer_with_content(MppBuffer &buffer,
-                                     std::shared_ptr<MediaBuffer> &mb) {
+                                     std::shared_ptr<MediaBuffer> &mb,
+                                     MPPImportCache *cache,
+                                     MppBufferGroup group) {
   size_t size = mb->GetValidSize();
-  MPP_RET ret = init_mpp_buffer(buffer, mb, size);
+  MPP_RET ret = (cache && mb->GetFD() >= 0)
+                    ? cache->Import(buffer, mb)
+                    : init_mpp_buffer(buffer, mb, size, group);
   if (ret)
     return ret;
   int fd = mb->GetFD();
-  void *ptr = mb->GetPtr();
+  void *ptr = (fd < 0) ? mb->GetPtr() : nullptr;
   // As init_mpp_buffer is a no time-consuming function and do not memcpy
   // content to a virtual buffer, do memcpy here.
   if (fd < 0 && ptr) {
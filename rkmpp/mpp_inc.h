@@ -22,6 +22,11 @@
 #ifndef EASYMEDIA_MPP_INC_H_
 #define EASYMEDIA_MPP_INC_H_
 
+#include <sys/types.h>
+
+#include <list>
+#include <mutex>
+
 #include "buffer.h"
 #include "image.h"
 #include <rk_mpi.h>
@@ -46,12 +51,47 @@ struct MPPContext {
   MppBufferGroup frame_group;
 };
 
-// no time-consuming, init a mppbuffer with MediaBuffer
+// Keep the mpp buffers imported from the fds of the long-lived buffers, such
+// as the dma buffers of a capture ring, so the frames on the same memory skip
+// the import and the mapping in mpp. An entry is keyed by the inode of the
+// dma buffer and dies with the memory owner, the user data of MediaBuffer.
+class _API MPPImportCache {
+public:
+  static const size_t kDefaultCapacity = 16;
+
+  MPPImportCache(size_t max_entries = kDefaultCapacity);
+  ~MPPImportCache() { Clear(); }
+  // Return a new reference of the mpp buffer of mb, put it after use.
+  // The buffers without owner are imported as before, uncached.
+  MPP_RET Import(MppBuffer &buffer, std::shared_ptr<MediaBuffer> &mb);
+  void Clear();
+  size_t GetHits() const { return hits; }
+  size_t GetMisses() const { return misses; }
+
+private:
+  struct Entry {
+    dev_t dev;
+    ino_t ino;
+    std::weak_ptr<void> owner;
+    MppBuffer buffer;
+  };
+  std::mutex mtx;
+  size_t capacity;
+  std::list<Entry> entries; // the recently used first
+  size_t hits;
+  size_t misses;
+};
+
+// no time-consuming, init a mppbuffer with MediaBuffer, the buffer without fd
+// comes from group if given
 MPP_RET init_mpp_buffer(MppBuffer &buffer, std::shared_ptr<MediaBuffer> &mb,
-                        size_t frame_size);
-// may time-consuming
-MPP_RET init_mpp_buffer_with_content(MppBuffer &buffer,
-                                     std::shared_ptr<MediaBuffer> &mb);
+                        size_t frame_size, MppBufferGroup group = NULL);
+// may time-consuming, the fd-backed mb is imported through cache if given,
+// else the content is copied to a buffer from group
+_API MPP_RET init_mpp_buffer_with_content(MppBuffer &buffer,
+                                          std::shared_ptr<MediaBuffer> &mb,
+                                          MPPImportCache *cache = nullptr,
+                                          MppBufferGroup group = NULL);
 } // namespace easymedia
 
 #endif // EASYMEDIA_MPP_INC_H_
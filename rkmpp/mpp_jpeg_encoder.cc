@@ -27,7 +27,7 @@ namespace easymedia {
 
 class MPPJpegEncoder : public MPPEncoder {
 public:
-  MPPJpegEncoder(const char *param _UNUSED) {
+  MPPJpegEncoder(const char *param) : MPPEncoder(param) {
     SetMppCodeingType(MPP_VIDEO_CodingMJPEG);
   }
   virtual ~MPPJpegEncoder() = default;
@@ -0,0 +1,1491 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+// In-process stand-in of the mpp library, see rk_mpi.h.
+// A context runs one worker thread as the vpu, which takes the enqueued
+// tasks and the decoder input in order and spends the configured latency
+// on each frame.
+
+#include "rk_mpi.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "au_assembler.h"
+#include "buffer.h"
+#include "h26x_parser.h"
+#include "startcode.h"
+#include "utils.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+namespace easymedia {
+
+struct StubBuffer;
+
+struct StubGroup {
+  StubGroup()
+      : limit(0), count(0), released(false), external(false), generation(0) {}
+  std::mutex mtx;
+  std::condition_variable cond;
+  int limit;
+  int count; // of the buffers not returned
+  bool released;
+  bool external;       // only the committed buffers, never allocates
+  uint32_t generation; // of the buffers kept, a clear drops the older ones
+  std::vector<StubBuffer *> unused; // returned, kept for the next get
+};
+
+struct StubBuffer {
+  StubBuffer()
+      : ptr(nullptr), size(0), map_size(0), fd(-1), heap(false), ref(1),
+        group(nullptr), index(-1), generation(0) {}
+  void *ptr;
+  size_t size;
+  size_t map_size; // non zero if ptr is mapped by us
+  int fd;          // owned
+  bool heap;       // ptr is malloc-ed
+  std::atomic<int> ref;
+  StubGroup *group;
+  int index; // of the committed one
+  uint32_t generation;
+};
+
+struct StubFrame {
+  RK_U32 width;
+  RK_U32 height;
+  RK_U32 hor_stride;
+  RK_U32 ver_stride;
+  MppFrameFormat fmt;
+  RK_S64 pts;
+  RK_S64 dts;
+  RK_U32 eos;
+  RK_U32 info_change;
+  RK_U32 discard;
+  RK_U32 errinfo;
+  StubBuffer *buffer;
+};
+
+struct StubPacket {
+  void *data;
+  size_t size;
+  void *pos;
+  size_t length;
+  RK_S64 pts;
+  RK_S64 dts;
+  RK_U32 flag;
+  RK_U32 eos;
+  StubBuffer *buffer;
+};
+
+// same as mpp_packet_impl.h
+#define STUB_PACKET_FLAG_INTRA (0x00000008)
+
+struct StubTask {
+  MppFrame input_frame;
+  MppPacket input_packet;
+  MppFrame output_frame;
+  MppPacket output_packet;
+  MppBuffer motion_info;
+};
+
+static void destroy_buffer(StubBuffer *b) {
+  if (b->map_size)
+    munmap(b->ptr, b->map_size);
+  else if (b->heap)
+    free(b->ptr);
+  if (b->fd >= 0)
+    close(b->fd);
+  delete b;
+}
+
+static void release_group(StubGroup *group) {
+  std::unique_lock<std::mutex> lock(group->mtx);
+  group->released = true;
+  for (StubBuffer *b : group->unused)
+    destroy_buffer(b);
+  group->unused.clear();
+  if (group->count > 0)
+    return; // the last buffer deletes it
+  lock.unlock();
+  delete group;
+}
+
+// As the internal groups of mpp, a live group keeps the returned buffers.
+static void free_buffer(StubBuffer *b) {
+  StubGroup *group = b->group;
+  if (!group) {
+    destroy_buffer(b);
+    return;
+  }
+  std::unique_lock<std::mutex> lock(group->mtx);
+  group->count--;
+  if (group->released) {
+    destroy_buffer(b);
+    if (group->count == 0) {
+      lock.unlock();
+      delete group;
+    }
+    return;
+  }
+  if (b->generation != group->generation) {
+    destroy_buffer(b); // cleared while in use
+    return;
+  }
+  group->unused.push_back(b);
+  group->cond.notify_all();
+}
+
+// memfd backed as the ion buffers, falls back to the heap
+static StubBuffer *alloc_buffer(size_t size) {
+  StubBuffer *b = new StubBuffer();
+  b->size = size;
+  size_t map_size = UPALIGNTO(size, (size_t)sysconf(_SC_PAGESIZE));
+#ifdef SYS_memfd_create
+  int fd = syscall(SYS_memfd_create, "mpp_stub", MFD_CLOEXEC);
+  if (fd >= 0) {
+    void *ptr = MAP_FAILED;
+    if (!ftruncate(fd, map_size))
+      ptr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr != MAP_FAILED) {
+      b->ptr = ptr;
+      b->map_size = map_size;
+      b->fd = fd;
+      return b;
+    }
+    close(fd);
+  }
+#endif
+  b->ptr = malloc(size);
+  if (!b->ptr) {
+    delete b;
+    return nullptr;
+  }
+  b->heap = true;
+  return b;
+}
+
+static MPP_RET get_buffer(StubGroup *group, StubBuffer **buffer, size_t size) {
+  if (group) {
+    std::lock_guard<std::mutex> _lg(group->mtx);
+    if (group->external) {
+      for (auto it = group->unused.begin(); it != group->unused.end(); ++it) {
+        StubBuffer *b = *it;
+        if (b->size >= size) {
+          group->unused.erase(it);
+          group->count++;
+          b->ref = 1;
+          *buffer = b;
+          return MPP_OK;
+        }
+      }
+      return MPP_ERR_NOMEM;
+    }
+    if (group->limit > 0 && group->count >= group->limit)
+      return MPP_ERR_NOMEM;
+    group->count++;
+    for (auto it = group->unused.begin(); it != group->unused.end(); ++it) {
+      StubBuffer *b = *it;
+      if (b->size >= size) {
+        group->unused.erase(it);
+        b->ref = 1;
+        *buffer = b;
+        return MPP_OK;
+      }
+    }
+    // the size changes, drop the old ones
+    for (StubBuffer *b : group->unused)
+      destroy_buffer(b);
+    group->unused.clear();
+  }
+  StubBuffer *b = alloc_buffer(size);
+  if (!b) {
+    if (group) {
+      std::lock_guard<std::mutex> _lg(group->mtx);
+      group->count--;
+    }
+    LOG_NO_MEMORY();
+    return MPP_ERR_MALLOC;
+  }
+  b->group = group;
+  *buffer = b;
+  return MPP_OK;
+}
+
+static inline uint32_t fnv1a(uint32_t hash, const uint8_t *p, size_t size) {
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ p[i]) * 16777619u;
+  return hash;
+}
+
+static const uint32_t kFnvBasis = 2166136261u;
+
+static inline uint32_t xorshift32(uint32_t &x) {
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+static int get_bits_per_pixel(MppFrameFormat fmt) {
+  switch (fmt) {
+  case MPP_FMT_YUV400:
+    return 8;
+  case MPP_FMT_YUV420SP:
+  case MPP_FMT_YUV420P:
+  case MPP_FMT_YUV420SP_VU:
+  case MPP_FMT_YUV411SP:
+    return 12;
+  case MPP_FMT_YUV422SP:
+  case MPP_FMT_YUV422P:
+  case MPP_FMT_YUV422SP_VU:
+  case MPP_FMT_YUV422_YUYV:
+  case MPP_FMT_YUV422_YVYU:
+  case MPP_FMT_YUV422_UYVY:
+  case MPP_FMT_YUV422_VYUY:
+  case MPP_FMT_YUV440SP:
+  case MPP_FMT_RGB565:
+  case MPP_FMT_BGR565:
+  case MPP_FMT_RGB555:
+  case MPP_FMT_BGR555:
+  case MPP_FMT_RGB444:
+  case MPP_FMT_BGR444:
+    return 16;
+  case MPP_FMT_YUV444SP:
+  case MPP_FMT_RGB888:
+  case MPP_FMT_BGR888:
+    return 24;
+  case MPP_FMT_RGB101010:
+  case MPP_FMT_BGR101010:
+  case MPP_FMT_ARGB8888:
+  case MPP_FMT_ABGR8888:
+    return 32;
+  default:
+    return 0;
+  }
+}
+
+static bool is_packed(MppFrameFormat fmt) {
+  return (fmt >= MPP_FMT_YUV422_YUYV && fmt <= MPP_FMT_YUV422_VYUY) ||
+         fmt >= MPP_FMT_RGB565;
+}
+
+// The hash of every 16th row of the luma, or of the whole row of the
+// packed formats. The hor_stride of the packed yuv is in bytes.
+static uint32_t hash_frame(const StubFrame *f) {
+  uint8_t *p = static_cast<uint8_t *>(f->buffer->ptr);
+  size_t row = f->hor_stride;
+  if (f->fmt >= MPP_FMT_RGB565)
+    row = row * get_bits_per_pixel(f->fmt) / 8;
+  uint32_t hash = kFnvBasis;
+  for (RK_U32 y = 0; y < f->height; y += 16) {
+    size_t offset = row * y;
+    if (offset >= f->buffer->size)
+      break;
+    hash = fnv1a(hash, p + offset, std::min(row, f->buffer->size - offset));
+  }
+  return hash;
+}
+
+// Write the syntax elements of a nal unit.
+class StubBitWriter {
+public:
+  StubBitWriter() : bits(0) {}
+  void U(int n, uint32_t v) {
+    for (int i = n - 1; i >= 0; i--) {
+      if (!(bits & 7))
+        rbsp.push_back(0);
+      rbsp.back() |= ((v >> i) & 1) << (7 - (bits & 7));
+      bits++;
+    }
+  }
+  void UE(uint32_t v) {
+    int len = 0;
+    while ((uint64_t)(v + 1) >> (len + 1))
+      len++;
+    U(len, 0);
+    U(len + 1, v + 1);
+  }
+  void SE(int32_t v) { UE(v > 0 ? 2 * v - 1 : -2 * v); }
+  void AlignWithOnes() {
+    while (bits & 7)
+      U(1, 1);
+  }
+  void TrailingBits() {
+    U(1, 1);
+    while (bits & 7)
+      U(1, 0);
+  }
+  // start code, nal header and the escaped rbsp
+  void Output(uint8_t nal_header, std::vector<uint8_t> &out) const {
+    static const uint8_t start_code[4] = {0, 0, 0, 1};
+    out.insert(out.end(), start_code, start_code + 4);
+    out.push_back(nal_header);
+    int zeros = 0;
+    for (uint8_t b : rbsp) {
+      if (zeros == 2 && b <= 3) {
+        out.push_back(3);
+        zeros = 0;
+      }
+      out.push_back(b);
+      zeros = b ? 0 : zeros + 1;
+    }
+  }
+
+private:
+  std::vector<uint8_t> rbsp;
+  int bits;
+};
+
+static const int kStubLog2MaxFrameNum = 4;
+
+// soi, sof0 of 3 components with the size at [7, 11), sos
+static const uint8_t kJpegHead[] = {
+    0xFF, 0xD8, 0xFF, 0xC0, 0x00, 0x11, 0x08, 0x00, 0x00, 0x00, 0x00, 0x03,
+    0x01, 0x22, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01, 0xFF, 0xDA, 0x00,
+    0x0C, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3F, 0x00};
+
+class StubContext {
+public:
+  static const int kTaskNum = 2;
+  static const size_t kMaxPendingUnits = 8;
+  static const int kDefaultFrameNum = 16;
+
+  StubContext();
+  ~StubContext();
+
+  MPP_RET Init(MppCtxType ctx_type, MppCodingType coding_type);
+  MPP_RET Control(MpiCmd cmd, MppParam param);
+  MPP_RET Poll(MppPortType port, MppPollType timeout);
+  MPP_RET Dequeue(MppPortType port, MppTask *task);
+  MPP_RET Enqueue(MppPortType port, MppTask task);
+  MPP_RET Reset();
+  MPP_RET PutPacket(MppPacket packet);
+  MPP_RET GetFrame(MppFrame *frame);
+
+  MppApi api;
+
+private:
+  template <typename Pred>
+  bool Wait(std::unique_lock<std::mutex> &lock, int timeout, Pred pred) {
+    if (timeout < 0) {
+      cond.wait(lock, [&] { return quit || pred(); });
+      return pred();
+    }
+    return cond.wait_for(lock, std::chrono::milliseconds(timeout), pred);
+  }
+  void Run();
+  void Encode(StubTask *task);
+  void DecodeTask(StubTask *task);
+  void DecodeUnit(std::shared_ptr<MediaBuffer> unit,
+                  std::unique_lock<std::mutex> &lock);
+  bool GetPictureSize(const uint8_t *data, size_t size, RK_U32 &w, RK_U32 &h);
+  MppFrame NewFrame(RK_U32 w, RK_U32 h);
+  void WriteH264Headers(std::vector<uint8_t> &out);
+  size_t GetStreamSize(const StubFrame *f, bool intra) const;
+
+  MppCtxType type;
+  MppCodingType coding;
+  std::chrono::microseconds latency;
+  int output_timeout;
+  bool input_block;
+  RK_U32 split_mode;
+
+  std::mutex mtx;
+  std::condition_variable cond;
+  std::thread *worker;
+  std::atomic<bool> quit;
+  StubTask tasks[kTaskNum];
+  std::deque<StubTask *> idle_tasks;
+  std::deque<StubTask *> input_tasks;
+  std::deque<StubTask *> output_tasks;
+
+  // encoder
+  MppEncPrepCfg prep;
+  MppEncRcCfg rc;
+  MppEncH264Cfg h264;
+  RK_S32 jpeg_quant;
+  bool force_idr;
+  RK_S32 gop_index;
+  uint32_t frame_index;
+  std::vector<uint8_t> extra_data;
+  MppPacket extra_packet;
+
+  // decoder
+  std::shared_ptr<AccessUnitAssembler> assembler;
+  std::shared_ptr<NalParser> parser;
+  std::deque<std::shared_ptr<MediaBuffer>> units;
+  std::deque<MppFrame> frames;
+  StubGroup *frame_group; // the external one or own_group
+  StubGroup *own_group;
+  MppFrameFormat output_format;
+  RK_U32 width, height;
+  bool wait_info_change;
+  uint32_t generation; // bumped by reset, drops the frame in decoding
+};
+
+static MPP_RET stub_decode_put_packet(MppCtx ctx, MppPacket packet) {
+  return static_cast<StubContext *>(ctx)->PutPacket(packet);
+}
+static MPP_RET stub_decode_get_frame(MppCtx ctx, MppFrame *frame) {
+  return static_cast<StubContext *>(ctx)->GetFrame(frame);
+}
+static MPP_RET stub_poll(MppCtx ctx, MppPortType type, MppPollType timeout) {
+  return static_cast<StubContext *>(ctx)->Poll(type, timeout);
+}
+static MPP_RET stub_dequeue(MppCtx ctx, MppPortType type, MppTask *task) {
+  return static_cast<StubContext *>(ctx)->Dequeue(type, task);
+}
+static MPP_RET stub_enqueue(MppCtx ctx, MppPortType type, MppTask task) {
+  return static_cast<StubContext *>(ctx)->Enqueue(type, task);
+}
+static MPP_RET stub_reset(MppCtx ctx) {
+  return static_cast<StubContext *>(ctx)->Reset();
+}
+static MPP_RET stub_control(MppCtx ctx, MpiCmd cmd, MppParam param) {
+  return static_cast<StubContext *>(ctx)->Control(cmd, param);
+}
+
+StubContext::StubContext()
+    : type(MPP_CTX_BUTT), coding(MPP_VIDEO_CodingUnused), latency(0),
+      output_timeout(MPP_POLL_NON_BLOCK), input_block(false), split_mode(0),
+      worker(nullptr), quit(false), jpeg_quant(10), force_idr(false),
+      gop_index(0), frame_index(0), extra_packet(nullptr),
+      frame_group(nullptr), own_group(nullptr),
+      output_format(MPP_FMT_YUV420SP), width(0), height(0),
+      wait_info_change(false), generation(0) {
+  memset(&api, 0, sizeof(api));
+  api.size = sizeof(api);
+  api.decode_put_packet = stub_decode_put_packet;
+  api.decode_get_frame = stub_decode_get_frame;
+  api.poll = stub_poll;
+  api.dequeue = stub_dequeue;
+  api.enqueue = stub_enqueue;
+  api.reset = stub_reset;
+  api.control = stub_control;
+  memset(tasks, 0, sizeof(tasks));
+  for (int i = 0; i < kTaskNum; i++)
+    idle_tasks.push_back(&tasks[i]);
+  memset(&prep, 0, sizeof(prep));
+  memset(&rc, 0, sizeof(rc));
+  memset(&h264, 0, sizeof(h264));
+  h264.profile = 100;
+  h264.level = 40;
+  h264.qp_init = 26;
+  const char *us = getenv("MPP_STUB_LATENCY_US");
+  if (us)
+    latency = std::chrono::microseconds(strtoul(us, nullptr, 10));
+}
+
+StubContext::~StubContext() {
+  if (worker) {
+    {
+      std::lock_guard<std::mutex> _lg(mtx);
+      quit = true;
+      cond.notify_all();
+    }
+    if (frame_group) {
+      std::lock_guard<std::mutex> _lg(frame_group->mtx);
+      frame_group->cond.notify_all();
+    }
+    worker->join();
+    delete worker;
+  }
+  for (MppFrame f : frames)
+    mpp_frame_deinit(&f);
+  if (extra_packet)
+    mpp_packet_deinit(&extra_packet);
+  if (own_group)
+    release_group(own_group);
+}
+
+MPP_RET StubContext::Init(MppCtxType ctx_type, MppCodingType coding_type) {
+  if (worker)
+    return MPP_ERR_INIT;
+  if (ctx_type == MPP_CTX_ENC) {
+    if (coding_type != MPP_VIDEO_CodingAVC &&
+        coding_type != MPP_VIDEO_CodingMJPEG)
+      return MPP_ERR_VALUE;
+  } else if (ctx_type == MPP_CTX_DEC) {
+    if (coding_type == MPP_VIDEO_CodingAVC ||
+        coding_type == MPP_VIDEO_CodingHEVC) {
+      NalCodec c = coding_type == MPP_VIDEO_CodingAVC ? NalCodec::H264
+                                                      : NalCodec::H265;
+      parser = NalParser::Create(c);
+      if (split_mode)
+        assembler = std::make_shared<AccessUnitAssembler>(c);
+    } else if (coding_type != MPP_VIDEO_CodingMJPEG) {
+      return MPP_ERR_VALUE;
+    }
+    own_group = new StubGroup();
+    own_group->limit = kDefaultFrameNum;
+    if (!frame_group)
+      frame_group = own_group;
+  } else {
+    return MPP_ERR_VALUE;
+  }
+  type = ctx_type;
+  coding = coding_type;
+  worker = new std::thread(&StubContext::Run, this);
+  return MPP_OK;
+}
+
+MPP_RET StubContext::Control(MpiCmd cmd, MppParam param) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  switch (cmd) {
+  case MPP_SET_INPUT_BLOCK:
+    input_block = *static_cast<RK_U32 *>(param) != 0;
+    break;
+  case MPP_SET_OUTPUT_TIMEOUT:
+    output_timeout = *static_cast<RK_S32 *>(param);
+    break;
+  case MPP_STUB_SET_LATENCY:
+    latency = std::chrono::microseconds(*static_cast<RK_U32 *>(param));
+    break;
+  case MPP_DEC_SET_PARSER_SPLIT_MODE:
+    if (worker)
+      return MPP_NOK;
+    split_mode = *static_cast<RK_U32 *>(param);
+    break;
+  case MPP_DEC_SET_EXT_BUF_GROUP:
+    frame_group = param ? static_cast<StubGroup *>(param) : own_group;
+    break;
+  case MPP_DEC_SET_INFO_CHANGE_READY:
+    wait_info_change = false;
+    cond.notify_all();
+    break;
+  case MPP_DEC_SET_OUTPUT_FORMAT:
+    if (!get_bits_per_pixel(*static_cast<MppFrameFormat *>(param)))
+      return MPP_ERR_VALUE;
+    output_format = *static_cast<MppFrameFormat *>(param);
+    break;
+  case MPP_ENC_SET_PREP_CFG: {
+    MppEncPrepCfg *cfg = static_cast<MppEncPrepCfg *>(param);
+    if (cfg->change & MPP_ENC_PREP_CFG_CHANGE_INPUT) {
+      prep.width = cfg->width;
+      prep.height = cfg->height;
+      prep.hor_stride = cfg->hor_stride;
+      prep.ver_stride = cfg->ver_stride;
+    }
+    if (cfg->change & MPP_ENC_PREP_CFG_CHANGE_FORMAT) {
+      if (!get_bits_per_pixel(cfg->format))
+        return MPP_ERR_VALUE;
+      prep.format = cfg->format;
+    }
+  } break;
+  case MPP_ENC_SET_RC_CFG: {
+    MppEncRcCfg *cfg = static_cast<MppEncRcCfg *>(param);
+    if (cfg->change & MPP_ENC_RC_CFG_CHANGE_RC_MODE)
+      rc.rc_mode = cfg->rc_mode;
+    if (cfg->change & MPP_ENC_RC_CFG_CHANGE_QUALITY)
+      rc.quality = cfg->quality;
+    if (cfg->change & MPP_ENC_RC_CFG_CHANGE_BPS) {
+      rc.bps_target = cfg->bps_target;
+      rc.bps_max = cfg->bps_max;
+      rc.bps_min = cfg->bps_min;
+    }
+    if (cfg->change & MPP_ENC_RC_CFG_CHANGE_FPS_IN) {
+      rc.fps_in_num = cfg->fps_in_num;
+      rc.fps_in_denorm = cfg->fps_in_denorm;
+    }
+    if (cfg->change & MPP_ENC_RC_CFG_CHANGE_FPS_OUT) {
+      rc.fps_out_num = cfg->fps_out_num;
+      rc.fps_out_denorm = cfg->fps_out_denorm;
+    }
+    if (cfg->change & MPP_ENC_RC_CFG_CHANGE_GOP)
+      rc.gop = cfg->gop;
+  } break;
+  case MPP_ENC_SET_CODEC_CFG: {
+    MppEncCodecCfg *cfg = static_cast<MppEncCodecCfg *>(param);
+    if (coding == MPP_VIDEO_CodingMJPEG) {
+      if (cfg->jpeg.change & MPP_ENC_JPEG_CFG_CHANGE_QP)
+        jpeg_quant = cfg->jpeg.quant;
+      break;
+    }
+    const MppEncH264Cfg &c = cfg->h264;
+    if (c.change & MPP_ENC_H264_CFG_CHANGE_PROFILE) {
+      h264.profile = c.profile;
+      h264.level = c.level;
+    }
+    if (c.change & MPP_ENC_H264_CFG_CHANGE_ENTROPY) {
+      h264.entropy_coding_mode = c.entropy_coding_mode;
+      h264.cabac_init_idc = c.cabac_init_idc;
+    }
+    if (c.change & MPP_ENC_H264_CFG_CHANGE_QP_LIMIT) {
+      h264.qp_init = c.qp_init;
+      h264.qp_min = c.qp_min;
+      h264.qp_max = c.qp_max;
+      h264.qp_max_step = c.qp_max_step;
+    }
+  } break;
+  case MPP_ENC_SET_IDR_FRAME:
+    force_idr = true;
+    break;
+  case MPP_ENC_GET_EXTRA_INFO:
+    *static_cast<MppPacket *>(param) = nullptr;
+    if (coding != MPP_VIDEO_CodingAVC)
+      break;
+    extra_data.clear();
+    WriteH264Headers(extra_data);
+    if (extra_packet)
+      mpp_packet_deinit(&extra_packet);
+    mpp_packet_init(&extra_packet, extra_data.data(), extra_data.size());
+    *static_cast<MppPacket *>(param) = extra_packet;
+    break;
+  case MPP_ENC_SET_QP_RANGE:
+  case MPP_ENC_PRE_ALLOC_BUFF:
+    break;
+  default:
+    LOG("mpp stub: unsupported cmd 0x%08x\n", cmd);
+    return MPP_ERR_VALUE;
+  }
+  return MPP_OK;
+}
+
+MPP_RET StubContext::Poll(MppPortType port, MppPollType timeout) {
+  std::unique_lock<std::mutex> lock(mtx);
+  std::deque<StubTask *> &q =
+      port == MPP_PORT_INPUT ? idle_tasks : output_tasks;
+  return Wait(lock, timeout, [&q] { return !q.empty(); }) ? MPP_OK
+                                                          : MPP_ERR_TIMEOUT;
+}
+
+MPP_RET StubContext::Dequeue(MppPortType port, MppTask *task) {
+  std::lock_guard<std::mutex> _lg(mtx);
+  std::deque<StubTask *> &q =
+      port == MPP_PORT_INPUT ? idle_tasks : output_tasks;
+  *task = nullptr;
+  if (q.empty())
+    return MPP_NOK;
+  *task = q.front();
+  q.pop_front();
+  return MPP_OK;
+}
+
+MPP_RET StubContext::Enqueue(MppPortType port, MppTask task) {
+  StubTask *t = static_cast<StubTask *>(task);
+  std::lock_guard<std::mutex> _lg(mtx);
+  if (port == MPP_PORT_INPUT) {
+    input_tasks.push_back(t);
+  } else {
+    memset(t, 0, sizeof(*t));
+    idle_tasks.push_back(t);
+  }
+  cond.notify_all();
+  return MPP_OK;
+}
+
+MPP_RET StubContext::Reset() {
+  std::lock_guard<std::mutex> _lg(mtx);
+  units.clear();
+  for (MppFrame f : frames)
+    mpp_frame_deinit(&f);
+  frames.clear();
+  if (assembler)
+    assembler->Reset();
+  generation++;
+  cond.notify_all();
+  return MPP_OK;
+}
+
+MPP_RET StubContext::PutPacket(MppPacket packet) {
+  StubPacket *p = static_cast<StubPacket *>(packet);
+  std::unique_lock<std::mutex> lock(mtx);
+  if (type != MPP_CTX_DEC)
+    return MPP_NOK;
+  auto not_full = [this] { return units.size() < kMaxPendingUnits; };
+  if (!Wait(lock, input_block ? MPP_POLL_BLOCK : MPP_POLL_NON_BLOCK,
+            not_full))
+    return MPP_ERR_BUFFER_FULL;
+  if (p->length) {
+    // as the vpu, copy the stream in
+    auto chunk = MediaBuffer::Alloc(p->length);
+    if (!chunk)
+      return MPP_ERR_NOMEM;
+    memcpy(chunk->GetPtr(), p->pos, p->length);
+    chunk->SetValidSize(p->length);
+    chunk->SetTimeStamp(p->pts);
+    if (assembler) {
+      std::list<std::shared_ptr<MediaBuffer>> out;
+      assembler->Push(chunk, out);
+      if (p->eos)
+        assembler->Flush(out);
+      units.insert(units.end(), out.begin(), out.end());
+    } else {
+      units.push_back(chunk);
+    }
+  }
+  if (p->eos) {
+    auto eos = std::make_shared<MediaBuffer>();
+    eos->SetTimeStamp(p->pts);
+    eos->SetEOF(true);
+    units.push_back(eos);
+  }
+  cond.notify_all();
+  return MPP_OK;
+}
+
+MPP_RET StubContext::GetFrame(MppFrame *frame) {
+  std::unique_lock<std::mutex> lock(mtx);
+  *frame = nullptr;
+  if (!Wait(lock, output_timeout, [this] { return !frames.empty(); }))
+    return output_timeout == MPP_POLL_NON_BLOCK ? MPP_OK : MPP_ERR_TIMEOUT;
+  *frame = frames.front();
+  frames.pop_front();
+  return MPP_OK;
+}
+
+void StubContext::Run() {
+  std::unique_lock<std::mutex> lock(mtx);
+  while (!quit) {
+    if (!input_tasks.empty()) {
+      StubTask *task = input_tasks.front();
+      input_tasks.pop_front();
+      auto done = std::chrono::steady_clock::now() + latency;
+      lock.unlock();
+      if (type == MPP_CTX_ENC)
+        Encode(task);
+      else
+        DecodeTask(task);
+      std::this_thread::sleep_until(done);
+      lock.lock();
+      output_tasks.push_back(task);
+      cond.notify_all();
+      continue;
+    }
+    if (!units.empty() && !wait_info_change) {
+      auto unit = units.front();
+      units.pop_front();
+      DecodeUnit(unit, lock);
+      continue;
+    }
+    cond.wait(lock);
+  }
+}
+
+// The stream bytes of a frame: bps / fps, or 1/64 of the luma if the rate is
+// not set; the idr takes 3 times. Jpeg takes quant / 40 of the luma.
+size_t StubContext::GetStreamSize(const StubFrame *f, bool intra) const {
+  size_t luma = (size_t)f->width * f->height;
+  size_t size;
+  if (coding == MPP_VIDEO_CodingMJPEG) {
+    size = luma * jpeg_quant / 40;
+  } else {
+    if (rc.bps_target > 0 && rc.fps_out_num > 0)
+      size = (uint64_t)rc.bps_target * std::max(rc.fps_out_denorm, 1) / 8 /
+             rc.fps_out_num;
+    else
+      size = luma / 64;
+    if (intra)
+      size *= 3;
+  }
+  return std::max<size_t>(size, 16);
+}
+
+void StubContext::WriteH264Headers(std::vector<uint8_t> &out) {
+  int mb_width = (prep.width + 15) / 16, mb_height = (prep.height + 15) / 16;
+  StubBitWriter sps;
+  sps.U(8, h264.profile);
+  sps.U(8, 0); // constraint flags
+  sps.U(8, h264.level);
+  sps.UE(0); // sps_id
+  if (h264.profile >= 100) {
+    sps.UE(1); // chroma_format_idc
+    sps.UE(0); // bit_depth_luma_minus8
+    sps.UE(0); // bit_depth_chroma_minus8
+    sps.U(1, 0);
+    sps.U(1, 0); // seq_scaling_matrix_present_flag
+  }
+  sps.UE(kStubLog2MaxFrameNum - 4);
+  sps.UE(2); // pic_order_cnt_type
+  sps.UE(1); // max_num_ref_frames
+  sps.U(1, 0);
+  sps.UE(std::max(mb_width, 1) - 1);
+  sps.UE(std::max(mb_height, 1) - 1);
+  sps.U(1, 1); // frame_mbs_only_flag
+  sps.U(1, 1); // direct_8x8_inference_flag
+  int crop_right = (mb_width * 16 - prep.width) / 2;
+  int crop_bottom = (mb_height * 16 - prep.height) / 2;
+  sps.U(1, crop_right || crop_bottom);
+  if (crop_right || crop_bottom) {
+    sps.UE(0);
+    sps.UE(crop_right);
+    sps.UE(0);
+    sps.UE(crop_bottom);
+  }
+  sps.U(1, 0); // vui_parameters_present_flag
+  sps.TrailingBits();
+  sps.Output(0x67, out);
+
+  StubBitWriter pps;
+  pps.UE(0); // pps_id
+  pps.UE(0); // sps_id
+  pps.U(1, h264.entropy_coding_mode);
+  pps.U(1, 0);
+  pps.UE(0); // num_slice_groups_minus1
+  pps.UE(0);
+  pps.UE(0);
+  pps.U(1, 0);
+  pps.U(2, 0);
+  pps.SE(h264.qp_init - 26);
+  pps.SE(0);
+  pps.SE(0);
+  pps.U(1, 0); // deblocking_filter_control_present_flag
+  pps.U(1, 0);
+  pps.U(1, 0);
+  pps.TrailingBits();
+  pps.Output(0x68, out);
+}
+
+void StubContext::Encode(StubTask *task) {
+  StubFrame *f = static_cast<StubFrame *>(task->input_frame);
+  StubPacket *pkt = static_cast<StubPacket *>(task->output_packet);
+  std::vector<uint8_t> head, tail;
+  size_t size = 0;
+  uint32_t seed = 0;
+  bool intra = false;
+  // restored if the frame overflows the packet buffer
+  RK_S32 last_gop_index = 0;
+  uint32_t last_frame_index = 0;
+  bool last_force_idr = false;
+  if (f && f->buffer) {
+    {
+      std::lock_guard<std::mutex> _lg(mtx);
+      last_gop_index = gop_index;
+      last_frame_index = frame_index;
+      last_force_idr = force_idr;
+      intra = force_idr || coding == MPP_VIDEO_CodingMJPEG || !gop_index;
+      if (intra && coding == MPP_VIDEO_CodingAVC)
+        gop_index = 0;
+      force_idr = false;
+    }
+    seed = hash_frame(f) ^ (frame_index * 0x9E3779B9u);
+    if (!seed)
+      seed = 1;
+    if (coding == MPP_VIDEO_CodingAVC) {
+      StubBitWriter slice;
+      slice.UE(0);             // first_mb_in_slice
+      slice.UE(intra ? 7 : 5); // all I or P
+      slice.UE(0);             // pps_id
+      slice.U(kStubLog2MaxFrameNum, gop_index & 15);
+      if (intra)
+        slice.UE(0); // idr_pic_id
+      else
+        slice.U(2, 0); // no ref override, no ref list modification
+      slice.U(2, 0); // dec_ref_pic_marking
+      if (!intra && h264.entropy_coding_mode)
+        slice.UE(h264.cabac_init_idc);
+      slice.SE(0); // slice_qp_delta
+      slice.AlignWithOnes();
+      slice.Output(intra ? 0x65 : 0x41, head);
+    } else {
+      head.assign(kJpegHead, kJpegHead + sizeof(kJpegHead));
+      head[7] = f->height >> 8;
+      head[8] = f->height & 0xFF;
+      head[9] = f->width >> 8;
+      head[10] = f->width & 0xFF;
+      tail = {0xFF, 0xD9};
+    }
+    size = head.size() + GetStreamSize(f, intra) + tail.size();
+    if (gop_index + 1 >= rc.gop && rc.gop > 0)
+      gop_index = 0;
+    else
+      gop_index++;
+    frame_index++;
+  }
+  if (!pkt) {
+    StubBuffer *b = nullptr;
+    MppPacket packet = nullptr;
+    if (get_buffer(nullptr, &b, std::max<size_t>(size, 1)))
+      return;
+    mpp_packet_init_with_buffer(&packet, b);
+    mpp_buffer_put(b);
+    task->output_packet = packet;
+    pkt = static_cast<StubPacket *>(packet);
+  }
+  pkt->length = 0;
+  pkt->flag = intra ? STUB_PACKET_FLAG_INTRA : 0;
+  pkt->eos = f ? f->eos : 1;
+  pkt->pts = f ? f->pts : 0;
+  pkt->dts = f ? f->dts : 0;
+  if (!size)
+    return;
+  if (pkt->size < size) {
+    LOG("mpp stub: packet buffer %zu too small for %zu\n", pkt->size, size);
+    std::lock_guard<std::mutex> _lg(mtx);
+    gop_index = last_gop_index;
+    frame_index = last_frame_index;
+    force_idr = force_idr || last_force_idr;
+    return;
+  }
+  uint8_t *p = static_cast<uint8_t *>(pkt->data);
+  memcpy(p, head.data(), head.size());
+  p += head.size();
+  uint8_t *end = p + size - head.size() - tail.size();
+  if (coding == MPP_VIDEO_CodingAVC) {
+    // no zero bytes, no emulation prevention
+    while (p < end)
+      *p++ = 4 + xorshift32(seed) % 252;
+  } else {
+    while (p < end)
+      *p++ = xorshift32(seed) % 255; // no markers
+  }
+  if (!tail.empty())
+    memcpy(p, tail.data(), tail.size());
+  pkt->pos = pkt->data;
+  pkt->length = size;
+  if (task->motion_info) {
+    StubBuffer *mv = static_cast<StubBuffer *>(task->motion_info);
+    memset(mv->ptr, seed & 0xFF, mv->size);
+  }
+}
+
+static bool get_jpeg_size(const uint8_t *p, size_t size, RK_U32 &w,
+                          RK_U32 &h) {
+  size_t pos = 2;
+  if (size < 4 || p[0] != 0xFF || p[1] != 0xD8)
+    return false;
+  while (pos + 4 <= size && p[pos] == 0xFF) {
+    uint8_t marker = p[pos + 1];
+    size_t len = (p[pos + 2] << 8) | p[pos + 3];
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+        marker != 0xC8 && marker != 0xCC) {
+      if (pos + 9 > size)
+        return false;
+      h = (p[pos + 5] << 8) | p[pos + 6];
+      w = (p[pos + 7] << 8) | p[pos + 8];
+      return w && h;
+    }
+    if (marker == 0xDA || len < 2)
+      return false;
+    pos += 2 + len;
+  }
+  return false;
+}
+
+bool StubContext::GetPictureSize(const uint8_t *data, size_t size, RK_U32 &w,
+                                 RK_U32 &h) {
+  if (coding == MPP_VIDEO_CodingMJPEG)
+    return get_jpeg_size(data, size, w, h);
+  std::vector<StartCodePos> pos;
+  FindAllStartCodes(data, size, pos);
+  for (size_t i = 0; i < pos.size(); i++) {
+    size_t begin = pos[i].offset + pos[i].size;
+    size_t end = i + 1 < pos.size() ? pos[i + 1].offset : size;
+    NalUnitInfo info;
+    parser->Parse(data + begin, end - begin, info);
+  }
+  StreamInfo info;
+  if (!parser->GetStreamInfo(info))
+    return false;
+  w = info.width;
+  h = info.height;
+  return true;
+}
+
+MppFrame StubContext::NewFrame(RK_U32 w, RK_U32 h) {
+  MppFrame frame = nullptr;
+  if (mpp_frame_init(&frame))
+    return nullptr;
+  StubFrame *f = static_cast<StubFrame *>(frame);
+  f->width = w;
+  f->height = h;
+  f->hor_stride = UPALIGNTO16(w);
+  f->ver_stride = UPALIGNTO16(h);
+  f->fmt = coding == MPP_VIDEO_CodingMJPEG ? output_format : MPP_FMT_YUV420SP;
+  return frame;
+}
+
+static void fill_frame(StubFrame *f, uint8_t luma) {
+  uint8_t *p = static_cast<uint8_t *>(f->buffer->ptr);
+  size_t size = (size_t)f->hor_stride * f->ver_stride *
+                get_bits_per_pixel(f->fmt) / 8;
+  size_t luma_size = is_packed(f->fmt) || f->fmt == MPP_FMT_YUV400
+                         ? size
+                         : (size_t)f->hor_stride * f->ver_stride;
+  memset(p, luma, luma_size);
+  memset(p + luma_size, 0x80, size - luma_size);
+}
+
+static size_t get_frame_size(const StubFrame *f) {
+  return (size_t)f->hor_stride * f->ver_stride * get_bits_per_pixel(f->fmt) /
+         8;
+}
+
+void StubContext::DecodeTask(StubTask *task) {
+  StubPacket *pkt = static_cast<StubPacket *>(task->input_packet);
+  StubFrame *f = static_cast<StubFrame *>(task->output_frame);
+  if (!f)
+    return;
+  const uint8_t *data = static_cast<const uint8_t *>(pkt->pos);
+  RK_U32 w = 0, h = 0;
+  StubBuffer *b = f->buffer;
+  f->eos = pkt->eos;
+  f->pts = pkt->pts;
+  if (!pkt->length || !GetPictureSize(data, pkt->length, w, h)) {
+    f->errinfo = 1;
+    return;
+  }
+  MppFrame tmp = NewFrame(w, h);
+  StubFrame *t = static_cast<StubFrame *>(tmp);
+  f->width = t->width;
+  f->height = t->height;
+  f->hor_stride = t->hor_stride;
+  f->ver_stride = t->ver_stride;
+  f->fmt = t->fmt;
+  mpp_frame_deinit(&tmp);
+  if (!b || b->size < get_frame_size(f)) {
+    f->errinfo = 1;
+    return;
+  }
+  fill_frame(f, fnv1a(kFnvBasis, data, pkt->length) & 0xFF);
+}
+
+// called and return with the lock held
+void StubContext::DecodeUnit(std::shared_ptr<MediaBuffer> unit,
+                             std::unique_lock<std::mutex> &lock) {
+  uint32_t gen = generation;
+  MppFrame frame = nullptr;
+  if (!unit->GetValidSize()) {
+    if (unit->IsEOF() && !mpp_frame_init(&frame)) {
+      mpp_frame_set_pts(frame, unit->GetTimeStamp());
+      mpp_frame_set_eos(frame, 1);
+      frames.push_back(frame);
+      cond.notify_all();
+    }
+    return;
+  }
+  lock.unlock();
+  auto done = std::chrono::steady_clock::now() + latency;
+  const uint8_t *data = static_cast<const uint8_t *>(unit->GetPtr());
+  RK_U32 w = 0, h = 0;
+  if (!GetPictureSize(data, unit->GetValidSize(), w, h)) {
+    // no picture before the first sps, as the vpu
+    lock.lock();
+    return;
+  }
+  if (w != width || h != height) {
+    lock.lock();
+    width = w;
+    height = h;
+    frame = NewFrame(w, h);
+    if (frame) {
+      static_cast<StubFrame *>(frame)->info_change = 1;
+      frames.push_back(frame);
+    }
+    wait_info_change = true;
+    units.push_front(unit);
+    cond.notify_all();
+    return;
+  }
+  frame = NewFrame(w, h);
+  StubFrame *f = static_cast<StubFrame *>(frame);
+  StubBuffer *b = nullptr;
+  while (frame) {
+    StubGroup *group = frame_group;
+    MPP_RET ret = get_buffer(group, &b, get_frame_size(f));
+    if (ret != MPP_ERR_NOMEM)
+      break;
+    // wait for a frame back to the group
+    std::unique_lock<std::mutex> glock(group->mtx);
+    group->cond.wait_for(glock, std::chrono::milliseconds(100), [&] {
+      return quit || (group->external ? !group->unused.empty()
+                                      : group->count < group->limit);
+    });
+    if (quit)
+      break;
+  }
+  if (b) {
+    f->buffer = b;
+    fill_frame(f, fnv1a(kFnvBasis, data, unit->GetValidSize()) & 0xFF);
+    f->pts = unit->GetTimeStamp();
+    std::this_thread::sleep_until(done);
+  }
+  lock.lock();
+  if (!b || gen != generation) {
+    if (frame)
+      mpp_frame_deinit(&frame);
+    return;
+  }
+  frames.push_back(frame);
+  cond.notify_all();
+}
+
+} // namespace easymedia
+
+using namespace easymedia;
+
+MPP_RET mpp_create(MppCtx *ctx, MppApi **mpi) {
+  if (!ctx || !mpi)
+    return MPP_ERR_NULL_PTR;
+  StubContext *c = new StubContext();
+  *ctx = c;
+  *mpi = &c->api;
+  return MPP_OK;
+}
+
+MPP_RET mpp_init(MppCtx ctx, MppCtxType type, MppCodingType coding) {
+  if (!ctx)
+    return MPP_ERR_NULL_PTR;
+  return static_cast<StubContext *>(ctx)->Init(type, coding);
+}
+
+MPP_RET mpp_destroy(MppCtx ctx) {
+  delete static_cast<StubContext *>(ctx);
+  return MPP_OK;
+}
+
+MPP_RET mpp_buffer_get(MppBufferGroup group, MppBuffer *buffer, size_t size) {
+  if (!buffer || !size)
+    return MPP_ERR_VALUE;
+  StubBuffer *b = nullptr;
+  MPP_RET ret = get_buffer(static_cast<StubGroup *>(group), &b, size);
+  *buffer = b;
+  return ret;
+}
+
+static StubBuffer *import_buffer(MppBufferInfo *info) {
+  StubBuffer *b = new StubBuffer();
+  b->size = info->size;
+  if (info->fd >= 0) {
+    b->fd = dup(info->fd);
+    if (b->fd < 0) {
+      delete b;
+      return nullptr;
+    }
+  }
+  b->ptr = info->ptr;
+  if (!b->ptr) {
+    void *ptr = mmap(nullptr, b->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     b->fd, 0);
+    if (ptr == MAP_FAILED) {
+      LOG("mpp stub: mmap fd %d failed, %m\n", info->fd);
+      close(b->fd);
+      delete b;
+      return nullptr;
+    }
+    b->ptr = ptr;
+    b->map_size = b->size;
+  }
+  return b;
+}
+
+MPP_RET mpp_buffer_import(MppBuffer *buffer, MppBufferInfo *info) {
+  if (!buffer || !info || !info->size || (info->fd < 0 && !info->ptr))
+    return MPP_ERR_VALUE;
+  StubBuffer *b = import_buffer(info);
+  if (!b)
+    return MPP_NOK;
+  *buffer = b;
+  return MPP_OK;
+}
+
+MPP_RET mpp_buffer_commit(MppBufferGroup group, MppBufferInfo *info) {
+  StubGroup *g = static_cast<StubGroup *>(group);
+  if (!g || !g->external || !info || !info->size ||
+      (info->fd < 0 && !info->ptr))
+    return MPP_ERR_VALUE;
+  StubBuffer *b = import_buffer(info);
+  if (!b)
+    return MPP_NOK;
+  b->index = info->index;
+  b->group = g;
+  std::lock_guard<std::mutex> _lg(g->mtx);
+  b->generation = g->generation;
+  g->unused.push_back(b);
+  g->cond.notify_all();
+  return MPP_OK;
+}
+
+MPP_RET mpp_buffer_put(MppBuffer buffer) {
+  StubBuffer *b = static_cast<StubBuffer *>(buffer);
+  if (!b)
+    return MPP_ERR_NULL_PTR;
+  if (--b->ref == 0)
+    free_buffer(b);
+  return MPP_OK;
+}
+
+MPP_RET mpp_buffer_inc_ref(MppBuffer buffer) {
+  if (!buffer)
+    return MPP_ERR_NULL_PTR;
+  static_cast<StubBuffer *>(buffer)->ref++;
+  return MPP_OK;
+}
+
+void *mpp_buffer_get_ptr(MppBuffer buffer) {
+  return buffer ? static_cast<StubBuffer *>(buffer)->ptr : nullptr;
+}
+
+int mpp_buffer_get_fd(MppBuffer buffer) {
+  return buffer ? static_cast<StubBuffer *>(buffer)->fd : -1;
+}
+
+size_t mpp_buffer_get_size(MppBuffer buffer) {
+  return buffer ? static_cast<StubBuffer *>(buffer)->size : 0;
+}
+
+int mpp_buffer_get_index(MppBuffer buffer) {
+  return buffer ? static_cast<StubBuffer *>(buffer)->index : -1;
+}
+
+MPP_RET mpp_buffer_group_get_internal(MppBufferGroup *group,
+                                      MppBufferType type _UNUSED) {
+  if (!group)
+    return MPP_ERR_NULL_PTR;
+  *group = new StubGroup();
+  return MPP_OK;
+}
+
+MPP_RET mpp_buffer_group_get_external(MppBufferGroup *group,
+                                      MppBufferType type _UNUSED) {
+  if (!group)
+    return MPP_ERR_NULL_PTR;
+  StubGroup *g = new StubGroup();
+  g->external = true;
+  *group = g;
+  return MPP_OK;
+}
+
+MPP_RET mpp_buffer_group_clear(MppBufferGroup group) {
+  StubGroup *g = static_cast<StubGroup *>(group);
+  if (!g)
+    return MPP_ERR_NULL_PTR;
+  std::lock_guard<std::mutex> _lg(g->mtx);
+  for (StubBuffer *b : g->unused)
+    destroy_buffer(b);
+  g->unused.clear();
+  g->generation++;
+  return MPP_OK;
+}
+
+MPP_RET mpp_buffer_group_limit_config(MppBufferGroup group,
+                                      size_t size _UNUSED, RK_S32 count) {
+  StubGroup *g = static_cast<StubGroup *>(group);
+  if (!g)
+    return MPP_ERR_NULL_PTR;
+  std::lock_guard<std::mutex> _lg(g->mtx);
+  g->limit = count;
+  g->cond.notify_all();
+  return MPP_OK;
+}
+
+MPP_RET mpp_buffer_group_put(MppBufferGroup group) {
+  if (!group)
+    return MPP_ERR_NULL_PTR;
+  release_group(static_cast<StubGroup *>(group));
+  return MPP_OK;
+}
+
+MPP_RET mpp_frame_init(MppFrame *frame) {
+  if (!frame)
+    return MPP_ERR_NULL_PTR;
+  StubFrame *f = static_cast<StubFrame *>(calloc(1, sizeof(StubFrame)));
+  if (!f)
+    return MPP_ERR_MALLOC;
+  *frame = f;
+  return MPP_OK;
+}
+
+MPP_RET mpp_frame_deinit(MppFrame *frame) {
+  if (!frame || !*frame)
+    return MPP_ERR_NULL_PTR;
+  StubFrame *f = static_cast<StubFrame *>(*frame);
+  if (f->buffer)
+    mpp_buffer_put(f->buffer);
+  free(f);
+  *frame = nullptr;
+  return MPP_OK;
+}
+
+#define STUB_FRAME_ACCESSOR(type, field)                                      \
+  type mpp_frame_get_##field(const MppFrame frame) {                          \
+    return static_cast<StubFrame *>(frame)->field;                            \
+  }                                                                            \
+  void mpp_frame_set_##field(MppFrame frame, type v) {                        \
+    static_cast<StubFrame *>(frame)->field = v;                               \
+  }
+
+STUB_FRAME_ACCESSOR(RK_U32, width)
+STUB_FRAME_ACCESSOR(RK_U32, height)
+STUB_FRAME_ACCESSOR(RK_U32, hor_stride)
+STUB_FRAME_ACCESSOR(RK_U32, ver_stride)
+STUB_FRAME_ACCESSOR(MppFrameFormat, fmt)
+STUB_FRAME_ACCESSOR(RK_S64, pts)
+STUB_FRAME_ACCESSOR(RK_S64, dts)
+STUB_FRAME_ACCESSOR(RK_U32, eos)
+
+RK_U32 mpp_frame_get_info_change(const MppFrame frame) {
+  return static_cast<StubFrame *>(frame)->info_change;
+}
+
+RK_U32 mpp_frame_get_discard(const MppFrame frame) {
+  return static_cast<StubFrame *>(frame)->discard;
+}
+
+RK_U32 mpp_frame_get_errinfo(const MppFrame frame) {
+  return static_cast<StubFrame *>(frame)->errinfo;
+}
+
+MppBuffer mpp_frame_get_buffer(const MppFrame frame) {
+  return static_cast<StubFrame *>(frame)->buffer;
+}
+
+void mpp_frame_set_buffer(MppFrame frame, MppBuffer buffer) {
+  StubFrame *f = static_cast<StubFrame *>(frame);
+  if (f->buffer == buffer)
+    return;
+  if (buffer)
+    mpp_buffer_inc_ref(buffer);
+  if (f->buffer)
+    mpp_buffer_put(f->buffer);
+  f->buffer = static_cast<StubBuffer *>(buffer);
+}
+
+MPP_RET mpp_packet_init(MppPacket *packet, void *data, size_t size) {
+  if (!packet)
+    return MPP_ERR_NULL_PTR;
+  StubPacket *p = static_cast<StubPacket *>(calloc(1, sizeof(StubPacket)));
+  if (!p)
+    return MPP_ERR_MALLOC;
+  p->data = p->pos = data;
+  p->size = p->length = size;
+  *packet = p;
+  return MPP_OK;
+}
+
+MPP_RET mpp_packet_init_with_buffer(MppPacket *packet, MppBuffer buffer) {
+  if (!buffer)
+    return MPP_ERR_NULL_PTR;
+  MPP_RET ret = mpp_packet_init(packet, mpp_buffer_get_ptr(buffer),
+                                mpp_buffer_get_size(buffer));
+  if (ret)
+    return ret;
+  mpp_buffer_inc_ref(buffer);
+  static_cast<StubPacket *>(*packet)->buffer =
+      static_cast<StubBuffer *>(buffer);
+  return MPP_OK;
+}
+
+MPP_RET mpp_packet_deinit(MppPacket *packet) {
+  if (!packet || !*packet)
+    return MPP_ERR_NULL_PTR;
+  StubPacket *p = static_cast<StubPacket *>(*packet);
+  if (p->buffer)
+    mpp_buffer_put(p->buffer);
+  free(p);
+  *packet = nullptr;
+  return MPP_OK;
+}
+
+void *mpp_packet_get_data(const MppPacket packet) {
+  return static_cast<StubPacket *>(packet)->data;
+}
+
+size_t mpp_packet_get_size(const MppPacket packet) {
+  return static_cast<StubPacket *>(packet)->size;
+}
+
+void *mpp_packet_get_pos(const MppPacket packet) {
+  return static_cast<StubPacket *>(packet)->pos;
+}
+
+size_t mpp_packet_get_length(const MppPacket packet) {
+  return static_cast<StubPacket *>(packet)->length;
+}
+
+void mpp_packet_set_length(MppPacket packet, size_t length) {
+  static_cast<StubPacket *>(packet)->length = length;
+}
+
+RK_S64 mpp_packet_get_pts(const MppPacket packet) {
+  return static_cast<StubPacket *>(packet)->pts;
+}
+
+void mpp_packet_set_pts(MppPacket packet, RK_S64 pts) {
+  static_cast<StubPacket *>(packet)->pts = pts;
+}
+
+RK_S64 mpp_packet_get_dts(const MppPacket packet) {
+  return static_cast<StubPacket *>(packet)->dts;
+}
+
+RK_U32 mpp_packet_get_eos(MppPacket packet) {
+  return static_cast<StubPacket *>(packet)->eos;
+}
+
+MPP_RET mpp_packet_set_eos(MppPacket packet) {
+  static_cast<StubPacket *>(packet)->eos = 1;
+  return MPP_OK;
+}
+
+RK_U32 mpp_packet_get_flag(const MppPacket packet) {
+  return static_cast<StubPacket *>(packet)->flag;
+}
+
+MppBuffer mpp_packet_get_buffer(const MppPacket packet) {
+  return static_cast<StubPacket *>(packet)->buffer;
+}
+
+#define STUB_TASK_META(type, Name, ...)                                        \
+  MPP_RET mpp_task_meta_set_##Name(MppTask task, MppMetaKey key, type v) {     \
+    StubTask *t = static_cast<StubTask *>(task);                               \
+    type *slot = nullptr;                                                      \
+    __VA_ARGS__                                                                \
+    if (!slot)                                                                 \
+      return MPP_ERR_VALUE;                                                    \
+    *slot = v;                                                                 \
+    return MPP_OK;                                                             \
+  }                                                                            \
+  MPP_RET mpp_task_meta_get_##Name(MppTask task, MppMetaKey key, type *v) {    \
+    StubTask *t = static_cast<StubTask *>(task);                               \
+    type *slot = nullptr;                                                      \
+    __VA_ARGS__                                                                \
+    if (!slot)                                                                 \
+      return MPP_ERR_VALUE;                                                    \
+    *v = *slot;                                                                \
+    return MPP_OK;                                                             \
+  }
+
+STUB_TASK_META(MppFrame, frame,
+               if (key == KEY_INPUT_FRAME) slot = &t->input_frame;
+               else if (key == KEY_OUTPUT_FRAME) slot = &t->output_frame;)
+STUB_TASK_META(MppPacket, packet,
+               if (key == KEY_INPUT_PACKET) slot = &t->input_packet;
+               else if (key == KEY_OUTPUT_PACKET) slot = &t->output_packet;)
+STUB_TASK_META(MppBuffer, buffer,
+               if (key == KEY_MOTION_INFO) slot = &t->motion_info;)
@@ -0,0 +1,394 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+// A stand-in of the vendor rk_mpi.h. It declares the subset of the mpp api
+// which the rkmpp wrapper uses, implemented in-process by mpp_stub.cc, so
+// that the wrapper can be built and exercised without the vendor library
+// and a vpu. Only the names are kept, the values and layouts are not the
+// vendor's ones; never mix it with the real library.
+//
+// The stand-in produces bit-exact outputs:
+//  * the h264 encoder writes a sps/pps as extra info and one slice per
+//    frame, idr by the gop; the slice data are bytes of a xorshift32 seeded
+//    by the frame number and the fnv-1a hash of every 16th luma row;
+//  * the jpeg encoder writes soi, sof0, sos, the same kind of entropy bytes
+//    and eoi;
+//  * a frame overflowing the given packet buffer gives an empty packet, still
+//    flagged intra if so, and is not counted, so encoding it again gives the
+//    same bytes;
+//  * the decoders output a info change frame first, then frames whose luma
+//    bytes are the low byte of the fnv-1a hash of the input access unit and
+//    chroma bytes are 0x80.
+// Each frame takes a fixed time on the stand-in vpu, which is 0 by default
+// and set by the MPP_STUB_LATENCY_US environment variable or by the
+// MPP_STUB_SET_LATENCY command (RK_U32 microseconds).
+
+#ifndef EASYMEDIA_RKMPP_STUB_RK_MPI_H_
+#define EASYMEDIA_RKMPP_STUB_RK_MPI_H_
+
+#include <stddef.h>
+
+#define MPP_STUB 1
+
+#define MPP_STUB_API __attribute__((visibility("default")))
+
+typedef unsigned char RK_U8;
+typedef unsigned short RK_U16;
+typedef unsigned int RK_U32;
+typedef unsigned long long RK_U64;
+typedef signed char RK_S8;
+typedef short RK_S16;
+typedef int RK_S32;
+typedef long long RK_S64;
+
+typedef void *MppCtx;
+typedef void *MppParam;
+typedef void *MppFrame;
+typedef void *MppPacket;
+typedef void *MppBuffer;
+typedef void *MppBufferGroup;
+typedef void *MppTask;
+
+typedef enum {
+  MPP_OK = 0,
+  MPP_NOK = -1,
+  MPP_ERR_UNKNOW = -2,
+  MPP_ERR_NULL_PTR = -3,
+  MPP_ERR_MALLOC = -4,
+  MPP_ERR_VALUE = -6,
+  MPP_ERR_TIMEOUT = -8,
+  MPP_ERR_INIT = -1002,
+  MPP_ERR_NOMEM = -1006,
+  MPP_ERR_BUFFER_FULL = -1012,
+} MPP_RET;
+
+typedef enum {
+  MPP_CTX_DEC,
+  MPP_CTX_ENC,
+  MPP_CTX_BUTT,
+} MppCtxType;
+
+typedef enum {
+  MPP_VIDEO_CodingUnused,
+  MPP_VIDEO_CodingAutoDetect,
+  MPP_VIDEO_CodingAVC = 7,
+  MPP_VIDEO_CodingMJPEG = 8,
+  MPP_VIDEO_CodingHEVC = 0x1000004,
+} MppCodingType;
+
+typedef enum {
+  MPP_FMT_YUV420SP = 0,
+  MPP_FMT_YUV420SP_10BIT,
+  MPP_FMT_YUV422SP,
+  MPP_FMT_YUV422SP_10BIT,
+  MPP_FMT_YUV420P,
+  MPP_FMT_YUV420SP_VU,
+  MPP_FMT_YUV422P,
+  MPP_FMT_YUV422SP_VU,
+  MPP_FMT_YUV422_YUYV,
+  MPP_FMT_YUV422_YVYU,
+  MPP_FMT_YUV422_UYVY,
+  MPP_FMT_YUV422_VYUY,
+  MPP_FMT_YUV400,
+  MPP_FMT_YUV440SP,
+  MPP_FMT_YUV411SP,
+  MPP_FMT_YUV444SP,
+  MPP_FMT_YUV_BUTT,
+  MPP_FMT_RGB565 = 0x10000,
+  MPP_FMT_BGR565,
+  MPP_FMT_RGB555,
+  MPP_FMT_BGR555,
+  MPP_FMT_RGB444,
+  MPP_FMT_BGR444,
+  MPP_FMT_RGB888,
+  MPP_FMT_BGR888,
+  MPP_FMT_RGB101010,
+  MPP_FMT_BGR101010,
+  MPP_FMT_ARGB8888,
+  MPP_FMT_ABGR8888,
+  MPP_FMT_RGB_BUTT,
+} MppFrameFormat;
+
+typedef enum {
+  MPP_BUFFER_TYPE_NORMAL,
+  MPP_BUFFER_TYPE_ION,
+  MPP_BUFFER_TYPE_EXT_DMA,
+  MPP_BUFFER_TYPE_DRM,
+  MPP_BUFFER_TYPE_BUTT,
+} MppBufferType;
+
+typedef struct {
+  MppBufferType type;
+  size_t size;
+  void *ptr;
+  void *hnd;
+  int fd;
+  int index;
+} MppBufferInfo;
+
+typedef enum {
+  MPP_PORT_INPUT,
+  MPP_PORT_OUTPUT,
+  MPP_PORT_BUTT,
+} MppPortType;
+
+// a positive value is the timeout in milliseconds
+typedef enum {
+  MPP_POLL_BUTT = -2,
+  MPP_POLL_BLOCK = -1,
+  MPP_POLL_NON_BLOCK = 0,
+  MPP_POLL_MAX = 8000,
+} MppPollType;
+
+#define MPP_META_KEY(a, b, c, d)                                              \
+  ((RK_U32)(a) << 24 | (RK_U32)(b) << 16 | (RK_U32)(c) << 8 | (RK_U32)(d))
+
+typedef enum {
+  KEY_INPUT_FRAME = MPP_META_KEY('i', 'f', 'r', 'm'),
+  KEY_INPUT_PACKET = MPP_META_KEY('i', 'p', 'k', 't'),
+  KEY_OUTPUT_FRAME = MPP_META_KEY('o', 'f', 'r', 'm'),
+  KEY_OUTPUT_PACKET = MPP_META_KEY('o', 'p', 'k', 't'),
+  KEY_MOTION_INFO = MPP_META_KEY('m', 'v', 'i', 'f'),
+} MppMetaKey;
+
+typedef enum {
+  MPP_CMD_BASE = 0,
+  MPP_SET_INPUT_BLOCK,
+  MPP_SET_OUTPUT_TIMEOUT,
+  MPP_DEC_SET_EXT_BUF_GROUP = 0x310000,
+  MPP_DEC_SET_INFO_CHANGE_READY,
+  MPP_DEC_SET_OUTPUT_FORMAT,
+  MPP_DEC_SET_PARSER_SPLIT_MODE,
+  MPP_ENC_SET_RC_CFG = 0x320000,
+  MPP_ENC_SET_PREP_CFG,
+  MPP_ENC_SET_CODEC_CFG,
+  MPP_ENC_SET_IDR_FRAME,
+  MPP_ENC_SET_QP_RANGE,
+  MPP_ENC_GET_EXTRA_INFO,
+  MPP_ENC_PRE_ALLOC_BUFF,
+  MPP_STUB_SET_LATENCY = 0x7f0000,
+} MpiCmd;
+
+// encoder configs, only the fields marked by the change flags are applied
+
+#define MPP_ENC_RC_CFG_CHANGE_RC_MODE (0x00000001)
+#define MPP_ENC_RC_CFG_CHANGE_QUALITY (0x00000002)
+#define MPP_ENC_RC_CFG_CHANGE_BPS (0x00000004)
+#define MPP_ENC_RC_CFG_CHANGE_FPS_IN (0x00000020)
+#define MPP_ENC_RC_CFG_CHANGE_FPS_OUT (0x00000040)
+#define MPP_ENC_RC_CFG_CHANGE_GOP (0x00000080)
+#define MPP_ENC_RC_CFG_CHANGE_SKIP_CNT (0x00000100)
+#define MPP_ENC_RC_CFG_CHANGE_ALL (0xFFFFFFFF)
+
+typedef enum {
+  MPP_ENC_RC_MODE_VBR,
+  MPP_ENC_RC_MODE_CBR,
+  MPP_ENC_RC_MODE_BUTT,
+} MppEncRcMode;
+
+typedef enum {
+  MPP_ENC_RC_QUALITY_CQP,
+  MPP_ENC_RC_QUALITY_WORST,
+  MPP_ENC_RC_QUALITY_WORSE,
+  MPP_ENC_RC_QUALITY_MEDIUM,
+  MPP_ENC_RC_QUALITY_BETTER,
+  MPP_ENC_RC_QUALITY_BEST,
+  MPP_ENC_RC_QUALITY_AQ_ONLY,
+  MPP_ENC_RC_QUALITY_BUTT,
+} MppEncRcQuality;
+
+typedef struct {
+  RK_U32 change;
+  MppEncRcMode rc_mode;
+  MppEncRcQuality quality;
+  RK_S32 bps_target;
+  RK_S32 bps_max;
+  RK_S32 bps_min;
+  RK_S32 fps_in_flex;
+  RK_S32 fps_in_num;
+  RK_S32 fps_in_denorm;
+  RK_S32 fps_out_flex;
+  RK_S32 fps_out_num;
+  RK_S32 fps_out_denorm;
+  RK_S32 gop;
+  RK_S32 skip_cnt;
+} MppEncRcCfg;
+
+#define MPP_ENC_PREP_CFG_CHANGE_INPUT (0x00000001)
+#define MPP_ENC_PREP_CFG_CHANGE_FORMAT (0x00000004)
+
+typedef struct {
+  RK_U32 change;
+  RK_S32 width;
+  RK_S32 height;
+  RK_S32 hor_stride; // in bytes for the packed yuv formats, else pixels
+  RK_S32 ver_stride;
+  MppFrameFormat format;
+} MppEncPrepCfg;
+
+#define MPP_ENC_H264_CFG_CHANGE_PROFILE (0x00000001)
+#define MPP_ENC_H264_CFG_CHANGE_ENTROPY (0x00000002)
+#define MPP_ENC_H264_CFG_CHANGE_QP_LIMIT (0x00000200)
+
+typedef struct {
+  RK_U32 change;
+  RK_S32 profile;
+  RK_S32 level;
+  RK_S32 entropy_coding_mode;
+  RK_S32 cabac_init_idc;
+  RK_S32 qp_init;
+  RK_S32 qp_max;
+  RK_S32 qp_min;
+  RK_S32 qp_max_step;
+} MppEncH264Cfg;
+
+#define MPP_ENC_JPEG_CFG_CHANGE_QP (0x00000001)
+
+typedef struct {
+  RK_U32 change;
+  RK_S32 quant; // 1 ~ 10
+} MppEncJpegCfg;
+
+typedef struct {
+  MppCodingType coding;
+  union {
+    RK_U32 change;
+    MppEncH264Cfg h264;
+    MppEncJpegCfg jpeg;
+  };
+} MppEncCodecCfg;
+
+typedef struct {
+  MppEncPrepCfg prep;
+  MppEncRcCfg rc;
+  MppEncCodecCfg codec;
+} MppEncCfgSet;
+
+typedef struct {
+  RK_U32 size;
+  RK_U32 version;
+  MPP_RET (*decode_put_packet)(MppCtx ctx, MppPacket packet);
+  MPP_RET (*decode_get_frame)(MppCtx ctx, MppFrame *frame);
+  MPP_RET (*poll)(MppCtx ctx, MppPortType type, MppPollType timeout);
+  MPP_RET (*dequeue)(MppCtx ctx, MppPortType type, MppTask *task);
+  MPP_RET (*enqueue)(MppCtx ctx, MppPortType type, MppTask task);
+  MPP_RET (*reset)(MppCtx ctx);
+  MPP_RET (*control)(MppCtx ctx, MpiCmd cmd, MppParam param);
+} MppApi;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+MPP_STUB_API MPP_RET mpp_create(MppCtx *ctx, MppApi **mpi);
+MPP_STUB_API MPP_RET mpp_init(MppCtx ctx, MppCtxType type,
+                              MppCodingType coding);
+MPP_STUB_API MPP_RET mpp_destroy(MppCtx ctx);
+
+// The buffers from the stand-in are memfd backed, so they have fds as the
+// ion ones. An imported fd is dup-ed and mapped unless the ptr is given.
+MPP_STUB_API MPP_RET mpp_buffer_get(MppBufferGroup group, MppBuffer *buffer,
+                                    size_t size);
+MPP_STUB_API MPP_RET mpp_buffer_import(MppBuffer *buffer, MppBufferInfo *info);
+MPP_STUB_API MPP_RET mpp_buffer_put(MppBuffer buffer);
+MPP_STUB_API MPP_RET mpp_buffer_inc_ref(MppBuffer buffer);
+MPP_STUB_API void *mpp_buffer_get_ptr(MppBuffer buffer);
+MPP_STUB_API int mpp_buffer_get_fd(MppBuffer buffer);
+MPP_STUB_API size_t mpp_buffer_get_size(MppBuffer buffer);
+// the index given by the commit, -1 for the others
+MPP_STUB_API int mpp_buffer_get_index(MppBuffer buffer);
+// As the internal groups of mpp, a group keeps the returned buffers for the
+// next get, while a get without group always allocates.
+MPP_STUB_API MPP_RET mpp_buffer_group_get_internal(MppBufferGroup *group,
+                                                   MppBufferType type);
+// An external group only hands out the buffers committed to it, imported as
+// mpp_buffer_import. A clear drops them; the ones in use are freed as they
+// are put back.
+MPP_STUB_API MPP_RET mpp_buffer_group_get_external(MppBufferGroup *group,
+                                                   MppBufferType type);
+MPP_STUB_API MPP_RET mpp_buffer_commit(MppBufferGroup group,
+                                       MppBufferInfo *info);
+MPP_STUB_API MPP_RET mpp_buffer_group_clear(MppBufferGroup group);
+// count 0 means no limit, getting a buffer beyond the limit fails
+MPP_STUB_API MPP_RET mpp_buffer_group_limit_config(MppBufferGroup group,
+                                                   size_t size, RK_S32 count);
+MPP_STUB_API MPP_RET mpp_buffer_group_put(MppBufferGroup group);
+
+MPP_STUB_API MPP_RET mpp_frame_init(MppFrame *frame);
+MPP_STUB_API MPP_RET mpp_frame_deinit(MppFrame *frame);
+MPP_STUB_API RK_U32 mpp_frame_get_width(const MppFrame frame);
+MPP_STUB_API void mpp_frame_set_width(MppFrame frame, RK_U32 width);
+MPP_STUB_API RK_U32 mpp_frame_get_height(const MppFrame frame);
+MPP_STUB_API void mpp_frame_set_height(MppFrame frame, RK_U32 height);
+MPP_STUB_API RK_U32 mpp_frame_get_hor_stride(const MppFrame frame);
+MPP_STUB_API void mpp_frame_set_hor_stride(MppFrame frame, RK_U32 stride);
+MPP_STUB_API RK_U32 mpp_frame_get_ver_stride(const MppFrame frame);
+MPP_STUB_API void mpp_frame_set_ver_stride(MppFrame frame, RK_U32 stride);
+MPP_STUB_API MppFrameFormat mpp_frame_get_fmt(const MppFrame frame);
+MPP_STUB_API void mpp_frame_set_fmt(MppFrame frame, MppFrameFormat fmt);
+MPP_STUB_API RK_S64 mpp_frame_get_pts(const MppFrame frame);
+MPP_STUB_API void mpp_frame_set_pts(MppFrame frame, RK_S64 pts);
+MPP_STUB_API RK_S64 mpp_frame_get_dts(const MppFrame frame);
+MPP_STUB_API void mpp_frame_set_dts(MppFrame frame, RK_S64 dts);
+MPP_STUB_API RK_U32 mpp_frame_get_eos(const MppFrame frame);
+MPP_STUB_API void mpp_frame_set_eos(MppFrame frame, RK_U32 eos);
+MPP_STUB_API RK_U32 mpp_frame_get_info_change(const MppFrame frame);
+MPP_STUB_API RK_U32 mpp_frame_get_discard(const MppFrame frame);
+MPP_STUB_API RK_U32 mpp_frame_get_errinfo(const MppFrame frame);
+MPP_STUB_API MppBuffer mpp_frame_get_buffer(const MppFrame frame);
+MPP_STUB_API void mpp_frame_set_buffer(MppFrame frame, MppBuffer buffer);
+
+MPP_STUB_API MPP_RET mpp_packet_init(MppPacket *packet, void *data,
+                                     size_t size);
+MPP_STUB_API MPP_RET mpp_packet_init_with_buffer(MppPacket *packet,
+                                                 MppBuffer buffer);
+MPP_STUB_API MPP_RET mpp_packet_deinit(MppPacket *packet);
+MPP_STUB_API void *mpp_packet_get_data(const MppPacket packet);
+MPP_STUB_API size_t mpp_packet_get_size(const MppPacket packet);
+MPP_STUB_API void *mpp_packet_get_pos(const MppPacket packet);
+MPP_STUB_API size_t mpp_packet_get_length(const MppPacket packet);
+MPP_STUB_API void mpp_packet_set_length(MppPacket packet, size_t length);
+MPP_STUB_API RK_S64 mpp_packet_get_pts(const MppPacket packet);
+MPP_STUB_API void mpp_packet_set_pts(MppPacket packet, RK_S64 pts);
+MPP_STUB_API RK_S64 mpp_packet_get_dts(const MppPacket packet);
+MPP_STUB_API RK_U32 mpp_packet_get_eos(MppPacket packet);
+MPP_STUB_API MPP_RET mpp_packet_set_eos(MppPacket packet);
+MPP_STUB_API RK_U32 mpp_packet_get_flag(const MppPacket packet);
+MPP_STUB_API MppBuffer mpp_packet_get_buffer(const MppPacket packet);
+
+MPP_STUB_API MPP_RET mpp_task_meta_set_frame(MppTask task, MppMetaKey key,
+                                             MppFrame frame);
+MPP_STUB_API MPP_RET mpp_task_meta_set_packet(MppTask task, MppMetaKey key,
+                                              MppPacket packet);
+MPP_STUB_API MPP_RET mpp_task_meta_set_buffer(MppTask task, MppMetaKey key,
+                                              MppBuffer buffer);
+MPP_STUB_API MPP_RET mpp_task_meta_get_frame(MppTask task, MppMetaKey key,
+                                             MppFrame *frame);
+MPP_STUB_API MPP_RET mpp_task_meta_get_packet(MppTask task, MppMetaKey key,
+                                              MppPacket *packet);
+MPP_STUB_API MPP_RET mpp_task_meta_get_buffer(MppTask task, MppMetaKey key,
+                                              MppBuffer *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYMEDIA_RKMPP_STUB_RK_MPI_H_
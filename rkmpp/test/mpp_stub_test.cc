@@ -0,0 +1,876 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+// Run the rkmpp wrappers against the in-process mpp stand-in, check the
+// outputs are the bit-exact ones described in stub/rk_mpi.h and print the
+// time per frame of the wrappers.
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "buffer_pool.h"
+#include "decoder.h"
+#include "encoder.h"
+#include "flow.h"
+#include "h26x_parser.h"
+#include "key_string.h"
+#include "media_type.h"
+#include "mpp_inc.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+struct Packet {
+  Bytes data;
+  uint32_t flag;
+  int64_t pts;
+};
+
+static const int kWidth = 320;
+static const int kHeight = 180; // cropped from 192
+static const int kFps = 30;
+static const int kBitRate = 240000; // 1000 bytes per frame
+
+static uint32_t fnv1a(const uint8_t *p, size_t size) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ p[i]) * 16777619u;
+  return hash;
+}
+
+static double now_ms() {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static std::shared_ptr<easymedia::ImageBuffer>
+new_frame(int index, int width = kWidth, int height = kHeight) {
+  ImageInfo info = {PIX_FMT_NV12, width, height, UPALIGNTO16(width),
+                    UPALIGNTO16(height)};
+  size_t len = CalPixFmtSize(info.pix_fmt, info.vir_width, info.vir_height);
+  auto &&mb = easymedia::MediaBuffer::Alloc2(len);
+  auto frame = std::make_shared<easymedia::ImageBuffer>(mb, info);
+  assert(frame && frame->GetSize() >= len);
+  uint8_t *p = static_cast<uint8_t *>(frame->GetPtr());
+  for (size_t i = 0; i < len; i++)
+    p[i] = (uint8_t)(i * 7 + index * 13);
+  frame->SetValidSize(len);
+  frame->SetTimeStamp(index * 1000 / kFps);
+  return frame;
+}
+
+static std::shared_ptr<easymedia::VideoEncoder>
+new_encoder(const char *codec, int gop, const char *param = nullptr,
+            int width = kWidth, int height = kHeight) {
+  auto enc = easymedia::REFLECTOR(Encoder)::Create<easymedia::VideoEncoder>(
+      codec, param);
+  assert(enc);
+  ImageInfo info = {PIX_FMT_NV12, width, height, UPALIGNTO16(width),
+                    UPALIGNTO16(height)};
+  MediaConfig cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  if (!strcmp(codec, "rkmpp_jpeg")) {
+    cfg.img_cfg.image_info = info;
+    cfg.img_cfg.qp_init = 8;
+  } else {
+    VideoConfig &vid_cfg = cfg.vid_cfg;
+    vid_cfg.image_cfg.image_info = info;
+    vid_cfg.image_cfg.qp_init = 24;
+    vid_cfg.qp_step = 4;
+    vid_cfg.qp_min = 12;
+    vid_cfg.qp_max = 48;
+    vid_cfg.bit_rate = kBitRate;
+    vid_cfg.frame_rate = kFps;
+    vid_cfg.level = 40;
+    vid_cfg.gop_size = gop;
+    vid_cfg.profile = 100;
+    vid_cfg.rc_quality = "best";
+    vid_cfg.rc_mode = "cbr";
+  }
+  bool ret = enc->InitConfig(cfg);
+  assert(ret);
+  return enc;
+}
+
+// zero_copy: output the mpp packets, else copy to the given buffers
+static void encode(const char *codec, int num, int gop, bool zero_copy,
+                   Bytes &extra, std::vector<Packet> &packets,
+                   int width = kWidth, int height = kHeight) {
+  auto enc = new_encoder(codec, gop, nullptr, width, height);
+  void *extra_data = nullptr;
+  size_t extra_size = 0;
+  enc->GetExtraData(extra_data, extra_size);
+  extra.assign((uint8_t *)extra_data, (uint8_t *)extra_data + extra_size);
+  packets.clear();
+  double start = now_ms();
+  for (int i = 0; i < num; i++) {
+    auto input = new_frame(i, width, height);
+    std::shared_ptr<easymedia::MediaBuffer> output;
+    if (zero_copy) {
+      output = std::make_shared<easymedia::MediaBuffer>();
+    } else {
+      output = easymedia::MediaBuffer::Alloc(input->GetValidSize());
+      output->SetValidSize(output->GetSize());
+    }
+    int ret = enc->Process(input, output, nullptr);
+    assert(!ret);
+    uint8_t *p = static_cast<uint8_t *>(output->GetPtr());
+    packets.push_back(Packet{Bytes(p, p + output->GetValidSize()),
+                             output->GetUserFlag(), output->GetTimeStamp()});
+  }
+  printf("%s %s: %.3f ms per frame\n", codec, zero_copy ? "zero copy" : "copy",
+         (now_ms() - start) / num);
+}
+
+static void check_h264_stream(const Bytes &extra,
+                              const std::vector<Packet> &packets, int gop) {
+  auto parser = easymedia::NalParser::Create(easymedia::NalCodec::H264);
+  easymedia::NalUnitInfo info;
+  // sps and pps, 4 bytes start codes
+  size_t pps = 4;
+  while (pps + 4 < extra.size() &&
+         memcmp(&extra[pps], "\x00\x00\x00\x01", 4))
+    pps++;
+  assert(pps + 4 < extra.size());
+  assert(!parser->Parse(&extra[4], pps - 4, info) && info.type == 7);
+  assert(!parser->Parse(&extra[pps + 4], extra.size() - pps - 4, info) &&
+         info.type == 8);
+  easymedia::StreamInfo si;
+  assert(parser->GetStreamInfo(si));
+  assert(si.width == kWidth && si.height == kHeight && si.profile == 100);
+  for (size_t i = 0; i < packets.size(); i++) {
+    const Packet &pkt = packets[i];
+    bool idr = (i % gop) == 0;
+    assert(pkt.data.size() > 4 && !memcmp(pkt.data.data(), "\0\0\0\1", 4));
+    int ret = parser->Parse(&pkt.data[4], pkt.data.size() - 4, info);
+    assert(!ret);
+    assert(info.type == (idr ? 5 : 1));
+    assert(info.slice_type == (idr ? easymedia::SliceType::I
+                                   : easymedia::SliceType::P));
+    assert(info.frame_num == (int)(i % gop) % 16);
+    assert(!!(pkt.flag & easymedia::MediaBuffer::kIntra) == idr);
+    assert(pkt.pts == (int64_t)i * 1000 / kFps);
+    size_t payload = kBitRate / 8 / kFps * (idr ? 3 : 1);
+    assert(pkt.data.size() > payload && pkt.data.size() < payload + 16);
+  }
+}
+
+static void test_encoder() {
+  const int num = 25, gop = 10;
+  Bytes extra, extra2;
+  std::vector<Packet> packets, packets2;
+  encode("rkmpp_h264", num, gop, true, extra, packets);
+  check_h264_stream(extra, packets, gop);
+  encode("rkmpp_h264", num, gop, false, extra2, packets2);
+  assert(extra == extra2);
+  for (int i = 0; i < num; i++)
+    assert(packets[i].data == packets2[i].data);
+
+  encode("rkmpp_jpeg", 3, 1, true, extra, packets);
+  assert(extra.empty());
+  for (auto &pkt : packets) {
+    const Bytes &d = pkt.data;
+    assert(d.size() == 35 + kWidth * kHeight * 8 / 40 + 2);
+    assert(d[0] == 0xFF && d[1] == 0xD8 && d[3] == 0xC0);
+    assert(((d[7] << 8) | d[8]) == kHeight && ((d[9] << 8) | d[10]) == kWidth);
+    assert(d[d.size() - 2] == 0xFF && d[d.size() - 1] == 0xD9);
+    assert(pkt.flag & easymedia::MediaBuffer::kIntra);
+  }
+}
+
+static void test_latency() {
+  const int num = 10, latency_ms = 5;
+  setenv("MPP_STUB_LATENCY_US", std::to_string(latency_ms * 1000).c_str(), 1);
+  Bytes extra;
+  std::vector<Packet> packets;
+  double start = now_ms();
+  encode("rkmpp_h264", num, 30, true, extra, packets);
+  double cost = now_ms() - start;
+  unsetenv("MPP_STUB_LATENCY_US");
+  assert(cost >= num * latency_ms);
+}
+
+// Keep depth frames in the encoder, 0 for the sync Process. The caller
+// spends work_ms on each frame before it sends the frame, which overlaps the
+// encoding of the frames in flight.
+static void encode_async(int num, int gop, int depth, int work_ms,
+                         std::vector<Packet> &packets) {
+  std::string param;
+  PARAM_STRING_APPEND_TO(param, KEY_MPP_ASYNC_DEPTH, depth);
+  auto enc = new_encoder("rkmpp_h264", gop, param.c_str());
+  std::vector<double> submit(num);
+  double latency = 0;
+  bool eof = false;
+  packets.clear();
+  auto collect = [&](std::shared_ptr<easymedia::MediaBuffer> out) {
+    assert(!eof);
+    if (out->IsEOF()) {
+      assert(!out->IsValid() && (int)packets.size() == num);
+      eof = true;
+      return;
+    }
+    size_t i = packets.size();
+    auto &sptrs = out->GetRelatedSPtrs();
+    assert(sptrs.size() == 1 &&
+           (size_t)*std::static_pointer_cast<int>(sptrs[0]) == i);
+    latency += now_ms() - submit[i];
+    uint8_t *p = static_cast<uint8_t *>(out->GetPtr());
+    packets.push_back(Packet{Bytes(p, p + out->GetValidSize()),
+                             out->GetUserFlag(), out->GetTimeStamp()});
+  };
+  double start = now_ms();
+  for (int i = 0; i <= num; i++) {
+    std::shared_ptr<easymedia::MediaBuffer> input;
+    if (i < num) {
+      easymedia::msleep(work_ms);
+      input = new_frame(i);
+      input->SetRelatedSPtr(std::make_shared<int>(i));
+    } else {
+      input = std::make_shared<easymedia::MediaBuffer>();
+      input->SetEOF(true);
+    }
+    submit[std::min(i, num - 1)] = now_ms();
+    if (!depth) {
+      assert(enc->SendInput(input) == -ENOSYS && errno == ENOSYS);
+      if (i == num) {
+        eof = true;
+        break;
+      }
+      auto output = std::make_shared<easymedia::MediaBuffer>();
+      int ret = enc->Process(input, output, nullptr);
+      assert(!ret);
+      output->SetRelatedSPtr(input->GetRelatedSPtrs()[0]);
+      collect(output);
+      continue;
+    }
+    int ret;
+    std::shared_ptr<easymedia::MediaBuffer> out;
+    while ((ret = enc->SendInput(input)) == -EAGAIN) {
+      // the pipeline is full, this waits for the oldest frame
+      out = enc->FetchOutput();
+      assert(out);
+      collect(out);
+    }
+    assert(!ret);
+    while ((out = enc->FetchOutput()))
+      collect(out);
+    assert(errno == 0);
+  }
+  assert(eof);
+  double cost = now_ms() - start;
+  printf("h264 async depth %d: %.3f ms per frame, %.3f ms latency\n", depth,
+         cost / num, latency / num);
+}
+
+// The outputs of the pipeline match the sync ones, and with the vpu latency
+// of the stand-in it runs at the pace of max(work, latency) rather than the
+// sum.
+static void test_async_encoder() {
+  const int num = 30, gop = 10, latency_ms = 5, work_ms = 4;
+  std::vector<Packet> sync_packets, packets;
+  Bytes extra;
+  encode("rkmpp_h264", num, gop, true, extra, sync_packets);
+  setenv("MPP_STUB_LATENCY_US", std::to_string(latency_ms * 1000).c_str(), 1);
+  double costs[4];
+  for (int depth = 0; depth < 4; depth++) {
+    double start = now_ms();
+    encode_async(num, gop, depth, work_ms, packets);
+    costs[depth] = now_ms() - start;
+    assert(packets.size() == sync_packets.size());
+    for (int i = 0; i < num; i++) {
+      assert(packets[i].data == sync_packets[i].data);
+      assert(packets[i].flag == sync_packets[i].flag);
+      assert(packets[i].pts == sync_packets[i].pts);
+    }
+  }
+  unsetenv("MPP_STUB_LATENCY_US");
+  assert(costs[0] >= num * (latency_ms + work_ms));
+  assert(costs[2] < costs[0] * 0.8);
+  // opt-in, the default is sync
+  auto enc = new_encoder("rkmpp_h264", gop);
+  assert(enc->SendInput(nullptr) == -ENOSYS);
+  enc = new_encoder("rkmpp_jpeg", gop);
+  assert(enc->SendInput(nullptr) == -ENOSYS);
+}
+
+// A slot of a capture ring, memfd backed as a dma buffer. The MediaBuffers
+// of the slot are not mapped as the hardware ones, the test writes the
+// content by its own mapping.
+struct RingSlot {
+  RingSlot(size_t s) : fd(-1), ptr(MAP_FAILED), size(s) {
+    fd = syscall(SYS_memfd_create, "ring_slot", 0);
+    assert(fd >= 0 && !ftruncate(fd, size));
+    ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    assert(ptr != MAP_FAILED);
+  }
+  ~RingSlot() {
+    munmap(ptr, size);
+    close(fd);
+  }
+  int fd;
+  void *ptr;
+  size_t size;
+};
+
+static int free_ring_slot(void *p) {
+  delete static_cast<RingSlot *>(p);
+  return 0;
+}
+
+static std::vector<easymedia::MediaBuffer> new_ring(int num, size_t size = 0) {
+  if (!size)
+    size = CalPixFmtSize(PIX_FMT_NV12, UPALIGNTO16(kWidth),
+                         UPALIGNTO16(kHeight));
+  std::vector<easymedia::MediaBuffer> ring;
+  for (int i = 0; i < num; i++) {
+    RingSlot *slot = new RingSlot(size);
+    ring.push_back(easymedia::MediaBuffer(nullptr, size, slot->fd, slot,
+                                          free_ring_slot));
+  }
+  return ring;
+}
+
+// capture frame index to the slot, as the dequeued v4l2 buffers
+static std::shared_ptr<easymedia::MediaBuffer>
+capture(easymedia::MediaBuffer &slot, int index) {
+  auto content = new_frame(index);
+  RingSlot *rs = static_cast<RingSlot *>(slot.GetUserData().get());
+  memcpy(rs->ptr, content->GetPtr(), content->GetValidSize());
+  auto frame =
+      std::make_shared<easymedia::ImageBuffer>(slot, content->GetImageInfo());
+  frame->SetTimeStamp(content->GetTimeStamp());
+  return frame;
+}
+
+typedef std::vector<std::shared_ptr<easymedia::MediaBuffer>> BufferVector;
+
+// us per frame to get the mpp buffer of mb, and to put it
+static double submit_cost(BufferVector &mbs, int num,
+                          easymedia::MPPImportCache *cache,
+                          MppBufferGroup group) {
+  double start = now_ms();
+  for (int i = 0; i < num; i++) {
+    MppBuffer buffer = nullptr;
+    auto &mb = mbs[i % mbs.size()];
+    MPP_RET ret =
+        easymedia::init_mpp_buffer_with_content(buffer, mb, cache, group);
+    assert(!ret && buffer && mpp_buffer_get_ptr(buffer));
+    mpp_buffer_put(buffer);
+  }
+  return (now_ms() - start) * 1000 / num;
+}
+
+static void test_import_cache() {
+  const int num = 400, ring_num = 4;
+  auto ring = new_ring(ring_num);
+  BufferVector frames;
+  for (int i = 0; i < ring_num; i++)
+    frames.push_back(capture(ring[i], i));
+  easymedia::MPPImportCache cache;
+  double uncached = submit_cost(frames, num, nullptr, NULL);
+  double cached = submit_cost(frames, num, &cache, NULL);
+  assert(cache.GetMisses() == ring_num && cache.GetHits() == num - ring_num);
+  printf("fd input: import %.2f us per frame, cached %.2f us\n", uncached,
+         cached);
+
+  // the cached buffers die with the ring
+  frames.clear();
+  ring = new_ring(ring_num);
+  for (int i = 0; i < ring_num; i++) {
+    auto frame = capture(ring[i], i + 100);
+    MppBuffer buffer = nullptr;
+    assert(!cache.Import(buffer, frame));
+    assert(!memcmp(mpp_buffer_get_ptr(buffer),
+                   static_cast<RingSlot *>(ring[i].GetUserData().get())->ptr,
+                   frame->GetValidSize()));
+    mpp_buffer_put(buffer);
+  }
+  assert(cache.GetMisses() == 2 * ring_num);
+
+  // the copy path
+  BufferVector heap_frames;
+  heap_frames.push_back(new_frame(0));
+  MppBufferGroup group = NULL;
+  assert(!mpp_buffer_group_get_internal(&group, MPP_BUFFER_TYPE_ION));
+  double copied = submit_cost(heap_frames, num / 4, nullptr, NULL);
+  double pooled = submit_cost(heap_frames, num / 4, nullptr, group);
+  mpp_buffer_group_put(group);
+  printf("copied input: %.2f us per frame, pooled %.2f us\n", copied, pooled);
+
+  // the encoder takes the ring as the other memory
+  Bytes extra;
+  std::vector<Packet> packets;
+  encode("rkmpp_h264", 12, 10, true, extra, packets);
+  auto enc = new_encoder("rkmpp_h264", 10);
+  for (int i = 0; i < 12; i++) {
+    auto output = std::make_shared<easymedia::MediaBuffer>();
+    assert(!enc->Process(capture(ring[i % ring_num], i), output, nullptr));
+    uint8_t *p = static_cast<uint8_t *>(output->GetPtr());
+    assert(Bytes(p, p + output->GetValidSize()) == packets[i].data);
+  }
+}
+
+// the bytes of an encoded frame, which is in one of the unmapped slots
+// or in a mapped buffer of mpp
+static Bytes output_bytes(std::shared_ptr<easymedia::MediaBuffer> out,
+                          std::vector<easymedia::MediaBuffer> &slots,
+                          bool &in_slot) {
+  const uint8_t *p = static_cast<const uint8_t *>(out->GetPtr());
+  in_slot = false;
+  for (auto &slot : slots) {
+    if (slot.GetFD() == out->GetFD()) {
+      assert(!p);
+      p = static_cast<uint8_t *>(
+          static_cast<RingSlot *>(slot.GetUserData().get())->ptr);
+      in_slot = true;
+    }
+  }
+  assert(p);
+  return Bytes(p, p + out->GetValidSize());
+}
+
+static void test_output_pool() {
+  const int num = 12, gop = 10;
+  Bytes extra;
+  std::vector<Packet> packets;
+  encode("rkmpp_h264", num, gop, true, extra, packets);
+
+  // async, the pool of the raw frame size never overflows, the outputs
+  // beyond the pool come from mpp
+  auto slots = new_ring(3);
+  auto pool = std::make_shared<easymedia::BufferPool>(slots);
+  std::string param;
+  PARAM_STRING_APPEND_TO(param, KEY_MPP_ASYNC_DEPTH, 2);
+  auto enc = new_encoder("rkmpp_h264", gop, param.c_str());
+  enc->SetOutputPool(pool);
+  BufferVector outputs;
+  for (int i = 0; i <= num; i++) {
+    std::shared_ptr<easymedia::MediaBuffer> input;
+    if (i < num) {
+      input = new_frame(i);
+    } else {
+      input = std::make_shared<easymedia::MediaBuffer>();
+      input->SetEOF(true);
+    }
+    while (enc->SendInput(input) == -EAGAIN)
+      outputs.push_back(enc->FetchOutput());
+    std::shared_ptr<easymedia::MediaBuffer> out;
+    while ((out = enc->FetchOutput()))
+      outputs.push_back(out);
+  }
+  assert((int)outputs.size() == num + 1 && outputs.back()->IsEOF());
+  assert(pool->GetFreeNum() == 0);
+  for (int i = 0; i < num; i++) {
+    bool in_slot;
+    assert(output_bytes(outputs[i], slots, in_slot) == packets[i].data);
+    assert(in_slot == (i < 3));
+    assert(outputs[i]->GetTimeStamp() == packets[i].pts);
+    assert(outputs[i]->GetUserFlag() == packets[i].flag);
+  }
+  outputs.clear();
+  assert(pool->GetFreeNum() == 3);
+
+  // sync, the idr frames overflow the small buffers and fall back to mpp
+  size_t slot_size = kBitRate / 8 / kFps * 2;
+  slots = new_ring(2, slot_size);
+  pool = std::make_shared<easymedia::BufferPool>(slots);
+  enc = new_encoder("rkmpp_h264", gop);
+  for (int i = 0; i < num; i++) {
+    auto out = pool->Get();
+    assert(out);
+    out->SetValidSize(out->GetSize());
+    assert(!enc->Process(new_frame(i), out, nullptr));
+    bool in_slot;
+    assert(output_bytes(out, slots, in_slot) == packets[i].data);
+    assert(in_slot == !(packets[i].flag & easymedia::MediaBuffer::kIntra));
+    assert(out->GetUserFlag() == packets[i].flag);
+  }
+  assert(pool->GetFreeNum() == 2);
+}
+
+static void check_frame(std::shared_ptr<easymedia::MediaBuffer> mb,
+                        const Bytes &unit, int width = kWidth,
+                        int height = kHeight) {
+  auto image = std::static_pointer_cast<easymedia::ImageBuffer>(mb);
+  const ImageInfo &info = image->GetImageInfo();
+  assert(info.pix_fmt == PIX_FMT_NV12);
+  assert(info.width == width && info.height == height);
+  assert(info.vir_width == UPALIGNTO16(width) &&
+         info.vir_height == UPALIGNTO16(height));
+  assert((int)image->GetValidSize() ==
+         CalPixFmtSize(info.pix_fmt, info.vir_width, info.vir_height));
+  const uint8_t *p = static_cast<const uint8_t *>(image->GetPtr());
+  size_t luma = info.vir_width * info.vir_height;
+  uint8_t y = fnv1a(unit.data(), unit.size()) & 0xFF;
+  for (size_t i = 0; i < image->GetValidSize(); i++)
+    assert(p[i] == (i < luma ? y : 0x80));
+}
+
+// Feed the stream by chunk_size, 0 for a packet per chunk. Hold hold_num
+// output frames before releasing them.
+static void decode(const Bytes &extra, const std::vector<Packet> &packets,
+                   size_t chunk_size, int hold_num) {
+  std::string param;
+  PARAM_STRING_APPEND(param, KEY_INPUTDATATYPE, VIDEO_H264);
+  if (hold_num)
+    PARAM_STRING_APPEND_TO(param, KEY_MPP_GROUP_MAX_FRAMES, hold_num);
+  auto dec = easymedia::REFLECTOR(Decoder)::Create<easymedia::VideoDecoder>(
+      "rkmpp", param.c_str());
+  assert(dec);
+  std::vector<std::shared_ptr<easymedia::MediaBuffer>> chunks;
+  std::vector<Bytes> units;
+  Bytes stream;
+  for (size_t i = 0; i < packets.size(); i++) {
+    Bytes unit = i ? Bytes() : extra;
+    unit.insert(unit.end(), packets[i].data.begin(), packets[i].data.end());
+    stream.insert(stream.end(), unit.begin(), unit.end());
+    units.push_back(unit);
+    if (!chunk_size) {
+      auto mb = easymedia::MediaBuffer::Alloc(unit.size());
+      memcpy(mb->GetPtr(), unit.data(), unit.size());
+      mb->SetValidSize(unit.size());
+      mb->SetTimeStamp(packets[i].pts);
+      chunks.push_back(mb);
+    }
+  }
+  for (size_t i = 0; chunk_size && i < stream.size(); i += chunk_size) {
+    size_t size = std::min(chunk_size, stream.size() - i);
+    auto mb = easymedia::MediaBuffer::Alloc(size);
+    memcpy(mb->GetPtr(), &stream[i], size);
+    mb->SetValidSize(size);
+    chunks.push_back(mb);
+  }
+  chunks.back()->SetEOF(true);
+
+  std::vector<std::shared_ptr<easymedia::MediaBuffer>> held;
+  size_t sent = 0, got = 0;
+  bool eos = false, stalled = false;
+  double start = now_ms(), last_output = start;
+  while (!eos) {
+    if (sent < chunks.size()) {
+      int ret = dec->SendInput(chunks[sent]);
+      assert(!ret || ret == -EAGAIN);
+      if (!ret)
+        sent++;
+    }
+    auto out = dec->FetchOutput();
+    if (!out) {
+      assert(errno == 0);
+      if (hold_num && (int)held.size() == hold_num &&
+          now_ms() - last_output > 50) {
+        // the frame pool is exhausted, the decoder waits
+        stalled = true;
+        held.clear();
+      }
+      if (sent == chunks.size())
+        easymedia::msleep(1);
+      continue;
+    }
+    last_output = now_ms();
+    if (out->IsEOF()) {
+      eos = true;
+      break;
+    }
+    assert(got < units.size());
+    check_frame(out, units[got]);
+    if (!chunk_size)
+      assert(out->GetTimeStamp() == packets[got].pts);
+    got++;
+    if (hold_num)
+      held.push_back(out);
+  }
+  assert(got == units.size());
+  assert(!hold_num || stalled);
+  printf("decode by %s, hold %d: %.3f ms per frame\n",
+         chunk_size ? std::to_string(chunk_size).c_str() : "packet", hold_num,
+         (now_ms() - start) / got);
+}
+
+static void test_decoder() {
+  Bytes extra;
+  std::vector<Packet> packets;
+  encode("rkmpp_h264", 20, 8, true, extra, packets);
+  decode(extra, packets, 0, 0);
+  decode(extra, packets, 777, 0);
+  decode(extra, packets, 0, 4);
+
+  // sync jpeg decoding to a buffer from mpp
+  encode("rkmpp_jpeg", 1, 1, true, extra, packets);
+  std::string param;
+  PARAM_STRING_APPEND(param, KEY_INPUTDATATYPE, IMAGE_JPEG);
+  auto dec = easymedia::REFLECTOR(Decoder)::Create<easymedia::VideoDecoder>(
+      "rkmpp", param.c_str());
+  assert(dec);
+  const Bytes &jpeg = packets[0].data;
+  auto input = easymedia::MediaBuffer::Alloc(jpeg.size());
+  memcpy(input->GetPtr(), jpeg.data(), jpeg.size());
+  input->SetValidSize(jpeg.size());
+  auto output = std::make_shared<easymedia::ImageBuffer>();
+  int ret = dec->Process(input, output, nullptr);
+  assert(!ret);
+  check_frame(output, jpeg);
+}
+
+// Takes the frames of a decoder flow, with the time they come.
+class SinkFlow : public easymedia::Flow {
+public:
+  SinkFlow() : eos(false) {
+    easymedia::SlotMap sm;
+    sm.input_slots.push_back(0);
+    sm.process = Collect;
+    sm.thread_model = easymedia::Model::SYNC;
+    bool ret = InstallSlotMap(sm, "sink", -1);
+    assert(ret);
+  }
+  virtual ~SinkFlow() { StopAllThread(); }
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mtx);
+    cond.wait(lock, [this] { return eos; });
+  }
+  std::vector<std::pair<int64_t, double>> frames; // pts, arrival
+
+private:
+  static bool Collect(easymedia::Flow *f,
+                      easymedia::MediaBufferVector &input_vector) {
+    SinkFlow *sink = static_cast<SinkFlow *>(f);
+    auto &in = input_vector[0];
+    if (!in)
+      return false;
+    std::lock_guard<std::mutex> _lg(sink->mtx);
+    if (in->IsEOF()) {
+      sink->eos = true;
+      sink->cond.notify_all();
+    } else {
+      sink->frames.emplace_back(in->GetTimeStamp(), now_ms());
+    }
+    return true;
+  }
+  std::mutex mtx;
+  std::condition_variable cond;
+  bool eos;
+};
+
+static std::vector<std::shared_ptr<easymedia::MediaBuffer>>
+packet_buffers(const Bytes &extra, const std::vector<Packet> &packets) {
+  std::vector<std::shared_ptr<easymedia::MediaBuffer>> mbs;
+  for (size_t i = 0; i < packets.size(); i++) {
+    Bytes unit = i ? Bytes() : extra;
+    unit.insert(unit.end(), packets[i].data.begin(), packets[i].data.end());
+    auto mb = easymedia::MediaBuffer::Alloc(unit.size());
+    memcpy(mb->GetPtr(), unit.data(), unit.size());
+    mb->SetValidSize(unit.size());
+    mb->SetTimeStamp(packets[i].pts);
+    mbs.push_back(mb);
+  }
+  mbs.back()->SetEOF(true);
+  return mbs;
+}
+
+// The latency from a packet sent at interval_ms to its frame. The polling one
+// is the former loop of the decoder flow: it retries SendInput after 5ms, and
+// takes the frames done after each packet.
+static double decode_latency(const Bytes &extra,
+                             const std::vector<Packet> &packets,
+                             int interval_ms, bool polling) {
+  auto mbs = packet_buffers(extra, packets);
+  std::vector<double> sent(mbs.size());
+  std::vector<std::pair<int64_t, double>> frames;
+  std::string dec_param;
+  PARAM_STRING_APPEND(dec_param, KEY_INPUTDATATYPE, VIDEO_H264);
+  // whole frames, not to wait for the start of the next one
+  PARAM_STRING_APPEND_TO(dec_param, KEY_MPP_SPLIT_MODE, 0);
+  if (polling) {
+    auto dec = easymedia::REFLECTOR(Decoder)::Create<easymedia::VideoDecoder>(
+        "rkmpp", dec_param.c_str());
+    assert(dec);
+    for (size_t i = 0; i < mbs.size(); i++) {
+      easymedia::msleep(interval_ms);
+      sent[i] = now_ms();
+      while (dec->SendInput(mbs[i]) == -EAGAIN)
+        easymedia::msleep(5);
+      std::shared_ptr<easymedia::MediaBuffer> out;
+      while ((out = dec->FetchOutput()) && !out->IsEOF())
+        frames.emplace_back(out->GetTimeStamp(), now_ms());
+    }
+    // the tail waits for no more input
+    while (frames.size() < packets.size()) {
+      auto out = dec->FetchOutput();
+      if (out)
+        frames.emplace_back(out->GetTimeStamp(), now_ms());
+      else
+        easymedia::msleep(1);
+    }
+  } else {
+    std::string param;
+    PARAM_STRING_APPEND(param, KEY_NAME, "rkmpp");
+    param = easymedia::JoinFlowParam(param, 1, dec_param);
+    auto flow = easymedia::REFLECTOR(Flow)::Create<easymedia::Flow>(
+        "video_dec", param.c_str());
+    assert(flow);
+    auto sink = std::make_shared<SinkFlow>();
+    flow->AddDownFlow(sink, 0, 0);
+    for (size_t i = 0; i < mbs.size(); i++) {
+      easymedia::msleep(interval_ms);
+      sent[i] = now_ms();
+      flow->SendInput(mbs[i], 0);
+    }
+    sink->Wait();
+    flow->RemoveDownFlow(sink);
+    frames = sink->frames;
+  }
+  assert(frames.size() == packets.size());
+  double latency = 0;
+  for (size_t i = 0; i < frames.size(); i++) {
+    assert(frames[i].first == packets[i].pts);
+    latency += frames[i].second - sent[i];
+  }
+  return latency / frames.size();
+}
+
+// The flow sends a frame down as soon as the decoder has it, rather than with
+// the next packet.
+static void test_decoder_flow_latency() {
+  const int num = 20, latency_ms = 5, interval_ms = 20;
+  Bytes extra;
+  std::vector<Packet> packets;
+  encode("rkmpp_h264", num, 8, true, extra, packets);
+  setenv("MPP_STUB_LATENCY_US", std::to_string(latency_ms * 1000).c_str(), 1);
+  double polling = decode_latency(extra, packets, interval_ms, true);
+  double event = decode_latency(extra, packets, interval_ms, false);
+  // a burst fills the decoder, which the flow waits for by the input events
+  decode_latency(extra, packets, 0, false);
+  unsetenv("MPP_STUB_LATENCY_US");
+  printf("decode latency at %d ms interval, polling: %.3f ms, event: %.3f "
+         "ms\n",
+         interval_ms, polling, event);
+  assert(event >= latency_ms && event < polling);
+}
+
+// Decode to a pool of frames, from a stream whose resolution grows midway.
+// Holding all frames of the pool blocks SendInput, and a frame of the old
+// resolution lives on after the pool is reallocated.
+static void test_decoder_pool() {
+  const int num = 6, pool_num = 3;
+  const int width2 = kWidth * 2, height2 = kHeight * 2;
+  Bytes extra, extra2;
+  std::vector<Packet> packets, packets2;
+  encode("rkmpp_h264", num, 8, true, extra, packets);
+  encode("rkmpp_h264", num, 8, true, extra2, packets2, width2, height2);
+  auto mbs = packet_buffers(extra, packets);
+  mbs.back()->SetEOF(false);
+  auto mbs2 = packet_buffers(extra2, packets2);
+  mbs.insert(mbs.end(), mbs2.begin(), mbs2.end());
+  std::vector<Bytes> units;
+  for (auto &mb : mbs) {
+    uint8_t *p = static_cast<uint8_t *>(mb->GetPtr());
+    units.push_back(Bytes(p, p + mb->GetValidSize()));
+  }
+
+  std::string param;
+  PARAM_STRING_APPEND(param, KEY_INPUTDATATYPE, VIDEO_H264);
+  PARAM_STRING_APPEND_TO(param, KEY_MPP_SPLIT_MODE, 0);
+  auto dec = easymedia::REFLECTOR(Decoder)::Create<easymedia::VideoDecoder>(
+      "rkmpp", param.c_str());
+  assert(dec);
+  auto pool = std::make_shared<easymedia::BufferPool>(new_ring(pool_num));
+  dec->SetOutputPool(pool);
+
+  std::vector<std::shared_ptr<easymedia::MediaBuffer>> held;
+  std::shared_ptr<easymedia::MediaBuffer> old_frame;
+  size_t sent = 0;
+  int got = 0, stalls = 0;
+  while (true) {
+    // old_frame is of the pool until a frame of the new one comes
+    int held_num = held.size() + (old_frame && got == num ? 1 : 0);
+    if (sent < mbs.size()) {
+      int ret = dec->SendInput(mbs[sent]);
+      assert(!ret || ret == -EAGAIN);
+      if (!ret) {
+        sent++;
+      } else if (held_num >= pool_num) {
+        // the back-pressure of the pool, release the frames
+        stalls++;
+        held.clear();
+      }
+    } else if (held_num >= pool_num) {
+      held.clear(); // for the tail
+    }
+    auto out = dec->FetchOutput();
+    if (!out) {
+      assert(errno == 0);
+      easymedia::msleep(1);
+      continue;
+    }
+    if (out->IsEOF())
+      break;
+    if (got < num) {
+      check_frame(out, units[got]);
+      assert(pool->GetFreeNum() == 0); // all committed to mpp
+    } else {
+      check_frame(out, units[got], width2, height2);
+    }
+    if (got == num - 1)
+      old_frame = out;
+    else
+      held.push_back(out);
+    got++;
+  }
+  assert(got == 2 * num);
+  assert(stalls >= 2);
+  // only old_frame is not back to the old pool, and it is intact
+  assert(pool->GetFreeNum() == pool_num - 1);
+  check_frame(old_frame, units[num - 1]);
+  old_frame.reset();
+  assert(pool->GetFreeNum() == pool_num);
+  printf("decode to a pool of %d frames, %d stalls\n", pool_num, stalls);
+}
+
+int main() {
+  test_encoder();
+  test_latency();
+  test_async_encoder();
+  test_import_cache();
+  test_output_pool();
+  test_decoder();
+  test_decoder_flow_latency();
+  test_decoder_pool();
+  printf("mpp stub test done\n");
+  return 0;
+}
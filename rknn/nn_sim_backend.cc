@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "nn_backend.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <list>
+#include <mutex>
+
+#include "utils.h"
+
+namespace easymedia {
+
+// A simulated npu, to test and measure the nn pipelines on any machine.
+// SetInputs copies the inputs as the driver does; Run sleeps the latency,
+// one run at a time over all the instances as on one npu; GetOutputs writes
+// floats which follow from the inputs: the first of each output tensor is
+// the sum of the input bytes mod 2^24, the next ones count up from it.
+// Params:
+//   KEY_NN_SIM_INPUTS: dims of the uint8 nhwc inputs, 1x224x224x3 if not set
+//   KEY_NN_SIM_OUTPUTS: dims of the float32 outputs, 1x1000 if not set
+//   KEY_NN_SIM_LATENCY: us of one run, 0 if not set
+class NNSimBackend : public NNBackend {
+public:
+  NNSimBackend(const char *param);
+  virtual ~NNSimBackend() = default;
+  static const char *GetBackendName() { return "sim"; }
+
+  virtual int SetInputs(const std::vector<NNInput> &inputs) override;
+  virtual int Run() override;
+  virtual int GetOutputs(std::vector<NNOutput> &outputs) override;
+
+private:
+  std::vector<std::vector<uint8_t>> input_mem;
+  uint32_t input_sum;
+  int latency;
+};
+
+static std::mutex npu_mtx;
+
+// "1x640x640x3,1x1000", empty if invalid
+static std::vector<NNTensorAttr> parse_tensors(const std::string &value,
+                                               TensorType type,
+                                               TensorLayout layout) {
+  std::vector<NNTensorAttr> attrs;
+  std::list<std::string> tensors;
+  if (!parse_media_param_list(value.c_str(), tensors, ','))
+    return attrs;
+  for (auto &t : tensors) {
+    std::list<std::string> dims;
+    if (!parse_media_param_list(t.c_str(), dims, 'x') || dims.empty())
+      return std::vector<NNTensorAttr>();
+    NNTensorAttr a;
+    a.index = attrs.size();
+    a.name = "sim" + std::to_string(a.index);
+    a.n_elems = 1;
+    for (auto &d : dims) {
+      int n = atoi(d.c_str());
+      if (n <= 0)
+        return std::vector<NNTensorAttr>();
+      a.dims.push_back(n);
+      a.n_elems *= n;
+    }
+    a.type = type;
+    a.layout = layout;
+    a.size = a.n_elems * GetTensorTypeSize(type);
+    a.scale = 1.0f;
+    a.zp = 0;
+    attrs.push_back(a);
+  }
+  return attrs;
+}
+
+NNSimBackend::NNSimBackend(const char *param) : input_sum(0), latency(0) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  std::string &in = params[KEY_NN_SIM_INPUTS];
+  std::string &out = params[KEY_NN_SIM_OUTPUTS];
+  input_attrs = parse_tensors(in.empty() ? "1x224x224x3" : in,
+                              TensorType::UINT8, TensorLayout::NHWC);
+  output_attrs = parse_tensors(out.empty() ? "1x1000" : out,
+                               TensorType::FLOAT32, TensorLayout::NCHW);
+  if (input_attrs.empty() || output_attrs.empty()) {
+    LOG("nn sim: invalid tensors <%s> <%s>\n", in.c_str(), out.c_str());
+    SetError(-EINVAL);
+    return;
+  }
+  for (auto &a : input_attrs)
+    input_mem.emplace_back(a.size);
+  const std::string &l = params[KEY_NN_SIM_LATENCY];
+  if (!l.empty())
+    latency = std::stoi(l);
+}
+
+int NNSimBackend::SetInputs(const std::vector<NNInput> &inputs) {
+  if (inputs.size() != input_attrs.size())
+    return -EINVAL;
+  uint32_t sum = 0;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (!inputs[i].buf || inputs[i].size != input_attrs[i].size) {
+      LOG("nn sim: input %d of %u bytes, expect %u\n", (int)i, inputs[i].size,
+          input_attrs[i].size);
+      return -EINVAL;
+    }
+    uint8_t *mem = input_mem[i].data();
+    memcpy(mem, inputs[i].buf, inputs[i].size);
+    for (uint32_t j = 0; j < inputs[i].size; j++)
+      sum += mem[j];
+  }
+  input_sum = sum;
+  return 0;
+}
+
+int NNSimBackend::Run() {
+  std::lock_guard<std::mutex> _lg(npu_mtx);
+  if (latency > 0)
+    usleep(latency);
+  return 0;
+}
+
+int NNSimBackend::GetOutputs(std::vector<NNOutput> &outputs) {
+  if (outputs.size() != output_attrs.size())
+    return -EINVAL;
+  for (size_t i = 0; i < outputs.size(); i++) {
+    uint32_t n = output_attrs[i].n_elems;
+    if (!outputs[i].buf || outputs[i].size < n * sizeof(float))
+      return -EINVAL;
+    float *f = static_cast<float *>(outputs[i].buf);
+    for (uint32_t j = 0; j < n; j++)
+      f[j] = (float)((input_sum + j) & 0xFFFFFF);
+  }
+  return 0;
+}
+
+DEFINE_NN_BACKEND_FACTORY(NNSimBackend)
+
+// A stand-in runtime which computes on the cpu, to measure the nn branches
+// without an npu. The model file is only its weights, as signed bytes; Run
+// spends the given multiply-accumulates on a dot product for each output:
+//   out[j] = sum(in[(j * K + k) % n_in] * w[(j * K + k) % n_w], k < K) / K
+// of the inputs one after another, j over the outputs one after another and
+// K = macs / all output elements, at least 1. So with K of the input of one
+// of a batch, each output is of its own part of the batch.
+// Params:
+//   KEY_PATH: the weights, shared by the instances, all 1 if not set
+//   KEY_NN_SIM_INPUTS, KEY_NN_SIM_OUTPUTS: as "sim"
+//   KEY_NN_CPU_MACS: of one run, in millions, 1 if not set
+class NNCpuBackend : public NNBackend {
+public:
+  NNCpuBackend(const char *param);
+  virtual ~NNCpuBackend() = default;
+  static const char *GetBackendName() { return "cpu"; }
+
+  virtual int SetInputs(const std::vector<NNInput> &inputs) override;
+  virtual int Run() override;
+  virtual int GetOutputs(std::vector<NNOutput> &outputs) override;
+
+private:
+  std::shared_ptr<NNModel> model;
+  std::vector<int8_t> default_weights;
+  const int8_t *weights;
+  size_t weight_num;
+  std::vector<uint8_t> input_mem; // all the inputs
+  std::vector<float> output_mem;  // all the outputs
+  size_t macs_per_output;
+};
+
+NNCpuBackend::NNCpuBackend(const char *param)
+    : weights(nullptr), weight_num(0), macs_per_output(1) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  std::string &in = params[KEY_NN_SIM_INPUTS];
+  std::string &out = params[KEY_NN_SIM_OUTPUTS];
+  input_attrs = parse_tensors(in.empty() ? "1x224x224x3" : in,
+                              TensorType::UINT8, TensorLayout::NHWC);
+  output_attrs = parse_tensors(out.empty() ? "1x1000" : out,
+                               TensorType::FLOAT32, TensorLayout::NCHW);
+  if (input_attrs.empty() || output_attrs.empty()) {
+    LOG("nn cpu: invalid tensors <%s> <%s>\n", in.c_str(), out.c_str());
+    SetError(-EINVAL);
+    return;
+  }
+  const std::string &path = params[KEY_PATH];
+  if (!path.empty()) {
+    model = NNModel::Open(path);
+    if (!model) {
+      SetError(-EINVAL);
+      return;
+    }
+    weights = static_cast<const int8_t *>(model->GetData());
+    weight_num = model->GetSize();
+  } else {
+    // long enough for the runs of dot_wrapped
+    default_weights.assign(4096, 1);
+    weights = default_weights.data();
+    weight_num = default_weights.size();
+  }
+  size_t in_size = 0, out_num = 0;
+  for (auto &a : input_attrs)
+    in_size += a.size;
+  for (auto &a : output_attrs)
+    out_num += a.n_elems;
+  input_mem.resize(in_size);
+  output_mem.resize(out_num);
+  double macs = 1.0;
+  const std::string &m = params[KEY_NN_CPU_MACS];
+  if (!m.empty())
+    macs = std::stod(m);
+  macs_per_output = (size_t)(macs * 1000000 / out_num + 0.5);
+  if (macs_per_output < 1)
+    macs_per_output = 1;
+}
+
+int NNCpuBackend::SetInputs(const std::vector<NNInput> &inputs) {
+  if (inputs.size() != input_attrs.size())
+    return -EINVAL;
+  uint8_t *mem = input_mem.data();
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (!inputs[i].buf || inputs[i].size != input_attrs[i].size) {
+      LOG("nn cpu: input %d of %u bytes, expect %u\n", (int)i, inputs[i].size,
+          input_attrs[i].size);
+      return -EINVAL;
+    }
+    memcpy(mem, inputs[i].buf, inputs[i].size);
+    mem += inputs[i].size;
+  }
+  return 0;
+}
+
+// sum(a[(ia + k) % na] * b[(ib + k) % nb], k < n), by the runs which wrap
+// neither, so the inner loop vectorises
+static int64_t dot_wrapped(const uint8_t *a, size_t na, size_t ia,
+                           const int8_t *b, size_t nb, size_t ib, size_t n) {
+  int64_t sum = 0;
+  while (n > 0) {
+    size_t len = std::min(n, std::min(na - ia, nb - ib));
+    int32_t acc = 0;
+    // 255 * 128 * 65536 fits int32
+    for (size_t done = 0; done < len;) {
+      size_t step = std::min(len - done, (size_t)65536);
+      for (size_t k = 0; k < step; k++)
+        acc += a[ia + k] * b[ib + k];
+      sum += acc;
+      acc = 0;
+      done += step;
+      ia += step;
+      ib += step;
+    }
+    n -= len;
+    if (ia == na)
+      ia = 0;
+    if (ib == nb)
+      ib = 0;
+  }
+  return sum;
+}
+
+int NNCpuBackend::Run() {
+  size_t n_in = input_mem.size();
+  size_t k = macs_per_output;
+  for (size_t j = 0; j < output_mem.size(); j++) {
+    int64_t sum = dot_wrapped(input_mem.data(), n_in, (j * k) % n_in, weights,
+                              weight_num, (j * k) % weight_num, k);
+    output_mem[j] = (float)((double)sum / k);
+  }
+  return 0;
+}
+
+int NNCpuBackend::GetOutputs(std::vector<NNOutput> &outputs) {
+  if (outputs.size() != output_attrs.size())
+    return -EINVAL;
+  const float *mem = output_mem.data();
+  for (size_t i = 0; i < outputs.size(); i++) {
+    uint32_t n = output_attrs[i].n_elems;
+    if (!outputs[i].buf || outputs[i].size < n * sizeof(float))
+      return -EINVAL;
+    memcpy(outputs[i].buf, mem, n * sizeof(float));
+    mem += n;
+  }
+  return 0;
+}
+
+DEFINE_NN_BACKEND_FACTORY(NNCpuBackend)
+
+} // namespace easymedia
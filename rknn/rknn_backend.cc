@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "nn_backend.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <rknn_runtime.h>
+
+namespace easymedia {
+
+// the outputs of rknn are given as NNOutput
+static_assert(sizeof(NNOutput) == sizeof(rknn_output), "NNOutput size");
+static_assert(offsetof(NNOutput, want_float) ==
+                  offsetof(rknn_output, want_float),
+              "NNOutput want_float");
+static_assert(offsetof(NNOutput, is_prealloc) ==
+                  offsetof(rknn_output, is_prealloc),
+              "NNOutput is_prealloc");
+static_assert(offsetof(NNOutput, index) == offsetof(rknn_output, index),
+              "NNOutput index");
+static_assert(offsetof(NNOutput, buf) == offsetof(rknn_output, buf),
+              "NNOutput buf");
+static_assert(offsetof(NNOutput, size) == offsetof(rknn_output, size),
+              "NNOutput size");
+
+// The npu of rockchip, by librknn_runtime. Params:
+//   KEY_PATH: the rknn model, required, shared by the instances
+class RKNNBackend : public NNBackend {
+public:
+  RKNNBackend(const char *param);
+  virtual ~RKNNBackend();
+  static const char *GetBackendName() { return "rknn"; }
+
+  virtual int SetInputs(const std::vector<NNInput> &inputs) override;
+  virtual int Run() override;
+  virtual int GetOutputs(std::vector<NNOutput> &outputs) override;
+
+private:
+  int QueryAttrs(rknn_query_cmd cmd, uint32_t num,
+                 std::vector<NNTensorAttr> &attrs);
+
+  std::shared_ptr<NNModel> model;
+  rknn_context ctx;
+  bool inited;
+};
+
+static const struct {
+  rknn_tensor_type rknn;
+  TensorType type;
+} tensor_types[] = {
+    {RKNN_TENSOR_FLOAT32, TensorType::FLOAT32},
+    {RKNN_TENSOR_FLOAT16, TensorType::FLOAT16},
+    {RKNN_TENSOR_INT8, TensorType::INT8},
+    {RKNN_TENSOR_UINT8, TensorType::UINT8},
+    {RKNN_TENSOR_INT16, TensorType::INT16},
+};
+
+static TensorType to_tensor_type(rknn_tensor_type t) {
+  for (auto &tt : tensor_types) {
+    if (tt.rknn == t)
+      return tt.type;
+  }
+  return TensorType::UINT8;
+}
+
+static rknn_tensor_type to_rknn_type(TensorType t) {
+  for (auto &tt : tensor_types) {
+    if (tt.type == t)
+      return tt.rknn;
+  }
+  return RKNN_TENSOR_UINT8;
+}
+
+static void print_rknn_tensor(rknn_tensor_attr *attr) {
+  LOG("index=%d name=%s n_dims=%d dims=[%d %d %d %d] n_elems=%d size=%d fmt=%d "
+      "type=%d qnt_type=%d fl=%d zp=%d scale=%f\n",
+      attr->index, attr->name, attr->n_dims, attr->dims[3], attr->dims[2],
+      attr->dims[1], attr->dims[0], attr->n_elems, attr->size, 0, attr->type,
+      attr->qnt_type, attr->fl, attr->zp, attr->scale);
+}
+
+RKNNBackend::RKNNBackend(const char *param) : ctx(0), inited(false) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  model = NNModel::Open(params[KEY_PATH]);
+  if (!model) {
+    LOG("Fail to load model\n");
+    SetError(-EINVAL);
+    return;
+  }
+  int ret = rknn_init(&ctx, model->GetData(), model->GetSize(), 0);
+  if (ret < 0) {
+    LOG("Fail to rknn_init, ret=%d\n", ret);
+    SetError(-EINVAL);
+    return;
+  }
+  inited = true;
+  rknn_input_output_num io_num;
+  memset(&io_num, 0, sizeof(io_num));
+  ret = rknn_query(ctx, RKNN_QUERY_IN_OUT_NUM, &io_num, sizeof(io_num));
+  if (ret != RKNN_SUCC) {
+    LOG("Fail to rknn_query IN_OUT_NUM fail, ret=%d\n", ret);
+    SetError(-EINVAL);
+    return;
+  }
+  LOG("model input num: %d, output num: %d\n", io_num.n_input, io_num.n_output);
+  LOG("input tensors:\n");
+  if (QueryAttrs(RKNN_QUERY_INPUT_ATTR, io_num.n_input, input_attrs)) {
+    SetError(-EINVAL);
+    return;
+  }
+  LOG("output tensors:\n");
+  if (QueryAttrs(RKNN_QUERY_OUTPUT_ATTR, io_num.n_output, output_attrs))
+    SetError(-EINVAL);
+}
+
+RKNNBackend::~RKNNBackend() {
+  if (inited)
+    rknn_destroy(ctx);
+}
+
+int RKNNBackend::QueryAttrs(rknn_query_cmd cmd, uint32_t num,
+                            std::vector<NNTensorAttr> &attrs) {
+  for (uint32_t i = 0; i < num; i++) {
+    rknn_tensor_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.index = i;
+    int ret = rknn_query(ctx, cmd, &attr, sizeof(attr));
+    if (ret != RKNN_SUCC) {
+      LOG("Fail to rknn_query %d fail, ret=%d\n", cmd, ret);
+      return ret;
+    }
+    print_rknn_tensor(&attr);
+    NNTensorAttr a;
+    a.index = attr.index;
+    a.name = attr.name;
+    // rknn has the innermost first
+    for (uint32_t d = attr.n_dims; d > 0; d--)
+      a.dims.push_back(attr.dims[d - 1]);
+    a.n_elems = attr.n_elems;
+    a.size = attr.size;
+    a.type = to_tensor_type(attr.type);
+    a.layout = (attr.fmt == RKNN_TENSOR_NCHW) ? TensorLayout::NCHW
+                                              : TensorLayout::NHWC;
+    a.scale = 1.0f;
+    a.zp = 0;
+    if (attr.qnt_type == RKNN_TENSOR_QNT_AFFINE_ASYMMETRIC) {
+      a.scale = attr.scale;
+      a.zp = attr.zp;
+    } else if (attr.qnt_type == RKNN_TENSOR_QNT_DFP) {
+      a.scale = ldexpf(1.0f, -attr.fl);
+    }
+    attrs.push_back(a);
+  }
+  return 0;
+}
+
+int RKNNBackend::SetInputs(const std::vector<NNInput> &inputs) {
+  uint32_t num = inputs.size();
+  rknn_input in[num];
+  memset(in, 0, sizeof(in));
+  for (uint32_t i = 0; i < num; i++) {
+    in[i].index = i;
+    in[i].buf = inputs[i].buf;
+    in[i].size = inputs[i].size;
+    in[i].type = to_rknn_type(inputs[i].type);
+    in[i].fmt = (inputs[i].layout == TensorLayout::NCHW) ? RKNN_TENSOR_NCHW
+                                                         : RKNN_TENSOR_NHWC;
+  }
+  int ret = rknn_inputs_set(ctx, num, in);
+  if (ret < 0) {
+    LOG("Fail to rknn_input_set, ret=%d\n", ret);
+    return -1;
+  }
+  return 0;
+}
+
+int RKNNBackend::Run() {
+  int ret = rknn_run(ctx, nullptr);
+  if (ret < 0) {
+    LOG("Fail to rknn_run, ret=%d\n", ret);
+    return -1;
+  }
+  return 0;
+}
+
+int RKNNBackend::GetOutputs(std::vector<NNOutput> &outputs) {
+  uint32_t num = outputs.size();
+  rknn_output out[num];
+  memset(out, 0, sizeof(out));
+  for (uint32_t i = 0; i < num; i++) {
+    out[i].want_float = outputs[i].want_float;
+    out[i].is_prealloc = 1;
+    out[i].index = i;
+    out[i].buf = outputs[i].buf;
+    out[i].size = outputs[i].size;
+  }
+  int ret = rknn_outputs_get(ctx, num, out, nullptr);
+  if (ret < 0) {
+    LOG("Fail to rknn_outputs_get, ret=%d\n", ret);
+    return -1;
+  }
+  rknn_outputs_release(ctx, num, out);
+  return 0;
+}
+
+DEFINE_NN_BACKEND_FACTORY(RKNNBackend)
+
+} // namespace easymedia
@@ -0,0 +1,426 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+
+#include "buffer.h"
+#include "buffer_pool.h"
+#include "filter.h"
+#include "image_tensor.h"
+#include "nn_backend.h"
+
+namespace easymedia {
+
+// Runs a model on the frames. The output buffer, of Type::NNResult, is an
+// array of NNOutput, one for each output tensor, of the timestamp of the
+// input; its NNResultMeta tells the tensors. A model of more
+// inputs takes a Type::Tensor input, whose TensorMeta::next_inputs are the
+// tensors of the other inputs. Params:
+//   KEY_NN_BACKEND: the NNBackend, "rknn" if not set, which takes the param
+//   too, such as KEY_PATH of the model
+//   KEY_TENSOR_TYPE, KEY_TENSOR_FMT: of the image inputs, NN_UINT8 and KEY_NHWC
+//   if not set; the Type::Tensor inputs of nnpreprocess tell their own
+//   KEY_OUTPUT_WANT_FLOAT: "1,0,..." for each output tensor
+//   KEY_NN_INFLIGHT: the inferences in flight, 1 if not set
+//   KEY_POOL_BUFFER_NUM: the output buffers of each tensor, 2 for each
+//   inference in flight if not set, more are allocated if all are in use
+// With one inference in flight, Process runs each frame to the end. With
+// more, each has an instance of the model and a thread: SendInput copies the
+// input into a free instance and returns, -EAGAIN if none is free, while the
+// others run; FetchOutput gives the outputs in the input order, waiting for
+// the oldest one only if none is free, or for all once the eof is sent, so
+// the last frames come out with it. So preparing the next frame, running
+// this one and reading the last one overlap. These outputs hold their
+// inputs, whose TensorMeta maps the detections back to the frames.
+class RKNNFilter : public Filter {
+public:
+  RKNNFilter(const char *param);
+  virtual ~RKNNFilter();
+  static const char *GetFilterName() { return "rknn"; }
+  virtual int Process(std::shared_ptr<MediaBuffer> input,
+                      std::shared_ptr<MediaBuffer> output) override;
+  virtual int SendInput(std::shared_ptr<MediaBuffer> input) override;
+  virtual std::shared_ptr<MediaBuffer> FetchOutput() override;
+
+private:
+  struct Job {
+    std::shared_ptr<MediaBuffer> output;
+    bool done;
+    int ret;
+  };
+  struct Lane {
+    std::shared_ptr<NNBackend> backend;
+    std::shared_ptr<Job> job; // set while the inference runs
+  };
+
+  int GetInput(MediaBuffer *input, NNInput &in);
+  int GetInputs(const std::shared_ptr<MediaBuffer> &input,
+                std::vector<NNInput> &inputs);
+  int PrepareOutput(const std::shared_ptr<MediaBuffer> &input,
+                    std::shared_ptr<MediaBuffer> output);
+  int Infer(NNBackend *backend, const std::shared_ptr<MediaBuffer> &input,
+            std::shared_ptr<MediaBuffer> output);
+  void RunLane(Lane *lane);
+
+  TensorType tensor_type;
+  TensorLayout tensor_fmt;
+  size_t input_num;
+  std::vector<bool> output_want_float;
+  std::vector<NNTensorAttr> result_attrs; // of the outputs as they are got
+  std::vector<uint32_t> output_sizes;
+  std::vector<std::shared_ptr<BufferPool>> pools;
+
+  int depth;
+  std::vector<Lane> lanes;
+  std::vector<std::thread> threads;
+  std::mutex mtx;
+  std::condition_variable cond;
+  std::list<std::shared_ptr<Job>> in_flight;
+  int eof_in_flight;
+  bool quit;
+};
+
+RKNNFilter::RKNNFilter(const char *param)
+    : tensor_type(TensorType::UINT8), tensor_fmt(TensorLayout::NHWC),
+      input_num(1), depth(1), eof_in_flight(0), quit(false) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  const std::string &type = params[KEY_TENSOR_TYPE];
+  const std::string &fmt = params[KEY_TENSOR_FMT];
+  if ((!type.empty() && !GetTensorTypeByString(type.c_str(), tensor_type)) ||
+      (!fmt.empty() && !GetTensorLayoutByString(fmt.c_str(), tensor_fmt))) {
+    LOG("incorrect tensor type or tensor fmt\n");
+    SetError(-EINVAL);
+    return;
+  }
+  const std::string &n = params[KEY_NN_INFLIGHT];
+  if (!n.empty())
+    depth = std::stoi(n);
+  if (depth < 1) {
+    LOG("rknn: %d inferences in flight\n", depth);
+    SetError(-EINVAL);
+    return;
+  }
+  std::string backend_name = params[KEY_NN_BACKEND];
+  if (backend_name.empty())
+    backend_name = "rknn";
+  lanes.resize(depth);
+  for (auto &lane : lanes) {
+    lane.backend =
+        REFLECTOR(NNBackend)::Create<NNBackend>(backend_name.c_str(), param);
+    if (!lane.backend) {
+      LOG("Fail to create nn backend %s\n", backend_name.c_str());
+      SetError(-EINVAL);
+      return;
+    }
+  }
+  NNBackend *backend = lanes[0].backend.get();
+  input_num = backend->GetInputAttrs().size();
+  const auto &attrs = backend->GetOutputAttrs();
+  const std::string &want_float = params[KEY_OUTPUT_WANT_FLOAT];
+  if (!want_float.empty()) {
+    std::list<std::string> value_list;
+    if (!parse_media_param_list(want_float.c_str(), value_list, ',')) {
+      SetError(-EINVAL);
+      return;
+    }
+    if (value_list.size() != attrs.size()) {
+      LOG("warning: input want floats [%d] not match model n_output [%d]\n",
+          (int)value_list.size(), (int)attrs.size());
+    }
+    for (auto &s : value_list)
+      output_want_float.push_back(!!std::stoi(s));
+  }
+  output_want_float.resize(attrs.size(), false);
+  int num = depth * 2;
+  const std::string &pn = params[KEY_POOL_BUFFER_NUM];
+  if (!pn.empty())
+    num = std::stoi(pn);
+  for (size_t i = 0; i < attrs.size(); i++) {
+    result_attrs.push_back(GetNNOutputAttr(attrs[i], output_want_float[i]));
+    uint32_t size = result_attrs[i].size;
+    output_sizes.push_back(size);
+    pools.push_back(num > 0 ? std::make_shared<BufferPool>(
+                                  num, size, MediaBuffer::MemType::MEM_COMMON,
+                                  "rknn_output")
+                            : nullptr);
+  }
+  if (depth > 1) {
+    for (auto &lane : lanes)
+      threads.emplace_back(&RKNNFilter::RunLane, this, &lane);
+  }
+}
+
+RKNNFilter::~RKNNFilter() {
+  {
+    std::lock_guard<std::mutex> _lg(mtx);
+    quit = true;
+  }
+  cond.notify_all();
+  for (auto &th : threads)
+    th.join();
+}
+
+int RKNNFilter::GetInput(MediaBuffer *input, NNInput &in) {
+  in.buf = input->GetPtr();
+  in.size = input->GetValidSize();
+  in.type = tensor_type;
+  in.layout = tensor_fmt;
+  if (input->GetType() == Type::Tensor) {
+    // made by nnpreprocess, which tells the type and the layout
+    const TensorSpec &spec = GetTensorMeta(*input)->spec;
+    in.type = spec.type;
+    in.layout = spec.layout;
+  } else if (input->GetType() != Type::Image) {
+    return -EINVAL;
+  }
+  return 0;
+}
+
+int RKNNFilter::GetInputs(const std::shared_ptr<MediaBuffer> &input,
+                          std::vector<NNInput> &inputs) {
+  inputs.resize(1);
+  int ret = GetInput(input.get(), inputs[0]);
+  if (ret || input_num == 1)
+    return ret;
+  TensorMeta *meta = GetTensorMeta(*input);
+  if (!meta || meta->next_inputs.size() + 1 != input_num) {
+    LOG("rknn: the model takes %d input tensors\n", (int)input_num);
+    return -EINVAL;
+  }
+  for (auto &next : meta->next_inputs) {
+    NNInput in;
+    if (!next)
+      return -EINVAL;
+    ret = GetInput(next.get(), in);
+    if (ret)
+      return ret;
+    inputs.push_back(in);
+  }
+  return 0;
+}
+
+int RKNNFilter::PrepareOutput(const std::shared_ptr<MediaBuffer> &input,
+                              std::shared_ptr<MediaBuffer> output) {
+  auto outs = std::make_shared<NNResultMeta>();
+  outs->attrs = result_attrs;
+  for (size_t i = 0; i < output_sizes.size(); i++) {
+    uint32_t size = output_sizes[i];
+    std::shared_ptr<MediaBuffer> mb = pools[i] ? pools[i]->Get() : nullptr;
+    if (!mb)
+      mb = MediaBuffer::Alloc(size, MediaBuffer::MemType::MEM_COMMON,
+                              "rknn_output");
+    if (!mb || !mb->GetPtr()) {
+      LOG_NO_MEMORY();
+      return -ENOMEM;
+    }
+    NNOutput o;
+    memset(&o, 0, sizeof(o));
+    o.want_float = output_want_float[i] ? 1 : 0;
+    o.is_prealloc = 1;
+    o.index = i;
+    o.buf = mb->GetPtr();
+    o.size = size;
+    outs->outputs.push_back(o);
+    outs->memory.push_back(mb);
+  }
+  output->SetPtr(outs->outputs.data());
+  output->SetSize(outs->outputs.size() * sizeof(NNOutput));
+  output->SetUserData(outs);
+  output->SetType(Type::NNResult);
+  output->SetValidSize(outs->outputs.size());
+  output->SetTimeStamp(input->GetTimeStamp());
+  return 0;
+}
+
+static int get_outputs(NNBackend *backend,
+                       const std::shared_ptr<MediaBuffer> &output) {
+  NNOutput *o = static_cast<NNOutput *>(output->GetPtr());
+  std::vector<NNOutput> outputs(o, o + output->GetValidSize());
+  int ret = backend->GetOutputs(outputs);
+  if (ret < 0)
+    LOG("Fail to get the nn outputs, ret=%d\n", ret);
+  return ret;
+}
+
+int RKNNFilter::Infer(NNBackend *backend,
+                      const std::shared_ptr<MediaBuffer> &input,
+                      std::shared_ptr<MediaBuffer> output) {
+  std::vector<NNInput> inputs;
+  int ret = GetInputs(input, inputs);
+  if (ret)
+    return ret;
+  ret = backend->SetInputs(inputs);
+  if (ret < 0) {
+    LOG("Fail to set the nn inputs, ret=%d\n", ret);
+    return -1;
+  }
+  ret = backend->Run();
+  if (ret < 0) {
+    LOG("Fail to run the nn, ret=%d\n", ret);
+    return -1;
+  }
+  ret = PrepareOutput(input, output);
+  if (ret)
+    return ret;
+  return get_outputs(backend, output) < 0 ? -1 : 0;
+}
+
+int RKNNFilter::Process(std::shared_ptr<MediaBuffer> input,
+                        std::shared_ptr<MediaBuffer> output) {
+  if (!input || !input->IsValid())
+    return -EINVAL;
+  if (!output)
+    return -EINVAL;
+  if (depth > 1) {
+    errno = ENOSYS;
+    return -1;
+  }
+  return Infer(lanes[0].backend.get(), input, output);
+}
+
+void RKNNFilter::RunLane(Lane *lane) {
+  std::unique_lock<std::mutex> lk(mtx);
+  while (true) {
+    cond.wait(lk, [&] { return quit || lane->job; });
+    if (!lane->job)
+      break;
+    auto job = lane->job;
+    lk.unlock();
+    int ret = lane->backend->Run();
+    if (ret < 0)
+      LOG("Fail to run the nn, ret=%d\n", ret);
+    else
+      ret = get_outputs(lane->backend.get(), job->output);
+    lk.lock();
+    job->ret = ret < 0 ? -1 : 0;
+    job->done = true;
+    lane->job.reset();
+    cond.notify_all();
+  }
+}
+
+int RKNNFilter::SendInput(std::shared_ptr<MediaBuffer> input) {
+  if (depth <= 1) {
+    errno = ENOSYS;
+    return -1;
+  }
+  if (!input)
+    return 0;
+  auto job = std::make_shared<Job>();
+  job->done = false;
+  job->ret = 0;
+  job->output = std::make_shared<MediaBuffer>();
+  if (!input->IsValid()) {
+    if (!input->IsEOF())
+      return 0;
+    // nothing to run, FetchOutput gives the eof in order
+    job->output->SetEOF(true);
+    job->output->SetTimeStamp(input->GetTimeStamp());
+    job->done = true;
+    std::lock_guard<std::mutex> _lg(mtx);
+    in_flight.push_back(job);
+    eof_in_flight++;
+    return 0;
+  }
+  Lane *lane = nullptr;
+  {
+    std::lock_guard<std::mutex> _lg(mtx);
+    if ((int)in_flight.size() >= depth)
+      return -EAGAIN;
+    // the lanes only turn free meanwhile
+    for (auto &l : lanes) {
+      if (!l.job) {
+        lane = &l;
+        break;
+      }
+    }
+  }
+  // less jobs than lanes in flight, so one is free
+  assert(lane);
+  std::vector<NNInput> inputs;
+  int ret = GetInputs(input, inputs);
+  if (ret)
+    return ret;
+  ret = PrepareOutput(input, job->output);
+  if (ret)
+    return ret;
+  ret = lane->backend->SetInputs(inputs);
+  if (ret < 0) {
+    LOG("Fail to set the nn inputs, ret=%d\n", ret);
+    return -1;
+  }
+  job->output->SetRelatedSPtr(input, 0);
+  job->output->SetEOF(input->IsEOF());
+  {
+    std::lock_guard<std::mutex> _lg(mtx);
+    lane->job = job;
+    in_flight.push_back(job);
+    if (input->IsEOF())
+      eof_in_flight++;
+  }
+  cond.notify_all();
+  return 0;
+}
+
+std::shared_ptr<MediaBuffer> RKNNFilter::FetchOutput() {
+  errno = 0;
+  if (depth <= 1) {
+    errno = ENOSYS;
+    return nullptr;
+  }
+  std::unique_lock<std::mutex> lk(mtx);
+  while (!in_flight.empty()) {
+    auto job = in_flight.front();
+    if (!job->done) {
+      // a full pipeline takes no input till the oldest one is done, and no
+      // input follows the eof to push the rest out
+      if ((int)in_flight.size() < depth && !eof_in_flight)
+        return nullptr;
+      cond.wait(lk, [&] { return job->done; });
+    }
+    in_flight.pop_front();
+    if (job->output->IsEOF())
+      eof_in_flight--;
+    if (!job->ret)
+      return job->output;
+    LOG("rknn: drop the frame of %lld ms\n",
+        (long long)job->output->GetTimeStamp());
+  }
+  return nullptr;
+}
+
+DEFINE_COMMON_FILTER_FACTORY(RKNNFilter)
+const char *FACTORY(RKNNFilter)::ExpectedInputDataType() {
+  return TYPE_ANYTHING;
+}
+const char *FACTORY(RKNNFilter)::OutPutDataType() { return TYPE_ANYTHING; }
+
+} // namespace easymedia
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+// Check the model files are mapped once for all the detectors which run
+// them, and the outputs of the cpu stand-in are the ones of its formula;
+// print the time of one run of the cpu stand-in.
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "filter.h"
+#include "key_string.h"
+#include "nn_backend.h"
+
+using easymedia::Filter;
+using easymedia::MediaBuffer;
+using easymedia::NNModel;
+using easymedia::NNOutput;
+
+static const int kInputs = 32 * 32 * 3;
+static const int kOutputs = 100;
+
+// the formula of the cpu stand-in, nn_sim_backend.cc
+static float expected_output(const std::vector<uint8_t> &in,
+                             const std::vector<int8_t> &w, size_t macs,
+                             size_t j) {
+  size_t k = macs / kOutputs;
+  int64_t sum = 0;
+  for (size_t i = 0; i < k; i++)
+    sum += in[(j * k + i) % in.size()] * w[(j * k + i) % w.size()];
+  return (float)((double)sum / k);
+}
+
+static std::shared_ptr<Filter> create(const std::string &path,
+                                      const char *macs) {
+  std::string param;
+  PARAM_STRING_APPEND(param, KEY_NN_BACKEND, "cpu");
+  PARAM_STRING_APPEND(param, KEY_PATH, path);
+  PARAM_STRING_APPEND(param, KEY_NN_SIM_INPUTS, "1x32x32x3");
+  PARAM_STRING_APPEND_TO(param, KEY_NN_SIM_OUTPUTS, kOutputs);
+  PARAM_STRING_APPEND(param, KEY_NN_CPU_MACS, macs);
+  return easymedia::REFLECTOR(Filter)::Create<Filter>("rknn", param.c_str());
+}
+
+static std::shared_ptr<MediaBuffer> run(Filter *filter,
+                                        std::vector<uint8_t> &in) {
+  ImageInfo info = {PIX_FMT_RGB888, 32, 32, 32, 32};
+  MediaBuffer mb(in.data(), in.size());
+  auto input = std::make_shared<easymedia::ImageBuffer>(mb, info);
+  auto output = std::make_shared<MediaBuffer>();
+  assert(!filter->Process(input, output));
+  return output;
+}
+
+static const float *output_of(const std::shared_ptr<MediaBuffer> &out) {
+  assert(out->GetValidSize() == 1);
+  auto *o = static_cast<NNOutput *>(out->GetPtr());
+  return static_cast<const float *>(o->buf);
+}
+
+int main() {
+  // a whole number of pages, the padding is out of the file
+  std::vector<int8_t> weights(256 * 4096);
+  for (auto &w : weights)
+    w = (int8_t)(rand() & 0xFF);
+  char path[] = "/tmp/nn_backend_test_XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  assert(write(fd, weights.data(), weights.size()) == (ssize_t)weights.size());
+  close(fd);
+
+  {
+    auto model = NNModel::Open(path);
+    assert(model && model->GetSize() == weights.size());
+    assert(!memcmp(model->GetData(), weights.data(), weights.size()));
+    const uint8_t *pad = (const uint8_t *)model->GetData() + weights.size();
+    for (size_t i = 0; i < NNModel::kPadding; i++)
+      assert(pad[i] == 0);
+    std::string other = std::string("/tmp/./") + (path + 5);
+    assert(NNModel::Open(other) == model);
+  }
+  assert(!NNModel::Open("/tmp/nn_backend_test_none"));
+
+  std::vector<uint8_t> in(kInputs);
+  for (auto &v : in)
+    v = (uint8_t)(rand() & 0xFF);
+  {
+    auto a = create(path, "0.5");
+    auto b = create(path, "0.5");
+    assert(a && b);
+    auto model = NNModel::Open(path);
+    // one mapping for both
+    assert(model.use_count() == 3);
+    auto out_a = run(a.get(), in);
+    const float *oa = output_of(out_a);
+    auto out_b = run(b.get(), in);
+    const float *ob = output_of(out_b);
+    for (int j = 0; j < kOutputs; j++) {
+      assert(oa[j] == expected_output(in, weights, 500000, j));
+      assert(ob[j] == oa[j]);
+    }
+  }
+  // unmapped with the last one
+  assert(NNModel::Open(path).use_count() == 1);
+
+  auto filter = create(path, "100");
+  assert(filter);
+  const int runs = 20;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < runs; i++)
+    run(filter.get(), in);
+  auto end = std::chrono::steady_clock::now();
+  double ms =
+      std::chrono::duration<double, std::milli>(end - begin).count() / runs;
+  printf("cpu stand-in: %.2f ms per run of 100M macs, %.2f GMAC/s\n", ms,
+         0.1 / ms * 1000);
+  unlink(path);
+  printf("ok\n");
+  return 0;
+}
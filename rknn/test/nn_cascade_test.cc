@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+// Run a classifier of the cpu stand-in on the crops of a frame of many
+// objects and check each result is of its crop; a multi-input model by the
+// rknn filter; the nncascade flow; and print the runs and the time per frame
+// by batches and by one run per crop on the simulated npu.
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "filter.h"
+#include "flow.h"
+#include "key_string.h"
+#include "nn_cascade.h"
+
+using easymedia::MediaBuffer;
+using easymedia::NNBackend;
+using easymedia::NNCascade;
+using easymedia::NNDetection;
+using easymedia::NNOutput;
+
+// a grid of 10x10 cells of 64x48, each of its own value
+static const int kCellW = 64, kCellH = 48;
+
+static uint8_t cell_value(int cell) { return (uint8_t)(20 + cell * 2); }
+
+struct Frame {
+  Frame() : info({PIX_FMT_RGB888, 640, 480, 640, 480}) {
+    mb = MediaBuffer::Alloc2(CalPixFmtSize(info));
+    uint8_t *p = static_cast<uint8_t *>(mb.GetPtr());
+    for (int y = 0; y < info.height; y++)
+      for (int x = 0; x < info.width; x++)
+        memset(p + (y * info.width + x) * 3,
+               cell_value(y / kCellH * 10 + x / kCellW), 3);
+    bool ret = easymedia::GetCpuImage(img, p, info);
+    assert(ret);
+  }
+  ImageInfo info;
+  MediaBuffer mb;
+  easymedia::CpuImage img;
+};
+
+// n objects inside their cells, of distinct scores in a shuffled order
+static std::vector<NNDetection> objects(int n) {
+  std::vector<NNDetection> dets;
+  for (int i = 0; i < n; i++) {
+    int cell = (i * 37) % 100;
+    NNDetection d;
+    d.box = {cell % 10 * kCellW + 8, cell / 10 * kCellH + 8, 48, 32};
+    d.cls = cell;
+    d.score = (float)((i * 53) % n) / n;
+    dets.push_back(d);
+  }
+  return dets;
+}
+
+static std::shared_ptr<NNBackend> backend(const char *name, int batch,
+                                          int latency_us) {
+  std::string param;
+  PARAM_STRING_APPEND(param, KEY_NN_SIM_INPUTS,
+                      std::to_string(batch) + "x16x16x3");
+  PARAM_STRING_APPEND(param, KEY_NN_SIM_OUTPUTS,
+                      std::to_string(batch) + "x1");
+  // a mean of each crop, see the cpu stand-in
+  PARAM_STRING_APPEND(param, KEY_NN_CPU_MACS,
+                      std::to_string(16 * 16 * 3 * batch / 1e6));
+  PARAM_STRING_APPEND_TO(param, KEY_NN_SIM_LATENCY, latency_us);
+  return easymedia::REFLECTOR(NNBackend)::Create<NNBackend>(name,
+                                                            param.c_str());
+}
+
+static std::unique_ptr<NNCascade> cascade(std::shared_ptr<NNBackend> nn,
+                                          int max_crops) {
+  easymedia::TensorSpec spec;
+  spec.letterbox = false;
+  std::unique_ptr<NNCascade> c(
+      new NNCascade(nn, spec, max_crops, std::vector<bool>()));
+  bool ret = c->Init();
+  assert(ret);
+  return c;
+}
+
+static int run(NNCascade *c, const Frame &frame,
+               const std::vector<NNDetection> &dets,
+               std::vector<NNDetection> &crops, std::vector<float> &results) {
+  results.resize(c->GetOutputSize(0) / sizeof(float));
+  std::vector<NNOutput> outputs(1);
+  outputs[0].buf = results.data();
+  outputs[0].size = c->GetOutputSize(0);
+  int runs = c->Run(frame.img, dets, crops, outputs);
+  assert(runs >= 0);
+  assert(outputs[0].size == crops.size() * sizeof(float));
+  results.resize(crops.size());
+  return runs;
+}
+
+static void test_crops() {
+  Frame frame;
+  auto dets = objects(40);
+  for (int batch : {1, 8}) {
+    auto c = cascade(backend("cpu", batch, 0), 24);
+    assert(c->GetBatch() == batch && c->GetCropOutputSize(0) == 4);
+    std::vector<NNDetection> crops;
+    std::vector<float> results;
+    int runs = run(c.get(), frame, dets, crops, results);
+    assert(crops.size() == 24 && runs == (24 + batch - 1) / batch);
+    for (size_t i = 0; i < crops.size(); i++) {
+      // the highest scores first
+      assert(crops[i].score == (float)(39 - i) / 40);
+      assert(results[i] == cell_value(crops[i].cls));
+    }
+  }
+  // clipped to the frame, the empty ones dropped
+  std::vector<NNDetection> edge(2);
+  edge[0] = {{600, 440, 100, 100}, 99, 0.9f};
+  edge[1] = {{-50, 0, 40, 40}, 0, 0.8f};
+  auto c = cascade(backend("cpu", 8, 0), 16);
+  std::vector<NNDetection> crops;
+  std::vector<float> results;
+  assert(run(c.get(), frame, edge, crops, results) == 1);
+  assert(crops.size() == 1 && crops[0].box.w == 40 && crops[0].box.h == 40);
+  assert(results[0] == cell_value(99));
+  assert(run(c.get(), frame, std::vector<NNDetection>(), crops, results) ==
+         0);
+  printf("crops ok\n");
+}
+
+// two inputs, the second by TensorMeta::next_inputs
+static void test_multi_input() {
+  std::string param;
+  PARAM_STRING_APPEND(param, KEY_NN_BACKEND, "cpu");
+  PARAM_STRING_APPEND(param, KEY_NN_SIM_INPUTS, "1x4x4x3,1x4x4x3");
+  PARAM_STRING_APPEND(param, KEY_NN_SIM_OUTPUTS, "2");
+  PARAM_STRING_APPEND(param, KEY_NN_CPU_MACS, "0.000096");
+  auto nn = easymedia::REFLECTOR(Filter)::Create<easymedia::Filter>(
+      "rknn", param.c_str());
+  assert(nn);
+  std::vector<uint8_t> a(48, 10), b(48, 30);
+  auto first = std::make_shared<MediaBuffer>(a.data(), a.size());
+  first->SetValidSize(a.size());
+  first->SetType(Type::Tensor);
+  auto meta = std::make_shared<easymedia::TensorMeta>();
+  auto second = std::make_shared<MediaBuffer>(b.data(), b.size());
+  second->SetValidSize(b.size());
+  second->SetType(Type::Image);
+  meta->next_inputs.push_back(second);
+  first->SetUserData(meta);
+  auto out = std::make_shared<MediaBuffer>();
+  assert(!nn->Process(first, out));
+  auto *o = static_cast<NNOutput *>(out->GetPtr());
+  const float *f = static_cast<const float *>(o->buf);
+  assert(f[0] == 10 && f[1] == 30);
+  // missing the second
+  meta->next_inputs.clear();
+  assert(nn->Process(first, out));
+  printf("multi input ok\n");
+}
+
+// Takes the outputs of the cascade flow.
+class SinkFlow : public easymedia::Flow {
+public:
+  SinkFlow() {
+    easymedia::SlotMap sm;
+    sm.input_slots.push_back(0);
+    sm.process = Collect;
+    sm.thread_model = easymedia::Model::SYNC;
+    bool ret = InstallSlotMap(sm, "sink", -1);
+    assert(ret);
+  }
+  virtual ~SinkFlow() { StopAllThread(); }
+  std::vector<std::shared_ptr<MediaBuffer>> outputs;
+
+private:
+  static bool Collect(easymedia::Flow *f,
+                      easymedia::MediaBufferVector &input_vector) {
+    static_cast<SinkFlow *>(f)->outputs.push_back(input_vector[0]);
+    return true;
+  }
+};
+
+static void test_flow() {
+  std::string param;
+  PARAM_STRING_APPEND(param, KEY_NN_BACKEND, "cpu");
+  PARAM_STRING_APPEND(param, KEY_NN_SIM_INPUTS, "4x16x16x3");
+  PARAM_STRING_APPEND(param, KEY_NN_SIM_OUTPUTS, "4x1");
+  PARAM_STRING_APPEND(param, KEY_NN_CPU_MACS, "0.003072");
+  PARAM_STRING_APPEND_TO(param, KEY_NN_CASCADE_MAX_CROPS, 6);
+  PARAM_STRING_APPEND_TO(param, KEY_LETTERBOX, 0);
+  PARAM_STRING_APPEND(param, KEK_THREAD_SYNC_MODEL, KEY_SYNC);
+  auto flow = easymedia::REFLECTOR(Flow)::Create<easymedia::Flow>(
+      "nncascade", param.c_str());
+  assert(flow);
+  auto sink = std::make_shared<SinkFlow>();
+  flow->AddDownFlow(sink, 0, 0);
+
+  Frame frame;
+  auto image = std::make_shared<easymedia::ImageBuffer>(frame.mb, frame.info);
+  image->SetTimeStamp(1234);
+  auto dets = objects(10);
+  std::shared_ptr<MediaBuffer> in = std::make_shared<MediaBuffer>(
+      dets.data(), dets.size() * sizeof(NNDetection));
+  in->SetValidSize(dets.size());
+  in->SetType(Type::Detection);
+  in->SetRelatedSPtr(image, 0);
+  flow->SendInput(in, 0);
+  flow->RemoveDownFlow(sink);
+
+  assert(sink->outputs.size() == 1);
+  auto &out = sink->outputs[0];
+  assert(out->GetTimeStamp() == 1234 && out->GetValidSize() == 1);
+  auto crops = std::static_pointer_cast<MediaBuffer>(out->GetRelatedSPtrs()[0]);
+  assert(crops->GetValidSize() == 6 && crops->GetRelatedSPtrs()[0] == image);
+  auto *c = static_cast<const NNDetection *>(crops->GetPtr());
+  auto *o = static_cast<NNOutput *>(out->GetPtr());
+  assert(o->size == 6 * sizeof(float));
+  auto *meta = easymedia::GetNNResultMeta(*out);
+  assert(meta && meta->attrs[0].dims[0] == 6 && meta->attrs[0].size == o->size);
+  for (int i = 0; i < 6; i++)
+    assert(static_cast<const float *>(o->buf)[i] == cell_value(c[i].cls));
+  printf("flow ok\n");
+}
+
+static void bench() {
+  Frame frame;
+  const int latency_us = 1500, frames = 10;
+  for (int objs : {4, 16, 64}) {
+    auto dets = objects(objs);
+    double ms[2];
+    int runs[2];
+    for (int b = 0; b < 2; b++) {
+      auto c = cascade(backend("sim", b ? 8 : 1, latency_us), 64);
+      std::vector<NNDetection> crops;
+      std::vector<float> results;
+      auto begin = std::chrono::steady_clock::now();
+      for (int i = 0; i < frames; i++)
+        runs[b] = run(c.get(), frame, dets, crops, results);
+      auto end = std::chrono::steady_clock::now();
+      ms[b] = std::chrono::duration<double, std::milli>(end - begin).count() /
+              frames;
+    }
+    printf("%2d crops, npu %.1f ms a run: one per crop %2d runs %.2f ms, "
+           "batches of 8 %d runs %.2f ms\n",
+           objs, latency_us / 1000.0, runs[0], ms[0], runs[1], ms[1]);
+  }
+}
+
+int main() {
+  test_crops();
+  test_multi_input();
+  test_flow();
+  bench();
+  return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+// Run nnpreprocess and the rknn filter on the simulated npu, check the
+// outputs come in the input order with the timestamps and the values of
+// their inputs, and print the time per frame of each depth.
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <deque>
+#include <string>
+
+#include "buffer.h"
+#include "filter.h"
+#include "image_tensor.h"
+#include "key_string.h"
+#include "nn_backend.h"
+
+using easymedia::Filter;
+using easymedia::MediaBuffer;
+
+static const int kFrames = 60;
+static const int kLatencyUs = 6000;
+
+struct Expected {
+  int64_t timestamp;
+  float value;
+  std::shared_ptr<MediaBuffer> tensor;
+};
+
+static float tensor_value(const std::shared_ptr<MediaBuffer> &tensor) {
+  const uint8_t *p = static_cast<const uint8_t *>(tensor->GetPtr());
+  uint32_t sum = 0;
+  for (size_t i = 0; i < tensor->GetValidSize(); i++)
+    sum += p[i];
+  return (float)(sum & 0xFFFFFF);
+}
+
+static void check(const std::shared_ptr<MediaBuffer> &out,
+                  std::deque<Expected> &expected, bool pipelined) {
+  assert(!expected.empty());
+  Expected &e = expected.front();
+  assert(out->GetTimeStamp() == e.timestamp);
+  assert(out->GetValidSize() == 2);
+  auto *o = static_cast<easymedia::NNOutput *>(out->GetPtr());
+  assert(o[0].index == 0 && o[1].index == 1);
+  assert(o[0].size == 1000 * sizeof(float) && o[1].size == 4 * sizeof(float));
+  const float *f = static_cast<const float *>(o[0].buf);
+  assert(f[0] == e.value && f[1] == e.value + 1);
+  assert(static_cast<const float *>(o[1].buf)[0] == e.value);
+  if (pipelined)
+    assert(out->GetRelatedSPtrs()[0] == e.tensor);
+  expected.pop_front();
+}
+
+// As the filter flow does for each input: send it, then fetch till nothing
+// comes; an input not taken is sent again. Return false if not taken.
+static bool send_fetch(Filter *nn, const std::shared_ptr<MediaBuffer> &input,
+                       std::deque<Expected> &expected) {
+  int ret = nn->SendInput(input);
+  assert(!ret || ret == -EAGAIN);
+  bool eof = false;
+  while (auto out = nn->FetchOutput()) {
+    assert(!eof);
+    if (out->IsEOF() && !out->IsValid())
+      eof = true;
+    else
+      check(out, expected, true);
+  }
+  assert(eof == (!ret && input->IsEOF()));
+  return !ret;
+}
+
+static double run(int depth) {
+  std::string pre_param;
+  PARAM_STRING_APPEND_TO(pre_param, KEY_BUFFER_WIDTH, 640);
+  PARAM_STRING_APPEND_TO(pre_param, KEY_BUFFER_HEIGHT, 640);
+  PARAM_STRING_APPEND_TO(pre_param, KEY_POOL_BUFFER_NUM, depth + 2);
+  auto pre = easymedia::REFLECTOR(Filter)::Create<Filter>(
+      "nnpreprocess", pre_param.c_str());
+  assert(pre);
+  std::string nn_param;
+  PARAM_STRING_APPEND(nn_param, KEY_NN_BACKEND, "sim");
+  PARAM_STRING_APPEND(nn_param, KEY_NN_SIM_INPUTS, "1x640x640x3");
+  PARAM_STRING_APPEND(nn_param, KEY_NN_SIM_OUTPUTS, "1x1000,1x4");
+  PARAM_STRING_APPEND_TO(nn_param, KEY_NN_SIM_LATENCY, kLatencyUs);
+  PARAM_STRING_APPEND_TO(nn_param, KEY_NN_INFLIGHT, depth);
+  auto nn =
+      easymedia::REFLECTOR(Filter)::Create<Filter>("rknn", nn_param.c_str());
+  assert(nn);
+  bool pipelined = depth > 1;
+  assert(pipelined == (nn->SendInput(nullptr) == 0));
+
+  ImageInfo info = {PIX_FMT_NV12, 1280, 720, 1280, 720};
+  auto mb = MediaBuffer::Alloc2(CalPixFmtSize(info));
+  auto frame = std::make_shared<easymedia::ImageBuffer>(mb, info);
+  std::deque<Expected> expected;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < kFrames; i++) {
+    memset(frame->GetPtr(), 16 + i, frame->GetValidSize());
+    frame->SetTimeStamp(i * 40);
+    auto tensor = std::make_shared<MediaBuffer>();
+    assert(!pre->Process(frame, tensor));
+    expected.push_back({tensor->GetTimeStamp(), tensor_value(tensor), tensor});
+    if (!pipelined) {
+      auto out = std::make_shared<MediaBuffer>();
+      assert(!nn->Process(tensor, out));
+      check(out, expected, false);
+      continue;
+    }
+    while (!send_fetch(nn.get(), tensor, expected))
+      ;
+  }
+  if (pipelined) {
+    auto eof = std::make_shared<MediaBuffer>();
+    eof->SetEOF(true);
+    // the eof drains the pipeline at once
+    assert(send_fetch(nn.get(), eof, expected));
+  }
+  assert(expected.empty());
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - begin).count() /
+         kFrames;
+}
+
+int main() {
+  double sync_ms = run(1);
+  printf("sync: %.2f ms per frame, the npu takes %.2f\n", sync_ms,
+         kLatencyUs / 1000.0);
+  for (int depth = 2; depth <= 3; depth++) {
+    double ms = run(depth);
+    printf("%d in flight: %.2f ms per frame, %.2fx\n", depth, ms,
+           sync_ms / ms);
+  }
+  std::string bad_param;
+  PARAM_STRING_APPEND(bad_param, KEY_NN_BACKEND, "sim");
+  PARAM_STRING_APPEND(bad_param, KEY_NN_SIM_INPUTS, "1x0x3");
+  assert(!easymedia::REFLECTOR(Filter)::Create<Filter>("rknn",
+                                                       bad_param.c_str()));
+  printf("ok\n");
+  return 0;
+}
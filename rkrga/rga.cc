@@ -93,7 +93,8 @@ int RgaFilter::Process(std::shared_ptr<MediaBuffer> input,
     size_t size = CalPixFmtSize(info);
     if (size == 0)
       return -EINVAL;
-    auto &&mb = MediaBuffer::Alloc2(size, MediaBuffer::MemType::MEM_HARD_WARE);
+    auto &&mb = MediaBuffer::Alloc2(size, MediaBuffer::MemType::MEM_HARD_WARE,
+                                    "rkrga");
     ImageBuffer ib(mb, info);
     if (ib.GetSize() >= size) {
       ib.SetValidSize(size);
@@ -126,43 +127,87 @@ static int get_rga_format(PixelFormat f) {
   return -1;
 }
 
+// Rga takes an image packed by a virtual size in one buffer. The explicit
+// planes are taken if they are of such layout, otherwise false, then rga_blit
+// goes by a packed copy. A crop view is the rect of origin in its parent.
+static bool get_rga_layout(ImageBuffer *ib, int &fd, int &vir_w, int &vir_h,
+                           ImageRect &origin) {
+  fd = ib->GetFD();
+  vir_w = ib->GetVirWidth();
+  vir_h = ib->GetVirHeight();
+  origin = {0, 0, ib->GetWidth(), ib->GetHeight()};
+  if (!ib->HasExplicitPlanes())
+    return true;
+  ImagePlane planes[IMAGE_MAX_PLANES];
+  int num = ib->GetPlanes(planes);
+  if (!GetVirRectOfPlanes(ib->GetImageInfo(), planes, num, vir_w, vir_h,
+                          origin))
+    return false;
+  if (planes[0].fd >= 0)
+    fd = planes[0].fd;
+  return true;
+}
+
 int rga_blit(std::shared_ptr<ImageBuffer> src, std::shared_ptr<ImageBuffer> dst,
              ImageRect *src_rect, ImageRect *dst_rect, int rotate) {
   if (!src || !src->IsValid())
     return -EINVAL;
   if (!dst || !dst->IsValid())
     return -EINVAL;
+  int src_vir_w, src_vir_h, dst_vir_w, dst_vir_h;
+  ImageRect src_origin, dst_origin;
   rga_info_t src_info, dst_info;
   memset(&src_info, 0, sizeof(src_info));
-  src_info.fd = src->GetFD();
+  if (!get_rga_layout(src.get(), src_info.fd, src_vir_w, src_vir_h,
+                      src_origin)) {
+    // !!time-consuming operation
+    src = src->PackedCopy(MediaBuffer::MemType::MEM_HARD_WARE);
+    if (!src || !get_rga_layout(src.get(), src_info.fd, src_vir_w,
+                                src_vir_h, src_origin)) {
+      LOG("rga: fail to pack the src planes\n");
+      return -EINVAL;
+    }
+  }
   if (src_info.fd < 0)
     src_info.virAddr = src->GetPtr();
   src_info.mmuFlag = 1;
   src_info.rotation = rotate;
   if (src_rect)
-    rga_set_rect(&src_info.rect, src_rect->x, src_rect->y, src_rect->w,
-                 src_rect->h, src->GetVirWidth(), src->GetVirHeight(),
-                 get_rga_format(src->GetPixelFormat()));
+    rga_set_rect(&src_info.rect, src_origin.x + src_rect->x,
+                 src_origin.y + src_rect->y, src_rect->w, src_rect->h,
+                 src_vir_w, src_vir_h, get_rga_format(src->GetPixelFormat()));
   else
-    rga_set_rect(&src_info.rect, 0, 0, src->GetWidth(), src->GetHeight(),
-                 src->GetVirWidth(), src->GetVirHeight(),
+    rga_set_rect(&src_info.rect, src_origin.x, src_origin.y, src_origin.w,
+                 src_origin.h, src_vir_w, src_vir_h,
                  get_rga_format(src->GetPixelFormat()));
 
   memset(&dst_info, 0, sizeof(dst_info));
-  dst_info.fd = dst->GetFD();
+  // the packed copy is blitted, then copied back to the planes of dst
+  std::shared_ptr<ImageBuffer> packed_dst = dst;
+  if (!get_rga_layout(dst.get(), dst_info.fd, dst_vir_w, dst_vir_h,
+                      dst_origin)) {
+    packed_dst = dst->PackedCopy(MediaBuffer::MemType::MEM_HARD_WARE);
+    if (!packed_dst || !get_rga_layout(packed_dst.get(), dst_info.fd,
+                                       dst_vir_w, dst_vir_h, dst_origin)) {
+      LOG("rga: fail to pack the dst planes\n");
+      return -EINVAL;
+    }
+  }
   if (dst_info.fd < 0)
-    dst_info.virAddr = dst->GetPtr();
+    dst_info.virAddr = packed_dst->GetPtr();
   dst_info.mmuFlag = 1;
   if (dst_rect)
-    rga_set_rect(&dst_info.rect, dst_rect->x, dst_rect->y, dst_rect->w,
-                 dst_rect->h, dst->GetVirWidth(), dst->GetVirHeight(),
-                 get_rga_format(dst->GetPixelFormat()));
+    rga_set_rect(&dst_info.rect, dst_origin.x + dst_rect->x,
+                 dst_origin.y + dst_rect->y, dst_rect->w, dst_rect->h,
+                 dst_vir_w, dst_vir_h, get_rga_format(dst->GetPixelFormat()));
   else
-    rga_set_rect(&dst_info.rect, 0, 0, dst->GetWidth(), dst->GetHeight(),
-                 dst->GetVirWidth(), dst->GetVirHeight(),
+    rga_set_rect(&dst_info.rect, dst_origin.x, dst_origin.y, dst_origin.w,
+                 dst_origin.h, dst_vir_w, dst_vir_h,
                  get_rga_format(dst->GetPixelFormat()));
 
   int ret = RgaFilter::gRkRga.RkRgaBlit(&src_info, &dst_info, NULL);
+  if (!ret && packed_dst != dst && !dst->CopyPlanesFrom(*packed_dst))
+    ret = -EINVAL;
   if (ret) {
     LOG("Fail to RkRgaBlit, ret=%d\n", ret);
   } else {
@@ -22,6 +22,8 @@
 #ifndef EASYMEDIA_RGA_H_
 #define EASYMEDIA_RGA_H_
 
+#include <memory>
+
 #include "image.h"
 namespace easymedia {
 
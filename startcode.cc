@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "startcode.h"
+
+#include <atomic>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define STARTCODE_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define STARTCODE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace easymedia {
+
+// Scan [p, end) for 00 00 01. Return the first one if all is null, otherwise
+// append every one to all with offset relative to base, and return end.
+typedef const uint8_t *(*ScanFunc)(const uint8_t *base, const uint8_t *p,
+                                   const uint8_t *end,
+                                   std::vector<StartCodePos> *all);
+
+static inline void add_pos(const uint8_t *base, const uint8_t *hit,
+                           std::vector<StartCodePos> *all) {
+  StartCodePos pos = {(size_t)(hit - base), 3};
+  if (hit > base && hit[-1] == 0) {
+    pos.offset--;
+    pos.size = 4;
+  }
+  all->push_back(pos);
+}
+
+// Copy from ffmpeg.
+static const uint8_t *find_startcode_internal(const uint8_t *p,
+                                              const uint8_t *end) {
+  const uint8_t *a = p + 4 - ((intptr_t)p & 3);
+
+  for (end -= 3; p < a && p < end; p++) {
+    if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+      return p;
+  }
+
+  for (end -= 3; p < end; p += 4) {
+    uint32_t x = *(const uint32_t *)p;
+    //      if ((x - 0x01000100) & (~x) & 0x80008000) // little endian
+    //      if ((x - 0x00010001) & (~x) & 0x00800080) // big endian
+    if ((x - 0x01010101) & (~x) & 0x80808080) { // generic
+      if (p[1] == 0) {
+        if (p[0] == 0 && p[2] == 1)
+          return p;
+        if (p[2] == 0 && p[3] == 1)
+          return p + 1;
+      }
+      if (p[3] == 0) {
+        if (p[2] == 0 && p[4] == 1)
+          return p + 2;
+        if (p[4] == 0 && p[5] == 1)
+          return p + 3;
+      }
+    }
+  }
+
+  for (end += 3; p < end; p++) {
+    if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+      return p;
+  }
+
+  return end + 3;
+}
+
+static const uint8_t *scan_scalar(const uint8_t *base, const uint8_t *p,
+                                  const uint8_t *end,
+                                  std::vector<StartCodePos> *all) {
+  for (;;) {
+    if (p >= end)
+      return end;
+    const uint8_t *hit = find_startcode_internal(p, end);
+    // ffmpeg leaves out the one which ends the data, having no payload
+    if (hit >= end && end - p >= 3 && !end[-3] && !end[-2] && end[-1] == 1)
+      hit = end - 3;
+    if (hit >= end || !all)
+      return hit;
+    add_pos(base, hit, all);
+    p = hit + 3;
+  }
+}
+
+// The vector kernels only look closer at the blocks which have zero bytes,
+// then one mask of "p[i] == 0 && p[i + 1] == 0 && p[i + 2] == 1" gives every
+// start code of the block. Matches never overlap, so each bit is a hit.
+#define FOR_EACH_HIT(mask, p)                                                  \
+  for (; mask; mask &= mask - 1) {                                             \
+    const uint8_t *hit = p + __builtin_ctzll(mask);                            \
+    if (!all)                                                                  \
+      return hit;                                                              \
+    add_pos(base, hit, all);                                                   \
+  }
+
+#ifdef STARTCODE_X86
+__attribute__((target("sse2"))) static const uint8_t *
+scan_sse2(const uint8_t *base, const uint8_t *p, const uint8_t *end,
+          std::vector<StartCodePos> *all) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  for (; end - p >= 16 + 2; p += 16) {
+    __m128i v0 = _mm_loadu_si128((const __m128i *)p);
+    uint64_t mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v0, zero));
+    if (!mask)
+      continue;
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(p + 1));
+    __m128i v2 = _mm_loadu_si128((const __m128i *)(p + 2));
+    mask &= (unsigned)_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(v1, zero), _mm_cmpeq_epi8(v2, one)));
+    FOR_EACH_HIT(mask, p)
+  }
+  return scan_scalar(base, p, end, all);
+}
+
+// 64 bytes a round, most rounds have no zero byte and cost one test
+__attribute__((target("avx2"))) static const uint8_t *
+scan_avx2(const uint8_t *base, const uint8_t *p, const uint8_t *end,
+          std::vector<StartCodePos> *all) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi8(1);
+  for (; end - p >= 64 + 2; p += 64) {
+    __m256i z0 =
+        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), zero);
+    __m256i z1 =
+        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 32)), zero);
+    if (_mm256_testz_si256(_mm256_or_si256(z0, z1), _mm256_or_si256(z0, z1)))
+      continue;
+    for (int i = 0; i < 64; i += 32) {
+      const uint8_t *q = p + i;
+      __m256i v1 = _mm256_loadu_si256((const __m256i *)(q + 1));
+      __m256i v2 = _mm256_loadu_si256((const __m256i *)(q + 2));
+      uint64_t mask = (unsigned)_mm256_movemask_epi8(
+          _mm256_and_si256(i ? z1 : z0, _mm256_and_si256(
+                                            _mm256_cmpeq_epi8(v1, zero),
+                                            _mm256_cmpeq_epi8(v2, one))));
+      FOR_EACH_HIT(mask, q)
+    }
+  }
+  return scan_sse2(base, p, end, all);
+}
+#endif
+
+#ifdef STARTCODE_NEON
+// neon has no movemask, narrow the 0xff/0x00 bytes to 4 bits each instead
+static inline uint64_t neon_mask(uint8x16_t cmp) {
+  uint8x8_t n = vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4);
+  return vget_lane_u64(vreinterpret_u64_u8(n), 0);
+}
+
+static const uint8_t *scan_neon(const uint8_t *base, const uint8_t *p,
+                                const uint8_t *end,
+                                std::vector<StartCodePos> *all) {
+  const uint8x16_t zero = vdupq_n_u8(0);
+  const uint8x16_t one = vdupq_n_u8(1);
+  for (; end - p >= 16 + 2; p += 16) {
+    uint8x16_t z0 = vceqq_u8(vld1q_u8(p), zero);
+    if (!neon_mask(z0))
+      continue;
+    uint8x16_t z1 = vceqq_u8(vld1q_u8(p + 1), zero);
+    uint8x16_t o2 = vceqq_u8(vld1q_u8(p + 2), one);
+    // keep one bit of each nibble, so that ctz / 4 is the byte index
+    uint64_t mask =
+        neon_mask(vandq_u8(z0, vandq_u8(z1, o2))) & 0x1111111111111111ULL;
+    for (; mask; mask &= mask - 1) {
+      const uint8_t *hit = p + (__builtin_ctzll(mask) >> 2);
+      if (!all)
+        return hit;
+      add_pos(base, hit, all);
+    }
+  }
+  return scan_scalar(base, p, end, all);
+}
+#endif
+
+static ScanFunc get_scan_func(StartCodeImpl impl) {
+  switch (impl) {
+  case StartCodeImpl::AUTO:
+    for (StartCodeImpl i : {StartCodeImpl::AVX2, StartCodeImpl::SSE2,
+                            StartCodeImpl::NEON}) {
+      ScanFunc func = get_scan_func(i);
+      if (func)
+        return func;
+    }
+    return scan_scalar;
+  case StartCodeImpl::SCALAR:
+    return scan_scalar;
+#ifdef STARTCODE_X86
+  case StartCodeImpl::SSE2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2") ? scan_sse2 : nullptr;
+  case StartCodeImpl::AVX2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? scan_avx2 : nullptr;
+#endif
+#ifdef STARTCODE_NEON
+  case StartCodeImpl::NEON:
+    return scan_neon;
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+static std::atomic<ScanFunc> scan_func(nullptr);
+static std::atomic<StartCodeImpl> scan_impl(StartCodeImpl::AUTO);
+
+static inline ScanFunc current_scan_func() {
+  ScanFunc func = scan_func.load(std::memory_order_relaxed);
+  if (!func) {
+    func = get_scan_func(StartCodeImpl::AUTO);
+    scan_func.store(func, std::memory_order_relaxed);
+  }
+  return func;
+}
+
+bool SetStartCodeImpl(StartCodeImpl impl) {
+  ScanFunc func = get_scan_func(impl);
+  if (!func)
+    return false;
+  scan_impl = impl;
+  scan_func = func;
+  return true;
+}
+
+StartCodeImpl GetStartCodeImpl() { return scan_impl; }
+
+bool IsStartCodeImplSupported(StartCodeImpl impl) {
+  return get_scan_func(impl) != nullptr;
+}
+
+const char *StartCodeImplToString(StartCodeImpl impl) {
+  switch (impl) {
+  case StartCodeImpl::AUTO:
+    return "auto";
+  case StartCodeImpl::SCALAR:
+    return "scalar";
+  case StartCodeImpl::SSE2:
+    return "sse2";
+  case StartCodeImpl::AVX2:
+    return "avx2";
+  case StartCodeImpl::NEON:
+    return "neon";
+  }
+  return "unknown";
+}
+
+const uint8_t *FindStartCode(const uint8_t *p, const uint8_t *end) {
+  if (end - p < 3)
+    return end;
+  return current_scan_func()(p, p, end, nullptr);
+}
+
+size_t FindAllStartCodes(const uint8_t *data, size_t size,
+                         std::vector<StartCodePos> &pos) {
+  size_t num = pos.size();
+  if (size >= 3)
+    current_scan_func()(data, data, data + size, &pos);
+  return pos.size() - num;
+}
+
+} // namespace easymedia
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_STARTCODE_H_
+#define EASYMEDIA_STARTCODE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "utils.h"
+
+namespace easymedia {
+
+// Annex-B start code scanner for h264/h265 elementary streams.
+// The implementation is picked at runtime by the cpu features.
+enum class StartCodeImpl {
+  AUTO,   // the best one the cpu supports
+  SCALAR, // word-at-a-time, the reference
+  SSE2,
+  AVX2,
+  NEON,
+};
+
+struct StartCodePos {
+  size_t offset; // of the first zero byte, a leading zero counts in
+  size_t size;   // 3 for 00 00 01, 4 for 00 00 00 01
+};
+
+// Return false if the cpu or the build does not support impl.
+_API bool SetStartCodeImpl(StartCodeImpl impl);
+_API StartCodeImpl GetStartCodeImpl();
+_API bool IsStartCodeImplSupported(StartCodeImpl impl);
+_API const char *StartCodeImplToString(StartCodeImpl impl);
+
+// Return the position of the first 00 00 01 in [p, end), or end if none.
+_API const uint8_t *FindStartCode(const uint8_t *p, const uint8_t *end);
+
+// Find all start codes of data in one pass, appending to pos.
+// Return the number found.
+_API size_t FindAllStartCodes(const uint8_t *data, size_t size,
+                              std::vector<StartCodePos> &pos);
+
+} // namespace easymedia
+
+#endif // EASYMEDIA_STARTCODE_H_
@@ -25,6 +25,8 @@
 #include <assert.h>
 #include <errno.h>
 
+#include "buffer.h"
+#include "buffer_chain.h"
 #include "utils.h"
 
 namespace easymedia {
@@ -70,6 +72,30 @@ int Stream::Close() {
   return 0;
 }
 
+size_t Stream::Writev(const struct iovec *iov, int iovcnt) {
+  size_t total = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_len == 0)
+      continue;
+    size_t ret = Write(iov[i].iov_base, 1, iov[i].iov_len);
+    if (ret != iov[i].iov_len) {
+      if (ret != (size_t)-1)
+        total += ret;
+      break;
+    }
+    total += ret;
+  }
+  return total;
+}
+
+size_t Stream::WriteChain(const BufferChain &chain) {
+  std::vector<struct iovec> iov;
+  chain.ToIovec(iov);
+  if (iov.empty())
+    return 0;
+  return Writev(iov.data(), iov.size());
+}
+
 DEFINE_REFLECTOR(Stream)
 
 // request should equal stream_name
@@ -78,48 +104,63 @@ DEFINE_FACTORY_COMMON_PARSE(Stream)
 DEFINE_PART_FINAL_EXPOSE_PRODUCT(Stream, Stream)
 
 bool Stream::ReadImage(void *ptr, const ImageInfo &info) {
-  size_t read_size;
-  if (info.width == info.vir_width && info.height == info.vir_height) {
-    int num, den;
-    GetPixFmtNumDen(info.pix_fmt, num, den);
-    read_size = info.width * info.height * num / den;
-    if (!read_size)
-      return false;
-    size_t ret = Read(ptr, 1, read_size);
-    if (ret != read_size) {
-      // LOG("read ori stream failed, %d != %d\n", ret, read_size);
-      return false;
-    }
-    return true;
+  ImagePlane planes[IMAGE_MAX_PLANES];
+  int num = GetImagePlanes(info, planes);
+  if (num <= 0) {
+    LOG("TODO: read image fmt %d\n", info.pix_fmt);
+    return false;
   }
-  int row = 0;
-  uint8_t *buf_y = (uint8_t *)ptr;
-  uint8_t *buf_u = buf_y + info.vir_width * info.vir_height;
-  // uint8_t *buf_v = buf_u + info.vir_width * info.vir_height / 4;
-  switch (info.pix_fmt) {
-  case PIX_FMT_NV12:
-    for (row = 0; row < info.height; row++) {
-      read_size = Read(buf_y + row * info.vir_width, 1, info.width);
-      if ((int)read_size != info.width) {
-        // LOG("read ori yuv stream luma failed, %d != %d\n",
-        // read_size,info.width);
+  return ReadImage(ptr, info, planes, num);
+}
+
+// The stream data is tightly packed, the rows are placed by the planes.
+static bool read_planes(Stream *s, uint8_t *const data[],
+                        const ImagePlane *planes, int num) {
+  for (int i = 0; i < num; i++) {
+    const ImagePlane &p = planes[i];
+    uint8_t *buf = data[i];
+    if (p.stride == p.row_bytes) {
+      size_t read_size = (size_t)p.row_bytes * p.rows;
+      if (s->Read(buf, 1, read_size) != read_size)
         return false;
-      }
+      continue;
     }
-    for (row = 0; row < info.height / 2; row++) {
-      read_size = Read(buf_u + row * info.vir_width, 1, info.width);
-      if ((int)read_size != info.width) {
-        // LOG("read ori yuv stream cb failed, %d != %d\n", read_size,
-        // info.width);
+    for (int row = 0; row < p.rows; row++) {
+      size_t read_size = s->Read(buf + (size_t)row * p.stride, 1, p.row_bytes);
+      if ((int)read_size != p.row_bytes) {
+        // LOG("read ori image plane %d failed, %d != %d\n", i, read_size,
+        // p.row_bytes);
         return false;
       }
     }
-    break;
-  default:
-    LOG("TODO: read image fmt %d\n", info.pix_fmt);
-    return false;
   }
   return true;
 }
 
+bool Stream::ReadImage(void *ptr, const ImageInfo &info _UNUSED,
+                       const ImagePlane *planes, int num) {
+  uint8_t *data[IMAGE_MAX_PLANES];
+  for (int i = 0; i < num; i++) {
+    // not in ptr, read it by ReadImage(ImageBuffer &) which maps the fd
+    if (planes[i].fd >= 0) {
+      LOG("read image: plane %d is of separate fd %d\n", i, planes[i].fd);
+      return false;
+    }
+    data[i] = (uint8_t *)ptr + planes[i].offset;
+  }
+  return read_planes(this, data, planes, num);
+}
+
+bool Stream::ReadImage(ImageBuffer &ib) {
+  ImagePlane planes[IMAGE_MAX_PLANES];
+  uint8_t *data[IMAGE_MAX_PLANES];
+  int num = ib.GetPlanes(planes);
+  if (num <= 0 || ib.GetPlanePtrs(data) != num)
+    return false;
+  ib.BeginCPUAccess(false, true);
+  bool ret = read_planes(this, data, planes, num);
+  ib.EndCPUAccess(false, true);
+  return ret;
+}
+
 } // namespace easymedia
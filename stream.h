@@ -24,6 +24,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -57,6 +58,8 @@ DECLARE_REFLECTOR(Stream)
   DEFINE_MEDIA_NEW_PRODUCT_BY(REAL_PRODUCT, FINAL_EXPOSE_PRODUCT, Open() < 0)
 
 class MediaBuffer;
+class ImageBuffer;
+class BufferChain;
 #ifdef IN_EASYMEDIA_STREAM_CC
 static int local_close(void *stream);
 #endif
@@ -70,6 +73,10 @@ public:
 
   virtual size_t Read(void *ptr, size_t size, size_t nmemb) = 0;
   virtual size_t Write(const void *ptr, size_t size, size_t nmemb) = 0;
+  // Scatter-gather write, return the total bytes written.
+  // The default one calls Write() for each iovec.
+  virtual size_t Writev(const struct iovec *iov, int iovcnt);
+  size_t WriteChain(const BufferChain &chain);
   // whence: SEEK_SET, SEEK_CUR, SEEK_END
   virtual int Seek(int64_t offset, int whence) = 0;
   virtual long Tell() = 0;
@@ -97,6 +104,10 @@ public:
 
   // read data as image by ImageInfo
   bool ReadImage(void *ptr, const ImageInfo &info);
+  // read data as image into the given planes of ptr, no plane of its own fd
+  bool ReadImage(void *ptr, const ImageInfo &info, const ImagePlane *planes,
+                 int num);
+  bool ReadImage(ImageBuffer &ib);
 
 protected:
   virtual int Open() = 0;
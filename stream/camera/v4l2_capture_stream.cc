@@ -24,6 +24,7 @@
 #include <vector>
 
 #include "buffer.h"
+#include "buffer_census.h"
 #include "v4l2_stream.h"
 
 namespace easymedia {
@@ -207,8 +208,8 @@ int V4L2CaptureStream::Open() {
       buf.index = i;
       buf.memory = req.memory;
 
-      auto &&buffer =
-          MediaBuffer::Alloc2(size, MediaBuffer::MemType::MEM_HARD_WARE);
+      auto &&buffer = MediaBuffer::Alloc2(
+          size, MediaBuffer::MemType::MEM_HARD_WARE, "v4l2_ring");
       if (buffer.GetSize() == 0) {
         errno = ENOMEM;
         return -1;
@@ -253,6 +254,8 @@ int V4L2CaptureStream::Open() {
       mb.SetPtr(ptr);
       buffer->length = buf.length;
       mb.SetSize(buf.length);
+      // the memory of the driver, as the dmabuf ring of hardware memory
+      CensusTrack(mb, "v4l2_ring", MediaBuffer::MemType::MEM_HARD_WARE);
       LOGD("query buf.length=%d\n", (int)buf.length);
     }
     for (size_t i = 0; i < req.count; ++i) {
@@ -348,6 +351,13 @@ std::shared_ptr<MediaBuffer> V4L2CaptureStream::Read() {
     if (buf.memory == V4L2_MEMORY_DMABUF) {
       assert(ret_buf->GetFD() == buf.m.fd);
     }
+    // census the dequeued buffer on its own, rather than the ring slot which
+    // is always alive; the slot counts its bytes already
+    if (IsBufferCensusEnabled()) {
+      ret_buf->SetCensusEntry(nullptr);
+      CensusTrackShared(*ret_buf, "v4l2_capture",
+                        MediaBuffer::MemType::MEM_HARD_WARE);
+    }
     ret_buf->SetTimeStamp(buf_ts.tv_sec * 1000LL + buf_ts.tv_usec / 1000LL);
     ret_buf->SetValidSize(buf.bytesused);
   } else {
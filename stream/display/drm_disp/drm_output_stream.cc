@@ -19,6 +19,10 @@
  *
  */
 
+#include <unistd.h>
+
+#include <algorithm>
+
 #include "buffer.h"
 #include "control.h"
 #include "drm_stream.h"
@@ -53,8 +57,11 @@ public:
       LOG("Fail to drmPrimeFDToHandle, ret=%d, %m\n", ret);
       return;
     }
-    int w = buffer->GetVirWidth() * num / den;
-    int h = buffer->GetVirHeight();
+    // the explicit planes, such as of a crop view, only hold the valid rect
+    bool explicit_planes = buffer->HasExplicitPlanes();
+    int w = (explicit_planes ? buffer->GetWidth() : buffer->GetVirWidth()) *
+            num / den;
+    int h = explicit_planes ? buffer->GetHeight() : buffer->GetVirHeight();
     uint32_t handles[4] = {0}, pitches[4] = {0}, offsets[4] = {0};
     switch (drm_fmt) {
     case DRM_FORMAT_NV12:
@@ -93,6 +100,8 @@ public:
       LOG("TODO format for drm %c%c%c%c\n", DUMP_FOURCC(drm_fmt));
       return;
     }
+    if (explicit_planes && !SetPlanes(handles, pitches, offsets))
+      return;
     ret = drmModeAddFB2(drm_fd, w, h, drm_fmt, handles, pitches, offsets,
                         &fb_id, 0);
     if (ret) {
@@ -104,23 +113,68 @@ public:
   ~DRMDisplayBuffer() {
     if (fb_id > 0)
       drmModeRmFB(drm_fd, fb_id);
-    if (handle > 0) {
-      struct drm_mode_destroy_dumb data = {
-          .handle = handle,
-      };
-      int ret = drmIoctl(drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &data);
-      if (ret)
-        LOG("Fail to free drm handle <%d>: %m\n", handle);
-    }
+    for (uint32_t h : plane_handles)
+      FreeHandle(h);
+    if (handle > 0)
+      FreeHandle(handle);
   }
   uint32_t GetFBID() { return fb_id; }
 
 private:
+  void FreeHandle(uint32_t h) {
+    struct drm_mode_destroy_dumb data = {
+        .handle = h,
+    };
+    int ret = drmIoctl(drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &data);
+    if (ret)
+      LOG("Fail to free drm handle <%d>: %m\n", h);
+  }
+  // Take the explicit planes as they are, each may be of its own dma buffer.
+  // The planes must end inside their buffers, as the fb is checked so.
+  bool SetPlanes(uint32_t *handles, uint32_t *pitches, uint32_t *offsets) {
+    ImagePlane planes[IMAGE_MAX_PLANES];
+    int num = ib->GetPlanes(planes);
+    for (int i = 0; i < num; i++) {
+      const ImagePlane &p = planes[i];
+      size_t size = ib->GetSize();
+      if (p.fd >= 0 && p.fd != ib->GetFD()) {
+        off_t end = lseek(p.fd, 0, SEEK_END);
+        size = end > 0 ? (size_t)end : 0;
+      }
+      if (p.rows <= 0 || p.stride < p.row_bytes ||
+          (size_t)p.offset + (size_t)p.stride * (p.rows - 1) + p.row_bytes >
+              size) {
+        LOG("drm plane %d (offset %d, stride %d, %d rows) is beyond the "
+            "buffer of %zu bytes\n",
+            i, p.offset, p.stride, p.rows, size);
+        return false;
+      }
+      handles[i] = handle;
+      if (planes[i].fd >= 0 && planes[i].fd != ib->GetFD()) {
+        int ret = drmPrimeFDToHandle(drm_fd, planes[i].fd, &handles[i]);
+        if (ret) {
+          LOG("Fail to drmPrimeFDToHandle of plane %d, ret=%d, %m\n", i, ret);
+          return false;
+        }
+        // the fds of the same dma buffer, such as a dup, give the same gem
+        // handle, which is freed once
+        if (handles[i] != handle &&
+            std::find(plane_handles.begin(), plane_handles.end(),
+                      handles[i]) == plane_handles.end())
+          plane_handles.push_back(handles[i]);
+      }
+      pitches[i] = planes[i].stride;
+      offsets[i] = planes[i].offset;
+    }
+    return true;
+  }
+
   std::shared_ptr<ImageBuffer> ib;
   std::shared_ptr<DRMDevice> drm_dev;
   int drm_fd;
   uint32_t handle;
   uint32_t fb_id;
+  std::vector<uint32_t> plane_handles;
 };
 
 class DRMOutPutStream : public DRMStream {
@@ -194,7 +248,8 @@ int DRMOutPutStream::Open() {
     return false;
   if (!active) {
     size_t size = CalPixFmtSize(img_info);
-    auto &&mb = MediaBuffer::Alloc2(size, MediaBuffer::MemType::MEM_HARD_WARE);
+    auto &&mb = MediaBuffer::Alloc2(size, MediaBuffer::MemType::MEM_HARD_WARE,
+                                    "drm_display");
     if (mb.GetSize() < size)
       return -1;
     auto fb = std::make_shared<ImageBuffer>(mb, img_info);
@@ -23,8 +23,18 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <list>
+
+#include "au_assembler.h"
+#include "buffer.h"
+#include "key_string.h"
 #include "media_type.h"
 #include "utils.h"
 
@@ -65,6 +75,7 @@ public:
     CHECK_FILE(file)
     return fwrite(ptr, size, nmemb, file);
   }
+  virtual size_t Writev(const struct iovec *iov, int iovcnt) final;
 
   virtual bool Eof() final {
     if (!file) {
@@ -98,7 +109,7 @@ protected:
     return ret;
   }
 
-private:
+protected:
   std::string path;
   std::string open_mode;
   FILE *file;
@@ -116,6 +127,45 @@ FileStream::FileStream(const char *param) : file(NULL), eof(true) {
   UNUSED(ret);
 }
 
+size_t FileStream::Writev(const struct iovec *iov, int iovcnt) {
+  if (!Writeable())
+    return -1;
+  CHECK_FILE(file)
+  // flush the pending stdio data, keep the order with Write()
+  if (fflush(file))
+    return -1;
+  int fd = fileno(file);
+  size_t total = 0;
+  struct iovec cur[IOV_MAX];
+  while (iovcnt > 0) {
+    int cnt = std::min(iovcnt, IOV_MAX);
+    memcpy(cur, iov, cnt * sizeof(*iov));
+    iov += cnt;
+    iovcnt -= cnt;
+    struct iovec *v = cur;
+    while (cnt > 0) {
+      ssize_t ret = writev(fd, v, cnt);
+      if (ret < 0) {
+        if (errno == EINTR)
+          continue;
+        return total;
+      }
+      total += ret;
+      // skip the finished ones and resume the partial one
+      while (cnt > 0 && (size_t)ret >= v->iov_len) {
+        ret -= v->iov_len;
+        v++;
+        cnt--;
+      }
+      if (cnt > 0) {
+        v->iov_base = (uint8_t *)v->iov_base + ret;
+        v->iov_len -= ret;
+      }
+    }
+  }
+  return total;
+}
+
 // FileWriteStream
 class FileWriteStream : public FileStream {
 public:
@@ -160,4 +210,463 @@ const char *FACTORY(FileReadStream)::ExpectedInputDataType() {
 
 const char *FACTORY(FileReadStream)::OutPutDataType() { return TYPE_ANYTHING; }
 
+// Sleep till the wall time of a frame comes, by the timestamps.
+class FramePacer {
+public:
+  FramePacer() : fast(false), started(false), wall_base(0), ts_base(0) {}
+  void SetFast(bool val) { fast = val; }
+  void Wait(int64_t timestamp) {
+    if (fast)
+      return;
+    int64_t now = gettimeofday();
+    if (!started) {
+      started = true;
+      wall_base = now;
+      ts_base = timestamp;
+      return;
+    }
+    int64_t due = wall_base + timestamp - ts_base;
+    if (due > now)
+      msleep(due - now);
+  }
+
+private:
+  bool fast;
+  bool started;
+  int64_t wall_base;
+  int64_t ts_base;
+};
+
+// The common params of the self-described file sources:
+//   loop_time: replay times after the first, negative means forever
+//   as_fast_as_possible: 1 to not pace by the frame rate
+class FileSourceStream : public FileStream {
+public:
+  FileSourceStream(const char *param);
+  virtual ~FileSourceStream() = default;
+  using FileStream::Read;
+  virtual int Open() override;
+
+protected:
+  // Rewind to the data for the next loop, return false if no more loop.
+  bool NextLoop();
+  bool AtFileEnd() { return Tell() >= file_size; }
+
+  std::map<std::string, std::string> params;
+  int loop_time;
+  long data_offset; // where a loop starts
+  long file_size;
+  FramePacer pacer;
+  bool param_error;
+};
+
+FileSourceStream::FileSourceStream(const char *param)
+    : FileStream(param), loop_time(0), data_offset(0), file_size(0),
+      param_error(false) {
+  parse_media_param_map(param, params);
+  const std::string &loop = params[KEY_LOOP_TIME];
+  const std::string &fast = params[KEY_AS_FAST_AS_POSSIBLE];
+  if (!loop.empty())
+    loop_time = std::stoi(loop);
+  if (!fast.empty())
+    pacer.SetFast(!!std::stoi(fast));
+  if (open_mode.empty())
+    open_mode = "re";
+}
+
+int FileSourceStream::Open() {
+  if (param_error)
+    return -1;
+  int ret = FileStream::Open();
+  if (ret)
+    return ret;
+  SetWriteable(false);
+  if (fseek(file, 0, SEEK_END) || (file_size = ftell(file)) < 0 ||
+      fseek(file, 0, SEEK_SET)) {
+    LOG("%s is not seekable\n", path.c_str());
+    return -1;
+  }
+  if (file_size == 0) {
+    LOG("%s is empty\n", path.c_str());
+    return -1;
+  }
+  return 0;
+}
+
+bool FileSourceStream::NextLoop() {
+  if (loop_time == 0)
+    return false;
+  if (loop_time > 0)
+    loop_time--;
+  return Seek(data_offset, SEEK_SET) == 0;
+}
+
+// Read the frames of a yuv4mpeg2 file, whose header tells the ImageInfo and
+// the frame rate. Besides the planar yuv of the C tag, any PixelFormat can
+// be read with the extension tag XPIXFMT=<pixel format>, such as
+// XPIXFMT=nv12, the planes are tightly packed as Stream::ReadImage expects.
+// Params:
+//   mem_type: the memory of the output ImageBuffer
+//   virtual_width/virtual_height: the stride of the output, default the size
+class Y4MReadStream : public FileSourceStream {
+public:
+  Y4MReadStream(const char *param);
+  virtual ~Y4MReadStream() = default;
+  static const char *GetStreamName() { return "y4m_read_stream"; }
+  using FileSourceStream::Read;
+  virtual std::shared_ptr<MediaBuffer> Read() override;
+  virtual int IoCtrl(unsigned long int request, ...) override;
+  virtual int Open() override;
+
+private:
+  bool ReadLine(std::string &line, size_t max_size);
+  bool ParseHeader(const std::string &header);
+
+  ImageInfo info;
+  FrameRateArg fps;
+  MediaBuffer::MemType mtype;
+  int64_t frame_index;
+  int64_t base_timestamp;
+};
+
+Y4MReadStream::Y4MReadStream(const char *param)
+    : FileSourceStream(param), fps({25, 1}),
+      mtype(MediaBuffer::MemType::MEM_COMMON), frame_index(0),
+      base_timestamp(0) {
+  memset(&info, 0, sizeof(info));
+  info.pix_fmt = PIX_FMT_NONE;
+  const std::string &mem = params[KEY_MEM_TYPE];
+  if (!mem.empty())
+    mtype = StringToMemType(mem.c_str());
+}
+
+bool Y4MReadStream::ReadLine(std::string &line, size_t max_size) {
+  line.clear();
+  char c;
+  while (line.size() < max_size) {
+    if (FileStream::Read(&c, 1, 1) != 1)
+      return false;
+    if (c == '\n')
+      return true;
+    line.push_back(c);
+  }
+  return false;
+}
+
+static PixelFormat y4m_colorspace_to_pix_fmt(const std::string &cs) {
+  if (cs == "420jpeg" || cs == "420paldv" || cs == "420mpeg2" || cs == "420")
+    return PIX_FMT_YUV420P;
+  if (cs == "422")
+    return PIX_FMT_YUV422P;
+  return PIX_FMT_NONE;
+}
+
+bool Y4MReadStream::ParseHeader(const std::string &header) {
+  std::list<std::string> tags;
+  if (!string_start_withs(header, "YUV4MPEG2 ") ||
+      !parse_media_param_list(header.c_str(), tags, ' ')) {
+    LOG("%s is not a yuv4mpeg2 file\n", path.c_str());
+    return false;
+  }
+  std::string colorspace = "420jpeg";
+  PixelFormat ext_fmt = PIX_FMT_NONE;
+  for (auto &tag : tags) {
+    if (tag.empty())
+      continue;
+    const std::string value = tag.substr(1);
+    switch (tag[0]) {
+    case 'W':
+      info.width = std::stoi(value);
+      break;
+    case 'H':
+      info.height = std::stoi(value);
+      break;
+    case 'F':
+      if (sscanf(value.c_str(), "%u:%u", &fps.num, &fps.den) != 2 ||
+          !fps.num || !fps.den) {
+        LOG("y4m: invalid frame rate %s\n", value.c_str());
+        return false;
+      }
+      break;
+    case 'C':
+      colorspace = value;
+      break;
+    case 'X':
+      if (string_start_withs(value, "PIXFMT=")) {
+        std::string fmt = value.substr(7);
+        if (!string_start_withs(fmt, IMAGE_PREFIX))
+          fmt = IMAGE_PREFIX + fmt;
+        ext_fmt = GetPixFmtByString(fmt.c_str());
+        if (ext_fmt == PIX_FMT_NONE) {
+          LOG("y4m: unsupport pixel format %s\n", fmt.c_str());
+          return false;
+        }
+      }
+      break;
+    default:
+      // interlacing, aspect ratio and the comments are of no use
+      break;
+    }
+  }
+  info.pix_fmt =
+      ext_fmt != PIX_FMT_NONE ? ext_fmt : y4m_colorspace_to_pix_fmt(colorspace);
+  if (info.pix_fmt == PIX_FMT_NONE) {
+    LOG("y4m: unsupport colorspace %s\n", colorspace.c_str());
+    return false;
+  }
+  if (info.width <= 0 || info.height <= 0) {
+    LOG("y4m: invalid size %dx%d\n", info.width, info.height);
+    return false;
+  }
+  const std::string &vir_w = params[KEY_BUFFER_VIR_WIDTH];
+  const std::string &vir_h = params[KEY_BUFFER_VIR_HEIGHT];
+  info.vir_width = vir_w.empty() ? info.width : std::stoi(vir_w);
+  info.vir_height = vir_h.empty() ? info.height : std::stoi(vir_h);
+  ImagePlane planes[IMAGE_MAX_PLANES];
+  if (info.vir_width < info.width || info.vir_height < info.height ||
+      GetImagePlanes(info, planes) <= 0) {
+    LOG("y4m: unsupport image %s %dx%d in %dx%d\n",
+        PixFmtToString(info.pix_fmt), info.width, info.height, info.vir_width,
+        info.vir_height);
+    return false;
+  }
+  return true;
+}
+
+int Y4MReadStream::Open() {
+  int ret = FileSourceStream::Open();
+  if (ret)
+    return ret;
+  std::string header;
+  if (!ReadLine(header, 4096) || !ParseHeader(header))
+    return -1;
+  data_offset = Tell();
+  return 0;
+}
+
+std::shared_ptr<MediaBuffer> Y4MReadStream::Read() {
+  if (eof)
+    return nullptr;
+  std::string frame_header;
+  // the end of the last loop is found after reading a frame, here it's not
+  if (!ReadLine(frame_header, 4096) ||
+      !string_start_withs(frame_header, "FRAME")) {
+    LOG("y4m: no frame header at %ld\n", Tell());
+    eof = true;
+    return nullptr;
+  }
+  auto mb = MediaBuffer::Alloc(CalPixFmtSize(info), mtype, "y4m_read_stream");
+  if (!mb) {
+    LOG_NO_MEMORY();
+    return nullptr;
+  }
+  auto ib = std::make_shared<ImageBuffer>(*mb, info);
+  if (!ib) {
+    LOG_NO_MEMORY();
+    return nullptr;
+  }
+  if (!ReadImage(*ib)) {
+    LOG("y4m: truncated frame %d\n", (int)frame_index);
+    eof = true;
+    return nullptr;
+  }
+  ib->SetValidSize(ib->GetSize());
+  if (frame_index == 0)
+    base_timestamp = gettimeofday();
+  ib->SetTimeStamp(base_timestamp + frame_index * 1000 * fps.den / fps.num);
+  frame_index++;
+  if (AtFileEnd() && !NextLoop()) {
+    eof = true;
+    ib->SetEOF(true);
+  }
+  pacer.Wait(ib->GetTimeStamp());
+  return ib;
+}
+
+int Y4MReadStream::IoCtrl(unsigned long int request, ...) {
+  va_list vl;
+  va_start(vl, request);
+  void *arg = va_arg(vl, void *);
+  va_end(vl);
+  if (!arg)
+    return -1;
+  switch (request) {
+  case G_STREAM_IMAGE_INFO:
+    *((ImageInfo *)arg) = info;
+    return 0;
+  case G_STREAM_FRAME_RATE:
+    *((FrameRateArg *)arg) = fps;
+    return 0;
+  }
+  return -1;
+}
+
+DEFINE_STREAM_FACTORY(Y4MReadStream, Stream)
+
+const char *FACTORY(Y4MReadStream)::ExpectedInputDataType() {
+  return STREAM_FILE;
+}
+
+const char *FACTORY(Y4MReadStream)::OutPutDataType() { return IMAGE_PREFIX; }
+
+// Read an h264/h265 elementary stream access unit by access unit, see
+// AccessUnitAssembler. Params:
+//   output_data_type: video:h264 or video:h265, default by the file
+//                     extension, .h265/.265/.hevc for h265
+//   size_pertime: the bytes of a read, 1M by default
+//   framerate: 30, 29.97 or 30000/1001; default the sps timing info, or
+//              the read time if the sps has no timing
+class AnnexBReadStream : public FileSourceStream {
+public:
+  AnnexBReadStream(const char *param);
+  virtual ~AnnexBReadStream() = default;
+  static const char *GetStreamName() { return "annexb_read_stream"; }
+  using FileSourceStream::Read;
+  virtual std::shared_ptr<MediaBuffer> Read() override;
+  virtual int IoCtrl(unsigned long int request, ...) override;
+
+private:
+  bool ReadChunk();
+
+  std::shared_ptr<AccessUnitAssembler> assembler;
+  std::list<std::shared_ptr<MediaBuffer>> access_units;
+  size_t chunk_size;
+  FrameRateArg fps;
+  int64_t loop_start_count; // the output count when this loop starts
+  bool read_end;            // all loops read
+};
+
+static bool parse_frame_rate(const std::string &str, FrameRateArg &fps) {
+  size_t slash = str.find('/');
+  if (slash != std::string::npos) {
+    fps.num = std::stoul(str.substr(0, slash));
+    fps.den = std::stoul(str.substr(slash + 1));
+  } else {
+    fps.num = (uint32_t)(std::stof(str) * 1000 + 0.5f);
+    fps.den = 1000;
+  }
+  return fps.num > 0 && fps.den > 0;
+}
+
+AnnexBReadStream::AnnexBReadStream(const char *param)
+    : FileSourceStream(param), chunk_size(1 << 20), fps({0, 0}),
+      loop_start_count(0), read_end(false) {
+  std::string type = params[KEY_OUTPUTDATATYPE];
+  if (type.empty()) {
+    bool hevc = string_end_withs(path, ".h265") ||
+                string_end_withs(path, ".265") ||
+                string_end_withs(path, ".hevc");
+    type = hevc ? VIDEO_H265 : VIDEO_H264;
+  }
+  if (type != VIDEO_H264 && type != VIDEO_H265) {
+    LOG("annexb read stream does not support %s\n", type.c_str());
+    param_error = true;
+    return;
+  }
+  assembler = std::make_shared<AccessUnitAssembler>(
+      type == VIDEO_H264 ? NalCodec::H264 : NalCodec::H265);
+  if (!assembler) {
+    param_error = true;
+    return;
+  }
+  const std::string &size = params[KEY_MEM_SIZE_PERTIME];
+  if (!size.empty())
+    chunk_size = std::stoul(size);
+  const std::string &rate = params[KEY_FPS];
+  if (!rate.empty()) {
+    if (!parse_frame_rate(rate, fps)) {
+      LOG("annexb read stream: invalid frame rate %s\n", rate.c_str());
+      param_error = true;
+      return;
+    }
+    assembler->SetFrameRate(fps.num, fps.den);
+  }
+  assembler->UseStreamTiming(true);
+  if (chunk_size == 0)
+    param_error = true;
+}
+
+bool AnnexBReadStream::ReadChunk() {
+  auto chunk = MediaBuffer::Alloc(chunk_size, MediaBuffer::MemType::MEM_COMMON,
+                                  "annexb_read_stream");
+  if (!chunk) {
+    LOG_NO_MEMORY();
+    return false;
+  }
+  size_t size = FileStream::Read(chunk->GetPtr(), 1, chunk_size);
+  if (size == (size_t)-1 || (size < chunk_size && ferror(file)))
+    return false;
+  // the loop end is told by the size, keep Eof() for the access units
+  clearerr(file);
+  chunk->SetValidSize(size);
+  chunk->SetTimeStamp(gettimeofday());
+  bool loop_end = AtFileEnd();
+  // flush the last access unit of this loop
+  chunk->SetEOF(loop_end);
+  assembler->Push(chunk, access_units);
+  if (loop_end) {
+    // stop if nothing comes from a whole loop, or it never ends
+    if (assembler->GetOutputCount() == loop_start_count || !NextLoop())
+      read_end = true;
+    loop_start_count = assembler->GetOutputCount();
+  }
+  return true;
+}
+
+std::shared_ptr<MediaBuffer> AnnexBReadStream::Read() {
+  if (eof)
+    return nullptr;
+  while (access_units.empty() && !read_end) {
+    if (!ReadChunk()) {
+      eof = true;
+      return nullptr;
+    }
+  }
+  if (access_units.empty()) {
+    eof = true;
+    return nullptr;
+  }
+  auto au = access_units.front();
+  access_units.pop_front();
+  // the eof of the chunks marks each loop end, only the last one counts
+  au->SetEOF(read_end && access_units.empty());
+  if (au->IsEOF())
+    eof = true;
+  pacer.Wait(au->GetTimeStamp());
+  return au;
+}
+
+int AnnexBReadStream::IoCtrl(unsigned long int request, ...) {
+  va_list vl;
+  va_start(vl, request);
+  void *arg = va_arg(vl, void *);
+  va_end(vl);
+  if (!arg)
+    return -1;
+  if (request == G_STREAM_FRAME_RATE) {
+    StreamInfo si;
+    FrameRateArg *rate = (FrameRateArg *)arg;
+    if (fps.num > 0) {
+      *rate = fps;
+      return 0;
+    }
+    if (assembler->GetParser()->GetStreamInfo(si) && si.fps_num > 0) {
+      rate->num = si.fps_num;
+      rate->den = si.fps_den;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+DEFINE_STREAM_FACTORY(AnnexBReadStream, Stream)
+
+const char *FACTORY(AnnexBReadStream)::ExpectedInputDataType() {
+  return STREAM_FILE;
+}
+
+const char *FACTORY(AnnexBReadStream)::OutPutDataType() {
+  return TYPENEAR(VIDEO_H264) TYPENEAR(VIDEO_H265);
+}
+
 } // namespace easymedia
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "buffer.h"
+#include "control.h"
+#include "filter.h"
+#include "pan_zoom.h"
+
+namespace easymedia {
+
+// Outputs the crop window of the input as a view of its memory, no pixel is
+// copied; the digital pan and zoom of a camera before the encoder or the
+// scaler. The output holds the input. Params:
+//   KEY_BUFFER_RECT: the first window, (x,y,w,h); the whole image if not set
+// IoCtrl:
+//   S_PAN_ZOOM: PanZoomArg, ease the window to the target
+//   G_CROP_WINDOW: ImageRect, the window of the last frame
+class CropViewFilter : public Filter {
+public:
+  CropViewFilter(const char *param);
+  virtual ~CropViewFilter() = default;
+  static const char *GetFilterName() { return "cropview"; }
+  virtual int Process(std::shared_ptr<MediaBuffer> input,
+                      std::shared_ptr<MediaBuffer> output) override;
+  virtual int IoCtrl(unsigned long int request, ...) override;
+
+private:
+  std::unique_ptr<PanZoom> pan_zoom;
+};
+
+CropViewFilter::CropViewFilter(const char *param) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  ImageRect rect = {0, 0, 0, 0};
+  const std::string &value = params[KEY_BUFFER_RECT];
+  if (!value.empty() && sscanf(value.c_str(), "(%d,%d,%d,%d)", &rect.x,
+                               &rect.y, &rect.w, &rect.h) != 4) {
+    LOG("invalid rect: %s\n", value.c_str());
+    SetError(-EINVAL);
+    return;
+  }
+  pan_zoom.reset(new PanZoom(rect));
+}
+
+int CropViewFilter::Process(std::shared_ptr<MediaBuffer> input,
+                            std::shared_ptr<MediaBuffer> output) {
+  if (!input || input->GetType() != Type::Image)
+    return -EINVAL;
+  if (!output || output->GetType() != Type::Image)
+    return -EINVAL;
+  auto src = std::static_pointer_cast<ImageBuffer>(input);
+  auto dst = std::static_pointer_cast<ImageBuffer>(output);
+  if (dst->GetPixelFormat() != PIX_FMT_NONE &&
+      dst->GetPixelFormat() != src->GetPixelFormat()) {
+    LOG("cropview: can not convert the format\n");
+    return -EINVAL;
+  }
+  ImageRect rect = pan_zoom->Next(src->GetWidth(), src->GetHeight());
+  auto view = ImageBuffer::CropView(src, rect);
+  if (!view)
+    return -EINVAL;
+  *dst.get() = *view;
+  return 0;
+}
+
+int CropViewFilter::IoCtrl(unsigned long int request, ...) {
+  va_list vl;
+  va_start(vl, request);
+  void *arg = va_arg(vl, void *);
+  va_end(vl);
+  if (!arg)
+    return -EINVAL;
+  switch (request) {
+  case S_PAN_ZOOM: {
+    auto pz = static_cast<PanZoomArg *>(arg);
+    if (pz->zoom > 0)
+      pan_zoom->SetZoom(pz->zoom, pz->rect.x, pz->rect.y, pz->frames);
+    else
+      pan_zoom->SetTarget(pz->rect, pz->frames);
+    return 0;
+  }
+  case G_CROP_WINDOW:
+    *static_cast<ImageRect *>(arg) = pan_zoom->GetWindow();
+    return 0;
+  default:
+    return -1;
+  }
+}
+
+class _CROPVIEW_SUPPORT_FMTS : public SupportMediaTypes {
+public:
+  _CROPVIEW_SUPPORT_FMTS() {
+    types.append(TYPENEAR(IMAGE_YUV420P));
+    types.append(TYPENEAR(IMAGE_NV12));
+    types.append(TYPENEAR(IMAGE_NV21));
+    types.append(TYPENEAR(IMAGE_YUV422P));
+    types.append(TYPENEAR(IMAGE_NV16));
+    types.append(TYPENEAR(IMAGE_NV61));
+    types.append(TYPENEAR(IMAGE_YUYV422));
+    types.append(TYPENEAR(IMAGE_UYVY422));
+    types.append(TYPENEAR(IMAGE_RGB332));
+    types.append(TYPENEAR(IMAGE_RGB565));
+    types.append(TYPENEAR(IMAGE_BGR565));
+    types.append(TYPENEAR(IMAGE_RGB888));
+    types.append(TYPENEAR(IMAGE_BGR888));
+    types.append(TYPENEAR(IMAGE_ARGB8888));
+    types.append(TYPENEAR(IMAGE_ABGR8888));
+  }
+};
+static _CROPVIEW_SUPPORT_FMTS priv_fmts;
+
+DEFINE_COMMON_FILTER_FACTORY(CropViewFilter)
+const char *FACTORY(CropViewFilter)::ExpectedInputDataType() {
+  return priv_fmts.types.c_str();
+}
+const char *FACTORY(CropViewFilter)::OutPutDataType() {
+  return priv_fmts.types.c_str();
+}
+
+} // namespace easymedia
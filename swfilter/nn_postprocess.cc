@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include <math.h>
+
+#include "buffer.h"
+#include "buffer_pool.h"
+#include "filter.h"
+#include "image_tensor.h"
+#include "nn_backend.h"
+#include "nn_detection.h"
+
+namespace easymedia {
+
+// Turns the outputs of a detector into the detections of the frame: decodes
+// the boxes of the head, runs nms and maps them back through the letterbox
+// of nnpreprocess. The input is a Type::NNResult of the rknn filter, whose
+// GetRelatedSPtrs()[0] is its input, a Type::Tensor holding the frame as
+// its GetRelatedSPtrs()[0], by KEY_OUTPUT_HOLD_INPUT, or the frame itself.
+// The output is a Type::Detection buffer, see nn_detection.h, of the
+// timestamp of the input, which holds the frame. Params:
+//   KEY_NN_HEAD: KEY_YOLOV5 or KEY_YOLOV8, required
+//   KEY_NN_ANCHORS: of yolov5, the 6 of each output, the ones of yolov5s if
+//   not set
+//   KEY_NN_LOGITS: 1 if the yolov5 model leaves the sigmoid out, 0 if not set
+//   KEY_NN_SCORE_THRESHOLD, KEY_NN_NMS_THRESHOLD: 0.25 and 0.45 if not set
+//   KEY_NN_MAX_DETECTIONS: of a frame, 100 if not set
+//   KEY_BUFFER_WIDTH, KEY_BUFFER_HEIGHT: the input of the model, if it is
+//   not from nnpreprocess nor the frame
+//   KEY_POOL_BUFFER_NUM: the detection buffers, 2 if not set, more are
+//   allocated if all are in use
+class NNPostprocessFilter : public Filter {
+public:
+  NNPostprocessFilter(const char *param);
+  virtual ~NNPostprocessFilter() = default;
+  static const char *GetFilterName() { return "nnpostprocess"; }
+  virtual int Process(std::shared_ptr<MediaBuffer> input,
+                      std::shared_ptr<MediaBuffer> output) override;
+
+private:
+  static const int kDefaultPoolBufferNum = 2;
+  static const int kDefaultMaxDetections = 100;
+
+  int Decode(NNResultMeta *meta, int width, std::vector<DetectionBox> &boxes);
+
+  bool yolov8;
+  bool logits;
+  std::vector<float> anchors;
+  float score_threshold, nms_threshold;
+  int max_detections;
+  int model_width, model_height;
+  std::shared_ptr<BufferPool> pool;
+  std::vector<DetectionBox> boxes; // of the frame in process
+};
+
+static const char *kYoloV5sAnchors =
+    "10,13,16,30,33,23,30,61,62,45,59,119,116,90,156,198,373,326";
+
+NNPostprocessFilter::NNPostprocessFilter(const char *param)
+    : yolov8(false), logits(false), score_threshold(0.25f),
+      nms_threshold(0.45f), max_detections(kDefaultMaxDetections),
+      model_width(0), model_height(0) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  const std::string &head = params[KEY_NN_HEAD];
+  if (head == KEY_YOLOV8) {
+    yolov8 = true;
+  } else if (head != KEY_YOLOV5) {
+    LOG("nnpostprocess: unknown head %s\n", head.c_str());
+    SetError(-EINVAL);
+    return;
+  }
+  std::string value = params[KEY_NN_ANCHORS];
+  if (value.empty())
+    value = kYoloV5sAnchors;
+  std::list<std::string> value_list;
+  if (!parse_media_param_list(value.c_str(), value_list, ',') ||
+      value_list.size() % 6) {
+    LOG("nnpostprocess: the anchors are not 6 of each output\n");
+    SetError(-EINVAL);
+    return;
+  }
+  for (auto &s : value_list)
+    anchors.push_back(std::stof(s));
+  value = params[KEY_NN_LOGITS];
+  if (!value.empty())
+    logits = !!std::stoi(value);
+  value = params[KEY_NN_SCORE_THRESHOLD];
+  if (!value.empty())
+    score_threshold = std::stof(value);
+  value = params[KEY_NN_NMS_THRESHOLD];
+  if (!value.empty())
+    nms_threshold = std::stof(value);
+  value = params[KEY_NN_MAX_DETECTIONS];
+  if (!value.empty())
+    max_detections = std::stoi(value);
+  if (max_detections <= 0) {
+    SetError(-EINVAL);
+    return;
+  }
+  const std::string &w = params[KEY_BUFFER_WIDTH];
+  const std::string &h = params[KEY_BUFFER_HEIGHT];
+  if (!w.empty() && !h.empty()) {
+    model_width = std::stoi(w);
+    model_height = std::stoi(h);
+  }
+  int num = kDefaultPoolBufferNum;
+  const std::string &pn = params[KEY_POOL_BUFFER_NUM];
+  if (!pn.empty())
+    num = std::stoi(pn);
+  if (num > 0)
+    pool = std::make_shared<BufferPool>(
+        num, max_detections * sizeof(NNDetection),
+        MediaBuffer::MemType::MEM_COMMON, "nnpostprocess");
+}
+
+int NNPostprocessFilter::Decode(NNResultMeta *meta, int width,
+                                std::vector<DetectionBox> &candidates) {
+  for (size_t i = 0; i < meta->outputs.size(); i++) {
+    const NNTensorAttr &attr = meta->attrs[i];
+    const void *data = meta->outputs[i].buf;
+    int ret;
+    if (yolov8) {
+      ret = DecodeYoloV8(data, attr, score_threshold, candidates);
+    } else {
+      if (anchors.size() < (i + 1) * 6 || attr.dims.size() != 4 ||
+          attr.dims[3] == 0) {
+        LOG("nnpostprocess: no anchors of output %d\n", (int)i);
+        return -EINVAL;
+      }
+      ret = DecodeYoloV5(data, attr, width / attr.dims[3], &anchors[i * 6],
+                         score_threshold, logits, candidates);
+    }
+    if (ret < 0)
+      return ret;
+  }
+  return 0;
+}
+
+int NNPostprocessFilter::Process(std::shared_ptr<MediaBuffer> input,
+                                 std::shared_ptr<MediaBuffer> output) {
+  if (!input || !output)
+    return -EINVAL;
+  NNResultMeta *meta = GetNNResultMeta(*input);
+  if (!meta)
+    return -EINVAL;
+  // the tensor of the model tells the letterbox, then the frame
+  std::shared_ptr<MediaBuffer> src, frame;
+  if (!input->GetRelatedSPtrs().empty())
+    src = std::static_pointer_cast<MediaBuffer>(input->GetRelatedSPtrs()[0]);
+  TensorMeta *tensor = src ? GetTensorMeta(*src) : nullptr;
+  if (tensor && !src->GetRelatedSPtrs().empty())
+    frame = std::static_pointer_cast<MediaBuffer>(src->GetRelatedSPtrs()[0]);
+  else if (!tensor)
+    frame = src;
+  if (frame && frame->GetType() != Type::Image)
+    frame = nullptr;
+  LetterboxTransform transform;
+  int width = model_width, height = model_height;
+  if (tensor) {
+    transform = tensor->transform;
+    width = tensor->spec.width;
+    height = tensor->spec.height;
+  } else if (frame && width <= 0) {
+    const ImageInfo &info =
+        std::static_pointer_cast<ImageBuffer>(frame)->GetImageInfo();
+    width = info.width;
+    height = info.height;
+  }
+  if (width <= 0 || height <= 0) {
+    LOG("nnpostprocess: unknown model input size\n");
+    return -EINVAL;
+  }
+  if (!tensor) {
+    transform.src = transform.dst = {0, 0, width, height};
+    transform.scale_x = transform.scale_y = 1.0f;
+  }
+  int frame_width = width, frame_height = height;
+  if (frame) {
+    const ImageInfo &info =
+        std::static_pointer_cast<ImageBuffer>(frame)->GetImageInfo();
+    frame_width = info.width;
+    frame_height = info.height;
+  }
+
+  boxes.clear();
+  int ret = Decode(meta, width, boxes);
+  if (ret)
+    return ret;
+  NMSBoxes(boxes, nms_threshold, max_detections);
+
+  size_t size = max_detections * sizeof(NNDetection);
+  std::shared_ptr<MediaBuffer> mb = pool ? pool->Get() : nullptr;
+  if (!mb)
+    mb = MediaBuffer::Alloc(size, MediaBuffer::MemType::MEM_COMMON,
+                            "nnpostprocess");
+  if (!mb || !mb->GetPtr()) {
+    LOG_NO_MEMORY();
+    return -ENOMEM;
+  }
+  NNDetection *dets = static_cast<NNDetection *>(mb->GetPtr());
+  int num = 0;
+  for (auto &b : boxes) {
+    float x0 = b.x0, y0 = b.y0, x1 = b.x1, y1 = b.y1;
+    transform.ToImage(x0, y0);
+    transform.ToImage(x1, y1);
+    int l = std::max(0, (int)lroundf(x0));
+    int t = std::max(0, (int)lroundf(y0));
+    int r = std::min(frame_width, (int)lroundf(x1));
+    int btm = std::min(frame_height, (int)lroundf(y1));
+    if (r <= l || btm <= t)
+      continue;
+    NNDetection &d = dets[num++];
+    d.box = {l, t, r - l, btm - t};
+    d.cls = b.cls;
+    d.score = b.score;
+  }
+  output->SetPtr(mb->GetPtr());
+  output->SetSize(mb->GetSize());
+  output->SetUserData(mb);
+  output->SetType(Type::Detection);
+  output->SetValidSize(num);
+  output->SetTimeStamp(input->GetTimeStamp());
+  if (frame)
+    output->SetRelatedSPtr(frame, 0);
+  return 0;
+}
+
+DEFINE_COMMON_FILTER_FACTORY(NNPostprocessFilter)
+const char *FACTORY(NNPostprocessFilter)::ExpectedInputDataType() {
+  return TYPE_ANYTHING;
+}
+const char *FACTORY(NNPostprocessFilter)::OutPutDataType() {
+  return TYPE_ANYTHING;
+}
+
+} // namespace easymedia
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "buffer.h"
+#include "buffer_pool.h"
+#include "filter.h"
+#include "image_tensor.h"
+#include "sw_blit.h"
+
+namespace easymedia {
+
+// Makes the input tensor of a model from the frames in one pass over them:
+// letterbox, scaling, rgb, normalisation, quantisation and layout. The
+// output is a buffer of Type::Tensor, whose TensorMeta tells the letterbox,
+// for the rknn filter and to map the detections back. Params:
+//   KEY_BUFFER_WIDTH, KEY_BUFFER_HEIGHT: of the tensor, required
+//   KEY_TENSOR_TYPE: NN_UINT8, NN_INT8 or NN_FLOAT32, NN_UINT8 if not set
+//   KEY_TENSOR_FMT: KEY_NHWC or KEY_NCHW, KEY_NHWC if not set
+//   KEY_TENSOR_CHANNEL_ORDER: KEY_RGB or KEY_BGR, KEY_RGB if not set
+//   KEY_TENSOR_MEAN, KEY_TENSOR_SCALE, KEY_TENSOR_QNT_SCALE,
+//   KEY_TENSOR_QNT_ZP: the values of TensorSpec
+//   KEY_LETTERBOX, KEY_LETTERBOX_COLOR: 1 and 0x727272 if not set
+//   KEY_COLOR_MATRIX, KEY_COLOR_RANGE: of the yuv frames
+//   KEY_THREAD_NUM: the threads of one frame, auto by the tensor size if 0
+//   KEY_POOL_BUFFER_NUM, KEY_MEM_TYPE: the tensor buffers, 2 of common memory
+//   if not set, more are allocated if all are in use
+class NNPreprocessFilter : public Filter {
+public:
+  NNPreprocessFilter(const char *param);
+  virtual ~NNPreprocessFilter() = default;
+  static const char *GetFilterName() { return "nnpreprocess"; }
+  virtual int Process(std::shared_ptr<MediaBuffer> input,
+                      std::shared_ptr<MediaBuffer> output) override;
+
+private:
+  static const int kDefaultPoolBufferNum = 2;
+
+  TensorSpec spec;
+  YuvMatrix matrix;
+  int threads;
+  MediaBuffer::MemType mem_type;
+  std::shared_ptr<BufferPool> pool;
+};
+
+NNPreprocessFilter::NNPreprocessFilter(const char *param)
+    : matrix(YuvMatrix::BT601_LIMITED), threads(0),
+      mem_type(MediaBuffer::MemType::MEM_COMMON) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  const std::string &w = params[KEY_BUFFER_WIDTH];
+  const std::string &h = params[KEY_BUFFER_HEIGHT];
+  if (!w.empty() && !h.empty()) {
+    spec.width = std::stoi(w);
+    spec.height = std::stoi(h);
+  }
+  if (GetTensorSize(spec) == 0) {
+    LOG("nnpreprocess: missing tensor size\n");
+    SetError(-EINVAL);
+    return;
+  }
+  if (!ParseTensorSpecFromMap(params, spec)) {
+    SetError(-EINVAL);
+    return;
+  }
+  if (spec.type == TensorType::FLOAT16 || spec.type == TensorType::INT16) {
+    LOG("nnpreprocess: unsupported tensor %s\n",
+        params[KEY_TENSOR_TYPE].c_str());
+    SetError(-EINVAL);
+    return;
+  }
+  matrix = GetYuvMatrixByString(params[KEY_COLOR_MATRIX].c_str(),
+                                params[KEY_COLOR_RANGE].c_str());
+  const std::string &t = params[KEY_THREAD_NUM];
+  if (!t.empty())
+    threads = std::stoi(t);
+  const std::string &mt = params[KEY_MEM_TYPE];
+  if (!mt.empty())
+    mem_type = StringToMemType(mt.c_str());
+  int num = kDefaultPoolBufferNum;
+  const std::string &pn = params[KEY_POOL_BUFFER_NUM];
+  if (!pn.empty())
+    num = std::stoi(pn);
+  if (num > 0)
+    pool = std::make_shared<BufferPool>(num, GetTensorSize(spec), mem_type,
+                                        "nnpreprocess");
+}
+
+int NNPreprocessFilter::Process(std::shared_ptr<MediaBuffer> input,
+                                std::shared_ptr<MediaBuffer> output) {
+  if (!input || input->GetType() != Type::Image || !output)
+    return -EINVAL;
+  auto src = std::static_pointer_cast<ImageBuffer>(input);
+  CpuImage img;
+  if (!get_cpu_image(src.get(), img))
+    return -EINVAL;
+  size_t size = GetTensorSize(spec);
+  std::shared_ptr<MediaBuffer> mb = pool ? pool->Get() : nullptr;
+  if (!mb)
+    mb = MediaBuffer::Alloc(size, mem_type, "nnpreprocess");
+  if (!mb || !mb->GetPtr() || mb->GetSize() < size) {
+    LOG_NO_MEMORY();
+    return -ENOMEM;
+  }
+  auto meta = std::make_shared<TensorMeta>();
+  meta->spec = spec;
+  meta->memory = mb;
+  src->BeginCPUAccess(true, false);
+  mb->BeginCPUAccess(false, true);
+  int ret = ImageToTensor(mb->GetPtr(), spec, img, nullptr, &meta->transform,
+                          matrix, threads);
+  mb->EndCPUAccess(false, true);
+  src->EndCPUAccess(true, false);
+  if (ret)
+    return ret;
+  output->SetPtr(mb->GetPtr());
+  output->SetFD(mb->GetFD());
+  output->SetSize(mb->GetSize());
+  output->SetUserData(meta);
+  output->SetValidSize(size);
+  output->SetType(Type::Tensor);
+  output->SetTimeStamp(input->GetTimeStamp());
+  return 0;
+}
+
+class _NNPREPROCESS_SUPPORT_FMTS : public SupportMediaTypes {
+public:
+  _NNPREPROCESS_SUPPORT_FMTS() {
+    types.append(TYPENEAR(IMAGE_YUV420P));
+    types.append(TYPENEAR(IMAGE_NV12));
+    types.append(TYPENEAR(IMAGE_NV21));
+    types.append(TYPENEAR(IMAGE_YUV422P));
+    types.append(TYPENEAR(IMAGE_NV16));
+    types.append(TYPENEAR(IMAGE_NV61));
+    types.append(TYPENEAR(IMAGE_RGB888));
+    types.append(TYPENEAR(IMAGE_BGR888));
+    types.append(TYPENEAR(IMAGE_ARGB8888));
+    types.append(TYPENEAR(IMAGE_ABGR8888));
+  }
+};
+static _NNPREPROCESS_SUPPORT_FMTS priv_fmts;
+
+DEFINE_COMMON_FILTER_FACTORY(NNPreprocessFilter)
+const char *FACTORY(NNPreprocessFilter)::ExpectedInputDataType() {
+  return priv_fmts.types.c_str();
+}
+const char *FACTORY(NNPreprocessFilter)::OutPutDataType() {
+  return TYPENEAR(NN_UINT8) TYPENEAR(NN_INT8) TYPENEAR(NN_FLOAT32);
+}
+
+} // namespace easymedia
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "sw_blit.h"
+
+#include <assert.h>
+
+#include <vector>
+
+#include "buffer.h"
+#include "filter.h"
+
+namespace easymedia {
+
+// The cpu counterpart of RgaFilter, for the boards whose rga is busy or
+// missing. It takes the same params, and more:
+//   KEY_SCALE_MODE: KEY_SCALE_BILINEAR or KEY_SCALE_AREA, auto if not set
+//   KEY_THREAD_NUM: the threads of one frame, auto by the frame size if 0
+class SwBlitFilter : public Filter {
+public:
+  SwBlitFilter(const char *param);
+  virtual ~SwBlitFilter() = default;
+  static const char *GetFilterName() { return "swblit"; }
+  virtual int Process(std::shared_ptr<MediaBuffer> input,
+                      std::shared_ptr<MediaBuffer> output) override;
+
+private:
+  std::vector<ImageRect> vec_rect;
+  int rotate;
+  ScaleMode mode;
+  int threads;
+};
+
+SwBlitFilter::SwBlitFilter(const char *param)
+    : rotate(0), mode(ScaleMode::AUTO), threads(0) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  const std::string &value = params[KEY_BUFFER_RECT];
+  auto &&rects = StringToTwoImageRect(value);
+  if (rects.empty()) {
+    LOG("missing rects\n");
+    SetError(-EINVAL);
+    return;
+  }
+  vec_rect = std::move(rects);
+  const std::string &v = params[KEY_BUFFER_ROTATE];
+  if (!v.empty())
+    rotate = std::stoi(v);
+  if (GetImageTransform(rotate) < 0) {
+    LOG("invalid rotate %d\n", rotate);
+    SetError(-EINVAL);
+    return;
+  }
+  mode = GetScaleModeByString(params[KEY_SCALE_MODE].c_str());
+  const std::string &t = params[KEY_THREAD_NUM];
+  if (!t.empty())
+    threads = std::stoi(t);
+}
+
+int SwBlitFilter::Process(std::shared_ptr<MediaBuffer> input,
+                          std::shared_ptr<MediaBuffer> output) {
+  if (vec_rect.size() < 2)
+    return -EINVAL;
+  if (!input || input->GetType() != Type::Image)
+    return -EINVAL;
+  if (!output || output->GetType() != Type::Image)
+    return -EINVAL;
+
+  auto src = std::static_pointer_cast<easymedia::ImageBuffer>(input);
+  ImageRect *src_rect = nullptr;
+  if (vec_rect[0].w > 0 && vec_rect[0].h > 0)
+    src_rect = &vec_rect[0];
+  auto dst = std::static_pointer_cast<easymedia::ImageBuffer>(output);
+  ImageRect *dst_rect = nullptr;
+  if (vec_rect[1].w > 0 && vec_rect[1].h > 0)
+    dst_rect = &vec_rect[1];
+  assert(!dst_rect || (dst_rect && dst->IsValid()));
+  if (!dst_rect && !dst->IsValid()) {
+    // the same to src, rotated
+    ImageInfo info = src->GetImageInfo();
+    info.pix_fmt = dst->GetPixelFormat();
+    if (GetImageTransform(rotate) & IMAGE_ROT_90) {
+      std::swap(info.width, info.height);
+      std::swap(info.vir_width, info.vir_height);
+    }
+    size_t size = CalPixFmtSize(info);
+    if (size == 0)
+      return -EINVAL;
+    auto &&mb = MediaBuffer::Alloc2(size, MediaBuffer::MemType::MEM_COMMON,
+                                    "swblit");
+    ImageBuffer ib(mb, info);
+    if (ib.GetSize() >= size) {
+      ib.SetValidSize(size);
+      *dst.get() = ib;
+    }
+    assert(dst->IsValid());
+  }
+  return sw_blit(src, dst, src_rect, dst_rect, rotate, mode, threads);
+}
+
+bool get_cpu_image(ImageBuffer *ib, CpuImage &img) {
+  ImagePlane planes[IMAGE_MAX_PLANES];
+  uint8_t *data[IMAGE_MAX_PLANES];
+  int num = ib->GetPlanes(planes);
+  if (ib->GetPlanePtrs(data) != num ||
+      !GetCpuImage(img, data, ib->GetImageInfo(), planes, num)) {
+    LOG("sw filter: unsupport image of fmt %d\n", ib->GetPixelFormat());
+    return false;
+  }
+  return true;
+}
+
+int sw_blit(std::shared_ptr<ImageBuffer> src, std::shared_ptr<ImageBuffer> dst,
+            ImageRect *src_rect, ImageRect *dst_rect, int rotate,
+            ScaleMode mode, int threads) {
+  if (!src || !src->IsValid())
+    return -EINVAL;
+  if (!dst || !dst->IsValid())
+    return -EINVAL;
+  CpuImage si, di;
+  if (!get_cpu_image(src.get(), si) || !get_cpu_image(dst.get(), di))
+    return -EINVAL;
+  src->BeginCPUAccess(true, false);
+  dst->BeginCPUAccess(false, true);
+  int ret = BlitImage(di, dst_rect, si, src_rect, rotate, mode, threads);
+  dst->EndCPUAccess(false, true);
+  src->EndCPUAccess(true, false);
+  if (!ret && src->GetTimeStamp() > dst->GetTimeStamp())
+    dst->SetTimeStamp(src->GetTimeStamp());
+  return ret;
+}
+
+class _SWBLIT_SUPPORT_FMTS : public SupportMediaTypes {
+public:
+  _SWBLIT_SUPPORT_FMTS() {
+    types.append(TYPENEAR(IMAGE_YUV420P));
+    types.append(TYPENEAR(IMAGE_NV12));
+    types.append(TYPENEAR(IMAGE_NV21));
+    types.append(TYPENEAR(IMAGE_YUV422P));
+    types.append(TYPENEAR(IMAGE_NV16));
+    types.append(TYPENEAR(IMAGE_NV61));
+    types.append(TYPENEAR(IMAGE_YUYV422));
+    types.append(TYPENEAR(IMAGE_UYVY422));
+    types.append(TYPENEAR(IMAGE_RGB332));
+    types.append(TYPENEAR(IMAGE_RGB565));
+    types.append(TYPENEAR(IMAGE_BGR565));
+    types.append(TYPENEAR(IMAGE_RGB888));
+    types.append(TYPENEAR(IMAGE_BGR888));
+    types.append(TYPENEAR(IMAGE_ARGB8888));
+    types.append(TYPENEAR(IMAGE_ABGR8888));
+  }
+};
+static _SWBLIT_SUPPORT_FMTS priv_fmts;
+
+DEFINE_COMMON_FILTER_FACTORY(SwBlitFilter)
+const char *FACTORY(SwBlitFilter)::ExpectedInputDataType() {
+  return priv_fmts.types.c_str();
+}
+const char *FACTORY(SwBlitFilter)::OutPutDataType() {
+  return priv_fmts.types.c_str();
+}
+
+} // namespace easymedia
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include "sw_convert.h"
+
+#include <assert.h>
+
+#include "buffer.h"
+#include "filter.h"
+#include "sw_blit.h"
+
+namespace easymedia {
+
+// Pixel format conversion by the cpu, such as the yuyv of uvc cameras to
+// nv12. Params:
+//   KEY_OUTPUTDATATYPE: the format of the output if the output buffer has none
+//   KEY_COLOR_MATRIX: KEY_BT601 or KEY_BT709, bt601 if not set
+//   KEY_COLOR_RANGE: KEY_RANGE_LIMITED or KEY_RANGE_FULL, limited if not set
+//   KEY_THREAD_NUM: the threads of one frame, auto by the frame size if 0
+class SwConvertFilter : public Filter {
+public:
+  SwConvertFilter(const char *param);
+  virtual ~SwConvertFilter() = default;
+  static const char *GetFilterName() { return "swconvert"; }
+  virtual int Process(std::shared_ptr<MediaBuffer> input,
+                      std::shared_ptr<MediaBuffer> output) override;
+
+private:
+  PixelFormat out_fmt;
+  YuvMatrix matrix;
+  int threads;
+};
+
+SwConvertFilter::SwConvertFilter(const char *param)
+    : out_fmt(PIX_FMT_NONE), matrix(YuvMatrix::BT601_LIMITED), threads(0) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  const std::string &type = params[KEY_OUTPUTDATATYPE];
+  if (!type.empty()) {
+    out_fmt = GetPixFmtByString(type.c_str());
+    if (out_fmt == PIX_FMT_NONE) {
+      LOG("unsupport output type %s\n", type.c_str());
+      SetError(-EINVAL);
+      return;
+    }
+  }
+  matrix = GetYuvMatrixByString(params[KEY_COLOR_MATRIX].c_str(),
+                                params[KEY_COLOR_RANGE].c_str());
+  const std::string &t = params[KEY_THREAD_NUM];
+  if (!t.empty())
+    threads = std::stoi(t);
+}
+
+int SwConvertFilter::Process(std::shared_ptr<MediaBuffer> input,
+                             std::shared_ptr<MediaBuffer> output) {
+  if (!input || input->GetType() != Type::Image)
+    return -EINVAL;
+  if (!output || output->GetType() != Type::Image)
+    return -EINVAL;
+  auto src = std::static_pointer_cast<easymedia::ImageBuffer>(input);
+  auto dst = std::static_pointer_cast<easymedia::ImageBuffer>(output);
+  if (!dst->IsValid()) {
+    ImageInfo info = src->GetImageInfo();
+    info.pix_fmt = dst->GetPixelFormat();
+    if (info.pix_fmt == PIX_FMT_NONE)
+      info.pix_fmt = out_fmt;
+    size_t size = CalPixFmtSize(info);
+    if (size == 0)
+      return -EINVAL;
+    auto &&mb = MediaBuffer::Alloc2(size, MediaBuffer::MemType::MEM_COMMON,
+                                    "swconvert");
+    ImageBuffer ib(mb, info);
+    if (ib.GetSize() >= size) {
+      ib.SetValidSize(size);
+      *dst.get() = ib;
+    }
+    assert(dst->IsValid());
+  }
+  return sw_convert(src, dst, matrix, threads);
+}
+
+int sw_convert(std::shared_ptr<ImageBuffer> src,
+               std::shared_ptr<ImageBuffer> dst, YuvMatrix matrix,
+               int threads) {
+  if (!src || !src->IsValid())
+    return -EINVAL;
+  if (!dst || !dst->IsValid())
+    return -EINVAL;
+  CpuImage si, di;
+  if (!get_cpu_image(src.get(), si) || !get_cpu_image(dst.get(), di))
+    return -EINVAL;
+  src->BeginCPUAccess(true, false);
+  dst->BeginCPUAccess(false, true);
+  int ret = ConvertImage(di, si, matrix, threads);
+  dst->EndCPUAccess(false, true);
+  src->EndCPUAccess(true, false);
+  if (!ret && src->GetTimeStamp() > dst->GetTimeStamp())
+    dst->SetTimeStamp(src->GetTimeStamp());
+  return ret;
+}
+
+class _SWCONVERT_SUPPORT_FMTS : public SupportMediaTypes {
+public:
+  _SWCONVERT_SUPPORT_FMTS() {
+    types.append(TYPENEAR(IMAGE_YUV420P));
+    types.append(TYPENEAR(IMAGE_NV12));
+    types.append(TYPENEAR(IMAGE_NV21));
+    types.append(TYPENEAR(IMAGE_YUV422P));
+    types.append(TYPENEAR(IMAGE_NV16));
+    types.append(TYPENEAR(IMAGE_NV61));
+    types.append(TYPENEAR(IMAGE_YUYV422));
+    types.append(TYPENEAR(IMAGE_UYVY422));
+    types.append(TYPENEAR(IMAGE_RGB332));
+    types.append(TYPENEAR(IMAGE_RGB565));
+    types.append(TYPENEAR(IMAGE_BGR565));
+    types.append(TYPENEAR(IMAGE_RGB888));
+    types.append(TYPENEAR(IMAGE_BGR888));
+    types.append(TYPENEAR(IMAGE_ARGB8888));
+    types.append(TYPENEAR(IMAGE_ABGR8888));
+  }
+};
+static _SWCONVERT_SUPPORT_FMTS priv_fmts;
+
+DEFINE_COMMON_FILTER_FACTORY(SwConvertFilter)
+const char *FACTORY(SwConvertFilter)::ExpectedInputDataType() {
+  return priv_fmts.types.c_str();
+}
+const char *FACTORY(SwConvertFilter)::OutPutDataType() {
+  return priv_fmts.types.c_str();
+}
+
+} // namespace easymedia
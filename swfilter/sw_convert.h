@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifndef EASYMEDIA_SW_CONVERT_H_
+#define EASYMEDIA_SW_CONVERT_H_
+
+#include <memory>
+
+#include "image_convert.h"
+
+namespace easymedia {
+
+class ImageBuffer;
+// Convert the pixel format of src to the one of dst, of the same size.
+int sw_convert(std::shared_ptr<ImageBuffer> src,
+               std::shared_ptr<ImageBuffer> dst,
+               YuvMatrix matrix = YuvMatrix::BT601_LIMITED, int threads = 0);
+
+} // namespace easymedia
+
+#endif // #ifndef EASYMEDIA_SW_CONVERT_H_
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include <stdarg.h>
+
+#include "buffer.h"
+#include "control.h"
+#include "filter.h"
+#include "image_overlay.h"
+#include "sw_blit.h"
+
+namespace easymedia {
+
+// Draws the osd regions and the privacy masks onto the frames in place, so
+// any encoder or display takes them; the output is the input. Params:
+//   KEY_COLOR_MATRIX, KEY_COLOR_RANGE: of the frames, bt601 limited if not set
+// IoCtrl:
+//   S_OVERLAY_REGION: OverlayRegionArg, add or replace a region
+//   S_OVERLAY_MOVE: OverlayRegionArg, move a region to rect.x, rect.y
+//   S_OVERLAY_REMOVE: int, the id to remove, -1 for all
+class SwOverlayFilter : public Filter {
+public:
+  SwOverlayFilter(const char *param);
+  virtual ~SwOverlayFilter() = default;
+  static const char *GetFilterName() { return "swoverlay"; }
+  virtual int Process(std::shared_ptr<MediaBuffer> input,
+                      std::shared_ptr<MediaBuffer> output) override;
+  virtual int IoCtrl(unsigned long int request, ...) override;
+
+private:
+  std::unique_ptr<ImageOverlay> overlay;
+};
+
+SwOverlayFilter::SwOverlayFilter(const char *param) {
+  std::map<std::string, std::string> params;
+  if (!parse_media_param_map(param, params)) {
+    SetError(-EINVAL);
+    return;
+  }
+  YuvMatrix matrix = GetYuvMatrixByString(params[KEY_COLOR_MATRIX].c_str(),
+                                          params[KEY_COLOR_RANGE].c_str());
+  overlay.reset(new ImageOverlay(matrix));
+}
+
+int SwOverlayFilter::Process(std::shared_ptr<MediaBuffer> input,
+                             std::shared_ptr<MediaBuffer> output) {
+  if (!input || input->GetType() != Type::Image)
+    return -EINVAL;
+  if (!output || output->GetType() != Type::Image)
+    return -EINVAL;
+  auto src = std::static_pointer_cast<ImageBuffer>(input);
+  auto dst = std::static_pointer_cast<ImageBuffer>(output);
+  if (!overlay->Empty()) {
+    CpuImage img;
+    if (!get_cpu_image(src.get(), img))
+      return -EINVAL;
+    src->BeginCPUAccess(true, true);
+    int ret = overlay->Apply(img);
+    src->EndCPUAccess(true, true);
+    if (ret)
+      return ret;
+  }
+  *dst.get() = *src.get();
+  return 0;
+}
+
+int SwOverlayFilter::IoCtrl(unsigned long int request, ...) {
+  va_list vl;
+  va_start(vl, request);
+  void *arg = va_arg(vl, void *);
+  va_end(vl);
+  if (!arg)
+    return -EINVAL;
+  switch (request) {
+  case S_OVERLAY_REGION: {
+    auto ra = static_cast<OverlayRegionArg *>(arg);
+    return overlay->SetRegion(ra->id, ra->region);
+  }
+  case S_OVERLAY_MOVE: {
+    auto ra = static_cast<OverlayRegionArg *>(arg);
+    return overlay->MoveRegion(ra->id, ra->region.rect.x, ra->region.rect.y);
+  }
+  case S_OVERLAY_REMOVE:
+    overlay->RemoveRegion(*static_cast<int *>(arg));
+    return 0;
+  default:
+    return -1;
+  }
+}
+
+class _SWOVERLAY_SUPPORT_FMTS : public SupportMediaTypes {
+public:
+  _SWOVERLAY_SUPPORT_FMTS() {
+    types.append(TYPENEAR(IMAGE_YUV420P));
+    types.append(TYPENEAR(IMAGE_NV12));
+    types.append(TYPENEAR(IMAGE_NV21));
+    types.append(TYPENEAR(IMAGE_YUV422P));
+    types.append(TYPENEAR(IMAGE_NV16));
+    types.append(TYPENEAR(IMAGE_NV61));
+  }
+};
+static _SWOVERLAY_SUPPORT_FMTS priv_fmts;
+
+DEFINE_COMMON_FILTER_FACTORY(SwOverlayFilter)
+const char *FACTORY(SwOverlayFilter)::ExpectedInputDataType() {
+  return priv_fmts.types.c_str();
+}
+const char *FACTORY(SwOverlayFilter)::OutPutDataType() {
+  return priv_fmts.types.c_str();
+}
+
+} // namespace easymedia
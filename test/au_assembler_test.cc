@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <list>
+#include <vector>
+
+#include "au_assembler.h"
+#include "buffer.h"
+
+using easymedia::AccessUnitAssembler;
+using easymedia::MediaBuffer;
+using easymedia::NalCodec;
+
+typedef std::vector<uint8_t> Bytes;
+typedef std::list<std::shared_ptr<MediaBuffer>> BufferList;
+
+struct AccessUnit {
+  Bytes data;
+  uint32_t flag;
+};
+
+// Write the head bits of a nal unit; the rest is filler which never
+// makes 00 00 0x.
+class NalWriter {
+public:
+  NalWriter(std::initializer_list<uint8_t> nal_header)
+      : nal(nal_header), bits(0) {}
+  NalWriter &U(int n, uint32_t v) {
+    for (int i = n - 1; i >= 0; i--) {
+      if (!(bits & 7))
+        head.push_back(0);
+      head.back() |= ((v >> i) & 1) << (7 - (bits & 7));
+      bits++;
+    }
+    return *this;
+  }
+  NalWriter &UE(uint32_t v) {
+    int len = 0;
+    while ((uint64_t)(v + 1) >> (len + 1))
+      len++;
+    U(len, 0);
+    return U(len + 1, v + 1);
+  }
+  Bytes Finish(size_t filler) {
+    U(1, 1);
+    while (bits & 7)
+      U(1, 0);
+    for (uint8_t b : head) {
+      // no emulation prevention needed for the tests
+      assert(b != 0 || nal.back() != 0);
+      nal.push_back(b);
+    }
+    for (size_t i = 0; i < filler; i++)
+      nal.push_back((uint8_t)(0x11 + i % 0xEE));
+    return nal;
+  }
+
+private:
+  Bytes nal;
+  Bytes head;
+  int bits;
+};
+
+static Bytes h264_slice(int type, int first_mb, int slice_type, size_t size) {
+  return NalWriter({(uint8_t)(0x60 | type)})
+      .UE(first_mb)
+      .UE(slice_type)
+      .UE(0)
+      .Finish(size);
+}
+
+static Bytes h265_slice(int type, bool first, int slice_type, size_t size) {
+  // no extra slice header bits, no output flag, no colour plane
+  NalWriter w({(uint8_t)(type << 1), 1});
+  w.U(1, first);
+  if (type >= 16 && type <= 23)
+    w.U(1, 0); // no_output_of_prior_pics_flag
+  w.UE(0);
+  if (!first)
+    w.U(1, 0); // slice_segment_address, 1 bit for the tests
+  return w.UE(slice_type).Finish(size);
+}
+
+// Build the stream from the access units, alternating 3 and 4 byte start
+// codes, and some garbage ahead.
+static Bytes make_stream(std::vector<std::vector<Bytes>> &units,
+                         std::vector<AccessUnit> &expect) {
+  Bytes stream = {0x00, 0x00, 0x12};
+  int n = 0;
+  for (auto &u : units) {
+    AccessUnit au;
+    for (auto &nal : u) {
+      if (n++ & 1)
+        au.data.push_back(0);
+      au.data.insert(au.data.end(), {0, 0, 1});
+      au.data.insert(au.data.end(), nal.begin(), nal.end());
+    }
+    stream.insert(stream.end(), au.data.begin(), au.data.end());
+    expect.push_back(au);
+  }
+  return stream;
+}
+
+// Push the stream in chunks of the given sizes, cycling.
+static BufferList assemble(NalCodec codec, const Bytes &stream,
+                           const std::vector<size_t> &chunk_sizes,
+                           int *views = nullptr) {
+  AccessUnitAssembler assembler(codec);
+  BufferList out;
+  size_t pos = 0, i = 0;
+  if (views)
+    *views = 0;
+  while (pos < stream.size()) {
+    size_t size =
+        std::min(chunk_sizes[i++ % chunk_sizes.size()], stream.size() - pos);
+    auto chunk = MediaBuffer::Alloc(size);
+    assert(chunk);
+    memcpy(chunk->GetPtr(), stream.data() + pos, size);
+    chunk->SetValidSize(size);
+    chunk->SetTimeStamp(pos);
+    pos += size;
+    if (pos == stream.size())
+      chunk->SetEOF(true);
+    BufferList l;
+    assembler.Push(chunk, l);
+    for (auto &b : l) {
+      uint8_t *p = (uint8_t *)b->GetPtr();
+      if (views && p >= chunk->GetPtr() &&
+          p + b->GetValidSize() <= (uint8_t *)chunk->GetPtr() + size)
+        (*views)++;
+    }
+    out.splice(out.end(), l);
+  }
+  return out;
+}
+
+static void check(const BufferList &out, const std::vector<AccessUnit> &expect,
+                  const char *what) {
+  if (out.size() != expect.size()) {
+    fprintf(stderr, "%s: %d access units, expect %d\n", what, (int)out.size(),
+            (int)expect.size());
+    abort();
+  }
+  size_t i = 0;
+  for (auto &b : out) {
+    const AccessUnit &au = expect[i];
+    if (b->GetValidSize() != au.data.size() ||
+        memcmp(b->GetPtr(), au.data.data(), au.data.size()) ||
+        b->GetUserFlag() != au.flag) {
+      fprintf(stderr, "%s: access unit %d mismatch, size %d/%d flag %x/%x\n",
+              what, (int)i, (int)b->GetValidSize(), (int)au.data.size(),
+              b->GetUserFlag(), au.flag);
+      abort();
+    }
+    i++;
+  }
+}
+
+static void check_chunkings(NalCodec codec, const Bytes &stream,
+                            const std::vector<AccessUnit> &expect,
+                            const char *what) {
+  const std::vector<std::vector<size_t>> chunkings = {
+      {stream.size()}, {1}, {2}, {3}, {5}, {7, 1, 2}, {64}, {1000, 3}};
+  for (auto &c : chunkings)
+    check(assemble(codec, stream, c), expect, what);
+  srand(1);
+  for (int round = 0; round < 200; round++) {
+    std::vector<size_t> c;
+    for (int i = 0; i < 16; i++)
+      c.push_back(1 + rand() % 300);
+    check(assemble(codec, stream, c), expect, what);
+  }
+  int views = 0;
+  assemble(codec, stream, {stream.size()}, &views);
+  assert(views == (int)expect.size());
+  printf("%s: ok\n", what);
+}
+
+static void test_h264() {
+  Bytes sps = NalWriter({0x67}).U(8, 66).U(8, 0).U(8, 30).UE(0).Finish(8);
+  Bytes pps = NalWriter({0x68}).UE(0).UE(0).Finish(2);
+  Bytes aud = NalWriter({0x09}).U(3, 7).Finish(0);
+  Bytes sei = {0x06, 0x05, 0x01, 0x20, 0x80};
+  Bytes eos = {0x0B};
+  std::vector<std::vector<Bytes>> units = {
+      {aud, sps, pps, h264_slice(5, 0, 7, 300)},
+      {aud, h264_slice(1, 0, 5, 40), h264_slice(1, 30, 5, 50)},
+      // no aud, split by first_mb_in_slice
+      {h264_slice(1, 0, 6, 20)},
+      {sei, h264_slice(1, 0, 5, 1), h264_slice(1, 10, 5, 2),
+       h264_slice(1, 20, 6, 3)},
+      {h264_slice(1, 0, 7, 2)},
+      {sps, pps, h264_slice(5, 0, 7, 500), eos},
+  };
+  std::vector<AccessUnit> expect;
+  Bytes stream = make_stream(units, expect);
+  const uint32_t flags[] = {
+      MediaBuffer::kIntra | MediaBuffer::kExtraIntra,
+      MediaBuffer::kPredicted,
+      MediaBuffer::kBiPredictive,
+      MediaBuffer::kBiPredictive,
+      0,
+      MediaBuffer::kIntra | MediaBuffer::kExtraIntra};
+  for (size_t i = 0; i < expect.size(); i++)
+    expect[i].flag = flags[i];
+  check_chunkings(NalCodec::H264, stream, expect, "h264");
+}
+
+static void test_h265() {
+  Bytes vps = {0x40, 0x01, 0x0C, 0x01, 0xFF};
+  Bytes sps = {0x42, 0x01, 0x01, 0x01, 0x60};
+  Bytes pps = {0x44, 0x01, 0xC1, 0x72};
+  Bytes aud = {0x46, 0x01, 0x50};
+  Bytes suffix_sei = {0x50, 0x01, 0x84, 0x01, 0x80};
+  Bytes eob = {0x4A, 0x01};
+  std::vector<std::vector<Bytes>> units = {
+      {aud, vps, sps, pps, h265_slice(19, true, 2, 400),
+       h265_slice(19, false, 2, 100), suffix_sei},
+      {aud, h265_slice(1, true, 1, 40)},
+      {h265_slice(1, true, 1, 40), h265_slice(1, false, 1, 30)},
+      {h265_slice(21, true, 2, 80), eob},
+  };
+  std::vector<AccessUnit> expect;
+  Bytes stream = make_stream(units, expect);
+  // the p slices are not classified without the parameter sets
+  const uint32_t flags[] = {MediaBuffer::kIntra | MediaBuffer::kExtraIntra,
+                            0, 0, MediaBuffer::kIntra};
+  for (size_t i = 0; i < expect.size(); i++)
+    expect[i].flag = flags[i];
+  check_chunkings(NalCodec::H265, stream, expect, "h265");
+}
+
+static void test_timestamp() {
+  Bytes stream;
+  for (int i = 0; i < 10; i++) {
+    Bytes s = h264_slice(i ? 1 : 5, 0, i ? 5 : 7, 10);
+    stream.insert(stream.end(), {0, 0, 0, 1});
+    stream.insert(stream.end(), s.begin(), s.end());
+  }
+  AccessUnitAssembler assembler(NalCodec::H264);
+  assembler.SetFrameRate(30000, 1001);
+  auto chunk = MediaBuffer::Alloc(stream.size());
+  memcpy(chunk->GetPtr(), stream.data(), stream.size());
+  chunk->SetValidSize(stream.size());
+  chunk->SetTimeStamp(1000);
+  BufferList out;
+  assembler.Push(chunk, out);
+  // the last one waits for the next access unit or eof
+  assert(out.size() == 9);
+  assembler.Flush(out);
+  assert(out.size() == 10);
+  int64_t i = 0;
+  for (auto &b : out) {
+    assert(b->GetTimeStamp() == 1000 + i * 1001 / 30);
+    i++;
+  }
+  printf("timestamp: ok\n");
+}
+
+// Check a real stream gives the same access units whatever the chunks are.
+static int test_file(const char *path, NalCodec codec) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "open %s failed, %m\n", path);
+    return -1;
+  }
+  Bytes stream;
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    stream.insert(stream.end(), buf, buf + n);
+  fclose(f);
+  BufferList whole = assemble(codec, stream, {stream.size()});
+  std::vector<AccessUnit> expect;
+  int keyframes = 0;
+  for (auto &b : whole) {
+    uint8_t *p = (uint8_t *)b->GetPtr();
+    expect.push_back({Bytes(p, p + b->GetValidSize()), b->GetUserFlag()});
+    if (b->GetUserFlag() & MediaBuffer::kIntra)
+      keyframes++;
+  }
+  for (size_t c : {1, 13, 4096, 65536})
+    check(assemble(codec, stream, {c}), expect, path);
+  printf("%s: %d access units, %d keyframes, ok\n", path, (int)expect.size(),
+         keyframes);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  test_h264();
+  test_h265();
+  test_timestamp();
+  if (argc > 1) {
+    NalCodec codec = NalCodec::H264;
+    if (argc > 2 && !strcmp(argv[2], "h265"))
+      codec = NalCodec::H265;
+    return test_file(argv[1], codec) ? 1 : 0;
+  }
+  return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+// Check the census counts each memory once: a tracked buffer adds its bytes
+// until its last copy dies, a shared one over its memory, such as a dequeued
+// capture slot, adds none but has its own holder and age; and the byte
+// threshold alerts. The age alert is of the time held by a flow, the idle
+// slots of a pool never alert.
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include "buffer.h"
+#include "buffer_census.h"
+#include "buffer_pool.h"
+#include "utils.h"
+
+using easymedia::BufferCensusRecord;
+using easymedia::MediaBuffer;
+
+static const MediaBuffer::MemType kCommon = MediaBuffer::MemType::MEM_COMMON;
+
+static int alerts;
+static void count_alert(const char *msg) {
+  alerts++;
+  printf("alert: %s", msg);
+}
+
+static const BufferCensusRecord *find(const std::vector<BufferCensusRecord> &r,
+                                      const char *tag) {
+  for (auto &rec : r)
+    if (!strcmp(rec.tag, tag))
+      return &rec;
+  return nullptr;
+}
+
+static void test_pool_age() {
+  auto pool = std::make_shared<easymedia::BufferPool>(2, 1000, kCommon,
+                                                      "census_pool");
+  size_t bytes = easymedia::GetCensusBytes(kCommon);
+  alerts = 0;
+  easymedia::SetCensusAgeThreshold(50);
+  auto mb = pool->Get();
+  assert(mb && easymedia::GetCensusBytes(kCommon) == bytes);
+  easymedia::msleep(100);
+  // the slots and the copy are older than the threshold, none is held
+  assert(easymedia::CheckBufferCensus() == 0);
+  easymedia::CensusSetHolder(*mb, "census_flow");
+  easymedia::msleep(100);
+  assert(easymedia::CheckBufferCensus() == 1 && alerts == 1);
+  // back to the pool, the next copy is not held
+  mb.reset();
+  mb = pool->Get();
+  auto records = easymedia::GetBufferCensus();
+  int held = 0;
+  for (auto &r : records)
+    held += !strcmp(r.tag, "census_pool") && !r.holder.empty();
+  assert(held == 0);
+  assert(easymedia::CheckBufferCensus() == 0 && alerts == 1);
+  easymedia::SetCensusAgeThreshold(0);
+  mb.reset();
+  pool.reset();
+  assert(easymedia::GetCensusBytes(kCommon) == bytes - 2000);
+  alerts = 0;
+  printf("pool age ok\n");
+}
+
+int main() {
+  easymedia::EnableBufferCensus(true);
+  size_t base = easymedia::GetCensusBytes(kCommon);
+  auto slot = MediaBuffer::Alloc(1000, kCommon, "census_slot");
+  assert(slot && easymedia::GetCensusBytes(kCommon) == base + 1000);
+  {
+    // a copy shares the entry of slot
+    auto copy = std::make_shared<MediaBuffer>(*slot);
+    assert(easymedia::GetCensusBytes(kCommon) == base + 1000);
+    // as v4l2 capture dequeues a ring slot
+    auto view = std::make_shared<MediaBuffer>(*slot);
+    view->SetCensusEntry(nullptr);
+    easymedia::CensusTrackShared(*view, "census_view", kCommon);
+    easymedia::CensusSetHolder(*view, "census_flow");
+    assert(easymedia::GetCensusBytes(kCommon) == base + 1000);
+    auto records = easymedia::GetBufferCensus();
+    const BufferCensusRecord *s = find(records, "census_slot");
+    const BufferCensusRecord *v = find(records, "census_view");
+    assert(s && !s->shared && s->size == 1000);
+    assert(v && v->shared && v->size == 1000 && v->holder == "census_flow");
+
+    easymedia::SetCensusAlertFunc(count_alert);
+    easymedia::SetCensusBytesThreshold(kCommon, base + 1500);
+    assert(easymedia::CheckBufferCensus() == 0 && alerts == 0);
+    easymedia::SetCensusBytesThreshold(kCommon, base + 500);
+    assert(easymedia::CheckBufferCensus() == 1 && alerts == 1);
+    easymedia::SetCensusBytesThreshold(kCommon, 0);
+
+    FILE *fp = tmpfile();
+    easymedia::DumpBufferCensus(fp);
+    rewind(fp);
+    char line[256];
+    bool shared_line = false;
+    while (fgets(line, sizeof(line), fp))
+      shared_line = shared_line || (strstr(line, "census_view") &&
+                                    strstr(line, ", shared"));
+    fclose(fp);
+    assert(shared_line);
+  }
+  assert(!find(easymedia::GetBufferCensus(), "census_view"));
+  assert(easymedia::GetCensusBytes(kCommon) == base + 1000);
+  slot.reset();
+  assert(easymedia::GetCensusBytes(kCommon) == base);
+  assert(!find(easymedia::GetBufferCensus(), "census_slot"));
+  test_pool_age();
+  printf("census ok\n");
+  return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "buffer.h"
+#include "buffer_copy.h"
+
+using easymedia::CopyStrategy;
+
+static const CopyStrategy strategies[] = {
+    CopyStrategy::AUTO, CopyStrategy::CPU, CopyStrategy::NON_TEMPORAL,
+    CopyStrategy::MULTI_THREAD};
+static const char *strategy_names[] = {"auto", "cpu", "non_temporal",
+                                       "multi_thread"};
+
+// every strategy must be the same as memcpy, at any alignment and size
+static void test_memory() {
+  const size_t max = 5 * 1024 * 1024 + 77;
+  std::vector<uint8_t> src(max + 64), dst(max + 64), ref(max + 64);
+  for (size_t i = 0; i < src.size(); i++)
+    src[i] = (uint8_t)rand();
+  const size_t sizes[] = {0, 1, 15, 63, 64, 65, 4097, 300 * 1024, max};
+  for (size_t size : sizes) {
+    for (int so = 0; so < 3; so++) {
+      for (int dofs = 0; dofs < 3; dofs++) {
+        for (size_t k = 0; k < ARRAY_ELEMS(strategies); k++) {
+          memset(dst.data(), 0xAA, dst.size());
+          memset(ref.data(), 0xAA, ref.size());
+          memcpy(ref.data() + dofs * 7, src.data() + so * 5, size);
+          easymedia::CopyMemory(dst.data() + dofs * 7, src.data() + so * 5,
+                                size, strategies[k], dofs & 1);
+          if (memcmp(dst.data(), ref.data(), dst.size())) {
+            fprintf(stderr, "%s mismatch, size %zu\n", strategy_names[k],
+                    size);
+            exit(EXIT_FAILURE);
+          }
+        }
+      }
+    }
+  }
+  printf("memory copy: ok\n");
+}
+
+// valid rows are copied, the stride padding of dst is untouched
+static void test_image() {
+  for (int fmt = PIX_FMT_YUV420P; fmt < PIX_FMT_NB; fmt++) {
+    ImageInfo si = {(PixelFormat)fmt, 1920, 1080, 1920, 1088};
+    ImageInfo di = {(PixelFormat)fmt, 1920, 1080, 2048, 1088};
+    ImagePlane sp[IMAGE_MAX_PLANES], dp[IMAGE_MAX_PLANES];
+    int num = GetImagePlanes(si, sp);
+    assert(num > 0 && GetImagePlanes(di, dp) == num);
+    std::vector<uint8_t> src(CalPixFmtSize(si));
+    std::vector<uint8_t> dst(CalPixFmtSize(di));
+    for (size_t i = 0; i < src.size(); i++)
+      src[i] = (uint8_t)rand();
+    for (size_t k = 0; k < ARRAY_ELEMS(strategies); k++) {
+      memset(dst.data(), 0xAA, dst.size());
+      assert(easymedia::CopyImage(dst.data(), di, src.data(), si,
+                                  strategies[k]));
+      for (int p = 0; p < num; p++) {
+        for (int r = 0; r < dp[p].rows; r++) {
+          const uint8_t *d = dst.data() + dp[p].offset + r * dp[p].stride;
+          const uint8_t *s = src.data() + sp[p].offset + r * sp[p].stride;
+          assert(!memcmp(d, s, dp[p].row_bytes));
+          for (int x = dp[p].row_bytes; x < dp[p].stride; x++)
+            assert(d[x] == 0xAA);
+        }
+      }
+    }
+    printf("image copy %s: ok\n", PixFmtToString((PixelFormat)fmt));
+  }
+}
+
+static void bench(size_t size, bool dst_uncached) {
+  std::vector<uint8_t> src(size, 1), dst(size, 0);
+  for (size_t k = 0; k < ARRAY_ELEMS(strategies); k++) {
+    const int loop = 20;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < loop; i++)
+      easymedia::CopyMemory(dst.data(), src.data(), size, strategies[k],
+                            dst_uncached);
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    printf("%8zu KB %-12s: %.2f GB/s\n", size / 1024, strategy_names[k],
+           size * loop / (ms / 1000) / 1e9);
+  }
+}
+
+int main() {
+  test_memory();
+  test_image();
+  bench(64 * 1024, false);
+  bench(3110400, true);      // 1080p nv12
+  bench(12441600, true);     // 4k nv12
+  return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "buffer.h"
+#include "control.h"
+#include "filter.h"
+#include "image_convert.h"
+#include "key_string.h"
+#include "pan_zoom.h"
+
+using easymedia::CpuImage;
+using easymedia::ImageBuffer;
+using easymedia::MediaBuffer;
+using easymedia::PanZoom;
+using easymedia::PlaneLayout;
+
+static std::shared_ptr<ImageBuffer> alloc_image(PixelFormat fmt, int w, int h,
+                                                int vir_w, int vir_h) {
+  ImageInfo info = {fmt, w, h, vir_w, vir_h};
+  auto mb = MediaBuffer::Alloc2(CalPixFmtSize(info));
+  auto ib = std::make_shared<ImageBuffer>(mb, info);
+  uint8_t *p = static_cast<uint8_t *>(ib->GetPtr());
+  for (size_t i = 0; i < ib->GetSize(); i++)
+    p[i] = (uint8_t)(i * 7 + (i >> 8));
+  return ib;
+}
+
+static bool get_image(const std::shared_ptr<ImageBuffer> &ib, CpuImage &img) {
+  ImagePlane planes[IMAGE_MAX_PLANES];
+  int num = ib->GetPlanes(planes);
+  return easymedia::GetCpuImage(img, ib->GetPtr(), ib->GetImageInfo(), planes,
+                                num);
+}
+
+// every sample of the view is the one of the parent at the rect
+static void test_view(PixelFormat fmt) {
+  auto src = alloc_image(fmt, 64, 48, 72, 52);
+  ImageRect rect = {10, 6, 32, 20};
+  auto view = ImageBuffer::CropView(src, rect);
+  assert(view);
+  assert(view->GetWidth() == 32 && view->GetHeight() == 20);
+  assert(view->GetPtr() == src->GetPtr() && view->GetFD() == src->GetFD());
+  CpuImage si, vi;
+  assert(get_image(src, si) && get_image(view, vi));
+  PlaneLayout layout[IMAGE_MAX_PLANES];
+  int num = easymedia::GetPlaneLayout(fmt, layout);
+  assert(num == vi.num);
+  for (int i = 0; i < num; i++) {
+    int x0 = rect.x / layout[i].xdiv, y0 = rect.y / layout[i].ydiv;
+    int bytes = rect.w / layout[i].xdiv * layout[i].bpp;
+    for (int y = 0; y < rect.h / layout[i].ydiv; y++) {
+      const uint8_t *s =
+          si.data[i] + (y0 + y) * si.stride[i] + x0 * layout[i].bpp;
+      assert(!memcmp(vi.data[i] + y * vi.stride[i], s, bytes));
+    }
+  }
+  // where the view is in its parent
+  ImagePlane planes[IMAGE_MAX_PLANES];
+  num = view->GetPlanes(planes);
+  int vir_w = 0, vir_h = 0;
+  ImageRect origin;
+  assert(GetVirRectOfPlanes(view->GetImageInfo(), planes, num, vir_w, vir_h,
+                            origin));
+  assert(vir_w == 72 && vir_h == 52);
+  assert(origin.x == rect.x && origin.y == rect.y);
+  // not a plain image of vir size
+  assert(!GetVirSizeOfPlanes(view->GetImageInfo(), planes, num, vir_w, vir_h));
+  // a view of a view
+  ImageRect sub = {2, 2, 8, 8};
+  auto view2 = ImageBuffer::CropView(view, sub);
+  assert(view2);
+  num = view2->GetPlanes(planes);
+  assert(GetVirRectOfPlanes(view2->GetImageInfo(), planes, num, vir_w, vir_h,
+                            origin));
+  assert(origin.x == rect.x + 2 && origin.y == rect.y + 2);
+  // the valid size ends at the last row of the crop, in the buffer
+  num = view->GetPlanes(planes);
+  PlaneLayout last = layout[num - 1];
+  int last_row_end = planes[num - 1].offset +
+                     planes[num - 1].stride * (planes[num - 1].rows - 1) +
+                     rect.w / last.xdiv * last.bpp;
+  assert((int)view->GetValidSize() == last_row_end);
+  auto corner = ImageBuffer::CropView(src, {32, 28, 32, 20});
+  assert(corner && corner->GetValidSize() <= src->GetSize());
+  // out of the image
+  assert(!ImageBuffer::CropView(src, {40, 0, 32, 8}));
+  printf("view of %s ok\n", PixFmtToString(fmt));
+}
+
+static void test_invalid() {
+  auto src = alloc_image(PIX_FMT_NV12, 64, 48, 64, 48);
+  assert(!ImageBuffer::CropView(src, {1, 0, 16, 16}));
+  assert(!ImageBuffer::CropView(src, {0, 0, 15, 16}));
+  assert(!ImageBuffer::CropView(src, {0, 0, 0, 16}));
+  assert(!ImageBuffer::CropView(src, {-2, 0, 16, 16}));
+  auto rgb = alloc_image(PIX_FMT_RGB888, 64, 48, 64, 48);
+  assert(ImageBuffer::CropView(rgb, {1, 1, 15, 15}));
+  printf("invalid rects ok\n");
+}
+
+static bool aligned_inside(const ImageRect &r, int w, int h) {
+  return r.x >= 0 && r.y >= 0 && r.w > 0 && r.h > 0 && r.x + r.w <= w &&
+         r.y + r.h <= h && !(r.x % 2) && !(r.y % 2) && !(r.w % 2) &&
+         !(r.h % 2);
+}
+
+static void test_pan_zoom() {
+  const int w = 1920, h = 1080, frames = 30;
+  PanZoom pz;
+  ImageRect r = pz.Next(w, h);
+  assert(r.x == 0 && r.y == 0 && r.w == w && r.h == h);
+  assert(!pz.IsMoving());
+  pz.SetZoom(4, -1, -1, frames);
+  int last_w = w;
+  for (int i = 0; i < frames; i++) {
+    r = pz.Next(w, h);
+    assert(aligned_inside(r, w, h));
+    assert(r.w <= last_w);
+    last_w = r.w;
+    // centred
+    assert(abs(r.x + r.w / 2 - w / 2) <= 2 && abs(r.y + r.h / 2 - h / 2) <= 2);
+  }
+  assert(!pz.IsMoving());
+  assert(r.w == 480 && r.h == 270);
+  // pan to the corner, clamped
+  ImageRect target = {1600, 900, 480, 270};
+  pz.SetTarget(target, frames);
+  int last_x = r.x;
+  for (int i = 0; i < frames; i++) {
+    r = pz.Next(w, h);
+    assert(aligned_inside(r, w, h));
+    assert(r.x >= last_x);
+    last_x = r.x;
+  }
+  assert(r.x + r.w == w && r.y + r.h == h);
+  // jump
+  pz.SetTarget({100, 100, 640, 360}, 0);
+  r = pz.Next(w, h);
+  assert(r.x == 100 && r.y == 100 && r.w == 640 && r.h == 360);
+  assert(pz.GetWindow().w == 640);
+  printf("pan zoom ok\n");
+}
+
+static void test_filter() {
+  auto filter = easymedia::REFLECTOR(Filter)::Create<easymedia::Filter>(
+      "cropview", KEY_BUFFER_RECT "=(16,8,32,16)");
+  assert(filter);
+  auto src = alloc_image(PIX_FMT_NV12, 64, 48, 64, 48);
+  auto out = std::make_shared<ImageBuffer>();
+  assert(!filter->Process(src, out));
+  assert(out->GetWidth() == 32 && out->GetHeight() == 16);
+  ImageRect win;
+  assert(!filter->IoCtrl(easymedia::G_CROP_WINDOW, &win));
+  assert(win.x == 16 && win.y == 8);
+  easymedia::PanZoomArg arg = {{0, 0, 64, 48}, 0, 2};
+  assert(!filter->IoCtrl(easymedia::S_PAN_ZOOM, &arg));
+  for (int i = 0; i < 2; i++) {
+    out = std::make_shared<ImageBuffer>();
+    assert(!filter->Process(src, out));
+  }
+  assert(out->GetWidth() == 64 && out->GetHeight() == 48);
+  printf("filter ok\n");
+}
+
+int main() {
+  test_view(PIX_FMT_NV12);
+  test_view(PIX_FMT_YUV420P);
+  test_view(PIX_FMT_NV16);
+  test_view(PIX_FMT_YUYV422);
+  test_view(PIX_FMT_RGB888);
+  test_view(PIX_FMT_ARGB8888);
+  test_invalid();
+  test_pan_zoom();
+  test_filter();
+  return 0;
+}
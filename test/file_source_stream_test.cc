@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "buffer.h"
+#include "control.h"
+#include "key_string.h"
+#include "stream.h"
+
+using easymedia::FrameRateArg;
+using easymedia::MediaBuffer;
+using easymedia::Stream;
+
+static std::shared_ptr<Stream> create(const char *name, const char *path,
+                                      const std::string &extra) {
+  std::string param;
+  PARAM_STRING_APPEND(param, KEY_PATH, path);
+  param.append(extra);
+  return easymedia::REFLECTOR(Stream)::Create<Stream>(name, param.c_str());
+}
+
+// Write frames of the given pixel format, the bytes of plane i of frame n
+// are (n + 16 * i).
+static void write_y4m(const char *path, const char *header, PixelFormat fmt,
+                      int w, int h, int frames) {
+  FILE *f = fopen(path, "wb");
+  assert(f);
+  fprintf(f, "%s\n", header);
+  ImageInfo info = {fmt, w, h, w, h};
+  ImagePlane planes[IMAGE_MAX_PLANES];
+  int num = GetImagePlanes(info, planes);
+  assert(num > 0);
+  for (int n = 0; n < frames; n++) {
+    fprintf(f, n & 1 ? "FRAME Ip\n" : "FRAME\n");
+    for (int i = 0; i < num; i++) {
+      std::string plane((size_t)planes[i].row_bytes * planes[i].rows,
+                        (char)(n + 16 * i));
+      fwrite(plane.data(), 1, plane.size(), f);
+    }
+  }
+  fclose(f);
+}
+
+static void test_y4m(PixelFormat fmt, const char *header, int vir_width) {
+  const char *path = "/tmp/file_source_stream_test.y4m";
+  const int w = 64, h = 48, frames = 4, loops = 2;
+  write_y4m(path, header, fmt, w, h, frames);
+  std::string extra;
+  PARAM_STRING_APPEND_TO(extra, KEY_LOOP_TIME, loops - 1);
+  PARAM_STRING_APPEND_TO(extra, KEY_AS_FAST_AS_POSSIBLE, 1);
+  PARAM_STRING_APPEND_TO(extra, KEY_BUFFER_VIR_WIDTH, vir_width);
+  auto s = create("y4m_read_stream", path, extra);
+  assert(s);
+  ImageInfo info;
+  FrameRateArg fps;
+  assert(!s->IoCtrl(easymedia::G_STREAM_IMAGE_INFO, &info));
+  assert(info.pix_fmt == fmt && info.width == w && info.height == h);
+  assert(info.vir_width == vir_width && info.vir_height == h);
+  assert(!s->IoCtrl(easymedia::G_STREAM_FRAME_RATE, &fps));
+  assert(fps.num == 30000 && fps.den == 1001);
+  ImagePlane planes[IMAGE_MAX_PLANES];
+  int num = GetImagePlanes(info, planes);
+  int count = 0;
+  int64_t last_ts = 0;
+  while (!s->Eof()) {
+    auto b = s->Read();
+    assert(b && b->GetType() == Type::Image);
+    int n = count % frames;
+    for (int i = 0; i < num; i++) {
+      const ImagePlane &p = planes[i];
+      const uint8_t *row = (const uint8_t *)b->GetPtr() + p.offset;
+      for (int y = 0; y < p.rows; y++, row += p.stride)
+        for (int x = 0; x < p.row_bytes; x++)
+          assert(row[x] == (uint8_t)(n + 16 * i));
+    }
+    assert(count == 0 || b->GetTimeStamp() > last_ts);
+    last_ts = b->GetTimeStamp();
+    count++;
+    assert(b->IsEOF() == (count == frames * loops));
+  }
+  assert(count == frames * loops);
+  assert(!s->Read());
+  unlink(path);
+  printf("y4m %s: ok\n", PixFmtToString(fmt));
+}
+
+static void test_annexb() {
+  const char *path = "/tmp/file_source_stream_test.h264";
+  // sps, pps, then an idr and 3 p pictures, just the slice headers
+  const uint8_t sps[] = {0x67, 0x42, 0x00, 0x1E, 0xF8};
+  const uint8_t pps[] = {0x68, 0xCE, 0x38, 0x80};
+  const uint8_t idr[] = {0x65, 0x88, 0x84, 0x21, 0xA0};
+  const uint8_t p[] = {0x41, 0x9A, 0x21, 0x6C};
+  const uint8_t sc[] = {0, 0, 0, 1};
+  FILE *f = fopen(path, "wb");
+  assert(f);
+  fwrite(sc, 1, 4, f);
+  fwrite(sps, 1, sizeof(sps), f);
+  fwrite(sc, 1, 4, f);
+  fwrite(pps, 1, sizeof(pps), f);
+  fwrite(sc, 1, 4, f);
+  fwrite(idr, 1, sizeof(idr), f);
+  for (int i = 0; i < 3; i++) {
+    fwrite(sc + 1, 1, 3, f);
+    fwrite(p, 1, sizeof(p), f);
+  }
+  fclose(f);
+  for (int chunk : {1, 5, 4096}) {
+    std::string extra;
+    PARAM_STRING_APPEND_TO(extra, KEY_LOOP_TIME, 2);
+    PARAM_STRING_APPEND_TO(extra, KEY_MEM_SIZE_PERTIME, chunk);
+    PARAM_STRING_APPEND(extra, KEY_FPS, "50");
+    PARAM_STRING_APPEND_TO(extra, KEY_AS_FAST_AS_POSSIBLE, 1);
+    auto s = create("annexb_read_stream", path, extra);
+    assert(s);
+    int count = 0;
+    int64_t first_ts = 0;
+    while (!s->Eof()) {
+      auto b = s->Read();
+      assert(b);
+      if (count == 0)
+        first_ts = b->GetTimeStamp();
+      assert(b->GetTimeStamp() == first_ts + count * 20);
+      bool key = (count % 4 == 0);
+      assert(!!(b->GetUserFlag() & MediaBuffer::kIntra) == key);
+      assert(b->GetValidSize() ==
+             (key ? 12 + sizeof(sps) + sizeof(pps) + sizeof(idr)
+                  : 3 + sizeof(p)));
+      count++;
+      assert(b->IsEOF() == (count == 12));
+    }
+    assert(count == 12);
+  }
+  unlink(path);
+  printf("annexb: ok\n");
+}
+
+int main() {
+  test_y4m(PIX_FMT_YUV420P, "YUV4MPEG2 W64 H48 F30000:1001 Ip A1:1 C420jpeg",
+           64);
+  test_y4m(PIX_FMT_YUV422P, "YUV4MPEG2 C422 W64 H48 F30000:1001", 80);
+  test_y4m(PIX_FMT_NV12, "YUV4MPEG2 W64 H48 F30000:1001 XPIXFMT=nv12", 64);
+  test_y4m(PIX_FMT_RGB888, "YUV4MPEG2 W64 H48 F30000:1001 XPIXFMT=rgb888",
+           64);
+  test_annexb();
+  return 0;
+}
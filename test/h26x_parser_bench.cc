@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "bit_reader.h"
+#include "h26x_parser.h"
+#include "startcode.h"
+
+typedef std::vector<uint8_t> Nal;
+
+// parameter sets and slice headers of rkmpp/test/mpp_dec_test.h264
+static const uint8_t real_sps[] = {
+    0x67, 0x64, 0x00, 0x33, 0xac, 0x1b, 0x1a, 0x81, 0x41, 0xfa, 0x10, 0x00,
+    0x00, 0x03, 0x00, 0x10, 0x00, 0x00, 0x03, 0x03, 0xc8, 0xf1, 0x42, 0xaa};
+static const uint8_t real_pps[] = {0x68, 0xee, 0x3c, 0xb0};
+static const uint8_t real_idr[] = {0x65, 0xb8, 0x00, 0x04, 0x00, 0x00,
+                                   0x19, 0xff, 0xfe, 0x5e, 0x1e, 0x05};
+static const uint8_t real_p[] = {0x41, 0xe0, 0x00, 0x20, 0x00, 0x42,
+                                 0x14, 0xff, 0x2c, 0xbd, 0xa7, 0x80};
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+static void bench_nals(easymedia::NalParser &parser,
+                       const std::vector<Nal> &nals, int loop,
+                       const char *name) {
+  easymedia::NalUnitInfo info;
+  size_t bytes = 0, errors = 0;
+  for (auto &nal : nals)
+    bytes += nal.size();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < loop; i++) {
+    for (auto &nal : nals) {
+      if (parser.Parse(nal.data(), nal.size(), info))
+        errors++;
+    }
+  }
+  double ms = elapsed_ms(start);
+  printf("%-16s: %zu nal x %d, %.2f M nal/s, %.2f GB/s of nal, %zu errors\n",
+         name, nals.size(), loop, nals.size() * loop / ms / 1000,
+         bytes * loop / (ms / 1000) / 1e9, errors);
+}
+
+// ue(v) of all sizes, escaped as a real nal unit
+static void bench_bit_reader() {
+  std::vector<uint8_t> rbsp;
+  uint64_t acc = 0;
+  int acc_bits = 0;
+  const int count = 1 << 20;
+  for (int i = 0; i < count; i++) {
+    uint32_t v = (uint32_t)rand() >> (rand() % 31);
+    int len = 0;
+    while ((uint64_t)(v + 1) >> (len + 1))
+      len++;
+    acc = (acc << (2 * len + 1)) | (v + 1);
+    acc_bits += 2 * len + 1;
+    while (acc_bits >= 8) {
+      rbsp.push_back((uint8_t)(acc >> (acc_bits - 8)));
+      acc_bits -= 8;
+    }
+  }
+  rbsp.push_back((uint8_t)((acc << (8 - acc_bits)) | (0x80 >> acc_bits)));
+  std::vector<uint8_t> nal;
+  int zeros = 0;
+  for (uint8_t b : rbsp) {
+    if (zeros >= 2 && b <= 3) {
+      nal.push_back(3);
+      zeros = 0;
+    }
+    nal.push_back(b);
+    zeros = b ? 0 : zeros + 1;
+  }
+  const int loop = 20;
+  uint64_t sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int l = 0; l < loop; l++) {
+    easymedia::BitReader br(nal.data(), nal.size());
+    for (int i = 0; i < count; i++)
+      sum += br.ReadUE();
+  }
+  double ms = elapsed_ms(start);
+  printf("bit reader ue(v) : %.2f M/s, %.2f MB/s (sum %llu)\n",
+         (double)count * loop / ms / 1000, nal.size() * loop / ms / 1000,
+         (unsigned long long)sum);
+}
+
+static std::vector<Nal> read_annexb(const char *path) {
+  std::vector<Nal> nals;
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    fprintf(stderr, "open %s failed\n", path);
+    return nals;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    data.insert(data.end(), buf, buf + n);
+  fclose(fp);
+  std::vector<easymedia::StartCodePos> pos;
+  easymedia::FindAllStartCodes(data.data(), data.size(), pos);
+  for (size_t i = 0; i < pos.size(); i++) {
+    size_t begin = pos[i].offset + pos[i].size;
+    size_t end = i + 1 < pos.size() ? pos[i + 1].offset : data.size();
+    if (begin < end)
+      nals.emplace_back(data.begin() + begin, data.begin() + end);
+  }
+  return nals;
+}
+
+// h26x_parser_bench [file.h264|file.h265 [loop]]
+int main(int argc, char **argv) {
+  srand(1);
+  bench_bit_reader();
+  if (argc > 1) {
+    std::string path = argv[1];
+    int loop = argc > 2 ? atoi(argv[2]) : 100;
+    bool hevc = path.find("265") != std::string::npos ||
+                path.find("hevc") != std::string::npos;
+    auto parser = easymedia::NalParser::Create(
+        hevc ? easymedia::NalCodec::H265 : easymedia::NalCodec::H264);
+    bench_nals(*parser, read_annexb(argv[1]), loop > 0 ? loop : 1,
+               hevc ? "h265 file" : "h264 file");
+    return 0;
+  }
+  easymedia::H264Parser parser;
+  std::vector<Nal> params = {Nal(real_sps, real_sps + sizeof(real_sps)),
+                             Nal(real_pps, real_pps + sizeof(real_pps))};
+  bench_nals(parser, params, 200000, "h264 sps+pps");
+  std::vector<Nal> slices = {Nal(real_idr, real_idr + sizeof(real_idr))};
+  for (int i = 0; i < 29; i++)
+    slices.push_back(Nal(real_p, real_p + sizeof(real_p)));
+  bench_nals(parser, slices, 20000, "h264 slice header");
+  return 0;
+}
@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "bit_reader.h"
+#include "buffer.h"
+#include "h26x_parser.h"
+
+using easymedia::H264Parser;
+using easymedia::H265Parser;
+using easymedia::NalUnitInfo;
+using easymedia::SliceType;
+using easymedia::StreamInfo;
+
+typedef std::vector<uint8_t> Nal;
+
+// Write rbsp bits, then escape them into a nal unit.
+class BitWriter {
+public:
+  BitWriter(std::initializer_list<uint8_t> nal_header)
+      : header(nal_header), bits(0) {}
+  BitWriter &U(int n, uint32_t v) {
+    for (int i = n - 1; i >= 0; i--) {
+      if (!(bits & 7))
+        rbsp.push_back(0);
+      rbsp.back() |= ((v >> i) & 1) << (7 - (bits & 7));
+      bits++;
+    }
+    return *this;
+  }
+  BitWriter &UE(uint32_t v) {
+    int len = 0;
+    while ((uint64_t)(v + 1) >> (len + 1))
+      len++;
+    U(len, 0);
+    return U(len + 1, v + 1);
+  }
+  BitWriter &SE(int32_t v) { return UE(v > 0 ? 2 * v - 1 : -2 * v); }
+  Nal Finish() {
+    U(1, 1); // rbsp_stop_one_bit
+    while (bits & 7)
+      U(1, 0);
+    Nal nal(header);
+    int zeros = 0;
+    for (uint8_t b : rbsp) {
+      if (zeros >= 2 && b <= 3) {
+        nal.push_back(3);
+        zeros = 0;
+      }
+      nal.push_back(b);
+      zeros = b ? 0 : zeros + 1;
+    }
+    return nal;
+  }
+
+private:
+  Nal header;
+  Nal rbsp;
+  int bits;
+};
+
+static void test_bit_reader() {
+  // 00 00 03 01 is escaped, ue(v) 0, 1, 2, 6 and the stop bit follow
+  const uint8_t data[] = {0x00, 0x00, 0x03, 0x01, 0xA6, 0x78};
+  easymedia::BitReader br(data, sizeof(data));
+  assert(br.ReadBits(24) == 0x000001);
+  assert(br.ReadUE() == 0);
+  assert(br.ReadUE() == 1);
+  assert(br.ReadUE() == 2);
+  assert(br.ReadUE() == 6);
+  assert(!br.MoreRbspData() && !br.Error());
+  br.ReadBits(16);
+  assert(br.Error());
+  printf("bit reader: ok\n");
+}
+
+// parameter sets and slices of rkmpp/test/mpp_dec_test.h264
+static const uint8_t real_sps[] = {
+    0x67, 0x64, 0x00, 0x33, 0xac, 0x1b, 0x1a, 0x81, 0x41, 0xfa, 0x10, 0x00,
+    0x00, 0x03, 0x00, 0x10, 0x00, 0x00, 0x03, 0x03, 0xc8, 0xf1, 0x42, 0xaa};
+static const uint8_t real_pps[] = {0x68, 0xee, 0x3c, 0xb0};
+static const uint8_t real_idr[] = {0x65, 0xb8, 0x00, 0x04, 0x00, 0x00,
+                                   0x19, 0xff, 0xfe, 0x5e, 0x1e, 0x05};
+static const uint8_t real_p[] = {0x41, 0xe0, 0x00, 0x20, 0x00, 0x42,
+                                 0x14, 0xff, 0x2c, 0xbd, 0xa7, 0x80};
+
+static void test_h264_real() {
+  H264Parser parser;
+  NalUnitInfo info;
+  assert(parser.Parse(real_idr, sizeof(real_idr), info) == -ENOENT);
+  assert(info.vcl && info.keyframe && info.slice_type == SliceType::I);
+  assert(!parser.Parse(real_sps, sizeof(real_sps), info));
+  assert(info.type == 7 && info.param_id == 0);
+  assert(easymedia::GetNalUnitFlag(info) ==
+         easymedia::MediaBuffer::kExtraIntra);
+  assert(!parser.Parse(real_pps, sizeof(real_pps), info));
+  assert(!parser.Parse(real_idr, sizeof(real_idr), info));
+  assert(info.first_slice && info.pic_order_cnt == 0);
+  assert(easymedia::GetNalUnitFlag(info) == easymedia::MediaBuffer::kIntra);
+  assert(!parser.Parse(real_p, sizeof(real_p), info));
+  assert(info.slice_type == SliceType::P && info.frame_num == 1);
+  assert(info.pic_order_cnt == 2);
+  assert(easymedia::GetNalUnitFlag(info) ==
+         easymedia::MediaBuffer::kPredicted);
+  StreamInfo si;
+  assert(parser.GetStreamInfo(si));
+  assert(si.width == 320 && si.height == 240 && si.profile == 100);
+  assert(si.fps_num == 60 && si.fps_den == 2);
+  printf("h264 real stream: ok\n");
+}
+
+static Nal h264_slice(int nal_type, int ref_idc, int slice_type,
+                      int frame_num, bool mmco5 = false) {
+  BitWriter w({(uint8_t)((ref_idc << 5) | nal_type)});
+  w.UE(0).UE(slice_type).UE(0).U(4, frame_num);
+  if (nal_type == 5)
+    w.UE(0); // idr_pic_id
+  if (slice_type % 5 == 0)
+    w.U(1, 0).U(1, 0); // no override, no list modification
+  if (ref_idc) {
+    if (nal_type == 5)
+      w.U(1, 0).U(1, 0);
+    else if (mmco5)
+      w.U(1, 1).UE(5).UE(0);
+    else
+      w.U(1, 0);
+  }
+  w.SE(0).U(8, 0xA5); // slice_qp_delta and some slice data
+  return w.Finish();
+}
+
+// baseline, 640x480, poc type 2, frame_num 4 bits
+static void test_h264_poc_type2() {
+  H264Parser parser;
+  NalUnitInfo info;
+  Nal sps = BitWriter({0x67})
+                .U(8, 66).U(8, 0).U(8, 30).UE(0).UE(0).UE(2).UE(1).U(1, 0)
+                .UE(39).UE(29).U(1, 1).U(1, 1).U(1, 0).U(1, 0)
+                .Finish();
+  Nal pps = BitWriter({0x68})
+                .UE(0).UE(0).U(1, 0).U(1, 0).UE(0).UE(0).UE(0).U(1, 0)
+                .U(2, 0).SE(0).SE(0).SE(0).U(1, 1).U(1, 0).U(1, 0)
+                .Finish();
+  assert(!parser.Parse(sps.data(), sps.size(), info));
+  assert(!parser.Parse(pps.data(), pps.size(), info));
+  Nal idr = h264_slice(5, 3, 7, 0);
+  assert(!parser.Parse(idr.data(), idr.size(), info));
+  assert(info.pic_order_cnt == 0);
+  // frame_num wraps at 16, the poc goes on
+  for (int i = 1; i < 40; i++) {
+    Nal p = h264_slice(1, 2, 5, i % 16);
+    assert(!parser.Parse(p.data(), p.size(), info));
+    assert(info.pic_order_cnt == 2 * i);
+  }
+  Nal nonref = h264_slice(1, 0, 5, 40 % 16);
+  assert(!parser.Parse(nonref.data(), nonref.size(), info));
+  assert(info.pic_order_cnt == 79);
+  // mmco 5 turns the picture into poc 0, frame_num 0
+  Nal reset = h264_slice(1, 2, 5, 40 % 16, true);
+  assert(!parser.Parse(reset.data(), reset.size(), info));
+  assert(info.pic_order_cnt == 0);
+  Nal next = h264_slice(1, 2, 5, 1);
+  assert(!parser.Parse(next.data(), next.size(), info));
+  assert(info.pic_order_cnt == 2);
+  StreamInfo si;
+  assert(parser.GetStreamInfo(si));
+  assert(si.width == 640 && si.height == 480 && !si.fps_num);
+  // recovery point sei: frame cnt 0, exact match
+  Nal sei = BitWriter({0x06}).U(8, 6).U(8, 1).UE(0).U(1, 1).U(1, 0).U(2, 0)
+                .U(3, 0).Finish();
+  assert(!parser.Parse(sei.data(), sei.size(), info));
+  assert(info.recovery_point && info.recovery_frame_cnt == 0);
+  assert(info.exact_match && !info.broken_link);
+  printf("h264 poc type 2: ok\n");
+}
+
+// main profile, level 3.1
+static void h265_ptl(BitWriter &w) {
+  w.U(2, 0).U(1, 0).U(5, 1).U(32, 0x60000000).U(16, 0x9000).U(32, 0);
+  w.U(8, 93);
+}
+
+static Nal h265_slice(int nal_type, int tid, bool first, int slice_type,
+                      int lsb, bool dependent = false) {
+  BitWriter w({(uint8_t)(nal_type << 1), (uint8_t)(tid + 1)});
+  w.U(1, first);
+  if (nal_type >= 16 && nal_type <= 23)
+    w.U(1, 0);
+  w.UE(0);
+  if (!first)
+    w.U(1, dependent).U(9, 255); // 30x17 ctbs
+  if (!dependent) {
+    w.UE(slice_type);
+    if (nal_type != 19 && nal_type != 20)
+      w.U(8, lsb);
+  }
+  w.U(8, 0x5A);
+  return w.Finish();
+}
+
+static void test_h265() {
+  H265Parser parser;
+  NalUnitInfo info;
+  BitWriter vps({0x40, 0x01});
+  vps.U(4, 0).U(2, 3).U(6, 0).U(3, 0).U(1, 1).U(16, 0xFFFF);
+  h265_ptl(vps);
+  vps.U(1, 1).UE(3).UE(0).UE(0).U(6, 0).UE(0).U(1, 1).U(32, 1001).U(32, 60000)
+      .U(1, 0).UE(0).U(1, 0);
+  Nal vps_nal = vps.Finish();
+  BitWriter sps({0x42, 0x01});
+  sps.U(4, 0).U(3, 0).U(1, 1);
+  h265_ptl(sps);
+  sps.UE(0).UE(1).UE(1920).UE(1088).U(1, 1).UE(0).UE(0).UE(0).UE(4);
+  sps.UE(0).UE(0).UE(4).U(1, 1).UE(4).UE(2).UE(0);
+  sps.UE(0).UE(3).UE(0).UE(3).UE(1).UE(1).U(1, 0).U(1, 1).U(1, 1).U(1, 0);
+  // two short term rps, the second predicted from the first
+  sps.UE(2).UE(1).UE(0).UE(0).U(1, 1);
+  sps.U(1, 1).U(1, 1).UE(0).U(1, 1).U(1, 1);
+  sps.U(1, 0).U(1, 1).U(1, 1);
+  // vui: sar 1:1, full range bt709, 59.94 fps
+  sps.U(1, 1).U(1, 1).U(8, 1).U(1, 0).U(1, 1).U(3, 5).U(1, 1).U(1, 1)
+      .U(8, 1).U(8, 1).U(8, 1).U(1, 0);
+  sps.U(1, 0).U(1, 0).U(1, 0).U(1, 0).U(1, 1).U(32, 1001).U(32, 60000)
+      .U(1, 0).U(1, 0).U(1, 0).U(1, 0);
+  Nal sps_nal = sps.Finish();
+  Nal pps_nal = BitWriter({0x44, 0x01})
+                    .UE(0).UE(0).U(1, 1).U(1, 0).U(3, 0).U(1, 0).U(1, 0)
+                    .UE(0).UE(0).SE(0).U(8, 0)
+                    .Finish();
+  assert(!parser.Parse(vps_nal.data(), vps_nal.size(), info));
+  assert(info.type == 32 && parser.GetVPS(0)->timing_info_present);
+  assert(!parser.Parse(sps_nal.data(), sps_nal.size(), info));
+  assert(!parser.Parse(pps_nal.data(), pps_nal.size(), info));
+  const easymedia::H265SPS *s = parser.GetSPS(0);
+  assert(s && s->pic_width_in_ctbs == 30 && s->pic_height_in_ctbs == 17);
+  assert(s->num_short_term_ref_pic_sets == 2 && s->max_num_reorder_pics == 2);
+  StreamInfo si;
+  assert(parser.GetStreamInfo(si));
+  assert(si.width == 1920 && si.height == 1080 && si.coded_height == 1088);
+  assert(si.fps_num == 60000 && si.fps_den == 1001);
+  assert(si.sar_width == 1 && si.sar_height == 1 && si.full_range);
+  assert(si.profile == 1 && si.level == 93);
+
+  struct {
+    int type, tid;
+    bool first;
+    int slice_type, lsb;
+    bool dependent;
+    int poc;
+    SliceType expect;
+  } seq[] = {
+      {19, 0, true, 2, 0, false, 0, SliceType::I},     // idr
+      {1, 0, true, 1, 4, false, 4, SliceType::P},      // trail_r
+      {1, 0, false, 0, 0, true, 4, SliceType::P},      // dependent segment
+      {1, 0, false, 0, 4, false, 4, SliceType::B},     // second slice
+      {1, 0, true, 1, 100, false, 100, SliceType::P},  //
+      {1, 0, true, 1, 200, false, 200, SliceType::P},  //
+      {1, 0, true, 1, 250, false, 250, SliceType::P},  //
+      {0, 0, true, 0, 120, false, 376, SliceType::B},  // trail_n, no update
+      {1, 0, true, 1, 2, false, 258, SliceType::P},    // lsb wraps
+      {21, 0, true, 2, 10, false, 266, SliceType::I},  // cra mid stream
+  };
+  for (auto &e : seq) {
+    Nal nal = h265_slice(e.type, e.tid, e.first, e.slice_type, e.lsb,
+                         e.dependent);
+    assert(!parser.Parse(nal.data(), nal.size(), info));
+    assert(info.vcl && info.first_slice == e.first);
+    assert(info.dependent_slice == e.dependent);
+    assert(info.slice_type == e.expect);
+    if (info.pic_order_cnt != e.poc) {
+      fprintf(stderr, "h265 poc %d, expect %d\n", info.pic_order_cnt, e.poc);
+      exit(EXIT_FAILURE);
+    }
+  }
+  // a cra after end of sequence starts over
+  const uint8_t eos[] = {36 << 1, 1};
+  assert(!parser.Parse(eos, sizeof(eos), info));
+  Nal cra = h265_slice(21, 0, true, 2, 5);
+  assert(!parser.Parse(cra.data(), cra.size(), info));
+  assert(info.keyframe && info.pic_order_cnt == 5);
+  assert(easymedia::GetNalUnitFlag(info) == easymedia::MediaBuffer::kIntra);
+  printf("h265: ok\n");
+}
+
+// Mutated nal units must never crash, and an accepted sps must be sane.
+static void test_fuzz(int rounds) {
+  std::vector<Nal> h264 = {
+      Nal(real_sps, real_sps + sizeof(real_sps)),
+      Nal(real_pps, real_pps + sizeof(real_pps)),
+      Nal(real_idr, real_idr + sizeof(real_idr)),
+      Nal(real_p, real_p + sizeof(real_p)), h264_slice(1, 2, 5, 3),
+      h264_slice(1, 2, 5, 3, true)};
+  std::vector<Nal> h265 = {h265_slice(19, 0, true, 2, 0),
+                           h265_slice(1, 0, false, 0, 9, true)};
+  H264Parser p264;
+  H265Parser p265;
+  NalUnitInfo info;
+  int accepted = 0;
+  for (int r = 0; r < rounds; r++) {
+    bool is_264 = r & 1;
+    std::vector<Nal> &pool = is_264 ? h264 : h265;
+    Nal nal = pool[rand() % pool.size()];
+    switch (rand() % 4) {
+    case 0: // flip bits
+      for (int i = rand() % 8; i >= 0; i--)
+        nal[rand() % nal.size()] ^= 1 << (rand() % 8);
+      break;
+    case 1: // truncate
+      nal.resize(rand() % nal.size() + 1);
+      break;
+    case 2: // random tail
+      for (size_t i = 1 + rand() % nal.size(); i < nal.size(); i++)
+        nal[i] = rand();
+      break;
+    default: // all random, with a nal header of a parameter set
+      for (auto &b : nal)
+        b = rand();
+      if (is_264)
+        nal[0] = 0x60 | (7 + rand() % 2);
+      else
+        nal[0] = (32 + rand() % 3) << 1;
+      break;
+    }
+    int ret = is_264 ? p264.Parse(nal.data(), nal.size(), info)
+                     : p265.Parse(nal.data(), nal.size(), info);
+    assert(ret == 0 || ret == -EINVAL || ret == -ENOENT);
+    if (ret)
+      continue;
+    accepted++;
+    StreamInfo si;
+    if ((is_264 ? p264.GetStreamInfo(si) : p265.GetStreamInfo(si))) {
+      assert(si.width > 0 && si.width <= si.coded_width);
+      assert(si.height > 0 && si.height <= si.coded_height);
+      assert(si.coded_width <= 16888 && si.coded_height <= 16888);
+    }
+  }
+  printf("fuzz %d rounds, %d accepted: ok\n", rounds, accepted);
+}
+
+int main(int argc, char **argv) {
+  int rounds = argc > 1 ? atoi(argv[1]) : 200000;
+  srand(1);
+  test_bit_reader();
+  test_h264_real();
+  test_h264_poc_type2();
+  test_h265();
+  test_fuzz(rounds);
+  return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+#include "buffer.h"
+#include "key_string.h"
+
+// kB of the given line in /proc/self/status, such as VmSize
+static long proc_status_kb(const char *key) {
+  FILE *fp = fopen("/proc/self/status", "r");
+  if (!fp)
+    return -1;
+  char line[256];
+  long val = -1;
+  size_t len = strlen(key);
+  while (fgets(line, sizeof(line), fp)) {
+    if (!strncmp(line, key, len) && line[len] == ':') {
+      val = atol(line + len + 1);
+      break;
+    }
+  }
+  fclose(fp);
+  return val;
+}
+
+// Allocate num buffers, map them at once if eager as the old behavior did.
+static void run(bool eager, easymedia::MediaBuffer::MemType type, int num,
+                size_t size) {
+  std::vector<std::shared_ptr<easymedia::MediaBuffer>> buffers;
+  long vm_before = proc_status_kb("VmSize");
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < num; i++) {
+    auto mb = easymedia::MediaBuffer::Alloc(size, type);
+    if (!mb) {
+      fprintf(stderr, "alloc failed at %d\n", i);
+      break;
+    }
+    if (eager)
+      assert(mb->GetPtr());
+    buffers.push_back(mb);
+  }
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  long vm_after = proc_status_kb("VmSize");
+  int mapped = 0;
+  for (auto &mb : buffers)
+    mapped += mb->IsMapped() ? 1 : 0;
+  printf("%-5s: %d buffers of %zu bytes, alloc %.3f ms (%.3f ms each), "
+         "%d mapped, VmSize +%ld kB\n",
+         eager ? "eager" : "lazy", (int)buffers.size(), size, ms,
+         buffers.empty() ? 0 : ms / buffers.size(), mapped,
+         vm_after - vm_before);
+}
+
+int main(int argc, char **argv) {
+  int num = 16;
+  size_t size = 1920 * 1088 * 3 / 2;
+  int c;
+  while ((c = getopt(argc, argv, "?n:s:")) != -1) {
+    switch (c) {
+    case 'n':
+      num = atoi(optarg);
+      break;
+    case 's':
+      size = atoi(optarg);
+      break;
+    case '?':
+    default:
+      printf("usage: hw_buffer_alloc_bench [-n buffer num] [-s size]\n");
+      exit(0);
+    }
+  }
+  // falls back to common memory if no drm/ion integrated
+  auto type = easymedia::StringToMemType(KEY_MEM_HARDWARE);
+  run(true, type, num, size);
+  run(false, type, num, size);
+  return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "image_blit.h"
+
+using easymedia::CpuImage;
+using easymedia::ScaleMode;
+
+struct Image {
+  Image(PixelFormat fmt, int w, int h) {
+    ImageInfo info = {fmt, w, h, UPALIGNTO16(w), h};
+    mem.resize(CalPixFmtSize(info));
+    for (auto &v : mem)
+      v = (uint8_t)rand();
+    easymedia::GetCpuImage(img, mem.data(), info);
+  }
+  std::vector<uint8_t> mem;
+  CpuImage img;
+};
+
+static const PixelFormat fmts[] = {
+    PIX_FMT_YUV420P,  PIX_FMT_NV12,    PIX_FMT_NV21,   PIX_FMT_YUV422P,
+    PIX_FMT_NV16,     PIX_FMT_NV61,    PIX_FMT_RGB565, PIX_FMT_BGR565,
+    PIX_FMT_RGB888,   PIX_FMT_BGR888,  PIX_FMT_ARGB8888,
+    PIX_FMT_ABGR8888};
+static const int sizes[][2] = {{640, 360}, {1920, 1080}, {3840, 2160}};
+static const int thread_nums[] = {1, 2, 4};
+
+// ms per blit, repeated for some time at least
+static double run(const Image &dst, const Image &src, int rotate,
+                  ScaleMode mode, int threads) {
+  int loop = 0;
+  double ms = 0;
+  auto start = std::chrono::steady_clock::now();
+  do {
+    easymedia::BlitImage(dst.img, nullptr, src.img, nullptr, rotate, mode,
+                         threads);
+    loop++;
+    ms = std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+             .count();
+  } while (ms < 200 && loop < 1000);
+  return ms / loop;
+}
+
+static void print_row(const char *fmt_name, int w, int h, const char *op,
+                      const double *ms) {
+  printf("%-9s %4dx%-4d %-16s", fmt_name, w, h, op);
+  for (size_t t = 0; t < ARRAY_ELEMS(thread_nums); t++)
+    printf(" %8.2fms %7.1fMP/s", ms[t], w * h / ms[t] / 1000);
+  printf("\n");
+}
+
+static void bench(PixelFormat sfmt, PixelFormat dfmt, int w, int h,
+                  const char *op, int dw, int dh, int rotate,
+                  ScaleMode mode) {
+  Image src(sfmt, w, h), dst(dfmt, dw, dh);
+  double ms[ARRAY_ELEMS(thread_nums)];
+  for (size_t t = 0; t < ARRAY_ELEMS(thread_nums); t++)
+    ms[t] = run(dst, src, rotate, mode, thread_nums[t]);
+  const char *name = strchr(PixFmtToString(sfmt), ':');
+  print_row(name + 1, w, h, op, ms);
+}
+
+int main() {
+  printf("%-9s %-9s %-16s", "format", "src", "op");
+  for (int t : thread_nums)
+    printf("       %d thread(s)     ", t);
+  printf("\n");
+  for (PixelFormat fmt : fmts) {
+    for (auto &s : sizes) {
+      int w = s[0], h = s[1];
+      bench(fmt, fmt, w, h, "bilinear 2/3", w * 2 / 3, h * 2 / 3, 0,
+            ScaleMode::BILINEAR);
+      bench(fmt, fmt, w, h, "area 1/2", w / 2, h / 2, 0, ScaleMode::AREA);
+      bench(fmt, fmt, w, h, "rotate 90", h, w, 90, ScaleMode::AUTO);
+      bench(fmt, fmt, w, h, "rotate 180", w, h, 180, ScaleMode::AUTO);
+      bench(fmt, PIX_FMT_NV12, w, h, "to nv12", w, h, 0, ScaleMode::AUTO);
+      bench(fmt, PIX_FMT_ARGB8888, w, h, "to argb8888", w, h, 0,
+            ScaleMode::AUTO);
+    }
+  }
+  return 0;
+}
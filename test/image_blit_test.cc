@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "image_blit.h"
+
+using easymedia::CpuImage;
+using easymedia::PlaneLayout;
+using easymedia::ScaleMode;
+
+struct TestImage {
+  TestImage(PixelFormat fmt, int w, int h, int pad = 0) {
+    // padded strides, so that a kernel which writes over the width is caught
+    ImageInfo info = {fmt, w, h, w + pad, h};
+    mem.resize(CalPixFmtSize(info) + 64, 0xA5);
+    bool ret = easymedia::GetCpuImage(img, mem.data(), info);
+    assert(ret);
+    num = easymedia::GetPlaneLayout(fmt, layout);
+  }
+  void Fill(int seed) {
+    srand(seed);
+    for (auto &v : mem)
+      v = (uint8_t)rand();
+  }
+  int PlaneW(int i) const { return img.width / layout[i].xdiv; }
+  int PlaneH(int i) const { return img.height / layout[i].ydiv; }
+  const uint8_t *Pixel(int i, int x, int y) const {
+    return img.data[i] + y * img.stride[i] + x * layout[i].bpp;
+  }
+  std::vector<uint8_t> mem;
+  CpuImage img;
+  PlaneLayout layout[IMAGE_MAX_PLANES];
+  int num;
+};
+
+static const PixelFormat fmts[] = {
+    PIX_FMT_YUV420P,  PIX_FMT_NV12,    PIX_FMT_NV21,   PIX_FMT_YUV422P,
+    PIX_FMT_NV16,     PIX_FMT_NV61,    PIX_FMT_RGB565, PIX_FMT_BGR565,
+    PIX_FMT_RGB888,   PIX_FMT_BGR888,  PIX_FMT_ARGB8888,
+    PIX_FMT_ABGR8888};
+
+// every transform of the planes against the pixel by pixel mapping
+static void test_transform() {
+  const PixelFormat tfmts[] = {PIX_FMT_YUV420P, PIX_FMT_NV12, PIX_FMT_RGB332,
+                               PIX_FMT_RGB565, PIX_FMT_RGB888,
+                               PIX_FMT_ARGB8888};
+  const int sizes[][2] = {{64, 48}, {70, 38}, {8, 8}};
+  for (PixelFormat fmt : tfmts) {
+    for (auto &size : sizes) {
+      TestImage src(fmt, size[0], size[1], 6);
+      src.Fill(fmt);
+      for (int t = 0; t < 8; t++) {
+        bool rot = t & easymedia::IMAGE_ROT_90;
+        int w = rot ? size[1] : size[0], h = rot ? size[0] : size[1];
+        for (int threads = 1; threads <= 3; threads += 2) {
+          TestImage dst(fmt, w, h, 10);
+          int ret = easymedia::BlitImage(dst.img, nullptr, src.img, nullptr,
+                                         t, ScaleMode::AUTO, threads);
+          assert(!ret);
+          for (int i = 0; i < dst.num; i++) {
+            int pw = src.PlaneW(i), ph = src.PlaneH(i);
+            for (int y = 0; y < dst.PlaneH(i); y++) {
+              for (int x = 0; x < dst.PlaneW(i); x++) {
+                int u = rot ? y : x, v = rot ? ph - 1 - x : y;
+                if (t & easymedia::IMAGE_FLIP_V)
+                  v = ph - 1 - v;
+                if (t & easymedia::IMAGE_FLIP_H)
+                  u = pw - 1 - u;
+                if (memcmp(dst.Pixel(i, x, y), src.Pixel(i, u, v),
+                           dst.layout[i].bpp)) {
+                  fprintf(stderr, "transform %d of fmt %d mismatch at %d,%d\n",
+                          t, fmt, x, y);
+                  exit(EXIT_FAILURE);
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  // the degrees are the same as the transforms
+  assert(easymedia::GetImageTransform(90) == easymedia::IMAGE_ROT_90);
+  assert(easymedia::GetImageTransform(270) == easymedia::IMAGE_ROT_270);
+  assert(easymedia::GetImageTransform(45) < 0);
+  printf("transform: ok\n");
+}
+
+static void ref_tap(int d, int dn, int sn, int &i0, int &i1, int &f) {
+  double s = (d + 0.5) * sn / dn - 0.5;
+  if (s < 0)
+    s = 0;
+  int fixed = (int)(s * 65536 + 0.5);
+  i0 = fixed >> 16;
+  f = (fixed >> 8) & 255;
+  if (i0 >= sn - 1) {
+    i0 = sn - 1;
+    f = 0;
+  }
+  i1 = f ? i0 + 1 : i0;
+}
+
+// the vector rows and the bands are the same as the plain per pixel formula
+static void test_bilinear() {
+  const int cases[][4] = {{150, 94, 76, 60},
+                          {76, 60, 300, 190},
+                          {64, 64, 64, 30},
+                          {40, 30, 96, 30}};
+  for (auto &c : cases) {
+    TestImage src(PIX_FMT_RGB888, c[0], c[1], 2);
+    src.Fill(c[0]);
+    TestImage dst(PIX_FMT_RGB888, c[2], c[3], 2);
+    int ret = easymedia::BlitImage(dst.img, nullptr, src.img, nullptr, 0,
+                                   ScaleMode::BILINEAR, 3);
+    assert(!ret);
+    for (int y = 0; y < c[3]; y++) {
+      int y0, y1, fy;
+      ref_tap(y, c[3], c[1], y0, y1, fy);
+      for (int x = 0; x < c[2]; x++) {
+        int x0, x1, fx;
+        ref_tap(x, c[2], c[0], x0, x1, fx);
+        for (int k = 0; k < 3; k++) {
+          int a = src.Pixel(0, x0, y0)[k], b = src.Pixel(0, x1, y0)[k];
+          int e = src.Pixel(0, x0, y1)[k], g = src.Pixel(0, x1, y1)[k];
+          if (fy) {
+            a = (a * (256 - fy) + e * fy + 128) >> 8;
+            b = (b * (256 - fy) + g * fy + 128) >> 8;
+          }
+          int v = (a * (256 - fx) + b * fx + 128) >> 8;
+          if (dst.Pixel(0, x, y)[k] != v) {
+            fprintf(stderr, "bilinear %dx%d->%dx%d mismatch at %d,%d\n", c[0],
+                    c[1], c[2], c[3], x, y);
+            exit(EXIT_FAILURE);
+          }
+        }
+      }
+    }
+  }
+  printf("bilinear: ok\n");
+}
+
+static void test_area() {
+  // the halving kernel of one byte samples and the generic box
+  const int cases[][5] = {{PIX_FMT_NV12, 132, 96, 66, 48},
+                          {PIX_FMT_ARGB8888, 96, 72, 32, 24},
+                          {PIX_FMT_NV16, 100, 90, 40, 36}};
+  for (auto &c : cases) {
+    TestImage src((PixelFormat)c[0], c[1], c[2], 4);
+    src.Fill(c[1]);
+    TestImage dst((PixelFormat)c[0], c[3], c[4], 4);
+    int ret = easymedia::BlitImage(dst.img, nullptr, src.img, nullptr, 0,
+                                   ScaleMode::AREA, 2);
+    assert(!ret);
+    for (int i = 0; i < dst.num; i++) {
+      int sw = src.PlaneW(i), sh = src.PlaneH(i);
+      int dw = dst.PlaneW(i), dh = dst.PlaneH(i), bpp = dst.layout[i].bpp;
+      for (int y = 0; y < dh; y++) {
+        int by0 = y * sh / dh, by1 = (y + 1) * sh / dh;
+        for (int x = 0; x < dw; x++) {
+          int bx0 = x * sw / dw, bx1 = (x + 1) * sw / dw;
+          int area = (bx1 - bx0) * (by1 - by0);
+          for (int k = 0; k < bpp; k++) {
+            int sum = 0;
+            for (int v = by0; v < by1; v++)
+              for (int u = bx0; u < bx1; u++)
+                sum += src.Pixel(i, u, v)[k];
+            if (dst.Pixel(i, x, y)[k] != (sum + area / 2) / area) {
+              fprintf(stderr, "area of fmt %d mismatch at %d,%d\n", c[0], x,
+                      y);
+              exit(EXIT_FAILURE);
+            }
+          }
+        }
+      }
+    }
+  }
+  printf("area: ok\n");
+}
+
+// the chroma only conversions are lossless, rgb ones are close
+static void test_convert() {
+  TestImage a(PIX_FMT_YUV420P, 64, 32);
+  a.Fill(1);
+  const PixelFormat chain[] = {PIX_FMT_NV12, PIX_FMT_NV21, PIX_FMT_YUV422P,
+                               PIX_FMT_NV61, PIX_FMT_NV16, PIX_FMT_YUV420P};
+  std::vector<TestImage> imgs;
+  imgs.reserve(ARRAY_ELEMS(chain));
+  const CpuImage *last = &a.img;
+  for (PixelFormat fmt : chain) {
+    imgs.emplace_back(fmt, 64, 32, 8);
+    int ret = easymedia::ConvertImage(imgs.back().img, *last);
+    assert(!ret);
+    last = &imgs.back().img;
+  }
+  const TestImage &b = imgs.back();
+  for (int i = 0; i < 3; i++)
+    for (int y = 0; y < a.PlaneH(i); y++)
+      assert(!memcmp(a.Pixel(i, 0, y), b.Pixel(i, 0, y), a.PlaneW(i)));
+  // grey and the primaries, through every format and back to argb8888
+  const uint8_t colors[][3] = {
+      {128, 128, 128}, {255, 0, 0}, {0, 255, 0}, {0, 0, 255}, {20, 200, 90}};
+  for (auto &c : colors) {
+    TestImage src(PIX_FMT_ARGB8888, 16, 8);
+    for (int y = 0; y < 8; y++)
+      for (int x = 0; x < 16; x++)
+        memcpy((uint8_t *)src.Pixel(0, x, y), c, 3);
+    for (PixelFormat fmt : fmts) {
+      TestImage mid(fmt, 16, 8, 2), back(PIX_FMT_ARGB8888, 16, 8);
+      assert(!easymedia::ConvertImage(mid.img, src.img));
+      assert(!easymedia::ConvertImage(back.img, mid.img));
+      for (int k = 0; k < 3; k++) {
+        // rgb565 keeps 5 bits
+        int diff = abs(back.Pixel(0, 5, 3)[k] - c[k]);
+        if (diff > 8) {
+          fprintf(stderr, "color %d,%d,%d through fmt %d: %d off\n", c[0],
+                  c[1], c[2], fmt, diff);
+          exit(EXIT_FAILURE);
+        }
+      }
+    }
+  }
+  printf("convert: ok\n");
+}
+
+// crop, scale, rotate and convert in one blit, against the separate steps
+static void test_blit() {
+  TestImage src(PIX_FMT_NV12, 320, 180, 16);
+  src.Fill(7);
+  ImageRect src_rect = {33, 21, 200, 120}; // aligned to 32,20
+  ImageRect dst_rect = {10, 6, 60, 100};
+  for (PixelFormat fmt : fmts) {
+    // its planes are scaled from the ones of nv12 directly
+    if (fmt == PIX_FMT_NV16)
+      continue;
+    TestImage dst(fmt, 128, 128, 4);
+    TestImage ref(fmt, 60, 100);
+    int ret = easymedia::BlitImage(dst.img, &dst_rect, src.img, &src_rect,
+                                   easymedia::IMAGE_ROT_270);
+    assert(!ret);
+    // the same steps by hand: crop by a view, scale then rotate then convert
+    TestImage scaled(PIX_FMT_NV12, 100, 60), rotated(PIX_FMT_NV12, 60, 100);
+    ImageRect aligned = {32, 20, 200, 120};
+    assert(!easymedia::BlitImage(scaled.img, nullptr, src.img, &aligned));
+    assert(!easymedia::BlitImage(rotated.img, nullptr, scaled.img, nullptr,
+                                 270));
+    assert(!easymedia::ConvertImage(ref.img, rotated.img));
+    for (int i = 0; i < ref.num; i++) {
+      int bytes = ref.PlaneW(i) * ref.layout[i].bpp;
+      for (int y = 0; y < ref.PlaneH(i); y++) {
+        const uint8_t *p = dst.Pixel(i, 10 / dst.layout[i].xdiv,
+                                     6 / dst.layout[i].ydiv + y);
+        if (memcmp(p, ref.Pixel(i, 0, y), bytes)) {
+          fprintf(stderr, "blit to fmt %d mismatch at plane %d row %d\n", fmt,
+                  i, y);
+          exit(EXIT_FAILURE);
+        }
+      }
+    }
+  }
+  ImageRect bad = {300, 0, 100, 100};
+  assert(easymedia::BlitImage(src.img, nullptr, src.img, &bad) == -EINVAL);
+  printf("blit: ok\n");
+}
+
+// the pixels of yuyv are pairs, they are transformed as nv16
+static void test_packed() {
+  for (int t = 0; t < 8; t++) {
+    bool rot = t & easymedia::IMAGE_ROT_90;
+    int w = rot ? 32 : 64, h = rot ? 64 : 32;
+    TestImage src(PIX_FMT_UYVY422, 64, 32, 4), mid(PIX_FMT_NV16, 64, 32);
+    src.Fill(t);
+    TestImage out(PIX_FMT_UYVY422, w, h, 2), ref(PIX_FMT_UYVY422, w, h, 2);
+    TestImage rotated(PIX_FMT_NV16, w, h);
+    assert(!easymedia::BlitImage(out.img, nullptr, src.img, nullptr, t));
+    assert(!easymedia::ConvertImage(mid.img, src.img));
+    assert(!easymedia::BlitImage(rotated.img, nullptr, mid.img, nullptr, t));
+    assert(!easymedia::ConvertImage(ref.img, rotated.img));
+    assert(out.mem == ref.mem);
+  }
+  printf("packed: ok\n");
+}
+
+int main() {
+  test_transform();
+  test_bilinear();
+  test_area();
+  test_convert();
+  test_blit();
+  test_packed();
+  return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "image_convert.h"
+
+using easymedia::ConvertImpl;
+using easymedia::CpuImage;
+using easymedia::YuvMatrix;
+
+struct Image {
+  Image(PixelFormat fmt, int w, int h) {
+    ImageInfo info = {fmt, w, h, UPALIGNTO16(w), h};
+    mem.resize(CalPixFmtSize(info));
+    for (auto &v : mem)
+      v = (uint8_t)rand();
+    easymedia::GetCpuImage(img, mem.data(), info);
+  }
+  std::vector<uint8_t> mem;
+  CpuImage img;
+};
+
+static const PixelFormat fmts[] = {
+    PIX_FMT_YUV420P,  PIX_FMT_NV12,     PIX_FMT_NV21,    PIX_FMT_YUV422P,
+    PIX_FMT_NV16,     PIX_FMT_NV61,     PIX_FMT_YUYV422, PIX_FMT_UYVY422,
+    PIX_FMT_RGB332,   PIX_FMT_RGB565,   PIX_FMT_BGR565,  PIX_FMT_RGB888,
+    PIX_FMT_BGR888,   PIX_FMT_ARGB8888, PIX_FMT_ABGR8888};
+
+// ms per conversion of one thread, repeated for some time at least
+static double run(const Image &dst, const Image &src, ConvertImpl impl) {
+  easymedia::SetConvertImpl(impl);
+  int loop = 0;
+  double ms = 0;
+  auto start = std::chrono::steady_clock::now();
+  do {
+    easymedia::ConvertImage(dst.img, src.img, YuvMatrix::BT601_LIMITED, 1);
+    loop++;
+    ms = std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+             .count();
+  } while (ms < 100 && loop < 1000);
+  return ms / loop;
+}
+
+// Every pair at 1080p, the scalar kernels against the vector ones.
+int main(int argc, char **argv) {
+  int w = 1920, h = 1080;
+  if (argc > 2) {
+    w = atoi(argv[1]) & ~1;
+    h = atoi(argv[2]) & ~1;
+  }
+  ConvertImpl simd = easymedia::IsConvertImplSupported(ConvertImpl::SSE2)
+                         ? ConvertImpl::SSE2
+                         : ConvertImpl::NEON;
+  bool has_simd = easymedia::IsConvertImplSupported(simd);
+  printf("%dx%d, 1 thread\n", w, h);
+  printf("%-9s %-9s %16s %16s %8s\n", "src", "dst", "scalar",
+         easymedia::ConvertImplToString(simd), "speedup");
+  for (PixelFormat sfmt : fmts) {
+    Image src(sfmt, w, h);
+    for (PixelFormat dfmt : fmts) {
+      if (sfmt == dfmt)
+        continue;
+      Image dst(dfmt, w, h);
+      double ms = run(dst, src, ConvertImpl::SCALAR);
+      printf("%-9s %-9s %7.1fMP/s", strchr(PixFmtToString(sfmt), ':') + 1,
+             strchr(PixFmtToString(dfmt), ':') + 1, w * h / ms / 1000);
+      if (has_simd) {
+        double simd_ms = run(dst, src, simd);
+        printf(" %10.1fMP/s %7.2fx", w * h / simd_ms / 1000, ms / simd_ms);
+      }
+      printf("\n");
+    }
+  }
+  easymedia::SetConvertImpl(ConvertImpl::AUTO);
+  return 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "image_convert.h"
+#include "key_string.h"
+
+using easymedia::ConvertImpl;
+using easymedia::CpuImage;
+using easymedia::PlaneLayout;
+using easymedia::YuvMatrix;
+
+struct TestImage {
+  TestImage(PixelFormat fmt, int w, int h, int pad = 0) {
+    // padded strides, so that a kernel which writes over the width is caught
+    ImageInfo info = {fmt, w, h, w + pad, h};
+    mem.resize(CalPixFmtSize(info) + 64, 0xA5);
+    bool ret = easymedia::GetCpuImage(img, mem.data(), info);
+    assert(ret);
+    num = easymedia::GetPlaneLayout(fmt, layout);
+  }
+  void Fill(int seed) {
+    srand(seed);
+    for (auto &v : mem)
+      v = (uint8_t)rand();
+  }
+  // every byte of the planes, so that a flat colour is easy to set
+  void Fill(const uint8_t *pixel) {
+    for (int y = 0; y < img.height; y++) {
+      for (int x = 0; x < img.width; x++)
+        memcpy(img.data[0] + y * img.stride[0] + x * layout[0].bpp,
+               pixel + x % 2 * layout[0].bpp, layout[0].bpp);
+    }
+  }
+  bool PaddingIntact() const {
+    for (int i = 0; i < num; i++) {
+      int bytes = img.width / layout[i].xdiv * layout[i].bpp;
+      for (int y = 0; y < img.height / layout[i].ydiv; y++) {
+        const uint8_t *row = img.data[i] + y * img.stride[i];
+        for (int x = bytes; x < img.stride[i]; x++) {
+          if (row[x] != 0xA5)
+            return false;
+        }
+      }
+    }
+    return true;
+  }
+  std::vector<uint8_t> mem;
+  CpuImage img;
+  PlaneLayout layout[IMAGE_MAX_PLANES];
+  int num;
+};
+
+static const PixelFormat fmts[] = {
+    PIX_FMT_YUV420P,  PIX_FMT_NV12,     PIX_FMT_NV21,    PIX_FMT_YUV422P,
+    PIX_FMT_NV16,     PIX_FMT_NV61,     PIX_FMT_YUYV422, PIX_FMT_UYVY422,
+    PIX_FMT_RGB332,   PIX_FMT_RGB565,   PIX_FMT_BGR565,  PIX_FMT_RGB888,
+    PIX_FMT_BGR888,   PIX_FMT_ARGB8888, PIX_FMT_ABGR8888};
+static const YuvMatrix matrices[] = {
+    YuvMatrix::BT601_LIMITED, YuvMatrix::BT601_FULL, YuvMatrix::BT709_LIMITED,
+    YuvMatrix::BT709_FULL};
+
+// the vector kernels against the scalar ones, every pair and matrix, with
+// the widths which leave tails to the scalar code
+static void test_bitexact(ConvertImpl impl) {
+  if (!easymedia::IsConvertImplSupported(impl)) {
+    printf("bitexact %s: not built\n", easymedia::ConvertImplToString(impl));
+    return;
+  }
+  const int sizes[][2] = {{2, 2}, {18, 4}, {70, 6}, {64, 10}};
+  for (PixelFormat sfmt : fmts) {
+    for (PixelFormat dfmt : fmts) {
+      for (YuvMatrix m : matrices) {
+        for (auto &size : sizes) {
+          TestImage src(sfmt, size[0], size[1], 6);
+          src.Fill(sfmt * 31 + size[0]);
+          TestImage ref(dfmt, size[0], size[1], 10);
+          TestImage out(dfmt, size[0], size[1], 10);
+          easymedia::SetConvertImpl(ConvertImpl::SCALAR);
+          assert(!easymedia::ConvertImage(ref.img, src.img, m, 1));
+          easymedia::SetConvertImpl(impl);
+          assert(!easymedia::ConvertImage(out.img, src.img, m, 1));
+          if (out.mem != ref.mem || !ref.PaddingIntact()) {
+            fprintf(stderr, "bitexact %s: %s -> %s of matrix %d at %dx%d\n",
+                    easymedia::ConvertImplToString(impl),
+                    PixFmtToString(sfmt), PixFmtToString(dfmt), (int)m,
+                    size[0], size[1]);
+            exit(EXIT_FAILURE);
+          }
+        }
+      }
+    }
+  }
+  easymedia::SetConvertImpl(ConvertImpl::AUTO);
+  printf("bitexact %s: ok\n", easymedia::ConvertImplToString(impl));
+}
+
+static void convert_pixel(PixelFormat sfmt, const uint8_t *pixel,
+                          PixelFormat dfmt, YuvMatrix m, uint8_t *out) {
+  TestImage src(sfmt, 2, 2), dst(dfmt, 2, 2);
+  if (src.num == 1) {
+    src.Fill(pixel);
+  } else {
+    // y, u, v of a planar image
+    for (int i = 0; i < src.num; i++)
+      memset(src.img.data[i], pixel[i], src.img.stride[i]);
+  }
+  assert(!easymedia::ConvertImage(dst.img, src.img, m));
+  memcpy(out, dst.img.data[0], dst.layout[0].bpp);
+  if (dst.num == 3) {
+    out[1] = dst.img.data[1][0];
+    out[2] = dst.img.data[2][0];
+  }
+}
+
+// the numbers of the matrices at the ends of the ranges and the primaries
+static void test_values() {
+  struct {
+    YuvMatrix m;
+    uint8_t yuv[3];
+    uint8_t rgba[4];
+  } to_rgb[] = {
+      {YuvMatrix::BT601_LIMITED, {235, 128, 128}, {255, 255, 255, 255}},
+      {YuvMatrix::BT601_LIMITED, {16, 128, 128}, {0, 0, 0, 255}},
+      {YuvMatrix::BT601_FULL, {255, 128, 128}, {255, 255, 255, 255}},
+      {YuvMatrix::BT601_FULL, {0, 128, 128}, {0, 0, 0, 255}},
+      {YuvMatrix::BT709_LIMITED, {63, 102, 240}, {255, 1, 0, 255}},
+      {YuvMatrix::BT709_FULL, {128, 128, 128}, {128, 128, 128, 255}},
+  };
+  for (auto &t : to_rgb) {
+    uint8_t out[4];
+    convert_pixel(PIX_FMT_YUV420P, t.yuv, PIX_FMT_ARGB8888, t.m, out);
+    assert(!memcmp(out, t.rgba, 4));
+  }
+  struct {
+    YuvMatrix m;
+    uint8_t rgb[3];
+    uint8_t yuv[3];
+  } to_yuv[] = {
+      {YuvMatrix::BT601_LIMITED, {255, 255, 255}, {235, 128, 128}},
+      {YuvMatrix::BT601_FULL, {255, 255, 255}, {255, 128, 128}},
+      {YuvMatrix::BT709_LIMITED, {255, 0, 0}, {63, 102, 240}},
+      {YuvMatrix::BT601_FULL, {255, 0, 0}, {77, 85, 255}},
+      {YuvMatrix::BT709_FULL, {0, 0, 255}, {19, 255, 116}},
+  };
+  for (auto &t : to_yuv) {
+    uint8_t pixel[6], out[3];
+    memcpy(pixel, t.rgb, 3);
+    memcpy(pixel + 3, t.rgb, 3);
+    convert_pixel(PIX_FMT_RGB888, pixel, PIX_FMT_YUV422P, t.m, out);
+    assert(!memcmp(out, t.yuv, 3));
+  }
+  // yuyv and uyvy take the same pixel pair
+  const uint8_t yuyv[4] = {20, 30, 40, 50}, uyvy[4] = {30, 20, 50, 40};
+  TestImage a(PIX_FMT_YUYV422, 2, 2), b(PIX_FMT_UYVY422, 2, 2);
+  a.Fill(yuyv);
+  assert(!easymedia::ConvertImage(b.img, a.img));
+  assert(!memcmp(b.img.data[0], uyvy, 4));
+  // rgb332 expands its fields to the full range
+  const uint8_t rgb332[2] = {0xff, 0x49};
+  uint8_t rgba[4];
+  convert_pixel(PIX_FMT_RGB332, rgb332, PIX_FMT_ARGB8888,
+                YuvMatrix::BT601_LIMITED, rgba);
+  assert(rgba[0] == 255 && rgba[1] == 255 && rgba[2] == 255);
+  assert(easymedia::GetYuvMatrixByString(KEY_BT709, KEY_RANGE_FULL) ==
+         YuvMatrix::BT709_FULL);
+  assert(easymedia::GetYuvMatrixByString(nullptr, nullptr) ==
+         YuvMatrix::BT601_LIMITED);
+  printf("values: ok\n");
+}
+
+// the conversions which keep every sample
+static void test_lossless() {
+  const PixelFormat pairs[][2] = {
+      {PIX_FMT_NV16, PIX_FMT_YUYV422},   {PIX_FMT_NV61, PIX_FMT_UYVY422},
+      {PIX_FMT_YUV422P, PIX_FMT_NV61},   {PIX_FMT_NV12, PIX_FMT_YUYV422},
+      {PIX_FMT_NV21, PIX_FMT_YUV422P},   {PIX_FMT_RGB332, PIX_FMT_RGB888},
+      {PIX_FMT_RGB565, PIX_FMT_ABGR8888}, {PIX_FMT_BGR888, PIX_FMT_ARGB8888},
+  };
+  for (auto &p : pairs) {
+    for (int threads = 1; threads <= 3; threads += 2) {
+      TestImage src(p[0], 70, 38, 6), mid(p[1], 70, 38, 4);
+      TestImage back(p[0], 70, 38, 6);
+      src.Fill(p[0]);
+      back.mem = src.mem;
+      assert(!easymedia::ConvertImage(mid.img, src.img,
+                                      YuvMatrix::BT601_LIMITED, threads));
+      assert(!easymedia::ConvertImage(back.img, mid.img,
+                                      YuvMatrix::BT601_LIMITED, threads));
+      for (int i = 0; i < src.num; i++) {
+        int bytes = src.img.width / src.layout[i].xdiv * src.layout[i].bpp;
+        for (int y = 0; y < src.img.height / src.layout[i].ydiv; y++) {
+          const uint8_t *s = src.img.data[i] + y * src.img.stride[i];
+          const uint8_t *d = back.img.data[i] + y * back.img.stride[i];
+          for (int x = 0; x < bytes; x++) {
+            // the alpha of a source without it is not kept
+            if (s[x] != d[x] && p[0] != PIX_FMT_RGB565) {
+              fprintf(stderr, "lossless: %s -> %s mismatch at %d,%d\n",
+                      PixFmtToString(p[0]), PixFmtToString(p[1]), x, y);
+              exit(EXIT_FAILURE);
+            }
+          }
+        }
+      }
+    }
+  }
+  printf("lossless: ok\n");
+}
+
+int main() {
+  test_bitexact(ConvertImpl::SSE2);
+  test_bitexact(ConvertImpl::NEON);
+  test_values();
+  test_lossless();
+  return 0;
+}
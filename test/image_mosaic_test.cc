@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "buffer.h"
+#include "control.h"
+#include "flow.h"
+#include "image_mosaic.h"
+#include "key_string.h"
+
+using easymedia::CpuImage;
+using easymedia::ImageMosaic;
+
+struct Image {
+  Image(PixelFormat fmt, int w, int h) : info({fmt, w, h, w, h}) {
+    mem.resize(CalPixFmtSize(info));
+    bool ret = easymedia::GetCpuImage(img, mem.data(), info);
+    assert(ret);
+  }
+  // flat luma, neutral chroma
+  void Fill(uint8_t y) {
+    memset(mem.data(), y, info.width * info.height);
+    memset(mem.data() + info.width * info.height, 128,
+           mem.size() - info.width * info.height);
+  }
+  uint8_t Y(int x, int y) const { return img.data[0][y * img.stride[0] + x]; }
+  ImageInfo info;
+  std::vector<uint8_t> mem;
+  CpuImage img;
+};
+
+static void test_layout() {
+  auto grid = ImageMosaic::GridLayout(4, 4, 1920, 1080);
+  assert(grid.size() == 16);
+  size_t area = 0;
+  for (auto &r : grid) {
+    assert(!(r.x & 1) && !(r.y & 1) && !(r.w & 1) && !(r.h & 1));
+    area += r.w * r.h;
+  }
+  assert(area == 1920 * 1080);
+  assert(grid[15].x + grid[15].w == 1920 && grid[15].y + grid[15].h == 1080);
+  assert(ImageMosaic::ParseLayout("3x3", 1920, 1080).size() == 9);
+  auto rects =
+      ImageMosaic::ParseLayout("(0,0,1280,720) (1280,0,640,360)", 1920, 1080);
+  assert(rects.size() == 2 && rects[1].x == 1280 && rects[1].h == 360);
+  assert(ImageMosaic::ParseLayout("3x", 1920, 1080).empty());
+  assert(ImageMosaic::ParseLayout("(0,0,1)", 1920, 1080).empty());
+  // an inset over another tile
+  assert(ImageMosaic::ParseLayout("(0,0,1920,1080)(1280,720,640,360)", 1920,
+                                  1080)
+             .empty());
+  // touching is not overlapping, after the rects are aligned to even
+  assert(ImageMosaic::ParseLayout("(0,0,961,1080)(961,0,959,1080)", 1920, 1080)
+             .size() == 2);
+  printf("layout ok\n");
+}
+
+static void test_compose() {
+  const int n = 16;
+  Image dst(PIX_FMT_NV12, 1920, 1080);
+  dst.Fill(0);
+  std::vector<Image> srcs;
+  for (int i = 0; i < n; i++) {
+    srcs.emplace_back(PIX_FMT_NV12, 352, 288);
+    srcs.back().Fill(32 + i * 8);
+  }
+  ImageMosaic mosaic(ImageMosaic::GridLayout(4, 4, 1920, 1080));
+  mosaic.SetPlaceholder(0xFFFFFF);
+  mosaic.SetBorder(0, 4, 0x000000);
+  std::vector<ImageMosaic::Input> inputs(n);
+  for (int i = 0; i < n; i++)
+    inputs[i] = {&srcs[i].img, 1};
+  // missing inputs
+  inputs[5].img = nullptr;
+  inputs[10].img = nullptr;
+  assert(!mosaic.Compose(dst.img, 1, inputs));
+  assert(mosaic.GetLastDrawnNum() == n);
+  auto &tiles = mosaic.GetTiles();
+  for (int i = 0; i < n; i++) {
+    const ImageRect &t = tiles[i];
+    uint8_t y = dst.Y(t.x + t.w / 2, t.y + t.h / 2);
+    if (inputs[i].img)
+      assert(y == 32 + i * 8);
+    else
+      assert(y == 235); // white of limited range
+  }
+  // the frame of tile 0, black
+  assert(dst.Y(0, 0) == 16 && dst.Y(3, 100) == 16 && dst.Y(4, 100) == 32);
+  assert(dst.Y(tiles[0].w - 1, 100) == 16);
+
+  // nothing new, nothing drawn
+  assert(!mosaic.Compose(dst.img, 1, inputs));
+  assert(mosaic.GetLastDrawnNum() == 0);
+  // new frames of three tiles, one input gone
+  inputs[1].seq = inputs[2].seq = 2;
+  inputs[3].img = nullptr;
+  assert(!mosaic.Compose(dst.img, 1, inputs));
+  assert(mosaic.GetLastDrawnNum() == 3);
+  // another buffer is drawn whole, then only what it misses
+  Image dst2(PIX_FMT_NV12, 1920, 1080);
+  assert(!mosaic.Compose(dst2.img, 2, inputs));
+  assert(mosaic.GetLastDrawnNum() == n);
+  inputs[7].seq = 2;
+  assert(!mosaic.Compose(dst.img, 1, inputs));
+  assert(mosaic.GetLastDrawnNum() == 1);
+  assert(!mosaic.Compose(dst2.img, 2, inputs));
+  assert(mosaic.GetLastDrawnNum() == 1);
+  assert(dst.mem == dst2.mem);
+  // the style changes all
+  mosaic.SetBorder(-1, 2, 0x00FF00);
+  assert(!mosaic.Compose(dst.img, 1, inputs));
+  assert(mosaic.GetLastDrawnNum() == n);
+  // the placeholder changes the empty tiles
+  mosaic.SetPlaceholder(0x202020);
+  assert(!mosaic.Compose(dst.img, 1, inputs));
+  assert(mosaic.GetLastDrawnNum() == 3);
+  // wrong number of inputs
+  inputs.pop_back();
+  assert(mosaic.Compose(dst.img, 1, inputs) < 0);
+
+  // the area out of the tiles is cleared once a buffer
+  ImageMosaic corner({{0, 0, 960, 540}});
+  std::vector<ImageMosaic::Input> one = {{&srcs[0].img, 1}};
+  dst.Fill(200);
+  assert(!corner.Compose(dst.img, 1, one));
+  assert(dst.Y(480, 270) == 32 && dst.Y(1500, 800) == 16);
+  dst.Fill(200);
+  one[0].seq = 2;
+  assert(!corner.Compose(dst.img, 1, one));
+  assert(dst.Y(480, 270) == 32 && dst.Y(1500, 800) == 200);
+  // overlapping tiles are refused
+  ImageMosaic overlap({{0, 0, 960, 540}, {480, 270, 960, 540}});
+  one.push_back({&srcs[1].img, 1});
+  assert(overlap.Compose(dst.img, 1, one) < 0);
+  printf("compose ok\n");
+}
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// 16 cif channels into 1080p, all tiles and one new tile a frame
+static void bench() {
+  const int n = 16, loops = 20;
+  Image dst(PIX_FMT_NV12, 1920, 1080);
+  std::vector<Image> srcs;
+  for (int i = 0; i < n; i++) {
+    srcs.emplace_back(PIX_FMT_NV12, 352, 288);
+    for (auto &v : srcs.back().mem)
+      v = (uint8_t)rand();
+  }
+  ImageMosaic mosaic(ImageMosaic::GridLayout(4, 4, 1920, 1080));
+  mosaic.SetBorder(-1, 2, 0x404040);
+  std::vector<ImageMosaic::Input> inputs(n);
+  for (int i = 0; i < n; i++)
+    inputs[i] = {&srcs[i].img, 1};
+  auto start = std::chrono::steady_clock::now();
+  for (int l = 0; l < loops; l++)
+    mosaic.Compose(dst.img, 0, inputs);
+  double full = ms_since(start) / loops;
+  start = std::chrono::steady_clock::now();
+  for (int l = 0; l < loops; l++) {
+    inputs[l % n].seq++;
+    mosaic.Compose(dst.img, 1, inputs);
+  }
+  double one = ms_since(start) / loops;
+  printf("16 cif -> 1080p nv12: %.2f ms all tiles, %.2f ms one tile\n", full,
+         one);
+}
+
+// the flow takes its params and runs with no downstream
+static void test_flow() {
+  std::string param;
+  PARAM_STRING_APPEND(param, KEY_OUTPUTDATATYPE, IMAGE_NV12);
+  PARAM_STRING_APPEND_TO(param, KEY_BUFFER_WIDTH, 640);
+  PARAM_STRING_APPEND_TO(param, KEY_BUFFER_HEIGHT, 480);
+  PARAM_STRING_APPEND(param, KEY_MOSAIC_LAYOUT, "2x2");
+  PARAM_STRING_APPEND_TO(param, KEY_MOSAIC_BORDER, 2);
+  PARAM_STRING_APPEND_TO(param, KEY_FPS, 100);
+  auto flow = easymedia::REFLECTOR(Flow)::Create<easymedia::Flow>(
+      "mosaic", param.c_str());
+  assert(flow);
+  ImageInfo info = {PIX_FMT_NV12, 320, 240, 320, 240};
+  for (int i = 0; i < 3; i++) {
+    auto mb = easymedia::MediaBuffer::Alloc2(CalPixFmtSize(info));
+    std::shared_ptr<easymedia::MediaBuffer> ib =
+        std::make_shared<easymedia::ImageBuffer>(mb, info);
+    flow->SendInput(ib, i);
+  }
+  easymedia::MosaicBorderArg arg = {1, 4, 0xFF0000};
+  assert(!flow->Control(easymedia::S_MOSAIC_BORDER, &arg));
+  easymedia::msleep(100);
+  flow.reset();
+  auto bad = easymedia::REFLECTOR(Flow)::Create<easymedia::Flow>(
+      "mosaic", KEY_OUTPUTDATATYPE "=" IMAGE_NV12);
+  assert(!bad);
+  printf("flow ok\n");
+}
+
+// Keeps the time of the last output, so the pool is not drained.
+class SinkFlow : public easymedia::Flow {
+public:
+  SinkFlow() : timestamp(-1) {
+    easymedia::SlotMap sm;
+    sm.input_slots.push_back(0);
+    sm.process = Collect;
+    sm.thread_model = easymedia::Model::SYNC;
+    bool ret = InstallSlotMap(sm, "sink", -1);
+    assert(ret);
+  }
+  virtual ~SinkFlow() { StopAllThread(); }
+  int64_t GetTimeStamp() {
+    std::lock_guard<std::mutex> _lg(mtx);
+    return timestamp;
+  }
+
+private:
+  static bool Collect(easymedia::Flow *f,
+                      easymedia::MediaBufferVector &input_vector) {
+    auto sink = static_cast<SinkFlow *>(f);
+    std::lock_guard<std::mutex> _lg(sink->mtx);
+    if (input_vector[0])
+      sink->timestamp = input_vector[0]->GetTimeStamp();
+    return true;
+  }
+  std::mutex mtx;
+  int64_t timestamp;
+};
+
+static std::shared_ptr<easymedia::MediaBuffer> new_frame(int64_t timestamp) {
+  ImageInfo info = {PIX_FMT_NV12, 64, 48, 64, 48};
+  auto mb = easymedia::MediaBuffer::Alloc2(CalPixFmtSize(info));
+  auto ib = std::make_shared<easymedia::ImageBuffer>(mb, info);
+  memset(ib->GetPtr(), 0, ib->GetValidSize());
+  ib->SetTimeStamp(timestamp);
+  return ib;
+}
+
+// the tiles are of the time of the slowest input, the frames of a silent
+// input are released
+static void test_flow_align() {
+  std::string param;
+  PARAM_STRING_APPEND(param, KEY_OUTPUTDATATYPE, IMAGE_NV12);
+  PARAM_STRING_APPEND_TO(param, KEY_BUFFER_WIDTH, 128);
+  PARAM_STRING_APPEND_TO(param, KEY_BUFFER_HEIGHT, 48);
+  PARAM_STRING_APPEND(param, KEY_MOSAIC_LAYOUT, "2x1");
+  PARAM_STRING_APPEND_TO(param, KEY_MOSAIC_TIMEOUT, 200);
+  PARAM_STRING_APPEND_TO(param, KEY_FPS, 100);
+  auto flow = easymedia::REFLECTOR(Flow)::Create<easymedia::Flow>(
+      "mosaic", param.c_str());
+  assert(flow);
+  auto sink = std::make_shared<SinkFlow>();
+  flow->AddDownFlow(sink, 0, 0);
+  auto fast0 = new_frame(1000), slow = new_frame(1000);
+  flow->SendInput(fast0, 0);
+  flow->SendInput(slow, 1);
+  easymedia::msleep(50);
+  assert(sink->GetTimeStamp() == 1000);
+  auto fast1 = new_frame(1040);
+  flow->SendInput(fast1, 0);
+  easymedia::msleep(50);
+  // the slow one has no frame of 1040 yet
+  assert(sink->GetTimeStamp() == 1000);
+  auto fast2 = new_frame(1080), slow1 = new_frame(1070);
+  flow->SendInput(fast2, 0);
+  flow->SendInput(slow1, 1);
+  easymedia::msleep(50);
+  assert(sink->GetTimeStamp() == 1070);
+  // older than the ones taken, not kept
+  assert(fast0.use_count() == 1 && slow.use_count() == 1);
+  fast0.reset();
+  slow.reset();
+  // silent past the timeout, nothing is held
+  easymedia::msleep(400);
+  assert(fast1.use_count() == 1);
+  assert(fast2.use_count() == 1 && slow1.use_count() == 1);
+  flow->RemoveDownFlow(sink);
+  flow.reset();
+  printf("flow align ok\n");
+}
+
+int main() {
+  test_layout();
+  test_compose();
+  bench();
+  test_flow();
+  test_flow_align();
+  return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "image_overlay.h"
+
+using easymedia::ConvertImpl;
+using easymedia::CpuImage;
+using easymedia::ImageOverlay;
+using easymedia::OverlayRegion;
+using easymedia::OverlayType;
+
+// rgba text of w x h: opaque glyph strokes with soft edges, mostly clear
+static std::vector<uint8_t> make_text(int w, int h) {
+  std::vector<uint8_t> px(w * h * 4, 0);
+  for (int y = 4; y < h - 4; y++) {
+    for (int x = 0; x < w; x++) {
+      int cx = x % 24;
+      if (cx >= 18)
+        continue; // the gap between two glyphs
+      uint8_t *p = &px[(y * w + x) * 4];
+      bool stroke = cx < 3 || cx > 14 || y % 16 < 3;
+      bool edge = cx == 3 || cx == 14 || y % 16 == 3;
+      p[0] = p[1] = p[2] = 255;
+      p[3] = stroke ? 255 : (edge ? 128 : 0);
+    }
+  }
+  return px;
+}
+
+// rgba logo with a gradient alpha
+static std::vector<uint8_t> make_logo(int w, int h) {
+  std::vector<uint8_t> px(w * h * 4);
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      uint8_t *p = &px[(y * w + x) * 4];
+      p[0] = x;
+      p[1] = y;
+      p[2] = x ^ y;
+      p[3] = 96 + (x + y) % 160;
+    }
+  }
+  return px;
+}
+
+// ms per frame of one thread, repeated for some time at least
+static double run(ImageOverlay &ov, const CpuImage &img, ConvertImpl impl) {
+  easymedia::SetConvertImpl(impl);
+  int loop = 0;
+  double ms = 0;
+  auto start = std::chrono::steady_clock::now();
+  do {
+    ov.Apply(img);
+    loop++;
+    ms = std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+             .count();
+  } while (ms < 200 && loop < 5000);
+  return ms / loop;
+}
+
+// A typical osd of an ip camera on 1080p: the time stamp, the channel name
+// of a palette, a logo and four privacy masks. The target is 1 ms a frame.
+int main(int argc, char **argv) {
+  int w = 1920, h = 1080;
+  if (argc > 2) {
+    w = atoi(argv[1]) & ~1;
+    h = atoi(argv[2]) & ~1;
+  }
+  ConvertImpl simd = easymedia::IsConvertImplSupported(ConvertImpl::SSE2)
+                         ? ConvertImpl::SSE2
+                         : ConvertImpl::NEON;
+  bool has_simd = easymedia::IsConvertImplSupported(simd);
+  const PixelFormat fmts[] = {PIX_FMT_NV12, PIX_FMT_NV16, PIX_FMT_YUV420P};
+
+  auto text = make_text(576, 64);
+  auto logo = make_logo(256, 128);
+  std::vector<uint8_t> name(384 * 48);
+  for (size_t i = 0; i < name.size(); i++)
+    name[i] = (i % 384) % 24 < 16 && (i / 384) % 12 < 8 ? 1 : 0;
+  uint32_t palette[256] = {0x00000000, 0xFFFFFF00};
+
+  ImageOverlay ov;
+  OverlayRegion r = {OverlayType::BITMAP, {64, 48, 576, 64}, text.data(), 0,
+                     nullptr, 0};
+  ov.SetRegion(0, r);
+  r = {OverlayType::PALETTE, {64, h - 112, 384, 48}, name.data(), 0, palette,
+       0};
+  ov.SetRegion(1, r);
+  r = {OverlayType::BITMAP, {w - 320, 48, 256, 128}, logo.data(), 0, nullptr,
+       0};
+  ov.SetRegion(2, r);
+  for (int i = 0; i < 4; i++) {
+    r = {OverlayType::MASK, {320 + i * 360, h / 2, 320, 180}, nullptr, 0,
+         nullptr, 0xFF808080};
+    ov.SetRegion(10 + i, r);
+  }
+
+  printf("%dx%d, 1 thread, time stamp 576x64, name 384x48, logo 256x128, "
+         "4 masks 320x180\n",
+         w, h);
+  printf("%-9s %12s %12s\n", "fmt", "scalar",
+         easymedia::ConvertImplToString(simd));
+  bool pass = true;
+  for (PixelFormat fmt : fmts) {
+    ImageInfo info = {fmt, w, h, w, h};
+    std::vector<uint8_t> mem(CalPixFmtSize(info), 0x80);
+    CpuImage img;
+    easymedia::GetCpuImage(img, mem.data(), info);
+    // the first frame converts the regions to the planes of fmt
+    ov.Apply(img);
+    double ms = run(ov, img, ConvertImpl::SCALAR);
+    printf("%-9s %10.3fms", strchr(PixFmtToString(fmt), ':') + 1, ms);
+    if (has_simd) {
+      ms = run(ov, img, simd);
+      printf(" %10.3fms", ms);
+    }
+    printf("\n");
+    pass = pass && ms < 1.0;
+  }
+  easymedia::SetConvertImpl(ConvertImpl::AUTO);
+  printf("%s: the target is 1 ms a frame\n", pass ? "pass" : "fail");
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "image_overlay.h"
+
+using easymedia::ConvertImpl;
+using easymedia::CpuImage;
+using easymedia::ImageOverlay;
+using easymedia::OverlayRegion;
+using easymedia::OverlayType;
+using easymedia::YuvMatrix;
+
+// random pixels, padded strides
+struct Frame {
+  Frame(PixelFormat fmt, int w, int h) : info({fmt, w, h, w + 16, h}) {
+    mem.resize(CalPixFmtSize(info));
+    srand(w * h + fmt);
+    for (auto &v : mem)
+      v = (uint8_t)rand();
+    bool ret = easymedia::GetCpuImage(img, mem.data(), info);
+    assert(ret);
+  }
+  Frame(const Frame &f) : info(f.info), mem(f.mem) {
+    easymedia::GetCpuImage(img, mem.data(), info);
+  }
+  uint8_t Y(int x, int y) const { return img.data[0][y * img.stride[0] + x]; }
+  ImageInfo info;
+  std::vector<uint8_t> mem;
+  CpuImage img;
+};
+
+// rgba pixels of glyph like shapes: opaque strokes, soft edges, holes
+static std::vector<uint8_t> make_bitmap(int w, int h, int seed) {
+  std::vector<uint8_t> px(w * h * 4);
+  srand(seed);
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      uint8_t *p = &px[(y * w + x) * 4];
+      p[0] = rand();
+      p[1] = rand();
+      p[2] = rand();
+      int k = (x / 3 + y / 5) % 5;
+      p[3] = k == 0 ? 0 : (k == 1 ? 255 : (uint8_t)rand());
+    }
+  }
+  return px;
+}
+
+static uint8_t blend(uint8_t d, uint8_t s, uint8_t a) {
+  unsigned t = s * a + d * (255 - a) + 128;
+  return (uint8_t)((t + (t >> 8)) >> 8);
+}
+
+// luma against the plain blending of every pixel; the chroma of an opaque
+// block is the colour; nothing out of the region changes
+static void test_bitmap(PixelFormat fmt) {
+  const int w = 96, h = 64, rw = 37, rh = 21, rx = 30, ry = 10;
+  Frame f(fmt, w, h);
+  Frame orig = f;
+  auto px = make_bitmap(rw, rh, 1);
+  ImageOverlay ov;
+  OverlayRegion r = {OverlayType::BITMAP, {rx, ry, rw, rh}, px.data(), 0,
+                     nullptr, 0};
+  assert(!ov.SetRegion(1, r));
+  assert(!ov.Apply(f.img));
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      uint8_t expect = orig.Y(x, y);
+      if (x >= rx && x < rx + rw && y >= ry && y < ry + rh) {
+        const uint8_t *p = &px[((y - ry) * rw + x - rx) * 4];
+        uint8_t yy, u, v;
+        easymedia::RgbToYuv(YuvMatrix::BT601_LIMITED, p[0], p[1], p[2], yy, u,
+                            v);
+        expect = blend(expect, yy, p[3]);
+      }
+      assert(f.Y(x, y) == expect);
+    }
+  }
+  // the chroma planes only change under the region
+  easymedia::PlaneLayout layout[IMAGE_MAX_PLANES];
+  int num = easymedia::GetPlaneLayout(fmt, layout);
+  for (int p = 1; p < num; p++) {
+    const easymedia::PlaneLayout &l = layout[p];
+    for (int y = 0; y < h / l.ydiv; y++) {
+      for (int x = 0; x < w / l.xdiv; x++) {
+        int lx = x * l.xdiv, ly = y * l.ydiv;
+        if (lx + l.xdiv > rx && lx < rx + rw && ly + l.ydiv > ry &&
+            ly < ry + rh)
+          continue;
+        size_t i = y * f.img.stride[p] + x * l.bpp;
+        assert(!memcmp(f.img.data[p] + i, orig.img.data[p] + i, l.bpp));
+      }
+    }
+  }
+  printf("bitmap on %s ok\n", PixFmtToString(fmt));
+}
+
+static void test_mask_and_clip() {
+  const int w = 64, h = 48;
+  Frame f(PIX_FMT_NV12, w, h);
+  ImageOverlay ov;
+  // opaque red, partly out of the frame at the top left and the right
+  OverlayRegion r = {OverlayType::MASK, {-6, -4, 20, 12}, nullptr, 0,
+                     nullptr, 0xFFFF0000};
+  assert(!ov.SetRegion(0, r));
+  r.rect = {50, 40, 40, 40};
+  assert(!ov.SetRegion(1, r));
+  assert(!ov.Apply(f.img));
+  uint8_t yy, u, v;
+  easymedia::RgbToYuv(YuvMatrix::BT601_LIMITED, 255, 0, 0, yy, u, v);
+  for (int y = 0; y < 8; y++)
+    for (int x = 0; x < 14; x++)
+      assert(f.Y(x, y) == yy);
+  for (int y = 40; y < h; y++)
+    for (int x = 50; x < w; x++)
+      assert(f.Y(x, y) == yy);
+  const uint8_t *uv = f.img.data[1];
+  assert(uv[0] == u && uv[1] == v);
+  assert(uv[23 * f.img.stride[1] + 62] == u);
+  // move, and remove all
+  assert(!ov.MoveRegion(0, 20, 20));
+  assert(ov.MoveRegion(5, 0, 0) < 0);
+  Frame g(PIX_FMT_NV12, w, h);
+  assert(!ov.Apply(g.img));
+  assert(g.Y(20, 20) == yy && g.Y(39, 31) == yy);
+  ov.RemoveRegion(-1);
+  assert(ov.Empty());
+  // unsupported
+  Frame rgb(PIX_FMT_RGB888, w, h);
+  assert(ov.Apply(rgb.img) < 0);
+  printf("mask and clip ok\n");
+}
+
+// the palette path is the bitmap of the colours
+static void test_palette() {
+  const int rw = 40, rh = 16;
+  uint32_t palette[256];
+  for (int i = 0; i < 256; i++)
+    palette[i] = (uint32_t)(i * 0x01010101u) ^ 0x00A05010u;
+  std::vector<uint8_t> idx(rw * rh), rgba(rw * rh * 4);
+  for (int i = 0; i < rw * rh; i++) {
+    idx[i] = (uint8_t)(i * 13);
+    uint32_t c = palette[idx[i]];
+    rgba[i * 4] = c >> 16;
+    rgba[i * 4 + 1] = c >> 8;
+    rgba[i * 4 + 2] = c;
+    rgba[i * 4 + 3] = c >> 24;
+  }
+  Frame a(PIX_FMT_YUV420P, 64, 32), b = a;
+  ImageOverlay oa, ob;
+  OverlayRegion r = {OverlayType::PALETTE, {8, 8, rw, rh}, idx.data(), 0,
+                     palette, 0};
+  assert(!oa.SetRegion(0, r));
+  r = {OverlayType::BITMAP, {8, 8, rw, rh}, rgba.data(), 0, nullptr, 0};
+  assert(!ob.SetRegion(0, r));
+  assert(!oa.Apply(a.img) && !ob.Apply(b.img));
+  assert(a.mem == b.mem);
+  printf("palette ok\n");
+}
+
+// the vector kernels are bit exact to the scalar ones
+static void test_impls() {
+  const PixelFormat fmts[] = {PIX_FMT_NV12, PIX_FMT_NV21, PIX_FMT_NV16,
+                              PIX_FMT_NV61, PIX_FMT_YUV420P,
+                              PIX_FMT_YUV422P};
+  auto px = make_bitmap(133, 45, 7);
+  for (PixelFormat fmt : fmts) {
+    std::vector<uint8_t> ref;
+    for (ConvertImpl impl :
+         {ConvertImpl::SCALAR, ConvertImpl::SSE2, ConvertImpl::NEON}) {
+      if (!easymedia::SetConvertImpl(impl))
+        continue;
+      Frame f(fmt, 320, 96);
+      ImageOverlay ov(YuvMatrix::BT709_LIMITED);
+      OverlayRegion r = {OverlayType::BITMAP, {11, 7, 133, 45}, px.data(), 0,
+                         nullptr, 0};
+      assert(!ov.SetRegion(3, r));
+      r = {OverlayType::MASK, {100, 30, 64, 40}, nullptr, 0, nullptr,
+           0x80102030};
+      assert(!ov.SetRegion(4, r));
+      // twice, the second is of the cached planes
+      assert(!ov.Apply(f.img) && !ov.Apply(f.img));
+      if (ref.empty())
+        ref = f.mem;
+      else
+        assert(ref == f.mem);
+    }
+  }
+  easymedia::SetConvertImpl(ConvertImpl::AUTO);
+  printf("impls ok\n");
+}
+
+int main() {
+  test_bitmap(PIX_FMT_NV12);
+  test_bitmap(PIX_FMT_NV16);
+  test_bitmap(PIX_FMT_YUV420P);
+  test_mask_and_clip();
+  test_palette();
+  test_impls();
+  return 0;
+}
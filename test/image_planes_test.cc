@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "filter.h"
+#include "image_convert.h"
+#include "key_string.h"
+
+using easymedia::CpuImage;
+using easymedia::ImageBuffer;
+using easymedia::MediaBuffer;
+
+static std::shared_ptr<ImageBuffer> alloc_image(const ImageInfo &info,
+                                                size_t size) {
+  auto mb = MediaBuffer::Alloc2(size);
+  auto ib = std::make_shared<ImageBuffer>(mb, info);
+  uint8_t *p = static_cast<uint8_t *>(ib->GetPtr());
+  for (size_t i = 0; i < ib->GetSize(); i++)
+    p[i] = (uint8_t)(i * 7 + (i >> 8));
+  return ib;
+}
+
+// the valid rows of every plane are the same
+static bool same_image(ImageBuffer &a, ImageBuffer &b) {
+  ImagePlane ap[IMAGE_MAX_PLANES], bp[IMAGE_MAX_PLANES];
+  uint8_t *ad[IMAGE_MAX_PLANES], *bd[IMAGE_MAX_PLANES];
+  int num = a.GetPlanes(ap);
+  if (b.GetPlanes(bp) != num || a.GetPlanePtrs(ad) != num ||
+      b.GetPlanePtrs(bd) != num)
+    return false;
+  for (int i = 0; i < num; i++) {
+    if (ap[i].rows != bp[i].rows || ap[i].row_bytes != bp[i].row_bytes)
+      return false;
+    for (int r = 0; r < ap[i].rows; r++) {
+      if (memcmp(ad[i] + r * ap[i].stride, bd[i] + r * bp[i].stride,
+                 ap[i].row_bytes))
+        return false;
+    }
+  }
+  return true;
+}
+
+static void test_default_planes() {
+  ImageInfo info = {PIX_FMT_NV12, 64, 48, 80, 64};
+  ImagePlane planes[IMAGE_MAX_PLANES];
+  assert(GetImagePlanes(info, planes) == 2);
+  assert(planes[0].offset == 0 && planes[0].stride == 80);
+  assert(planes[0].row_bytes == 64 && planes[0].rows == 48);
+  assert(planes[1].offset == 80 * 64 && planes[1].stride == 80);
+  assert(planes[1].row_bytes == 64 && planes[1].rows == 24);
+  assert(planes[0].fd < 0 && planes[1].fd < 0);
+  // the chroma ends before the vir height does
+  assert(CalPixFmtSize(info, planes, 2) == 80 * 64 + 80 * 24);
+  assert(CalPixFmtSize(info, nullptr, 0) == CalPixFmtSize(info));
+  int vir_w = 0, vir_h = 0;
+  assert(GetVirSizeOfPlanes(info, planes, 2, vir_w, vir_h));
+  assert(vir_w == 80 && vir_h == 64);
+  info = {PIX_FMT_YUV420P, 64, 48, 64, 48};
+  assert(GetImagePlanes(info, planes) == 3);
+  assert(planes[1].offset == 64 * 48 && planes[1].stride == 32);
+  assert(planes[2].offset == 64 * 48 * 5 / 4 && planes[2].rows == 24);
+  assert(CalPixFmtSize(info, planes, 3) == CalPixFmtSize(info));
+  printf("default planes ok\n");
+}
+
+static void test_set_planes() {
+  ImageInfo info = {PIX_FMT_NV12, 64, 48, 64, 48};
+  // the chroma of a decoder aligned to 64 rows
+  ImagePlane planes[2] = {{0, 64, 64, 48, -1}, {64 * 64, 64, 64, 24, -1}};
+  auto ib = alloc_image(info, 64 * 64 + 64 * 24);
+  assert(!ib->HasExplicitPlanes());
+  ib->SetPlanes(planes, 2);
+  assert(ib->HasExplicitPlanes());
+  assert(ib->GetValidSize() == 64 * 64 + 64 * 24);
+  ImagePlane got[IMAGE_MAX_PLANES];
+  assert(ib->GetPlanes(got) == 2);
+  assert(!memcmp(got, planes, sizeof(planes)));
+  int vir_w = 0, vir_h = 0;
+  assert(GetVirSizeOfPlanes(info, got, 2, vir_w, vir_h));
+  assert(vir_w == 64 && vir_h == 64);
+  // the chroma not on a row of the luma stride
+  planes[1].offset = 64 * 48 + 32;
+  assert(!GetVirSizeOfPlanes(info, planes, 2, vir_w, vir_h));
+  // the strides differ
+  planes[1] = {64 * 48, 128, 64, 24, -1};
+  assert(!GetVirSizeOfPlanes(info, planes, 2, vir_w, vir_h));
+  assert(CalPixFmtSize(info, planes, 2) == 64 * 48 + 128 * 24);
+  ib->ClearPlanes();
+  assert(!ib->HasExplicitPlanes());
+  assert(ib->GetPlanes(got) == 2 && got[1].offset == 64 * 48);
+  printf("set planes ok\n");
+}
+
+// the chroma in a dma buffer of its own, as multi-planar v4l2
+static void test_separate_fd() {
+  ImageInfo info = {PIX_FMT_NV12, 64, 48, 64, 48};
+  FILE *f = tmpfile();
+  assert(f);
+  int fd = fileno(f);
+  const int chroma_size = 64 * 24;
+  uint8_t chroma[chroma_size];
+  for (int i = 0; i < chroma_size; i++)
+    chroma[i] = (uint8_t)(i * 3);
+  assert(write(fd, chroma, chroma_size) == chroma_size);
+  ImagePlane planes[2] = {{0, 64, 64, 48, -1}, {0, 64, 64, 24, fd}};
+  auto ib = alloc_image(info, 64 * 48);
+  ib->SetPlanes(planes, 2);
+  // the plane of the fd is not in the buffer
+  assert(CalPixFmtSize(info, planes, 2) == 64 * 48);
+  assert(ib->GetValidSize() == 64 * 48);
+  int vir_w = 0, vir_h = 0;
+  assert(!GetVirSizeOfPlanes(info, planes, 2, vir_w, vir_h));
+  uint8_t *data[IMAGE_MAX_PLANES];
+  assert(ib->GetPlanePtrs(data) == 2);
+  assert(data[0] == ib->GetPtr());
+  assert(!memcmp(data[1], chroma, chroma_size));
+  // the packed copy is the same image in one buffer
+  auto packed = ib->PackedCopy(MediaBuffer::MemType::MEM_COMMON);
+  assert(packed && !packed->HasExplicitPlanes());
+  assert(packed->GetVirWidth() == 64 && packed->GetVirHeight() == 48);
+  assert(same_image(*ib, *packed));
+  // and back to the fd
+  uint8_t *p = static_cast<uint8_t *>(packed->GetPtr());
+  memset(p + 64 * 48, 0x5a, chroma_size);
+  assert(ib->CopyPlanesFrom(*packed));
+  assert(data[1][0] == 0x5a && data[1][chroma_size - 1] == 0x5a);
+  assert(pread(fd, chroma, chroma_size, 0) == chroma_size);
+  assert(chroma[0] == 0x5a && chroma[chroma_size - 1] == 0x5a);
+  // not the same size
+  ImageInfo small = {PIX_FMT_NV12, 32, 32, 32, 32};
+  auto other = alloc_image(small, CalPixFmtSize(small));
+  assert(!ib->CopyPlanesFrom(*other));
+  ib.reset();
+  fclose(f);
+  printf("separate fd ok\n");
+}
+
+static void test_packed_copy_of_view() {
+  ImageInfo info = {PIX_FMT_YUV420P, 64, 48, 64, 48};
+  auto src = alloc_image(info, CalPixFmtSize(info));
+  auto view = ImageBuffer::CropView(src, {10, 6, 20, 18});
+  assert(view);
+  auto packed = view->PackedCopy(MediaBuffer::MemType::MEM_COMMON);
+  assert(packed);
+  assert(packed->GetWidth() == 20 && packed->GetHeight() == 18);
+  assert(packed->GetVirWidth() == 32 && packed->GetVirHeight() == 32);
+  assert(same_image(*view, *packed));
+  printf("packed copy of view ok\n");
+}
+
+// the cpu filters take the planes of a separate fd
+static void test_cpu_image_of_fd() {
+  ImageInfo info = {PIX_FMT_NV12, 64, 48, 64, 48};
+  FILE *f = tmpfile();
+  assert(f);
+  int fd = fileno(f);
+  const int chroma_size = 64 * 24;
+  assert(ftruncate(fd, chroma_size) == 0);
+  ImagePlane planes[2] = {{0, 64, 64, 48, -1}, {0, 64, 64, 24, fd}};
+  auto src = alloc_image(info, 64 * 48);
+  src->SetPlanes(planes, 2);
+  uint8_t *data[IMAGE_MAX_PLANES];
+  assert(src->GetPlanePtrs(data) == 2);
+  for (int i = 0; i < chroma_size; i++)
+    data[1][i] = (uint8_t)(i * 3);
+  CpuImage img;
+  assert(!easymedia::GetCpuImage(img, src->GetPtr(), info, planes, 2));
+  assert(easymedia::GetCpuImage(img, data, info, planes, 2));
+  assert(img.num == 2 && img.data[1] == data[1] && img.stride[1] == 64);
+  ImageRect rect = {0, 0, 64, 48};
+  std::string param;
+  PARAM_STRING_APPEND(param, KEY_BUFFER_RECT,
+                      easymedia::TwoImageRectToString({rect, rect}));
+  auto filter = easymedia::REFLECTOR(Filter)::Create<easymedia::Filter>(
+      "swblit", param.c_str());
+  assert(filter);
+  auto dst = alloc_image(info, CalPixFmtSize(info));
+  assert(!filter->Process(src, dst));
+  assert(same_image(*src, *dst));
+  src.reset();
+  fclose(f);
+  printf("cpu image of separate fd ok\n");
+}
+
+int main() {
+  test_default_planes();
+  test_set_planes();
+  test_separate_fd();
+  test_packed_copy_of_view();
+  test_cpu_image_of_fd();
+  return 0;
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "buffer.h"
+#include "filter.h"
+#include "image_blit.h"
+#include "image_tensor.h"
+#include "key_string.h"
+
+using easymedia::CpuImage;
+using easymedia::LetterboxTransform;
+using easymedia::TensorLayout;
+using easymedia::TensorSpec;
+using easymedia::TensorType;
+
+struct Image {
+  Image(PixelFormat fmt, int w, int h) : info({fmt, w, h, w, h}) {
+    mem.resize(CalPixFmtSize(info));
+    bool ret = easymedia::GetCpuImage(img, mem.data(), info);
+    assert(ret);
+  }
+  ImageInfo info;
+  std::vector<uint8_t> mem;
+  CpuImage img;
+};
+
+// smooth gradients with some noise, as a camera frame
+static void fill_scene(Image &im) {
+  const CpuImage &img = im.img;
+  for (int y = 0; y < img.height; y++)
+    for (int x = 0; x < img.width; x++)
+      img.data[0][y * img.stride[0] + x] =
+          (uint8_t)(16 + (x * 200 / img.width + y * 20 / img.height) +
+                    rand() % 8);
+  for (int y = 0; y < img.height / 2; y++)
+    for (int x = 0; x < img.width / 2; x++) {
+      uint8_t *uv = img.data[1] + y * img.stride[1] + x * 2;
+      uv[0] = (uint8_t)(64 + y * 128 / (img.height / 2));
+      uv[1] = (uint8_t)(192 - x * 128 / (img.width / 2));
+    }
+}
+
+static TensorSpec float_spec(TensorLayout layout) {
+  TensorSpec spec;
+  spec.width = spec.height = 640;
+  spec.type = TensorType::FLOAT32;
+  spec.layout = layout;
+  for (int c = 0; c < 3; c++) {
+    spec.mean[c] = 127.5f;
+    spec.scale[c] = 1 / 127.5f;
+  }
+  return spec;
+}
+
+// the chained path: convert the frame to rgb, letterbox it into the tensor
+// size, then normalise
+static void chained(float *tensor, const TensorSpec &spec, const Image &src,
+                    Image &rgb, Image &boxed, int threads) {
+  easymedia::ConvertImage(rgb.img, src.img, easymedia::YuvMatrix::BT601_LIMITED,
+                          threads);
+  memset(boxed.mem.data(), 0x72, boxed.mem.size());
+  int h = spec.width * src.img.height / src.img.width;
+  ImageRect r = {0, (spec.height - h) / 2, spec.width, h};
+  easymedia::BlitImage(boxed.img, &r, rgb.img, nullptr, 0,
+                       easymedia::ScaleMode::BILINEAR, threads);
+  size_t plane = spec.width * spec.height;
+  const uint8_t *p = boxed.mem.data();
+  for (size_t i = 0; i < plane; i++, p += 3)
+    for (int c = 0; c < 3; c++)
+      tensor[c * plane + i] = (p[c] - spec.mean[c]) * spec.scale[c];
+}
+
+static void test_against_chained() {
+  Image src(PIX_FMT_NV12, 1920, 1080);
+  fill_scene(src);
+  TensorSpec spec = float_spec(TensorLayout::NCHW);
+  std::vector<float> fused(GetTensorSize(spec) / sizeof(float));
+  std::vector<float> ref(fused.size());
+  LetterboxTransform tf;
+  int ret = easymedia::ImageToTensor(fused.data(), spec, src.img, nullptr, &tf);
+  assert(!ret);
+  assert(tf.dst.x == 0 && tf.dst.w == 640 && tf.dst.h == 360 &&
+         tf.dst.y == 140);
+  Image rgb(PIX_FMT_RGB888, 1920, 1080), boxed(PIX_FMT_RGB888, 640, 640);
+  chained(ref.data(), spec, src, rgb, boxed, 0);
+  double sum = 0, max = 0;
+  for (size_t i = 0; i < fused.size(); i++) {
+    double d = fabs(fused[i] - ref[i]) * 127.5;
+    sum += d;
+    max = std::max(max, d);
+  }
+  // only the rounding and the chroma siting differ
+  printf("fused vs chained: mean diff %.3f, max %.1f levels\n",
+         sum / fused.size(), max);
+  assert(sum / fused.size() < 1.0 && max <= 12);
+}
+
+static void test_exact() {
+  Image src(PIX_FMT_NV12, 320, 480);
+  memset(src.mem.data(), 235, 320 * 480);          // white
+  memset(src.mem.data() + 320 * 480, 128, 320 * 240);
+  TensorSpec spec;
+  spec.width = spec.height = 64;
+  spec.pad_color = 0x102030;
+  spec.type = TensorType::INT8;
+  spec.qnt_zp = -128;
+  std::vector<uint8_t> nhwc(GetTensorSize(spec));
+  LetterboxTransform tf;
+  assert(!easymedia::ImageToTensor(nhwc.data(), spec, src.img, nullptr, &tf));
+  // 2:3 into 64x64 is 43x64 centered
+  assert(tf.dst.x == 10 && tf.dst.w == 43 && tf.dst.h == 64);
+  for (int y = 0; y < 64; y++)
+    for (int x = 0; x < 64; x++) {
+      const int8_t *p = (const int8_t *)&nhwc[(y * 64 + x) * 3];
+      bool in = x >= tf.dst.x && x < tf.dst.x + tf.dst.w;
+      assert(p[0] == (in ? 127 : 0x10 - 128));
+      assert(p[1] == (in ? 127 : 0x20 - 128));
+      assert(p[2] == (in ? 127 : 0x30 - 128));
+    }
+  // the tensor corners of the image map back to its corners
+  float x = tf.dst.x, y = tf.dst.y;
+  tf.ToImage(x, y);
+  assert(fabsf(x) < 0.01f && fabsf(y) < 0.01f);
+  x = tf.dst.x + tf.dst.w;
+  y = tf.dst.y + tf.dst.h;
+  tf.ToImage(x, y);
+  assert(fabsf(x - 320) < 0.01f && fabsf(y - 480) < 0.01f);
+  tf.ToTensor(x, y);
+  assert(fabsf(x - 53) < 0.01f && fabsf(y - 64) < 0.01f);
+
+  // the two layouts and the channel orders hold the same values
+  Image scene(PIX_FMT_NV12, 640, 360);
+  fill_scene(scene);
+  TensorSpec a = float_spec(TensorLayout::NHWC), b = a;
+  b.layout = TensorLayout::NCHW;
+  b.bgr = true;
+  std::vector<float> ta(GetTensorSize(a) / 4), tb(ta.size());
+  assert(!easymedia::ImageToTensor(ta.data(), a, scene.img, nullptr, nullptr,
+                                   easymedia::YuvMatrix::BT601_LIMITED, 1));
+  assert(!easymedia::ImageToTensor(tb.data(), b, scene.img));
+  size_t plane = 640 * 640;
+  for (size_t i = 0; i < plane; i++)
+    for (int c = 0; c < 3; c++)
+      assert(ta[i * 3 + c] == tb[(2 - c) * plane + i]);
+  // a crop of the center, stretched
+  ImageRect crop = {161, 90, 320, 180};
+  a.letterbox = false;
+  assert(!easymedia::ImageToTensor(ta.data(), a, scene.img, &crop, &tf));
+  assert(tf.src.x == 160 && tf.dst.w == 640 && tf.dst.h == 640);
+  Image small(PIX_FMT_YUYV422, 64, 64);
+  assert(easymedia::ImageToTensor(ta.data(), a, small.img) == -EINVAL);
+  printf("exact ok\n");
+}
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// 1080p nv12 into a 640x640 float nchw tensor, as yolo takes
+static void bench() {
+  const int loops = 10;
+  Image src(PIX_FMT_NV12, 1920, 1080);
+  fill_scene(src);
+  TensorSpec spec = float_spec(TensorLayout::NCHW);
+  std::vector<float> tensor(GetTensorSize(spec) / sizeof(float));
+  Image rgb(PIX_FMT_RGB888, 1920, 1080), boxed(PIX_FMT_RGB888, 640, 640);
+  for (int threads : {1, 0}) {
+    auto start = std::chrono::steady_clock::now();
+    for (int l = 0; l < loops; l++)
+      easymedia::ImageToTensor(tensor.data(), spec, src.img, nullptr, nullptr,
+                               easymedia::YuvMatrix::BT601_LIMITED, threads);
+    double fused = ms_since(start) / loops;
+    start = std::chrono::steady_clock::now();
+    for (int l = 0; l < loops; l++)
+      chained(tensor.data(), spec, src, rgb, boxed, threads);
+    double chain = ms_since(start) / loops;
+    printf("1080p nv12 -> 640x640 float nchw, %s threads: fused %.2f ms, "
+           "chained %.2f ms\n",
+           threads ? "1" : "auto", fused, chain);
+  }
+  spec.type = TensorType::UINT8;
+  spec.layout = TensorLayout::NHWC;
+  auto start = std::chrono::steady_clock::now();
+  for (int l = 0; l < loops; l++)
+    easymedia::ImageToTensor(tensor.data(), spec, src.img, nullptr, nullptr,
+                             easymedia::YuvMatrix::BT601_LIMITED, 1);
+  printf("1080p nv12 -> 640x640 uint8 nhwc, 1 thread: fused %.2f ms\n",
+         ms_since(start) / loops);
+}
+
+static void test_filter() {
+  std::string param;
+  PARAM_STRING_APPEND_TO(param, KEY_BUFFER_WIDTH, 320);
+  PARAM_STRING_APPEND_TO(param, KEY_BUFFER_HEIGHT, 320);
+  PARAM_STRING_APPEND(param, KEY_TENSOR_TYPE, NN_FLOAT32);
+  PARAM_STRING_APPEND(param, KEY_TENSOR_FMT, KEY_NCHW);
+  PARAM_STRING_APPEND(param, KEY_TENSOR_MEAN, "123.675,116.28,103.53");
+  PARAM_STRING_APPEND(param, KEY_TENSOR_SCALE, "0.01712,0.01751,0.01743");
+  auto filter = easymedia::REFLECTOR(Filter)::Create<easymedia::Filter>(
+      "nnpreprocess", param.c_str());
+  assert(filter);
+  ImageInfo info = {PIX_FMT_NV12, 640, 480, 640, 480};
+  auto mb = easymedia::MediaBuffer::Alloc2(CalPixFmtSize(info));
+  auto in = std::make_shared<easymedia::ImageBuffer>(mb, info);
+  memset(in->GetPtr(), 128, in->GetValidSize());
+  in->SetTimeStamp(42);
+  auto out = std::make_shared<easymedia::MediaBuffer>();
+  assert(!filter->Process(in, out));
+  assert(out->GetType() == Type::Tensor && out->GetTimeStamp() == 42);
+  assert(out->GetValidSize() == 320 * 320 * 3 * sizeof(float));
+  auto meta = easymedia::GetTensorMeta(*out);
+  assert(meta && meta->transform.dst.h == 240 && meta->transform.dst.y == 40);
+  assert(meta->memory->GetPtr() == out->GetPtr());
+  assert(!easymedia::GetTensorMeta(*in));
+  std::string bad_param;
+  PARAM_STRING_APPEND_TO(bad_param, KEY_BUFFER_WIDTH, 320);
+  PARAM_STRING_APPEND_TO(bad_param, KEY_BUFFER_HEIGHT, 320);
+  PARAM_STRING_APPEND(bad_param, KEY_TENSOR_TYPE, NN_INT16);
+  auto bad = easymedia::REFLECTOR(Filter)::Create<easymedia::Filter>(
+      "nnpreprocess", bad_param.c_str());
+  assert(!bad);
+  printf("filter ok\n");
+}
+
+int main() {
+  test_against_chained();
+  test_exact();
+  bench();
+  test_filter();
+  return 0;
+}
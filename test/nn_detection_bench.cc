@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include "nn_detection.h"
+
+using easymedia::ConvertImpl;
+using easymedia::DetectionBox;
+using easymedia::NNTensorAttr;
+using easymedia::TensorType;
+
+// ms per call, repeated for some time at least
+static double run(const std::function<void()> &f) {
+  int loop = 0;
+  double ms = 0;
+  auto start = std::chrono::steady_clock::now();
+  do {
+    f();
+    loop++;
+    ms = std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+             .count();
+  } while (ms < 200 && loop < 5000);
+  return ms / loop;
+}
+
+static NNTensorAttr int8_attr(std::vector<uint32_t> dims, float scale,
+                              int32_t zp) {
+  NNTensorAttr a;
+  a.index = 0;
+  a.dims = dims;
+  a.n_elems = 1;
+  for (uint32_t d : dims)
+    a.n_elems *= d;
+  a.size = a.n_elems;
+  a.type = TensorType::INT8;
+  a.layout = easymedia::TensorLayout::NCHW;
+  a.scale = scale;
+  a.zp = zp;
+  return a;
+}
+
+// the usual one: sort, then each kept box removes the later ones by the iou
+static void naive_nms(std::vector<DetectionBox> &boxes, float t,
+                      int max_num) {
+  std::stable_sort(boxes.begin(), boxes.end(),
+                   [](const DetectionBox &a, const DetectionBox &b) {
+                     return a.score > b.score;
+                   });
+  std::vector<bool> removed(boxes.size(), false);
+  std::vector<DetectionBox> kept;
+  for (size_t i = 0; i < boxes.size() && (int)kept.size() < max_num; i++) {
+    if (removed[i])
+      continue;
+    const DetectionBox &a = boxes[i];
+    kept.push_back(a);
+    float area_a = (a.x1 - a.x0) * (a.y1 - a.y0);
+    for (size_t j = i + 1; j < boxes.size(); j++) {
+      const DetectionBox &b = boxes[j];
+      if (removed[j] || a.cls != b.cls)
+        continue;
+      float w = std::min(a.x1, b.x1) - std::max(a.x0, b.x0);
+      float h = std::min(a.y1, b.y1) - std::max(a.y0, b.y0);
+      float inter = std::max(w, 0.0f) * std::max(h, 0.0f);
+      float area_b = (b.x1 - b.x0) * (b.y1 - b.y0);
+      if (inter / (area_a + area_b - inter) > t)
+        removed[j] = true;
+    }
+  }
+  boxes.swap(kept);
+}
+
+// the candidates of a crowded 640x640 frame: 200 objects of 3 classes, many
+// boxes each
+static std::vector<DetectionBox> candidates(int n) {
+  std::vector<DetectionBox> boxes;
+  srand(n);
+  for (int i = 0; i < n; i++) {
+    int obj = rand() % 200;
+    float cx = obj % 20 * 32.0f + rand() % 7, cy = obj / 20 * 64.0f;
+    float w = 24 + rand() % 9, h = 48 + rand() % 9;
+    DetectionBox b = {cx - w / 2, cy - h / 2, cx + w / 2, cy + h / 2,
+                      (float)rand() / RAND_MAX, obj % 3};
+    boxes.push_back(b);
+  }
+  return boxes;
+}
+
+// The nms of 1k to 10k candidates against the naive one, keeping 100, and
+// the decoding of the int8 heads of yolov5s and yolov8s of 640x640, of the
+// scalar and the vector kernels.
+int main() {
+  ConvertImpl simd = easymedia::IsConvertImplSupported(ConvertImpl::SSE2)
+                         ? ConvertImpl::SSE2
+                         : ConvertImpl::NEON;
+  bool has_simd = easymedia::IsConvertImplSupported(simd);
+  const char *simd_name = easymedia::ConvertImplToString(simd);
+  std::vector<DetectionBox> boxes;
+  printf("nms, iou 0.45, at most 100\n");
+  printf("%-12s %12s %12s %12s\n", "candidates", "naive", "scalar",
+         has_simd ? simd_name : "-");
+  for (int n : {1000, 3000, 10000}) {
+    auto src = candidates(n);
+    double naive = run([&]() {
+      boxes = src;
+      naive_nms(boxes, 0.45f, 100);
+    });
+    printf("%-12d %10.3fms", n, naive);
+    for (int i = 0; i < (has_simd ? 2 : 1); i++) {
+      easymedia::SetConvertImpl(i ? simd : ConvertImpl::SCALAR);
+      double ms = run([&]() {
+        boxes = src;
+        easymedia::NMSBoxes(boxes, 0.45f, 100);
+      });
+      printf(" %10.3fms", ms);
+    }
+    printf("\n");
+  }
+
+  // the objectness and the scores are low but at some objects
+  const float scale = 0.1f;
+  const int zp = -50;
+  std::vector<NNTensorAttr> v5;
+  std::vector<std::vector<int8_t>> v5_data;
+  for (int s : {80, 40, 20}) {
+    v5.push_back(int8_attr({1, 255, (uint32_t)s, (uint32_t)s}, scale, zp));
+    std::vector<int8_t> d(v5.back().n_elems);
+    srand(s);
+    for (auto &x : d)
+      x = (int8_t)(-128 + rand() % 40);
+    for (int k = 0; k < s * s * 3 / 100; k++) {
+      int a = rand() % 3, idx = rand() % (s * s);
+      for (int c = 0; c < 85; c++)
+        d[(a * 85 + c) * s * s + idx] = (int8_t)(rand() % 100);
+    }
+    v5_data.push_back(d);
+  }
+  const float anchors[18] = {10, 13,  16,  30,  33, 23,  30,  61,  62,
+                             45, 59,  119, 116, 90, 156, 198, 373, 326};
+  NNTensorAttr v8 = int8_attr({1, 84, 8400}, 1 / 255.0f, -128);
+  std::vector<int8_t> v8_data(v8.n_elems);
+  srand(8);
+  for (size_t i = 0; i < v8_data.size(); i++)
+    v8_data[i] = (int8_t)(i < 4 * 8400 ? rand() : -128 + rand() % 20);
+  for (int k = 0; k < 100; k++)
+    v8_data[(4 + rand() % 80) * 8400 + rand() % 8400] = 100;
+
+  printf("decoding, int8, score 0.25\n");
+  printf("%-12s %12s %12s %12s\n", "head", "candidates", "scalar",
+         has_simd ? simd_name : "-");
+  for (int head = 0; head < 2; head++) {
+    double ms[2] = {0, 0};
+    for (int i = 0; i < (has_simd ? 2 : 1); i++) {
+      easymedia::SetConvertImpl(i ? simd : ConvertImpl::SCALAR);
+      ms[i] = run([&]() {
+        boxes.clear();
+        if (head == 0) {
+          for (size_t k = 0; k < v5.size(); k++)
+            easymedia::DecodeYoloV5(v5_data[k].data(), v5[k], 8 << k,
+                                    &anchors[k * 6], 0.25f, true, boxes);
+        } else {
+          easymedia::DecodeYoloV8(v8_data.data(), v8, 0.25f, boxes);
+        }
+      });
+    }
+    printf("%-12s %12d %10.3fms", head ? "yolov8s" : "yolov5s",
+           (int)boxes.size(), ms[0]);
+    if (has_simd)
+      printf(" %10.3fms", ms[1]);
+    printf("\n");
+  }
+  easymedia::SetConvertImpl(ConvertImpl::AUTO);
+  return 0;
+}
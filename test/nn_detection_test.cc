@@ -0,0 +1,375 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+// Check the decoding of the yolov5 and yolov8 heads against the formulas, of
+// float32 and quantised tensors; the vector kernels against the scalar ones;
+// the nms against a naive one; and the nnpostprocess filter on the output of
+// a letterboxed tensor.
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "filter.h"
+#include "image_tensor.h"
+#include "key_string.h"
+#include "nn_backend.h"
+#include "nn_detection.h"
+
+using easymedia::ConvertImpl;
+using easymedia::DetectionBox;
+using easymedia::MediaBuffer;
+using easymedia::NNDetection;
+using easymedia::NNTensorAttr;
+using easymedia::TensorType;
+
+static const float kAnchors[6] = {10, 13, 16, 30, 33, 23};
+
+static NNTensorAttr make_attr(std::vector<uint32_t> dims, TensorType type,
+                              float scale = 1.0f, int32_t zp = 0) {
+  NNTensorAttr a;
+  a.index = 0;
+  a.dims = dims;
+  a.n_elems = 1;
+  for (uint32_t d : dims)
+    a.n_elems *= d;
+  a.type = type;
+  a.size = a.n_elems * easymedia::GetTensorTypeSize(type);
+  a.layout = easymedia::TensorLayout::NCHW;
+  a.scale = scale;
+  a.zp = zp;
+  return a;
+}
+
+// the float values quantised by the attr
+static std::vector<uint8_t> quantise(const std::vector<float> &v,
+                                     const NNTensorAttr &a) {
+  std::vector<uint8_t> q(v.size());
+  int lo = a.type == TensorType::UINT8 ? 0 : -128;
+  for (size_t i = 0; i < v.size(); i++) {
+    int x = (int)lroundf(v[i] / a.scale) + a.zp;
+    q[i] = (uint8_t)std::min(std::max(x, lo), lo + 255);
+  }
+  return q;
+}
+
+static float sigmoid(float x) { return 1.0f / (1.0f + expf(-x)); }
+
+static bool near(float a, float b, float tol) { return fabsf(a - b) <= tol; }
+
+static bool same_boxes(const std::vector<DetectionBox> &a,
+                       const std::vector<DetectionBox> &b) {
+  return a.size() == b.size() &&
+         (a.empty() || !memcmp(a.data(), b.data(), a.size() * sizeof(a[0])));
+}
+
+// [1, 3 * (5 + 3), 4, 5] logits, all far under any threshold but two
+static void test_yolov5() {
+  const int C = 8, h = 4, w = 5, plane = h * w;
+  std::vector<float> v(3 * C * plane, -8.0f);
+  // anchor 1 at (x 3, y 2), class 2; anchor 2 at (x 0, y 0), class 0
+  float *p = &v[1 * C * plane + 2 * w + 3];
+  float obj = 2.0f, tx = 0.5f, ty = -0.5f, tw = 0.2f, th = -0.3f;
+  p[0] = tx, p[plane] = ty, p[2 * plane] = tw, p[3 * plane] = th;
+  p[4 * plane] = obj, p[5 * plane] = -1, p[6 * plane] = 0, p[7 * plane] = 1;
+  p = &v[2 * C * plane];
+  p[4 * plane] = 3.0f, p[5 * plane] = 4.0f, p[6 * plane] = 0;
+  p[7 * plane] = 0;
+  const int stride = 16;
+  float score = sigmoid(obj) * sigmoid(1);
+  float cx = (sigmoid(tx) * 2 - 0.5f + 3) * stride;
+  float cy = (sigmoid(ty) * 2 - 0.5f + 2) * stride;
+  float bw = powf(sigmoid(tw) * 2, 2) * kAnchors[2];
+  float bh = powf(sigmoid(th) * 2, 2) * kAnchors[3];
+
+  NNTensorAttr f = make_attr({1, 3 * C, h, w}, TensorType::FLOAT32);
+  NNTensorAttr u = make_attr({1, 3 * C, h, w}, TensorType::UINT8, 0.05f, 160);
+  NNTensorAttr s = make_attr({1, 3 * C, h, w}, TensorType::INT8, 0.05f, 0);
+  auto qu = quantise(v, u), qs = quantise(v, s);
+  const void *data[] = {v.data(), qu.data(), qs.data()};
+  const NNTensorAttr *attrs[] = {&f, &u, &s};
+  for (int t = 0; t < 3; t++) {
+    std::vector<DetectionBox> boxes;
+    int n = easymedia::DecodeYoloV5(data[t], *attrs[t], stride, kAnchors, 0.5f,
+                                    true, boxes);
+    assert(n == 2 && boxes.size() == 2);
+    float tol = t ? 0.5f : 1e-3f;
+    const DetectionBox &b = boxes[0];
+    assert(b.cls == 2 && near(b.score, score, t ? 0.02f : 1e-5f));
+    assert(near(b.x0, cx - bw / 2, tol) && near(b.x1, cx + bw / 2, tol));
+    assert(near(b.y0, cy - bh / 2, tol) && near(b.y1, cy + bh / 2, tol));
+    assert(boxes[1].cls == 0);
+    // the one of anchor 1 only
+    boxes.clear();
+    n = easymedia::DecodeYoloV5(data[t], *attrs[t], stride, kAnchors, 0.8f,
+                                true, boxes);
+    assert(n == 1 && boxes[0].cls == 0);
+  }
+  std::vector<DetectionBox> boxes;
+  NNTensorAttr bad = make_attr({1, 3 * C + 1, h, w}, TensorType::FLOAT32);
+  assert(easymedia::DecodeYoloV5(v.data(), bad, stride, kAnchors, 0.5f, true,
+                                 boxes) < 0);
+  printf("yolov5 ok\n");
+}
+
+// [1, 4 + 3, 37] of the scores after the sigmoid, the tail is not of a
+// whole vector. The boxes are small to share the scale with the scores.
+static void test_yolov8() {
+  const int n = 37;
+  std::vector<float> v(7 * n, 0.0f);
+  for (int j = 0; j < n; j++) {
+    v[j] = 0.1f * j, v[n + j] = 0.05f * j;
+    v[2 * n + j] = 0.5f, v[3 * n + j] = 0.25f;
+    for (int c = 0; c < 3; c++)
+      v[(4 + c) * n + j] = 0.01f * ((j + c) % 5);
+  }
+  v[(4 + 1) * n + 36] = 0.9f;
+  v[(4 + 2) * n + 17] = 0.6f;
+  NNTensorAttr f = make_attr({1, 7, n}, TensorType::FLOAT32);
+  NNTensorAttr u = make_attr({1, 7, n}, TensorType::UINT8, 1 / 64.0f, 0);
+  NNTensorAttr s = make_attr({1, 7, n}, TensorType::INT8, 1 / 64.0f, -128);
+  auto qu = quantise(v, u), qs = quantise(v, s);
+  const void *data[] = {v.data(), qu.data(), qs.data()};
+  const NNTensorAttr *attrs[] = {&f, &u, &s};
+  for (int t = 0; t < 3; t++) {
+    std::vector<DetectionBox> boxes;
+    int ret = easymedia::DecodeYoloV8(data[t], *attrs[t], 0.5f, boxes);
+    assert(ret == 2);
+    float tol = t ? 1 / 64.0f : 1e-5f;
+    assert(boxes[0].cls == 2 && near(boxes[0].score, 0.6f, tol));
+    assert(boxes[1].cls == 1 && near(boxes[1].score, 0.9f, tol));
+    assert(near(boxes[1].x0, 3.35f, tol) && near(boxes[1].y1, 1.925f, tol));
+  }
+  printf("yolov8 ok\n");
+}
+
+static std::vector<float> random_floats(size_t n, float lo, float hi,
+                                        int seed) {
+  std::vector<float> v(n);
+  srand(seed);
+  for (auto &x : v)
+    x = lo + (hi - lo) * rand() / RAND_MAX;
+  return v;
+}
+
+static std::vector<uint8_t> random_bytes(size_t n, int seed) {
+  std::vector<uint8_t> v(n);
+  srand(seed);
+  for (auto &x : v)
+    x = (uint8_t)rand();
+  return v;
+}
+
+// the same candidates by the scalar and the vector kernels, of the dense
+// and the sparse scores, as the scans only pick which ones to decode
+static void test_impls() {
+  ConvertImpl simd = easymedia::IsConvertImplSupported(ConvertImpl::SSE2)
+                         ? ConvertImpl::SSE2
+                         : ConvertImpl::NEON;
+  if (!easymedia::IsConvertImplSupported(simd)) {
+    printf("impls skipped, no simd\n");
+    return;
+  }
+  const TensorType types[] = {TensorType::UINT8, TensorType::INT8,
+                              TensorType::FLOAT32};
+  for (TensorType type : types) {
+    for (float thr : {0.25f, 0.6f, 0.95f}) {
+      NNTensorAttr v5 = make_attr({1, 3 * 12, 20, 21}, type, 0.06f, 3);
+      NNTensorAttr v8 = make_attr({1, 4 + 7, 333}, type, 1 / 200.0f, -100);
+      auto b5 = random_bytes(v5.size, 5);
+      auto b8 = random_bytes(v8.size, 8);
+      if (type == TensorType::FLOAT32) {
+        auto f5 = random_floats(v5.n_elems, -6, 6, 5);
+        auto f8 = random_floats(v8.n_elems, 0, 1, 8);
+        memcpy(b5.data(), f5.data(), v5.size);
+        memcpy(b8.data(), f8.data(), v8.size);
+      }
+      std::vector<DetectionBox> boxes[2][2];
+      for (int i = 0; i < 2; i++) {
+        easymedia::SetConvertImpl(i ? simd : ConvertImpl::SCALAR);
+        int ret = easymedia::DecodeYoloV5(b5.data(), v5, 8, kAnchors, thr,
+                                          true, boxes[i][0]);
+        assert(ret >= 0);
+        ret = easymedia::DecodeYoloV8(b8.data(), v8, thr, boxes[i][1]);
+        assert(ret >= 0);
+      }
+      assert(same_boxes(boxes[0][0], boxes[1][0]));
+      assert(same_boxes(boxes[0][1], boxes[1][1]));
+      for (auto &b : boxes[0][1])
+        assert(b.score >= thr);
+    }
+  }
+  easymedia::SetConvertImpl(ConvertImpl::AUTO);
+  printf("impls ok\n");
+}
+
+static bool suppresses(const DetectionBox &a, const DetectionBox &b,
+                       float t) {
+  if (a.cls != b.cls)
+    return false;
+  float w = std::min(a.x1, b.x1) - std::max(a.x0, b.x0);
+  float h = std::min(a.y1, b.y1) - std::max(a.y0, b.y0);
+  float inter = std::max(w, 0.0f) * std::max(h, 0.0f);
+  float area_a = (a.x1 - a.x0) * (a.y1 - a.y0);
+  float area_b = (b.x1 - b.x0) * (b.y1 - b.y0);
+  return inter > t * ((area_a + area_b) - inter);
+}
+
+// each box suppresses all the later ones, as the common implementations
+static std::vector<DetectionBox> naive_nms(std::vector<DetectionBox> boxes,
+                                           float t, int max_num) {
+  std::stable_sort(boxes.begin(), boxes.end(),
+                   [](const DetectionBox &a, const DetectionBox &b) {
+                     return a.score > b.score;
+                   });
+  std::vector<bool> removed(boxes.size(), false);
+  std::vector<DetectionBox> kept;
+  for (size_t i = 0; i < boxes.size(); i++) {
+    if (removed[i])
+      continue;
+    kept.push_back(boxes[i]);
+    if (max_num > 0 && (int)kept.size() == max_num)
+      break;
+    for (size_t j = i + 1; j < boxes.size(); j++)
+      if (!removed[j] && suppresses(boxes[i], boxes[j], t))
+        removed[j] = true;
+  }
+  return kept;
+}
+
+// clusters of boxes around some objects, the scores of ties too
+static std::vector<DetectionBox> clusters(int n, int seed) {
+  std::vector<DetectionBox> boxes;
+  srand(seed);
+  for (int i = 0; i < n; i++) {
+    int obj = rand() % 40;
+    float cx = obj * 15.0f + rand() % 9, cy = (obj % 7) * 80.0f + rand() % 9;
+    float w = 30 + obj % 5 * 10 + rand() % 7, h = 40 + rand() % 11;
+    DetectionBox b = {cx - w / 2, cy - h / 2, cx + w / 2, cy + h / 2,
+                      (rand() % 100) / 100.0f, obj % 3};
+    boxes.push_back(b);
+  }
+  return boxes;
+}
+
+static void test_nms() {
+  ConvertImpl impls[] = {ConvertImpl::SCALAR, ConvertImpl::AUTO};
+  for (ConvertImpl impl : impls) {
+    easymedia::SetConvertImpl(impl);
+    for (int n : {0, 1, 7, 300, 3000}) {
+      for (int max_num : {0, 1, 5, 100}) {
+        for (float t : {0.3f, 0.45f, 0.7f}) {
+          auto boxes = clusters(n, n + max_num);
+          auto ref = naive_nms(boxes, t, max_num);
+          easymedia::NMSBoxes(boxes, t, max_num);
+          assert(same_boxes(boxes, ref));
+          assert(max_num == 0 || (int)boxes.size() <= max_num);
+        }
+      }
+    }
+  }
+  easymedia::SetConvertImpl(ConvertImpl::AUTO);
+  printf("nms ok\n");
+}
+
+// A 64x64 letterboxed tensor of a 128x64 frame, one class of yolov8: two
+// overlapping candidates and a far one.
+static void test_filter() {
+  ImageInfo info = {PIX_FMT_RGB888, 128, 64, 128, 64};
+  auto frame = std::make_shared<easymedia::ImageBuffer>(
+      MediaBuffer::Alloc2(CalPixFmtSize(info)), info);
+  auto tensor = std::make_shared<MediaBuffer>();
+  auto tmeta = std::make_shared<easymedia::TensorMeta>();
+  tmeta->spec.width = tmeta->spec.height = 64;
+  tmeta->transform.src = {0, 0, 128, 64};
+  tmeta->transform.dst = {0, 16, 64, 32};
+  tmeta->transform.scale_x = tmeta->transform.scale_y = 0.5f;
+  tensor->SetUserData(tmeta);
+  tensor->SetType(Type::Tensor);
+  tensor->SetRelatedSPtr(frame, 0);
+
+  const int n = 16;
+  std::vector<float> v(5 * n, 0.0f);
+  const float cands[3][5] = {
+      {32, 32, 20, 10, 0.9f}, {33, 32, 20, 10, 0.8f}, {10, 20, 4, 4, 0.7f}};
+  for (int i = 0; i < 3; i++)
+    for (int k = 0; k < 5; k++)
+      v[k * n + 3 + i] = cands[i][k];
+  auto result = std::make_shared<easymedia::NNResultMeta>();
+  easymedia::NNOutput o;
+  memset(&o, 0, sizeof(o));
+  o.buf = v.data();
+  o.size = v.size() * sizeof(float);
+  result->outputs.push_back(o);
+  result->attrs.push_back(make_attr({1, 5, n}, TensorType::FLOAT32));
+  auto in = std::make_shared<MediaBuffer>(result->outputs.data(),
+                                          sizeof(easymedia::NNOutput));
+  in->SetUserData(result);
+  in->SetType(Type::NNResult);
+  in->SetValidSize(1);
+  in->SetTimeStamp(77);
+  in->SetRelatedSPtr(tensor, 0);
+
+  for (int max_num : {100, 1}) {
+    std::string param;
+    PARAM_STRING_APPEND(param, KEY_NN_HEAD, KEY_YOLOV8);
+    PARAM_STRING_APPEND_TO(param, KEY_NN_MAX_DETECTIONS, max_num);
+    auto filter = easymedia::REFLECTOR(Filter)::Create<easymedia::Filter>(
+        "nnpostprocess", param.c_str());
+    assert(filter);
+    auto out = std::make_shared<MediaBuffer>();
+    int ret = filter->Process(in, out);
+    assert(!ret);
+    int num = 0;
+    const NNDetection *d = easymedia::GetDetections(*out, num);
+    assert(d && num == std::min(max_num, 2));
+    assert(out->GetTimeStamp() == 77 && out->GetRelatedSPtrs()[0] == frame);
+    assert(d[0].box.x == 44 && d[0].box.y == 22 && d[0].box.w == 40 &&
+           d[0].box.h == 20 && d[0].score == 0.9f);
+    if (num > 1)
+      assert(d[1].box.x == 16 && d[1].box.y == 4 && d[1].box.w == 8 &&
+             d[1].box.h == 8);
+  }
+  printf("filter ok\n");
+}
+
+int main() {
+  test_yolov5();
+  test_yolov8();
+  test_impls();
+  test_nms();
+  test_filter();
+  return 0;
+}
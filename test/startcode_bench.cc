@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "startcode.h"
+
+using easymedia::StartCodeImpl;
+using easymedia::StartCodePos;
+
+static const StartCodeImpl impls[] = {StartCodeImpl::SCALAR,
+                                      StartCodeImpl::SSE2, StartCodeImpl::AVX2,
+                                      StartCodeImpl::NEON};
+
+// An idr frame like access unit: aud, sps, pps, sei and some big slices of
+// random payload, emulation prevention applied as an encoder does.
+static std::vector<uint8_t> make_frame(size_t size, int slices) {
+  static const uint8_t header[] = {
+      0, 0, 0, 1, 0x09, 0x10,                        // aud
+      0, 0, 0, 1, 0x67, 0x64, 0x00, 0x33, 0xac, 0x2c, // sps
+      0, 0, 0, 1, 0x68, 0xee, 0x3c, 0xb0,             // pps
+      0, 0, 1,    0x06, 0x05, 0x10, 0xaa, 0x80};      // sei
+  std::vector<uint8_t> frame(header, header + sizeof(header));
+  size_t slice_size = size / slices;
+  for (int s = 0; s < slices; s++) {
+    const uint8_t start[] = {0, 0, 1, 0x65, 0x88};
+    frame.insert(frame.end(), start, start + sizeof(start));
+    int zeros = 0;
+    for (size_t i = 0; i < slice_size; i++) {
+      // cabac payload has rather more zero bytes than uniform random
+      uint8_t b = (rand() % 64) ? (uint8_t)rand() : 0;
+      if (zeros >= 2 && b <= 3) {
+        frame.push_back(3);
+        zeros = 0;
+      }
+      frame.push_back(b);
+      zeros = b ? 0 : zeros + 1;
+    }
+    frame.push_back(0x80); // rbsp trailing bits
+  }
+  return frame;
+}
+
+static void bench(const std::vector<uint8_t> &frame, const char *name) {
+  const int loop = 50;
+  for (StartCodeImpl impl : impls) {
+    if (!easymedia::SetStartCodeImpl(impl))
+      continue;
+    std::vector<StartCodePos> pos;
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < loop; i++) {
+      pos.clear();
+      found += easymedia::FindAllStartCodes(frame.data(), frame.size(), pos);
+    }
+    double all_ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    // the old way, one call per nal unit
+    const uint8_t *end = frame.data() + frame.size();
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < loop; i++) {
+      const uint8_t *p = frame.data();
+      while ((p = easymedia::FindStartCode(p, end)) < end)
+        p += 3;
+    }
+    double one_ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    printf("%s %-7s: %zu nal, find all %.2f GB/s, one by one %.2f GB/s\n",
+           name, easymedia::StartCodeImplToString(impl), found / loop,
+           frame.size() * loop / (all_ms / 1000) / 1e9,
+           frame.size() * loop / (one_ms / 1000) / 1e9);
+  }
+}
+
+int main(int argc, char **argv) {
+  int mb = argc > 1 ? atoi(argv[1]) : 4;
+  if (mb <= 0)
+    mb = 4;
+  srand(1);
+  bench(make_frame(mb * 1024 * 1024, 8), "4k idr");
+  bench(make_frame(64 * 1024, 1), "p frame");
+  return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2019 Hertz Wang 1989wanghang@163.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see http://www.gnu.org/licenses
+ *
+ * Any non-GPL usage of this software or parts of this software is strictly
+ * forbidden.
+ *
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+#ifndef DEBUG
+#define DEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "startcode.h"
+
+using easymedia::StartCodeImpl;
+using easymedia::StartCodePos;
+
+static const StartCodeImpl impls[] = {StartCodeImpl::SSE2, StartCodeImpl::AVX2,
+                                      StartCodeImpl::NEON};
+
+// the obvious byte by byte one
+static void find_all_ref(const uint8_t *data, size_t size,
+                         std::vector<StartCodePos> &pos) {
+  for (size_t i = 0; i + 2 < size; i++) {
+    if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+      if (i > 0 && data[i - 1] == 0)
+        pos.push_back({i - 1, 4});
+      else
+        pos.push_back({i, 3});
+    }
+  }
+}
+
+// mostly 0 and 1, so that start codes and near misses are everywhere
+static void fill_random(std::vector<uint8_t> &buf, int zero_percent) {
+  for (size_t i = 0; i < buf.size(); i++) {
+    int r = rand() % 100;
+    if (r < zero_percent)
+      buf[i] = 0;
+    else if (r < zero_percent + 10)
+      buf[i] = 1;
+    else
+      buf[i] = (uint8_t)rand();
+  }
+}
+
+static void check(const uint8_t *data, size_t size, StartCodeImpl impl) {
+  std::vector<StartCodePos> ref, pos;
+  find_all_ref(data, size, ref);
+  assert(easymedia::FindAllStartCodes(data, size, pos) == ref.size());
+  for (size_t i = 0; i < ref.size(); i++) {
+    if (pos[i].offset != ref[i].offset || pos[i].size != ref[i].size) {
+      fprintf(stderr, "%s: mismatch at #%zu, %zu/%zu vs %zu/%zu, size %zu\n",
+              easymedia::StartCodeImplToString(impl), i, pos[i].offset,
+              pos[i].size, ref[i].offset, ref[i].size, size);
+      exit(EXIT_FAILURE);
+    }
+  }
+  // the first one alone
+  const uint8_t *first = easymedia::FindStartCode(data, data + size);
+  size_t expect = size;
+  if (!ref.empty())
+    expect = ref[0].offset + ref[0].size - 3;
+  assert((size_t)(first - data) == expect);
+}
+
+int main() {
+  srand(1);
+  std::vector<uint8_t> buf(4096 + 64);
+  int tested = 0;
+  for (StartCodeImpl impl : impls) {
+    if (!easymedia::SetStartCodeImpl(impl)) {
+      printf("%s: not supported, skip\n",
+             easymedia::StartCodeImplToString(impl));
+      continue;
+    }
+    for (int round = 0; round < 20000; round++) {
+      fill_random(buf, round % 60);
+      size_t offset = rand() % 64;
+      size_t size = rand() % (buf.size() - offset);
+      check(buf.data() + offset, size, impl);
+      assert(easymedia::SetStartCodeImpl(StartCodeImpl::SCALAR));
+      check(buf.data() + offset, size, StartCodeImpl::SCALAR);
+      assert(easymedia::SetStartCodeImpl(impl));
+    }
+    // no start code, and all zero
+    for (uint8_t v : {0x55, 0x00}) {
+      memset(buf.data(), v, buf.size());
+      for (size_t size = 0; size < 200; size++)
+        check(buf.data() + 1, size, impl);
+    }
+    printf("%s: ok\n", easymedia::StartCodeImplToString(impl));
+    tested++;
+  }
+  printf("%d simd implementations checked against scalar\n", tested);
+  return 0;
+}